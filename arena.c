@@ -0,0 +1,87 @@
+#include <stdlib.h>
+#include <stdalign.h>
+
+#include "arena.h"
+
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+static ArenaBlock* block_new(size_t size);
+
+Arena arena_init(void) {
+    return (Arena) {
+        .head = NULL,
+    };
+}
+
+void arena_deinit(Arena* arena) {
+    ArenaBlock* block = arena->head;
+
+    while (block != NULL) {
+        ArenaBlock* next = block->next;
+        free(block);
+        block = next;
+    }
+
+    arena->head = NULL;
+}
+
+void arena_reset(Arena* arena) {
+    ArenaBlock* largest = NULL;
+    ArenaBlock* block = arena->head;
+
+    while (block != NULL) {
+        ArenaBlock* next = block->next;
+
+        if (largest == NULL || block->size > largest->size) {
+            free(largest);
+            largest = block;
+        } else {
+            free(block);
+        }
+
+        block = next;
+    }
+
+    if (largest != NULL) {
+        largest->next = NULL;
+        largest->used = 0;
+    }
+
+    arena->head = largest;
+}
+
+void* arena_alloc(Arena* arena, size_t size) {
+    size_t align = alignof(max_align_t);
+    size = (size + align - 1) & ~(align - 1);
+
+    ArenaBlock* block = arena->head;
+
+    if (block == NULL || block->size - block->used < size) {
+        block = block_new(size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE);
+        if (block == NULL)
+            return NULL;
+
+        block->next = arena->head;
+        arena->head = block;
+    }
+
+    void* ptr = block->data + block->used;
+    block->used += size;
+
+    return ptr;
+}
+
+static ArenaBlock* block_new(size_t size) {
+    size_t header = (sizeof(ArenaBlock) + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1);
+
+    ArenaBlock* block = malloc(header + size);
+    if (block == NULL)
+        return NULL;
+
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+    block->data = (char*)block + header;
+
+    return block;
+}
@@ -0,0 +1,28 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+typedef struct ArenaBlock_t {
+    struct ArenaBlock_t* next;
+    size_t size;
+    size_t used;
+    char* data;
+} ArenaBlock;
+
+/* a bump allocator. everything allocated from an arena is released at once
+ * by arena_reset or arena_deinit, never individually. */
+typedef struct Arena_t {
+    ArenaBlock* head;
+} Arena;
+
+Arena arena_init(void);
+void arena_deinit(Arena* arena);
+
+/* keeps the largest block around so a reused arena stops calling malloc. */
+void arena_reset(Arena* arena);
+
+/* returns NULL when out of memory. */
+void* arena_alloc(Arena* arena, size_t size);
+
+#endif /* ARENA_H */
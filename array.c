@@ -0,0 +1,602 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "array.h"
+
+/* x86-64 always has sse2, avx2 is checked for at runtime. the avx2 kernels
+ * are compiled for it with a target attribute, so the rest of the library
+ * still runs on any x86-64. -DKD_NO_SIMD leaves only the scalar kernels. */
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(KD_NO_SIMD)
+#define KD_SIMD
+#include <immintrin.h>
+#endif
+
+#define ARRAY_ALIGN 64
+
+/* the elements follow the header, which is padded to keep them aligned. */
+#define ARRAY_HEADER ((sizeof(ArrayObject) + ARRAY_ALIGN - 1) & ~(size_t)(ARRAY_ALIGN - 1))
+
+static void binop_i64_scalar(char op, int64_t* dst, const int64_t* lhs, size_t lhs_step, const int64_t* rhs, size_t rhs_step, size_t n);
+static void binop_f64_scalar(char op, double* dst, const double* lhs, size_t lhs_step, const double* rhs, size_t rhs_step, size_t n);
+
+ArrayObject* array_new(size_t size) {
+    if (size > (SIZE_MAX - ARRAY_HEADER - ARRAY_ALIGN) / sizeof(int64_t))
+        return NULL;
+
+    /* aligned_alloc wants a multiple of the alignment. */
+    size_t bytes = (ARRAY_HEADER + size * sizeof(int64_t) + ARRAY_ALIGN - 1) & ~(size_t)(ARRAY_ALIGN - 1);
+
+    ArrayObject* array = aligned_alloc(ARRAY_ALIGN, bytes);
+    if (array == NULL)
+        return NULL;
+
+    array->refcount = 1;
+    array->size = size;
+    array->i64 = (int64_t*)((char*)array + ARRAY_HEADER);
+
+    return array;
+}
+
+void array_release(ArrayObject* array) {
+    if (__atomic_sub_fetch(&array->refcount, 1, __ATOMIC_ACQ_REL) == 0)
+        free(array);
+}
+
+Value array_value(ValueKind kind, ArrayObject* array) {
+    Value value;
+    memset(&value, 0, sizeof(Value));
+
+    value.kind = kind;
+    value.array = array;
+
+    return value;
+}
+
+ArrayStatus array_binop_begin(char op, const Value* lhs, const Value* rhs, Value* result) {
+    const Value* array = value_is_array(lhs) ? lhs : rhs;
+
+    if (value_is_array(lhs) && value_is_array(rhs) && lhs->array->size != rhs->array->size)
+        return ARRAY_SIZE_MISMATCH;
+
+    /* a divisor array is checked block by block, see array_binop_range. */
+    if (op == '/' && array->kind == VAL_INT_ARRAY && !value_is_array(rhs) && rhs->i64 == 0)
+        return ARRAY_DIVISION_BY_ZERO;
+
+    ArrayObject* out = array_new(array->array->size);
+    if (out == NULL)
+        return ARRAY_NOMEM;
+
+    *result = array_value(array->kind, out);
+    return ARRAY_OK;
+}
+
+ArrayStatus array_binop_range(char op, const Value* lhs, const Value* rhs, Value* result, size_t from, size_t to) {
+    /* a scalar operand is read in place, with a step of 0. */
+    size_t lhs_step = value_is_array(lhs) ? 1 : 0;
+    size_t rhs_step = value_is_array(rhs) ? 1 : 0;
+
+    if (result->kind == VAL_INT_ARRAY) {
+        const int64_t* lhs_data = lhs_step ? lhs->array->i64 + from : &lhs->i64;
+        const int64_t* rhs_data = rhs_step ? rhs->array->i64 + from : &rhs->i64;
+
+        if (op == '/' && rhs_step) {
+            for (size_t i = 0; i < to - from; i++) {
+                if (rhs_data[i] == 0)
+                    return ARRAY_DIVISION_BY_ZERO;
+            }
+        }
+
+        array_binop_i64(op, result->array->i64 + from, lhs_data, lhs_step, rhs_data, rhs_step, to - from);
+        return ARRAY_OK;
+    }
+
+    const double* lhs_data = lhs_step ? lhs->array->f64 + from : &lhs->f64;
+    const double* rhs_data = rhs_step ? rhs->array->f64 + from : &rhs->f64;
+
+    array_binop_f64(op, result->array->f64 + from, lhs_data, lhs_step, rhs_data, rhs_step, to - from);
+    return ARRAY_OK;
+}
+
+#ifdef KD_SIMD
+static int has_avx2(void) {
+    /* 0 not checked yet, 1 no, 2 yes. */
+    static int avx2 = 0;
+
+    int cached = __atomic_load_n(&avx2, __ATOMIC_RELAXED);
+    if (cached != 0)
+        return cached == 2;
+
+    cached = __builtin_cpu_supports("avx2") ? 2 : 1;
+    __atomic_store_n(&avx2, cached, __ATOMIC_RELAXED);
+
+    return cached == 2;
+}
+
+/* an operand with a step of 0 is broadcast to every lane. */
+#define LOAD_PD_AVX2(DATA, STEP, I) ((STEP) ? _mm256_load_pd((DATA) + (I)) : _mm256_set1_pd(*(DATA)))
+#define LOAD_PD_SSE2(DATA, STEP, I) ((STEP) ? _mm_load_pd((DATA) + (I)) : _mm_set1_pd(*(DATA)))
+#define LOAD_EPI64_AVX2(DATA, STEP, I) ((STEP) ? _mm256_load_si256((const __m256i*)((DATA) + (I))) : _mm256_set1_epi64x(*(DATA)))
+#define LOAD_EPI64_SSE2(DATA, STEP, I) ((STEP) ? _mm_load_si128((const __m128i*)((DATA) + (I))) : _mm_set1_epi64x(*(DATA)))
+
+#define BINOP_F64_AVX2(INTRIN)                                                              \
+    for (; i + 4 <= n; i += 4)                                                              \
+        _mm256_store_pd(dst + i, INTRIN(LOAD_PD_AVX2(lhs, lhs_step, i), LOAD_PD_AVX2(rhs, rhs_step, i)))
+
+#define BINOP_F64_SSE2(INTRIN)                                                              \
+    for (; i + 2 <= n; i += 2)                                                              \
+        _mm_store_pd(dst + i, INTRIN(LOAD_PD_SSE2(lhs, lhs_step, i), LOAD_PD_SSE2(rhs, rhs_step, i)))
+
+#define BINOP_I64_AVX2(INTRIN)                                                              \
+    for (; i + 4 <= n; i += 4)                                                              \
+        _mm256_store_si256((__m256i*)(dst + i),                                             \
+            INTRIN(LOAD_EPI64_AVX2(lhs, lhs_step, i), LOAD_EPI64_AVX2(rhs, rhs_step, i)))
+
+#define BINOP_I64_SSE2(INTRIN)                                                              \
+    for (; i + 2 <= n; i += 2)                                                              \
+        _mm_store_si128((__m128i*)(dst + i),                                                \
+            INTRIN(LOAD_EPI64_SSE2(lhs, lhs_step, i), LOAD_EPI64_SSE2(rhs, rhs_step, i)))
+
+__attribute__((target("avx2")))
+static void binop_f64_avx2(char op, double* dst, const double* lhs, size_t lhs_step, const double* rhs, size_t rhs_step, size_t n) {
+    size_t i = 0;
+
+    switch (op) {
+    case '+':
+        BINOP_F64_AVX2(_mm256_add_pd);
+        break;
+    case '-':
+        BINOP_F64_AVX2(_mm256_sub_pd);
+        break;
+    case '*':
+        BINOP_F64_AVX2(_mm256_mul_pd);
+        break;
+    default:
+        BINOP_F64_AVX2(_mm256_div_pd);
+        break;
+    }
+
+    binop_f64_scalar(op, dst + i, lhs + i * lhs_step, lhs_step, rhs + i * rhs_step, rhs_step, n - i);
+}
+
+static void binop_f64_sse2(char op, double* dst, const double* lhs, size_t lhs_step, const double* rhs, size_t rhs_step, size_t n) {
+    size_t i = 0;
+
+    switch (op) {
+    case '+':
+        BINOP_F64_SSE2(_mm_add_pd);
+        break;
+    case '-':
+        BINOP_F64_SSE2(_mm_sub_pd);
+        break;
+    case '*':
+        BINOP_F64_SSE2(_mm_mul_pd);
+        break;
+    default:
+        BINOP_F64_SSE2(_mm_div_pd);
+        break;
+    }
+
+    binop_f64_scalar(op, dst + i, lhs + i * lhs_step, lhs_step, rhs + i * rhs_step, rhs_step, n - i);
+}
+
+/* neither set has a 64 bit multiply or any integer divide, those stay
+ * scalar. */
+__attribute__((target("avx2")))
+static void binop_i64_avx2(char op, int64_t* dst, const int64_t* lhs, size_t lhs_step, const int64_t* rhs, size_t rhs_step, size_t n) {
+    size_t i = 0;
+
+    if (op == '+')
+        BINOP_I64_AVX2(_mm256_add_epi64);
+    else if (op == '-')
+        BINOP_I64_AVX2(_mm256_sub_epi64);
+
+    binop_i64_scalar(op, dst + i, lhs + i * lhs_step, lhs_step, rhs + i * rhs_step, rhs_step, n - i);
+}
+
+static void binop_i64_sse2(char op, int64_t* dst, const int64_t* lhs, size_t lhs_step, const int64_t* rhs, size_t rhs_step, size_t n) {
+    size_t i = 0;
+
+    if (op == '+')
+        BINOP_I64_SSE2(_mm_add_epi64);
+    else if (op == '-')
+        BINOP_I64_SSE2(_mm_sub_epi64);
+
+    binop_i64_scalar(op, dst + i, lhs + i * lhs_step, lhs_step, rhs + i * rhs_step, rhs_step, n - i);
+}
+
+/* two accumulators so consecutive adds do not wait on each other. */
+__attribute__((target("avx2")))
+static double sum_f64_avx2(const double* data, size_t n) {
+    __m256d acc0 = _mm256_setzero_pd();
+    __m256d acc1 = _mm256_setzero_pd();
+    size_t i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        acc0 = _mm256_add_pd(acc0, _mm256_load_pd(data + i));
+        acc1 = _mm256_add_pd(acc1, _mm256_load_pd(data + i + 4));
+    }
+
+    double lanes[4];
+    _mm256_storeu_pd(lanes, _mm256_add_pd(acc0, acc1));
+
+    double sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+
+    for (; i < n; i++)
+        sum += data[i];
+
+    return sum;
+}
+
+static double sum_f64_sse2(const double* data, size_t n) {
+    __m128d acc0 = _mm_setzero_pd();
+    __m128d acc1 = _mm_setzero_pd();
+    size_t i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        acc0 = _mm_add_pd(acc0, _mm_load_pd(data + i));
+        acc1 = _mm_add_pd(acc1, _mm_load_pd(data + i + 2));
+    }
+
+    double lanes[2];
+    _mm_storeu_pd(lanes, _mm_add_pd(acc0, acc1));
+
+    double sum = lanes[0] + lanes[1];
+
+    for (; i < n; i++)
+        sum += data[i];
+
+    return sum;
+}
+
+__attribute__((target("avx2")))
+static int64_t sum_i64_avx2(const int64_t* data, size_t n) {
+    __m256i acc = _mm256_setzero_si256();
+    size_t i = 0;
+
+    for (; i + 4 <= n; i += 4)
+        acc = _mm256_add_epi64(acc, _mm256_load_si256((const __m256i*)(data + i)));
+
+    uint64_t lanes[4];
+    _mm256_storeu_si256((__m256i*)lanes, acc);
+
+    uint64_t sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+
+    for (; i < n; i++)
+        sum += (uint64_t)data[i];
+
+    return (int64_t)sum;
+}
+
+static int64_t sum_i64_sse2(const int64_t* data, size_t n) {
+    __m128i acc = _mm_setzero_si128();
+    size_t i = 0;
+
+    for (; i + 2 <= n; i += 2)
+        acc = _mm_add_epi64(acc, _mm_load_si128((const __m128i*)(data + i)));
+
+    uint64_t lanes[2];
+    _mm_storeu_si128((__m128i*)lanes, acc);
+
+    uint64_t sum = lanes[0] + lanes[1];
+
+    for (; i < n; i++)
+        sum += (uint64_t)data[i];
+
+    return (int64_t)sum;
+}
+
+/* is_max picks between the two, the loop is the same. minpd and maxpd give
+ * their second operand unless the first one wins, so with the element
+ * first they keep the accumulator over a NaN element, and a NaN in it for
+ * good, as the scalar loop does. */
+__attribute__((target("avx2")))
+static double minmax_f64_avx2(const double* data, size_t n, int is_max) {
+    __m256d acc = _mm256_set1_pd(data[0]);
+    size_t i = 0;
+
+    if (is_max) {
+        for (; i + 4 <= n; i += 4)
+            acc = _mm256_max_pd(_mm256_load_pd(data + i), acc);
+    } else {
+        for (; i + 4 <= n; i += 4)
+            acc = _mm256_min_pd(_mm256_load_pd(data + i), acc);
+    }
+
+    double lanes[4];
+    _mm256_storeu_pd(lanes, acc);
+
+    double result = lanes[0];
+
+    for (size_t lane = 1; lane < 4; lane++)
+        result = is_max ? (lanes[lane] > result ? lanes[lane] : result) : (lanes[lane] < result ? lanes[lane] : result);
+
+    for (; i < n; i++)
+        result = is_max ? (data[i] > result ? data[i] : result) : (data[i] < result ? data[i] : result);
+
+    return result;
+}
+
+static double minmax_f64_sse2(const double* data, size_t n, int is_max) {
+    __m128d acc = _mm_set1_pd(data[0]);
+    size_t i = 0;
+
+    if (is_max) {
+        for (; i + 2 <= n; i += 2)
+            acc = _mm_max_pd(_mm_load_pd(data + i), acc);
+    } else {
+        for (; i + 2 <= n; i += 2)
+            acc = _mm_min_pd(_mm_load_pd(data + i), acc);
+    }
+
+    double lanes[2];
+    _mm_storeu_pd(lanes, acc);
+
+    double result = is_max ? (lanes[1] > lanes[0] ? lanes[1] : lanes[0]) : (lanes[1] < lanes[0] ? lanes[1] : lanes[0]);
+
+    for (; i < n; i++)
+        result = is_max ? (data[i] > result ? data[i] : result) : (data[i] < result ? data[i] : result);
+
+    return result;
+}
+
+/* sse2 has no 64 bit compare, so only avx2 gets a vector version. the
+ * compare and blend take a few cycles, four accumulators keep that off the
+ * critical path. */
+#define MINMAX_I64_AVX2(GREATER)                                                    \
+    for (; i + 16 <= n; i += 16) {                                                  \
+        for (size_t k = 0; k < 4; k++) {                                            \
+            __m256i x = _mm256_load_si256((const __m256i*)(data + i + 4 * k));      \
+            acc[k] = _mm256_blendv_epi8(acc[k], x, GREATER);                        \
+        }                                                                           \
+    }
+
+__attribute__((target("avx2")))
+static int64_t minmax_i64_avx2(const int64_t* data, size_t n, int is_max) {
+    __m256i acc[4];
+    size_t i = 0;
+
+    for (size_t k = 0; k < 4; k++)
+        acc[k] = _mm256_set1_epi64x(data[0]);
+
+    if (is_max)
+        MINMAX_I64_AVX2(_mm256_cmpgt_epi64(x, acc[k]))
+    else
+        MINMAX_I64_AVX2(_mm256_cmpgt_epi64(acc[k], x))
+
+    int64_t lanes[16];
+
+    for (size_t k = 0; k < 4; k++)
+        _mm256_storeu_si256((__m256i*)(lanes + 4 * k), acc[k]);
+
+    int64_t result = lanes[0];
+
+    for (size_t lane = 1; lane < 16; lane++)
+        result = is_max ? (lanes[lane] > result ? lanes[lane] : result) : (lanes[lane] < result ? lanes[lane] : result);
+
+    for (; i < n; i++)
+        result = is_max ? (data[i] > result ? data[i] : result) : (data[i] < result ? data[i] : result);
+
+    return result;
+}
+
+__attribute__((target("avx2")))
+static double dot_f64_avx2(const double* lhs, const double* rhs, size_t n) {
+    __m256d acc0 = _mm256_setzero_pd();
+    __m256d acc1 = _mm256_setzero_pd();
+    size_t i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        acc0 = _mm256_add_pd(acc0, _mm256_mul_pd(_mm256_load_pd(lhs + i), _mm256_load_pd(rhs + i)));
+        acc1 = _mm256_add_pd(acc1, _mm256_mul_pd(_mm256_load_pd(lhs + i + 4), _mm256_load_pd(rhs + i + 4)));
+    }
+
+    double lanes[4];
+    _mm256_storeu_pd(lanes, _mm256_add_pd(acc0, acc1));
+
+    double dot = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+
+    for (; i < n; i++)
+        dot += lhs[i] * rhs[i];
+
+    return dot;
+}
+
+static double dot_f64_sse2(const double* lhs, const double* rhs, size_t n) {
+    __m128d acc0 = _mm_setzero_pd();
+    __m128d acc1 = _mm_setzero_pd();
+    size_t i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        acc0 = _mm_add_pd(acc0, _mm_mul_pd(_mm_load_pd(lhs + i), _mm_load_pd(rhs + i)));
+        acc1 = _mm_add_pd(acc1, _mm_mul_pd(_mm_load_pd(lhs + i + 2), _mm_load_pd(rhs + i + 2)));
+    }
+
+    double lanes[2];
+    _mm_storeu_pd(lanes, _mm_add_pd(acc0, acc1));
+
+    double dot = lanes[0] + lanes[1];
+
+    for (; i < n; i++)
+        dot += lhs[i] * rhs[i];
+
+    return dot;
+}
+#endif
+
+void array_binop_i64(char op, int64_t* dst, const int64_t* lhs, size_t lhs_step, const int64_t* rhs, size_t rhs_step, size_t n) {
+#ifdef KD_SIMD
+    if (has_avx2())
+        binop_i64_avx2(op, dst, lhs, lhs_step, rhs, rhs_step, n);
+    else
+        binop_i64_sse2(op, dst, lhs, lhs_step, rhs, rhs_step, n);
+#else
+    binop_i64_scalar(op, dst, lhs, lhs_step, rhs, rhs_step, n);
+#endif
+}
+
+void array_binop_f64(char op, double* dst, const double* lhs, size_t lhs_step, const double* rhs, size_t rhs_step, size_t n) {
+#ifdef KD_SIMD
+    if (has_avx2())
+        binop_f64_avx2(op, dst, lhs, lhs_step, rhs, rhs_step, n);
+    else
+        binop_f64_sse2(op, dst, lhs, lhs_step, rhs, rhs_step, n);
+#else
+    binop_f64_scalar(op, dst, lhs, lhs_step, rhs, rhs_step, n);
+#endif
+}
+
+int64_t array_sum_i64(const int64_t* data, size_t n) {
+#ifdef KD_SIMD
+    return has_avx2() ? sum_i64_avx2(data, n) : sum_i64_sse2(data, n);
+#else
+    uint64_t sum = 0;
+
+    for (size_t i = 0; i < n; i++)
+        sum += (uint64_t)data[i];
+
+    return (int64_t)sum;
+#endif
+}
+
+double array_sum_f64(const double* data, size_t n) {
+#ifdef KD_SIMD
+    return has_avx2() ? sum_f64_avx2(data, n) : sum_f64_sse2(data, n);
+#else
+    double sum = 0;
+
+    for (size_t i = 0; i < n; i++)
+        sum += data[i];
+
+    return sum;
+#endif
+}
+
+int64_t array_min_i64(const int64_t* data, size_t n) {
+#ifdef KD_SIMD
+    if (has_avx2())
+        return minmax_i64_avx2(data, n, 0);
+#endif
+
+    int64_t result = data[0];
+
+    for (size_t i = 1; i < n; i++)
+        result = data[i] < result ? data[i] : result;
+
+    return result;
+}
+
+int64_t array_max_i64(const int64_t* data, size_t n) {
+#ifdef KD_SIMD
+    if (has_avx2())
+        return minmax_i64_avx2(data, n, 1);
+#endif
+
+    int64_t result = data[0];
+
+    for (size_t i = 1; i < n; i++)
+        result = data[i] > result ? data[i] : result;
+
+    return result;
+}
+
+double array_min_f64(const double* data, size_t n) {
+#ifdef KD_SIMD
+    return has_avx2() ? minmax_f64_avx2(data, n, 0) : minmax_f64_sse2(data, n, 0);
+#else
+    double result = data[0];
+
+    for (size_t i = 1; i < n; i++)
+        result = data[i] < result ? data[i] : result;
+
+    return result;
+#endif
+}
+
+double array_max_f64(const double* data, size_t n) {
+#ifdef KD_SIMD
+    return has_avx2() ? minmax_f64_avx2(data, n, 1) : minmax_f64_sse2(data, n, 1);
+#else
+    double result = data[0];
+
+    for (size_t i = 1; i < n; i++)
+        result = data[i] > result ? data[i] : result;
+
+    return result;
+#endif
+}
+
+/* no vector 64 bit multiply below avx-512, so this one stays scalar. */
+int64_t array_dot_i64(const int64_t* lhs, const int64_t* rhs, size_t n) {
+    uint64_t dot = 0;
+
+    for (size_t i = 0; i < n; i++)
+        dot += (uint64_t)lhs[i] * (uint64_t)rhs[i];
+
+    return (int64_t)dot;
+}
+
+double array_dot_f64(const double* lhs, const double* rhs, size_t n) {
+#ifdef KD_SIMD
+    return has_avx2() ? dot_f64_avx2(lhs, rhs, n) : dot_f64_sse2(lhs, rhs, n);
+#else
+    double dot = 0;
+
+    for (size_t i = 0; i < n; i++)
+        dot += lhs[i] * rhs[i];
+
+    return dot;
+#endif
+}
+
+const char* array_isa(void) {
+#ifdef KD_SIMD
+    return has_avx2() ? "avx2" : "sse2";
+#else
+    return "scalar";
+#endif
+}
+
+/* also the tails of the vector kernels, so it has to handle any step. */
+static void binop_i64_scalar(char op, int64_t* dst, const int64_t* lhs, size_t lhs_step, const int64_t* rhs, size_t rhs_step, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        uint64_t x = (uint64_t)lhs[i * lhs_step];
+        uint64_t y = (uint64_t)rhs[i * rhs_step];
+
+        switch (op) {
+        case '+':
+            dst[i] = (int64_t)(x + y);
+            break;
+        case '-':
+            dst[i] = (int64_t)(x - y);
+            break;
+        case '*':
+            dst[i] = (int64_t)(x * y);
+            break;
+        default:
+            dst[i] = (int64_t)y == -1 ? (int64_t)(0 - x) : (int64_t)x / (int64_t)y;
+            break;
+        }
+    }
+}
+
+static void binop_f64_scalar(char op, double* dst, const double* lhs, size_t lhs_step, const double* rhs, size_t rhs_step, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        double x = lhs[i * lhs_step];
+        double y = rhs[i * rhs_step];
+
+        switch (op) {
+        case '+':
+            dst[i] = x + y;
+            break;
+        case '-':
+            dst[i] = x - y;
+            break;
+        case '*':
+            dst[i] = x * y;
+            break;
+        default:
+            dst[i] = x / y;
+            break;
+        }
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef ARRAY_H
+#define ARRAY_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "value.h"
+
+typedef enum ArrayStatus_t {
+    ARRAY_OK,
+    ARRAY_NOMEM,
+    ARRAY_SIZE_MISMATCH,
+    ARRAY_DIVISION_BY_ZERO,
+} ArrayStatus;
+
+/* an array of size elements with one reference, its elements are not
+ * initialised. returns NULL when out of memory. */
+ArrayObject* array_new(size_t size);
+
+Value array_value(ValueKind kind, ArrayObject* array);
+
+/* the array instructions go through their elements this many at a time,
+ * so a run with fuel can suspend between two blocks, see interpreter.c. */
+#define ARRAY_BLOCK (1 << 16)
+
+/* lhs op rhs element by element. at least one side is an array, a scalar of
+ * the element kind on the other side is applied to every element. begin
+ * leaves result with a new array of the size of the operands, its elements
+ * not set yet, and range sets those from up to to. */
+ArrayStatus array_binop_begin(char op, const Value* lhs, const Value* rhs, Value* result);
+ArrayStatus array_binop_range(char op, const Value* lhs, const Value* rhs, Value* result, size_t from, size_t to);
+
+/* the kernels behind the operators, picked at runtime for the best vector
+ * instructions the cpu has. a step of 0 repeats the first element of an
+ * operand, a step of 1 walks it. integer arithmetic wraps around and rhs
+ * must not contain 0 for '/'. */
+void array_binop_i64(char op, int64_t* dst, const int64_t* lhs, size_t lhs_step, const int64_t* rhs, size_t rhs_step, size_t n);
+void array_binop_f64(char op, double* dst, const double* lhs, size_t lhs_step, const double* rhs, size_t rhs_step, size_t n);
+
+/* the reductions add in a different order than a loop would, so a double
+ * sum may round differently. min and max need n > 0. they give what a loop
+ * keeping an element only when it compares below (above) the result so far
+ * gives: NaN when the first element is, and never an element that is NaN
+ * after it. */
+int64_t array_sum_i64(const int64_t* data, size_t n);
+double array_sum_f64(const double* data, size_t n);
+
+int64_t array_min_i64(const int64_t* data, size_t n);
+int64_t array_max_i64(const int64_t* data, size_t n);
+double array_min_f64(const double* data, size_t n);
+double array_max_f64(const double* data, size_t n);
+
+int64_t array_dot_i64(const int64_t* lhs, const int64_t* rhs, size_t n);
+double array_dot_f64(const double* lhs, const double* rhs, size_t n);
+
+/* the instruction set the kernels use: "avx2", "sse2" or "scalar". */
+const char* array_isa(void);
+
+#endif /* ARRAY_H */
@@ -1,65 +1,149 @@
 #ifndef AST_H
 #define AST_H
 
+/* the tree is allocated from the arena of the program that owns it and
+ * has no deinit functions of its own. */
+
 #include <stdint.h>
 
 #include "lexer.h"
+#include "value.h"
 
-typedef enum ValueKind_t {
-    VAL_INT,
-    VAL_DOUBLE,
-    VAL_BOOL,
-    VAL_STRING,
-    VAL_IDENT,
-} ValueKind;
-
-typedef struct Value_t {
+/* the kinds of a map's keys and values are only set for VAL_MAP. a struct,
+ * or an array of them, is named by the parser and found by the resolver. */
+typedef struct Type_t {
     ValueKind kind;
+    ValueKind key;
+    ValueKind value;
 
-    union {
-        int64_t i64;
-        double f64;
-        int bool;
-        struct {
-            char* data;
-            size_t size;
-        } String;
-        Span span;
-    };
-} Value;
-
-void value_deinit(Value* value);
+    Span name;
+    const RecordType* record;
+} Type;
 
 typedef enum ExprKind_t {
     EXPR_BINARY,
     EXPR_PRIMARY,
+    EXPR_CALL,
+    EXPR_ARRAY,
+    EXPR_INDEX,
+    EXPR_MAP,
+    EXPR_RECORD,
+    EXPR_FIELD,
 } ExprKind;
 
+/* functions the language provides, set on calls by the resolver. */
+typedef enum Builtin_t {
+    BUILTIN_LEN,
+    BUILTIN_SUM,
+    BUILTIN_MIN,
+    BUILTIN_MAX,
+    BUILTIN_DOT,
+    BUILTIN_FILL,
+    BUILTIN_IOTA,
+    BUILTIN_HAS,
+    BUILTIN_PUT,
+    BUILTIN_DEL,
+    BUILTIN_PRINT,
+    BUILTIN_PRINTLN,
+} Builtin;
+
 typedef struct Expr_t Expr;
 
+struct Function_t;
+struct Module_t;
+
 struct Expr_t {
     ExprKind kind;
 
+    /* of the operator for binary expressions. */
+    size_t line;
+    size_t col;
+
     union {
         struct {
             Expr* lhs;
             Expr* rhs;
+            /* '=' for == and '!' for !=. */
             char op;
         } Binary;
 
         Value Primary;
+
+        /* the resolver sets function for a call of a function declared
+         * with fn, and slot to where it is in the table of the caller, or
+         * builtin otherwise. */
+        struct {
+            Span callee;
+            Expr** args;
+            size_t nargs;
+            Builtin builtin;
+            struct Function_t* function;
+            size_t slot;
+        } Call;
+
+        /* a literal, never empty. */
+        struct {
+            Expr** elements;
+            size_t nelements;
+        } Array;
+
+        /* indexes a map too. */
+        struct {
+            Expr* array;
+            Expr* index;
+        } Index;
+
+        /* a literal, keys[i] maps to values[i]. */
+        struct {
+            Type type;
+            Expr** keys;
+            Expr** values;
+            size_t nentries;
+        } Map;
+
+        /* a literal, the values run in the order they are written. the
+         * resolver checks every field is given once and sets fields[i] to
+         * the field values[i] is for. */
+        struct {
+            Type type;
+            Span* names;
+            Expr** values;
+            size_t* fields;
+            size_t nfields;
+        } Record;
+
+        /* the resolver finds the field in the struct type the record is
+         * known to have. when record is an array of structs the result is
+         * the column of that field. */
+        struct {
+            Expr* record;
+            Span name;
+            const RecordType* type;
+            const RecordField* field;
+            int column;
+        } Field;
     };
-};
 
-void expr_deinit(Expr* expr);
+    /* set by the resolver on identifiers: how many scopes out from the use
+     * the variable was declared, and its slot in that scope's frame. */
+    size_t depth;
+    size_t slot;
+
+    /* the parser shares a pure expression between every place it appears
+     * in the same block, see Parser. uses counts the parents and statements
+     * it was handed to, constant is set when no variable appears in it. */
+    size_t uses;
+    int constant;
+};
 
 typedef struct VarDecl_t {
     Span id;
-    ValueKind type;
+    Type type;
     Expr* expr;
-} VarDecl;
 
-void var_decl_deinit(VarDecl* vardecl);
+    /* set by the resolver, in the frame of the enclosing scope. */
+    size_t slot;
+} VarDecl;
 
 struct BlockStatement_t;
 
@@ -69,33 +153,89 @@ typedef struct IfStatement_t {
     struct BlockStatement_t* else_block; 
 } IfStatement;
 
-void if_statement_deinit(IfStatement* ifstatement);
-
 typedef enum StatementKind_t {
     STATEMENT_VAR_DECL,
     STATEMENT_IF,
     STATEMENT_BLOCK,
     STATEMENT_RETURN,
+    STATEMENT_EXPR,
+    STATEMENT_STRUCT,
+    STATEMENT_FN,
+    STATEMENT_IMPORT,
+    STATEMENT_FOR,
+    STATEMENT_YIELD,
 } StatementKind;
 
+/* import "path"; where path is relative to the directory of the importing
+ * file. module is set once the file has been loaded, see module.h. */
+typedef struct Import_t {
+    Span path;
+    size_t line;
+    size_t col;
+
+    const struct Module_t* module;
+} Import;
+
+/* [par] for (var in from..to) [reduce(op) id: type] { body }, over the
+ * half open range of i64s. a loop with a reduction starts result at the
+ * identity of op, '+' or '*', and combines each yield of its body into it.
+ * the iterations of a par for may run in any order and at the same time, so
+ * the resolver checks they cannot see each other, see resolver.h. */
+typedef struct ForStatement_t {
+    Span var;
+    Expr* from;
+    Expr* to;
+    int parallel;
+
+    /* 0 when the loop reduces nothing, result is declared after the loop. */
+    char op;
+    VarDecl result;
+
+    struct BlockStatement_t* body;
+
+    /* set by the resolver: the frame of the loop, var is slot 0 of it and
+     * the body declares the rest. */
+    size_t nslots;
+} ForStatement;
+
 typedef struct Statement_t {
     StatementKind kind;
 
+    size_t line;
+    size_t col;
+
     union {
         VarDecl vardecl;
         IfStatement ifstatement;
         struct BlockStatement_t* blockstatement;
         Expr* ret;
+
+        /* evaluated for its effect, put(m, k, v) for instance. */
+        Expr* expr;
+
+        /* laid out by the parser. */
+        RecordType* record;
+
+        /* only its signature is parsed, see function.h. */
+        struct Function_t* function;
+
+        Import import;
+
+        ForStatement forstatement;
+
+        /* adds to the reduction of the innermost for that has one. */
+        Expr* yield;
     };
 } Statement;
 
-void statement_deinit(Statement* statement);
-
 typedef struct BlockStatement_t {
     Statement* statement;
     struct BlockStatement_t* next;
-} BlockStatement;
 
-void block_statement_deinit(BlockStatement* blockstatement);
+    /* set by the resolver on the first node of a block only: how many
+     * slots the frame of the block needs. an empty block is NULL and
+     * needs none. */
+    size_t nslots;
+} BlockStatement;
 
 #endif /* AST_H */
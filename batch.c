@@ -0,0 +1,315 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <pthread.h>
+
+#include "batch.h"
+#include "file.h"
+#include "pool.h"
+#include "program.h"
+
+typedef struct BatchJob_t {
+    char* path;
+
+    int failed;
+
+    /* everything this script wants printed, written out in job order. */
+    char* output;
+    size_t output_size;
+
+    /* what the script itself printed, which goes to stdout. */
+    char* printed;
+    size_t printed_size;
+
+    /* some of the above could not be kept for want of memory. */
+    int lost;
+
+    int done;
+} BatchJob;
+
+/* each worker compiles into its own arena and runs in its own context, so
+ * jobs never share mutable state and steady state does no arena mallocs. */
+typedef struct BatchWorker_t {
+    kd_program program;
+    kd_context* context;
+} BatchWorker;
+
+typedef struct Batch_t {
+    BatchJob* jobs;
+    size_t njobs;
+
+    BatchWorker* workers;
+
+    /* the modules the scripts import are compiled once for all of them. */
+    kd_modules* modules;
+
+    pthread_mutex_t lock;
+    pthread_cond_t job_done;
+} Batch;
+
+typedef struct BatchTask_t {
+    Batch* batch;
+    BatchJob* job;
+} BatchTask;
+
+static int list_scripts(const char* dirpath, BatchJob** jobs, size_t* njobs);
+static int compare_jobs(const void* lhs, const void* rhs);
+static void run_job(void* arg, size_t worker);
+static void job_printf(BatchJob* job, const char* fmt, ...);
+
+int batch_run(const char* dirpath, size_t njobs) {
+    Batch batch;
+    int listed = list_scripts(dirpath, &batch.jobs, &batch.njobs);
+
+    if (listed == 0) {
+        fprintf(stderr, "ERROR: cannot read directory '%s'!\n", dirpath);
+        return 1;
+    }
+
+    if (listed < 0) {
+        fprintf(stderr, "ERROR: cannot allocate memory!\n");
+        return 1;
+    }
+
+    ThreadPool pool;
+    if (!pool_init(&pool, njobs)) {
+        fprintf(stderr, "ERROR: cannot start worker threads!\n");
+        return 1;
+    }
+
+    batch.workers = calloc(pool.nworkers, sizeof(BatchWorker));
+    batch.modules = kd_modules_new(NULL, pool.nworkers);
+    BatchTask* tasks = calloc(batch.njobs, sizeof(BatchTask));
+
+    if (batch.workers == NULL || batch.modules == NULL || tasks == NULL) {
+        fprintf(stderr, "ERROR: cannot allocate memory!\n");
+        return 1;
+    }
+
+    for (size_t i = 0; i < pool.nworkers; i++) {
+        program_init(&batch.workers[i].program);
+        batch.workers[i].context = kd_context_new();
+
+        if (batch.workers[i].context == NULL) {
+            fprintf(stderr, "ERROR: cannot allocate memory!\n");
+            return 1;
+        }
+
+        /* the pool already has a script on every thread. */
+        kd_context_set_threads(batch.workers[i].context, 1);
+        kd_context_set_output(batch.workers[i].context, -1);
+    }
+
+    pthread_mutex_init(&batch.lock, NULL);
+    pthread_cond_init(&batch.job_done, NULL);
+
+    for (size_t i = 0; i < batch.njobs; i++) {
+        tasks[i] = (BatchTask) {
+            .batch = &batch,
+            .job = &batch.jobs[i],
+        };
+
+        if (!pool_submit(&pool, run_job, &tasks[i])) {
+            fprintf(stderr, "ERROR: cannot allocate memory!\n");
+            return 1;
+        }
+    }
+
+    size_t failed = 0;
+
+    /* print every job as soon as it and all the jobs before it are done. */
+    for (size_t i = 0; i < batch.njobs; i++) {
+        BatchJob* job = &batch.jobs[i];
+
+        pthread_mutex_lock(&batch.lock);
+        while (!job->done)
+            pthread_cond_wait(&batch.job_done, &batch.lock);
+        pthread_mutex_unlock(&batch.lock);
+
+        if (job->printed_size != 0) {
+            fwrite(job->printed, 1, job->printed_size, stdout);
+            fflush(stdout);
+        }
+
+        if (job->output_size != 0)
+            fwrite(job->output, 1, job->output_size, stderr);
+
+        if (job->lost)
+            fprintf(stderr, "%s: ERROR: cannot allocate memory for its output!\n", job->path);
+
+        if (job->failed)
+            failed++;
+
+        free(job->output);
+        free(job->printed);
+        free(job->path);
+    }
+
+    pool_wait(&pool);
+    pool_deinit(&pool);
+
+    for (size_t i = 0; i < pool.nworkers; i++) {
+        program_deinit(&batch.workers[i].program);
+        kd_context_free(batch.workers[i].context);
+    }
+
+    kd_modules_free(batch.modules);
+
+    pthread_mutex_destroy(&batch.lock);
+    pthread_cond_destroy(&batch.job_done);
+
+    fprintf(stderr, "%zu scripts, %zu failed\n", batch.njobs, failed);
+
+    free(batch.workers);
+    free(batch.jobs);
+    free(tasks);
+
+    return failed == 0 ? 0 : 1;
+}
+
+/* 1 once the jobs are listed, 0 when the directory cannot be read and -1
+ * when out of memory, with nothing left allocated. */
+static int list_scripts(const char* dirpath, BatchJob** jobs, size_t* njobs) {
+    DIR* dir = opendir(dirpath);
+    if (dir == NULL)
+        return 0;
+
+    size_t capacity = 64;
+    *njobs = 0;
+    *jobs = malloc(capacity * sizeof(BatchJob));
+
+    struct dirent* entry = NULL;
+
+    while (*jobs != NULL && (entry = readdir(dir)) != NULL) {
+        size_t length = strlen(entry->d_name);
+
+        if (length < 3 || strcmp(entry->d_name + length - 3, ".mr") != 0)
+            continue;
+
+        if (*njobs == capacity) {
+            BatchJob* grown = realloc(*jobs, capacity * 2 * sizeof(BatchJob));
+            if (grown == NULL)
+                break;
+
+            *jobs = grown;
+            capacity *= 2;
+        }
+
+        size_t path_size = strlen(dirpath) + length + 2;
+        char* path = malloc(path_size);
+        if (path == NULL)
+            break;
+
+        snprintf(path, path_size, "%s/%s", dirpath, entry->d_name);
+
+        BatchJob* job = &(*jobs)[(*njobs)++];
+        memset(job, 0, sizeof(BatchJob));
+        job->path = path;
+    }
+
+    /* readdir only ends the loop early when it is done. */
+    int done = *jobs != NULL && entry == NULL;
+
+    closedir(dir);
+
+    if (!done) {
+        for (size_t i = 0; *jobs != NULL && i < *njobs; i++)
+            free((*jobs)[i].path);
+
+        free(*jobs);
+        return -1;
+    }
+
+    qsort(*jobs, *njobs, sizeof(BatchJob), compare_jobs);
+
+    return 1;
+}
+
+static int compare_jobs(const void* lhs, const void* rhs) {
+    return strcmp(((const BatchJob*)lhs)->path, ((const BatchJob*)rhs)->path);
+}
+
+static void run_job(void* arg, size_t worker_index) {
+    BatchTask* task = arg;
+    BatchJob* job = task->job;
+    BatchWorker* worker = &task->batch->workers[worker_index];
+
+    size_t size = 0;
+    char* source = read_whole_file(job->path, &size);
+
+    if (source == NULL || source == ERR_FILE_MISREAD) {
+        job->failed = 1;
+        job_printf(job, "%s: ERROR: cannot open file!\n", job->path);
+    } else if (source != ERR_FILE_EMPTY) {
+        kd_compile_options options = {
+            .optimize = 1,
+            .inline_calls = 1,
+            .dedup = 1,
+            .modules = task->batch->modules,
+            .path = job->path,
+        };
+
+        kd_error error;
+        arena_reset(&worker->program.arena);
+
+        kd_status status = program_compile(&worker->program, source, size, &options, &error);
+        free(source);
+
+        const kd_error* reported = &error;
+        long long exit_code = 0;
+
+        if (status == KD_OK) {
+            status = kd_run(&worker->program, worker->context);
+            exit_code = kd_context_exit_code(worker->context);
+            reported = kd_context_error(worker->context);
+
+            size_t printed_size;
+            const char* printed = kd_context_take_output(worker->context, &printed_size);
+
+            job->printed = printed_size != 0 ? malloc(printed_size) : NULL;
+            if (job->printed != NULL) {
+                memcpy(job->printed, printed, printed_size);
+                job->printed_size = printed_size;
+            } else if (printed_size != 0) {
+                job->lost = 1;
+            }
+        }
+
+        if (status != KD_OK && reported->line != 0)
+            job_printf(job, "%s: (%zu:%zu) ERROR: %s\n", job->path, reported->line, reported->col, reported->message);
+        else if (status != KD_OK)
+            job_printf(job, "%s: ERROR: %s\n", job->path, reported->message);
+        else if (exit_code != 0)
+            job_printf(job, "%s: exited with %lld\n", job->path, exit_code);
+
+        job->failed = status != KD_OK || exit_code != 0 || job->lost;
+    }
+
+    pthread_mutex_lock(&task->batch->lock);
+    job->done = 1;
+    pthread_cond_broadcast(&task->batch->job_done);
+    pthread_mutex_unlock(&task->batch->lock);
+}
+
+static void job_printf(BatchJob* job, const char* fmt, ...) {
+    va_list args;
+
+    va_start(args, fmt);
+    int size = vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
+
+    char* output = realloc(job->output, job->output_size + size + 1);
+    if (output == NULL) {
+        job->lost = 1;
+        return;
+    }
+
+    va_start(args, fmt);
+    vsnprintf(output + job->output_size, size + 1, fmt, args);
+    va_end(args);
+
+    job->output = output;
+    job->output_size += size;
+}
@@ -0,0 +1,12 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stddef.h>
+
+/* compiles and runs every .mr file of a directory on njobs worker threads.
+ * the diagnostics of each script are printed in file name order no matter
+ * which worker ran it. returns 0 when every script succeeded with exit code
+ * 0, 1 otherwise. */
+int batch_run(const char* dirpath, size_t njobs);
+
+#endif /* BATCH_H */
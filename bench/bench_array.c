@@ -0,0 +1,188 @@
+/* throughput of the array kernels against a plain scalar loop over the same
+ * data. build.sh compiles this file with auto-vectorisation off, so the
+ * loops below stay one element at a time.
+ *
+ * usage: bench_array [elements] [repeats] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "array.h"
+
+typedef struct Data_t {
+    size_t n;
+    ArrayObject* a;
+    ArrayObject* b;
+    ArrayObject* out;
+} Data;
+
+static double now(void);
+static void report(const char* name, double kernel, double scalar, size_t n, long repeats);
+
+/* a checksum of every result, so none of the work can be thrown away. */
+static volatile double sink;
+
+int main(int argc, char** argv) {
+    size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : 4096;
+    long repeats = argc > 2 ? atol(argv[2]) : 20000;
+
+    Data data = { n, array_new(n), array_new(n), array_new(n) };
+    if (data.a == NULL || data.b == NULL || data.out == NULL) {
+        fprintf(stderr, "ERROR: cannot allocate memory!\n");
+        return 1;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        data.a->f64[i] = 1.0 + i * 0.25;
+        data.b->f64[i] = 2.0 - i * 0.125;
+    }
+
+    printf("%zu elements, %ld repeats, kernels use %s\n", n, repeats, array_isa());
+
+    double start, kernel, scalar;
+    double acc = 0;
+
+    /* f64 a + b */
+    start = now();
+    for (long r = 0; r < repeats; r++) {
+        array_binop_f64('+', data.out->f64, data.a->f64, 1, data.b->f64, 1, n);
+        acc += data.out->f64[r % n];
+    }
+    kernel = now() - start;
+
+    start = now();
+    for (long r = 0; r < repeats; r++) {
+        for (size_t i = 0; i < n; i++)
+            data.out->f64[i] = data.a->f64[i] + data.b->f64[i];
+        acc += data.out->f64[r % n];
+    }
+    scalar = now() - start;
+    report("f64 add", kernel, scalar, n, repeats);
+
+    /* f64 a * 3.0 */
+    double three = 3.0;
+
+    start = now();
+    for (long r = 0; r < repeats; r++) {
+        array_binop_f64('*', data.out->f64, data.a->f64, 1, &three, 0, n);
+        acc += data.out->f64[r % n];
+    }
+    kernel = now() - start;
+
+    start = now();
+    for (long r = 0; r < repeats; r++) {
+        for (size_t i = 0; i < n; i++)
+            data.out->f64[i] = data.a->f64[i] * three;
+        acc += data.out->f64[r % n];
+    }
+    scalar = now() - start;
+    report("f64 scale", kernel, scalar, n, repeats);
+
+    /* sum */
+    start = now();
+    for (long r = 0; r < repeats; r++)
+        acc += array_sum_f64(data.a->f64, n);
+    kernel = now() - start;
+
+    start = now();
+    for (long r = 0; r < repeats; r++) {
+        double sum = 0;
+        for (size_t i = 0; i < n; i++)
+            sum += data.a->f64[i];
+        acc += sum;
+    }
+    scalar = now() - start;
+    report("f64 sum", kernel, scalar, n, repeats);
+
+    /* dot */
+    start = now();
+    for (long r = 0; r < repeats; r++)
+        acc += array_dot_f64(data.a->f64, data.b->f64, n);
+    kernel = now() - start;
+
+    start = now();
+    for (long r = 0; r < repeats; r++) {
+        double dot = 0;
+        for (size_t i = 0; i < n; i++)
+            dot += data.a->f64[i] * data.b->f64[i];
+        acc += dot;
+    }
+    scalar = now() - start;
+    report("f64 dot", kernel, scalar, n, repeats);
+
+    /* max */
+    start = now();
+    for (long r = 0; r < repeats; r++)
+        acc += array_max_f64(data.b->f64, n);
+    kernel = now() - start;
+
+    start = now();
+    for (long r = 0; r < repeats; r++) {
+        double max = data.b->f64[0];
+        for (size_t i = 1; i < n; i++)
+            max = data.b->f64[i] > max ? data.b->f64[i] : max;
+        acc += max;
+    }
+    scalar = now() - start;
+    report("f64 max", kernel, scalar, n, repeats);
+
+    /* the same buffers reinterpreted as i64 */
+    for (size_t i = 0; i < n; i++) {
+        data.a->i64[i] = (int64_t)(i * 7919) % 10007;
+        data.b->i64[i] = (int64_t)i - 5000;
+    }
+
+    start = now();
+    for (long r = 0; r < repeats; r++) {
+        array_binop_i64('+', data.out->i64, data.a->i64, 1, data.b->i64, 1, n);
+        acc += data.out->i64[r % n];
+    }
+    kernel = now() - start;
+
+    start = now();
+    for (long r = 0; r < repeats; r++) {
+        for (size_t i = 0; i < n; i++)
+            data.out->i64[i] = data.a->i64[i] + data.b->i64[i];
+        acc += data.out->i64[r % n];
+    }
+    scalar = now() - start;
+    report("i64 add", kernel, scalar, n, repeats);
+
+    start = now();
+    for (long r = 0; r < repeats; r++)
+        acc += array_max_i64(data.a->i64, n);
+    kernel = now() - start;
+
+    start = now();
+    for (long r = 0; r < repeats; r++) {
+        int64_t max = data.a->i64[0];
+        for (size_t i = 1; i < n; i++)
+            max = data.a->i64[i] > max ? data.a->i64[i] : max;
+        acc += max;
+    }
+    scalar = now() - start;
+    report("i64 max", kernel, scalar, n, repeats);
+
+    sink = acc;
+
+    array_release(data.a);
+    array_release(data.b);
+    array_release(data.out);
+
+    return 0;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char* name, double kernel, double scalar, size_t n, long repeats) {
+    double elements = (double)n * repeats;
+
+    printf("%-10s kernel %8.2f M elements/s   scalar %8.2f M elements/s   (%.2fx)\n",
+        name, elements / kernel / 1e6, elements / scalar / 1e6, scalar / kernel);
+}
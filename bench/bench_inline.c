@@ -0,0 +1,185 @@
+/* speedup of inlining on scripts dominated by calls.
+ *
+ * "helpers" sums a loop of n calls to small helper functions calling each
+ * other, "constants" calls a function too large to inline with constant
+ * arguments for all but one parameter, which specializes it. each is
+ * compiled with and without inline_calls and run as many times as asked,
+ * checking that both give the same exit code.
+ *
+ * usage: bench_inline [n] [runs] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "kidomaru.h"
+
+typedef struct Mode_t {
+    const char* name;
+    kd_compile_options options;
+} Mode;
+
+static double now(void);
+static char* write_helpers(long n, size_t* len);
+static char* write_constants(long n, size_t* len);
+static int bench(const Mode* mode, const char* source, size_t len, long runs, double* compile, double* elapsed, long long* exit_code);
+
+int main(int argc, char** argv) {
+    long n = argc > 1 ? atol(argv[1]) : 1000000;
+    long runs = argc > 2 ? atol(argv[2]) : 5;
+
+    if (n < 1 || runs < 1) {
+        fprintf(stderr, "Usage: %s [n] [runs]\n", argv[0]);
+        return 1;
+    }
+
+    const char* names[2] = { "helpers", "constants" };
+    size_t len[2];
+    char* sources[2] = { write_helpers(n, &len[0]), write_constants(n, &len[1]) };
+
+    if (sources[0] == NULL || sources[1] == NULL) {
+        fprintf(stderr, "ERROR: cannot allocate memory!\n");
+        free(sources[0]);
+        free(sources[1]);
+        return 1;
+    }
+
+    const Mode modes[] = {
+        { "calls", { .optimize = 1, .dedup = 1 } },
+        { "inlined", { .optimize = 1, .inline_calls = 1, .dedup = 1 } },
+    };
+
+    printf("%ld iterations\n", n);
+    printf("%-20s %12s %12s %10s\n", "script", "compile (us)", "run (ms)", "speedup");
+
+    int status = 0;
+
+    for (size_t s = 0; s < 2 && status == 0; s++) {
+        double elapsed[2];
+        long long exit_codes[2];
+
+        for (size_t i = 0; i < 2 && status == 0; i++) {
+            double compile;
+            status = bench(&modes[i], sources[s], len[s], runs, &compile, &elapsed[i], &exit_codes[i]);
+
+            if (status == 0) {
+                char name[32];
+                snprintf(name, sizeof(name), "%s %s", names[s], modes[i].name);
+                printf("%-20s %12.1f %12.3f %9.2fx\n", name, compile * 1e6, elapsed[i] * 1e3, elapsed[0] / elapsed[i]);
+            }
+        }
+
+        if (status == 0 && exit_codes[0] != exit_codes[1]) {
+            fprintf(stderr, "ERROR: %s exits with %lld inlined, %lld with calls!\n", names[s], exit_codes[1], exit_codes[0]);
+            status = 1;
+        }
+    }
+
+    free(sources[0]);
+    free(sources[1]);
+    return status;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static char* write_helpers(long n, size_t* len) {
+    char* source = NULL;
+    FILE* file = open_memstream(&source, len);
+    if (file == NULL)
+        return NULL;
+
+    fprintf(file, "{\n");
+    fprintf(file, "fn sq(x: i64) -> i64 {\n    return x * x;\n}\n");
+    fprintf(file, "fn mix(a: i64, b: i64) -> i64 {\n    return a * 31 + b;\n}\n");
+    fprintf(file, "fn pick(c: bool, a: i64, b: i64) -> i64 {\n");
+    fprintf(file, "    if (c) {\n        return a;\n    }\n");
+    fprintf(file, "    return b;\n}\n");
+    fprintf(file, "fn odd(x: i64) -> bool {\n    return x / 2 * 2 != x;\n}\n");
+    fprintf(file, "fn step(x: i64, i: i64) -> i64 {\n");
+    fprintf(file, "    return mix(sq(i), pick(odd(i), x, i)) / 7;\n}\n");
+    fprintf(file, "for (i in 0..%ld) reduce(+) s: i64 {\n", n);
+    fprintf(file, "    yield step(i, 3) - sq(i / 1000);\n");
+    fprintf(file, "}\n");
+    fprintf(file, "return s;\n}\n");
+
+    if (fclose(file) != 0) {
+        free(source);
+        return NULL;
+    }
+
+    return source;
+}
+
+static char* write_constants(long n, size_t* len) {
+    char* source = NULL;
+    FILE* file = open_memstream(&source, len);
+    if (file == NULL)
+        return NULL;
+
+    fprintf(file, "{\n");
+    fprintf(file, "fn scale(x: i64, k: i64, wide: bool) -> i64 {\n");
+    fprintf(file, "    let v0: i64 = x * k + k * k;\n");
+
+    for (int i = 1; i < 16; i++)
+        fprintf(file, "    let v%d: i64 = v%d * k + k * %d;\n", i, i - 1, i);
+
+    fprintf(file, "    if (wide) {\n        return v15 * k * k;\n    }\n");
+    fprintf(file, "    return v15 + v0;\n}\n");
+    fprintf(file, "for (i in 0..%ld) reduce(+) s: i64 {\n", n);
+    fprintf(file, "    yield scale(i, 1, false) - scale(i, 0, true);\n");
+    fprintf(file, "}\n");
+    fprintf(file, "return s;\n}\n");
+
+    if (fclose(file) != 0) {
+        free(source);
+        return NULL;
+    }
+
+    return source;
+}
+
+/* the best of runs, and how long compiling took. */
+static int bench(const Mode* mode, const char* source, size_t len, long runs, double* compile, double* elapsed, long long* exit_code) {
+    kd_error error;
+
+    double start = now();
+    kd_program* program = kd_compile_with(source, len, &mode->options, &error);
+    *compile = now() - start;
+
+    if (program == NULL) {
+        fprintf(stderr, "(%zu:%zu) ERROR: %s\n", error.line, error.col, error.message);
+        return 1;
+    }
+
+    kd_context* context = kd_context_new();
+    int status = 0;
+
+    *elapsed = 0;
+
+    for (long i = 0; i < runs && status == 0; i++) {
+        start = now();
+        kd_status result = kd_run(program, context);
+        double run = now() - start;
+
+        if (result != KD_OK) {
+            const kd_error* error = kd_context_error(context);
+            fprintf(stderr, "(%zu:%zu) ERROR: %s\n", error->line, error->col, error->message);
+            status = 1;
+        }
+
+        if (i == 0 || run < *elapsed)
+            *elapsed = run;
+    }
+
+    *exit_code = kd_context_exit_code(context);
+
+    kd_context_free(context);
+    kd_program_free(program);
+    return status;
+}
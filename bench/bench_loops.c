@@ -0,0 +1,144 @@
+/* scaling of par for with the number of threads.
+ *
+ * the script sums a function over a range of n, once with a plain for and
+ * once with a par for. the plain one is run on one thread and the par one
+ * on 1, 2, 4 and so on up to 32 threads, each as many times as asked,
+ * checking that all of them give the same exit code.
+ *
+ * usage: bench_loops [n] [runs] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "kidomaru.h"
+
+#define MAX_THREADS 32
+
+static double now(void);
+static char* write_script(long n, int parallel, size_t* len);
+static int bench(const char* source, size_t len, size_t nthreads, long runs, double* elapsed, long long* exit_code);
+
+int main(int argc, char** argv) {
+    long n = argc > 1 ? atol(argv[1]) : 1000000;
+    long runs = argc > 2 ? atol(argv[2]) : 5;
+
+    if (n < 1 || runs < 1) {
+        fprintf(stderr, "Usage: %s [n] [runs]\n", argv[0]);
+        return 1;
+    }
+
+    size_t len[2];
+    char* sources[2] = { write_script(n, 0, &len[0]), write_script(n, 1, &len[1]) };
+
+    if (sources[0] == NULL || sources[1] == NULL) {
+        fprintf(stderr, "ERROR: cannot allocate memory!\n");
+        free(sources[0]);
+        free(sources[1]);
+        return 1;
+    }
+
+    printf("sum over %ld iterations on %ld cores\n", n, sysconf(_SC_NPROCESSORS_ONLN));
+    printf("%-14s %12s %10s\n", "mode", "run (ms)", "speedup");
+
+    double sequential;
+    long long expected;
+    int status = bench(sources[0], len[0], 1, runs, &sequential, &expected);
+
+    if (status == 0)
+        printf("%-14s %12.3f %9.2fx\n", "for", sequential * 1e3, 1.0);
+
+    for (size_t nthreads = 1; nthreads <= MAX_THREADS && status == 0; nthreads *= 2) {
+        double elapsed;
+        long long exit_code;
+
+        status = bench(sources[1], len[1], nthreads, runs, &elapsed, &exit_code);
+        if (status != 0)
+            break;
+
+        char name[32];
+        snprintf(name, sizeof(name), "par for x%zu", nthreads);
+        printf("%-14s %12.3f %9.2fx\n", name, elapsed * 1e3, sequential / elapsed);
+
+        if (exit_code != expected) {
+            fprintf(stderr, "ERROR: exit code %lld on %zu threads, %lld with a plain for!\n", exit_code, nthreads, expected);
+            status = 1;
+        }
+    }
+
+    free(sources[0]);
+    free(sources[1]);
+    return status;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static char* write_script(long n, int parallel, size_t* len) {
+    char* source = NULL;
+    FILE* file = open_memstream(&source, len);
+    if (file == NULL)
+        return NULL;
+
+    fprintf(file, "{\n");
+    fprintf(file, "fn work(x: i64) -> i64 {\n");
+    fprintf(file, "    let y: i64 = x * x + 7;\n");
+    fprintf(file, "    let z: i64 = y * y + x;\n");
+    fprintf(file, "    return z / 3 - y;\n");
+    fprintf(file, "}\n");
+    fprintf(file, "%sfor (i in 0..%ld) reduce(+) s: i64 {\n", parallel ? "par " : "", n);
+    fprintf(file, "    yield work(i);\n");
+    fprintf(file, "}\n");
+    fprintf(file, "return s;\n}\n");
+
+    if (fclose(file) != 0) {
+        free(source);
+        return NULL;
+    }
+
+    return source;
+}
+
+/* the best of runs, compiling is left out. */
+static int bench(const char* source, size_t len, size_t nthreads, long runs, double* elapsed, long long* exit_code) {
+    kd_error error;
+    kd_program* program = kd_compile(source, len, &error);
+
+    if (program == NULL) {
+        fprintf(stderr, "(%zu:%zu) ERROR: %s\n", error.line, error.col, error.message);
+        return 1;
+    }
+
+    kd_context* context = kd_context_new();
+    int status = 0;
+
+    kd_context_set_threads(context, nthreads);
+    *elapsed = 0;
+
+    for (long i = 0; i < runs && status == 0; i++) {
+        double start = now();
+        kd_status result = kd_run(program, context);
+        double run = now() - start;
+
+        if (result != KD_OK) {
+            const kd_error* error = kd_context_error(context);
+            fprintf(stderr, "(%zu:%zu) ERROR: %s\n", error->line, error->col, error->message);
+            status = 1;
+        }
+
+        if (i == 0 || run < *elapsed)
+            *elapsed = run;
+    }
+
+    *exit_code = kd_context_exit_code(context);
+
+    kd_context_free(context);
+    kd_program_free(program);
+    return status;
+}
@@ -0,0 +1,161 @@
+/* throughput and memory of the map for insert, lookup, iteration and delete
+ * over i64 keys, and insert and lookup over string keys.
+ *
+ * usage: bench_map [entries] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "map.h"
+
+static double now(void);
+static void report(const char* name, double seconds, size_t ops);
+
+/* spreads the keys over the whole i64 range, in an order the table does not
+ * see coming. */
+static int64_t scramble(uint64_t i) {
+    return (int64_t)(i * 0x9e3779b97f4a7c15ull);
+}
+
+/* a sum of every result, so none of the work can be thrown away. */
+static volatile int64_t sink;
+
+int main(int argc, char** argv) {
+    size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : 10000000;
+
+    MapObject* map = map_new(VAL_INT, VAL_INT);
+    if (map == NULL) {
+        fprintf(stderr, "ERROR: cannot allocate memory!\n");
+        return 1;
+    }
+
+    printf("%zu i64 -> i64 entries\n", n);
+
+    int64_t acc = 0;
+    double start;
+
+    start = now();
+    for (size_t i = 0; i < n; i++) {
+        Value key = { .kind = VAL_INT, .i64 = scramble(i) };
+        Value value = { .kind = VAL_INT, .i64 = (int64_t)i };
+        int inserted;
+
+        if (map_put(map, &key, &value, &inserted) != MAP_OK) {
+            fprintf(stderr, "ERROR: cannot allocate memory!\n");
+            return 1;
+        }
+    }
+    report("insert", now() - start, n);
+
+    printf("%-12s %.1f bytes/entry, capacity %zu\n", "memory", (double)map_memory(map) / map->count, map->capacity);
+
+    start = now();
+    for (size_t i = 0; i < n; i++) {
+        Value key = { .kind = VAL_INT, .i64 = scramble(i) };
+        Value value;
+
+        map_get(map, &key, &value);
+        acc += value.i64;
+    }
+    report("lookup hit", now() - start, n);
+
+    start = now();
+    for (size_t i = 0; i < n; i++) {
+        Value key = { .kind = VAL_INT, .i64 = scramble(i + n) };
+        Value value;
+
+        acc += map_get(map, &key, &value);
+    }
+    report("lookup miss", now() - start, n);
+
+    start = now();
+    size_t cursor = 0;
+    Value key, value;
+    while (map_next(map, &cursor, &key, &value))
+        acc += value.i64;
+    report("iterate", now() - start, n);
+
+    start = now();
+    for (size_t i = 0; i < n; i += 2) {
+        Value key = { .kind = VAL_INT, .i64 = scramble(i) };
+        acc += map_delete(map, &key);
+    }
+    report("delete half", now() - start, n / 2);
+
+    start = now();
+    for (size_t i = 0; i < n; i++) {
+        Value key = { .kind = VAL_INT, .i64 = scramble(i) };
+        Value value;
+
+        acc += map_get(map, &key, &value);
+    }
+    report("lookup mixed", now() - start, n);
+
+    map_release(map);
+
+    /* string keys longer than STRING_INLINE_MAX, so their hashes are cached
+     * in the string objects. */
+    size_t nstrings = n / 10;
+
+    Value* keys = malloc(nstrings * sizeof(Value));
+    map = map_new(VAL_STRING, VAL_INT);
+    if (keys == NULL || map == NULL) {
+        fprintf(stderr, "ERROR: cannot allocate memory!\n");
+        return 1;
+    }
+
+    for (size_t i = 0; i < nstrings; i++) {
+        Value prefix = { .kind = VAL_STRING, .String = { "a string key #", 14 } };
+        Value number = { .kind = VAL_STRING };
+        number.String.size = snprintf(number.String.data, sizeof(number.String.data), "%zu", i);
+
+        if (!string_concat(&prefix, &number, &keys[i])) {
+            fprintf(stderr, "ERROR: cannot allocate memory!\n");
+            return 1;
+        }
+    }
+
+    printf("%zu string -> i64 entries\n", nstrings);
+
+    start = now();
+    for (size_t i = 0; i < nstrings; i++) {
+        Value value = { .kind = VAL_INT, .i64 = (int64_t)i };
+        int inserted;
+
+        if (map_put(map, &keys[i], &value, &inserted) != MAP_OK) {
+            fprintf(stderr, "ERROR: cannot allocate memory!\n");
+            return 1;
+        }
+    }
+    report("insert", now() - start, nstrings);
+
+    start = now();
+    for (size_t i = 0; i < nstrings; i++) {
+        Value value;
+
+        map_get(map, &keys[i], &value);
+        acc += value.i64;
+    }
+    report("lookup hit", now() - start, nstrings);
+
+    sink = acc;
+
+    map_release(map);
+    for (size_t i = 0; i < nstrings; i++)
+        value_release(&keys[i]);
+    free(keys);
+
+    return 0;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char* name, double seconds, size_t ops) {
+    printf("%-12s %8.2f M ops/s\n", name, ops / seconds / 1e6);
+}
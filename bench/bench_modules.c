@@ -0,0 +1,224 @@
+/* compile time of a script importing a tree of modules, from scratch and
+ * after edits.
+ *
+ * writes layers of modules to a temporary directory, each one declaring a
+ * struct and some functions and importing two modules of the layer below,
+ * and a script importing the top layer. the script is compiled with a fresh
+ * kd_modules on one thread and on all of them, then again with the same
+ * kd_modules without any change, after editing a module of the top layer
+ * and after editing one of the bottom layer, which every module above
+ * imports through some path.
+ *
+ * usage: bench_modules [layers] [width] [functions] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "kidomaru.h"
+
+typedef struct Tree_t {
+    char dir[64];
+    long layers;
+    long width;
+    long functions;
+} Tree;
+
+static double now(void);
+static int write_module(const Tree* tree, long layer, long i, long edit);
+static int write_script(const Tree* tree, char* path, size_t size, char** source, size_t* len);
+static int compile(kd_modules* modules, const char* path, const char* source, size_t len, const char* name);
+static void remove_tree(const Tree* tree);
+
+int main(int argc, char** argv) {
+    Tree tree = {
+        .dir = "/tmp/bench_modules.XXXXXX",
+        .layers = argc > 1 ? atol(argv[1]) : 6,
+        .width = argc > 2 ? atol(argv[2]) : 16,
+        .functions = argc > 3 ? atol(argv[3]) : 20,
+    };
+
+    if (tree.layers < 1 || tree.width < 1 || tree.functions < 1) {
+        fprintf(stderr, "Usage: %s [layers] [width] [functions]\n", argv[0]);
+        return 1;
+    }
+
+    if (mkdtemp(tree.dir) == NULL) {
+        fprintf(stderr, "ERROR: cannot create a temporary directory!\n");
+        return 1;
+    }
+
+    char path[128];
+    char* source = NULL;
+    size_t len = 0;
+    int status = 0;
+
+    for (long layer = 0; layer < tree.layers && status == 0; layer++) {
+        for (long i = 0; i < tree.width && status == 0; i++)
+            status = write_module(&tree, layer, i, 0);
+    }
+
+    if (status == 0)
+        status = write_script(&tree, path, sizeof(path), &source, &len);
+
+    if (status != 0) {
+        fprintf(stderr, "ERROR: cannot write the modules!\n");
+        remove_tree(&tree);
+        return 1;
+    }
+
+    long ncores = sysconf(_SC_NPROCESSORS_ONLN);
+    kd_compile_options options = { .optimize = 1, .inline_calls = 1, .dedup = 1 };
+
+    printf("%ld modules of %ld functions\n", tree.layers * tree.width, tree.functions);
+    printf("%-20s %12s %10s %10s\n", "compile", "time (ms)", "compiled", "reused");
+
+    kd_modules* single = kd_modules_new(&options, 1);
+    kd_modules* modules = kd_modules_new(&options, ncores > 0 ? (size_t)ncores : 1);
+
+    if (single == NULL || modules == NULL) {
+        fprintf(stderr, "ERROR: cannot allocate memory!\n");
+        status = 1;
+    }
+
+    if (status == 0)
+        status = compile(single, path, source, len, "cold, 1 thread");
+
+    if (status == 0)
+        status = compile(modules, path, source, len, "cold, all threads");
+
+    if (status == 0)
+        status = compile(modules, path, source, len, "unchanged");
+
+    if (status == 0)
+        status = write_module(&tree, tree.layers - 1, 0, 1);
+
+    if (status == 0)
+        status = compile(modules, path, source, len, "top module edited");
+
+    if (status == 0)
+        status = write_module(&tree, 0, 0, 1);
+
+    if (status == 0)
+        status = compile(modules, path, source, len, "leaf module edited");
+
+    kd_modules_free(single);
+    kd_modules_free(modules);
+
+    free(source);
+    remove_tree(&tree);
+    return status;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* module i of a layer imports modules i and i + 1 of the layer below and
+ * calls into both. an edit changes a constant of its first function. */
+static int write_module(const Tree* tree, long layer, long i, long edit) {
+    char path[128];
+    snprintf(path, sizeof(path), "%s/m%ld_%ld.mr", tree->dir, layer, i);
+
+    FILE* file = fopen(path, "w");
+    if (file == NULL)
+        return 1;
+
+    long below = (i + 1) % tree->width;
+
+    if (layer > 0) {
+        fprintf(file, "import \"m%ld_%ld.mr\";\n", layer - 1, i);
+        if (below != i)
+            fprintf(file, "import \"m%ld_%ld.mr\";\n", layer - 1, below);
+    }
+
+    fprintf(file, "struct S%ld_%ld { a: i64, b: f64 }\n", layer, i);
+
+    for (long f = 0; f < tree->functions; f++) {
+        fprintf(file, "fn f%ld_%ld_%ld(x: i64) -> i64 {\n", layer, i, f);
+        fprintf(file, "    let s: S%ld_%ld = S%ld_%ld{a: x * %ld, b: 1.5};\n", layer, i, layer, i, f + edit + 1);
+
+        if (layer > 0)
+            fprintf(file, "    return s.a + f%ld_%ld_%ld(x) + f%ld_%ld_%ld(x);\n", layer - 1, i, f, layer - 1, below, f);
+        else
+            fprintf(file, "    return s.a + %ld;\n", f);
+
+        fprintf(file, "}\n");
+    }
+
+    return fclose(file) != 0;
+}
+
+static int write_script(const Tree* tree, char* path, size_t size, char** source, size_t* len) {
+    snprintf(path, size, "%s/main.mr", tree->dir);
+
+    FILE* file = fopen(path, "w");
+    if (file == NULL)
+        return 1;
+
+    fprintf(file, "{\n");
+    for (long i = 0; i < tree->width; i++)
+        fprintf(file, "    import \"m%ld_%ld.mr\";\n", tree->layers - 1, i);
+
+    fprintf(file, "    return f%ld_0_0(1);\n}\n", tree->layers - 1);
+
+    long length = ftell(file);
+    if (fclose(file) != 0 || length <= 0)
+        return 1;
+
+    file = fopen(path, "r");
+    if (file == NULL)
+        return 1;
+
+    *source = malloc(length);
+    *len = *source != NULL ? fread(*source, 1, length, file) : 0;
+
+    fclose(file);
+    return *len != (size_t)length;
+}
+
+static int compile(kd_modules* modules, const char* path, const char* source, size_t len, const char* name) {
+    kd_compile_options options = { .optimize = 1, .inline_calls = 1, .dedup = 1, .modules = modules, .path = path };
+    kd_module_stats before;
+    kd_module_stats after;
+
+    kd_modules_stats(modules, &before);
+    double start = now();
+
+    kd_error error;
+    kd_program* program = kd_compile_with(source, len, &options, &error);
+
+    double elapsed = now() - start;
+    kd_modules_stats(modules, &after);
+
+    if (program == NULL) {
+        fprintf(stderr, "(%zu:%zu) ERROR: %s\n", error.line, error.col, error.message);
+        return 1;
+    }
+
+    kd_program_free(program);
+
+    printf("%-20s %12.3f %10zu %10zu\n", name, elapsed * 1e3,
+        after.compiled - before.compiled, after.reused - before.reused);
+    return 0;
+}
+
+static void remove_tree(const Tree* tree) {
+    char path[128];
+
+    for (long layer = 0; layer < tree->layers; layer++) {
+        for (long i = 0; i < tree->width; i++) {
+            snprintf(path, sizeof(path), "%s/m%ld_%ld.mr", tree->dir, layer, i);
+            remove(path);
+        }
+    }
+
+    snprintf(path, sizeof(path), "%s/main.mr", tree->dir);
+    remove(path);
+    remove(tree->dir);
+}
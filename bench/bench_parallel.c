@@ -0,0 +1,147 @@
+/* speedup of --auto-parallel on a wide script.
+ *
+ * the script declares width independent variables, each one calling a
+ * recursive function of the given depth, and as many again each depending
+ * on one of those, then returns their sum. it is compiled with and without
+ * auto_parallel and run as many times as asked with each, checking that
+ * both give the same exit code.
+ *
+ * usage: bench_parallel [width] [depth] [runs] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "kidomaru.h"
+
+typedef struct Mode_t {
+    const char* name;
+    kd_compile_options options;
+} Mode;
+
+static double now(void);
+static char* write_script(long width, long depth, size_t* len);
+static int bench(const Mode* mode, const char* source, size_t len, long runs, double* elapsed, long long* exit_code);
+
+int main(int argc, char** argv) {
+    long width = argc > 1 ? atol(argv[1]) : 16;
+    long depth = argc > 2 ? atol(argv[2]) : 22;
+    long runs = argc > 3 ? atol(argv[3]) : 5;
+
+    if (width < 1 || depth < 2 || runs < 1) {
+        fprintf(stderr, "Usage: %s [width] [depth] [runs]\n", argv[0]);
+        return 1;
+    }
+
+    size_t len;
+    char* source = write_script(width, depth, &len);
+    if (source == NULL) {
+        fprintf(stderr, "ERROR: cannot allocate memory!\n");
+        return 1;
+    }
+
+    const Mode modes[] = {
+        { "sequential", { .optimize = 1, .inline_calls = 1, .dedup = 1 } },
+        { "auto-parallel", { .optimize = 1, .inline_calls = 1, .dedup = 1, .auto_parallel = 1 } },
+    };
+
+    printf("%ld x 2 statements of depth %ld on %ld cores\n", width, depth, sysconf(_SC_NPROCESSORS_ONLN));
+    printf("%-14s %12s %10s\n", "mode", "run (ms)", "speedup");
+
+    double elapsed[2];
+    long long exit_codes[2];
+    int status = 0;
+
+    for (size_t i = 0; i < 2 && status == 0; i++) {
+        status = bench(&modes[i], source, len, runs, &elapsed[i], &exit_codes[i]);
+
+        if (status == 0)
+            printf("%-14s %12.3f %9.2fx\n", modes[i].name, elapsed[i] * 1e3, elapsed[0] / elapsed[i]);
+    }
+
+    if (status == 0 && exit_codes[0] != exit_codes[1]) {
+        fprintf(stderr, "ERROR: exit code %lld with auto-parallel, %lld without!\n", exit_codes[1], exit_codes[0]);
+        status = 1;
+    }
+
+    free(source);
+    return status;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static char* write_script(long width, long depth, size_t* len) {
+    char* source = NULL;
+    FILE* file = open_memstream(&source, len);
+    if (file == NULL)
+        return NULL;
+
+    fprintf(file, "{\n");
+    fprintf(file, "fn work(n: i64) -> i64 {\n");
+    fprintf(file, "    if (n == 0) { return 0; }\n");
+    fprintf(file, "    if (n == 1) { return 1; }\n");
+    fprintf(file, "    return work(n - 1) + work(n - 2);\n");
+    fprintf(file, "}\n");
+
+    for (long i = 0; i < width; i++)
+        fprintf(file, "let a%ld: i64 = work(%ld);\n", i, depth - i % 2);
+
+    for (long i = 0; i < width; i++)
+        fprintf(file, "let b%ld: i64 = work(%ld) - a%ld;\n", i, depth - 1, i);
+
+    fprintf(file, "return 0");
+    for (long i = 0; i < width; i++)
+        fprintf(file, " + a%ld + b%ld", i, i);
+    fprintf(file, ";\n}\n");
+
+    if (fclose(file) != 0) {
+        free(source);
+        return NULL;
+    }
+
+    return source;
+}
+
+/* the best of runs, compiling is left out. */
+static int bench(const Mode* mode, const char* source, size_t len, long runs, double* elapsed, long long* exit_code) {
+    kd_error error;
+    kd_program* program = kd_compile_with(source, len, &mode->options, &error);
+
+    if (program == NULL) {
+        fprintf(stderr, "(%zu:%zu) ERROR: %s\n", error.line, error.col, error.message);
+        return 1;
+    }
+
+    kd_context* context = kd_context_new();
+    int status = 0;
+
+    *elapsed = 0;
+
+    for (long i = 0; i < runs && status == 0; i++) {
+        double start = now();
+        kd_status result = kd_run(program, context);
+        double run = now() - start;
+
+        if (result != KD_OK) {
+            const kd_error* error = kd_context_error(context);
+            fprintf(stderr, "(%zu:%zu) ERROR: %s\n", error->line, error->col, error->message);
+            status = 1;
+        }
+
+        if (i == 0 || run < *elapsed)
+            *elapsed = run;
+    }
+
+    *exit_code = kd_context_exit_code(context);
+
+    kd_context_free(context);
+    kd_program_free(program);
+    return status;
+}
@@ -0,0 +1,180 @@
+/* throughput of print.
+ *
+ * a script prints n i64s, then n f64s, one per line. each runs once with
+ * the output going to /dev/null and once kept in memory, against a loop of
+ * fprintf writing the same numbers to /dev/null, and checks that both
+ * wrote as many bytes.
+ *
+ * usage: bench_print [n] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "kidomaru.h"
+
+static double now(void);
+static char* write_script(long n, int f64, size_t* len);
+static int bench(const char* source, size_t len, int fd, double* elapsed, size_t* size);
+static double bench_fprintf(long n, int f64, size_t* size);
+static void report(const char* name, double elapsed, size_t size);
+
+int main(int argc, char** argv) {
+    long n = argc > 1 ? atol(argv[1]) : 10000000;
+
+    if (n < 1) {
+        fprintf(stderr, "Usage: %s [n]\n", argv[0]);
+        return 1;
+    }
+
+    int null = open("/dev/null", O_WRONLY);
+    if (null < 0) {
+        fprintf(stderr, "ERROR: cannot open /dev/null!\n");
+        return 1;
+    }
+
+    printf("printing %ld numbers\n", n);
+    printf("%-20s %12s %10s %10s\n", "mode", "run (ms)", "MB", "MB/s");
+
+    int status = 0;
+
+    for (int f64 = 0; f64 <= 1 && status == 0; f64++) {
+        size_t len;
+        char* source = write_script(n, f64, &len);
+
+        if (source == NULL) {
+            fprintf(stderr, "ERROR: cannot allocate memory!\n");
+            status = 1;
+            break;
+        }
+
+        const char* type = f64 ? "f64" : "i64";
+        char name[32];
+        double elapsed;
+        size_t size;
+        size_t expected;
+
+        elapsed = bench_fprintf(n, f64, &expected);
+        snprintf(name, sizeof(name), "fprintf %s", type);
+        report(name, elapsed, expected);
+
+        status = bench(source, len, null, &elapsed, &size);
+        if (status == 0) {
+            snprintf(name, sizeof(name), "println %s", type);
+            report(name, elapsed, size);
+            status = bench(source, len, -1, &elapsed, &size);
+        }
+
+        if (status == 0) {
+            snprintf(name, sizeof(name), "println %s (mem)", type);
+            report(name, elapsed, size);
+
+            if (size != expected) {
+                fprintf(stderr, "ERROR: println wrote %zu bytes, fprintf %zu!\n", size, expected);
+                status = 1;
+            }
+        }
+
+        free(source);
+    }
+
+    close(null);
+    return status;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* the f64s are i + 0.25, which print the same with %.2f. the script
+ * returns how many bytes it printed. */
+static char* write_script(long n, int f64, size_t* len) {
+    char* source = NULL;
+    FILE* file = open_memstream(&source, len);
+    if (file == NULL)
+        return NULL;
+
+    fprintf(file, "{\n");
+    if (f64) {
+        fprintf(file, "let xs: []f64 = iota(%ld, 0.25);\n", n);
+        fprintf(file, "for (i in 0..%ld) reduce(+) size: i64 {\n    yield println(xs[i]);\n}\n", n);
+    } else {
+        fprintf(file, "for (i in 0..%ld) reduce(+) size: i64 {\n    yield println(i);\n}\n", n);
+    }
+    fprintf(file, "return size;\n}\n");
+
+    if (fclose(file) != 0) {
+        free(source);
+        return NULL;
+    }
+
+    return source;
+}
+
+/* a run to fd, compiling is left out. size is how many bytes it printed. */
+static int bench(const char* source, size_t len, int fd, double* elapsed, size_t* size) {
+    kd_error error;
+    kd_program* program = kd_compile(source, len, &error);
+
+    if (program == NULL) {
+        fprintf(stderr, "(%zu:%zu) ERROR: %s\n", error.line, error.col, error.message);
+        return 1;
+    }
+
+    kd_context* context = kd_context_new();
+    kd_context_set_output(context, fd);
+
+    int status = 0;
+
+    double start = now();
+    kd_status result = kd_run(program, context);
+    *elapsed = now() - start;
+
+    if (result != KD_OK) {
+        const kd_error* error = kd_context_error(context);
+        fprintf(stderr, "(%zu:%zu) ERROR: %s\n", error->line, error->col, error->message);
+        status = 1;
+    }
+
+    *size = kd_context_exit_code(context);
+
+    kd_context_free(context);
+    kd_program_free(program);
+    return status;
+}
+
+static double bench_fprintf(long n, int f64, size_t* size) {
+    *size = 0;
+
+    FILE* file = fopen("/dev/null", "w");
+    if (file == NULL)
+        return 0;
+
+    long long written = 0;
+    double start = now();
+
+    for (long i = 0; i < n; i++) {
+        if (f64)
+            written += fprintf(file, "%.2f\n", i + 0.25);
+        else
+            written += fprintf(file, "%ld\n", i);
+    }
+
+    fflush(file);
+    double elapsed = now() - start;
+
+    fclose(file);
+    *size = written;
+    return elapsed;
+}
+
+static void report(const char* name, double elapsed, size_t size) {
+    double mb = size / 1e6;
+    printf("%-20s %12.3f %10.1f %10.1f\n", name, elapsed * 1e3, mb, mb / elapsed);
+}
@@ -0,0 +1,118 @@
+/* overhead of the sampling profiler.
+ *
+ * a script is compiled and run, the given number of times, with the
+ * profiler off and on at hz, in alternating rounds so that both see the
+ * same noise, and the best round of each is compared. the samples of the
+ * last round are counted, and its stacks printed on stderr.
+ *
+ * usage: bench_profile <file> [hz] [runs] [rounds] */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "kidomaru.h"
+#include "file.h"
+#include "bench.h"
+
+static int bench(const char* source, size_t size, long runs, double* elapsed);
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <file> [hz] [runs] [rounds]\n", argv[0]);
+        return 1;
+    }
+
+    int hz = argc > 2 ? atoi(argv[2]) : 100;
+    long runs = argc > 3 ? atol(argv[3]) : 10;
+    long rounds = argc > 4 ? atol(argv[4]) : 5;
+
+    if (hz < 1 || runs < 1 || rounds < 1) {
+        fprintf(stderr, "Usage: %s <file> [hz] [runs] [rounds]\n", argv[0]);
+        return 1;
+    }
+
+    size_t size;
+    char* source = read_whole_file(argv[1], &size);
+    if (source == NULL || source == ERR_FILE_MISREAD || source == ERR_FILE_EMPTY) {
+        fprintf(stderr, "ERROR: cannot open '%s'!\n", argv[1]);
+        return 1;
+    }
+
+    double best[2] = { 0, 0 };
+    int status = 0;
+
+    for (long round = 0; round < rounds && status == 0; round++) {
+        for (int enabled = 0; enabled <= 1 && status == 0; enabled++) {
+            double elapsed = 0;
+
+            if (enabled && !kd_profile_start(hz)) {
+                fprintf(stderr, "ERROR: cannot start the profiler!\n");
+                status = 1;
+                break;
+            }
+
+            status = bench(source, size, runs, &elapsed);
+
+            if (enabled)
+                kd_profile_stop();
+
+            if (round == 0 || elapsed < best[enabled])
+                best[enabled] = elapsed;
+        }
+    }
+
+    if (status == 0) {
+        long long samples, dropped;
+        kd_profile_counts(&samples, &dropped);
+
+        printf("%-12s %14s\n", "profiler", "run (ms)");
+        printf("%-12s %14.3f\n", "off", best[0] * 1e3);
+        printf("%-12s %14.3f\n", "on", best[1] * 1e3);
+        printf("overhead %.2f%% at %d hz, %lld samples, %lld dropped\n", (best[1] / best[0] - 1) * 100, hz, samples, dropped);
+
+        kd_profile_write(stderr);
+    }
+
+    free(source);
+    return status;
+}
+
+/* runs compiles and runs of source, with what they print discarded. */
+static int bench(const char* source, size_t size, long runs, double* elapsed) {
+    kd_context* context = kd_context_new();
+    if (context == NULL) {
+        fprintf(stderr, "ERROR: cannot allocate memory!\n");
+        return 1;
+    }
+
+    kd_context_set_output(context, -1);
+
+    int status = 0;
+    double start = bench_now();
+
+    for (long i = 0; i < runs && status == 0; i++) {
+        kd_error error;
+        kd_program* program = kd_compile(source, size, &error);
+
+        if (program == NULL) {
+            fprintf(stderr, "(%zu:%zu) ERROR: %s\n", error.line, error.col, error.message);
+            status = 1;
+            break;
+        }
+
+        if (kd_run(program, context) != KD_OK) {
+            const kd_error* error = kd_context_error(context);
+            fprintf(stderr, "(%zu:%zu) ERROR: %s\n", error->line, error->col, error->message);
+            status = 1;
+        }
+
+        size_t printed;
+        kd_context_take_output(context, &printed);
+        kd_program_free(program);
+    }
+
+    *elapsed = bench_now() - start;
+
+    kd_context_free(context);
+    return status;
+}
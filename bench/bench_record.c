@@ -0,0 +1,107 @@
+/* memory and column scan throughput of an array of structs, packed as is
+ * and as struct of arrays, against one Value per field.
+ *
+ * usage: bench_record [elements] [repeats] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "array.h"
+#include "record.h"
+
+#define NFIELDS 8
+
+static double now(void);
+static double scan(const RecordArrayObject* records, size_t offset, long repeats);
+
+/* a checksum of every result, so none of the work can be thrown away. */
+static volatile double sink;
+
+int main(int argc, char** argv) {
+    size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+    long repeats = argc > 2 ? atol(argv[2]) : 50;
+
+    /* struct Particle { x, y, z, vx, vy, vz, mass: f64, id: i64 } */
+    static const char* names[NFIELDS] = { "x", "y", "z", "vx", "vy", "vz", "mass", "id" };
+    RecordField fields[NFIELDS];
+
+    for (size_t i = 0; i < NFIELDS; i++) {
+        fields[i] = (RecordField) {
+            .name = span_from(names[i]),
+            .kind = i == NFIELDS - 1 ? VAL_INT : VAL_DOUBLE,
+            .size = sizeof(int64_t),
+            .offset = i * sizeof(int64_t),
+        };
+    }
+
+    RecordType aos = { .name = span_from("Particle"), .fields = fields, .nfields = NFIELDS, .size = NFIELDS * sizeof(int64_t) };
+    RecordType soa = aos;
+    soa.soa = 1;
+
+    RecordArrayObject* packed = record_array_new(&aos, n);
+    RecordArrayObject* columns = record_array_new(&soa, n);
+    RecordObject* particle = record_new(&aos);
+
+    if (packed == NULL || columns == NULL || particle == NULL) {
+        fprintf(stderr, "ERROR: cannot allocate memory!\n");
+        return 1;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        for (size_t f = 0; f < NFIELDS; f++) {
+            Value value = f == NFIELDS - 1 ? (Value) { .kind = VAL_INT, .i64 = (int64_t)i }
+                                           : (Value) { .kind = VAL_DOUBLE, .f64 = i * 0.5 + f };
+            record_store(particle->data + fields[f].offset, &value);
+        }
+
+        record_array_set(packed, i, particle);
+        record_array_set(columns, i, particle);
+    }
+
+    printf("%zu elements of %d fields, %ld repeats\n", n, NFIELDS, repeats);
+    printf("%-10s %zu bytes/element packed, %zu bytes/element as values\n",
+        "memory", aos.size, NFIELDS * sizeof(Value));
+
+    /* sum(particles.mass) */
+    size_t mass = fields[6].offset;
+
+    double aos_time = scan(packed, mass, repeats);
+    double soa_time = scan(columns, mass, repeats);
+    double elements = (double)n * repeats;
+
+    printf("%-10s aos %8.2f M elements/s   soa %8.2f M elements/s   (%.2fx)\n",
+        "column", elements / aos_time / 1e6, elements / soa_time / 1e6, aos_time / soa_time);
+
+    record_array_release(packed);
+    record_array_release(columns);
+    record_release(particle);
+
+    return 0;
+}
+
+static double scan(const RecordArrayObject* records, size_t offset, long repeats) {
+    double acc = 0;
+    double start = now();
+
+    for (long r = 0; r < repeats; r++) {
+        ArrayObject* column = record_column(records, offset);
+        if (column == NULL) {
+            fprintf(stderr, "ERROR: cannot allocate memory!\n");
+            exit(1);
+        }
+
+        acc += array_sum_f64(column->f64, column->size);
+        array_release(column);
+    }
+
+    sink = acc;
+    return now() - start;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
@@ -0,0 +1,153 @@
+/* run-only throughput of a compiled program.
+ *
+ * the program is compiled once and shared by every thread, each thread owns
+ * one context and calls kd_run in a loop.
+ *
+ * --no-opt compiles it without the ssa passes, to compare against.
+ *
+ * usage: bench_run [--no-opt] <file> [runs per thread] [threads] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "kidomaru.h"
+
+typedef struct Worker_t {
+    pthread_t thread;
+    const kd_program* program;
+    long runs;
+    int failed;
+    kd_quicken_stats quicken;
+} Worker;
+
+static double now(void);
+static void* worker_main(void* arg);
+static double bench(const kd_program* program, long runs, int nthreads);
+static char* read_file(const char* filepath, size_t* size);
+
+int main(int argc, char** argv) {
+    kd_compile_options options = { .optimize = 1, .inline_calls = 1, .dedup = 1 };
+
+    if (argc > 1 && strcmp(argv[1], "--no-opt") == 0) {
+        options.optimize = 0;
+        argv++;
+        argc--;
+    }
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s [--no-opt] <file> [runs per thread] [threads]\n", argv[0]);
+        return 1;
+    }
+
+    long runs = argc > 2 ? atol(argv[2]) : 1000000;
+    int nthreads = argc > 3 ? atoi(argv[3]) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+    size_t size;
+    char* source = read_file(argv[1], &size);
+    if (source == NULL) {
+        fprintf(stderr, "ERROR: cannot open '%s'!\n", argv[1]);
+        return 1;
+    }
+
+    kd_error error;
+    kd_program* program = kd_compile_with(source, size, &options, &error);
+    free(source);
+
+    if (program == NULL) {
+        fprintf(stderr, "(%zu:%zu) ERROR: %s\n", error.line, error.col, error.message);
+        return 1;
+    }
+
+    double single = bench(program, runs, 1);
+    printf("1 thread:   %12.0f runs/s\n", single);
+
+    if (nthreads > 1) {
+        double multi = bench(program, runs, nthreads);
+        printf("%d threads: %12.0f runs/s (%.2fx)\n", nthreads, multi, multi / single);
+    }
+
+    kd_program_free(program);
+    return 0;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void* worker_main(void* arg) {
+    Worker* worker = arg;
+    kd_context* context = kd_context_new();
+
+    for (long i = 0; i < worker->runs; i++) {
+        if (kd_run(worker->program, context) != KD_OK) {
+            worker->failed = 1;
+            break;
+        }
+    }
+
+    kd_context_quicken_stats(context, &worker->quicken);
+    kd_context_free(context);
+    return NULL;
+}
+
+static double bench(const kd_program* program, long runs, int nthreads) {
+    Worker* workers = calloc(nthreads, sizeof(Worker));
+
+    double start = now();
+
+    for (int i = 0; i < nthreads; i++) {
+        workers[i].program = program;
+        workers[i].runs = runs;
+        pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]);
+    }
+
+    int failed = 0;
+    kd_quicken_stats quicken = { 0 };
+
+    for (int i = 0; i < nthreads; i++) {
+        pthread_join(workers[i].thread, NULL);
+        failed |= workers[i].failed;
+
+        quicken.generic += workers[i].quicken.generic;
+        quicken.quickened += workers[i].quicken.quickened;
+        quicken.rewrites += workers[i].quicken.rewrites;
+        quicken.deopts += workers[i].quicken.deopts;
+    }
+
+    double elapsed = now() - start;
+    free(workers);
+
+    long long executed = quicken.generic + quicken.quickened;
+    if (executed != 0) {
+        printf("quickened arithmetic: %.4f%% hits (%lld rewrites, %lld deopts)\n",
+            100.0 * quicken.quickened / executed, quicken.rewrites, quicken.deopts);
+    }
+
+    if (failed)
+        fprintf(stderr, "WARNING: some runs failed\n");
+
+    return (double)runs * nthreads / elapsed;
+}
+
+static char* read_file(const char* filepath, size_t* size) {
+    FILE* file = fopen(filepath, "r");
+    if (file == NULL)
+        return NULL;
+
+    fseek(file, 0, SEEK_END);
+    long file_size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    char* buffer = malloc(file_size > 0 ? file_size : 1);
+    *size = fread(buffer, 1, file_size, file);
+
+    fclose(file);
+    return buffer;
+}
@@ -0,0 +1,102 @@
+/* time to first instruction of a script run once.
+ *
+ * every run compiles the source again and runs it with a fuel of one
+ * instruction, so kd_run returns right after the first one. that is the
+ * time to first instruction. the run is then resumed without a limit to get
+ * the time of the whole run. the tree with and without the ssa passes is
+ * compared against the one-pass compiler, and compiling function bodies on
+ * their first call against compiling all of them up front.
+ *
+ * usage: bench_startup <file> [runs] */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "kidomaru.h"
+#include "file.h"
+#include "bench.h"
+
+typedef struct Mode_t {
+    const char* name;
+    kd_compile_options options;
+} Mode;
+
+static int bench(const Mode* mode, const char* source, size_t size, long runs);
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <file> [runs]\n", argv[0]);
+        return 1;
+    }
+
+    long runs = argc > 2 ? atol(argv[2]) : 1000;
+
+    size_t size;
+    char* source = read_whole_file(argv[1], &size);
+    if (source == NULL || source == ERR_FILE_MISREAD || source == ERR_FILE_EMPTY) {
+        fprintf(stderr, "ERROR: cannot open '%s'!\n", argv[1]);
+        return 1;
+    }
+
+    const Mode modes[] = {
+        { "tree + ssa", { .optimize = 1, .inline_calls = 1, .dedup = 1 } },
+        { "tree", { .optimize = 0, .dedup = 1 } },
+        { "one-pass", { .one_pass = 1 } },
+        { "eager", { .optimize = 1, .inline_calls = 1, .dedup = 1, .eager = 1 } },
+    };
+
+    printf("%-12s %22s %16s %14s\n", "mode", "first instruction (us)", "whole run (us)", "instructions");
+
+    int status = 0;
+    for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); i++)
+        status |= bench(&modes[i], source, size, runs);
+
+    free(source);
+    return status;
+}
+
+static int bench(const Mode* mode, const char* source, size_t size, long runs) {
+    kd_context* context = kd_context_new();
+    double first = 0;
+    double whole = 0;
+    long long executed = 0;
+
+    for (long i = 0; i < runs; i++) {
+        double start = bench_now();
+
+        kd_error error;
+        kd_program* program = kd_compile_with(source, size, &mode->options, &error);
+
+        if (program == NULL) {
+            fprintf(stderr, "(%zu:%zu) ERROR: %s\n", error.line, error.col, error.message);
+            kd_context_free(context);
+            return 1;
+        }
+
+        kd_context_set_fuel(context, 1);
+        kd_status status = kd_run(program, context);
+
+        first += bench_now() - start;
+
+        kd_context_set_fuel(context, 0);
+        if (status == KD_SUSPENDED)
+            status = kd_resume(context);
+
+        whole += bench_now() - start;
+        executed = kd_context_fuel_used(context);
+
+        kd_program_free(program);
+
+        if (status != KD_OK) {
+            const kd_error* error = kd_context_error(context);
+            fprintf(stderr, "(%zu:%zu) ERROR: %s\n", error->line, error->col, error->message);
+            kd_context_free(context);
+            return 1;
+        }
+    }
+
+    printf("%-12s %22.2f %16.2f %14lld\n", mode->name, first / runs * 1e6, whole / runs * 1e6, executed);
+
+    kd_context_free(context);
+    return 0;
+}
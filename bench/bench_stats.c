@@ -0,0 +1,112 @@
+/* overhead of the stats.
+ *
+ * a script is compiled from scratch and run, the given number of times,
+ * with the stats off and on, in alternating rounds so that both see the
+ * same noise, and the best round of each is compared. the counts of the
+ * last round are printed as json.
+ *
+ * usage: bench_stats <file> [runs] [rounds] */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "kidomaru.h"
+#include "file.h"
+#include "bench.h"
+
+static int bench(const char* source, size_t size, long runs, double* elapsed);
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <file> [runs] [rounds]\n", argv[0]);
+        return 1;
+    }
+
+    long runs = argc > 2 ? atol(argv[2]) : 100;
+    long rounds = argc > 3 ? atol(argv[3]) : 5;
+
+    if (runs < 1 || rounds < 1) {
+        fprintf(stderr, "Usage: %s <file> [runs] [rounds]\n", argv[0]);
+        return 1;
+    }
+
+    size_t size;
+    char* source = read_whole_file(argv[1], &size);
+    if (source == NULL || source == ERR_FILE_MISREAD || source == ERR_FILE_EMPTY) {
+        fprintf(stderr, "ERROR: cannot open '%s'!\n", argv[1]);
+        return 1;
+    }
+
+    double best[2] = { 0, 0 };
+    int status = 0;
+
+    for (long round = 0; round < rounds && status == 0; round++) {
+        for (int enabled = 0; enabled <= 1 && status == 0; enabled++) {
+            double elapsed = 0;
+
+            kd_stats_enable(enabled);
+            kd_stats_reset();
+            status = bench(source, size, runs, &elapsed);
+
+            if (round == 0 || elapsed < best[enabled])
+                best[enabled] = elapsed;
+        }
+    }
+
+    kd_stats_enable(0);
+
+    if (status == 0) {
+        kd_stats stats;
+        kd_stats_read(&stats);
+
+        printf("%-12s %14s\n", "stats", "run (ms)");
+        printf("%-12s %14.3f\n", "off", best[0] * 1e3);
+        printf("%-12s %14.3f\n", "on", best[1] * 1e3);
+        printf("overhead %.2f%%\n", (best[1] / best[0] - 1) * 100);
+
+        kd_stats_write_json(&stats, stdout);
+    }
+
+    free(source);
+    return status;
+}
+
+/* runs compiles and runs of source, with what they print discarded. */
+static int bench(const char* source, size_t size, long runs, double* elapsed) {
+    kd_context* context = kd_context_new();
+    if (context == NULL) {
+        fprintf(stderr, "ERROR: cannot allocate memory!\n");
+        return 1;
+    }
+
+    kd_context_set_output(context, -1);
+
+    int status = 0;
+    double start = bench_now();
+
+    for (long i = 0; i < runs && status == 0; i++) {
+        kd_error error;
+        kd_program* program = kd_compile(source, size, &error);
+
+        if (program == NULL) {
+            fprintf(stderr, "(%zu:%zu) ERROR: %s\n", error.line, error.col, error.message);
+            status = 1;
+            break;
+        }
+
+        if (kd_run(program, context) != KD_OK) {
+            const kd_error* error = kd_context_error(context);
+            fprintf(stderr, "(%zu:%zu) ERROR: %s\n", error->line, error->col, error->message);
+            status = 1;
+        }
+
+        size_t printed;
+        kd_context_take_output(context, &printed);
+        kd_program_free(program);
+    }
+
+    *elapsed = bench_now() - start;
+
+    kd_context_free(context);
+    return status;
+}
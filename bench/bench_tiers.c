@@ -0,0 +1,189 @@
+/* tiered execution against compiling everything with or without passes.
+ *
+ * "cold" declares many functions of some size and calls each of them
+ * once, which is all compile and hardly any run. "hot" runs a loop of n
+ * calls to small helpers, which is all run. each is compiled from scratch
+ * and run as many times as asked in every mode, the best time of a compile
+ * and run together is printed, and every mode has to give the same exit
+ * code.
+ *
+ * usage: bench_tiers [n] [runs] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "kidomaru.h"
+
+typedef struct Mode_t {
+    const char* name;
+    kd_compile_options options;
+} Mode;
+
+static double now(void);
+static char* write_cold(size_t* len);
+static char* write_hot(long n, size_t* len);
+static int bench(const Mode* mode, const char* source, size_t len, long runs, double* elapsed, long long* exit_code);
+
+int main(int argc, char** argv) {
+    long n = argc > 1 ? atol(argv[1]) : 1000000;
+    long runs = argc > 2 ? atol(argv[2]) : 5;
+
+    if (n < 1 || runs < 1) {
+        fprintf(stderr, "Usage: %s [n] [runs]\n", argv[0]);
+        return 1;
+    }
+
+    const char* names[2] = { "cold", "hot" };
+    size_t len[2];
+    char* sources[2] = { write_cold(&len[0]), write_hot(n, &len[1]) };
+
+    if (sources[0] == NULL || sources[1] == NULL) {
+        fprintf(stderr, "ERROR: cannot allocate memory!\n");
+        free(sources[0]);
+        free(sources[1]);
+        return 1;
+    }
+
+    const Mode modes[] = {
+        { "no-opt", { .optimize = 0, .dedup = 1 } },
+        { "optimized", { .optimize = 1, .inline_calls = 1, .dedup = 1 } },
+        { "tiered", { .optimize = 1, .inline_calls = 1, .dedup = 1, .tiered = 1 } },
+    };
+    size_t nmodes = sizeof(modes) / sizeof(modes[0]);
+
+    printf("%ld iterations\n", n);
+    printf("%-20s %14s %14s\n", "script", "total (ms)", "vs optimized");
+
+    int status = 0;
+
+    for (size_t s = 0; s < 2 && status == 0; s++) {
+        double elapsed[3];
+        long long exit_codes[3];
+
+        for (size_t i = 0; i < nmodes && status == 0; i++)
+            status = bench(&modes[i], sources[s], len[s], runs, &elapsed[i], &exit_codes[i]);
+
+        for (size_t i = 0; i < nmodes && status == 0; i++) {
+            char name[32];
+            snprintf(name, sizeof(name), "%s %s", names[s], modes[i].name);
+            printf("%-20s %14.3f %13.2fx\n", name, elapsed[i] * 1e3, elapsed[i] / elapsed[1]);
+
+            if (exit_codes[i] != exit_codes[1]) {
+                fprintf(stderr, "ERROR: %s exits with %lld %s, %lld optimized!\n", names[s], exit_codes[i], modes[i].name, exit_codes[1]);
+                status = 1;
+            }
+        }
+    }
+
+    free(sources[0]);
+    free(sources[1]);
+    return status;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static char* write_cold(size_t* len) {
+    char* source = NULL;
+    FILE* file = open_memstream(&source, len);
+    if (file == NULL)
+        return NULL;
+
+    fprintf(file, "{\n");
+
+    for (int f = 0; f < 64; f++) {
+        fprintf(file, "fn f%d(x: i64, y: i64) -> i64 {\n", f);
+        fprintf(file, "    let v0: i64 = x * %d + y;\n", f + 1);
+
+        for (int i = 1; i < 24; i++)
+            fprintf(file, "    let v%d: i64 = v%d * %d + x / %d - y;\n", i, i - 1, i % 7 + 1, i + 1);
+
+        fprintf(file, "    if (v23 != 0) {\n        return v23 / 1000;\n    }\n");
+        fprintf(file, "    return v0;\n}\n");
+    }
+
+    fprintf(file, "return 0");
+    for (int f = 0; f < 64; f++)
+        fprintf(file, " + f%d(%d, %d) / 1000", f, f, 64 - f);
+    fprintf(file, ";\n}\n");
+
+    if (fclose(file) != 0) {
+        free(source);
+        return NULL;
+    }
+
+    return source;
+}
+
+static char* write_hot(long n, size_t* len) {
+    char* source = NULL;
+    FILE* file = open_memstream(&source, len);
+    if (file == NULL)
+        return NULL;
+
+    fprintf(file, "{\n");
+    fprintf(file, "fn sq(x: i64) -> i64 {\n    return x * x;\n}\n");
+    fprintf(file, "fn mix(a: i64, b: i64) -> i64 {\n    return a * 31 + b;\n}\n");
+    fprintf(file, "fn step(x: i64, i: i64) -> i64 {\n");
+    fprintf(file, "    return mix(sq(i), x) / 7;\n}\n");
+    fprintf(file, "for (i in 0..%ld) reduce(+) s: i64 {\n", n);
+    fprintf(file, "    yield step(i, 3) - sq(i / 1000);\n");
+    fprintf(file, "}\n");
+    fprintf(file, "return s / 1000000;\n}\n");
+
+    if (fclose(file) != 0) {
+        free(source);
+        return NULL;
+    }
+
+    return source;
+}
+
+/* the best of runs compiles and runs, each of a program of its own. */
+static int bench(const Mode* mode, const char* source, size_t len, long runs, double* elapsed, long long* exit_code) {
+    kd_context* context = kd_context_new();
+    if (context == NULL) {
+        fprintf(stderr, "ERROR: cannot allocate memory!\n");
+        return 1;
+    }
+
+    int status = 0;
+    *elapsed = 0;
+
+    for (long i = 0; i < runs && status == 0; i++) {
+        kd_error error;
+
+        double start = now();
+        kd_program* program = kd_compile_with(source, len, &mode->options, &error);
+
+        if (program == NULL) {
+            fprintf(stderr, "(%zu:%zu) ERROR: %s\n", error.line, error.col, error.message);
+            status = 1;
+            break;
+        }
+
+        kd_status result = kd_run(program, context);
+        double run = now() - start;
+
+        if (result != KD_OK) {
+            const kd_error* error = kd_context_error(context);
+            fprintf(stderr, "(%zu:%zu) ERROR: %s\n", error->line, error->col, error->message);
+            status = 1;
+        }
+
+        if (i == 0 || run < *elapsed)
+            *elapsed = run;
+
+        *exit_code = kd_context_exit_code(context);
+        kd_program_free(program);
+    }
+
+    kd_context_free(context);
+    return status;
+}
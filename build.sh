@@ -1,3 +1,36 @@
 #!/usr/bin/bash
 
-clang -D_FILE_OFFSET_BITS=64 -Wall -O3 main.c lexer.c ast.c parser.c interpreter.c -o kidomaru
+set -e
+
+CC=${CC:-clang}
+CFLAGS="-D_FILE_OFFSET_BITS=64 -Wall -O3 -fPIC"
+
+SOURCES="value.c array.c map.c record.c lexer.c parser.c resolver.c ir.c ir_opt.c compiler.c onepass.c interpreter.c arena.c pool.c scheduler.c parallel.c stream.c function.c module.c output.c ir_inline.c ir_osr.c tier.c stats.c sample.c kidomaru.c"
+
+mkdir -p build
+
+OBJECTS=""
+for source in $SOURCES; do
+    $CC $CFLAGS -c $source -o build/${source%.c}.o
+    OBJECTS="$OBJECTS build/${source%.c}.o"
+done
+
+ar rcs libkidomaru.a $OBJECTS
+$CC -shared $OBJECTS -o libkidomaru.so -lpthread
+
+$CC $CFLAGS main.c file.c batch.c libkidomaru.a -o kidomaru -lpthread
+$CC $CFLAGS -I. bench/bench_run.c libkidomaru.a -o bench/bench_run -lpthread
+$CC $CFLAGS -fno-tree-vectorize -I. bench/bench_array.c libkidomaru.a -o bench/bench_array -lpthread
+$CC $CFLAGS -I. bench/bench_map.c libkidomaru.a -o bench/bench_map -lpthread
+$CC $CFLAGS -I. bench/bench_record.c libkidomaru.a -o bench/bench_record -lpthread
+$CC $CFLAGS -I. bench/bench_startup.c file.c libkidomaru.a -o bench/bench_startup -lpthread
+$CC $CFLAGS -I. bench/bench_modules.c libkidomaru.a -o bench/bench_modules -lpthread
+$CC $CFLAGS -I. bench/bench_parallel.c libkidomaru.a -o bench/bench_parallel -lpthread
+$CC $CFLAGS -I. bench/bench_loops.c libkidomaru.a -o bench/bench_loops -lpthread
+$CC $CFLAGS -I. bench/bench_print.c libkidomaru.a -o bench/bench_print -lpthread
+$CC $CFLAGS -I. bench/bench_inline.c libkidomaru.a -o bench/bench_inline -lpthread
+$CC $CFLAGS -I. bench/bench_stats.c file.c libkidomaru.a -o bench/bench_stats -lpthread
+$CC $CFLAGS -I. bench/bench_tiers.c libkidomaru.a -o bench/bench_tiers -lpthread
+$CC $CFLAGS -I. bench/bench_profile.c file.c libkidomaru.a -o bench/bench_profile -lpthread
+
+CC=$CC tests/run.sh
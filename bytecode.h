@@ -0,0 +1,248 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "ast.h"
+
+/* R(x) is register x of the running chunk, K(x) is its constant x and G(x)
+ * is global x of the interpreter. a register or global owns a reference to
+ * the string it holds, constants never hold counted strings. */
+typedef enum OpCode_t {
+    OP_LOADK,       /* R(a) = K(bx) */
+    OP_MOVE,        /* R(a) = R(b) */
+
+    OP_ADD,         /* R(a) = R(b) + R(c) */
+    OP_SUB,
+    OP_MUL,
+    OP_DIV,
+
+    OP_ADDK,        /* R(a) = R(b) + K(c) */
+    OP_SUBK,
+    OP_MULK,
+    OP_DIVK,
+
+    OP_EQ,          /* R(a) = R(b) == R(c) */
+    OP_NE,
+    OP_EQK,         /* R(a) = R(b) == K(c) */
+    OP_NEK,
+
+    /* strength reduced arithmetic, R(b) is known to be an i64. */
+    OP_SHL_I64,     /* R(a) = R(b) << c */
+    OP_DIVPOW2_I64, /* R(a) = R(b) / 2^c rounded towards zero */
+
+    /* the test of a for loop, both operands are known to be i64s. */
+    OP_LT_I64,      /* R(a) = R(b) < R(c) */
+    OP_LTK_I64,     /* R(a) = R(b) < K(c) */
+
+    OP_LEN,         /* R(a) = the length of the string or array R(b) */
+    OP_BUILTIN,     /* R(a) = builtin c called with the arguments from R(b) on */
+
+    OP_NEWARRAY,    /* R(a) = an array of the c values from R(b) on */
+    OP_INDEX,       /* R(a) = element R(c) of R(b), or the value of key R(c) of map R(b) */
+
+    OP_NEWMAP,      /* R(a) = an empty map from ValueKind b to ValueKind c */
+    OP_MAPSET,      /* key R(b) of map R(a) = R(c) */
+
+    OP_NEWRECORD,   /* R(a) = a struct of type records[c] with its fields from R(b) on */
+    OP_FIELD,       /* R(a) = field c of struct R(b), see field_operand */
+    OP_INDEXFIELD,  /* R(a) = field bx of the next instruction of element R(c) of R(b) */
+    OP_COLUMN,      /* R(a) = field c of every element of R(b) */
+    OP_EXTRAARG,    /* bx is an operand of the instruction before, never run */
+
+    OP_DEFINE,      /* R(a) is a new variable, check it is of the type c, see define_operand */
+
+    OP_GETGLOBAL,   /* R(a) = G(bx), a variable of the stream the chunk is a statement of */
+    OP_SETGLOBAL,   /* G(bx) = R(a), G(bx) is not set yet */
+
+    OP_CALL,        /* R(a) = function c of Chunk.functions called with the arguments from R(b) on */
+
+    OP_SPAWN,       /* start task a of Chunk.tasks on another thread with its arguments from R(b) on */
+    OP_JOIN,        /* R(a) = the result of task b once it is done */
+    OP_PARFOR,      /* R(a) = the result of par for c of Chunk.parfors run with its arguments from R(b) on */
+
+    OP_JMP,         /* pc += sbx */
+    OP_JMPIFNOT,    /* if not R(a) then pc += sbx */
+    OP_LOOP,        /* pc += sbx back to the start of a loop, counting the jump in backedges[a] */
+
+    OP_RETURN,      /* return R(a) to the caller, or stop with it as the result */
+    OP_HALT,        /* stop without a result */
+
+    /* quickened forms. a generic arithmetic instruction rewrites itself into
+     * one of these after it has run once, assuming the operand kinds it saw.
+     * they check that assumption and turn back into the generic form when it
+     * does not hold, so every form is correct whichever one a thread sees. */
+    OP_ADD_I64,
+    OP_SUB_I64,
+    OP_MUL_I64,
+    OP_DIV_I64,
+
+    OP_ADD_F64,
+    OP_SUB_F64,
+    OP_MUL_F64,
+    OP_DIV_F64,
+
+    OP_ADDK_I64,    /* the constant is known to be an i64, only R(b) is checked */
+    OP_SUBK_I64,
+    OP_MULK_I64,
+    OP_DIVK_I64,    /* the constant is also known not to be 0 or -1 */
+
+    OP_ADDK_F64,
+    OP_SUBK_F64,
+    OP_MULK_F64,
+    OP_DIVK_F64,
+} OpCode;
+
+typedef struct Instr_t {
+    uint16_t op;
+    uint16_t a;
+
+    union {
+        struct {
+            uint16_t b;
+            uint16_t c;
+        };
+
+        uint32_t bx;
+        int32_t sbx;
+    };
+} Instr;
+
+/* the type of a variable declaration as the c operand of OP_DEFINE: the kind
+ * in the low 4 bits, then the key and value kinds of a map, or record, the
+ * index of a struct in Chunk.records. */
+#define MAX_RECORD_TYPES 4096
+
+static inline uint16_t define_operand(Type type, size_t record) {
+    if (type.kind == VAL_RECORD || type.kind == VAL_RECORD_ARRAY)
+        return type.kind | record << 4;
+
+    return type.kind | type.key << 4 | type.value << 8;
+}
+
+/* a field as an operand: its offset above the low 2 bits, which are 0 for
+ * an i64, 1 for an f64 and 2 for a bool. RECORD_MAX_SIZE keeps it in 16
+ * bits. */
+static inline uint16_t field_operand(const RecordField* field) {
+    return field->offset << 2 | (field->kind == VAL_INT ? 0 : field->kind == VAL_DOUBLE ? 1 : 2);
+}
+
+static inline size_t field_operand_offset(uint32_t operand) {
+    return operand >> 2;
+}
+
+static inline ValueKind field_operand_kind(uint32_t operand) {
+    static const ValueKind kinds[] = { VAL_INT, VAL_DOUBLE, VAL_BOOL, VAL_BOOL };
+    return kinds[operand & 3];
+}
+
+static inline size_t field_operand_size(uint32_t operand) {
+    return (operand & 3) == 2 ? 1 : sizeof(int64_t);
+}
+
+typedef struct Position_t {
+    uint32_t line;
+    uint32_t col;
+} Position;
+
+struct Chunk_t;
+
+/* a let at the top level of a program compiled on its own to run on
+ * another thread, see IrTask. its chunk finds the results of the tasks in
+ * deps in its first registers and the nargs values OP_SPAWN copies after
+ * them. the tasks in dependents are the ones that wait for its result. */
+typedef struct ChunkTask_t {
+    const struct Chunk_t* chunk;
+
+    const uint16_t* deps;
+    size_t ndeps;
+    size_t nargs;
+
+    const uint16_t* dependents;
+    size_t ndependents;
+} ChunkTask;
+
+#define MAX_TASKS UINT16_MAX
+
+/* the body of a par for compiled on its own, see IrParFor. its chunk runs
+ * the iterations from R(0) up to R(1), finding the nargs - 2 values the
+ * body reads from around the loop after them, and returns what they
+ * yielded combined with op: a VAL_INT or VAL_DOUBLE as kind says, or a
+ * VAL_INT 0 when op is 0 and the loop reduces nothing. */
+typedef struct ChunkParFor_t {
+    const struct Chunk_t* chunk;
+    size_t nargs;
+
+    char op;
+    ValueKind kind;
+} ChunkParFor;
+
+#define MAX_PARFORS UINT16_MAX
+#define MAX_LOOPS UINT16_MAX
+
+/* a backedge counter stops counting there, see Chunk.backedges. */
+#define BACKEDGE_LIMIT (1u << 16)
+
+/* a loop of a chunk compiled from ssa form with IrFunction.record_loops:
+ * the block it jumps back to, and the values live at its OP_LOOP with the
+ * registers they are in there, the phis of that block first. what the
+ * next tier needs to go on with the loop from there, see tier.h. */
+typedef struct ChunkLoop_t {
+    uint32_t header;
+
+    const uint32_t* values;
+    const uint16_t* registers;
+    size_t nvalues;
+} ChunkLoop;
+
+/* the compiled form of a program. apart from quickening, which only ever
+ * swaps an opcode for an equivalent one, the backedge counters and what its
+ * tier counts, a chunk is never written after it has been compiled.
+ * everything else a run changes lives in the Interpreter. */
+typedef struct Chunk_t {
+    Instr* code;
+    Position* positions; /* the source location of every instruction. */
+    size_t size;
+
+    Value* constants;
+    size_t nconstants;
+
+    /* every struct type the chunk makes or declares a variable of, in the
+     * order it first uses them. */
+    const RecordType** records;
+    size_t nrecords;
+
+    /* the table the c operand of OP_CALL indexes, which starts with the
+     * functions imported into it. */
+    const struct Functions_t* functions;
+
+    /* the tasks OP_SPAWN starts, in the order of their statements. */
+    const ChunkTask* tasks;
+    size_t ntasks;
+
+    /* the par fors OP_PARFOR runs, in the order of their statements. */
+    const ChunkParFor* parfors;
+    size_t nparfors;
+
+    /* how often each loop has jumped back to its start, by the a operand
+     * of its OP_LOOP. like quickening, counting never changes what a run
+     * does, so threads count with relaxed atomics and a counter stops at
+     * BACKEDGE_LIMIT. */
+    uint32_t* backedges;
+    size_t nbackedges;
+
+    /* one for each loop, by the a operand of its OP_LOOP, when the chunk
+     * was compiled with IrFunction.record_loops, NULL otherwise. */
+    const ChunkLoop* loops;
+
+    /* set on a chunk of the first tier, NULL on any other, see tier.h. */
+    struct Tier_t* tier;
+
+    /* variables live in registers too, a block's variables take the ones
+     * above the variables of the blocks around it. the chunk of a function
+     * finds its arguments in the first ones. */
+    size_t nregisters;
+} Chunk;
+
+#endif /* BYTECODE_H */
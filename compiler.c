@@ -0,0 +1,1183 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+
+#include "compiler.h"
+#include "stats.h"
+
+#define MAX_REGISTERS UINT16_MAX
+#define MAX_CONSTANTS UINT16_MAX
+
+#define NO_REGISTER UINT32_MAX
+
+/* registers are given out by linear scan. every value that needs one lives
+ * from the first to the last point of the layout where it is live, and
+ * gets the lowest register free for all of that. copies share the register
+ * of what they copy, and so does a DEFINE, which checks a value in place.
+ * constants never get one: they are read as the constant operand of an
+ * instruction, or loaded into a temporary right before the instruction that
+ * needs them in a register. */
+typedef struct Compiler_t {
+    Arena* arena;
+    IrFunction* function;
+
+    /* the chunk is built in malloc'd buffers and copied into the arena once
+     * its final size is known. */
+    Instr* code;
+    Position* positions;
+    size_t size;
+    size_t capacity;
+
+    Value* constants;
+    size_t nconstants;
+    size_t constants_capacity;
+
+    /* by value: the value whose register it shares, that value's register
+     * and, for a constant, its index in the constants. */
+    uint32_t* homes;
+    uint32_t* registers;
+    uint32_t* constant_indexes;
+
+    /* by instruction, and by block for its exit: the first of the
+     * temporaries it loads constants or gathers its operands into. */
+    uint32_t* scratch;
+    uint32_t* exit_scratch;
+    size_t nregisters;
+
+    /* the reachable blocks in the order they are emitted, each block's
+     * place in it and where its code starts. */
+    uint32_t* order;
+    size_t norder;
+    size_t* places;
+    size_t* starts;
+
+    /* the layout position of every instruction and of the start and exit of
+     * every block. */
+    size_t* positions_of;
+    size_t* froms;
+    size_t* exits;
+    size_t npositions;
+
+    /* jumps to patch once every block has been emitted, with their target
+     * blocks. */
+    size_t* jumps;
+    uint32_t* jump_targets;
+    size_t njumps;
+    size_t jumps_capacity;
+
+    /* the OP_LOOPs emitted so far, each counts in a slot of its own, and
+     * what is recorded of them with IrFunction.record_loops. */
+    size_t nbackedges;
+    ChunkLoop* loops;
+
+    /* by block, the values that need a register live at its start. */
+    uint32_t** live_in;
+
+    kd_error* error;
+} Compiler;
+
+static void compile_error(Compiler* compiler, size_t line, size_t col, const char* fmt, ...);
+static void out_of_memory(Compiler* compiler);
+static void* scratch_alloc(Compiler* compiler, size_t size);
+
+static size_t emit(Compiler* compiler, Instr instr, size_t line, size_t col);
+static void emit_jump(Compiler* compiler, Instr instr, uint32_t target, size_t line, size_t col);
+static uint16_t add_constant(Compiler* compiler, uint32_t constant);
+static uint16_t record_slot(Compiler* compiler, const RecordType* record, size_t line, size_t col);
+
+static void split_critical_edges(Compiler* compiler);
+static void lay_out(Compiler* compiler);
+static uint32_t home(Compiler* compiler, uint32_t value);
+static int needs_register(Compiler* compiler, uint32_t value);
+static uint32_t* live_out(Compiler* compiler, uint32_t block, uint32_t* const* live_in, uint32_t* live, size_t nwords);
+static void allocate_registers(Compiler* compiler);
+static uint32_t allocate(Compiler* compiler, size_t* busy, size_t count, size_t start, size_t end, size_t line, size_t col);
+static size_t temporaries(Compiler* compiler, const IrInstr* instr);
+static int consecutive(Compiler* compiler, const IrInstr* instr);
+
+static void compile_block(Compiler* compiler, size_t place);
+static void compile_instr(Compiler* compiler, uint32_t id);
+static void compile_exit(Compiler* compiler, size_t place);
+static void compile_phi_moves(Compiler* compiler, uint32_t block, uint32_t succ, uint32_t scratch);
+static void record_loop(Compiler* compiler, uint32_t header);
+static uint16_t operand(Compiler* compiler, uint32_t value, uint32_t* scratch, size_t line, size_t col);
+static uint16_t gather(Compiler* compiler, const IrInstr* instr, uint32_t id);
+
+static OpCode binary_opcode(char op, int constant_rhs);
+static OpCode specialise(OpCode generic, ValueKind lhs, ValueKind rhs, const Value* constant);
+
+kd_status compile_program(Arena* arena, IrFunction* function, Chunk* chunk, kd_error* error) {
+    Compiler compiler = {
+        .arena = arena,
+        .function = function,
+        .error = error,
+    };
+
+    function->error = error;
+
+    int64_t started = stats_start();
+
+    if (setjmp(function->bail)) {
+        free(compiler.code);
+        free(compiler.positions);
+        free(compiler.constants);
+        free(compiler.jumps);
+        free(compiler.jump_targets);
+
+        stats_stop(KD_PHASE_CODEGEN, started);
+        return error->status;
+    }
+
+    split_critical_edges(&compiler);
+    lay_out(&compiler);
+    allocate_registers(&compiler);
+
+    /* a loop ends in a block of its own, so there are fewer than blocks. */
+    if (function->record_loops)
+        compiler.loops = scratch_alloc(&compiler, compiler.norder * sizeof(ChunkLoop));
+
+    for (size_t i = 0; i < compiler.norder; i++)
+        compile_block(&compiler, i);
+
+    for (size_t i = 0; i < compiler.njumps; i++) {
+        size_t jump = compiler.jumps[i];
+        compiler.code[jump].sbx = (int32_t)(compiler.starts[compiler.jump_targets[i]] - jump - 1);
+    }
+
+    chunk->size = compiler.size;
+    chunk->nconstants = compiler.nconstants;
+    chunk->nrecords = function->nrecords;
+    chunk->nregisters = compiler.nregisters;
+    chunk->tasks = NULL;
+    chunk->ntasks = 0;
+    chunk->parfors = NULL;
+    chunk->nparfors = 0;
+    chunk->nbackedges = compiler.nbackedges;
+    chunk->loops = NULL;
+    chunk->tier = NULL;
+
+    chunk->code = arena_alloc(arena, (compiler.size + 1) * sizeof(Instr));
+    chunk->positions = arena_alloc(arena, (compiler.size + 1) * sizeof(Position));
+    chunk->constants = arena_alloc(arena, (compiler.nconstants + 1) * sizeof(Value));
+    chunk->records = arena_alloc(arena, (function->nrecords + 1) * sizeof(RecordType*));
+    chunk->backedges = arena_alloc(arena, (compiler.nbackedges + 1) * sizeof(uint32_t));
+
+    if (chunk->code == NULL || chunk->positions == NULL || chunk->constants == NULL || chunk->records == NULL
+        || chunk->backedges == NULL)
+        out_of_memory(&compiler);
+
+    /* the stats count a chunk as one piece. */
+    stats_alloc(KD_MEMORY_BYTECODE, (compiler.size + 1) * (sizeof(Instr) + sizeof(Position)) + (compiler.nconstants + 1) * sizeof(Value)
+        + (function->nrecords + 1) * sizeof(RecordType*) + (compiler.nbackedges + 1) * sizeof(uint32_t));
+
+    memset(chunk->backedges, 0, (compiler.nbackedges + 1) * sizeof(uint32_t));
+
+    if (function->record_loops) {
+        ChunkLoop* loops = arena_alloc(arena, (compiler.nbackedges + 1) * sizeof(ChunkLoop));
+        if (loops == NULL)
+            out_of_memory(&compiler);
+
+        if (compiler.nbackedges > 0)
+            memcpy(loops, compiler.loops, compiler.nbackedges * sizeof(ChunkLoop));
+
+        chunk->loops = loops;
+    }
+
+    if (compiler.size > 0) {
+        memcpy(chunk->code, compiler.code, compiler.size * sizeof(Instr));
+        memcpy(chunk->positions, compiler.positions, compiler.size * sizeof(Position));
+    }
+    if (compiler.nconstants > 0)
+        memcpy(chunk->constants, compiler.constants, compiler.nconstants * sizeof(Value));
+    if (function->nrecords > 0)
+        memcpy(chunk->records, function->records, function->nrecords * sizeof(RecordType*));
+
+    free(compiler.code);
+    free(compiler.positions);
+    free(compiler.constants);
+    free(compiler.jumps);
+    free(compiler.jump_targets);
+
+    stats_stop(KD_PHASE_CODEGEN, started);
+    return KD_OK;
+}
+
+static void compile_error(Compiler* compiler, size_t line, size_t col, const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+
+    compiler->error->status = KD_ERROR_SYNTAX;
+    compiler->error->line = line;
+    compiler->error->col = col;
+    vsnprintf(compiler->error->message, sizeof(compiler->error->message), fmt, args);
+
+    va_end(args);
+    longjmp(compiler->function->bail, 1);
+}
+
+static void out_of_memory(Compiler* compiler) {
+    compiler->error->status = KD_ERROR_NOMEM;
+    compiler->error->line = 0;
+    compiler->error->col = 0;
+    snprintf(compiler->error->message, sizeof(compiler->error->message), "cannot allocate memory!");
+
+    longjmp(compiler->function->bail, 1);
+}
+
+/* bookkeeping that only lives as long as the ir does. */
+static void* scratch_alloc(Compiler* compiler, size_t size) {
+    void* data = arena_alloc(&compiler->function->arena, size == 0 ? 1 : size);
+    if (data == NULL)
+        out_of_memory(compiler);
+
+    return data;
+}
+
+static size_t emit(Compiler* compiler, Instr instr, size_t line, size_t col) {
+    if (compiler->size == compiler->capacity) {
+        size_t capacity = compiler->capacity == 0 ? 64 : compiler->capacity * 2;
+
+        Instr* code = realloc(compiler->code, capacity * sizeof(Instr));
+        if (code == NULL)
+            out_of_memory(compiler);
+        compiler->code = code;
+
+        Position* positions = realloc(compiler->positions, capacity * sizeof(Position));
+        if (positions == NULL)
+            out_of_memory(compiler);
+        compiler->positions = positions;
+
+        compiler->capacity = capacity;
+    }
+
+    compiler->code[compiler->size] = instr;
+    compiler->positions[compiler->size] = (Position) {
+        .line = line,
+        .col = col,
+    };
+
+    return compiler->size++;
+}
+
+/* the jump is pointed at the start of target once it is known. */
+static void emit_jump(Compiler* compiler, Instr instr, uint32_t target, size_t line, size_t col) {
+    if (compiler->njumps == compiler->jumps_capacity) {
+        size_t capacity = compiler->jumps_capacity == 0 ? 16 : compiler->jumps_capacity * 2;
+
+        size_t* jumps = realloc(compiler->jumps, capacity * sizeof(size_t));
+        if (jumps == NULL)
+            out_of_memory(compiler);
+        compiler->jumps = jumps;
+
+        uint32_t* jump_targets = realloc(compiler->jump_targets, capacity * sizeof(uint32_t));
+        if (jump_targets == NULL)
+            out_of_memory(compiler);
+        compiler->jump_targets = jump_targets;
+
+        compiler->jumps_capacity = capacity;
+    }
+
+    compiler->jumps[compiler->njumps] = emit(compiler, instr, line, col);
+    compiler->jump_targets[compiler->njumps++] = target;
+}
+
+/* every constant instruction gets one entry, however often it is used. */
+static uint16_t add_constant(Compiler* compiler, uint32_t constant) {
+    if (compiler->constant_indexes[constant] != NO_REGISTER)
+        return compiler->constant_indexes[constant];
+
+    const IrInstr* instr = &compiler->function->instrs[constant];
+
+    if (compiler->nconstants == MAX_CONSTANTS)
+        compile_error(compiler, instr->line, instr->col, "too many constants in one program");
+
+    if (compiler->nconstants == compiler->constants_capacity) {
+        size_t capacity = compiler->constants_capacity == 0 ? 16 : compiler->constants_capacity * 2;
+
+        Value* constants = realloc(compiler->constants, capacity * sizeof(Value));
+        if (constants == NULL)
+            out_of_memory(compiler);
+
+        compiler->constants = constants;
+        compiler->constants_capacity = capacity;
+    }
+
+    compiler->constants[compiler->nconstants] = instr->constant;
+    compiler->constant_indexes[constant] = compiler->nconstants;
+
+    return compiler->nconstants++;
+}
+
+/* the index of record in the chunk's structs. the ones the program declares
+ * are there already, one it imports is added the first time it is used. */
+static uint16_t record_slot(Compiler* compiler, const RecordType* record, size_t line, size_t col) {
+    IrFunction* function = compiler->function;
+
+    for (size_t i = 0; i < function->nrecords; i++) {
+        if (function->records[i] == record)
+            return i;
+    }
+
+    if (function->nrecords == MAX_RECORD_TYPES)
+        compile_error(compiler, line, col, "too many structs");
+
+    if (function->nrecords == function->records_capacity) {
+        size_t capacity = function->records_capacity == 0 ? 8 : function->records_capacity * 2;
+
+        const RecordType** records = realloc(function->records, capacity * sizeof(RecordType*));
+        if (records == NULL)
+            out_of_memory(compiler);
+
+        function->records = records;
+        function->records_capacity = capacity;
+    }
+
+    function->records[function->nrecords] = record;
+    return function->nrecords++;
+}
+
+/* the moves into the phis of a block are made at the end of each pred. a
+ * pred that branches gets a block of its own for them on that edge. */
+static void split_critical_edges(Compiler* compiler) {
+    IrFunction* function = compiler->function;
+    size_t nblocks = function->nblocks;
+
+    for (uint32_t b = 0; b < nblocks; b++) {
+        if (function->blocks[b].dead || function->blocks[b].exit != IR_BRANCH)
+            continue;
+
+        for (int s = 0; s < 2; s++) {
+            uint32_t succ = function->blocks[b].succs[s];
+            const IrBlock* target = &function->blocks[succ];
+
+            if (target->ninstrs == 0 || function->instrs[target->instrs[0]].op != IR_PHI)
+                continue;
+
+            uint32_t edge = ir_new_block(function);
+            IrBlock* block = &function->blocks[edge];
+
+            block->exit = IR_JUMP;
+            block->succs[0] = succ;
+            block->line = function->blocks[b].line;
+            block->col = function->blocks[b].col;
+            block->sealed = 1;
+            ir_add_edge(function, b, edge);
+
+            function->blocks[b].succs[s] = edge;
+
+            IrBlock* join = &function->blocks[succ];
+            for (size_t p = 0; p < join->npreds; p++) {
+                if (join->preds[p] == b) {
+                    join->preds[p] = edge;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+/* blocks in reverse postorder, so the code of an if falls through into its
+ * then side, and numbers every point of the layout. */
+static void lay_out(Compiler* compiler) {
+    IrFunction* function = compiler->function;
+    size_t nblocks = function->nblocks;
+
+    compiler->order = scratch_alloc(compiler, nblocks * sizeof(uint32_t));
+    compiler->norder = ir_reverse_postorder(function, compiler->order);
+
+    compiler->places = scratch_alloc(compiler, nblocks * sizeof(size_t));
+    compiler->starts = scratch_alloc(compiler, nblocks * sizeof(size_t));
+    compiler->froms = scratch_alloc(compiler, nblocks * sizeof(size_t));
+    compiler->exits = scratch_alloc(compiler, nblocks * sizeof(size_t));
+    compiler->exit_scratch = scratch_alloc(compiler, nblocks * sizeof(uint32_t));
+
+    size_t ninstrs = function->ninstrs;
+
+    compiler->positions_of = scratch_alloc(compiler, ninstrs * sizeof(size_t));
+    compiler->homes = scratch_alloc(compiler, ninstrs * sizeof(uint32_t));
+    compiler->registers = scratch_alloc(compiler, ninstrs * sizeof(uint32_t));
+    compiler->constant_indexes = scratch_alloc(compiler, ninstrs * sizeof(uint32_t));
+    compiler->scratch = scratch_alloc(compiler, ninstrs * sizeof(uint32_t));
+
+    for (size_t i = 0; i < ninstrs; i++) {
+        compiler->homes[i] = IR_NONE;
+        compiler->registers[i] = NO_REGISTER;
+        compiler->constant_indexes[i] = NO_REGISTER;
+        compiler->scratch[i] = NO_REGISTER;
+    }
+
+    size_t position = 0;
+
+    for (size_t i = 0; i < compiler->norder; i++) {
+        uint32_t b = compiler->order[i];
+        const IrBlock* block = &function->blocks[b];
+
+        compiler->places[b] = i;
+        compiler->exit_scratch[b] = NO_REGISTER;
+        compiler->froms[b] = position++;
+
+        for (size_t j = 0; j < block->ninstrs; j++)
+            compiler->positions_of[block->instrs[j]] = position++;
+
+        compiler->exits[b] = position++;
+    }
+
+    compiler->npositions = position;
+}
+
+/* a DEFINE of a constant has to load it into a register of its own. */
+static uint32_t home(Compiler* compiler, uint32_t value) {
+    if (compiler->homes[value] != IR_NONE)
+        return compiler->homes[value];
+
+    const IrInstr* instr = &compiler->function->instrs[value];
+    uint32_t result = value;
+
+    if (instr->op == IR_COPY) {
+        result = home(compiler, instr->args[0]);
+    } else if (instr->op == IR_DEFINE) {
+        uint32_t checked = home(compiler, instr->args[0]);
+
+        if (compiler->function->instrs[checked].op != IR_CONST)
+            result = checked;
+    }
+
+    compiler->homes[value] = result;
+    return result;
+}
+
+static int needs_register(Compiler* compiler, uint32_t value) {
+    IrOp op = compiler->function->instrs[value].op;
+    return home(compiler, value) == value && op != IR_CONST && op != IR_MAPSET && op != IR_SETGLOBAL && op != IR_SPAWN;
+}
+
+#define SET(bits, i) ((bits)[(i) / 32] |= 1u << (i) % 32)
+#define CLEAR(bits, i) ((bits)[(i) / 32] &= ~(1u << (i) % 32))
+#define TEST(bits, i) ((bits)[(i) / 32] >> (i) % 32 & 1)
+
+/* the values live at the end of block: whatever its succs need, and the
+ * operands of their phis on the edges from block. */
+static uint32_t* live_out(Compiler* compiler, uint32_t block, uint32_t* const* live_in, uint32_t* live, size_t nwords) {
+    const IrFunction* function = compiler->function;
+    const IrBlock* current = &function->blocks[block];
+
+    memset(live, 0, nwords * sizeof(uint32_t));
+
+    int nsuccs = current->exit == IR_JUMP ? 1 : current->exit == IR_BRANCH ? 2 : 0;
+
+    for (int s = 0; s < nsuccs; s++) {
+        uint32_t succ = current->succs[s];
+        const IrBlock* target = &function->blocks[succ];
+
+        for (size_t w = 0; w < nwords; w++)
+            live[w] |= live_in[succ][w];
+
+        size_t pred = 0;
+        while (target->preds[pred] != block)
+            pred++;
+
+        for (size_t i = 0; i < target->ninstrs; i++) {
+            const IrInstr* phi = &function->instrs[target->instrs[i]];
+            if (phi->op != IR_PHI)
+                break;
+
+            uint32_t value = home(compiler, phi->args[pred]);
+            if (needs_register(compiler, value))
+                SET(live, value);
+        }
+    }
+
+    if (current->value != IR_NONE) {
+        uint32_t value = home(compiler, current->value);
+        if (needs_register(compiler, value))
+            SET(live, value);
+    }
+
+    return live;
+}
+
+/* the values an instruction reads from registers. a DEFINE reads the value
+ * it checks, unless that is a constant loaded into the DEFINE's own
+ * register. */
+#define FOR_EACH_USE(compiler, instr, id, use, body)                                    \
+    if ((instr)->op == IR_DEFINE) {                                                     \
+        uint32_t use = home(compiler, id);                                              \
+        if (use != (id)) { body }                                                       \
+    } else if ((instr)->op != IR_PHI && (instr)->op != IR_COPY) {                       \
+        for (size_t a_ = 0; a_ < (instr)->nargs; a_++) {                                \
+            uint32_t use = home(compiler, (instr)->args[a_]);                           \
+            if (needs_register(compiler, use)) { body }                                 \
+        }                                                                               \
+    }
+
+static void allocate_registers(Compiler* compiler) {
+    IrFunction* function = compiler->function;
+    size_t ninstrs = function->ninstrs;
+    size_t nwords = (ninstrs + 31) / 32;
+
+    for (size_t i = 0; i < ninstrs; i++)
+        home(compiler, i);
+
+    /* the values live at the start of every block, until nothing changes. */
+    uint32_t** live_in = scratch_alloc(compiler, function->nblocks * sizeof(uint32_t*));
+    compiler->live_in = live_in;
+    for (size_t i = 0; i < compiler->norder; i++) {
+        live_in[compiler->order[i]] = scratch_alloc(compiler, nwords * sizeof(uint32_t));
+        memset(live_in[compiler->order[i]], 0, nwords * sizeof(uint32_t));
+    }
+
+    uint32_t* live = scratch_alloc(compiler, nwords * sizeof(uint32_t));
+    int changed = 1;
+
+    while (changed) {
+        changed = 0;
+
+        for (size_t i = compiler->norder; i-- > 0;) {
+            uint32_t b = compiler->order[i];
+            const IrBlock* block = &function->blocks[b];
+
+            live_out(compiler, b, live_in, live, nwords);
+
+            for (size_t j = block->ninstrs; j-- > 0;) {
+                uint32_t id = block->instrs[j];
+                const IrInstr* instr = &function->instrs[id];
+
+                if (needs_register(compiler, id))
+                    CLEAR(live, id);
+
+                FOR_EACH_USE(compiler, instr, id, use, SET(live, use);)
+            }
+
+            if (memcmp(live, live_in[b], nwords * sizeof(uint32_t)) != 0) {
+                memcpy(live_in[b], live, nwords * sizeof(uint32_t));
+                changed = 1;
+            }
+        }
+    }
+
+    /* the first and last point where each value is live. */
+    size_t* starts = scratch_alloc(compiler, ninstrs * sizeof(size_t));
+    size_t* ends = scratch_alloc(compiler, ninstrs * sizeof(size_t));
+
+    for (size_t i = 0; i < ninstrs; i++) {
+        starts[i] = SIZE_MAX;
+        ends[i] = 0;
+    }
+
+#define EXTEND(value, position)                                     \
+    do {                                                            \
+        if ((position) < starts[value]) starts[value] = (position); \
+        if ((position) > ends[value]) ends[value] = (position);     \
+    } while (0)
+
+    for (size_t i = 0; i < compiler->norder; i++) {
+        uint32_t b = compiler->order[i];
+        const IrBlock* block = &function->blocks[b];
+
+        live_out(compiler, b, live_in, live, nwords);
+
+        for (size_t w = 0; w < nwords; w++) {
+            for (uint32_t in = live_in[b][w], out = live[w]; in | out; ) {
+                uint32_t bits = in | out;
+                uint32_t bit = __builtin_ctz(bits);
+                uint32_t value = w * 32 + bit;
+
+                if (in >> bit & 1)
+                    EXTEND(value, compiler->froms[b]);
+                if (out >> bit & 1)
+                    EXTEND(value, compiler->exits[b]);
+
+                in &= ~(1u << bit);
+                out &= ~(1u << bit);
+            }
+        }
+
+        for (size_t j = 0; j < block->ninstrs; j++) {
+            uint32_t id = block->instrs[j];
+            const IrInstr* instr = &function->instrs[id];
+            size_t position = compiler->positions_of[id];
+
+            /* a phi is written at the end of every pred. */
+            if (instr->op == IR_PHI) {
+                EXTEND(id, compiler->froms[b]);
+                for (size_t p = 0; p < block->npreds; p++)
+                    EXTEND(id, compiler->exits[block->preds[p]]);
+            } else if (needs_register(compiler, id)) {
+                EXTEND(id, position);
+            }
+
+            FOR_EACH_USE(compiler, instr, id, use, EXTEND(use, position);)
+        }
+    }
+
+#undef EXTEND
+
+    /* values by the point they start at. */
+    size_t* counts = scratch_alloc(compiler, (compiler->npositions + 1) * sizeof(size_t));
+    memset(counts, 0, (compiler->npositions + 1) * sizeof(size_t));
+
+    for (size_t i = 0; i < ninstrs; i++) {
+        if (starts[i] != SIZE_MAX)
+            counts[starts[i] + 1]++;
+    }
+    for (size_t p = 0; p < compiler->npositions; p++)
+        counts[p + 1] += counts[p];
+
+    uint32_t* by_start = scratch_alloc(compiler, ninstrs * sizeof(uint32_t));
+    size_t nvalues = 0;
+
+    for (size_t i = 0; i < ninstrs; i++) {
+        if (starts[i] != SIZE_MAX) {
+            by_start[counts[starts[i]]++] = i;
+            nvalues++;
+        }
+    }
+
+    /* the last point every register is taken up to, one past the end for
+     * a free one. */
+    size_t* busy = scratch_alloc(compiler, (MAX_REGISTERS + 1) * sizeof(size_t));
+    size_t next = 0;
+
+    for (size_t i = 0; i < compiler->norder; i++) {
+        uint32_t b = compiler->order[i];
+        const IrBlock* block = &function->blocks[b];
+
+        for (size_t j = 0; j <= block->ninstrs + 1; j++) {
+            size_t position = j == 0 ? compiler->froms[b] : j <= block->ninstrs ? compiler->positions_of[block->instrs[j - 1]] : compiler->exits[b];
+
+            while (next < nvalues && starts[by_start[next]] == position) {
+                uint32_t value = by_start[next++];
+                const IrInstr* instr = &function->instrs[value];
+
+                compiler->registers[value] = allocate(compiler, busy, 1, position, ends[value], instr->line, instr->col);
+            }
+
+            if (j > 0 && j <= block->ninstrs) {
+                uint32_t id = block->instrs[j - 1];
+                size_t count = temporaries(compiler, &function->instrs[id]);
+
+                if (count > 0)
+                    compiler->scratch[id] = allocate(compiler, busy, count, position, position, function->instrs[id].line, function->instrs[id].col);
+            }
+        }
+
+        /* a constant for the exit, or one register to break a cycle of phi
+         * moves with. */
+        size_t count = 0;
+
+        if (block->value != IR_NONE && function->instrs[home(compiler, block->value)].op == IR_CONST)
+            count = 1;
+
+        if (block->exit == IR_JUMP) {
+            const IrBlock* succ = &function->blocks[block->succs[0]];
+            size_t nphis = 0;
+
+            while (nphis < succ->ninstrs && function->instrs[succ->instrs[nphis]].op == IR_PHI)
+                nphis++;
+
+            count = nphis > 1 ? 1 : 0;
+        }
+
+        if (count > 0)
+            compiler->exit_scratch[b] = allocate(compiler, busy, count, compiler->exits[b], compiler->exits[b], block->line, block->col);
+    }
+}
+
+#undef SET
+#undef CLEAR
+#undef TEST
+
+/* the lowest count registers in a row that are free from start to end. */
+static uint32_t allocate(Compiler* compiler, size_t* busy, size_t count, size_t start, size_t end, size_t line, size_t col) {
+    size_t first = 0;
+
+    for (size_t r = 0; r - first < count; r++) {
+        if (r == MAX_REGISTERS)
+            compile_error(compiler, line, col, "expression needs too many registers");
+
+        if (r >= compiler->nregisters)
+            busy[r] = 0;
+
+        if (busy[r] > start)
+            first = r + 1;
+    }
+
+    for (size_t r = first; r < first + count; r++)
+        busy[r] = end + 1;
+
+    if (first + count > compiler->nregisters)
+        compiler->nregisters = first + count;
+
+    return first;
+}
+
+/* how many temporaries an instruction needs: one for every constant it
+ * reads from a register, or one for each operand when they are not already
+ * in consecutive registers. */
+static size_t temporaries(Compiler* compiler, const IrInstr* instr) {
+    const IrFunction* function = compiler->function;
+
+    switch (instr->op) {
+    case IR_CONST:
+    case IR_COPY:
+    case IR_PHI:
+    case IR_DEFINE:
+    case IR_NEWMAP:
+        return 0;
+    case IR_BUILTIN:
+    case IR_CALL:
+    case IR_SPAWN:
+    case IR_PARFOR:
+    case IR_NEWARRAY:
+    case IR_NEWRECORD:
+        return consecutive(compiler, instr) ? 0 : instr->nargs;
+    default: {
+        size_t count = 0;
+
+        /* a constant right operand is read straight from the constants. */
+        size_t nargs = instr->op == IR_BINARY || instr->op == IR_LESS ? 1 : instr->nargs;
+
+        for (size_t a = 0; a < nargs; a++) {
+            if (function->instrs[home(compiler, instr->args[a])].op == IR_CONST)
+                count++;
+        }
+
+        return count;
+    }
+    }
+}
+
+static int consecutive(Compiler* compiler, const IrInstr* instr) {
+    for (size_t a = 0; a < instr->nargs; a++) {
+        uint32_t value = home(compiler, instr->args[a]);
+
+        if (!needs_register(compiler, value))
+            return 0;
+        if (compiler->registers[value] != compiler->registers[home(compiler, instr->args[0])] + a)
+            return 0;
+    }
+
+    return 1;
+}
+
+static void compile_block(Compiler* compiler, size_t place) {
+    uint32_t b = compiler->order[place];
+    const IrBlock* block = &compiler->function->blocks[b];
+
+    compiler->starts[b] = compiler->size;
+
+    for (size_t i = 0; i < block->ninstrs; i++)
+        compile_instr(compiler, block->instrs[i]);
+
+    compile_exit(compiler, place);
+}
+
+static void compile_instr(Compiler* compiler, uint32_t id) {
+    const IrFunction* function = compiler->function;
+    const IrInstr* instr = &function->instrs[id];
+
+    uint32_t scratch = compiler->scratch[id];
+    uint16_t dst = compiler->registers[id];
+    size_t line = instr->line;
+    size_t col = instr->col;
+
+    switch (instr->op) {
+    case IR_CONST:
+    case IR_COPY:
+    case IR_PHI:
+        break;
+    case IR_BINARY: {
+        const IrInstr* lhs = &function->instrs[home(compiler, instr->args[0])];
+        const IrInstr* rhs = &function->instrs[home(compiler, instr->args[1])];
+
+        uint16_t lhs_reg = operand(compiler, instr->args[0], &scratch, line, col);
+
+        if (rhs->op == IR_CONST) {
+            uint16_t constant = add_constant(compiler, home(compiler, instr->args[1]));
+            OpCode op = binary_instruction(instr->binop, lhs->type.kind, rhs->type.kind, &rhs->constant);
+
+            emit(compiler, (Instr) { .op = op, .a = dst, .b = lhs_reg, .c = constant }, line, col);
+            break;
+        }
+
+        uint16_t rhs_reg = operand(compiler, instr->args[1], &scratch, line, col);
+        OpCode op = binary_instruction(instr->binop, lhs->type.kind, rhs->type.kind, NULL);
+
+        emit(compiler, (Instr) { .op = op, .a = dst, .b = lhs_reg, .c = rhs_reg }, line, col);
+        break;
+    }
+    case IR_LESS: {
+        const IrInstr* rhs = &function->instrs[home(compiler, instr->args[1])];
+        uint16_t lhs_reg = operand(compiler, instr->args[0], &scratch, line, col);
+
+        if (rhs->op == IR_CONST) {
+            uint16_t constant = add_constant(compiler, home(compiler, instr->args[1]));
+            emit(compiler, (Instr) { .op = OP_LTK_I64, .a = dst, .b = lhs_reg, .c = constant }, line, col);
+            break;
+        }
+
+        uint16_t rhs_reg = operand(compiler, instr->args[1], &scratch, line, col);
+        emit(compiler, (Instr) { .op = OP_LT_I64, .a = dst, .b = lhs_reg, .c = rhs_reg }, line, col);
+        break;
+    }
+    case IR_SHL:
+    case IR_DIVPOW2: {
+        uint16_t reg = operand(compiler, instr->args[0], &scratch, line, col);
+        OpCode op = instr->op == IR_SHL ? OP_SHL_I64 : OP_DIVPOW2_I64;
+
+        emit(compiler, (Instr) { .op = op, .a = dst, .b = reg, .c = instr->shift }, line, col);
+        break;
+    }
+    case IR_LEN: {
+        uint16_t reg = operand(compiler, instr->args[0], &scratch, line, col);
+        emit(compiler, (Instr) { .op = OP_LEN, .a = dst, .b = reg }, line, col);
+        break;
+    }
+    case IR_BUILTIN: {
+        uint16_t first = gather(compiler, instr, id);
+        emit(compiler, (Instr) { .op = OP_BUILTIN, .a = dst, .b = first, .c = instr->builtin }, line, col);
+        break;
+    }
+    case IR_CALL: {
+        uint16_t first = gather(compiler, instr, id);
+        emit(compiler, (Instr) { .op = OP_CALL, .a = dst, .b = first, .c = instr->slot }, line, col);
+        break;
+    }
+    case IR_SPAWN: {
+        uint16_t first = gather(compiler, instr, id);
+        emit(compiler, (Instr) { .op = OP_SPAWN, .a = instr->task, .b = first }, line, col);
+        break;
+    }
+    case IR_JOIN:
+        emit(compiler, (Instr) { .op = OP_JOIN, .a = dst, .b = instr->task }, line, col);
+        break;
+    case IR_PARFOR: {
+        uint16_t first = gather(compiler, instr, id);
+        emit(compiler, (Instr) { .op = OP_PARFOR, .a = dst, .b = first, .c = instr->parfor }, line, col);
+        break;
+    }
+    case IR_PARAM:
+        /* the arguments arrive in the first registers, and a parameter is
+         * never given a register above its own, so nothing is overwritten
+         * before it is moved. */
+        if (dst != instr->param)
+            emit(compiler, (Instr) { .op = OP_MOVE, .a = dst, .b = instr->param }, line, col);
+        break;
+    case IR_NEWARRAY: {
+        uint16_t first = gather(compiler, instr, id);
+        emit(compiler, (Instr) { .op = OP_NEWARRAY, .a = dst, .b = first, .c = instr->nargs }, line, col);
+        break;
+    }
+    case IR_NEWRECORD: {
+        uint16_t first = gather(compiler, instr, id);
+        emit(compiler, (Instr) { .op = OP_NEWRECORD, .a = dst, .b = first, .c = record_slot(compiler, instr->type.record, line, col) }, line, col);
+        break;
+    }
+    case IR_INDEX: {
+        uint16_t array = operand(compiler, instr->args[0], &scratch, line, col);
+        uint16_t index = operand(compiler, instr->args[1], &scratch, line, col);
+
+        emit(compiler, (Instr) { .op = OP_INDEX, .a = dst, .b = array, .c = index }, line, col);
+        break;
+    }
+    case IR_NEWMAP:
+        emit(compiler, (Instr) { .op = OP_NEWMAP, .a = dst, .b = instr->type.key, .c = instr->type.value }, line, col);
+        break;
+    case IR_MAPSET: {
+        uint16_t map = operand(compiler, instr->args[0], &scratch, line, col);
+        uint16_t key = operand(compiler, instr->args[1], &scratch, line, col);
+        uint16_t value = operand(compiler, instr->args[2], &scratch, line, col);
+
+        emit(compiler, (Instr) { .op = OP_MAPSET, .a = map, .b = key, .c = value }, line, col);
+        break;
+    }
+    case IR_FIELD:
+    case IR_COLUMN: {
+        uint16_t reg = operand(compiler, instr->args[0], &scratch, line, col);
+        OpCode op = instr->op == IR_FIELD ? OP_FIELD : OP_COLUMN;
+
+        emit(compiler, (Instr) { .op = op, .a = dst, .b = reg, .c = field_operand(instr->field) }, line, col);
+        break;
+    }
+    case IR_INDEXFIELD: {
+        uint16_t array = operand(compiler, instr->args[0], &scratch, line, col);
+        uint16_t index = operand(compiler, instr->args[1], &scratch, line, col);
+
+        emit(compiler, (Instr) { .op = OP_INDEXFIELD, .a = dst, .b = array, .c = index }, line, col);
+        emit(compiler, (Instr) { .op = OP_EXTRAARG, .bx = field_operand(instr->field) }, line, col);
+        break;
+    }
+    case IR_GLOBAL:
+        emit(compiler, (Instr) { .op = OP_GETGLOBAL, .a = dst, .bx = instr->global }, line, col);
+        break;
+    case IR_SETGLOBAL: {
+        uint16_t reg = operand(compiler, instr->args[0], &scratch, line, col);
+        emit(compiler, (Instr) { .op = OP_SETGLOBAL, .a = reg, .bx = instr->global }, line, col);
+        break;
+    }
+    case IR_DEFINE: {
+        uint32_t checked = home(compiler, id);
+
+        if (checked == id) {
+            uint16_t constant = add_constant(compiler, home(compiler, instr->args[0]));
+            emit(compiler, (Instr) { .op = OP_LOADK, .a = dst, .bx = constant }, line, col);
+        }
+
+        const RecordType* record = instr->declared.record;
+        size_t slot = record != NULL ? record_slot(compiler, record, line, col) : 0;
+
+        emit(compiler, (Instr) { .op = OP_DEFINE, .a = compiler->registers[checked], .c = define_operand(instr->declared, slot) }, line, col);
+        break;
+    }
+    }
+}
+
+static void compile_exit(Compiler* compiler, size_t place) {
+    const IrFunction* function = compiler->function;
+    uint32_t b = compiler->order[place];
+    const IrBlock* block = &function->blocks[b];
+
+    uint32_t next = place + 1 < compiler->norder ? compiler->order[place + 1] : IR_NONE;
+    uint32_t scratch = compiler->exit_scratch[b];
+
+    switch (block->exit) {
+    case IR_JUMP:
+        compile_phi_moves(compiler, b, block->succs[0], scratch);
+
+        /* a jump back is the backedge of a loop, the layout puts every
+         * other jump forwards. */
+        if (compiler->places[block->succs[0]] <= place) {
+            if (compiler->nbackedges == MAX_LOOPS)
+                compile_error(compiler, block->line, block->col, "too many loops in one program");
+
+            if (compiler->loops != NULL)
+                record_loop(compiler, block->succs[0]);
+
+            emit_jump(compiler, (Instr) { .op = OP_LOOP, .a = compiler->nbackedges++ }, block->succs[0], block->line, block->col);
+        } else if (block->succs[0] != next) {
+            emit_jump(compiler, (Instr) { .op = OP_JMP }, block->succs[0], block->line, block->col);
+        }
+        break;
+    case IR_BRANCH: {
+        uint16_t reg = operand(compiler, block->value, &scratch, block->line, block->col);
+        emit_jump(compiler, (Instr) { .op = OP_JMPIFNOT, .a = reg }, block->succs[1], block->line, block->col);
+
+        if (block->succs[0] != next)
+            emit_jump(compiler, (Instr) { .op = OP_JMP }, block->succs[0], block->line, block->col);
+        break;
+    }
+    case IR_RETURN: {
+        uint16_t reg = operand(compiler, block->value, &scratch, block->line, block->col);
+        emit(compiler, (Instr) { .op = OP_RETURN, .a = reg }, block->line, block->col);
+        break;
+    }
+    case IR_HALT:
+        emit(compiler, (Instr) { .op = OP_HALT }, block->line, block->col);
+        break;
+    }
+}
+
+/* the phis of succ all take their value at once. a move waits while its
+ * register is still to be read by another one, and a cycle of them goes
+ * through scratch. constants are loaded last, nothing reads them. */
+static void compile_phi_moves(Compiler* compiler, uint32_t block, uint32_t succ, uint32_t scratch) {
+    const IrFunction* function = compiler->function;
+    const IrBlock* target = &function->blocks[succ];
+    const IrBlock* current = &function->blocks[block];
+
+    size_t pred = 0;
+    while (target->preds[pred] != block)
+        pred++;
+
+    size_t nphis = 0;
+    while (nphis < target->ninstrs && function->instrs[target->instrs[nphis]].op == IR_PHI)
+        nphis++;
+
+    if (nphis == 0)
+        return;
+
+    uint32_t* dsts = scratch_alloc(compiler, nphis * sizeof(uint32_t));
+    uint32_t* srcs = scratch_alloc(compiler, nphis * sizeof(uint32_t));
+    size_t nmoves = 0;
+
+    for (size_t i = 0; i < nphis; i++) {
+        uint32_t phi = target->instrs[i];
+        uint32_t value = home(compiler, function->instrs[phi].args[pred]);
+
+        if (function->instrs[value].op == IR_CONST || compiler->registers[value] == compiler->registers[phi])
+            continue;
+
+        dsts[nmoves] = compiler->registers[phi];
+        srcs[nmoves] = compiler->registers[value];
+        nmoves++;
+    }
+
+    while (nmoves > 0) {
+        size_t ready = nmoves;
+
+        for (size_t i = 0; i < nmoves && ready == nmoves; i++) {
+            ready = i;
+
+            for (size_t j = 0; j < nmoves; j++) {
+                if (j != i && srcs[j] == dsts[i]) {
+                    ready = nmoves;
+                    break;
+                }
+            }
+        }
+
+        if (ready == nmoves) {
+            emit(compiler, (Instr) { .op = OP_MOVE, .a = scratch, .b = srcs[0] }, current->line, current->col);
+
+            for (size_t j = 1; j < nmoves; j++) {
+                if (srcs[j] == srcs[0])
+                    srcs[j] = scratch;
+            }
+
+            srcs[0] = scratch;
+            continue;
+        }
+
+        emit(compiler, (Instr) { .op = OP_MOVE, .a = dsts[ready], .b = srcs[ready] }, current->line, current->col);
+
+        dsts[ready] = dsts[nmoves - 1];
+        srcs[ready] = srcs[nmoves - 1];
+        nmoves--;
+    }
+
+    for (size_t i = 0; i < nphis; i++) {
+        uint32_t phi = target->instrs[i];
+        uint32_t value = home(compiler, function->instrs[phi].args[pred]);
+
+        if (function->instrs[value].op == IR_CONST) {
+            uint16_t constant = add_constant(compiler, value);
+            emit(compiler, (Instr) { .op = OP_LOADK, .a = compiler->registers[phi], .bx = constant }, current->line, current->col);
+        }
+    }
+}
+
+/* the phis of header and the values live into it, which all stay where
+ * they are from the end of every block jumping to it. */
+static void record_loop(Compiler* compiler, uint32_t header) {
+    const IrFunction* function = compiler->function;
+    const IrBlock* block = &function->blocks[header];
+    const uint32_t* live = compiler->live_in[header];
+    size_t nwords = (function->ninstrs + 31) / 32;
+
+    size_t nphis = 0;
+    while (nphis < block->ninstrs && function->instrs[block->instrs[nphis]].op == IR_PHI)
+        nphis++;
+
+    size_t nvalues = nphis;
+    for (size_t w = 0; w < nwords; w++)
+        nvalues += __builtin_popcount(live[w]);
+
+    uint32_t* values = arena_alloc(compiler->arena, (nvalues + 1) * sizeof(uint32_t));
+    uint16_t* registers = arena_alloc(compiler->arena, (nvalues + 1) * sizeof(uint16_t));
+
+    if (values == NULL || registers == NULL)
+        out_of_memory(compiler);
+
+    for (size_t i = 0; i < nphis; i++)
+        values[i] = block->instrs[i];
+
+    size_t n = nphis;
+
+    for (size_t w = 0; w < nwords; w++) {
+        for (uint32_t bits = live[w]; bits != 0; bits &= bits - 1)
+            values[n++] = w * 32 + __builtin_ctz(bits);
+    }
+
+    for (size_t i = 0; i < nvalues; i++)
+        registers[i] = compiler->registers[values[i]];
+
+    compiler->loops[compiler->nbackedges] = (ChunkLoop) {
+        .header = header,
+        .values = values,
+        .registers = registers,
+        .nvalues = nvalues,
+    };
+}
+
+/* the register holding value, loading it into the next temporary first if
+ * it is a constant. */
+static uint16_t operand(Compiler* compiler, uint32_t value, uint32_t* scratch, size_t line, size_t col) {
+    uint32_t reg = home(compiler, value);
+
+    if (compiler->function->instrs[reg].op != IR_CONST)
+        return compiler->registers[reg];
+
+    uint16_t constant = add_constant(compiler, reg);
+    uint16_t temporary = (*scratch)++;
+
+    emit(compiler, (Instr) { .op = OP_LOADK, .a = temporary, .bx = constant }, line, col);
+    return temporary;
+}
+
+/* the first of the operands of instr in consecutive registers, moving them
+ * into temporaries unless they are there already. */
+static uint16_t gather(Compiler* compiler, const IrInstr* instr, uint32_t id) {
+    uint32_t first = compiler->scratch[id];
+
+    if (first == NO_REGISTER)
+        return instr->nargs > 0 ? compiler->registers[home(compiler, instr->args[0])] : 0;
+
+    for (size_t a = 0; a < instr->nargs; a++) {
+        uint32_t value = home(compiler, instr->args[a]);
+        uint32_t temporary = first + a;
+
+        if (compiler->function->instrs[value].op == IR_CONST) {
+            emit(compiler, (Instr) { .op = OP_LOADK, .a = temporary, .bx = add_constant(compiler, value) }, instr->line, instr->col);
+        } else {
+            emit(compiler, (Instr) { .op = OP_MOVE, .a = temporary, .b = compiler->registers[value] }, instr->line, instr->col);
+        }
+    }
+
+    return first;
+}
+
+OpCode binary_instruction(char binop, ValueKind lhs, ValueKind rhs, const Value* constant) {
+    return specialise(binary_opcode(binop, constant != NULL), lhs, rhs, constant);
+}
+
+static OpCode binary_opcode(char op, int constant_rhs) {
+    switch (op) {
+    case '+':
+        return constant_rhs ? OP_ADDK : OP_ADD;
+    case '-':
+        return constant_rhs ? OP_SUBK : OP_SUB;
+    case '*':
+        return constant_rhs ? OP_MULK : OP_MUL;
+    case '/':
+        return constant_rhs ? OP_DIVK : OP_DIV;
+    case '=':
+        return constant_rhs ? OP_EQK : OP_EQ;
+    default:
+        return constant_rhs ? OP_NEK : OP_NE;
+    }
+}
+
+/* arithmetic on operands of known kinds starts out in its quickened form
+ * instead of waiting to rewrite itself on the first run. */
+static OpCode specialise(OpCode generic, ValueKind lhs, ValueKind rhs, const Value* constant) {
+#ifdef KD_NO_QUICKEN
+    (void)lhs;
+    (void)rhs;
+    (void)constant;
+    return generic;
+#else
+    if (generic >= OP_EQ || lhs != rhs || (lhs != VAL_INT && lhs != VAL_DOUBLE))
+        return generic;
+
+    if (generic >= OP_ADDK) {
+        if (generic == OP_DIVK && lhs == VAL_INT && (constant->i64 == 0 || constant->i64 == -1))
+            return generic;
+
+        return (lhs == VAL_INT ? OP_ADDK_I64 : OP_ADDK_F64) + (generic - OP_ADDK);
+    }
+
+    return (lhs == VAL_INT ? OP_ADD_I64 : OP_ADD_F64) + (generic - OP_ADD);
+#endif
+}
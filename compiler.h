@@ -0,0 +1,19 @@
+#ifndef COMPILER_H
+#define COMPILER_H
+
+#include "kidomaru.h"
+#include "arena.h"
+#include "ir.h"
+#include "bytecode.h"
+
+/* lowers a function in ssa form to a register bytecode chunk. the chunk is
+ * allocated from arena so it lives exactly as long as the tree it was
+ * compiled from. the function gets blocks added on the way. */
+kd_status compile_program(Arena* arena, IrFunction* function, Chunk* chunk, kd_error* error);
+
+/* the opcode of binop, starting out quickened when the kinds of both
+ * operands are known. constant is the right hand side when it is read as a
+ * constant operand, NULL when it is in a register. */
+OpCode binary_instruction(char binop, ValueKind lhs, ValueKind rhs, const Value* constant);
+
+#endif /* COMPILER_H */
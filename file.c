@@ -0,0 +1,43 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+
+#include "file.h"
+
+char* read_whole_file(const char* filepath, size_t* size) {
+    if (!filepath)
+        return NULL;
+
+    FILE* file = fopen(filepath, "r");
+    
+    if (!file)
+        return NULL;
+
+    fseeko(file, 0, SEEK_END);
+    off_t file_size = ftello(file);
+    fseeko(file, 0, SEEK_SET);
+
+    if (file_size <= 0) {
+        fclose(file);
+        return ERR_FILE_EMPTY;
+    }
+
+    char* buffer = malloc(sizeof(char) * file_size);
+    if (!buffer) {
+        fclose(file);
+        return NULL;
+    }
+
+    size_t nitems = fread(buffer, sizeof(char), file_size, file);
+
+    fclose(file);
+
+    if (((size_t)file_size) != nitems) {
+        free(buffer);
+        return ERR_FILE_MISREAD;
+    }
+
+    *size = file_size;
+
+    return buffer;
+}
@@ -0,0 +1,13 @@
+#ifndef FILE_H
+#define FILE_H
+
+#include <stddef.h>
+
+#define ERR_FILE_EMPTY (char*)0xDEADBEEF
+#define ERR_FILE_MISREAD (char*)0xBEEFDEAD /* NOTE: this error name is kinda misleading. this error will yield when num of read bytes is not equal to ftell's size. */
+
+/* returns NULL when the file cannot be opened, otherwise a malloc'd buffer
+ * or one of the ERR_FILE_* markers. the buffer is not null terminated. */
+char* read_whole_file(const char* filepath, size_t* size);
+
+#endif /* FILE_H */
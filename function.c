@@ -0,0 +1,282 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "function.h"
+#include "program.h"
+#include "module.h"
+#include "stats.h"
+
+static uint64_t hash_name(Span name);
+static int append(Functions* functions, Function* function);
+static int push(Functions* functions, Function* function);
+static int same_bound(const Value* a, const Value* b, size_t n);
+
+void functions_init(Functions* functions, Arena* arena, const kd_compile_options* options) {
+    *functions = (Functions) {
+        .arena = arena,
+        .options = *options,
+    };
+
+    pthread_mutex_init(&functions->lock, NULL);
+}
+
+void functions_deinit(Functions* functions) {
+    for (size_t i = 0; i < functions->nmodules; i++)
+        module_release(functions->modules[i]);
+
+    free(functions->modules);
+    pthread_mutex_destroy(&functions->lock);
+}
+
+int functions_add(Functions* functions, Function* function) {
+    if (!append(functions, function))
+        return 0;
+
+    function->table = functions;
+    function->index = functions->count - 1;
+    function->chunk = NULL;
+    function->tree = NULL;
+    function->generic = NULL;
+    function->bound = NULL;
+    function->specializations = NULL;
+    function->next = NULL;
+    function->nspecializations = 0;
+
+    return 1;
+}
+
+int functions_link(Functions* functions, Function* function) {
+    return append(functions, function);
+}
+
+int functions_keep(Functions* functions, Module* module) {
+    for (size_t i = 0; i < functions->nmodules; i++) {
+        if (functions->modules[i] == module)
+            return 1;
+    }
+
+    if (functions->nmodules == functions->modules_capacity) {
+        size_t capacity = functions->modules_capacity == 0 ? 4 : functions->modules_capacity * 2;
+
+        Module** modules = realloc(functions->modules, capacity * sizeof(Module*));
+        if (modules == NULL)
+            return 0;
+
+        functions->modules = modules;
+        functions->modules_capacity = capacity;
+    }
+
+    module_retain(module);
+    functions->modules[functions->nmodules++] = module;
+
+    return 1;
+}
+
+Function* functions_lookup(const Functions* functions, Span name, size_t limit, size_t* slot) {
+    if (functions->count == 0)
+        return NULL;
+
+    size_t mask = functions->table_capacity - 1;
+    int64_t probes = 0;
+
+    for (size_t i = hash_name(name) & mask; functions->table[i] != 0; i = (i + 1) & mask) {
+        size_t found = functions->table[i] - 1;
+        Function* function = functions->items[found];
+        probes++;
+
+        if (found >= limit || !span_equals(function->name, name))
+            continue;
+
+        if (slot != NULL)
+            *slot = found;
+
+        stats_add(STAT_LOOKUPS, 1);
+        stats_add(STAT_PROBES, probes);
+        return function;
+    }
+
+    stats_add(STAT_LOOKUPS, 1);
+    stats_add(STAT_PROBES, probes);
+    return NULL;
+}
+
+/* the chunk is published with release ordering, so a thread that sees it
+ * sees everything it points to as well. the arena of the table is not safe
+ * to allocate from on two threads at once, so its bodies are compiled one
+ * at a time, while other tables compile theirs. */
+const Chunk* function_chunk(Function* function, kd_error* error) {
+    const Chunk* chunk = __atomic_load_n(&function->chunk, __ATOMIC_ACQUIRE);
+    if (chunk != NULL)
+        return chunk;
+
+    pthread_mutex_lock(&function->table->lock);
+
+    chunk = function->chunk;
+
+    if (chunk == NULL) {
+        Chunk* compiled = arena_alloc(function->table->arena, sizeof(Chunk));
+
+        if (compiled == NULL) {
+            error->status = KD_ERROR_NOMEM;
+            error->line = 0;
+            error->col = 0;
+            snprintf(error->message, sizeof(error->message), "cannot allocate memory!");
+        } else if (program_compile_function(function, compiled, error) == KD_OK) {
+            chunk = compiled;
+            function->table->ncompiled++;
+            __atomic_store_n(&function->chunk, chunk, __ATOMIC_RELEASE);
+        } else if (function->table->path != NULL) {
+            error_in_module(error, function->table->path);
+        }
+    }
+
+    pthread_mutex_unlock(&function->table->lock);
+    return chunk;
+}
+
+void functions_lock(Functions* functions) {
+    pthread_mutex_lock(&functions->lock);
+}
+
+void functions_unlock(Functions* functions) {
+    pthread_mutex_unlock(&functions->lock);
+}
+
+/* a copy is not found by name, it only has a slot for the calls pointed at
+ * it. */
+Function* function_specialize(Function* function, const Value* bound) {
+    for (Function* copy = function->specializations; copy != NULL; copy = copy->next) {
+        if (same_bound(copy->bound, bound, function->nparams))
+            return copy;
+    }
+
+    Functions* table = function->table;
+
+    if (function->nspecializations == MAX_SPECIALIZATIONS || table->count == MAX_FUNCTIONS)
+        return NULL;
+
+    Function* copy = arena_alloc(table->arena, sizeof(Function));
+    Value* values = arena_alloc(table->arena, function->nparams * sizeof(Value));
+    Type* params = arena_alloc(table->arena, (function->nparams + 1) * sizeof(Type));
+    Span* names = arena_alloc(table->arena, (function->nparams + 1) * sizeof(Span));
+
+    if (copy == NULL || values == NULL || params == NULL || names == NULL)
+        return NULL;
+
+    *copy = *function;
+    copy->params = params;
+    copy->names = names;
+    copy->nparams = 0;
+
+    for (size_t i = 0; i < function->nparams; i++) {
+        values[i] = bound[i];
+
+        if (bound[i].kind == VAL_IDENT) {
+            params[copy->nparams] = function->params[i];
+            names[copy->nparams++] = function->names[i];
+        }
+    }
+
+    if (!push(table, copy))
+        return NULL;
+
+    copy->index = table->count - 1;
+    copy->chunk = NULL;
+    copy->tree = NULL;
+    copy->generic = function;
+    copy->bound = values;
+    copy->specializations = NULL;
+    copy->nspecializations = 0;
+
+    copy->next = function->specializations;
+    function->specializations = copy;
+    function->nspecializations++;
+
+    return copy;
+}
+
+/* the old arrays stay in the arena, at most doubling what is used, so a
+ * thread still reading the old one finds what it is looking for there. */
+static int push(Functions* functions, Function* function) {
+    if (functions->count == functions->capacity) {
+        size_t capacity = functions->capacity == 0 ? 16 : functions->capacity * 2;
+
+        Function** items = arena_alloc(functions->arena, capacity * sizeof(Function*));
+        if (items == NULL)
+            return 0;
+
+        if (functions->count > 0)
+            memcpy(items, functions->items, functions->count * sizeof(Function*));
+
+        __atomic_store_n(&functions->items, items, __ATOMIC_RELEASE);
+        functions->capacity = capacity;
+    }
+
+    functions->items[functions->count++] = function;
+    return 1;
+}
+
+static int same_bound(const Value* a, const Value* b, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        if (a[i].kind != b[i].kind)
+            return 0;
+
+        if (a[i].kind == VAL_INT && a[i].i64 != b[i].i64)
+            return 0;
+
+        if (a[i].kind == VAL_DOUBLE && memcmp(&a[i].f64, &b[i].f64, sizeof(double)) != 0)
+            return 0;
+
+        if (a[i].kind == VAL_BOOL && a[i].bool != b[i].bool)
+            return 0;
+    }
+
+    return 1;
+}
+
+/* the table is kept at most half full. */
+static int append(Functions* functions, Function* function) {
+    if (!push(functions, function))
+        return 0;
+
+    if (functions->count * 2 > functions->table_capacity) {
+        size_t capacity = functions->table_capacity == 0 ? 32 : functions->table_capacity * 2;
+
+        size_t* table = arena_alloc(functions->arena, capacity * sizeof(size_t));
+        if (table == NULL)
+            return 0;
+
+        memset(table, 0, capacity * sizeof(size_t));
+
+        for (size_t i = 0; i + 1 < functions->count; i++) {
+            if (functions->items[i]->generic != NULL)
+                continue;
+
+            size_t j = hash_name(functions->items[i]->name) & (capacity - 1);
+            while (table[j] != 0)
+                j = (j + 1) & (capacity - 1);
+
+            table[j] = i + 1;
+        }
+
+        functions->table = table;
+        functions->table_capacity = capacity;
+    }
+
+    size_t i = hash_name(function->name) & (functions->table_capacity - 1);
+    while (functions->table[i] != 0)
+        i = (i + 1) & (functions->table_capacity - 1);
+
+    functions->table[i] = functions->count;
+    return 1;
+}
+
+static uint64_t hash_name(Span name) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+
+    for (size_t i = 0; i < name.size; i++)
+        hash = (hash ^ (unsigned char)name.data[i]) * 0x100000001b3ull;
+
+    return hash ^ hash >> 32;
+}
@@ -0,0 +1,134 @@
+#ifndef FUNCTION_H
+#define FUNCTION_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "kidomaru.h"
+#include "arena.h"
+#include "ast.h"
+#include "bytecode.h"
+
+/* a function declared with fn name(param: type, ...) -> type { ... }. the
+ * parser only reads its signature and skips over the body, which is kept as
+ * text and only parsed and compiled the first time the function is called.
+ * it lives in the arena of the table it is declared in. */
+typedef struct Function_t {
+    Span name;
+    size_t line;
+    size_t col;
+
+    Span* names;
+    Type* params;
+    size_t nparams;
+    Type result;
+
+    /* from the '{' to the '}' of the body, and where the '{' is. */
+    Span body;
+    size_t body_line;
+    size_t body_col;
+
+    /* set once it is declared: the structs visible where it is, and how
+     * many functions of its table its body can call. */
+    const RecordType** records;
+    size_t nrecords;
+    size_t nfunctions;
+
+    struct Functions_t* table;
+    uint16_t index;
+
+    /* the compiled body, NULL until the first call, see function_chunk. */
+    const Chunk* chunk;
+
+    /* the resolved body, NULL until something needs it, see
+     * program_function_body. */
+    const Statement* tree;
+
+    /* a copy of generic with the arguments that are not VAL_IDENT in bound,
+     * one for each parameter of generic, fixed to those constants. its own
+     * params are the ones left, see function_specialize. */
+    struct Function_t* generic;
+    const Value* bound;
+
+    /* the copies made of a generic function, linked through next. */
+    struct Function_t* specializations;
+    struct Function_t* next;
+    size_t nspecializations;
+} Function;
+
+#define MAX_FUNCTIONS UINT16_MAX
+
+/* how many copies of one function function_specialize makes at most. */
+#define MAX_SPECIALIZATIONS 4
+
+/* the functions of a program, a stream or a module, by name. they and
+ * their bodies are allocated from arena and go with it. a table also lists
+ * the functions it imports from modules, which belong to the tables of
+ * their modules, and a call names its callee by its slot in the table of
+ * the caller. */
+typedef struct Functions_t {
+    Arena* arena;
+
+    /* bodies are compiled into arena under it, see function_chunk. */
+    pthread_mutex_t lock;
+
+    /* how bodies are compiled, and the file of the module declaring them,
+     * NULL outside of a module. */
+    kd_compile_options options;
+    const char* path;
+
+    Function** items;
+    size_t count;
+    size_t capacity;
+
+    /* open addressing by name, index + 1 of the function, 0 when empty. */
+    size_t* table;
+    size_t table_capacity;
+
+    /* bodies compiled so far. */
+    size_t ncompiled;
+
+    /* the modules it links functions of, kept until functions_deinit. */
+    struct Module_t** modules;
+    size_t nmodules;
+    size_t modules_capacity;
+} Functions;
+
+void functions_init(Functions* functions, Arena* arena, const kd_compile_options* options);
+void functions_deinit(Functions* functions);
+
+/* appends function to the table, setting its table and index. returns 0
+ * when out of memory. */
+int functions_add(Functions* functions, Function* function);
+
+/* appends a function of another table, which is left as it is. */
+int functions_link(Functions* functions, Function* function);
+
+/* keeps module, whose functions the table links, for as long as the table.
+ * returns 0 when out of memory. */
+int functions_keep(Functions* functions, struct Module_t* module);
+
+/* the function named name among the first limit slots of the table, NULL
+ * if there is none. its slot is written to slot when that is not NULL. */
+Function* functions_lookup(const Functions* functions, Span name, size_t limit, size_t* slot);
+
+/* the chunk of function, compiling its body first on the first call. the
+ * body of a function is compiled once however many threads call it, and a
+ * body that does not compile writes its error to error and returns NULL. */
+const Chunk* function_chunk(Function* function, kd_error* error);
+
+/* the lock function_chunk compiles under, for whatever else compiles into
+ * the arena of the table while programs run, see tier.h. */
+void functions_lock(Functions* functions);
+void functions_unlock(Functions* functions);
+
+/* the copy of function taking only the arguments bound leaves as
+ * VAL_IDENT, with the others fixed to its constants, made the first time
+ * and appended to the table of function. NULL once function has
+ * MAX_SPECIALIZATIONS copies already, or when out of memory. like
+ * program_function_body, it is only called while compiling something of
+ * the table of function, which never happens on two threads at once. */
+Function* function_specialize(Function* function, const Value* bound);
+
+#endif /* FUNCTION_H */
@@ -1,147 +1,1834 @@
 #include <stdio.h>
+#include <stdarg.h>
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
 
 #include "interpreter.h"
+#include "function.h"
+#include "array.h"
+#include "map.h"
+#include "record.h"
+#include "parallel.h"
+#include "tier.h"
+#include "stats.h"
+#include "sample.h"
 
-static void evaluate_statement(Interpreter* interpreter, Statement* statement);
-static void evaluate_var_decl(Interpreter* interpreter, VarDecl* vardecl);
-static void evaluate_if_statement(Interpreter* interpreter, IfStatement* ifstatement);
-static void evaluate_block_statement(Interpreter* interpreter, BlockStatement* blockstatement);
+static const char* value_kind_stringified[] = {
+    "i64",
+    "f64",
+    "bool",
+    "string",
+    "[]i64",
+    "[]f64",
+    "map",
+    "struct",
+    "[]struct",
+    "identifier",
+};
 
-static Value evaluate_expression(Expr* expr);
+static kd_status begin(Interpreter* interpreter, const Chunk* chunk);
+static kd_status execute(Interpreter* interpreter);
+static kd_status enter_loop(Interpreter* interpreter, const Chunk* from, const ChunkLoop* loop, const Chunk* to);
+
+static kd_status runtime_error(Interpreter* interpreter, size_t pc, const char* fmt, ...);
+static kd_status out_of_memory(Interpreter* interpreter);
+static kd_status write_failed(Interpreter* interpreter);
+
+static void release_registers(Value* registers, size_t nregisters);
+static kd_status grow_registers(Interpreter* interpreter, size_t nregisters);
+static int value_matches(const Value* value, const Type* type);
+
+static OpCode quickened_form(OpCode generic, Value lhs, Value rhs);
+static kd_status evaluate_binop(Interpreter* interpreter, size_t pc, char op, const Value* lhs, const Value* rhs, int64_t fuel, int64_t* used, Value* result);
+static kd_status evaluate_array_binop(Interpreter* interpreter, size_t pc, char op, const Value* lhs, const Value* rhs, int64_t fuel, int64_t* used, Value* result);
+static kd_status evaluate_builtin(Interpreter* interpreter, size_t pc, Builtin builtin, const Value* args, int64_t fuel, int64_t* used, Value* result);
+static kd_status evaluate_equals(Interpreter* interpreter, size_t pc, const Value* lhs, const Value* rhs, int* equal);
+static int64_t string_units(const Value* value);
+static int64_t equals_units(const Value* lhs, const Value* rhs);
+static void end_step(ArrayStep* step);
+static Value take_step(ArrayStep* step);
+static kd_status check_map_key(Interpreter* interpreter, size_t pc, const MapObject* map, const Value* key);
+static kd_status check_map_value(Interpreter* interpreter, size_t pc, const MapObject* map, const Value* value);
+static const char* type_stringified(char* buffer, size_t size, ValueKind kind, ValueKind key, ValueKind value, const RecordType* record);
+static const char* value_type_stringified(char* buffer, size_t size, const Value* value);
+static kd_status check_index(Interpreter* interpreter, size_t pc, const Value* index, size_t size);
 static int64_t evaluate_binop_int(int64_t lhs, int64_t rhs, char op);
 static double evaluate_binop_double(double lhs, double rhs, char op);
 
-Interpreter interpreter_init(Statement* root) {
+static const char binop_char[] = {
+    [OP_ADD] = '+', [OP_SUB] = '-', [OP_MUL] = '*', [OP_DIV] = '/',
+    [OP_ADDK] = '+', [OP_SUBK] = '-', [OP_MULK] = '*', [OP_DIVK] = '/',
+};
+
+/* every arithmetic opcode mapped to the generic instruction it came from. */
+static const OpCode generic_form[] = {
+    [OP_ADD] = OP_ADD, [OP_SUB] = OP_SUB, [OP_MUL] = OP_MUL, [OP_DIV] = OP_DIV,
+    [OP_ADDK] = OP_ADDK, [OP_SUBK] = OP_SUBK, [OP_MULK] = OP_MULK, [OP_DIVK] = OP_DIVK,
+
+    [OP_ADD_I64] = OP_ADD, [OP_SUB_I64] = OP_SUB, [OP_MUL_I64] = OP_MUL, [OP_DIV_I64] = OP_DIV,
+    [OP_ADD_F64] = OP_ADD, [OP_SUB_F64] = OP_SUB, [OP_MUL_F64] = OP_MUL, [OP_DIV_F64] = OP_DIV,
+
+    [OP_ADDK_I64] = OP_ADDK, [OP_SUBK_I64] = OP_SUBK, [OP_MULK_I64] = OP_MULK, [OP_DIVK_I64] = OP_DIVK,
+    [OP_ADDK_F64] = OP_ADDK, [OP_SUBK_F64] = OP_SUBK, [OP_MULK_F64] = OP_MULK, [OP_DIVK_F64] = OP_DIVK,
+};
+
+/* the chunk may be shared by threads running it at the same time. an opcode
+ * is only ever replaced by an equivalent one, so all that is needed is that
+ * the store and the loads are single, untorn accesses. */
+static inline OpCode quicken_load(const Instr* instr) {
+    return __atomic_load_n(&instr->op, __ATOMIC_RELAXED);
+}
+
+static inline void quicken_store(Instr* instr, OpCode op) {
+    __atomic_store_n(&instr->op, op, __ATOMIC_RELAXED);
+}
+
+/* the frame running now becomes that of function at pc of chunk, with
+ * nframes calls around it. the sampling profiler sees it all at once, or
+ * still the frame before. */
+static inline void switch_frame(Interpreter* interpreter, const Chunk* chunk, const struct Function_t* function, size_t pc, size_t nframes) {
+    Running* next = &interpreter->running[interpreter->current == &interpreter->running[0]];
+    *next = (Running) { .chunk = chunk, .function = function, .pc = pc, .nframes = nframes };
+
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+    __atomic_store_n(&interpreter->current, next, __ATOMIC_RELAXED);
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+
+    interpreter->chunk = chunk;
+    interpreter->function = function;
+    interpreter->nframes = nframes;
+}
+
+/* drops the reference the register held, value has to bring its own. */
+static inline void set_register(Value* reg, Value value) {
+    Value old = *reg;
+    *reg = value;
+    value_release(&old);
+}
+
+/* direct threaded dispatch: with labels as values every handler ends in its
+ * own indirect jump to the next handler, which gives the branch predictor one
+ * history per opcode instead of one shared switch branch. compilers without
+ * them, or builds with -DKD_NO_COMPUTED_GOTO, get the portable switch. */
+#if defined(__GNUC__) && !defined(KD_NO_COMPUTED_GOTO)
+#define KD_COMPUTED_GOTO
+#endif
+
+/* every instruction costs one unit of fuel, taken before it runs, and while
+ * the profiler is on it is left where the SIGPROF handler finds it. */
+#define FETCH()                                                             \
+    do {                                                                    \
+        if (fuel == 0) {                                                    \
+            status = KD_SUSPENDED;                                          \
+            goto suspended;                                                 \
+        }                                                                   \
+                                                                            \
+        fuel--;                                                             \
+        instr = &code[pc++];                                                \
+        if (sampled)                                                        \
+            __atomic_store_n(&interpreter->instr, instr, __ATOMIC_RELAXED); \
+        op = quicken_load(instr);                                           \
+    } while (0)
+
+/* an instruction going through the elements of an array, or the bytes of a
+ * string, costs a unit of fuel for each on top of its own. what the fuel
+ * left does not cover is used all the same. */
+#define CHARGE(UNITS)                                                       \
+    do {                                                                    \
+        int64_t units = (UNITS);                                            \
+        int64_t charged = units < fuel ? units : fuel;                      \
+                                                                            \
+        fuel -= charged;                                                    \
+        delegated += charged;                                               \
+        interpreter->fuel_used += units - charged;                          \
+    } while (0)
+
+#ifdef KD_COMPUTED_GOTO
+#define TARGET(OP) target_##OP:
+#define DISPATCH()                          \
+    do {                                    \
+        FETCH();                            \
+        goto *dispatch_table[op];           \
+    } while (0)
+#else
+#define TARGET(OP) case OP:
+#define DISPATCH() goto dispatch
+#endif
+
+/* R(a) = R(b) op R(c), both known to be of kind. */
+#define QUICK_BINOP(OP, KIND, FIELD, EXPR)                                  \
+        TARGET(OP) {                                                        \
+            const Value* lhs = &registers[instr->b];                        \
+            const Value* rhs = &registers[instr->c];                        \
+                                                                            \
+            if (lhs->kind != KIND || rhs->kind != KIND)                     \
+                goto deopt;                                                 \
+                                                                            \
+            set_register(&registers[instr->a],                              \
+                (Value) { .kind = KIND, .FIELD = EXPR });                   \
+            quickened++;                                                    \
+            DISPATCH();                                                     \
+        }
+
+/* R(a) = R(b) op K(c), only R(b) needs checking. */
+#define QUICK_BINOPK(OP, KIND, FIELD, EXPR)                                 \
+        TARGET(OP) {                                                        \
+            const Value* lhs = &registers[instr->b];                        \
+            const Value* rhs = &constants[instr->c];                        \
+                                                                            \
+            if (lhs->kind != KIND)                                          \
+                goto deopt;                                                 \
+                                                                            \
+            set_register(&registers[instr->a],                              \
+                (Value) { .kind = KIND, .FIELD = EXPR });                   \
+            quickened++;                                                    \
+            DISPATCH();                                                     \
+        }
+
+Interpreter interpreter_init(kd_error* error) {
     return (Interpreter) {
-        .root = root,
-        .symbols = NULL,
+        .chunk = NULL,
+        .pc = 0,
+        .state = INTERPRETER_IDLE,
+        .instr = NULL,
+        .running = { { 0 }, { 0 } },
+        .current = NULL,
+        .registers = NULL,
+        .nregisters = 0,
+        .base = 0,
+        .frames = NULL,
+        .nframes = 0,
+        .frames_capacity = 0,
+        .function = NULL,
+        .globals = NULL,
+        .fuel = 0,
+        .fuel_used = 0,
+        .exit_code = 0,
+        .returned = 0,
+        .result = { .kind = VAL_INT, .i64 = 0 },
+        .parallel = NULL,
+        .parfor = NULL,
+        .step = { .active = 0, .done = 0, .partial = { .kind = VAL_INT, .i64 = 0 } },
+        .nthreads = 0,
+        .output = output_init(-1),
+        .quicken = { 0 },
+        .error = error,
     };
 }
 
 void interpreter_deinit(Interpreter* interpreter) {
-    statement_deinit(interpreter->root);
+    parallel_for_cancel(interpreter);
+    parallel_free(interpreter->parallel);
+    end_step(&interpreter->step);
+
+    release_registers(interpreter->registers, interpreter->nregisters);
+    value_release(&interpreter->result);
+    output_deinit(&interpreter->output);
+    free(interpreter->registers);
+    free(interpreter->frames);
+}
 
-    if (interpreter->symbols != NULL) {
-        value_deinit(&interpreter->symbols->value);
-        free(interpreter->symbols);
+kd_status interpreter_begin(Interpreter* interpreter, const Chunk* chunk) {
+    if (chunk->tier != NULL)
+        chunk = tier_call(chunk->tier);
+
+    kd_status status = begin(interpreter, chunk);
+    if (status != KD_OK)
+        return status;
+
+    return execute(interpreter);
+}
+
+kd_status interpreter_begin_task(Interpreter* interpreter, const Chunk* chunk, Value* args, size_t nargs) {
+    kd_status status = begin(interpreter, chunk);
+    if (status != KD_OK)
+        return status;
+
+    for (size_t i = 0; i < nargs; i++) {
+        interpreter->registers[i] = args[i];
+        args[i] = (Value) { .kind = VAL_INT, .i64 = 0 };
     }
+
+    return execute(interpreter);
 }
 
-void interpreter_begin(Interpreter* interpreter) {
-    evaluate_statement(interpreter, interpreter->root);
+kd_status interpreter_resume(Interpreter* interpreter) {
+    if (interpreter->state != INTERPRETER_SUSPENDED) {
+        interpreter->error->status = KD_ERROR_RUNTIME;
+        interpreter->error->line = 0;
+        interpreter->error->col = 0;
+        snprintf(interpreter->error->message, sizeof(interpreter->error->message), "there is no suspended run to resume");
+
+        return KD_ERROR_RUNTIME;
+    }
+
+    return execute(interpreter);
 }
 
-static void evaluate_statement(Interpreter* interpreter, Statement* statement) {
-    switch (interpreter->root->kind) {
-    case STATEMENT_VAR_DECL:
-        evaluate_var_decl(interpreter, &statement->vardecl);
-        break;
-    case STATEMENT_IF:
-        evaluate_if_statement(interpreter, &statement->ifstatement);
-        break;
-    case STATEMENT_BLOCK:
-        evaluate_block_statement(interpreter, statement->blockstatement);
+static kd_status begin(Interpreter* interpreter, const Chunk* chunk) {
+    /* a finished run has released its registers and waited for its tasks
+     * already. */
+    if (interpreter->state == INTERPRETER_SUSPENDED) {
+        parallel_for_cancel(interpreter);
+
+        if (interpreter->parallel != NULL)
+            parallel_cancel(interpreter->parallel);
+
+        end_step(&interpreter->step);
+
+        /* what its tasks printed is dropped with them. */
+        interpreter->output.held = 0;
+
+        release_registers(interpreter->registers, interpreter->nregisters);
+    }
+
+    /* the workers are started again when the thread count has changed. */
+    if (interpreter->parallel != NULL && interpreter->parallel->nworkers != parallel_threads(interpreter->nthreads)) {
+        parallel_free(interpreter->parallel);
+        interpreter->parallel = NULL;
+    }
+
+    value_release(&interpreter->result);
+    interpreter->result = (Value) { .kind = VAL_INT, .i64 = 0 };
+
+    switch_frame(interpreter, chunk, NULL, 0, 0);
+
+    interpreter->pc = 0;
+    interpreter->state = INTERPRETER_SUSPENDED;
+    interpreter->base = 0;
+    interpreter->fuel_used = 0;
+    interpreter->exit_code = 0;
+    interpreter->returned = 0;
+
+    if (grow_registers(interpreter, chunk->nregisters) != KD_OK) {
+        interpreter->state = INTERPRETER_FINISHED;
+        return KD_ERROR_NOMEM;
+    }
+
+    return KD_OK;
+}
+
+static kd_status execute(Interpreter* interpreter) {
+    const Chunk* chunk = interpreter->chunk;
+    Instr* code = chunk->code;
+    const Value* constants = chunk->constants;
+    Value* registers = interpreter->registers + interpreter->base;
+    Value* globals = interpreter->globals;
+
+    size_t pc = interpreter->pc;
+    int64_t budget = interpreter->fuel > 0 ? interpreter->fuel : INT64_MAX;
+    int64_t fuel = budget;
+
+    /* the fuel used by the chunks of par fors, which count their own
+     * instructions, and by the elements instructions go through. */
+    int64_t delegated = 0;
+
+    kd_status status = KD_OK;
+    Interpreter* outer = sample_enter(interpreter);
+    int sampled = sample_enabled();
+
+    /* kept in locals so counting costs no memory traffic. */
+    int64_t generic_count = 0;
+    int64_t quickened = 0;
+    int64_t rewrites = 0;
+    int64_t deopts = 0;
+    int64_t calls = 0;
+
+    Instr* instr;
+    OpCode op;
+
+#ifdef KD_COMPUTED_GOTO
+    static void* dispatch_table[] = {
+        [OP_LOADK] = &&target_OP_LOADK,
+        [OP_MOVE] = &&target_OP_MOVE,
+
+        [OP_ADD] = &&target_OP_ADD,
+        [OP_SUB] = &&target_OP_SUB,
+        [OP_MUL] = &&target_OP_MUL,
+        [OP_DIV] = &&target_OP_DIV,
+
+        [OP_ADDK] = &&target_OP_ADDK,
+        [OP_SUBK] = &&target_OP_SUBK,
+        [OP_MULK] = &&target_OP_MULK,
+        [OP_DIVK] = &&target_OP_DIVK,
+
+        [OP_EQ] = &&target_OP_EQ,
+        [OP_NE] = &&target_OP_NE,
+        [OP_EQK] = &&target_OP_EQK,
+        [OP_NEK] = &&target_OP_NEK,
+
+        [OP_SHL_I64] = &&target_OP_SHL_I64,
+        [OP_DIVPOW2_I64] = &&target_OP_DIVPOW2_I64,
+
+        [OP_LT_I64] = &&target_OP_LT_I64,
+        [OP_LTK_I64] = &&target_OP_LTK_I64,
+
+        [OP_LEN] = &&target_OP_LEN,
+        [OP_BUILTIN] = &&target_OP_BUILTIN,
+
+        [OP_NEWARRAY] = &&target_OP_NEWARRAY,
+        [OP_INDEX] = &&target_OP_INDEX,
+        [OP_NEWMAP] = &&target_OP_NEWMAP,
+        [OP_MAPSET] = &&target_OP_MAPSET,
+
+        [OP_NEWRECORD] = &&target_OP_NEWRECORD,
+        [OP_FIELD] = &&target_OP_FIELD,
+        [OP_INDEXFIELD] = &&target_OP_INDEXFIELD,
+        [OP_COLUMN] = &&target_OP_COLUMN,
+        [OP_EXTRAARG] = &&target_OP_EXTRAARG,
+
+        [OP_DEFINE] = &&target_OP_DEFINE,
+
+        [OP_GETGLOBAL] = &&target_OP_GETGLOBAL,
+        [OP_SETGLOBAL] = &&target_OP_SETGLOBAL,
+
+        [OP_CALL] = &&target_OP_CALL,
+        [OP_SPAWN] = &&target_OP_SPAWN,
+        [OP_JOIN] = &&target_OP_JOIN,
+        [OP_PARFOR] = &&target_OP_PARFOR,
+
+        [OP_JMP] = &&target_OP_JMP,
+        [OP_JMPIFNOT] = &&target_OP_JMPIFNOT,
+        [OP_LOOP] = &&target_OP_LOOP,
+
+        [OP_RETURN] = &&target_OP_RETURN,
+        [OP_HALT] = &&target_OP_HALT,
+
+        [OP_ADD_I64] = &&target_OP_ADD_I64,
+        [OP_SUB_I64] = &&target_OP_SUB_I64,
+        [OP_MUL_I64] = &&target_OP_MUL_I64,
+        [OP_DIV_I64] = &&target_OP_DIV_I64,
+
+        [OP_ADD_F64] = &&target_OP_ADD_F64,
+        [OP_SUB_F64] = &&target_OP_SUB_F64,
+        [OP_MUL_F64] = &&target_OP_MUL_F64,
+        [OP_DIV_F64] = &&target_OP_DIV_F64,
+
+        [OP_ADDK_I64] = &&target_OP_ADDK_I64,
+        [OP_SUBK_I64] = &&target_OP_SUBK_I64,
+        [OP_MULK_I64] = &&target_OP_MULK_I64,
+        [OP_DIVK_I64] = &&target_OP_DIVK_I64,
+
+        [OP_ADDK_F64] = &&target_OP_ADDK_F64,
+        [OP_SUBK_F64] = &&target_OP_SUBK_F64,
+        [OP_MULK_F64] = &&target_OP_MULK_F64,
+        [OP_DIVK_F64] = &&target_OP_DIVK_F64,
+    };
+
+    DISPATCH();
+#else
+dispatch:
+    FETCH();
+
+    switch (op) {
+#endif
+        TARGET(OP_LOADK) {
+            set_register(&registers[instr->a], constants[instr->bx]);
+            DISPATCH();
+        }
+
+        TARGET(OP_MOVE) {
+            value_retain(&registers[instr->b]);
+            set_register(&registers[instr->a], registers[instr->b]);
+            DISPATCH();
+        }
+
+        TARGET(OP_ADD)
+        TARGET(OP_SUB)
+        TARGET(OP_MUL)
+        TARGET(OP_DIV)
+        TARGET(OP_ADDK)
+        TARGET(OP_SUBK)
+        TARGET(OP_MULK)
+        TARGET(OP_DIVK)
+            goto generic_binop;
+
+        QUICK_BINOP(OP_ADD_I64, VAL_INT, i64, (int64_t)((uint64_t)lhs->i64 + (uint64_t)rhs->i64))
+        QUICK_BINOP(OP_SUB_I64, VAL_INT, i64, (int64_t)((uint64_t)lhs->i64 - (uint64_t)rhs->i64))
+        QUICK_BINOP(OP_MUL_I64, VAL_INT, i64, (int64_t)((uint64_t)lhs->i64 * (uint64_t)rhs->i64))
+
+        TARGET(OP_DIV_I64) {
+            const Value* lhs = &registers[instr->b];
+            const Value* rhs = &registers[instr->c];
+
+            if (lhs->kind != VAL_INT || rhs->kind != VAL_INT)
+                goto deopt;
+
+            /* let the generic path report division by zero. */
+            if (rhs->i64 == 0 || rhs->i64 == -1)
+                goto generic_binop;
+
+            set_register(&registers[instr->a], (Value) { .kind = VAL_INT, .i64 = lhs->i64 / rhs->i64 });
+            quickened++;
+            DISPATCH();
+        }
+
+        QUICK_BINOP(OP_ADD_F64, VAL_DOUBLE, f64, lhs->f64 + rhs->f64)
+        QUICK_BINOP(OP_SUB_F64, VAL_DOUBLE, f64, lhs->f64 - rhs->f64)
+        QUICK_BINOP(OP_MUL_F64, VAL_DOUBLE, f64, lhs->f64 * rhs->f64)
+        QUICK_BINOP(OP_DIV_F64, VAL_DOUBLE, f64, lhs->f64 / rhs->f64)
+
+        QUICK_BINOPK(OP_ADDK_I64, VAL_INT, i64, (int64_t)((uint64_t)lhs->i64 + (uint64_t)rhs->i64))
+        QUICK_BINOPK(OP_SUBK_I64, VAL_INT, i64, (int64_t)((uint64_t)lhs->i64 - (uint64_t)rhs->i64))
+        QUICK_BINOPK(OP_MULK_I64, VAL_INT, i64, (int64_t)((uint64_t)lhs->i64 * (uint64_t)rhs->i64))
+        QUICK_BINOPK(OP_DIVK_I64, VAL_INT, i64, lhs->i64 / rhs->i64)
+
+        QUICK_BINOPK(OP_ADDK_F64, VAL_DOUBLE, f64, lhs->f64 + rhs->f64)
+        QUICK_BINOPK(OP_SUBK_F64, VAL_DOUBLE, f64, lhs->f64 - rhs->f64)
+        QUICK_BINOPK(OP_MULK_F64, VAL_DOUBLE, f64, lhs->f64 * rhs->f64)
+        QUICK_BINOPK(OP_DIVK_F64, VAL_DOUBLE, f64, lhs->f64 / rhs->f64)
+
+        TARGET(OP_EQ)
+        TARGET(OP_NE)
+        TARGET(OP_EQK)
+        TARGET(OP_NEK) {
+            const Value* lhs = &registers[instr->b];
+            const Value* rhs = op >= OP_EQK ? &constants[instr->c] : &registers[instr->c];
+            int equal = 0;
+
+            status = evaluate_equals(interpreter, pc - 1, lhs, rhs, &equal);
+            if (status != KD_OK)
+                goto finished;
+
+            CHARGE(equals_units(lhs, rhs));
+
+            set_register(&registers[instr->a], (Value) { .kind = VAL_BOOL, .bool = equal == (op == OP_EQ || op == OP_EQK) });
+            DISPATCH();
+        }
+
+        TARGET(OP_SHL_I64) {
+            uint64_t value = registers[instr->b].i64;
+            set_register(&registers[instr->a], (Value) { .kind = VAL_INT, .i64 = (int64_t)(value << instr->c) });
+            DISPATCH();
+        }
+
+        /* an arithmetic shift rounds towards minus infinity, a negative value
+         * is biased by 2^c - 1 first. */
+        TARGET(OP_DIVPOW2_I64) {
+            int64_t value = registers[instr->b].i64;
+            uint64_t bias = (uint64_t)(value >> 63) >> (64 - instr->c);
+
+            set_register(&registers[instr->a], (Value) { .kind = VAL_INT, .i64 = (int64_t)((uint64_t)value + bias) >> instr->c });
+            DISPATCH();
+        }
+
+        TARGET(OP_LT_I64)
+        TARGET(OP_LTK_I64) {
+            int64_t lhs = registers[instr->b].i64;
+            int64_t rhs = op == OP_LTK_I64 ? constants[instr->c].i64 : registers[instr->c].i64;
+
+            set_register(&registers[instr->a], (Value) { .kind = VAL_BOOL, .bool = lhs < rhs });
+            DISPATCH();
+        }
+
+        TARGET(OP_LEN) {
+            const Value* value = &registers[instr->b];
+
+            int64_t size;
+
+            if (value->kind == VAL_STRING) {
+                size = string_size(value);
+            } else if (value_is_array(value)) {
+                size = value->array->size;
+            } else if (value->kind == VAL_RECORD_ARRAY) {
+                size = value->records->size;
+            } else if (value->kind == VAL_MAP) {
+                size = value->map->count;
+            } else {
+                status = runtime_error(interpreter, pc - 1, "len expects a string, an array or a map but got %s", value_kind_stringified[value->kind]);
+                goto finished;
+            }
+
+            set_register(&registers[instr->a], (Value) { .kind = VAL_INT, .i64 = size });
+            DISPATCH();
+        }
+
+        TARGET(OP_BUILTIN) {
+            Value result;
+            int64_t used = 0;
+
+            status = evaluate_builtin(interpreter, pc - 1, instr->c, &registers[instr->b], fuel, &used, &result);
+            CHARGE(used);
+
+            /* as for OP_JOIN. */
+            if (status == KD_SUSPENDED) {
+                pc--;
+                fuel++;
+                goto suspended;
+            }
+
+            if (status != KD_OK)
+                goto finished;
+
+            set_register(&registers[instr->a], result);
+            DISPATCH();
+        }
+
+        TARGET(OP_NEWARRAY) {
+            const Value* elements = &registers[instr->b];
+            ValueKind kind = elements[0].kind;
+
+            if (kind == VAL_RECORD) {
+                const RecordType* type = elements[0].record->type;
+
+                for (uint16_t i = 0; i < instr->c; i++) {
+                    if (elements[i].kind != VAL_RECORD || elements[i].record->type != type) {
+                        status = runtime_error(interpreter, pc - 1, "array elements have to be all %.*s but element %u is not",
+                            (int)type->name.size, type->name.data, (unsigned)i);
+                        goto finished;
+                    }
+                }
+
+                RecordArrayObject* records = record_array_new(type, instr->c);
+                if (records == NULL) {
+                    status = out_of_memory(interpreter);
+                    goto finished;
+                }
+
+                for (uint16_t i = 0; i < instr->c; i++)
+                    record_array_set(records, i, elements[i].record);
+
+                set_register(&registers[instr->a], record_array_value(records));
+                DISPATCH();
+            }
+
+            for (uint16_t i = 0; i < instr->c; i++) {
+                if ((kind != VAL_INT && kind != VAL_DOUBLE) || elements[i].kind != kind) {
+                    status = runtime_error(interpreter, pc - 1, "array elements have to be all i64 or all f64 but element %u is %s",
+                        (unsigned)i, value_kind_stringified[elements[i].kind]);
+                    goto finished;
+                }
+            }
+
+            ArrayObject* array = array_new(instr->c);
+            if (array == NULL) {
+                status = out_of_memory(interpreter);
+                goto finished;
+            }
+
+            /* i64 and f64 are both 8 bytes at the same place in a Value. */
+            for (uint16_t i = 0; i < instr->c; i++)
+                array->i64[i] = elements[i].i64;
+
+            set_register(&registers[instr->a], array_value(kind == VAL_INT ? VAL_INT_ARRAY : VAL_DOUBLE_ARRAY, array));
+            DISPATCH();
+        }
+
+        TARGET(OP_INDEX) {
+            const Value* array = &registers[instr->b];
+            const Value* index = &registers[instr->c];
+
+            if (array->kind == VAL_MAP) {
+                Value value;
+
+                status = check_map_key(interpreter, pc - 1, array->map, index);
+                if (status != KD_OK)
+                    goto finished;
+
+                CHARGE(string_units(index));
+
+                if (map_get(array->map, index, &value) != MAP_OK) {
+                    status = runtime_error(interpreter, pc - 1, "key not found");
+                    goto finished;
+                }
+
+                value_retain(&value);
+                set_register(&registers[instr->a], value);
+                DISPATCH();
+            }
+
+            if (!value_is_array(array) && array->kind != VAL_RECORD_ARRAY) {
+                status = runtime_error(interpreter, pc - 1, "cannot index %s", value_kind_stringified[array->kind]);
+                goto finished;
+            }
+
+            size_t size = array->kind == VAL_RECORD_ARRAY ? array->records->size : array->array->size;
+
+            status = check_index(interpreter, pc - 1, index, size);
+            if (status != KD_OK)
+                goto finished;
+
+            /* a struct on its own is a copy of the element. */
+            if (array->kind == VAL_RECORD_ARRAY) {
+                RecordObject* record = record_new(array->records->type);
+                if (record == NULL) {
+                    status = out_of_memory(interpreter);
+                    goto finished;
+                }
+
+                record_array_get(array->records, index->i64, record);
+
+                set_register(&registers[instr->a], record_value(record));
+                DISPATCH();
+            }
+
+            Value element = array->kind == VAL_INT_ARRAY
+                ? (Value) { .kind = VAL_INT, .i64 = array->array->i64[index->i64] }
+                : (Value) { .kind = VAL_DOUBLE, .f64 = array->array->f64[index->i64] };
+
+            set_register(&registers[instr->a], element);
+            DISPATCH();
+        }
+
+        TARGET(OP_NEWMAP) {
+            MapObject* map = map_new(instr->b, instr->c);
+            if (map == NULL) {
+                status = out_of_memory(interpreter);
+                goto finished;
+            }
+
+            set_register(&registers[instr->a], (Value) { .kind = VAL_MAP, .map = map });
+            DISPATCH();
+        }
+
+        TARGET(OP_MAPSET) {
+            MapObject* map = registers[instr->a].map;
+            const Value* key = &registers[instr->b];
+            const Value* value = &registers[instr->c];
+
+            status = check_map_key(interpreter, pc - 1, map, key);
+            if (status == KD_OK)
+                status = check_map_value(interpreter, pc - 1, map, value);
+            if (status != KD_OK)
+                goto finished;
+
+            int inserted;
+            size_t capacity = map->capacity;
+
+            if (map_put(map, key, value, &inserted) != MAP_OK) {
+                status = out_of_memory(interpreter);
+                goto finished;
+            }
+
+            /* growing moved every entry. */
+            CHARGE(string_units(key) + (map->capacity != capacity ? (int64_t)map->count : 0));
+            DISPATCH();
+        }
+
+        TARGET(OP_NEWRECORD) {
+            const RecordType* type = chunk->records[instr->c];
+            const Value* fields = &registers[instr->b];
+
+            for (size_t i = 0; i < type->nfields; i++) {
+                const RecordField* field = &type->fields[i];
+
+                if (fields[i].kind != field->kind) {
+                    status = runtime_error(interpreter, pc - 1, "field '%.*s' of %.*s has to be %s but got %s",
+                        (int)field->name.size, field->name.data, (int)type->name.size, type->name.data,
+                        value_kind_stringified[field->kind], value_kind_stringified[fields[i].kind]);
+                    goto finished;
+                }
+            }
+
+            RecordObject* record = record_new(type);
+            if (record == NULL) {
+                status = out_of_memory(interpreter);
+                goto finished;
+            }
+
+            for (size_t i = 0; i < type->nfields; i++)
+                record_store(record->data + type->fields[i].offset, &fields[i]);
+
+            set_register(&registers[instr->a], record_value(record));
+            DISPATCH();
+        }
+
+        /* the field instructions are only compiled for registers the
+         * resolver has proved to hold a struct, or an array of them, of the
+         * type the field belongs to. */
+        TARGET(OP_FIELD) {
+            const RecordObject* record = registers[instr->b].record;
+
+            set_register(&registers[instr->a], record_load(record->data + field_operand_offset(instr->c), field_operand_kind(instr->c)));
+            DISPATCH();
+        }
+
+        TARGET(OP_INDEXFIELD) {
+            const RecordArrayObject* records = registers[instr->b].records;
+            const Value* index = &registers[instr->c];
+
+            status = check_index(interpreter, pc - 1, index, records->size);
+            if (status != KD_OK)
+                goto finished;
+
+            /* the field is in the OP_EXTRAARG that follows. */
+            uint32_t field = code[pc++].bx;
+            const unsigned char* data = record_array_field(records, index->i64, field_operand_offset(field), field_operand_size(field));
+
+            set_register(&registers[instr->a], record_load(data, field_operand_kind(field)));
+            DISPATCH();
+        }
+
+        TARGET(OP_COLUMN) {
+            const RecordArrayObject* records = registers[instr->b].records;
+
+            ArrayObject* column = record_column(records, field_operand_offset(instr->c));
+            if (column == NULL) {
+                status = out_of_memory(interpreter);
+                goto finished;
+            }
+
+            CHARGE(column->size);
+
+            set_register(&registers[instr->a], array_value(field_operand_kind(instr->c) == VAL_INT ? VAL_INT_ARRAY : VAL_DOUBLE_ARRAY, column));
+            DISPATCH();
+        }
+
+        TARGET(OP_EXTRAARG) {
+            status = runtime_error(interpreter, pc - 1, "unreachable!");
+            goto finished;
+        }
+
+        TARGET(OP_DEFINE) {
+            Value value = registers[instr->a];
+
+            /* a struct type, or the key and value kinds of a map. */
+            Type type = {
+                .kind = instr->c & 0xf,
+                .key = instr->c >> 4 & 0xf,
+                .value = instr->c >> 8 & 0xf,
+            };
+
+            if (type.kind == VAL_RECORD || type.kind == VAL_RECORD_ARRAY)
+                type.record = chunk->records[instr->c >> 4];
+
+            if (!value_matches(&value, &type)) {
+                char lhs[64], rhs[64];
+
+                status = runtime_error(interpreter, pc - 1, "mismatch types for variable declaration (lhs: %s, rhs: %s)",
+                    type_stringified(lhs, sizeof(lhs), type.kind, type.key, type.value, type.record),
+                    value_type_stringified(rhs, sizeof(rhs), &value));
+                goto finished;
+            }
+
+            DISPATCH();
+        }
+
+        TARGET(OP_GETGLOBAL) {
+            value_retain(&globals[instr->bx]);
+            set_register(&registers[instr->a], globals[instr->bx]);
+            DISPATCH();
+        }
+
+        /* a long literal, or a rope reaching one, is in the arena of the
+         * statement, which is reset before the next one runs. */
+        TARGET(OP_SETGLOBAL) {
+            const Value* value = &registers[instr->a];
+
+            if (value->kind == VAL_STRING) {
+                if (!string_own(value, &globals[instr->bx])) {
+                    status = out_of_memory(interpreter);
+                    goto finished;
+                }
+
+                DISPATCH();
+            }
+
+            value_retain(value);
+            globals[instr->bx] = *value;
+            DISPATCH();
+        }
+
+        /* the callee's registers go right above the caller's, its arguments
+         * in the first of them. */
+        TARGET(OP_CALL) {
+            Function* function = chunk->functions->items[instr->c];
+            calls++;
+
+            const Chunk* callee = function_chunk(function, interpreter->error);
+            if (callee == NULL) {
+                status = interpreter->error->status;
+                goto finished;
+            }
+
+            if (callee->tier != NULL)
+                callee = tier_call(callee->tier);
+
+            for (size_t i = 0; i < function->nparams; i++) {
+                const Value* arg = &registers[instr->b + i];
+
+                if (!value_matches(arg, &function->params[i])) {
+                    const Type* param = &function->params[i];
+                    char lhs[64], rhs[64];
+
+                    status = runtime_error(interpreter, pc - 1, "argument %zu of '%.*s' has to be %s but got %s",
+                        i + 1, (int)function->name.size, function->name.data,
+                        type_stringified(lhs, sizeof(lhs), param->kind, param->key, param->value, param->record),
+                        value_type_stringified(rhs, sizeof(rhs), arg));
+                    goto finished;
+                }
+            }
+
+            if (interpreter->nframes == MAX_FRAMES) {
+                status = runtime_error(interpreter, pc - 1, "too many nested calls");
+                goto finished;
+            }
+
+            /* not realloc, the sampling profiler may read the old frames
+             * until the new ones are in place. */
+            if (interpreter->nframes == interpreter->frames_capacity) {
+                size_t capacity = interpreter->frames_capacity == 0 ? 16 : interpreter->frames_capacity * 2;
+
+                Frame* frames = malloc(capacity * sizeof(Frame));
+                if (frames == NULL) {
+                    status = out_of_memory(interpreter);
+                    goto finished;
+                }
+
+                Frame* old = interpreter->frames;
+                if (interpreter->nframes > 0)
+                    memcpy(frames, old, interpreter->nframes * sizeof(Frame));
+
+                __atomic_signal_fence(__ATOMIC_SEQ_CST);
+                interpreter->frames = frames;
+                interpreter->frames_capacity = capacity;
+                __atomic_signal_fence(__ATOMIC_SEQ_CST);
+
+                free(old);
+            }
+
+            size_t base = interpreter->base + chunk->nregisters;
+
+            status = grow_registers(interpreter, base + callee->nregisters);
+            if (status != KD_OK)
+                goto finished;
+
+            registers = interpreter->registers + interpreter->base;
+
+            Value* args = interpreter->registers + base;
+            for (size_t i = 0; i < function->nparams; i++) {
+                value_retain(&registers[instr->b + i]);
+                set_register(&args[i], registers[instr->b + i]);
+            }
+
+            interpreter->frames[interpreter->nframes] = (Frame) {
+                .chunk = chunk,
+                .pc = pc,
+                .base = interpreter->base,
+                .result = instr->a,
+                .function = interpreter->function,
+            };
+
+            switch_frame(interpreter, callee, function, 0, interpreter->nframes + 1);
+
+            chunk = callee;
+            interpreter->base = base;
+
+            code = chunk->code;
+            constants = chunk->constants;
+            registers = args;
+            pc = 0;
+            DISPATCH();
+        }
+
+        /* the task's deps are passed to it as they finish, see parallel.h. */
+        TARGET(OP_SPAWN) {
+            status = parallel_spawn(interpreter, instr->a, &registers[instr->b]);
+            if (status != KD_OK)
+                goto finished;
+            DISPATCH();
+        }
+
+        TARGET(OP_JOIN) {
+            Value result;
+
+            status = parallel_join(interpreter, instr->b, &result);
+
+            /* it is fetched, and counted, again on resume. */
+            if (status == KD_SUSPENDED) {
+                pc--;
+                fuel++;
+                goto suspended;
+            }
+
+            if (status != KD_OK)
+                goto finished;
+
+            set_register(&registers[instr->a], result);
+            DISPATCH();
+        }
+
+        /* the iterations run to the end before the next instruction, on
+         * the threads of the pool, see parallel.h. they run on the fuel of
+         * the run, which suspends on this instruction when they need more
+         * than is left. */
+        TARGET(OP_PARFOR) {
+            Value result;
+            int64_t used;
+
+            status = parallel_for(interpreter, instr->c, &registers[instr->b], fuel, &used, &result);
+            CHARGE(used);
+
+            /* as for OP_JOIN. */
+            if (status == KD_SUSPENDED) {
+                pc--;
+                fuel++;
+                goto suspended;
+            }
+
+            if (status != KD_OK)
+                goto finished;
+
+            set_register(&registers[instr->a], result);
+            DISPATCH();
+        }
+
+        TARGET(OP_JMP) {
+            pc += instr->sbx;
+            DISPATCH();
+        }
+
+        TARGET(OP_LOOP) {
+            uint32_t* counter = &chunk->backedges[instr->a];
+            uint32_t count = __atomic_load_n(counter, __ATOMIC_RELAXED);
+
+            if (count < BACKEDGE_LIMIT) {
+                __atomic_store_n(counter, count + 1, __ATOMIC_RELAXED);
+
+                /* a hot loop of the first tier goes on in the second from
+                 * where it is, see tier.h. */
+                if (chunk->tier != NULL && count + 1 == chunk->tier->loops_threshold) {
+                    const Chunk* entered = tier_enter_loop(chunk->tier, instr->a, pc - 1);
+
+                    if (entered != NULL) {
+                        status = enter_loop(interpreter, chunk, &chunk->loops[instr->a], entered);
+                        if (status != KD_OK)
+                            goto finished;
+
+                        switch_frame(interpreter, entered, interpreter->function, 0, interpreter->nframes);
+                        chunk = entered;
+
+                        code = chunk->code;
+                        constants = chunk->constants;
+                        registers = interpreter->registers + interpreter->base;
+                        pc = 0;
+                        DISPATCH();
+                    }
+                }
+            }
+
+            pc += instr->sbx;
+            DISPATCH();
+        }
+
+        TARGET(OP_JMPIFNOT) {
+            Value value = registers[instr->a];
+
+            if (value.kind != VAL_BOOL) {
+                status = runtime_error(interpreter, pc - 1, "expected boolean expression but got %s", value_kind_stringified[value.kind]);
+                goto finished;
+            }
+
+            if (!value.bool)
+                pc += instr->sbx;
+            DISPATCH();
+        }
+
+        TARGET(OP_RETURN) {
+            const Function* function = interpreter->function;
+
+            if (function != NULL) {
+                Value result = registers[instr->a];
+
+                if (!value_matches(&result, &function->result)) {
+                    const Type* type = &function->result;
+                    char lhs[64], rhs[64];
+
+                    status = runtime_error(interpreter, pc - 1, "'%.*s' has to return %s but got %s",
+                        (int)function->name.size, function->name.data,
+                        type_stringified(lhs, sizeof(lhs), type->kind, type->key, type->value, type->record),
+                        value_type_stringified(rhs, sizeof(rhs), &result));
+                    goto finished;
+                }
+
+                /* the result keeps the reference its register had. */
+                registers[instr->a] = (Value) { .kind = VAL_INT, .i64 = 0 };
+                release_registers(registers, chunk->nregisters);
+
+                /* until the next instruction the caller is at its call. */
+                Frame* frame = &interpreter->frames[interpreter->nframes - 1];
+                switch_frame(interpreter, frame->chunk, frame->function, frame->pc - 1, interpreter->nframes - 1);
+
+                chunk = frame->chunk;
+                interpreter->base = frame->base;
+
+                code = chunk->code;
+                constants = chunk->constants;
+                registers = interpreter->registers + frame->base;
+                pc = frame->pc;
+
+                set_register(&registers[frame->result], result);
+                DISPATCH();
+            }
+
+            interpreter->returned = 1;
+
+            value_retain(&registers[instr->a]);
+            interpreter->result = registers[instr->a];
+
+            if (registers[instr->a].kind == VAL_INT)
+                interpreter->exit_code = registers[instr->a].i64;
+            goto finished;
+        }
+
+        TARGET(OP_HALT) {
+            const Function* function = interpreter->function;
+
+            if (function != NULL) {
+                status = runtime_error(interpreter, pc - 1, "'%.*s' ended without returning a value",
+                    (int)function->name.size, function->name.data);
+            }
+
+            goto finished;
+        }
+#ifndef KD_COMPUTED_GOTO
+    }
+#endif
+
+deopt:
+    quicken_store(instr, generic_form[op]);
+    deopts++;
+
+generic_binop: {
+        OpCode generic = generic_form[op];
+        Value lhs = registers[instr->b];
+        Value rhs = generic >= OP_ADDK ? constants[instr->c] : registers[instr->c];
+        Value result;
+        int64_t used = 0;
+
+        status = evaluate_binop(interpreter, pc - 1, binop_char[generic], &lhs, &rhs, fuel, &used, &result);
+        CHARGE(used);
+
+        /* as for OP_JOIN. */
+        if (status == KD_SUSPENDED) {
+            pc--;
+            fuel++;
+            goto suspended;
+        }
+
+        if (status != KD_OK)
+            goto finished;
+
+        set_register(&registers[instr->a], result);
+        generic_count++;
+
+        OpCode quick = quickened_form(generic, lhs, rhs);
+        if (quick != generic && op == generic) {
+            quicken_store(instr, quick);
+            rewrites++;
+        }
+
+        DISPATCH();
+    }
+
+finished:
+    interpreter->state = INTERPRETER_FINISHED;
+
+    if (interpreter->parallel != NULL)
+        status = parallel_finish(interpreter, status);
+
+    release_registers(interpreter->registers, interpreter->base + chunk->nregisters);
+
+    /* an error in a callee has been reported from its chunk already. */
+    if (interpreter->nframes > 0) {
+        const Frame* root = &interpreter->frames[0];
+
+        switch_frame(interpreter, root->chunk, NULL, root->pc - 1, 0);
+        chunk = root->chunk;
+    }
+
+    interpreter->base = 0;
+    interpreter->function = NULL;
+
+suspended:
+    interpreter->pc = pc;
+    interpreter->fuel_used += budget - fuel;
+
+    /* a suspended run tries again the next time it returns. */
+    if (output_flush(&interpreter->output, 1) == OUTPUT_WRITE && interpreter->state == INTERPRETER_FINISHED) {
+        if (status == KD_OK)
+            status = write_failed(interpreter);
+        else
+            interpreter->output.size = 0;
+    }
+
+    interpreter->quicken.generic += generic_count;
+    interpreter->quicken.quickened += quickened;
+    interpreter->quicken.rewrites += rewrites;
+    interpreter->quicken.deopts += deopts;
+
+    stats_add(STAT_INSTRUCTIONS, budget - fuel - delegated);
+    stats_add(STAT_CALLS, calls);
+
+    sample_leave(outer);
+    return status;
+}
+
+static kd_status runtime_error(Interpreter* interpreter, size_t pc, const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+
+    interpreter->error->status = KD_ERROR_RUNTIME;
+    interpreter->error->line = interpreter->chunk->positions[pc].line;
+    interpreter->error->col = interpreter->chunk->positions[pc].col;
+    vsnprintf(interpreter->error->message, sizeof(interpreter->error->message), fmt, args);
+
+    va_end(args);
+    return KD_ERROR_RUNTIME;
+}
+
+static kd_status out_of_memory(Interpreter* interpreter) {
+    interpreter->error->status = KD_ERROR_NOMEM;
+    interpreter->error->line = 0;
+    interpreter->error->col = 0;
+    snprintf(interpreter->error->message, sizeof(interpreter->error->message), "cannot allocate memory!");
+
+    return KD_ERROR_NOMEM;
+}
+
+/* the output of a run that has ended could not be written, what is left
+ * of it is dropped. */
+static kd_status write_failed(Interpreter* interpreter) {
+    interpreter->error->status = KD_ERROR_RUNTIME;
+    interpreter->error->line = 0;
+    interpreter->error->col = 0;
+    snprintf(interpreter->error->message, sizeof(interpreter->error->message), "cannot write the output: %s", strerror(errno));
+
+    interpreter->output.size = 0;
+    return KD_ERROR_RUNTIME;
+}
+
+/* leaves every register holding a plain 0. */
+static void release_registers(Value* registers, size_t nregisters) {
+    for (size_t i = 0; i < nregisters; i++) {
+        value_release(&registers[i]);
+        registers[i] = (Value) { .kind = VAL_INT, .i64 = 0 };
+    }
+}
+
+/* the values live at the OP_LOOP of loop go to the first registers of the
+ * frame, where to finds its arguments, and the rest of what from had in
+ * them is released. */
+static kd_status enter_loop(Interpreter* interpreter, const Chunk* from, const ChunkLoop* loop, const Chunk* to) {
+    kd_status status = grow_registers(interpreter, interpreter->base + to->nregisters);
+    if (status != KD_OK)
+        return status;
+
+    Value* registers = interpreter->registers + interpreter->base;
+    Value values[TIER_MAX_VALUES];
+
+    for (size_t i = 0; i < loop->nvalues; i++) {
+        values[i] = registers[loop->registers[i]];
+        registers[loop->registers[i]] = (Value) { .kind = VAL_INT, .i64 = 0 };
+    }
+
+    release_registers(registers, from->nregisters);
+
+    for (size_t i = 0; i < loop->nvalues; i++)
+        registers[i] = values[i];
+
+    return KD_OK;
+}
+
+/* the register file is kept between runs and calls, it only ever grows. */
+static kd_status grow_registers(Interpreter* interpreter, size_t nregisters) {
+    if (interpreter->nregisters >= nregisters)
+        return KD_OK;
+
+    size_t capacity = interpreter->nregisters * 2 > nregisters ? interpreter->nregisters * 2 : nregisters;
+
+    Value* registers = realloc(interpreter->registers, capacity * sizeof(Value));
+    if (registers == NULL)
+        return out_of_memory(interpreter);
+
+    /* the new registers hold garbage, there is nothing to release. */
+    for (size_t i = interpreter->nregisters; i < capacity; i++)
+        registers[i] = (Value) { .kind = VAL_INT, .i64 = 0 };
+
+    interpreter->registers = registers;
+    interpreter->nregisters = capacity;
+    return KD_OK;
+}
+
+/* whether value can be stored in a variable declared with type. */
+static int value_matches(const Value* value, const Type* type) {
+    if (value->kind != type->kind)
+        return 0;
+
+    switch (type->kind) {
+    case VAL_MAP:
+        return value->map->key_kind == type->key && value->map->value_kind == type->value;
+    case VAL_RECORD:
+        return value->record->type == type->record;
+    case VAL_RECORD_ARRAY:
+        return value->records->type == type->record;
+    default:
+        return 1;
+    }
+}
+
+/* the specialised form of a generic arithmetic instruction that just ran with
+ * lhs and rhs, or generic itself when there is none. */
+static OpCode quickened_form(OpCode generic, Value lhs, Value rhs) {
+#ifdef KD_NO_QUICKEN
+    return generic;
+#endif
+
+    if (lhs.kind != rhs.kind)
+        return generic;
+
+    int offset = generic >= OP_ADDK ? generic - OP_ADDK : generic - OP_ADD;
+
+    if (generic >= OP_ADDK) {
+        if (generic == OP_DIVK && lhs.kind == VAL_INT && (rhs.i64 == 0 || rhs.i64 == -1))
+            return generic;
+
+        if (lhs.kind == VAL_INT)
+            return OP_ADDK_I64 + offset;
+        if (lhs.kind == VAL_DOUBLE)
+            return OP_ADDK_F64 + offset;
+
+        return generic;
+    }
+
+    if (lhs.kind == VAL_INT)
+        return OP_ADD_I64 + offset;
+    if (lhs.kind == VAL_DOUBLE)
+        return OP_ADD_F64 + offset;
+
+    return generic;
+}
+
+/* result is left with its own reference. an operation on arrays goes
+ * through their elements block by block, adding them to used, and returns
+ * KD_SUSPENDED once it has used up fuel, see ArrayStep. */
+static kd_status evaluate_binop(Interpreter* interpreter, size_t pc, char op, const Value* lhs, const Value* rhs, int64_t fuel, int64_t* used, Value* result) {
+    if (value_is_array(lhs) || value_is_array(rhs))
+        return evaluate_array_binop(interpreter, pc, op, lhs, rhs, fuel, used, result);
+
+    if (lhs->kind != rhs->kind) {
+        return runtime_error(interpreter, pc, "invalid operands for binary operator '%c' (lhs: %s, rhs: %s)",
+            op, value_kind_stringified[lhs->kind], value_kind_stringified[rhs->kind]);
+    }
+
+    switch (lhs->kind) {
+    case VAL_INT:
+        if (op == '/' && rhs->i64 == 0)
+            return runtime_error(interpreter, pc, "division by zero");
+
+        *result = (Value) {
+            .kind = lhs->kind,
+            .i64  = evaluate_binop_int(lhs->i64, rhs->i64, op),
+        };
+
+        return KD_OK;
+    case VAL_DOUBLE:
+        *result = (Value) {
+            .kind = lhs->kind,
+            .f64  = evaluate_binop_double(lhs->f64, rhs->f64, op),
+        };
+
+        return KD_OK;
+    case VAL_STRING:
+        if (op != '+')
+            break;
+
+        if (!string_concat(lhs, rhs, result))
+            return out_of_memory(interpreter);
+
+        return KD_OK;
+    default:
         break;
+    }
+
+    return runtime_error(interpreter, pc, "binary operator '%c' is not supported for %s", op, value_kind_stringified[lhs->kind]);
+}
+
+static kd_status evaluate_equals(Interpreter* interpreter, size_t pc, const Value* lhs, const Value* rhs, int* equal) {
+    if (lhs->kind != rhs->kind) {
+        return runtime_error(interpreter, pc, "cannot compare %s with %s",
+            value_kind_stringified[lhs->kind], value_kind_stringified[rhs->kind]);
+    }
+
+    switch (lhs->kind) {
+    case VAL_INT:
+        *equal = lhs->i64 == rhs->i64;
+        return KD_OK;
+    case VAL_DOUBLE:
+        *equal = lhs->f64 == rhs->f64;
+        return KD_OK;
+    case VAL_BOOL:
+        *equal = lhs->bool == rhs->bool;
+        return KD_OK;
+    case VAL_STRING:
+        *equal = string_equals(lhs, rhs);
+        if (*equal < 0)
+            return out_of_memory(interpreter);
+
+        return KD_OK;
     default:
-        fprintf(stderr, "ERROR: unsupported statement\n");
-        exit(1);
+        return runtime_error(interpreter, pc, "cannot compare %s values", value_kind_stringified[lhs->kind]);
+    }
+}
+
+/* a NaN key could never be found again, it is not equal to itself. */
+static kd_status check_map_key(Interpreter* interpreter, size_t pc, const MapObject* map, const Value* key) {
+    if (key->kind != map->key_kind) {
+        return runtime_error(interpreter, pc, "map key has to be %s but got %s",
+            value_kind_stringified[map->key_kind], value_kind_stringified[key->kind]);
+    }
+
+    if (key->kind == VAL_DOUBLE && key->f64 != key->f64)
+        return runtime_error(interpreter, pc, "map key cannot be NaN");
+
+    return KD_OK;
+}
+
+static kd_status check_map_value(Interpreter* interpreter, size_t pc, const MapObject* map, const Value* value) {
+    if (value->kind != map->value_kind) {
+        return runtime_error(interpreter, pc, "map value has to be %s but got %s",
+            value_kind_stringified[map->value_kind], value_kind_stringified[value->kind]);
     }
+
+    return KD_OK;
+}
+
+/* the name of a type as it is written in a declaration. */
+static const char* type_stringified(char* buffer, size_t size, ValueKind kind, ValueKind key, ValueKind value, const RecordType* record) {
+    if (kind == VAL_MAP)
+        snprintf(buffer, size, "map[%s]%s", value_kind_stringified[key], value_kind_stringified[value]);
+    else if (kind == VAL_RECORD)
+        snprintf(buffer, size, "%.*s", (int)record->name.size, record->name.data);
+    else if (kind == VAL_RECORD_ARRAY)
+        snprintf(buffer, size, "[]%.*s", (int)record->name.size, record->name.data);
+    else
+        return value_kind_stringified[kind];
+
+    return buffer;
 }
 
-static void evaluate_var_decl(Interpreter* interpreter, VarDecl* vardecl) {
-    SymTable* new_node = malloc(sizeof(SymTable));
-    if (new_node == NULL) {
-        fprintf(stderr, "ERROR: cannot allocate memory!\n");
-        exit(1);
+static const char* value_type_stringified(char* buffer, size_t size, const Value* value) {
+    switch (value->kind) {
+    case VAL_MAP:
+        return type_stringified(buffer, size, VAL_MAP, value->map->key_kind, value->map->value_kind, NULL);
+    case VAL_RECORD:
+        return type_stringified(buffer, size, VAL_RECORD, 0, 0, value->record->type);
+    case VAL_RECORD_ARRAY:
+        return type_stringified(buffer, size, VAL_RECORD_ARRAY, 0, 0, value->records->type);
+    default:
+        return value_kind_stringified[value->kind];
     }
+}
+
+static kd_status check_index(Interpreter* interpreter, size_t pc, const Value* index, size_t size) {
+    if (index->kind != VAL_INT)
+        return runtime_error(interpreter, pc, "array index has to be i64 but got %s", value_kind_stringified[index->kind]);
 
-    Value expr_value = evaluate_expression(vardecl->expr);
+    if (index->i64 < 0 || (uint64_t)index->i64 >= size)
+        return runtime_error(interpreter, pc, "index %lld out of bounds for an array of %zu elements", (long long)index->i64, size);
 
-    if (vardecl->type != expr_value.kind) {
-        fprintf(stderr, "ERROR: mismatch types for variable declaration\n");
-        fprintf(stderr, "    lhs: %d\n", vardecl->type);
-        fprintf(stderr, "    rhs: %d\n", expr_value.kind);
-        exit(1);
+    return KD_OK;
+}
+
+/* the kind of the elements of an array, or of a scalar itself. */
+static ValueKind element_kind(const Value* value) {
+    switch (value->kind) {
+    case VAL_INT_ARRAY:
+        return VAL_INT;
+    case VAL_DOUBLE_ARRAY:
+        return VAL_DOUBLE;
+    default:
+        return value->kind;
     }
+}
 
-    new_node->id = vardecl->id;
-    new_node->value = expr_value;
+/* whether another block of an array instruction runs before the run
+ * suspends: the first one since it was resumed always does, so it gets
+ * somewhere even on the last unit of fuel. */
+static inline int block_fits(int64_t fuel, int64_t used) {
+    return used == 0 || used < fuel;
+}
 
+static inline size_t block_end(size_t done, size_t size) {
+    return size - done > ARRAY_BLOCK ? done + ARRAY_BLOCK : size;
+}
 
-    new_node->next = interpreter->symbols;
-    interpreter->symbols = new_node;
+static void end_step(ArrayStep* step) {
+    value_release(&step->partial);
+    step->partial = (Value) { .kind = VAL_INT, .i64 = 0 };
+    step->active = 0;
 }
 
-static void evaluate_if_statement(Interpreter* interpreter, IfStatement* ifstatement) {
-    Value bool_val = evaluate_expression(ifstatement->expr);
+/* what the finished step made, with its reference. */
+static Value take_step(ArrayStep* step) {
+    Value partial = step->partial;
+
+    step->partial = (Value) { .kind = VAL_INT, .i64 = 0 };
+    step->active = 0;
+
+    return partial;
+}
+
+static kd_status evaluate_array_binop(Interpreter* interpreter, size_t pc, char op, const Value* lhs, const Value* rhs, int64_t fuel, int64_t* used, Value* result) {
+    ValueKind kind = element_kind(lhs);
+
+    if (kind != element_kind(rhs) || (kind != VAL_INT && kind != VAL_DOUBLE)) {
+        return runtime_error(interpreter, pc, "invalid operands for binary operator '%c' (lhs: %s, rhs: %s)",
+            op, value_kind_stringified[lhs->kind], value_kind_stringified[rhs->kind]);
+    }
+
+    ArrayStep* step = &interpreter->step;
+    ArrayStatus status = ARRAY_OK;
 
-    if (bool_val.kind != VAL_BOOL) {
-        fprintf(stderr, "ERROR: expected boolean expression but got else\n");
-        exit(1);
+    if (!step->active) {
+        status = array_binop_begin(op, lhs, rhs, &step->partial);
+        step->active = status == ARRAY_OK;
+        step->done = 0;
     }
 
-    if (bool_val.bool) {
-        evaluate_block_statement(interpreter, ifstatement->if_block);
-    } else {
-        if (ifstatement->else_block == NULL)
-            return;
+    while (status == ARRAY_OK && step->done < step->partial.array->size) {
+        if (!block_fits(fuel, *used))
+            return KD_SUSPENDED;
+
+        size_t to = block_end(step->done, step->partial.array->size);
+
+        status = array_binop_range(op, lhs, rhs, &step->partial, step->done, to);
+        *used += to - step->done;
+        step->done = to;
+    }
 
-        evaluate_block_statement(interpreter, ifstatement->else_block);
+    if (status == ARRAY_OK) {
+        *result = take_step(step);
+        return KD_OK;
     }
+
+    end_step(step);
+
+    switch (status) {
+    case ARRAY_NOMEM:
+        return out_of_memory(interpreter);
+    case ARRAY_SIZE_MISMATCH:
+        return runtime_error(interpreter, pc, "arrays of %zu and %zu elements for binary operator '%c'",
+            lhs->array->size, rhs->array->size, op);
+    default:
+        return runtime_error(interpreter, pc, "division by zero");
+    }
+}
+
+/* the unit of fuel a string costs for every byte of it a rope that has to
+ * be flattened first copies. */
+static int64_t string_units(const Value* value) {
+    return value->kind == VAL_STRING ? (int64_t)string_unflattened(value) : 0;
+}
+
+/* strings of the same size are compared byte by byte. */
+static int64_t equals_units(const Value* lhs, const Value* rhs) {
+    if (lhs->kind != VAL_STRING || rhs->kind != VAL_STRING)
+        return 0;
+
+    int64_t units = string_units(lhs) + string_units(rhs);
+    if (string_size(lhs) == string_size(rhs))
+        units += string_size(lhs);
+
+    return units;
 }
 
-static void evaluate_block_statement(Interpreter* interpreter, BlockStatement* blockstatement) {
-    while (1) {
-        evaluate_statement(interpreter, blockstatement->statement);
-        blockstatement = blockstatement->next;
+/* the reduction of the elements of args from up to to, into partial. the
+ * blocks after the first are combined with what the ones before gave, as
+ * a loop over the elements would: min and max skip the NaN elements that
+ * begin a block, a loop would not keep them either. */
+static void reduce_block(Builtin builtin, const Value* args, size_t from, size_t to, Value* partial) {
+    const ArrayObject* array = args[0].array;
+    int first = from == 0;
+
+    if (args[0].kind == VAL_INT_ARRAY) {
+        const int64_t* data = array->i64 + from;
+        size_t n = to - from;
+        int64_t value;
+
+        switch (builtin) {
+        case BUILTIN_SUM:
+            value = array_sum_i64(data, n);
+            partial->i64 = first ? value : (int64_t)((uint64_t)partial->i64 + (uint64_t)value);
+            break;
+        case BUILTIN_MIN:
+            value = array_min_i64(data, n);
+            partial->i64 = first || value < partial->i64 ? value : partial->i64;
+            break;
+        case BUILTIN_MAX:
+            value = array_max_i64(data, n);
+            partial->i64 = first || value > partial->i64 ? value : partial->i64;
+            break;
+        default:
+            value = array_dot_i64(data, args[1].array->i64 + from, n);
+            partial->i64 = first ? value : (int64_t)((uint64_t)partial->i64 + (uint64_t)value);
+            break;
+        }
+
+        return;
+    }
+
+    const double* data = array->f64 + from;
+    size_t n = to - from;
+    double value;
+
+    switch (builtin) {
+    case BUILTIN_SUM:
+        value = array_sum_f64(data, n);
+        partial->f64 = first ? value : partial->f64 + value;
+        break;
+    case BUILTIN_MIN:
+    case BUILTIN_MAX:
+        while (!first && n > 0 && data[0] != data[0]) {
+            data++;
+            n--;
+        }
+
+        if (n == 0)
+            break;
+
+        if (builtin == BUILTIN_MIN) {
+            value = array_min_f64(data, n);
+            partial->f64 = first || value < partial->f64 ? value : partial->f64;
+        } else {
+            value = array_max_f64(data, n);
+            partial->f64 = first || value > partial->f64 ? value : partial->f64;
+        }
+
+        break;
+    default:
+        value = array_dot_f64(data, args[1].array->f64 + from, n);
+        partial->f64 = first ? value : partial->f64 + value;
+        break;
     }
 }
 
-static Value evaluate_expression(Expr* expr) {
-    if (expr->kind == EXPR_BINARY) {
-        Value lhs = evaluate_expression(expr->Binary.lhs);
-        Value rhs = evaluate_expression(expr->Binary.rhs);
+/* args are the values of consecutive registers, as many as the resolver
+ * checked the builtin takes. the builtins over arrays go through them block
+ * by block as evaluate_binop does, the others add the elements they go
+ * through to used. */
+static kd_status evaluate_builtin(Interpreter* interpreter, size_t pc, Builtin builtin, const Value* args, int64_t fuel, int64_t* used, Value* result) {
+    static const char* names[] = {
+        [BUILTIN_LEN] = "len", [BUILTIN_SUM] = "sum", [BUILTIN_MIN] = "min", [BUILTIN_MAX] = "max",
+        [BUILTIN_DOT] = "dot", [BUILTIN_FILL] = "fill", [BUILTIN_IOTA] = "iota",
+        [BUILTIN_HAS] = "has", [BUILTIN_PUT] = "put", [BUILTIN_DEL] = "del",
+        [BUILTIN_PRINT] = "print", [BUILTIN_PRINTLN] = "println",
+    };
+
+    ArrayStep* step = &interpreter->step;
+
+    /* print answers how many bytes it wrote. */
+    if (builtin == BUILTIN_PRINT || builtin == BUILTIN_PRINTLN) {
+        Output* output = &interpreter->output;
+        size_t size = output->size;
+
+        OutputStatus status = output_value(output, &args[0], builtin == BUILTIN_PRINTLN);
+
+        if (status != OUTPUT_OK)
+            output->size = size;
 
-        if (lhs.kind != rhs.kind) {
-            fprintf(stderr, "ERROR: invalid operands for binary operator '%c'\n", expr->Binary.op);
-            fprintf(stderr, "    lhs: %d\n", lhs.kind);
-            fprintf(stderr, "    rhs: %d\n", rhs.kind);
-            exit(1);
+        if (status == OUTPUT_KIND) {
+            return runtime_error(interpreter, pc, "%s expects an i64, f64, bool, string or array of numbers but got %s",
+                names[builtin], value_kind_stringified[args[0].kind]);
         }
 
-        switch (lhs.kind) {
-        case VAL_INT:
-            return (Value) {
-                .kind = lhs.kind,
-                .i64  = evaluate_binop_int(lhs.i64, rhs.i64, expr->Binary.op),
-            };
-        case VAL_DOUBLE:
-            return (Value) {
-                .kind = lhs.kind,
-                .f64  = evaluate_binop_double(lhs.f64, rhs.f64, expr->Binary.op),
-            };
+        if (status == OUTPUT_NOMEM)
+            return out_of_memory(interpreter);
+
+        *result = (Value) { .kind = VAL_INT, .i64 = (int64_t)(output->size - size) };
+
+        if (value_is_array(&args[0]))
+            *used = args[0].array->size;
+        else if (args[0].kind == VAL_STRING)
+            *used = string_size(&args[0]);
+
+        if (output_flush(output, 0) == OUTPUT_WRITE)
+            return runtime_error(interpreter, pc, "cannot write the output: %s", strerror(errno));
+
+        return KD_OK;
+    }
+
+    /* has and del answer whether the key was there, put whether it was new. */
+    if (builtin == BUILTIN_HAS || builtin == BUILTIN_PUT || builtin == BUILTIN_DEL) {
+        if (args[0].kind != VAL_MAP)
+            return runtime_error(interpreter, pc, "%s expects a map but got %s", names[builtin], value_kind_stringified[args[0].kind]);
+
+        MapObject* map = args[0].map;
+
+        kd_status status = check_map_key(interpreter, pc, map, &args[1]);
+        if (status == KD_OK && builtin == BUILTIN_PUT)
+            status = check_map_value(interpreter, pc, map, &args[2]);
+        if (status != KD_OK)
+            return status;
+
+        Value value;
+        int found;
+        size_t capacity = map->capacity;
+
+        *used = string_units(&args[1]);
+
+        switch (builtin) {
+        case BUILTIN_HAS:
+            found = map_get(map, &args[1], &value) == MAP_OK;
+            break;
+        case BUILTIN_PUT:
+            if (map_put(map, &args[1], &args[2], &found) != MAP_OK)
+                return out_of_memory(interpreter);
+            break;
         default:
-            exit(1); // unreachable
+            found = map_delete(map, &args[1]) == MAP_OK;
+            break;
+        }
+
+        /* growing moved every entry. */
+        if (map->capacity != capacity)
+            *used += map->count;
+
+        *result = (Value) { .kind = VAL_BOOL, .bool = found };
+        return KD_OK;
+    }
+
+    if (builtin == BUILTIN_FILL || builtin == BUILTIN_IOTA) {
+        if (args[0].kind != VAL_INT || args[0].i64 < 0)
+            return runtime_error(interpreter, pc, "%s expects a size of at least 0 as its first argument", names[builtin]);
+
+        if (builtin == BUILTIN_FILL && args[1].kind == VAL_RECORD) {
+            const RecordObject* record = args[1].record;
+
+            if (!step->active) {
+                RecordArrayObject* records = (uint64_t)args[0].i64 > SIZE_MAX ? NULL : record_array_new(record->type, args[0].i64);
+                if (records == NULL)
+                    return out_of_memory(interpreter);
+
+                step->partial = record_array_value(records);
+                step->active = 1;
+                step->done = 0;
+            }
+
+            RecordArrayObject* records = step->partial.records;
+
+            while (step->done < records->size) {
+                if (!block_fits(fuel, *used))
+                    return KD_SUSPENDED;
+
+                size_t to = block_end(step->done, records->size);
+
+                for (size_t i = step->done; i < to; i++)
+                    record_array_set(records, i, record);
+
+                *used += to - step->done;
+                step->done = to;
+            }
+
+            *result = take_step(step);
+            return KD_OK;
+        }
+
+        if (args[1].kind != VAL_INT && args[1].kind != VAL_DOUBLE)
+            return runtime_error(interpreter, pc, "%s expects an i64 or f64 element but got %s", names[builtin], value_kind_stringified[args[1].kind]);
+
+        if (!step->active) {
+            ArrayObject* array = (uint64_t)args[0].i64 > SIZE_MAX ? NULL : array_new(args[0].i64);
+            if (array == NULL)
+                return out_of_memory(interpreter);
+
+            step->partial = array_value(args[1].kind == VAL_INT ? VAL_INT_ARRAY : VAL_DOUBLE_ARRAY, array);
+            step->active = 1;
+            step->done = 0;
+        }
+
+        ArrayObject* array = step->partial.array;
+
+        while (step->done < array->size) {
+            if (!block_fits(fuel, *used))
+                return KD_SUSPENDED;
+
+            size_t to = block_end(step->done, array->size);
+
+            /* iota counts up from the element, fill repeats it. */
+            for (size_t i = step->done; i < to; i++) {
+                if (args[1].kind == VAL_INT)
+                    array->i64[i] = (int64_t)((uint64_t)args[1].i64 + (builtin == BUILTIN_IOTA ? i : 0));
+                else
+                    array->f64[i] = args[1].f64 + (builtin == BUILTIN_IOTA ? (double)i : 0);
+            }
+
+            *used += to - step->done;
+            step->done = to;
         }
+
+        *result = take_step(step);
+        return KD_OK;
+    }
+
+    const Value* array = &args[0];
+
+    if (!value_is_array(array))
+        return runtime_error(interpreter, pc, "%s expects an array but got %s", names[builtin], value_kind_stringified[array->kind]);
+
+    size_t size = array->array->size;
+    int is_int = array->kind == VAL_INT_ARRAY;
+
+    switch (builtin) {
+    case BUILTIN_SUM:
+        break;
+    case BUILTIN_MIN:
+    case BUILTIN_MAX:
+        if (size == 0)
+            return runtime_error(interpreter, pc, "%s of an empty array", names[builtin]);
+
+        break;
+    case BUILTIN_DOT:
+        if (args[1].kind != array->kind) {
+            return runtime_error(interpreter, pc, "dot expects two arrays of the same kind (lhs: %s, rhs: %s)",
+                value_kind_stringified[array->kind], value_kind_stringified[args[1].kind]);
+        }
+
+        if (args[1].array->size != size)
+            return runtime_error(interpreter, pc, "dot of arrays of %zu and %zu elements", size, args[1].array->size);
+
+        break;
+    default:
+        return runtime_error(interpreter, pc, "unreachable!");
     }
 
-    return expr->Primary;
+    /* the sum of no elements is 0. */
+    if (!step->active) {
+        step->partial = is_int ? (Value) { .kind = VAL_INT, .i64 = 0 } : (Value) { .kind = VAL_DOUBLE, .f64 = 0 };
+        step->active = 1;
+        step->done = 0;
+    }
+
+    while (step->done < size) {
+        if (!block_fits(fuel, *used))
+            return KD_SUSPENDED;
+
+        size_t to = block_end(step->done, size);
+
+        reduce_block(builtin, args, step->done, to, &step->partial);
+        *used += to - step->done;
+        step->done = to;
+    }
+
+    *result = take_step(step);
+    return KD_OK;
 }
 
+/* wraps around on overflow. rhs is never 0 for '/'. */
 static int64_t evaluate_binop_int(int64_t lhs, int64_t rhs, char op) {
     switch (op) {
     case '+':
-        return lhs + rhs;
+        return (int64_t)((uint64_t)lhs + (uint64_t)rhs);
     case '-':
-        return lhs - rhs;
+        return (int64_t)((uint64_t)lhs - (uint64_t)rhs);
     case '*':
-        return lhs * rhs;
-    case '/':
-        return lhs / rhs;
+        return (int64_t)((uint64_t)lhs * (uint64_t)rhs);
     default:
-        fprintf(stderr, "ERROR: invalid binary operation!\n");
-        exit(1);
+        if (rhs == -1)
+            return (int64_t)(0 - (uint64_t)lhs);
+
+        return lhs / rhs;
     }
 }
 
@@ -153,10 +1840,7 @@ static double evaluate_binop_double(double lhs, double rhs, char op) {
         return lhs - rhs;
     case '*':
         return lhs * rhs;
-    case '/':
-        return lhs / rhs;
     default:
-        fprintf(stderr, "ERROR: invalid binary operation!\n");
-        exit(1);
+        return lhs / rhs;
     }
 }
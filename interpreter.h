@@ -1,21 +1,137 @@
 #ifndef INTERPRETER_H
 #define INTERPRETER_H
 
+#include <stdint.h>
+
+#include "kidomaru.h"
 #include "ast.h"
+#include "bytecode.h"
+#include "output.h"
+
+typedef enum InterpreterState_t {
+    INTERPRETER_IDLE,
+    INTERPRETER_SUSPENDED,
+    INTERPRETER_FINISHED,
+} InterpreterState;
+
+/* a call in progress: what to go back to once the callee returns. */
+typedef struct Frame_t {
+    const Chunk* chunk;
+    size_t pc;
+    size_t base;
+
+    /* the register of the caller the result goes to. */
+    uint16_t result;
+
+    /* the function the caller is running, NULL for the program itself. */
+    const struct Function_t* function;
+} Frame;
+
+#define MAX_FRAMES 16384
 
-typedef struct SymTable_t {
-    Span id;
-    Value value;
-    struct SymTable* next;
-} SymTable;
+/* the frame running now as the sampling profiler reads it, see sample.h:
+ * the function running, NULL for the program itself, where in its chunk a
+ * sample goes when Interpreter.instr is not in it, and the calls around
+ * it. */
+typedef struct Running_t {
+    const Chunk* chunk;
+    const struct Function_t* function;
+    size_t pc;
+    size_t nframes;
+} Running;
 
+/* an instruction going through the elements of an array that used up the
+ * fuel part way, see ARRAY_BLOCK. when the run is resumed on it, it goes on
+ * from done with what it has so far in partial: the array it fills, or the
+ * reduction of the elements before done. */
+typedef struct ArrayStep_t {
+    int active;
+    size_t done;
+    Value partial;
+} ArrayStep;
+
+/* all the state one run mutates. the chunk it executes is only ever read, so
+ * several interpreters can run the same chunk from different threads.
+ *
+ * nothing about a run lives on the C stack between two instructions, so a run
+ * that used up its fuel can be suspended and resumed later from pc. */
 typedef struct Interpreter_t {
-    Statement* root;
-    SymTable* symbols;
+    /* the chunk running now, which is that of a function during a call. */
+    const Chunk* chunk;
+    size_t pc;
+    InterpreterState state;
+
+    /* the instruction running now, stored before it runs, and the frame it
+     * runs in, for the sampling profiler. current is one of running, the
+     * other is written before a call or a return makes it current. */
+    const Instr* instr;
+    Running running[2];
+    const Running* current;
+
+    /* holds the variables as well as the temporaries, so once it has grown
+     * to the largest chunk run on it a run allocates nothing. a callee's
+     * registers start at base, right above those of its caller. */
+    Value* registers;
+    size_t nregisters;
+    size_t base;
+
+    /* the calls in progress and the function running now. */
+    Frame* frames;
+    size_t nframes;
+    size_t frames_capacity;
+    const struct Function_t* function;
+
+    /* the variables of the stream whose statement is running, NULL outside
+     * of one. the stream owns them and grows them before a run declares
+     * new ones, see stream.c. */
+    Value* globals;
+
+    /* instructions a single interpreter_begin or interpreter_resume may run
+     * before it suspends, 0 means no limit. an instruction costs a unit more
+     * for every element of an array, or byte of a string, it goes through. */
+    int64_t fuel;
+    int64_t fuel_used;
+
+    int64_t exit_code;
+
+    /* the run ended in a return rather than by running off its end, and
+     * what it returned, kept until the next run. */
+    int returned;
+    Value result;
+
+    /* the tasks the running chunk spawned, NULL until a chunk first spawns
+     * one, see parallel.h. */
+    struct Parallel_t* parallel;
+
+    /* the par for the run is suspended in the middle of, see parallel.h. */
+    struct ParForRun_t* parfor;
+
+    /* the array instruction the run is suspended in the middle of. */
+    ArrayStep step;
+
+    /* how many threads run the tasks and par fors, 0 for one per core. */
+    size_t nthreads;
+
+    /* what the run printed and has not written out yet. it is written when
+     * full and whenever the run returns, suspended or not. */
+    Output output;
+
+    kd_quicken_stats quicken;
+
+    kd_error* error;
 } Interpreter;
 
-Interpreter interpreter_init(Statement* root);
+Interpreter interpreter_init(kd_error* error);
 void interpreter_deinit(Interpreter* interpreter);
-void interpreter_begin(Interpreter* interpreter);
+
+/* starts a new run of chunk, releasing whatever the previous run left. */
+kd_status interpreter_begin(Interpreter* interpreter, const Chunk* chunk);
+
+/* starts a run of the chunk of a task, see ChunkTask, moving the nargs
+ * values of args to its first registers. */
+kd_status interpreter_begin_task(Interpreter* interpreter, const Chunk* chunk, Value* args, size_t nargs);
+
+/* continues a run that returned KD_SUSPENDED. */
+kd_status interpreter_resume(Interpreter* interpreter);
 
 #endif /* INTERPRETER_H */
@@ -0,0 +1,2081 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+#include "ir.h"
+#include "bytecode.h"
+#include "stats.h"
+
+/* one definition of a variable, the value it has at the end of block. */
+typedef struct VariableDef_t {
+    uint32_t block;
+    uint32_t value;
+} VariableDef;
+
+typedef struct Variable_t {
+    VariableDef* defs;
+    size_t ndefs;
+    size_t capacity;
+} Variable;
+
+/* a phi made for a read in a block whose preds were not all known yet, its
+ * operands are filled in when the block is sealed. */
+typedef struct IncompletePhi_t {
+    uint32_t block;
+    uint32_t variable;
+    uint32_t phi;
+} IncompletePhi;
+
+/* what a yield adds to, op is 0 outside of a for with a reduction. */
+typedef struct Reduction_t {
+    uint32_t variable;
+    char op;
+    ValueKind kind;
+} Reduction;
+
+/* values are numbered as they are lowered, variables are looked up the way
+ * Braun et al. build ssa: in the block itself, else through its preds. */
+typedef struct Builder_t {
+    IrFunction* function;
+
+    /* the frame around the root, NULL unless lowering a statement of a
+     * stream. */
+    const Globals* globals;
+
+    /* IR_NONE once the code being lowered cannot be reached. */
+    uint32_t current;
+
+    Variable* variables;
+    size_t nvariables;
+    size_t variables_capacity;
+
+    /* the variables of every scope from the root to the current one, by
+     * slot. */
+    uint32_t** scopes;
+    size_t depth;
+    size_t scopes_capacity;
+
+    IncompletePhi* incomplete;
+    size_t nincomplete;
+    size_t incomplete_capacity;
+
+    /* the values of the shared constant expressions lowered so far, an open
+     * addressing table by node. */
+    const Expr** memo;
+    uint32_t* memo_values;
+    size_t nmemo;
+    size_t memo_capacity;
+
+    Reduction reduction;
+
+    /* lowering the body of a par for, whose own par fors run in order. */
+    int sequential;
+} Builder;
+
+static void lower_error(IrFunction* function, size_t line, size_t col, const char* fmt, ...);
+static void out_of_memory(IrFunction* function);
+static void* grow(IrFunction* function, void* items, size_t* capacity, size_t size);
+
+static void open_scope(Builder* builder, size_t nslots);
+static void close_scope(Builder* builder);
+
+static uint32_t new_variable(Builder* builder);
+static void write_variable(Builder* builder, uint32_t variable, uint32_t block, uint32_t value);
+static uint32_t read_variable(Builder* builder, uint32_t variable, uint32_t block);
+static uint32_t read_variable_recursive(Builder* builder, uint32_t variable, uint32_t block);
+static uint32_t new_phi(Builder* builder, uint32_t block);
+static uint32_t add_phi_operands(Builder* builder, uint32_t variable, uint32_t phi);
+static uint32_t remove_trivial_phi(IrFunction* function, uint32_t phi);
+static void seal_block(Builder* builder, uint32_t block);
+
+static void terminate(Builder* builder, IrExit exit, uint32_t value, uint32_t then, uint32_t otherwise, size_t line, size_t col);
+static void append(Builder* builder, uint32_t instr);
+
+static void lower_global(Builder* builder, const Statement* statement);
+static void lower_statement(Builder* builder, const Statement* statement);
+static uint32_t lower_define(Builder* builder, const Statement* statement);
+static void lower_if_statement(Builder* builder, const Statement* statement);
+static uint32_t lower_for_statement(Builder* builder, const Statement* statement);
+static uint32_t lower_bound(Builder* builder, const Expr* expr);
+static uint32_t lower_loop(Builder* builder, const Statement* statement, uint32_t from, uint32_t to);
+static uint32_t loop_phi(Builder* builder, uint32_t header, uint32_t initial, Type type);
+static uint32_t lower_parfor(Builder* builder, const Statement* statement, uint32_t from, uint32_t to);
+static void capture_block(IrParFor* parfor, size_t* capacity, IrFunction* function, const BlockStatement* blockstatement, size_t nesting);
+static void capture_statement(IrParFor* parfor, size_t* capacity, IrFunction* function, const Statement* statement, size_t nesting);
+static void capture_expression(IrParFor* parfor, size_t* capacity, IrFunction* function, const Expr* expr, size_t nesting);
+static void lower_yield(Builder* builder, const Statement* statement);
+static void set_global(Builder* builder, uint32_t value, size_t slot, const Statement* statement);
+static void lower_block_statement(Builder* builder, const BlockStatement* blockstatement);
+static void lower_struct(Builder* builder, const Statement* statement);
+
+static void lower_root_block(Builder* builder, const BlockStatement* blockstatement);
+static void spawn(Builder* builder, const Statement* statement, const char* reads, uint32_t* pending, const VarDecl** decls, size_t nslots);
+static void join(Builder* builder, uint32_t task, uint32_t* pending);
+static void scan_statement(const Statement* statement, size_t depth, char* reads, int* found);
+static void scan_block(const BlockStatement* blockstatement, size_t depth, char* reads, int* found);
+static void scan_expression(const Expr* expr, size_t depth, char* reads, int* found);
+
+static uint32_t lower_expression(Builder* builder, const Expr* expr);
+static uint32_t lower_node(Builder* builder, const Expr* expr);
+static void memoize(Builder* builder, const Expr* expr, uint32_t value);
+static uint32_t lower_call(Builder* builder, const Expr* expr);
+static uint32_t lower_map(Builder* builder, const Expr* expr);
+static uint32_t lower_field(Builder* builder, const Expr* expr);
+static uint32_t lower_list(Builder* builder, IrOp op, Expr** exprs, size_t count, const Expr* expr);
+static uint32_t lower_record(Builder* builder, const Expr* expr);
+
+static Type binary_type(const IrFunction* function, const IrInstr* instr);
+static Type builtin_type(const IrFunction* function, const IrInstr* instr);
+static Type index_type(const IrFunction* function, const IrInstr* instr);
+static Type known(ValueKind kind);
+
+static void dump_type(const Type* type, FILE* file);
+static void dump_value(const Value* value, FILE* file);
+
+IrFunction ir_init(Arena* constants) {
+    return (IrFunction) {
+        .arena = arena_init(),
+        .constants = constants,
+    };
+}
+
+void ir_deinit(IrFunction* function) {
+    stats_add(STAT_ALLOCATIONS + KD_MEMORY_IR, function->nallocs);
+    stats_add(STAT_BYTES + KD_MEMORY_IR, function->nbytes);
+
+    arena_deinit(&function->arena);
+
+    free(function->instrs);
+    free(function->blocks);
+    free(function->records);
+    free(function->tasks);
+    free(function->parfors);
+}
+
+kd_status ir_lower(IrFunction* function, const Statement* root, size_t root_nslots, const Globals* globals, int parallel, kd_error* error) {
+    Builder builder = {
+        .function = function,
+        .globals = globals,
+    };
+
+    function->error = error;
+
+    if (setjmp(function->bail)) {
+        free(builder.variables);
+        free(builder.scopes);
+        free(builder.incomplete);
+        free(builder.memo);
+        free(builder.memo_values);
+
+        return error->status;
+    }
+
+    builder.current = ir_new_block(function);
+    function->blocks[builder.current].sealed = 1;
+
+    open_scope(&builder, root_nslots);
+
+    if (globals != NULL)
+        lower_global(&builder, root);
+    else if (parallel && root->kind == STATEMENT_BLOCK)
+        lower_root_block(&builder, root->blockstatement);
+    else
+        lower_statement(&builder, root);
+
+    if (builder.current != IR_NONE)
+        terminate(&builder, IR_HALT, IR_NONE, IR_NONE, IR_NONE, root->line, root->col);
+
+    free(builder.variables);
+    free(builder.scopes);
+    free(builder.incomplete);
+    free(builder.memo);
+    free(builder.memo_values);
+
+    return KD_OK;
+}
+
+kd_status ir_lower_function(IrFunction* function, const Function* fn, const Value* bound, const Statement* body, kd_error* error) {
+    Builder builder = {
+        .function = function,
+    };
+
+    function->error = error;
+
+    if (setjmp(function->bail)) {
+        free(builder.variables);
+        free(builder.scopes);
+        free(builder.incomplete);
+        free(builder.memo);
+        free(builder.memo_values);
+
+        return error->status;
+    }
+
+    builder.current = ir_new_block(function);
+    function->blocks[builder.current].sealed = 1;
+
+    /* the parameters are the variables of the frame around the body. */
+    open_scope(&builder, fn->nparams);
+
+    uint32_t nparams = 0;
+
+    for (size_t i = 0; i < fn->nparams; i++) {
+        uint32_t param;
+
+        if (bound != NULL && bound[i].kind != VAL_IDENT) {
+            param = ir_new_instr(function, IR_CONST, 0, fn->line, fn->col);
+            function->instrs[param].constant = bound[i];
+            function->instrs[param].type = known(bound[i].kind);
+        } else {
+            param = ir_new_instr(function, IR_PARAM, 0, fn->line, fn->col);
+            function->instrs[param].param = nparams++;
+            function->instrs[param].type = fn->params[i];
+        }
+
+        append(&builder, param);
+
+        uint32_t variable = new_variable(&builder);
+        builder.scopes[0][i] = variable;
+        write_variable(&builder, variable, builder.current, param);
+    }
+
+    lower_statement(&builder, body);
+
+    if (builder.current != IR_NONE)
+        terminate(&builder, IR_HALT, IR_NONE, IR_NONE, IR_NONE, body->line, body->col);
+
+    free(builder.variables);
+    free(builder.scopes);
+    free(builder.incomplete);
+    free(builder.memo);
+    free(builder.memo_values);
+
+    return KD_OK;
+}
+
+/* the statement as the root lowers it, with what it reads in the frame
+ * of the root block given as parameters. */
+kd_status ir_lower_task(IrFunction* function, const IrTask* task, const Statement* root, size_t root_nslots, kd_error* error) {
+    Builder builder = {
+        .function = function,
+    };
+
+    function->error = error;
+
+    if (setjmp(function->bail)) {
+        free(builder.variables);
+        free(builder.scopes);
+        free(builder.incomplete);
+        free(builder.memo);
+        free(builder.memo_values);
+
+        return error->status;
+    }
+
+    const Statement* statement = task->statement;
+
+    builder.current = ir_new_block(function);
+    function->blocks[builder.current].sealed = 1;
+
+    open_scope(&builder, root_nslots);
+    open_scope(&builder, root->blockstatement->nslots);
+
+    for (size_t i = 0; i < task->nparams; i++) {
+        uint32_t param = ir_new_instr(function, IR_PARAM, 0, statement->line, statement->col);
+        function->instrs[param].param = i;
+        function->instrs[param].type = task->types[i];
+        append(&builder, param);
+
+        uint32_t variable = new_variable(&builder);
+        builder.scopes[1][task->slots[i]] = variable;
+        write_variable(&builder, variable, builder.current, param);
+    }
+
+    uint32_t define = lower_define(&builder, statement);
+    terminate(&builder, IR_RETURN, define, IR_NONE, IR_NONE, statement->line, statement->col);
+
+    free(builder.variables);
+    free(builder.scopes);
+    free(builder.incomplete);
+    free(builder.memo);
+    free(builder.memo_values);
+
+    return KD_OK;
+}
+
+/* the frames around the loop are shifted one out, frame 0 holding the
+ * globals it captures, and only get the slots it captures. */
+kd_status ir_lower_parfor(IrFunction* function, const IrParFor* parfor, kd_error* error) {
+    Builder builder = {
+        .function = function,
+        .sequential = 1,
+    };
+
+    function->error = error;
+
+    if (setjmp(function->bail)) {
+        free(builder.variables);
+        free(builder.scopes);
+        free(builder.incomplete);
+        free(builder.memo);
+        free(builder.memo_values);
+
+        return error->status;
+    }
+
+    const Statement* statement = parfor->statement;
+
+    builder.current = ir_new_block(function);
+    function->blocks[builder.current].sealed = 1;
+
+    size_t* sizes = ir_alloc(function, (parfor->depth + 1) * sizeof(size_t));
+    memset(sizes, 0, (parfor->depth + 1) * sizeof(size_t));
+
+    for (size_t i = 0; i < parfor->ncaptures; i++) {
+        size_t frame = parfor->levels[i] + 1;
+        if (parfor->slots[i] + 1 > sizes[frame])
+            sizes[frame] = parfor->slots[i] + 1;
+    }
+
+    for (size_t i = 0; i <= parfor->depth; i++)
+        open_scope(&builder, sizes[i]);
+
+    uint32_t bounds[2];
+
+    for (size_t i = 0; i < 2 + parfor->ncaptures; i++) {
+        uint32_t param = ir_new_instr(function, IR_PARAM, 0, statement->line, statement->col);
+        function->instrs[param].param = i;
+        function->instrs[param].type = i < 2 ? known(VAL_INT) : parfor->types[i - 2];
+        append(&builder, param);
+
+        if (i < 2) {
+            bounds[i] = param;
+            continue;
+        }
+
+        uint32_t variable = new_variable(&builder);
+        builder.scopes[parfor->levels[i - 2] + 1][parfor->slots[i - 2]] = variable;
+        write_variable(&builder, variable, builder.current, param);
+    }
+
+    uint32_t result = lower_loop(&builder, statement, bounds[0], bounds[1]);
+
+    if (statement->forstatement.op == 0) {
+        result = ir_new_instr(function, IR_CONST, 0, statement->line, statement->col);
+        function->instrs[result].constant = (Value) { .kind = VAL_INT, .i64 = 0 };
+        function->instrs[result].type = known(VAL_INT);
+        append(&builder, result);
+    }
+
+    terminate(&builder, IR_RETURN, result, IR_NONE, IR_NONE, statement->line, statement->col);
+
+    free(builder.variables);
+    free(builder.scopes);
+    free(builder.incomplete);
+    free(builder.memo);
+    free(builder.memo_values);
+
+    return KD_OK;
+}
+
+size_t ir_count(const IrFunction* function) {
+    size_t count = 0;
+
+    for (size_t i = 0; i < function->nblocks; i++)
+        count += function->blocks[i].ninstrs;
+
+    return count;
+}
+
+void* ir_alloc(IrFunction* function, size_t size) {
+    void* data = arena_alloc(&function->arena, size == 0 ? 1 : size);
+    if (data == NULL)
+        out_of_memory(function);
+
+    function->nallocs++;
+    function->nbytes += size;
+
+    return data;
+}
+
+uint32_t ir_new_instr(IrFunction* function, IrOp op, size_t nargs, size_t line, size_t col) {
+    if (function->ninstrs == IR_NONE)
+        lower_error(function, line, col, "program is too large");
+
+    if (function->ninstrs == function->capacity)
+        function->instrs = grow(function, function->instrs, &function->capacity, sizeof(IrInstr));
+
+    IrInstr* instr = &function->instrs[function->ninstrs];
+    memset(instr, 0, sizeof(IrInstr));
+
+    instr->op = op;
+    instr->type = known(VAL_IDENT);
+    instr->args = nargs > 0 ? ir_alloc(function, nargs * sizeof(uint32_t)) : NULL;
+    instr->nargs = nargs;
+    instr->block = IR_NONE;
+    instr->line = line;
+    instr->col = col;
+
+    return function->ninstrs++;
+}
+
+/* instructions are kept in arena arrays that double as they fill up. */
+void ir_insert(IrFunction* function, uint32_t block, size_t index, uint32_t instr) {
+    IrBlock* target = &function->blocks[block];
+
+    if (target->ninstrs == target->capacity) {
+        size_t capacity = target->capacity == 0 ? 8 : target->capacity * 2;
+        uint32_t* instrs = ir_alloc(function, capacity * sizeof(uint32_t));
+
+        if (target->ninstrs > 0)
+            memcpy(instrs, target->instrs, target->ninstrs * sizeof(uint32_t));
+
+        target->instrs = instrs;
+        target->capacity = capacity;
+    }
+
+    memmove(&target->instrs[index + 1], &target->instrs[index], (target->ninstrs - index) * sizeof(uint32_t));
+    target->instrs[index] = instr;
+    target->ninstrs++;
+
+    function->instrs[instr].block = block;
+}
+
+uint32_t ir_new_block(IrFunction* function) {
+    if (function->nblocks == function->blocks_capacity)
+        function->blocks = grow(function, function->blocks, &function->blocks_capacity, sizeof(IrBlock));
+
+    IrBlock* block = &function->blocks[function->nblocks];
+    memset(block, 0, sizeof(IrBlock));
+
+    block->exit = IR_HALT;
+    block->value = IR_NONE;
+    block->succs[0] = IR_NONE;
+    block->succs[1] = IR_NONE;
+
+    return function->nblocks++;
+}
+
+void ir_add_edge(IrFunction* function, uint32_t from, uint32_t to) {
+    IrBlock* target = &function->blocks[to];
+
+    if (target->npreds == target->preds_capacity) {
+        size_t capacity = target->preds_capacity == 0 ? 2 : target->preds_capacity * 2;
+        uint32_t* preds = ir_alloc(function, capacity * sizeof(uint32_t));
+
+        if (target->npreds > 0)
+            memcpy(preds, target->preds, target->npreds * sizeof(uint32_t));
+
+        target->preds = preds;
+        target->preds_capacity = capacity;
+    }
+
+    target->preds[target->npreds++] = from;
+}
+
+void ir_replace(IrFunction* function, uint32_t instr, uint32_t value) {
+    IrInstr* target = &function->instrs[instr];
+
+    target->op = IR_COPY;
+    target->type = function->instrs[value].type;
+    target->args = ir_alloc(function, sizeof(uint32_t));
+    target->args[0] = value;
+    target->nargs = 1;
+}
+
+int ir_same_type(const Type* a, const Type* b) {
+    if (a->kind != b->kind || a->kind == VAL_IDENT)
+        return 0;
+
+    if (a->kind == VAL_MAP)
+        return a->key == b->key && a->value == b->value;
+
+    if (a->kind == VAL_RECORD || a->kind == VAL_RECORD_ARRAY)
+        return a->record == b->record;
+
+    return 1;
+}
+
+/* an instruction that cannot fail is free of effects unless it writes to a
+ * map. running out of memory does not count as failing, the passes are free
+ * to drop an allocation. */
+int ir_has_effect(const IrFunction* function, const IrInstr* instr) {
+    const Type* lhs = instr->nargs > 0 ? &function->instrs[instr->args[0]].type : NULL;
+    const Type* rhs = instr->nargs > 1 ? &function->instrs[instr->args[1]].type : NULL;
+
+    switch (instr->op) {
+    case IR_CONST:
+    case IR_SHL:
+    case IR_DIVPOW2:
+    case IR_NEWMAP:
+    case IR_FIELD:
+    case IR_COLUMN:
+    case IR_GLOBAL:
+    case IR_LESS:
+    case IR_PARAM:
+    case IR_COPY:
+    case IR_PHI:
+        return 0;
+    case IR_BINARY:
+        if (lhs->kind != rhs->kind)
+            return 1;
+
+        if (instr->binop == '=' || instr->binop == '!')
+            return lhs->kind != VAL_INT && lhs->kind != VAL_DOUBLE && lhs->kind != VAL_BOOL && lhs->kind != VAL_STRING;
+
+        if (lhs->kind == VAL_INT && instr->binop == '/') {
+            const IrInstr* divisor = &function->instrs[ir_resolve(function, instr->args[1])];
+            return divisor->op != IR_CONST || divisor->constant.i64 == 0;
+        }
+
+        return lhs->kind != VAL_INT && lhs->kind != VAL_DOUBLE && (lhs->kind != VAL_STRING || instr->binop != '+');
+    case IR_LEN:
+        return lhs->kind != VAL_STRING && lhs->kind != VAL_INT_ARRAY && lhs->kind != VAL_DOUBLE_ARRAY
+            && lhs->kind != VAL_MAP && lhs->kind != VAL_RECORD_ARRAY;
+    case IR_NEWARRAY:
+        if (lhs->kind != VAL_INT && lhs->kind != VAL_DOUBLE)
+            return 1;
+
+        for (size_t i = 1; i < instr->nargs; i++) {
+            if (function->instrs[instr->args[i]].type.kind != lhs->kind)
+                return 1;
+        }
+
+        return 0;
+    case IR_NEWRECORD:
+        for (size_t i = 0; i < instr->nargs; i++) {
+            if (function->instrs[instr->args[i]].type.kind != instr->type.record->fields[i].kind)
+                return 1;
+        }
+
+        return 0;
+    case IR_DEFINE:
+        return !ir_same_type(lhs, &instr->declared);
+    default:
+        return 1;
+    }
+}
+
+size_t ir_reverse_postorder(IrFunction* function, uint32_t* order) {
+    size_t nblocks = function->nblocks;
+
+    /* an explicit stack of blocks and how many of their succs are done. */
+    uint32_t* stack = ir_alloc(function, nblocks * sizeof(uint32_t));
+    int* next = ir_alloc(function, nblocks * sizeof(int));
+    char* seen = ir_alloc(function, nblocks);
+    memset(seen, 0, nblocks);
+
+    size_t top = 0;
+    size_t count = 0;
+
+    stack[top++] = 0;
+    next[0] = 0;
+    seen[0] = 1;
+
+    /* the postorder is written from the back. succs are visited last one
+     * first, so the true side of a branch comes before the false side. */
+    uint32_t* postorder = ir_alloc(function, nblocks * sizeof(uint32_t));
+
+    while (top > 0) {
+        uint32_t block = stack[top - 1];
+        const IrBlock* current = &function->blocks[block];
+        int nsuccs = current->exit == IR_JUMP ? 1 : current->exit == IR_BRANCH ? 2 : 0;
+
+        if (next[block] < nsuccs) {
+            uint32_t succ = current->succs[nsuccs - 1 - next[block]++];
+
+            if (!seen[succ]) {
+                seen[succ] = 1;
+                next[succ] = 0;
+                stack[top++] = succ;
+            }
+
+            continue;
+        }
+
+        postorder[count++] = block;
+        top--;
+    }
+
+    for (size_t i = 0; i < count; i++)
+        order[i] = postorder[count - 1 - i];
+
+    return count;
+}
+
+void ir_dump(const IrFunction* function, FILE* file) {
+    static const char* names[] = {
+        [IR_CONST] = "const", [IR_BINARY] = "", [IR_SHL] = "shl", [IR_DIVPOW2] = "divpow2",
+        [IR_LEN] = "len", [IR_BUILTIN] = "call", [IR_NEWARRAY] = "array", [IR_INDEX] = "index",
+        [IR_NEWMAP] = "map", [IR_MAPSET] = "mapset", [IR_NEWRECORD] = "struct", [IR_FIELD] = "field",
+        [IR_INDEXFIELD] = "indexfield", [IR_COLUMN] = "column", [IR_GLOBAL] = "global",
+        [IR_SETGLOBAL] = "setglobal", [IR_DEFINE] = "define", [IR_CALL] = "call", [IR_SPAWN] = "spawn",
+        [IR_JOIN] = "join", [IR_PARFOR] = "parfor", [IR_LESS] = "less", [IR_PARAM] = "param",
+        [IR_COPY] = "copy", [IR_PHI] = "phi",
+    };
+    static const char* builtins[] = {
+        [BUILTIN_LEN] = "len", [BUILTIN_SUM] = "sum", [BUILTIN_MIN] = "min", [BUILTIN_MAX] = "max",
+        [BUILTIN_DOT] = "dot", [BUILTIN_FILL] = "fill", [BUILTIN_IOTA] = "iota",
+        [BUILTIN_HAS] = "has", [BUILTIN_PUT] = "put", [BUILTIN_DEL] = "del",
+        [BUILTIN_PRINT] = "print", [BUILTIN_PRINTLN] = "println",
+    };
+
+    for (size_t b = 0; b < function->nblocks; b++) {
+        const IrBlock* block = &function->blocks[b];
+        if (block->dead)
+            continue;
+
+        fprintf(file, "b%zu:", b);
+        for (size_t i = 0; i < block->npreds; i++)
+            fprintf(file, "%s b%u", i == 0 ? " ; preds" : ",", block->preds[i]);
+        fprintf(file, "\n");
+
+        for (size_t i = 0; i < block->ninstrs; i++) {
+            uint32_t id = block->instrs[i];
+            const IrInstr* instr = &function->instrs[id];
+
+            fprintf(file, "    ");
+            if (instr->op != IR_MAPSET && instr->op != IR_SETGLOBAL && instr->op != IR_SPAWN)
+                fprintf(file, "v%u = ", id);
+
+            switch (instr->op) {
+            case IR_BINARY: {
+                const char* op = instr->binop == '+' ? "add" : instr->binop == '-' ? "sub" : instr->binop == '*' ? "mul"
+                    : instr->binop == '/' ? "div" : instr->binop == '=' ? "eq" : "ne";
+                fprintf(file, "%s", op);
+                break;
+            }
+            case IR_BUILTIN:
+                fprintf(file, "call %s", builtins[instr->builtin]);
+                break;
+            case IR_CALL:
+                fprintf(file, "call %.*s", (int)instr->callee->name.size, instr->callee->name.data);
+                break;
+            case IR_PARAM:
+                fprintf(file, "param %u", instr->param);
+                break;
+            case IR_SPAWN:
+            case IR_JOIN:
+                fprintf(file, "%s t%u", names[instr->op], instr->task);
+                break;
+            case IR_PARFOR:
+                fprintf(file, "parfor p%u", instr->parfor);
+                break;
+            default:
+                fprintf(file, "%s", names[instr->op]);
+                break;
+            }
+
+            if (instr->op == IR_CONST) {
+                fprintf(file, " ");
+                dump_value(&instr->constant, file);
+            }
+
+            for (size_t a = 0; a < instr->nargs; a++) {
+                fprintf(file, "%s", a == 0 ? " " : ", ");
+                if (instr->op == IR_PHI)
+                    fprintf(file, "[b%u: v%u]", block->preds[a], instr->args[a]);
+                else
+                    fprintf(file, "v%u", instr->args[a]);
+            }
+
+            if (instr->op == IR_SHL || instr->op == IR_DIVPOW2)
+                fprintf(file, ", %d", instr->shift);
+
+            if (instr->op == IR_GLOBAL)
+                fprintf(file, " g%u", instr->global);
+            else if (instr->op == IR_SETGLOBAL)
+                fprintf(file, ", g%u", instr->global);
+
+            if (instr->op == IR_FIELD || instr->op == IR_INDEXFIELD || instr->op == IR_COLUMN)
+                fprintf(file, " .%.*s", (int)instr->field->name.size, instr->field->name.data);
+
+            if (instr->op == IR_DEFINE) {
+                fprintf(file, " as ");
+                dump_type(&instr->declared, file);
+            }
+
+            if (instr->type.kind != VAL_IDENT) {
+                fprintf(file, " : ");
+                dump_type(&instr->type, file);
+            }
+
+            fprintf(file, "\n");
+        }
+
+        switch (block->exit) {
+        case IR_JUMP:
+            fprintf(file, "    jump b%u\n", block->succs[0]);
+            break;
+        case IR_BRANCH:
+            fprintf(file, "    branch v%u, b%u, b%u\n", block->value, block->succs[0], block->succs[1]);
+            break;
+        case IR_RETURN:
+            fprintf(file, "    return v%u\n", block->value);
+            break;
+        case IR_HALT:
+            fprintf(file, "    halt\n");
+            break;
+        }
+    }
+}
+
+static void lower_error(IrFunction* function, size_t line, size_t col, const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+
+    function->error->status = KD_ERROR_SYNTAX;
+    function->error->line = line;
+    function->error->col = col;
+    vsnprintf(function->error->message, sizeof(function->error->message), fmt, args);
+
+    va_end(args);
+    longjmp(function->bail, 1);
+}
+
+static void out_of_memory(IrFunction* function) {
+    function->error->status = KD_ERROR_NOMEM;
+    function->error->line = 0;
+    function->error->col = 0;
+    snprintf(function->error->message, sizeof(function->error->message), "cannot allocate memory!");
+
+    longjmp(function->bail, 1);
+}
+
+/* doubles a malloc'd array of items of size bytes. */
+static void* grow(IrFunction* function, void* items, size_t* capacity, size_t size) {
+    size_t new_capacity = *capacity == 0 ? 16 : *capacity * 2;
+
+    void* new_items = realloc(items, new_capacity * size);
+    if (new_items == NULL)
+        out_of_memory(function);
+
+    function->nallocs++;
+    function->nbytes += new_capacity * size;
+
+    *capacity = new_capacity;
+    return new_items;
+}
+
+static void open_scope(Builder* builder, size_t nslots) {
+    if (builder->depth == builder->scopes_capacity)
+        builder->scopes = grow(builder->function, builder->scopes, &builder->scopes_capacity, sizeof(uint32_t*));
+
+    builder->scopes[builder->depth++] = ir_alloc(builder->function, nslots * sizeof(uint32_t));
+}
+
+static void close_scope(Builder* builder) {
+    builder->depth--;
+}
+
+static uint32_t new_variable(Builder* builder) {
+    if (builder->nvariables == builder->variables_capacity)
+        builder->variables = grow(builder->function, builder->variables, &builder->variables_capacity, sizeof(Variable));
+
+    builder->variables[builder->nvariables] = (Variable) { 0 };
+    return builder->nvariables++;
+}
+
+static void write_variable(Builder* builder, uint32_t variable, uint32_t block, uint32_t value) {
+    Variable* target = &builder->variables[variable];
+
+    for (size_t i = 0; i < target->ndefs; i++) {
+        if (target->defs[i].block == block) {
+            target->defs[i].value = value;
+            return;
+        }
+    }
+
+    if (target->ndefs == target->capacity) {
+        size_t capacity = target->capacity == 0 ? 2 : target->capacity * 2;
+        VariableDef* defs = ir_alloc(builder->function, capacity * sizeof(VariableDef));
+
+        if (target->ndefs > 0)
+            memcpy(defs, target->defs, target->ndefs * sizeof(VariableDef));
+
+        target->defs = defs;
+        target->capacity = capacity;
+    }
+
+    target->defs[target->ndefs++] = (VariableDef) { .block = block, .value = value };
+}
+
+/* the most recent definitions are the likeliest to be read. */
+static uint32_t read_variable(Builder* builder, uint32_t variable, uint32_t block) {
+    const Variable* target = &builder->variables[variable];
+
+    for (size_t i = target->ndefs; i-- > 0;) {
+        if (target->defs[i].block == block)
+            return target->defs[i].value;
+    }
+
+    return read_variable_recursive(builder, variable, block);
+}
+
+static uint32_t read_variable_recursive(Builder* builder, uint32_t variable, uint32_t block) {
+    const IrBlock* target = &builder->function->blocks[block];
+    uint32_t value;
+
+    if (!target->sealed) {
+        value = new_phi(builder, block);
+
+        if (builder->nincomplete == builder->incomplete_capacity)
+            builder->incomplete = grow(builder->function, builder->incomplete, &builder->incomplete_capacity, sizeof(IncompletePhi));
+
+        builder->incomplete[builder->nincomplete++] = (IncompletePhi) {
+            .block = block,
+            .variable = variable,
+            .phi = value,
+        };
+    } else if (target->npreds == 1) {
+        value = read_variable(builder, variable, target->preds[0]);
+    } else {
+        /* written first, so a loop back to this block finds the phi. */
+        value = new_phi(builder, block);
+        write_variable(builder, variable, block, value);
+        value = add_phi_operands(builder, variable, value);
+    }
+
+    write_variable(builder, variable, block, value);
+    return value;
+}
+
+/* after the phis already at the start of block. */
+static uint32_t new_phi(Builder* builder, uint32_t block) {
+    IrFunction* function = builder->function;
+    const IrBlock* target = &function->blocks[block];
+
+    size_t index = 0;
+    while (index < target->ninstrs && function->instrs[target->instrs[index]].op == IR_PHI)
+        index++;
+
+    uint32_t phi = ir_new_instr(function, IR_PHI, 0, target->line, target->col);
+    ir_insert(function, block, index, phi);
+
+    return phi;
+}
+
+static uint32_t add_phi_operands(Builder* builder, uint32_t variable, uint32_t phi) {
+    IrFunction* function = builder->function;
+    uint32_t block = function->instrs[phi].block;
+    size_t npreds = function->blocks[block].npreds;
+
+    uint32_t* args = ir_alloc(function, npreds * sizeof(uint32_t));
+    for (size_t i = 0; i < npreds; i++)
+        args[i] = read_variable(builder, variable, function->blocks[block].preds[i]);
+
+    IrInstr* instr = &function->instrs[phi];
+    instr->args = args;
+    instr->nargs = npreds;
+
+    /* the phi has a type when every way in agrees on it. */
+    instr->type = npreds > 0 ? function->instrs[args[0]].type : known(VAL_IDENT);
+    for (size_t i = 1; i < npreds; i++) {
+        if (!ir_same_type(&instr->type, &function->instrs[args[i]].type))
+            instr->type = known(VAL_IDENT);
+    }
+
+    return remove_trivial_phi(function, phi);
+}
+
+/* a phi that only ever sees one value other than itself is that value. */
+static uint32_t remove_trivial_phi(IrFunction* function, uint32_t phi) {
+    const IrInstr* instr = &function->instrs[phi];
+    uint32_t same = IR_NONE;
+
+    for (size_t i = 0; i < instr->nargs; i++) {
+        uint32_t arg = ir_resolve(function, instr->args[i]);
+
+        if (arg == same || arg == phi)
+            continue;
+        if (same != IR_NONE)
+            return phi;
+
+        same = arg;
+    }
+
+    if (same == IR_NONE)
+        return phi;
+
+    ir_replace(function, phi, same);
+    return same;
+}
+
+static void seal_block(Builder* builder, uint32_t block) {
+    for (size_t i = 0; i < builder->nincomplete; i++) {
+        IncompletePhi incomplete = builder->incomplete[i];
+
+        if (incomplete.block == block) {
+            add_phi_operands(builder, incomplete.variable, incomplete.phi);
+            builder->incomplete[i--] = builder->incomplete[--builder->nincomplete];
+        }
+    }
+
+    builder->function->blocks[block].sealed = 1;
+}
+
+/* ends the current block, nothing after it can be reached. */
+static void terminate(Builder* builder, IrExit exit, uint32_t value, uint32_t then, uint32_t otherwise, size_t line, size_t col) {
+    IrFunction* function = builder->function;
+    IrBlock* block = &function->blocks[builder->current];
+
+    block->exit = exit;
+    block->value = value;
+    block->succs[0] = then;
+    block->succs[1] = otherwise;
+    block->line = line;
+    block->col = col;
+
+    if (then != IR_NONE)
+        ir_add_edge(function, builder->current, then);
+    if (otherwise != IR_NONE)
+        ir_add_edge(function, builder->current, otherwise);
+
+    builder->current = IR_NONE;
+}
+
+static void append(Builder* builder, uint32_t instr) {
+    ir_insert(builder->function, builder->current, builder->function->blocks[builder->current].ninstrs, instr);
+}
+
+/* what a statement at the top level of a stream declares outlives it. the
+ * structs are known to every statement from the globals, the variables are
+ * stored to their slots. */
+static void lower_global(Builder* builder, const Statement* statement) {
+    IrFunction* function = builder->function;
+    const Globals* globals = builder->globals;
+
+    if (globals->nrecords > MAX_RECORD_TYPES)
+        lower_error(function, statement->line, statement->col, "too many structs");
+
+    for (size_t i = 0; i < globals->nrecords; i++) {
+        if (function->nrecords == function->records_capacity)
+            function->records = grow(function, function->records, &function->records_capacity, sizeof(RecordType*));
+
+        function->records[function->nrecords++] = globals->records[i];
+    }
+
+    if (statement->kind == STATEMENT_STRUCT)
+        return;
+
+    if (statement->kind == STATEMENT_VAR_DECL) {
+        set_global(builder, lower_define(builder, statement), statement->vardecl.slot, statement);
+        return;
+    }
+
+    if (statement->kind == STATEMENT_FOR && statement->forstatement.op != 0) {
+        set_global(builder, lower_for_statement(builder, statement), statement->forstatement.result.slot, statement);
+        return;
+    }
+
+    lower_statement(builder, statement);
+}
+
+static void set_global(Builder* builder, uint32_t value, size_t slot, const Statement* statement) {
+    IrFunction* function = builder->function;
+
+    uint32_t set = ir_new_instr(function, IR_SETGLOBAL, 1, statement->line, statement->col);
+    function->instrs[set].args[0] = value;
+    function->instrs[set].global = slot;
+    append(builder, set);
+}
+
+static void lower_statement(Builder* builder, const Statement* statement) {
+    if (builder->current == IR_NONE)
+        return;
+
+    switch (statement->kind) {
+    case STATEMENT_VAR_DECL: {
+        uint32_t define = lower_define(builder, statement);
+
+        uint32_t variable = new_variable(builder);
+        builder->scopes[builder->depth - 1][statement->vardecl.slot] = variable;
+        write_variable(builder, variable, builder->current, define);
+        break;
+    }
+    case STATEMENT_IF:
+        lower_if_statement(builder, statement);
+        break;
+    case STATEMENT_BLOCK:
+        lower_block_statement(builder, statement->blockstatement);
+        break;
+    case STATEMENT_EXPR:
+        lower_expression(builder, statement->expr);
+        break;
+    case STATEMENT_RETURN: {
+        uint32_t value = lower_expression(builder, statement->ret);
+        terminate(builder, IR_RETURN, value, IR_NONE, IR_NONE, statement->line, statement->col);
+        break;
+    }
+    case STATEMENT_STRUCT:
+        lower_struct(builder, statement);
+        break;
+    case STATEMENT_FN:
+        /* its body is lowered on its own when it is first called. */
+        break;
+    case STATEMENT_IMPORT:
+        break;
+    case STATEMENT_FOR: {
+        uint32_t result = lower_for_statement(builder, statement);
+
+        if (statement->forstatement.op != 0) {
+            uint32_t variable = new_variable(builder);
+            builder->scopes[builder->depth - 1][statement->forstatement.result.slot] = variable;
+            write_variable(builder, variable, builder->current, result);
+        }
+        break;
+    }
+    case STATEMENT_YIELD:
+        lower_yield(builder, statement);
+        break;
+    }
+}
+
+static uint32_t lower_define(Builder* builder, const Statement* statement) {
+    const VarDecl* vardecl = &statement->vardecl;
+
+    /* the variable is not visible in its own initialiser. */
+    uint32_t value = lower_expression(builder, vardecl->expr);
+
+    uint32_t define = ir_new_instr(builder->function, IR_DEFINE, 1, statement->line, statement->col);
+    IrInstr* instr = &builder->function->instrs[define];
+
+    instr->args[0] = value;
+    instr->declared = vardecl->type;
+    instr->type = vardecl->type;
+    append(builder, define);
+
+    return define;
+}
+
+/* the branches meet in a block of their own, which is left out when neither
+ * of them gets there. */
+static void lower_if_statement(Builder* builder, const Statement* statement) {
+    IrFunction* function = builder->function;
+    const IfStatement* ifstatement = &statement->ifstatement;
+
+    uint32_t condition = lower_expression(builder, ifstatement->expr);
+
+    uint32_t then = ir_new_block(function);
+    uint32_t otherwise = ifstatement->else_block != NULL ? ir_new_block(function) : IR_NONE;
+    uint32_t join = ir_new_block(function);
+
+    terminate(builder, IR_BRANCH, condition, then, otherwise != IR_NONE ? otherwise : join,
+        ifstatement->expr->line, ifstatement->expr->col);
+
+    seal_block(builder, then);
+    builder->current = then;
+    lower_block_statement(builder, ifstatement->if_block);
+    if (builder->current != IR_NONE)
+        terminate(builder, IR_JUMP, IR_NONE, join, IR_NONE, statement->line, statement->col);
+
+    if (otherwise != IR_NONE) {
+        seal_block(builder, otherwise);
+        builder->current = otherwise;
+        lower_block_statement(builder, ifstatement->else_block);
+        if (builder->current != IR_NONE)
+            terminate(builder, IR_JUMP, IR_NONE, join, IR_NONE, statement->line, statement->col);
+    }
+
+    seal_block(builder, join);
+
+    if (function->blocks[join].npreds == 0) {
+        function->blocks[join].dead = 1;
+        return;
+    }
+
+    builder->current = join;
+}
+
+static void lower_block_statement(Builder* builder, const BlockStatement* blockstatement) {
+    if (blockstatement == NULL)
+        return;
+
+    open_scope(builder, blockstatement->nslots);
+
+    for (const BlockStatement* node = blockstatement; node != NULL; node = node->next)
+        lower_statement(builder, node->statement);
+
+    close_scope(builder);
+}
+
+/* the bounds are evaluated once, before the first iteration. */
+static uint32_t lower_for_statement(Builder* builder, const Statement* statement) {
+    const ForStatement* forstatement = &statement->forstatement;
+
+    uint32_t from = lower_bound(builder, forstatement->from);
+    uint32_t to = lower_bound(builder, forstatement->to);
+
+    if (forstatement->parallel && !builder->sequential)
+        return lower_parfor(builder, statement, from, to);
+
+    return lower_loop(builder, statement, from, to);
+}
+
+static uint32_t lower_bound(Builder* builder, const Expr* expr) {
+    uint32_t value = lower_expression(builder, expr);
+
+    uint32_t define = ir_new_instr(builder->function, IR_DEFINE, 1, expr->line, expr->col);
+    IrInstr* instr = &builder->function->instrs[define];
+
+    instr->args[0] = value;
+    instr->declared = known(VAL_INT);
+    instr->type = known(VAL_INT);
+    append(builder, define);
+
+    return define;
+}
+
+/* the loop variable and the reduction are the only variables an iteration
+ * can change, so the header gets a phi for each of them up front and is
+ * sealed with the block before the loop as its only pred. whatever else the
+ * body reads is the value it had before the loop. the backedge and the phi
+ * operands coming with it are added once the body is lowered.
+ *
+ * returns the result of the loop when it has a reduction of its own, the
+ * reduction of an outer loop is carried through it otherwise. */
+static uint32_t lower_loop(Builder* builder, const Statement* statement, uint32_t from, uint32_t to) {
+    IrFunction* function = builder->function;
+    const ForStatement* forstatement = &statement->forstatement;
+    size_t line = statement->line;
+    size_t col = statement->col;
+
+    Reduction outer = builder->reduction;
+    uint32_t initial = IR_NONE;
+
+    if (forstatement->op != 0) {
+        ValueKind kind = forstatement->result.type.kind;
+        int64_t identity = forstatement->op == '+' ? 0 : 1;
+
+        builder->reduction = (Reduction) { .variable = new_variable(builder), .op = forstatement->op, .kind = kind };
+
+        initial = ir_new_instr(function, IR_CONST, 0, line, col);
+        function->instrs[initial].constant = kind == VAL_INT
+            ? (Value) { .kind = VAL_INT, .i64 = identity }
+            : (Value) { .kind = VAL_DOUBLE, .f64 = identity };
+        function->instrs[initial].type = known(kind);
+        append(builder, initial);
+    } else if (outer.op != 0) {
+        initial = read_variable(builder, outer.variable, builder->current);
+    }
+
+    uint32_t header = ir_new_block(function);
+    uint32_t body = ir_new_block(function);
+    uint32_t exit = ir_new_block(function);
+
+    terminate(builder, IR_JUMP, IR_NONE, header, IR_NONE, line, col);
+    function->blocks[header].sealed = 1;
+    builder->current = header;
+
+    uint32_t index = loop_phi(builder, header, from, known(VAL_INT));
+    uint32_t acc = initial != IR_NONE ? loop_phi(builder, header, initial, known(builder->reduction.kind)) : IR_NONE;
+
+    open_scope(builder, forstatement->nslots);
+
+    uint32_t variable = new_variable(builder);
+    builder->scopes[builder->depth - 1][0] = variable;
+    write_variable(builder, variable, header, index);
+
+    if (acc != IR_NONE)
+        write_variable(builder, builder->reduction.variable, header, acc);
+
+    uint32_t less = ir_new_instr(function, IR_LESS, 2, line, col);
+    function->instrs[less].args[0] = index;
+    function->instrs[less].args[1] = to;
+    function->instrs[less].type = known(VAL_BOOL);
+    append(builder, less);
+
+    terminate(builder, IR_BRANCH, less, body, exit, line, col);
+
+    seal_block(builder, body);
+    builder->current = body;
+
+    for (const BlockStatement* node = forstatement->body; node != NULL; node = node->next)
+        lower_statement(builder, node->statement);
+
+    if (builder->current != IR_NONE) {
+        uint32_t one = ir_new_instr(function, IR_CONST, 0, line, col);
+        function->instrs[one].constant = (Value) { .kind = VAL_INT, .i64 = 1 };
+        function->instrs[one].type = known(VAL_INT);
+        append(builder, one);
+
+        uint32_t next = ir_new_instr(function, IR_BINARY, 2, line, col);
+        IrInstr* instr = &function->instrs[next];
+
+        instr->args[0] = index;
+        instr->args[1] = one;
+        instr->binop = '+';
+        instr->type = binary_type(function, instr);
+        append(builder, next);
+
+        function->instrs[index].args[1] = next;
+        function->instrs[index].nargs = 2;
+
+        if (acc != IR_NONE) {
+            function->instrs[acc].args[1] = read_variable(builder, builder->reduction.variable, builder->current);
+            function->instrs[acc].nargs = 2;
+        }
+
+        terminate(builder, IR_JUMP, IR_NONE, header, IR_NONE, line, col);
+    }
+
+    close_scope(builder);
+
+    remove_trivial_phi(function, index);
+    if (acc != IR_NONE)
+        acc = remove_trivial_phi(function, acc);
+
+    builder->reduction = outer;
+
+    seal_block(builder, exit);
+    builder->current = exit;
+
+    return forstatement->op != 0 ? acc : IR_NONE;
+}
+
+/* the operand from the backedge is filled in by lower_loop. */
+static uint32_t loop_phi(Builder* builder, uint32_t header, uint32_t initial, Type type) {
+    IrFunction* function = builder->function;
+    uint32_t phi = new_phi(builder, header);
+    IrInstr* instr = &function->instrs[phi];
+
+    instr->args = ir_alloc(function, 2 * sizeof(uint32_t));
+    instr->args[0] = initial;
+    instr->nargs = 1;
+    instr->type = type;
+
+    return phi;
+}
+
+/* the variables from outside the loop its body reads are handed to the
+ * function of the par for, see ir_lower_parfor. */
+static uint32_t lower_parfor(Builder* builder, const Statement* statement, uint32_t from, uint32_t to) {
+    IrFunction* function = builder->function;
+    const ForStatement* forstatement = &statement->forstatement;
+
+    if (function->nparfors == MAX_PARFORS)
+        lower_error(function, statement->line, statement->col, "too many par fors");
+
+    IrParFor parfor = {
+        .statement = statement,
+        .depth = builder->depth,
+    };
+
+    size_t capacity = 0;
+    capture_block(&parfor, &capacity, function, forstatement->body, 1);
+
+    parfor.types = ir_alloc(function, parfor.ncaptures * sizeof(Type));
+
+    uint32_t instr = ir_new_instr(function, IR_PARFOR, 2 + parfor.ncaptures, statement->line, statement->col);
+    function->instrs[instr].args[0] = from;
+    function->instrs[instr].args[1] = to;
+
+    for (size_t i = 0; i < parfor.ncaptures; i++) {
+        uint32_t value;
+
+        if (parfor.levels[i] < 0) {
+            value = ir_new_instr(function, IR_GLOBAL, 0, statement->line, statement->col);
+            function->instrs[value].global = parfor.slots[i];
+            function->instrs[value].type = builder->globals->variables[parfor.slots[i]].type;
+            append(builder, value);
+        } else {
+            value = read_variable(builder, builder->scopes[parfor.levels[i]][parfor.slots[i]], builder->current);
+        }
+
+        parfor.types[i] = function->instrs[value].type;
+        function->instrs[instr].args[2 + i] = value;
+    }
+
+    function->instrs[instr].parfor = function->nparfors;
+    function->instrs[instr].type = known(forstatement->op != 0 ? forstatement->result.type.kind : VAL_INT);
+    append(builder, instr);
+
+    if (function->nparfors == function->parfors_capacity)
+        function->parfors = grow(function, function->parfors, &function->parfors_capacity, sizeof(IrParFor));
+
+    function->parfors[function->nparfors++] = parfor;
+    return instr;
+}
+
+/* statement is nesting frames inside the one around the loop, counting
+ * that frame. a variable read there is depth frames out from where it is
+ * used, any before the frame of the loop is captured. */
+static void capture_block(IrParFor* parfor, size_t* capacity, IrFunction* function, const BlockStatement* blockstatement, size_t nesting) {
+    for (const BlockStatement* node = blockstatement; node != NULL; node = node->next)
+        capture_statement(parfor, capacity, function, node->statement, nesting);
+}
+
+static void capture_statement(IrParFor* parfor, size_t* capacity, IrFunction* function, const Statement* statement, size_t nesting) {
+    switch (statement->kind) {
+    case STATEMENT_VAR_DECL:
+        capture_expression(parfor, capacity, function, statement->vardecl.expr, nesting);
+        break;
+    case STATEMENT_IF:
+        capture_expression(parfor, capacity, function, statement->ifstatement.expr, nesting);
+        capture_block(parfor, capacity, function, statement->ifstatement.if_block, nesting + 1);
+        capture_block(parfor, capacity, function, statement->ifstatement.else_block, nesting + 1);
+        break;
+    case STATEMENT_BLOCK:
+        capture_block(parfor, capacity, function, statement->blockstatement, nesting + 1);
+        break;
+    case STATEMENT_RETURN:
+        capture_expression(parfor, capacity, function, statement->ret, nesting);
+        break;
+    case STATEMENT_EXPR:
+        capture_expression(parfor, capacity, function, statement->expr, nesting);
+        break;
+    case STATEMENT_FOR:
+        capture_expression(parfor, capacity, function, statement->forstatement.from, nesting);
+        capture_expression(parfor, capacity, function, statement->forstatement.to, nesting);
+        capture_block(parfor, capacity, function, statement->forstatement.body, nesting + 1);
+        break;
+    case STATEMENT_YIELD:
+        capture_expression(parfor, capacity, function, statement->yield, nesting);
+        break;
+    case STATEMENT_STRUCT:
+    case STATEMENT_FN:
+    case STATEMENT_IMPORT:
+        break;
+    }
+}
+
+static void capture_expression(IrParFor* parfor, size_t* capacity, IrFunction* function, const Expr* expr, size_t nesting) {
+    switch (expr->kind) {
+    case EXPR_PRIMARY: {
+        if (expr->Primary.kind != VAL_IDENT)
+            break;
+
+        ptrdiff_t level = (ptrdiff_t)(parfor->depth + nesting) - 1 - (ptrdiff_t)expr->depth;
+        if (level >= (ptrdiff_t)parfor->depth)
+            break;
+
+        for (size_t i = 0; i < parfor->ncaptures; i++) {
+            if (parfor->levels[i] == level && parfor->slots[i] == expr->slot)
+                return;
+        }
+
+        if (parfor->ncaptures == *capacity) {
+            size_t grown = *capacity == 0 ? 8 : *capacity * 2;
+            ptrdiff_t* levels = ir_alloc(function, grown * sizeof(ptrdiff_t));
+            size_t* slots = ir_alloc(function, grown * sizeof(size_t));
+
+            if (parfor->ncaptures > 0) {
+                memcpy(levels, parfor->levels, parfor->ncaptures * sizeof(ptrdiff_t));
+                memcpy(slots, parfor->slots, parfor->ncaptures * sizeof(size_t));
+            }
+
+            parfor->levels = levels;
+            parfor->slots = slots;
+            *capacity = grown;
+        }
+
+        parfor->levels[parfor->ncaptures] = level;
+        parfor->slots[parfor->ncaptures++] = expr->slot;
+        break;
+    }
+    case EXPR_BINARY:
+        capture_expression(parfor, capacity, function, expr->Binary.lhs, nesting);
+        capture_expression(parfor, capacity, function, expr->Binary.rhs, nesting);
+        break;
+    case EXPR_CALL:
+        for (size_t i = 0; i < expr->Call.nargs; i++)
+            capture_expression(parfor, capacity, function, expr->Call.args[i], nesting);
+        break;
+    case EXPR_ARRAY:
+        for (size_t i = 0; i < expr->Array.nelements; i++)
+            capture_expression(parfor, capacity, function, expr->Array.elements[i], nesting);
+        break;
+    case EXPR_INDEX:
+        capture_expression(parfor, capacity, function, expr->Index.array, nesting);
+        capture_expression(parfor, capacity, function, expr->Index.index, nesting);
+        break;
+    case EXPR_MAP:
+        for (size_t i = 0; i < expr->Map.nentries; i++) {
+            capture_expression(parfor, capacity, function, expr->Map.keys[i], nesting);
+            capture_expression(parfor, capacity, function, expr->Map.values[i], nesting);
+        }
+        break;
+    case EXPR_RECORD:
+        for (size_t i = 0; i < expr->Record.nfields; i++)
+            capture_expression(parfor, capacity, function, expr->Record.values[i], nesting);
+        break;
+    case EXPR_FIELD:
+        capture_expression(parfor, capacity, function, expr->Field.record, nesting);
+        break;
+    }
+}
+
+/* the value is checked to be of the type of the reduction first. */
+static void lower_yield(Builder* builder, const Statement* statement) {
+    IrFunction* function = builder->function;
+    Reduction* reduction = &builder->reduction;
+
+    uint32_t value = lower_expression(builder, statement->yield);
+
+    uint32_t define = ir_new_instr(function, IR_DEFINE, 1, statement->line, statement->col);
+    function->instrs[define].args[0] = value;
+    function->instrs[define].declared = known(reduction->kind);
+    function->instrs[define].type = known(reduction->kind);
+    append(builder, define);
+
+    uint32_t binary = ir_new_instr(function, IR_BINARY, 2, statement->line, statement->col);
+    IrInstr* instr = &function->instrs[binary];
+
+    instr->args[0] = read_variable(builder, reduction->variable, builder->current);
+    instr->args[1] = define;
+    instr->binop = reduction->op;
+    instr->type = binary_type(function, instr);
+    append(builder, binary);
+
+    write_variable(builder, reduction->variable, builder->current, binary);
+}
+
+/* the structs of the chunk are numbered in the order they are declared,
+ * see record_slot in compiler.c. */
+static void lower_struct(Builder* builder, const Statement* statement) {
+    IrFunction* function = builder->function;
+
+    if (function->nrecords == MAX_RECORD_TYPES)
+        lower_error(function, statement->line, statement->col, "too many structs");
+
+    if (function->nrecords == function->records_capacity)
+        function->records = grow(function, function->records, &function->records_capacity, sizeof(RecordType*));
+
+    function->records[function->nrecords++] = statement->record;
+}
+
+/* what scanning a statement finds besides the variables it reads. */
+#define SCAN_CALLS 1    /* a call of a function, or of a builtin worth a thread */
+#define SCAN_WRITES 2   /* a call that could write to a map */
+
+/* pending holds the task each variable of the block is still to be joined
+ * from, in order of the tasks in joins, and decls the let declaring it. */
+static void lower_root_block(Builder* builder, const BlockStatement* blockstatement) {
+    IrFunction* function = builder->function;
+
+    if (blockstatement == NULL)
+        return;
+
+    size_t nslots = blockstatement->nslots;
+    open_scope(builder, nslots);
+
+    uint32_t* pending = ir_alloc(function, nslots * sizeof(uint32_t));
+    const VarDecl** decls = ir_alloc(function, nslots * sizeof(VarDecl*));
+    char* reads = ir_alloc(function, nslots);
+
+    uint32_t* joins = NULL;
+    size_t njoins = 0;
+    size_t joins_capacity = 0;
+
+    for (size_t i = 0; i < nslots; i++) {
+        pending[i] = IR_NONE;
+        decls[i] = NULL;
+    }
+
+    for (const BlockStatement* node = blockstatement; node != NULL && builder->current != IR_NONE; node = node->next) {
+        const Statement* statement = node->statement;
+        int found = 0;
+
+        memset(reads, 0, nslots);
+        scan_statement(statement, 0, reads, &found);
+
+        if (statement->kind == STATEMENT_VAR_DECL && found == SCAN_CALLS && function->ntasks < MAX_TASKS) {
+            if (njoins == joins_capacity) {
+                size_t capacity = joins_capacity == 0 ? 16 : joins_capacity * 2;
+                uint32_t* grown = ir_alloc(function, capacity * sizeof(uint32_t));
+
+                if (njoins > 0)
+                    memcpy(grown, joins, njoins * sizeof(uint32_t));
+
+                joins = grown;
+                joins_capacity = capacity;
+            }
+
+            joins[njoins++] = function->ntasks;
+            spawn(builder, statement, reads, pending, decls, nslots);
+        } else {
+            size_t kept = 0;
+
+            for (size_t i = 0; i < njoins; i++) {
+                size_t slot = function->tasks[joins[i]].statement->vardecl.slot;
+
+                if (reads[slot] || found & SCAN_WRITES)
+                    join(builder, joins[i], pending);
+                else
+                    joins[kept++] = joins[i];
+            }
+
+            njoins = kept;
+            lower_statement(builder, statement);
+        }
+
+        if (statement->kind == STATEMENT_VAR_DECL)
+            decls[statement->vardecl.slot] = &statement->vardecl;
+        else if (statement->kind == STATEMENT_FOR && statement->forstatement.op != 0)
+            decls[statement->forstatement.result.slot] = &statement->forstatement.result;
+    }
+
+    close_scope(builder);
+}
+
+/* the results of the tasks it reads come straight from them, the other
+ * variables are copied when it is spawned. */
+static void spawn(Builder* builder, const Statement* statement, const char* reads, uint32_t* pending, const VarDecl** decls, size_t nslots) {
+    IrFunction* function = builder->function;
+    size_t nparams = 0;
+    size_t ndeps = 0;
+
+    for (size_t slot = 0; slot < nslots; slot++) {
+        nparams += reads[slot];
+        ndeps += reads[slot] && pending[slot] != IR_NONE;
+    }
+
+    if (function->ntasks == function->tasks_capacity)
+        function->tasks = grow(function, function->tasks, &function->tasks_capacity, sizeof(IrTask));
+
+    IrTask* task = &function->tasks[function->ntasks];
+
+    *task = (IrTask) {
+        .statement = statement,
+        .deps = ir_alloc(function, ndeps * sizeof(uint32_t)),
+        .ndeps = 0,
+        .slots = ir_alloc(function, nparams * sizeof(size_t)),
+        .types = ir_alloc(function, nparams * sizeof(Type)),
+        .nparams = nparams,
+    };
+
+    for (size_t slot = 0; slot < nslots; slot++) {
+        if (reads[slot] && pending[slot] != IR_NONE) {
+            task->slots[task->ndeps] = slot;
+            task->types[task->ndeps] = decls[slot]->type;
+            task->deps[task->ndeps++] = pending[slot];
+        }
+    }
+
+    uint32_t instr = ir_new_instr(function, IR_SPAWN, nparams - ndeps, statement->line, statement->col);
+    function->instrs[instr].task = function->ntasks;
+
+    size_t n = ndeps;
+
+    for (size_t slot = 0; slot < nslots; slot++) {
+        if (!reads[slot] || pending[slot] != IR_NONE)
+            continue;
+
+        uint32_t value = read_variable(builder, builder->scopes[builder->depth - 1][slot], builder->current);
+
+        task->slots[n] = slot;
+        task->types[n] = decls[slot]->type;
+        function->instrs[instr].args[n++ - ndeps] = value;
+    }
+
+    append(builder, instr);
+    pending[statement->vardecl.slot] = function->ntasks++;
+}
+
+static void join(Builder* builder, uint32_t task, uint32_t* pending) {
+    IrFunction* function = builder->function;
+    const Statement* statement = function->tasks[task].statement;
+
+    uint32_t instr = ir_new_instr(function, IR_JOIN, 0, statement->line, statement->col);
+    function->instrs[instr].task = task;
+    function->instrs[instr].type = statement->vardecl.type;
+    append(builder, instr);
+
+    uint32_t variable = new_variable(builder);
+    builder->scopes[builder->depth - 1][statement->vardecl.slot] = variable;
+    write_variable(builder, variable, builder->current, instr);
+
+    pending[statement->vardecl.slot] = IR_NONE;
+}
+
+/* marks in reads the variables of the root block read by statement, which
+ * is depth blocks inside it. */
+static void scan_statement(const Statement* statement, size_t depth, char* reads, int* found) {
+    switch (statement->kind) {
+    case STATEMENT_VAR_DECL:
+        scan_expression(statement->vardecl.expr, depth, reads, found);
+        break;
+    case STATEMENT_IF:
+        scan_expression(statement->ifstatement.expr, depth, reads, found);
+        scan_block(statement->ifstatement.if_block, depth + 1, reads, found);
+        scan_block(statement->ifstatement.else_block, depth + 1, reads, found);
+        break;
+    case STATEMENT_BLOCK:
+        scan_block(statement->blockstatement, depth + 1, reads, found);
+        break;
+    case STATEMENT_RETURN:
+        scan_expression(statement->ret, depth, reads, found);
+        break;
+    case STATEMENT_EXPR:
+        scan_expression(statement->expr, depth, reads, found);
+        break;
+    case STATEMENT_FOR:
+        scan_expression(statement->forstatement.from, depth, reads, found);
+        scan_expression(statement->forstatement.to, depth, reads, found);
+        scan_block(statement->forstatement.body, depth + 1, reads, found);
+        break;
+    case STATEMENT_YIELD:
+        scan_expression(statement->yield, depth, reads, found);
+        break;
+    case STATEMENT_STRUCT:
+    case STATEMENT_FN:
+    case STATEMENT_IMPORT:
+        break;
+    }
+}
+
+static void scan_block(const BlockStatement* blockstatement, size_t depth, char* reads, int* found) {
+    for (const BlockStatement* node = blockstatement; node != NULL; node = node->next)
+        scan_statement(node->statement, depth, reads, found);
+}
+
+/* a function can only write to the maps it is given. */
+static void scan_expression(const Expr* expr, size_t depth, char* reads, int* found) {
+    switch (expr->kind) {
+    case EXPR_PRIMARY:
+        if (expr->Primary.kind == VAL_IDENT && expr->depth == depth)
+            reads[expr->slot] = 1;
+        break;
+    case EXPR_BINARY:
+        scan_expression(expr->Binary.lhs, depth, reads, found);
+        scan_expression(expr->Binary.rhs, depth, reads, found);
+        break;
+    case EXPR_CALL: {
+        const Function* function = expr->Call.function;
+
+        if (function != NULL) {
+            *found |= SCAN_CALLS;
+
+            for (size_t i = 0; i < function->nparams; i++) {
+                if (function->params[i].kind == VAL_MAP)
+                    *found |= SCAN_WRITES;
+            }
+        } else if (expr->Call.builtin == BUILTIN_PUT || expr->Call.builtin == BUILTIN_DEL) {
+            *found |= SCAN_WRITES;
+        } else if (expr->Call.builtin != BUILTIN_LEN && expr->Call.builtin != BUILTIN_HAS
+            && expr->Call.builtin != BUILTIN_PRINT && expr->Call.builtin != BUILTIN_PRINTLN) {
+            *found |= SCAN_CALLS;
+        }
+
+        for (size_t i = 0; i < expr->Call.nargs; i++)
+            scan_expression(expr->Call.args[i], depth, reads, found);
+        break;
+    }
+    case EXPR_ARRAY:
+        for (size_t i = 0; i < expr->Array.nelements; i++)
+            scan_expression(expr->Array.elements[i], depth, reads, found);
+        break;
+    case EXPR_INDEX:
+        scan_expression(expr->Index.array, depth, reads, found);
+        scan_expression(expr->Index.index, depth, reads, found);
+        break;
+    case EXPR_MAP:
+        for (size_t i = 0; i < expr->Map.nentries; i++) {
+            scan_expression(expr->Map.keys[i], depth, reads, found);
+            scan_expression(expr->Map.values[i], depth, reads, found);
+        }
+        break;
+    case EXPR_RECORD:
+        for (size_t i = 0; i < expr->Record.nfields; i++)
+            scan_expression(expr->Record.values[i], depth, reads, found);
+        break;
+    case EXPR_FIELD:
+        scan_expression(expr->Field.record, depth, reads, found);
+        break;
+    }
+}
+
+/* a shared expression without variables evaluates to the same everywhere
+ * the parser put it. those places are all further down one block, so the
+ * first value dominates the others and stands for them. */
+static uint32_t lower_expression(Builder* builder, const Expr* expr) {
+    if (expr->uses < 2 || !expr->constant)
+        return lower_node(builder, expr);
+
+    if (builder->nmemo > 0) {
+        size_t mask = builder->memo_capacity - 1;
+
+        for (size_t i = ((uintptr_t)expr >> 4) & mask; builder->memo[i] != NULL; i = (i + 1) & mask) {
+            if (builder->memo[i] == expr)
+                return builder->memo_values[i];
+        }
+    }
+
+    uint32_t value = lower_node(builder, expr);
+    memoize(builder, expr, value);
+
+    return value;
+}
+
+static void memoize(Builder* builder, const Expr* expr, uint32_t value) {
+    if (builder->nmemo * 2 >= builder->memo_capacity) {
+        size_t capacity = builder->memo_capacity == 0 ? 64 : builder->memo_capacity * 2;
+
+        const Expr** memo = calloc(capacity, sizeof(Expr*));
+        uint32_t* values = malloc(capacity * sizeof(uint32_t));
+
+        if (memo == NULL || values == NULL) {
+            free(memo);
+            free(values);
+            out_of_memory(builder->function);
+        }
+
+        for (size_t i = 0; i < builder->memo_capacity; i++) {
+            if (builder->memo[i] == NULL)
+                continue;
+
+            size_t j = ((uintptr_t)builder->memo[i] >> 4) & (capacity - 1);
+            while (memo[j] != NULL)
+                j = (j + 1) & (capacity - 1);
+
+            memo[j] = builder->memo[i];
+            values[j] = builder->memo_values[i];
+        }
+
+        free(builder->memo);
+        free(builder->memo_values);
+
+        builder->memo = memo;
+        builder->memo_values = values;
+        builder->memo_capacity = capacity;
+    }
+
+    size_t i = ((uintptr_t)expr >> 4) & (builder->memo_capacity - 1);
+    while (builder->memo[i] != NULL)
+        i = (i + 1) & (builder->memo_capacity - 1);
+
+    builder->memo[i] = expr;
+    builder->memo_values[i] = value;
+    builder->nmemo++;
+}
+
+static uint32_t lower_node(Builder* builder, const Expr* expr) {
+    IrFunction* function = builder->function;
+
+    switch (expr->kind) {
+    case EXPR_PRIMARY: {
+        /* one frame further out than the root is the globals. */
+        if (expr->Primary.kind == VAL_IDENT && expr->depth == builder->depth) {
+            uint32_t global = ir_new_instr(function, IR_GLOBAL, 0, expr->line, expr->col);
+            function->instrs[global].global = expr->slot;
+            function->instrs[global].type = builder->globals->variables[expr->slot].type;
+            append(builder, global);
+
+            return global;
+        }
+
+        if (expr->Primary.kind == VAL_IDENT) {
+            uint32_t variable = builder->scopes[builder->depth - 1 - expr->depth][expr->slot];
+            return read_variable(builder, variable, builder->current);
+        }
+
+        uint32_t constant = ir_new_instr(function, IR_CONST, 0, expr->line, expr->col);
+        function->instrs[constant].constant = expr->Primary;
+        function->instrs[constant].type = known(expr->Primary.kind);
+        append(builder, constant);
+
+        return constant;
+    }
+    case EXPR_BINARY: {
+        uint32_t lhs = lower_expression(builder, expr->Binary.lhs);
+        uint32_t rhs = lower_expression(builder, expr->Binary.rhs);
+
+        uint32_t binary = ir_new_instr(function, IR_BINARY, 2, expr->line, expr->col);
+        IrInstr* instr = &function->instrs[binary];
+
+        instr->args[0] = lhs;
+        instr->args[1] = rhs;
+        instr->binop = expr->Binary.op;
+        instr->type = binary_type(function, instr);
+        append(builder, binary);
+
+        return binary;
+    }
+    case EXPR_CALL:
+        return lower_call(builder, expr);
+    case EXPR_ARRAY: {
+        if (expr->Array.nelements > UINT16_MAX)
+            lower_error(function, expr->line, expr->col, "too many elements in an array literal");
+
+        uint32_t array = lower_list(builder, IR_NEWARRAY, expr->Array.elements, expr->Array.nelements, expr);
+        IrInstr* instr = &function->instrs[array];
+
+        ValueKind kind = function->instrs[instr->args[0]].type.kind;
+        if (kind == VAL_INT || kind == VAL_DOUBLE)
+            instr->type = known(kind == VAL_INT ? VAL_INT_ARRAY : VAL_DOUBLE_ARRAY);
+
+        return array;
+    }
+    case EXPR_INDEX: {
+        uint32_t array = lower_expression(builder, expr->Index.array);
+        uint32_t index = lower_expression(builder, expr->Index.index);
+
+        uint32_t result = ir_new_instr(function, IR_INDEX, 2, expr->line, expr->col);
+        IrInstr* instr = &function->instrs[result];
+
+        instr->args[0] = array;
+        instr->args[1] = index;
+        instr->type = index_type(function, instr);
+        append(builder, result);
+
+        return result;
+    }
+    case EXPR_MAP:
+        return lower_map(builder, expr);
+    case EXPR_RECORD:
+        return lower_record(builder, expr);
+    case EXPR_FIELD:
+        return lower_field(builder, expr);
+    }
+
+    return IR_NONE;
+}
+
+static uint32_t lower_call(Builder* builder, const Expr* expr) {
+    IrFunction* function = builder->function;
+
+    if (expr->Call.function != NULL) {
+        uint32_t call = lower_list(builder, IR_CALL, expr->Call.args, expr->Call.nargs, expr);
+        function->instrs[call].callee = expr->Call.function;
+        function->instrs[call].slot = expr->Call.slot;
+        function->instrs[call].type = expr->Call.function->result;
+
+        return call;
+    }
+
+    if (expr->Call.builtin == BUILTIN_LEN) {
+        uint32_t value = lower_expression(builder, expr->Call.args[0]);
+
+        uint32_t len = ir_new_instr(function, IR_LEN, 1, expr->line, expr->col);
+        function->instrs[len].args[0] = value;
+        function->instrs[len].type = known(VAL_INT);
+        append(builder, len);
+
+        return len;
+    }
+
+    uint32_t call = lower_list(builder, IR_BUILTIN, expr->Call.args, expr->Call.nargs, expr);
+    IrInstr* instr = &function->instrs[call];
+
+    instr->builtin = expr->Call.builtin;
+    instr->type = builtin_type(function, instr);
+
+    return call;
+}
+
+static uint32_t lower_map(Builder* builder, const Expr* expr) {
+    IrFunction* function = builder->function;
+
+    uint32_t map = ir_new_instr(function, IR_NEWMAP, 0, expr->line, expr->col);
+    function->instrs[map].type = expr->Map.type;
+    append(builder, map);
+
+    for (size_t i = 0; i < expr->Map.nentries; i++) {
+        const Expr* key = expr->Map.keys[i];
+
+        uint32_t key_value = lower_expression(builder, key);
+        uint32_t value = lower_expression(builder, expr->Map.values[i]);
+
+        uint32_t set = ir_new_instr(function, IR_MAPSET, 3, key->line, key->col);
+        function->instrs[set].args[0] = map;
+        function->instrs[set].args[1] = key_value;
+        function->instrs[set].args[2] = value;
+        append(builder, set);
+    }
+
+    return map;
+}
+
+/* an element of an array of structs is read in place instead of being
+ * copied out first. */
+static uint32_t lower_field(Builder* builder, const Expr* expr) {
+    IrFunction* function = builder->function;
+
+    const Expr* record = expr->Field.record;
+    const RecordField* field = expr->Field.field;
+    uint32_t result;
+
+    if (!expr->Field.column && record->kind == EXPR_INDEX) {
+        uint32_t array = lower_expression(builder, record->Index.array);
+        uint32_t index = lower_expression(builder, record->Index.index);
+
+        result = ir_new_instr(function, IR_INDEXFIELD, 2, expr->line, expr->col);
+        function->instrs[result].args[0] = array;
+        function->instrs[result].args[1] = index;
+    } else {
+        uint32_t value = lower_expression(builder, record);
+
+        result = ir_new_instr(function, expr->Field.column ? IR_COLUMN : IR_FIELD, 1, expr->line, expr->col);
+        function->instrs[result].args[0] = value;
+    }
+
+    IrInstr* instr = &function->instrs[result];
+    instr->field = field;
+
+    if (!expr->Field.column)
+        instr->type = known(field->kind);
+    else
+        instr->type = known(field->kind == VAL_INT ? VAL_INT_ARRAY : VAL_DOUBLE_ARRAY);
+
+    append(builder, result);
+    return result;
+}
+
+/* an instruction taking the values of exprs in order. */
+static uint32_t lower_list(Builder* builder, IrOp op, Expr** exprs, size_t count, const Expr* expr) {
+    IrFunction* function = builder->function;
+    uint32_t* args = ir_alloc(function, count * sizeof(uint32_t));
+
+    for (size_t i = 0; i < count; i++)
+        args[i] = lower_expression(builder, exprs[i]);
+
+    uint32_t result = ir_new_instr(function, op, 0, expr->line, expr->col);
+    function->instrs[result].args = args;
+    function->instrs[result].nargs = count;
+    append(builder, result);
+
+    return result;
+}
+
+/* the values run in the order they are written, the struct takes them in
+ * the order of its fields. */
+static uint32_t lower_record(Builder* builder, const Expr* expr) {
+    IrFunction* function = builder->function;
+    size_t count = expr->Record.nfields;
+    uint32_t* args = ir_alloc(function, count * sizeof(uint32_t));
+
+    for (size_t i = 0; i < count; i++)
+        args[expr->Record.fields[i]] = lower_expression(builder, expr->Record.values[i]);
+
+    uint32_t result = ir_new_instr(function, IR_NEWRECORD, 0, expr->line, expr->col);
+    function->instrs[result].args = args;
+    function->instrs[result].nargs = count;
+    function->instrs[result].type = expr->Record.type;
+    append(builder, result);
+
+    return result;
+}
+
+/* arithmetic keeps the kind of its operands, or of the array among them. a
+ * comparison that does not fail is a bool. */
+static Type binary_type(const IrFunction* function, const IrInstr* instr) {
+    ValueKind lhs = function->instrs[instr->args[0]].type.kind;
+    ValueKind rhs = function->instrs[instr->args[1]].type.kind;
+
+    if (instr->binop == '=' || instr->binop == '!')
+        return known(VAL_BOOL);
+
+    if (lhs == VAL_INT_ARRAY || lhs == VAL_DOUBLE_ARRAY)
+        return known(lhs);
+    if (rhs == VAL_INT_ARRAY || rhs == VAL_DOUBLE_ARRAY)
+        return known(rhs);
+
+    if (lhs == rhs && (lhs == VAL_INT || lhs == VAL_DOUBLE || (lhs == VAL_STRING && instr->binop == '+')))
+        return known(lhs);
+
+    return known(VAL_IDENT);
+}
+
+static Type builtin_type(const IrFunction* function, const IrInstr* instr) {
+    const Type* first = &function->instrs[instr->args[0]].type;
+
+    switch (instr->builtin) {
+    case BUILTIN_HAS:
+    case BUILTIN_PUT:
+    case BUILTIN_DEL:
+        return known(VAL_BOOL);
+    case BUILTIN_PRINT:
+    case BUILTIN_PRINTLN:
+        return known(VAL_INT);
+    case BUILTIN_FILL:
+    case BUILTIN_IOTA: {
+        const Type* element = &function->instrs[instr->args[1]].type;
+
+        if (element->kind == VAL_INT || element->kind == VAL_DOUBLE)
+            return known(element->kind == VAL_INT ? VAL_INT_ARRAY : VAL_DOUBLE_ARRAY);
+
+        if (element->kind == VAL_RECORD && instr->builtin == BUILTIN_FILL) {
+            Type type = *element;
+            type.kind = VAL_RECORD_ARRAY;
+            return type;
+        }
+
+        return known(VAL_IDENT);
+    }
+    default:
+        if (first->kind == VAL_INT_ARRAY)
+            return known(VAL_INT);
+        if (first->kind == VAL_DOUBLE_ARRAY)
+            return known(VAL_DOUBLE);
+
+        return known(VAL_IDENT);
+    }
+}
+
+static Type index_type(const IrFunction* function, const IrInstr* instr) {
+    const Type* array = &function->instrs[instr->args[0]].type;
+
+    switch (array->kind) {
+    case VAL_INT_ARRAY:
+        return known(VAL_INT);
+    case VAL_DOUBLE_ARRAY:
+        return known(VAL_DOUBLE);
+    case VAL_MAP:
+        return known(array->value);
+    case VAL_RECORD_ARRAY: {
+        Type type = *array;
+        type.kind = VAL_RECORD;
+        return type;
+    }
+    default:
+        return known(VAL_IDENT);
+    }
+}
+
+static Type known(ValueKind kind) {
+    return (Type) { .kind = kind };
+}
+
+static void dump_type(const Type* type, FILE* file) {
+    static const char* kinds[] = {
+        [VAL_INT] = "i64", [VAL_DOUBLE] = "f64", [VAL_BOOL] = "bool", [VAL_STRING] = "string",
+        [VAL_INT_ARRAY] = "[]i64", [VAL_DOUBLE_ARRAY] = "[]f64",
+    };
+
+    switch (type->kind) {
+    case VAL_MAP:
+        fprintf(file, "map[%s]%s", kinds[type->key], kinds[type->value]);
+        break;
+    case VAL_RECORD:
+        fprintf(file, "%.*s", (int)type->record->name.size, type->record->name.data);
+        break;
+    case VAL_RECORD_ARRAY:
+        fprintf(file, "[]%.*s", (int)type->record->name.size, type->record->name.data);
+        break;
+    default:
+        fprintf(file, "%s", kinds[type->kind]);
+        break;
+    }
+}
+
+static void dump_value(const Value* value, FILE* file) {
+    switch (value->kind) {
+    case VAL_INT:
+        fprintf(file, "%lld", (long long)value->i64);
+        break;
+    case VAL_DOUBLE:
+        fprintf(file, "%.17g", value->f64);
+        break;
+    case VAL_BOOL:
+        fprintf(file, "%s", value->bool ? "true" : "false");
+        break;
+    case VAL_STRING: {
+        const char* data = string_data(value);
+        fprintf(file, "\"%.*s\"", data != NULL ? (int)string_size(value) : 0, data != NULL ? data : "");
+        break;
+    }
+    default:
+        fprintf(file, "?");
+        break;
+    }
+}
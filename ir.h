@@ -0,0 +1,301 @@
+#ifndef IR_H
+#define IR_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <setjmp.h>
+
+#include "kidomaru.h"
+#include "arena.h"
+#include "ast.h"
+#include "resolver.h"
+
+/* the ssa form a program takes between the resolved tree and the bytecode.
+ *
+ * every instruction defines at most one value, named by the instruction's
+ * index in IrFunction.instrs, and nothing is ever defined twice. control
+ * flow is a graph of basic blocks ending in one exit each. a value that
+ * depends on the path taken into a block is a phi at the start of it. */
+
+#define IR_NONE UINT32_MAX
+
+typedef enum IrOp_t {
+    IR_CONST,       /* constant */
+    IR_BINARY,      /* args[0] binop args[1] */
+    IR_SHL,         /* args[0] << shift, args[0] is known to be an i64 */
+    IR_DIVPOW2,     /* args[0] / 2^shift rounded towards zero, args[0] is known to be an i64 */
+    IR_LEN,         /* the length of args[0] */
+    IR_BUILTIN,     /* builtin called with args */
+    IR_NEWARRAY,    /* an array of args */
+    IR_INDEX,       /* element args[1] of args[0], or the value of key args[1] of a map */
+    IR_NEWMAP,      /* an empty map of type */
+    IR_MAPSET,      /* key args[1] of map args[0] = args[2], defines no value */
+    IR_NEWRECORD,   /* a struct of type with the fields args */
+    IR_FIELD,       /* field of struct args[0] */
+    IR_INDEXFIELD,  /* field of element args[1] of args[0] */
+    IR_COLUMN,      /* field of every element of args[0] */
+    IR_GLOBAL,      /* global variable global of a stream */
+    IR_SETGLOBAL,   /* global variable global = args[0], defines no value */
+    IR_DEFINE,      /* args[0] once it is checked to be of the declared type */
+    IR_CALL,        /* callee called with args */
+    IR_SPAWN,       /* task started on another thread with args, defines no value */
+    IR_JOIN,        /* the result of task once it is done */
+    IR_PARFOR,      /* the result of par for parfor over args[0] to args[1], capturing the other args */
+    IR_LESS,        /* args[0] < args[1], both known to be i64s */
+    IR_PARAM,       /* argument param of the function being lowered */
+    IR_COPY,        /* args[0] */
+    IR_PHI,         /* args[i] when the block was entered from its preds[i] */
+} IrOp;
+
+typedef struct IrInstr_t {
+    IrOp op;
+
+    /* what is known about the value, whenever it is defined at all. the kind
+     * is VAL_IDENT when nothing is. */
+    Type type;
+
+    uint32_t* args;
+    size_t nargs;
+
+    union {
+        Value constant;
+        char binop;     /* like Expr.Binary.op */
+        int shift;
+        Builtin builtin;
+        const RecordField* field;
+        Type declared;
+        uint32_t global;
+        uint32_t param;
+        uint32_t task;
+        uint32_t parfor;
+
+        /* and its slot in the table of the caller. */
+        struct {
+            const Function* callee;
+            uint32_t slot;
+        };
+    };
+
+    uint32_t block;
+
+    size_t line;
+    size_t col;
+
+    /* removed by a pass, nothing refers to it anymore. */
+    int dead;
+} IrInstr;
+
+typedef enum IrExit_t {
+    IR_JUMP,        /* to succs[0] */
+    IR_BRANCH,      /* to succs[0] if value is true, succs[1] if false */
+    IR_RETURN,      /* stop, value is the result */
+    IR_HALT,        /* stop without a result */
+} IrExit;
+
+typedef struct IrBlock_t {
+    /* phis first, in order of execution. */
+    uint32_t* instrs;
+    size_t ninstrs;
+    size_t capacity;
+
+    uint32_t* preds;
+    size_t npreds;
+    size_t preds_capacity;
+
+    IrExit exit;
+    uint32_t value;
+    uint32_t succs[2];
+
+    size_t line;
+    size_t col;
+
+    /* every pred is known. */
+    int sealed;
+
+    /* cannot be reached, it has no preds and no instructions. */
+    int dead;
+} IrBlock;
+
+/* a let at the top level of the root block lowered into a function of its
+ * own, see ir_lower. its parameters are the results of the tasks in deps
+ * followed by the other variables of the root block its initialiser reads,
+ * slots and types giving the variable each of them stands for. */
+typedef struct IrTask_t {
+    const Statement* statement;
+
+    uint32_t* deps;
+    size_t ndeps;
+
+    size_t* slots;
+    Type* types;
+    size_t nparams;
+} IrTask;
+
+/* a par for lowered into a function of its own, see ir_lower_parfor. the
+ * parameters of that function are the bounds of a chunk of the range,
+ * followed by the variables from outside the loop that its body reads:
+ * levels and slots give the frame and slot of each, a level of -1 being a
+ * global of a stream, and types what is known of its value. depth is how
+ * many frames were open around the loop. */
+typedef struct IrParFor_t {
+    const Statement* statement;
+    size_t depth;
+
+    ptrdiff_t* levels;
+    size_t* slots;
+    Type* types;
+    size_t ncaptures;
+} IrParFor;
+
+typedef struct IrFunction_t {
+    /* instructions and blocks are in malloc'd arrays that grow as they are
+     * added, everything hanging off them comes from the arena. */
+    Arena arena;
+
+    IrInstr* instrs;
+    size_t ninstrs;
+    size_t capacity;
+
+    /* block 0 is the entry. */
+    IrBlock* blocks;
+    size_t nblocks;
+    size_t blocks_capacity;
+
+    /* every struct type declared, in the order of their indexes. */
+    const RecordType** records;
+    size_t nrecords;
+    size_t records_capacity;
+
+    /* the tasks the root spawns, in the order of their statements. */
+    IrTask* tasks;
+    size_t ntasks;
+    size_t tasks_capacity;
+
+    /* the par fors it runs, in the order of their statements. */
+    IrParFor* parfors;
+    size_t nparfors;
+    size_t parfors_capacity;
+
+    /* where folded string constants go, it outlives the function. */
+    Arena* constants;
+
+    /* the table the calls name their callees in, when the functions of it
+     * may be inlined and specialized, see ir_inline. NULL otherwise. */
+    Functions* functions;
+
+    /* the chunk compiled from it records its loops, see ChunkLoop. */
+    int record_loops;
+
+    /* allocations made for it and their bytes, which go to the stats at
+     * ir_deinit. */
+    size_t nallocs;
+    size_t nbytes;
+
+    kd_error* error;
+    jmp_buf bail;
+} IrFunction;
+
+/* how long a pass took and how many instructions were left after it. */
+typedef struct IrPassTime_t {
+    const char* name;
+    double seconds;
+    size_t ninstrs;
+} IrPassTime;
+
+#define IR_MAX_PASSES 16
+
+IrFunction ir_init(Arena* constants);
+void ir_deinit(IrFunction* function);
+
+/* builds the function from a resolved tree. statements that cannot be
+ * reached are dropped. root is a statement at the top level of a stream
+ * when globals is not NULL, see resolve_global.
+ *
+ * with parallel, a let of the root block whose initialiser calls a function
+ * and cannot write to a map becomes a task: the root spawns it where the
+ * let stands and joins it before the first statement reading its variable
+ * or calling something that could write to a map. a task reading the
+ * variable of another task waits for it on its own. */
+kd_status ir_lower(IrFunction* function, const Statement* root, size_t root_nslots, const Globals* globals, int parallel, kd_error* error);
+
+/* builds the function of a task of root, which was lowered with parallel
+ * and root_nslots. */
+kd_status ir_lower_task(IrFunction* function, const IrTask* task, const Statement* root, size_t root_nslots, kd_error* error);
+
+/* builds the function running a chunk of parfor, lowered into function
+ * with the loops of its body run in order. */
+kd_status ir_lower_parfor(IrFunction* function, const IrParFor* parfor, kd_error* error);
+
+/* builds the function from the resolved body of fn, see resolve_function.
+ * its structs are numbered after the ones of the table of fn. with bound,
+ * one value for each parameter, the parameters it does not leave VAL_IDENT
+ * are those constants and the others are numbered as if they were alone. */
+kd_status ir_lower_function(IrFunction* function, const Function* fn, const Value* bound, const Statement* body, kd_error* error);
+
+/* runs every pass in order, filling times with one entry for each. with
+ * function->functions, calls are inlined first. */
+kd_status ir_optimize(IrFunction* function, IrPassTime* times, size_t* ntimes, kd_error* error);
+
+/* the calls of function to small functions of function->functions become
+ * copies of their bodies, with the arguments in place of the parameters,
+ * as long as the copies add up to at most INLINE_BUDGET instructions. a
+ * call of a larger one with constant arguments calls a copy of the callee
+ * specialized for them instead, see function_specialize, when that copy
+ * comes out smaller. a callee is only inlined or specialized when nothing
+ * it would check of its arguments and result at runtime can fail. */
+void ir_inline(IrFunction* function);
+
+/* a callee of at most INLINE_SIZE instructions once optimized is inlined,
+ * one of at most SPECIALIZE_SIZE can be specialized. */
+#define INLINE_SIZE 40
+#define INLINE_BUDGET 2000
+#define SPECIALIZE_SIZE 1000
+
+/* turns function, lowered again just as the chunk with a loop jumping back
+ * to header was, into one that starts at header with values for parameters,
+ * which are the values live there as ChunkLoop lists them. what runs before
+ * the loop is dropped, apart from constants. fails when the rest of the
+ * function needs anything else from before it, as the code after a loop
+ * nested in another does. */
+kd_status ir_enter_loop(IrFunction* function, uint32_t header, const uint32_t* values, size_t nvalues, kd_error* error);
+
+void ir_dump(const IrFunction* function, FILE* file);
+
+/* instructions not removed yet. */
+size_t ir_count(const IrFunction* function);
+
+/* the value a copy, or chain of copies, stands for. */
+static inline uint32_t ir_resolve(const IrFunction* function, uint32_t value) {
+    while (value != IR_NONE && function->instrs[value].op == IR_COPY)
+        value = function->instrs[value].args[0];
+
+    return value;
+}
+
+/* helpers shared by the lowering and the passes. they longjmp to
+ * function->bail when out of memory. */
+void* ir_alloc(IrFunction* function, size_t size);
+uint32_t ir_new_instr(IrFunction* function, IrOp op, size_t nargs, size_t line, size_t col);
+void ir_insert(IrFunction* function, uint32_t block, size_t index, uint32_t instr);
+uint32_t ir_new_block(IrFunction* function);
+void ir_add_edge(IrFunction* function, uint32_t from, uint32_t to);
+
+/* makes instr a copy of value, dropping its own operands. */
+void ir_replace(IrFunction* function, uint32_t instr, uint32_t value);
+
+/* instructions whose removal would change what a run does. */
+int ir_has_effect(const IrFunction* function, const IrInstr* instr);
+
+/* blocks in reverse postorder from the entry, the unreachable ones left
+ * out. returns how many there are. */
+size_t ir_reverse_postorder(IrFunction* function, uint32_t* order);
+
+/* marks the blocks that cannot be reached from the entry dead, with their
+ * instructions, and takes them out of the preds of the others. */
+void ir_remove_unreachable(IrFunction* function);
+
+/* types are equal when their values are interchangeable for a DEFINE. */
+int ir_same_type(const Type* a, const Type* b);
+
+#endif /* IR_H */
@@ -0,0 +1,602 @@
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+
+#include "ir.h"
+#include "program.h"
+
+/* a function called from the one being inlined into, lowered and optimized
+ * on its own the first time a call of it is looked at. */
+typedef struct Callee_t {
+    Function* function;
+    IrFunction ir;
+
+    /* its body lowered, and whether it can be copied into a caller. */
+    int lowered;
+    int copyable;
+
+    /* it calls itself, or a callee that comes back to it, see
+     * find_cycles. */
+    int recursive;
+
+    size_t size;
+
+    /* the functions of the same table its body calls. */
+    Function** calls;
+    size_t ncalls;
+
+    /* for find_cycles: when it was reached, 0 before, the earliest callee
+     * on the stack it reaches, and whether it is on the stack. */
+    size_t order;
+    size_t low;
+    int stacked;
+} Callee;
+
+/* a callee find_cycles is going through the calls of. */
+typedef struct Visit_t {
+    size_t callee;
+    size_t next;
+} Visit;
+
+typedef struct Inliner_t {
+    IrFunction* function;
+
+    Callee* callees;
+    size_t ncallees;
+    size_t capacity;
+
+    /* the path find_cycles has taken, and the callees reached that are not
+     * in a component yet. */
+    Visit* path;
+    size_t npath;
+    size_t path_capacity;
+    size_t* stack;
+    size_t nstack;
+    size_t stack_capacity;
+    size_t order;
+
+    /* instructions inlining may still add. */
+    size_t budget;
+} Inliner;
+
+static void inline_call(Inliner* inliner, uint32_t call);
+static size_t callee_of(Inliner* inliner, Function* fn);
+static void find_cycles(Inliner* inliner, size_t first);
+static void reach(Inliner* inliner, size_t callee);
+static void* grow(Inliner* inliner, void* items, size_t* capacity, size_t count, size_t size);
+static int lower_callee(IrFunction* function, Function* fn, const Value* bound, IrFunction* ir);
+static int copyable(const IrFunction* ir, const Function* fn, int* recursive);
+static void collect_calls(Inliner* inliner, Callee* callee);
+static void copy_body(IrFunction* function, uint32_t call, const IrFunction* ir, const Function* fn);
+static uint32_t split_block(IrFunction* function, uint32_t call);
+static void specialize(Inliner* inliner, uint32_t call, const Callee* callee);
+static void free_callees(Inliner* inliner);
+
+/* what the body of a pass does when running out of memory goes through
+ * function->bail, which is taken over while callees are held so that they
+ * are freed on the way out. */
+void ir_inline(IrFunction* function) {
+    Inliner inliner = {
+        .function = function,
+        .budget = INLINE_BUDGET,
+    };
+
+    jmp_buf outer;
+    memcpy(outer, function->bail, sizeof(jmp_buf));
+
+    if (setjmp(function->bail)) {
+        free_callees(&inliner);
+        memcpy(function->bail, outer, sizeof(jmp_buf));
+        longjmp(function->bail, 1);
+    }
+
+    /* the calls copied in from a callee come after the ones there were,
+     * and are looked at in turn. */
+    for (uint32_t id = 0; id < function->ninstrs; id++) {
+        const IrInstr* instr = &function->instrs[id];
+
+        if (instr->op == IR_CALL && instr->block != IR_NONE && !instr->dead && instr->callee->table == function->functions)
+            inline_call(&inliner, id);
+    }
+
+    free_callees(&inliner);
+    memcpy(function->bail, outer, sizeof(jmp_buf));
+}
+
+static void inline_call(Inliner* inliner, uint32_t call) {
+    IrFunction* function = inliner->function;
+    IrInstr* instr = &function->instrs[call];
+
+    Function* fn = function->functions->items[instr->slot];
+
+    if (fn->generic != NULL)
+        return;
+
+    for (size_t i = 0; i < instr->nargs; i++) {
+        instr->args[i] = ir_resolve(function, instr->args[i]);
+
+        if (!ir_same_type(&function->instrs[instr->args[i]].type, &fn->params[i]))
+            return;
+    }
+
+    size_t index = callee_of(inliner, fn);
+
+    if (inliner->callees[index].order == 0)
+        find_cycles(inliner, index);
+
+    Callee* callee = &inliner->callees[index];
+    if (!callee->lowered || callee->recursive)
+        return;
+
+    if (callee->copyable && callee->size <= INLINE_SIZE && callee->size <= inliner->budget) {
+        copy_body(function, call, &callee->ir, fn);
+        inliner->budget -= callee->size;
+        return;
+    }
+
+    specialize(inliner, call, callee);
+}
+
+/* the index of the callee for fn, which may move the callees. */
+static size_t callee_of(Inliner* inliner, Function* fn) {
+    for (size_t i = 0; i < inliner->ncallees; i++) {
+        if (inliner->callees[i].function == fn)
+            return i;
+    }
+
+    inliner->callees = grow(inliner, inliner->callees, &inliner->capacity, inliner->ncallees, sizeof(Callee));
+
+    Callee* callee = &inliner->callees[inliner->ncallees];
+
+    *callee = (Callee) { .function = fn };
+    callee->lowered = lower_callee(inliner->function, fn, NULL, &callee->ir);
+
+    /* counted once its ir is there to be freed. */
+    inliner->ncallees++;
+
+    if (callee->lowered) {
+        callee->copyable = copyable(&callee->ir, fn, &callee->recursive);
+        callee->size = ir_count(&callee->ir);
+        collect_calls(inliner, callee);
+    }
+
+    return inliner->ncallees - 1;
+}
+
+/* Tarjan's strongly connected components over the calls from first on,
+ * lowering the callees as they are reached. a callee belongs to one
+ * component, found once whatever order the calls are inlined in, and is
+ * recursive when that has others in it: inlining it would unroll the
+ * cycle until the budget runs out. it keeps its own path rather than
+ * recursing, a chain of calls can be as long as the program. */
+static void find_cycles(Inliner* inliner, size_t first) {
+    reach(inliner, first);
+
+    while (inliner->npath > 0) {
+        Visit* visit = &inliner->path[inliner->npath - 1];
+        size_t from = visit->callee;
+
+        if (visit->next < inliner->callees[from].ncalls) {
+            size_t to = callee_of(inliner, inliner->callees[from].calls[visit->next++]);
+            Callee* callee = &inliner->callees[to];
+
+            if (callee->order == 0)
+                reach(inliner, to);
+            else if (callee->stacked && callee->order < inliner->callees[from].low)
+                inliner->callees[from].low = callee->order;
+
+            continue;
+        }
+
+        inliner->npath--;
+
+        Callee* done = &inliner->callees[from];
+
+        if (inliner->npath > 0) {
+            Callee* caller = &inliner->callees[inliner->path[inliner->npath - 1].callee];
+            if (done->low < caller->low)
+                caller->low = done->low;
+        }
+
+        if (done->low != done->order)
+            continue;
+
+        /* from is the first of its component on the stack. */
+        size_t start = inliner->nstack;
+        while (inliner->stack[start - 1] != from)
+            start--;
+
+        for (size_t i = start - 1; i < inliner->nstack; i++) {
+            Callee* member = &inliner->callees[inliner->stack[i]];
+
+            member->stacked = 0;
+            if (inliner->nstack - start > 0)
+                member->recursive = 1;
+        }
+
+        inliner->nstack = start - 1;
+    }
+}
+
+static void reach(Inliner* inliner, size_t index) {
+    inliner->path = grow(inliner, inliner->path, &inliner->path_capacity, inliner->npath, sizeof(Visit));
+    inliner->stack = grow(inliner, inliner->stack, &inliner->stack_capacity, inliner->nstack, sizeof(size_t));
+
+    Callee* callee = &inliner->callees[index];
+
+    callee->order = ++inliner->order;
+    callee->low = callee->order;
+    callee->stacked = 1;
+
+    inliner->path[inliner->npath++] = (Visit) { .callee = index, .next = 0 };
+    inliner->stack[inliner->nstack++] = index;
+}
+
+/* items with room for one more than count, of size bytes each. */
+static void* grow(Inliner* inliner, void* items, size_t* capacity, size_t count, size_t size) {
+    if (count < *capacity)
+        return items;
+
+    size_t grown = *capacity == 0 ? 8 : *capacity * 2;
+
+    void* moved = realloc(items, grown * size);
+    if (moved == NULL) {
+        inliner->function->error->status = KD_ERROR_NOMEM;
+        snprintf(inliner->function->error->message, sizeof(inliner->function->error->message), "cannot allocate memory!");
+        longjmp(inliner->function->bail, 1);
+    }
+
+    *capacity = grown;
+    return moved;
+}
+
+/* a body that does not compile is left for its own compile to report. */
+static int lower_callee(IrFunction* function, Function* fn, const Value* bound, IrFunction* ir) {
+    kd_error error;
+
+    const Statement* body = program_function_body(fn, &error);
+    if (body == NULL)
+        return 0;
+
+    IrPassTime times[IR_MAX_PASSES];
+    size_t ntimes;
+
+    *ir = ir_init(function->constants);
+
+    if (ir_lower_function(ir, fn, bound, body, &error) != KD_OK || ir_optimize(ir, times, &ntimes, &error) != KD_OK) {
+        ir_deinit(ir);
+        return 0;
+    }
+
+    return 1;
+}
+
+/* everything the body refers to has to mean the same in the caller, every
+ * way out of it has to return a value of the declared type, and the entry
+ * cannot be jumped back to. */
+static int copyable(const IrFunction* ir, const Function* fn, int* recursive) {
+    int copyable = ir->ntasks == 0 && ir->nparfors == 0 && ir->nrecords == 0 && ir->blocks[0].npreds == 0;
+    size_t nreturns = 0;
+
+    *recursive = 0;
+
+    for (size_t b = 0; b < ir->nblocks; b++) {
+        const IrBlock* block = &ir->blocks[b];
+
+        if (block->dead)
+            continue;
+
+        for (size_t i = 0; i < block->ninstrs; i++) {
+            const IrInstr* instr = &ir->instrs[block->instrs[i]];
+
+            if (instr->op == IR_CALL && instr->callee == fn)
+                *recursive = 1;
+        }
+
+        if (block->exit == IR_HALT)
+            copyable = 0;
+
+        if (block->exit == IR_RETURN) {
+            uint32_t value = ir_resolve(ir, block->value);
+
+            if (!ir_same_type(&ir->instrs[value].type, &fn->result))
+                copyable = 0;
+
+            nreturns++;
+        }
+    }
+
+    return copyable && nreturns > 0;
+}
+
+/* the calls that can be inlined, each function once. */
+static void collect_calls(Inliner* inliner, Callee* callee) {
+    const IrFunction* ir = &callee->ir;
+    size_t capacity = 0;
+
+    for (size_t b = 0; b < ir->nblocks; b++) {
+        const IrBlock* block = &ir->blocks[b];
+
+        if (block->dead)
+            continue;
+
+        for (size_t i = 0; i < block->ninstrs; i++) {
+            const IrInstr* instr = &ir->instrs[block->instrs[i]];
+
+            if (instr->op != IR_CALL || instr->callee->table != inliner->function->functions || instr->callee->generic != NULL)
+                continue;
+
+            Function* fn = inliner->function->functions->items[instr->slot];
+
+            size_t c = 0;
+            while (c < callee->ncalls && callee->calls[c] != fn)
+                c++;
+
+            if (c < callee->ncalls)
+                continue;
+
+            callee->calls = grow(inliner, callee->calls, &capacity, callee->ncalls, sizeof(Function*));
+            callee->calls[callee->ncalls++] = fn;
+        }
+    }
+}
+
+/* the block of call is split after it, the blocks of the callee go in
+ * between with its parameters replaced by the arguments, and each of its
+ * returns jumps to the second half, where call is left a copy of the
+ * value returned. */
+static void copy_body(IrFunction* function, uint32_t call, const IrFunction* ir, const Function* fn) {
+    IrFunction* callee = (IrFunction*)ir;
+
+    uint32_t* order = ir_alloc(function, ir->nblocks * sizeof(uint32_t));
+    size_t norder = ir_reverse_postorder(callee, order);
+
+    uint32_t* blocks = ir_alloc(function, ir->nblocks * sizeof(uint32_t));
+    uint32_t* values = ir_alloc(function, ir->ninstrs * sizeof(uint32_t));
+
+    for (size_t b = 0; b < ir->nblocks; b++)
+        blocks[b] = IR_NONE;
+
+    for (size_t i = 0; i < ir->ninstrs; i++)
+        values[i] = IR_NONE;
+
+    for (size_t i = 0; i < norder; i++) {
+        blocks[order[i]] = ir_new_block(function);
+        function->blocks[blocks[order[i]]].sealed = 1;
+    }
+
+    /* the instructions first, a phi only keeping the operands of the preds
+     * that can be reached. */
+    for (size_t i = 0; i < norder; i++) {
+        const IrBlock* block = &ir->blocks[order[i]];
+
+        size_t npreds = 0;
+        for (size_t p = 0; p < block->npreds; p++)
+            npreds += blocks[block->preds[p]] != IR_NONE;
+
+        for (size_t j = 0; j < block->ninstrs; j++) {
+            uint32_t id = block->instrs[j];
+            const IrInstr* instr = &ir->instrs[id];
+
+            if (instr->op == IR_PARAM) {
+                values[id] = function->instrs[call].args[instr->param];
+                continue;
+            }
+
+            size_t nargs = instr->op == IR_PHI ? npreds : instr->nargs;
+            uint32_t copy = ir_new_instr(function, instr->op, nargs, instr->line, instr->col);
+            uint32_t* args = function->instrs[copy].args;
+
+            function->instrs[copy] = *instr;
+            function->instrs[copy].args = args;
+            function->instrs[copy].nargs = nargs;
+
+            ir_insert(function, blocks[order[i]], function->blocks[blocks[order[i]]].ninstrs, copy);
+            values[id] = copy;
+        }
+    }
+
+    for (size_t i = 0; i < norder; i++) {
+        const IrBlock* block = &ir->blocks[order[i]];
+
+        for (size_t j = 0; j < block->ninstrs; j++) {
+            const IrInstr* instr = &ir->instrs[block->instrs[j]];
+
+            if (instr->op == IR_PARAM)
+                continue;
+
+            uint32_t* args = function->instrs[values[block->instrs[j]]].args;
+            size_t n = 0;
+
+            for (size_t a = 0; a < instr->nargs; a++) {
+                if (instr->op == IR_PHI && blocks[block->preds[a]] == IR_NONE)
+                    continue;
+
+                args[n++] = values[ir_resolve(ir, instr->args[a])];
+            }
+        }
+
+        for (size_t p = 0; p < block->npreds; p++) {
+            if (blocks[block->preds[p]] != IR_NONE)
+                ir_add_edge(function, blocks[block->preds[p]], blocks[order[i]]);
+        }
+    }
+
+    uint32_t rest = split_block(function, call);
+    uint32_t from = function->instrs[call].block;
+
+    function->blocks[from].exit = IR_JUMP;
+    function->blocks[from].succs[0] = blocks[0];
+    ir_add_edge(function, from, blocks[0]);
+
+    uint32_t* results = ir_alloc(function, norder * sizeof(uint32_t));
+    size_t nresults = 0;
+
+    for (size_t i = 0; i < norder; i++) {
+        const IrBlock* block = &ir->blocks[order[i]];
+        IrBlock* copy = &function->blocks[blocks[order[i]]];
+
+        copy->line = block->line;
+        copy->col = block->col;
+        copy->exit = block->exit;
+        copy->value = block->value != IR_NONE ? values[ir_resolve(ir, block->value)] : IR_NONE;
+
+        for (int s = 0; s < 2; s++)
+            copy->succs[s] = block->succs[s] != IR_NONE ? blocks[block->succs[s]] : IR_NONE;
+
+        if (block->exit == IR_RETURN) {
+            results[nresults++] = copy->value;
+
+            copy->exit = IR_JUMP;
+            copy->value = IR_NONE;
+            copy->succs[0] = rest;
+            ir_add_edge(function, blocks[order[i]], rest);
+        }
+    }
+
+    /* call stays where it is, in the second half. */
+    size_t at = function->blocks[from].ninstrs - 1;
+    function->blocks[from].ninstrs = at;
+
+    uint32_t result = results[0];
+
+    if (nresults > 1) {
+        result = ir_new_instr(function, IR_PHI, nresults, fn->line, fn->col);
+        memcpy(function->instrs[result].args, results, nresults * sizeof(uint32_t));
+        function->instrs[result].type = fn->result;
+
+        ir_insert(function, rest, 0, result);
+    }
+
+    ir_insert(function, rest, nresults > 1, call);
+    ir_replace(function, call, result);
+}
+
+/* moves what follows call in its block to a new block, which takes over
+ * the exit of the block. returns the new block. */
+static uint32_t split_block(IrFunction* function, uint32_t call) {
+    uint32_t from = function->instrs[call].block;
+    uint32_t rest = ir_new_block(function);
+
+    IrBlock* block = &function->blocks[from];
+
+    size_t at = 0;
+    while (block->instrs[at] != call)
+        at++;
+
+    for (size_t i = at + 1; i < function->blocks[from].ninstrs; i++) {
+        uint32_t instr = function->blocks[from].instrs[i];
+        ir_insert(function, rest, function->blocks[rest].ninstrs, instr);
+    }
+
+    block = &function->blocks[from];
+    block->ninstrs = at + 1;
+
+    IrBlock* second = &function->blocks[rest];
+    second->exit = block->exit;
+    second->value = block->value;
+    second->succs[0] = block->succs[0];
+    second->succs[1] = block->succs[1];
+    second->line = block->line;
+    second->col = block->col;
+    second->sealed = 1;
+
+    for (int s = 0; s < 2; s++) {
+        if (block->succs[s] == IR_NONE || (s == 1 && block->succs[1] == block->succs[0]))
+            continue;
+
+        IrBlock* succ = &function->blocks[block->succs[s]];
+
+        for (size_t p = 0; p < succ->npreds; p++) {
+            if (succ->preds[p] == from)
+                succ->preds[p] = rest;
+        }
+    }
+
+    block->exit = IR_HALT;
+    block->value = IR_NONE;
+    block->succs[0] = IR_NONE;
+    block->succs[1] = IR_NONE;
+
+    return rest;
+}
+
+/* the arguments that are constants become part of the callee, which is
+ * inlined after all when that makes it small enough. */
+static void specialize(Inliner* inliner, uint32_t call, const Callee* callee) {
+    IrFunction* function = inliner->function;
+    Function* fn = callee->function;
+
+    if (callee->size > SPECIALIZE_SIZE || fn->generic != NULL)
+        return;
+
+    Value* bound = ir_alloc(function, (fn->nparams + 1) * sizeof(Value));
+    size_t nbound = 0;
+
+    for (size_t i = 0; i < fn->nparams; i++) {
+        const IrInstr* arg = &function->instrs[function->instrs[call].args[i]];
+        ValueKind kind = arg->op == IR_CONST ? arg->constant.kind : VAL_IDENT;
+
+        bound[i] = (Value) { .kind = VAL_IDENT };
+
+        if (kind == VAL_INT || kind == VAL_DOUBLE || kind == VAL_BOOL) {
+            bound[i] = arg->constant;
+            nbound++;
+        }
+    }
+
+    if (nbound == 0)
+        return;
+
+    IrFunction ir;
+    if (!lower_callee(function, fn, bound, &ir))
+        return;
+
+    size_t size = ir_count(&ir);
+    int recursive;
+    int inlined = copyable(&ir, fn, &recursive) && size <= INLINE_SIZE && size <= inliner->budget;
+
+    Function* copy = NULL;
+    if (!inlined && size < callee->size)
+        copy = function_specialize(fn, bound);
+
+    if (inlined || copy != NULL) {
+        IrInstr* instr = &function->instrs[call];
+        size_t n = 0;
+
+        for (size_t i = 0; i < fn->nparams; i++) {
+            if (bound[i].kind == VAL_IDENT)
+                instr->args[n++] = instr->args[i];
+        }
+
+        instr->nargs = n;
+    }
+
+    if (inlined) {
+        copy_body(function, call, &ir, fn);
+        inliner->budget -= size;
+    } else if (copy != NULL) {
+        function->instrs[call].callee = copy;
+        function->instrs[call].slot = copy->index;
+    }
+
+    ir_deinit(&ir);
+}
+
+static void free_callees(Inliner* inliner) {
+    for (size_t i = 0; i < inliner->ncallees; i++) {
+        if (inliner->callees[i].lowered)
+            ir_deinit(&inliner->callees[i].ir);
+
+        free(inliner->callees[i].calls);
+    }
+
+    free(inliner->callees);
+    free(inliner->path);
+    free(inliner->stack);
+
+    inliner->callees = NULL;
+    inliner->ncallees = 0;
+    inliner->path = NULL;
+    inliner->stack = NULL;
+}
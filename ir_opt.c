@@ -0,0 +1,860 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "ir.h"
+
+typedef struct Pass_t {
+    const char* name;
+    void (*run)(IrFunction* function);
+} Pass;
+
+static void fold(IrFunction* function);
+static void propagate_copies(IrFunction* function);
+static void eliminate_common_subexpressions(IrFunction* function);
+static void reduce_strength(IrFunction* function);
+static void eliminate_dead_code(IrFunction* function);
+static void eliminate_dead_stores(IrFunction* function);
+
+/* dead stores leave their maps unused, so dead code runs again after them. */
+static const Pass passes[] = {
+    { "fold", fold },
+    { "copy-propagation", propagate_copies },
+    { "cse", eliminate_common_subexpressions },
+    { "copy-propagation", propagate_copies },
+    { "strength-reduction", reduce_strength },
+    { "dce", eliminate_dead_code },
+    { "dse", eliminate_dead_stores },
+    { "dce", eliminate_dead_code },
+};
+
+static void fold_binary(IrFunction* function, uint32_t id);
+static int fold_constants(IrFunction* function, char op, const Value* lhs, const Value* rhs, Value* result);
+static void make_constant(IrFunction* function, uint32_t id, Value value);
+static void remove_pred(IrFunction* function, uint32_t block, uint32_t pred);
+static int remove_trivial_phi(IrFunction* function, uint32_t phi);
+static void sweep(IrFunction* function);
+
+static int is_constant(const IrFunction* function, uint32_t value, ValueKind kind);
+static int power_of_two(int64_t value);
+
+static uint32_t* dominators(IrFunction* function, uint32_t* order, size_t norder);
+static int cse_candidate(const IrFunction* function, const IrInstr* instr);
+static int commutes(const IrFunction* function, const IrInstr* instr);
+static uint64_t cse_hash(const IrFunction* function, const IrInstr* instr);
+static int cse_equal(const IrFunction* function, const IrInstr* a, const IrInstr* b);
+
+static double now(void);
+
+kd_status ir_optimize(IrFunction* function, IrPassTime* times, size_t* ntimes, kd_error* error) {
+    function->error = error;
+    *ntimes = 0;
+
+    if (setjmp(function->bail))
+        return error->status;
+
+    if (function->functions != NULL) {
+        double start = now();
+        ir_inline(function);
+
+        times[(*ntimes)++] = (IrPassTime) {
+            .name = "inline",
+            .seconds = now() - start,
+            .ninstrs = ir_count(function),
+        };
+    }
+
+    for (size_t i = 0; i < sizeof(passes) / sizeof(passes[0]); i++) {
+        double start = now();
+        passes[i].run(function);
+
+        times[(*ntimes)++] = (IrPassTime) {
+            .name = passes[i].name,
+            .seconds = now() - start,
+            .ninstrs = ir_count(function),
+        };
+    }
+
+    return KD_OK;
+}
+
+/* constant folding and algebraic identities. a DEFINE of a value already
+ * known to have the declared type checks nothing, and a branch on a
+ * constant only ever goes one way. */
+static void fold(IrFunction* function) {
+    for (size_t b = 0; b < function->nblocks; b++) {
+        IrBlock* block = &function->blocks[b];
+
+        for (size_t i = 0; i < block->ninstrs; i++) {
+            uint32_t id = block->instrs[i];
+            IrInstr* instr = &function->instrs[id];
+
+            for (size_t a = 0; a < instr->nargs; a++)
+                instr->args[a] = ir_resolve(function, instr->args[a]);
+
+            switch (instr->op) {
+            case IR_DEFINE:
+                if (ir_same_type(&function->instrs[instr->args[0]].type, &instr->declared))
+                    ir_replace(function, id, instr->args[0]);
+                break;
+            case IR_BINARY:
+                fold_binary(function, id);
+                break;
+            case IR_LEN:
+                if (is_constant(function, instr->args[0], VAL_STRING)) {
+                    Value size = { .kind = VAL_INT, .i64 = string_size(&function->instrs[instr->args[0]].constant) };
+                    make_constant(function, id, size);
+                }
+                break;
+            default:
+                break;
+            }
+        }
+
+        if (block->exit != IR_BRANCH)
+            continue;
+
+        block->value = ir_resolve(function, block->value);
+        if (!is_constant(function, block->value, VAL_BOOL))
+            continue;
+
+        int taken = function->instrs[block->value].constant.bool ? 0 : 1;
+        uint32_t skipped = block->succs[1 - taken];
+
+        block->exit = IR_JUMP;
+        block->succs[0] = block->succs[taken];
+        block->succs[1] = IR_NONE;
+        block->value = IR_NONE;
+
+        remove_pred(function, skipped, b);
+    }
+
+    ir_remove_unreachable(function);
+}
+
+static void fold_binary(IrFunction* function, uint32_t id) {
+    IrInstr* instr = &function->instrs[id];
+    const IrInstr* lhs = &function->instrs[instr->args[0]];
+    const IrInstr* rhs = &function->instrs[instr->args[1]];
+    char op = instr->binop;
+
+    if (lhs->op == IR_CONST && rhs->op == IR_CONST) {
+        Value result;
+
+        if (fold_constants(function, op, &lhs->constant, &rhs->constant, &result))
+            make_constant(function, id, result);
+
+        return;
+    }
+
+    if (instr->type.kind == VAL_INT) {
+        /* x + 0, x - 0, x * 1 and x / 1 are x, x * 0 is 0. */
+        if (rhs->op == IR_CONST) {
+            int64_t k = rhs->constant.i64;
+
+            if (((op == '+' || op == '-') && k == 0) || ((op == '*' || op == '/') && k == 1))
+                ir_replace(function, id, instr->args[0]);
+            else if (op == '*' && k == 0)
+                make_constant(function, id, rhs->constant);
+        } else if (lhs->op == IR_CONST) {
+            int64_t k = lhs->constant.i64;
+
+            if ((op == '+' && k == 0) || (op == '*' && k == 1))
+                ir_replace(function, id, instr->args[1]);
+            else if (op == '*' && k == 0)
+                make_constant(function, id, lhs->constant);
+        }
+    } else if (instr->type.kind == VAL_DOUBLE && rhs->op == IR_CONST) {
+        /* x + 0.0 is not x when x is -0.0, x - 0.0 always is. */
+        double k = rhs->constant.f64;
+
+        if ((op == '-' && k == 0 && !signbit(k)) || ((op == '*' || op == '/') && k == 1))
+            ir_replace(function, id, instr->args[0]);
+    }
+}
+
+/* computes what the interpreter would, but never folds an operation that
+ * fails. that is left for the run to report. */
+static int fold_constants(IrFunction* function, char op, const Value* lhs, const Value* rhs, Value* result) {
+    if (lhs->kind != rhs->kind)
+        return 0;
+
+    if (op == '=' || op == '!') {
+        int equal;
+
+        switch (lhs->kind) {
+        case VAL_INT:
+            equal = lhs->i64 == rhs->i64;
+            break;
+        case VAL_DOUBLE:
+            equal = lhs->f64 == rhs->f64;
+            break;
+        case VAL_BOOL:
+            equal = lhs->bool == rhs->bool;
+            break;
+        case VAL_STRING:
+            equal = string_equals(lhs, rhs);
+            if (equal < 0)
+                return 0;
+            break;
+        default:
+            return 0;
+        }
+
+        *result = (Value) { .kind = VAL_BOOL, .bool = op == '=' ? equal : !equal };
+        return 1;
+    }
+
+    switch (lhs->kind) {
+    case VAL_INT: {
+        uint64_t a = lhs->i64;
+        uint64_t b = rhs->i64;
+
+        *result = (Value) { .kind = VAL_INT };
+
+        if (op == '+')
+            result->i64 = (int64_t)(a + b);
+        else if (op == '-')
+            result->i64 = (int64_t)(a - b);
+        else if (op == '*')
+            result->i64 = (int64_t)(a * b);
+        else if (rhs->i64 == 0)
+            return 0;
+        else if (rhs->i64 == -1)
+            result->i64 = (int64_t)(0 - a);
+        else
+            result->i64 = lhs->i64 / rhs->i64;
+
+        return 1;
+    }
+    case VAL_DOUBLE: {
+        double a = lhs->f64;
+        double b = rhs->f64;
+
+        *result = (Value) { .kind = VAL_DOUBLE };
+        result->f64 = op == '+' ? a + b : op == '-' ? a - b : op == '*' ? a * b : a / b;
+
+        return 1;
+    }
+    case VAL_STRING: {
+        if (op != '+')
+            return 0;
+
+        /* the result is a literal of the program like any other. */
+        size_t lhs_size = string_size(lhs);
+        size_t rhs_size = string_size(rhs);
+        const char* lhs_data = string_data(lhs);
+        const char* rhs_data = string_data(rhs);
+
+        if (lhs_data == NULL || rhs_data == NULL)
+            return 0;
+
+        char* data = ir_alloc(function, lhs_size + rhs_size);
+        memcpy(data, lhs_data, lhs_size);
+        memcpy(data + lhs_size, rhs_data, rhs_size);
+
+        return string_constant(function->constants, data, lhs_size + rhs_size, result);
+    }
+    default:
+        return 0;
+    }
+}
+
+static void make_constant(IrFunction* function, uint32_t id, Value value) {
+    IrInstr* instr = &function->instrs[id];
+
+    instr->op = IR_CONST;
+    instr->args = NULL;
+    instr->nargs = 0;
+    instr->constant = value;
+    instr->type = (Type) { .kind = value.kind };
+}
+
+/* the phis of block lose their operand from pred along with the edge. */
+static void remove_pred(IrFunction* function, uint32_t block, uint32_t pred) {
+    IrBlock* target = &function->blocks[block];
+
+    size_t index = 0;
+    while (target->preds[index] != pred)
+        index++;
+
+    memmove(&target->preds[index], &target->preds[index + 1], (target->npreds - index - 1) * sizeof(uint32_t));
+    target->npreds--;
+
+    for (size_t i = 0; i < target->ninstrs; i++) {
+        IrInstr* phi = &function->instrs[target->instrs[i]];
+        if (phi->op != IR_PHI)
+            break;
+
+        memmove(&phi->args[index], &phi->args[index + 1], (phi->nargs - index - 1) * sizeof(uint32_t));
+        phi->nargs--;
+    }
+}
+
+void ir_remove_unreachable(IrFunction* function) {
+    uint32_t* order = ir_alloc(function, function->nblocks * sizeof(uint32_t));
+    size_t norder = ir_reverse_postorder(function, order);
+
+    char* reachable = ir_alloc(function, function->nblocks);
+    memset(reachable, 0, function->nblocks);
+
+    for (size_t i = 0; i < norder; i++)
+        reachable[order[i]] = 1;
+
+    for (size_t b = 0; b < function->nblocks; b++) {
+        IrBlock* block = &function->blocks[b];
+        if (reachable[b] || block->dead)
+            continue;
+
+        int nsuccs = block->exit == IR_JUMP ? 1 : block->exit == IR_BRANCH ? 2 : 0;
+        for (int s = 0; s < nsuccs; s++) {
+            if (reachable[block->succs[s]])
+                remove_pred(function, block->succs[s], b);
+        }
+
+        for (size_t i = 0; i < block->ninstrs; i++)
+            function->instrs[block->instrs[i]].dead = 1;
+
+        block->ninstrs = 0;
+        block->npreds = 0;
+        block->exit = IR_HALT;
+        block->value = IR_NONE;
+        block->dead = 1;
+    }
+}
+
+/* every use of a copy is pointed at what it copies, which leaves the
+ * copies unused. phis that turn out to see a single value become copies
+ * themselves, until there are none left. */
+static void propagate_copies(IrFunction* function) {
+    int changed = 1;
+
+    while (changed) {
+        changed = 0;
+
+        for (size_t b = 0; b < function->nblocks; b++) {
+            IrBlock* block = &function->blocks[b];
+
+            for (size_t i = 0; i < block->ninstrs; i++) {
+                IrInstr* instr = &function->instrs[block->instrs[i]];
+
+                for (size_t a = 0; a < instr->nargs; a++)
+                    instr->args[a] = ir_resolve(function, instr->args[a]);
+
+                if (instr->op == IR_PHI && remove_trivial_phi(function, block->instrs[i]))
+                    changed = 1;
+            }
+
+            block->value = ir_resolve(function, block->value);
+        }
+    }
+
+    for (size_t i = 0; i < function->ninstrs; i++) {
+        if (function->instrs[i].op == IR_COPY)
+            function->instrs[i].dead = 1;
+    }
+
+    sweep(function);
+}
+
+static int remove_trivial_phi(IrFunction* function, uint32_t phi) {
+    const IrInstr* instr = &function->instrs[phi];
+    uint32_t same = IR_NONE;
+
+    for (size_t i = 0; i < instr->nargs; i++) {
+        uint32_t arg = ir_resolve(function, instr->args[i]);
+
+        if (arg == same || arg == phi)
+            continue;
+        if (same != IR_NONE)
+            return 0;
+
+        same = arg;
+    }
+
+    if (same == IR_NONE)
+        return 0;
+
+    ir_replace(function, phi, same);
+    return 1;
+}
+
+/* value numbering over the dominator tree: an instruction that computes
+ * the same as one in a dominating block, or earlier in its own, is
+ * replaced by it. only instructions whose result depends on nothing but
+ * their operands qualify, which leaves out anything that reads a map. */
+static void eliminate_common_subexpressions(IrFunction* function) {
+    size_t nblocks = function->nblocks;
+
+    uint32_t* order = ir_alloc(function, nblocks * sizeof(uint32_t));
+    size_t norder = ir_reverse_postorder(function, order);
+    uint32_t* idom = dominators(function, order, norder);
+
+    /* the dominator tree as lists of children. */
+    uint32_t* first_child = ir_alloc(function, nblocks * sizeof(uint32_t));
+    uint32_t* next_sibling = ir_alloc(function, nblocks * sizeof(uint32_t));
+
+    for (size_t b = 0; b < nblocks; b++)
+        first_child[b] = next_sibling[b] = IR_NONE;
+
+    for (size_t i = norder; i-- > 1;) {
+        uint32_t block = order[i];
+        next_sibling[block] = first_child[idom[block]];
+        first_child[idom[block]] = block;
+    }
+
+    /* a chained table whose entries are removed in the reverse order they
+     * went in, as the walk leaves the block that added them. */
+    size_t nbuckets = 64;
+    while (nbuckets < function->ninstrs * 2)
+        nbuckets *= 2;
+
+    uint32_t* buckets = ir_alloc(function, nbuckets * sizeof(uint32_t));
+    uint32_t* chain = ir_alloc(function, function->ninstrs * sizeof(uint32_t));
+    uint32_t* added = ir_alloc(function, function->ninstrs * sizeof(uint32_t));
+    size_t nadded = 0;
+
+    for (size_t i = 0; i < nbuckets; i++)
+        buckets[i] = IR_NONE;
+
+    /* a block on the stack with the number of entries before it. */
+    uint32_t* stack = ir_alloc(function, norder * sizeof(uint32_t));
+    size_t* marks = ir_alloc(function, norder * sizeof(size_t));
+    int* visited = ir_alloc(function, norder * sizeof(int));
+    size_t top = 0;
+
+    stack[top] = 0;
+    visited[top] = 0;
+    top++;
+
+    while (top > 0) {
+        uint32_t b = stack[top - 1];
+
+        if (visited[top - 1]) {
+            while (nadded > marks[top - 1]) {
+                uint32_t id = added[--nadded];
+                buckets[cse_hash(function, &function->instrs[id]) & (nbuckets - 1)] = chain[id];
+            }
+
+            top--;
+            continue;
+        }
+
+        visited[top - 1] = 1;
+        marks[top - 1] = nadded;
+
+        const IrBlock* block = &function->blocks[b];
+
+        for (size_t i = 0; i < block->ninstrs; i++) {
+            uint32_t id = block->instrs[i];
+            IrInstr* instr = &function->instrs[id];
+
+            for (size_t a = 0; a < instr->nargs; a++)
+                instr->args[a] = ir_resolve(function, instr->args[a]);
+
+            if (!cse_candidate(function, instr))
+                continue;
+
+            uint32_t* bucket = &buckets[cse_hash(function, instr) & (nbuckets - 1)];
+            uint32_t match = *bucket;
+
+            while (match != IR_NONE && !cse_equal(function, &function->instrs[match], instr))
+                match = chain[match];
+
+            if (match != IR_NONE) {
+                ir_replace(function, id, match);
+                continue;
+            }
+
+            chain[id] = *bucket;
+            *bucket = id;
+            added[nadded++] = id;
+        }
+
+        for (uint32_t child = first_child[b]; child != IR_NONE; child = next_sibling[child]) {
+            stack[top] = child;
+            visited[top] = 0;
+            top++;
+        }
+    }
+}
+
+/* x * 2^k and x / 2^k on i64 become shifts, x * 2.0 becomes x + x, and
+ * x / 2^k on f64 becomes a multiplication by the exact reciprocal. */
+static void reduce_strength(IrFunction* function) {
+    for (size_t b = 0; b < function->nblocks; b++) {
+        IrBlock* block = &function->blocks[b];
+
+        for (size_t i = 0; i < block->ninstrs; i++) {
+            uint32_t id = block->instrs[i];
+            IrInstr* instr = &function->instrs[id];
+
+            if (instr->op != IR_BINARY || (instr->binop != '*' && instr->binop != '/'))
+                continue;
+
+            uint32_t lhs = instr->args[0];
+            uint32_t rhs = instr->args[1];
+
+            if (instr->type.kind == VAL_INT) {
+                int shift = is_constant(function, rhs, VAL_INT) ? power_of_two(function->instrs[rhs].constant.i64) : 0;
+
+                /* multiplication commutes. */
+                if (shift == 0 && instr->binop == '*' && is_constant(function, lhs, VAL_INT)) {
+                    shift = power_of_two(function->instrs[lhs].constant.i64);
+                    lhs = rhs;
+                }
+
+                if (shift == 0)
+                    continue;
+
+                instr->op = instr->binop == '*' ? IR_SHL : IR_DIVPOW2;
+                instr->args[0] = lhs;
+                instr->nargs = 1;
+                instr->shift = shift;
+                continue;
+            }
+
+            if (instr->type.kind != VAL_DOUBLE || !is_constant(function, rhs, VAL_DOUBLE))
+                continue;
+
+            double k = function->instrs[rhs].constant.f64;
+            int exponent;
+
+            if (instr->binop == '*' && k == 2.0) {
+                instr->binop = '+';
+                instr->args[1] = lhs;
+            } else if (instr->binop == '/' && frexp(k, &exponent) == 0.5 && exponent > -1021 && exponent < 1024 && k != 1.0) {
+                /* k is 2^(exponent - 1), so 1 / k is exact and both round the
+                 * same quotient. */
+                uint32_t reciprocal = ir_new_instr(function, IR_CONST, 0, function->instrs[rhs].line, function->instrs[rhs].col);
+                make_constant(function, reciprocal, (Value) { .kind = VAL_DOUBLE, .f64 = ldexp(1.0, 1 - exponent) });
+                ir_insert(function, b, i, reciprocal);
+
+                i++;
+                instr = &function->instrs[id];
+                instr->binop = '*';
+                instr->args[1] = reciprocal;
+            }
+        }
+    }
+}
+
+/* removes every instruction nothing with an effect depends on. */
+static void eliminate_dead_code(IrFunction* function) {
+    char* live = ir_alloc(function, function->ninstrs);
+    memset(live, 0, function->ninstrs);
+
+    uint32_t* worklist = ir_alloc(function, function->ninstrs * sizeof(uint32_t));
+    size_t nworklist = 0;
+
+    for (size_t b = 0; b < function->nblocks; b++) {
+        const IrBlock* block = &function->blocks[b];
+
+        for (size_t i = 0; i < block->ninstrs; i++) {
+            uint32_t id = block->instrs[i];
+
+            if (!live[id] && ir_has_effect(function, &function->instrs[id])) {
+                live[id] = 1;
+                worklist[nworklist++] = id;
+            }
+        }
+
+        if (block->value != IR_NONE && !live[block->value]) {
+            live[block->value] = 1;
+            worklist[nworklist++] = block->value;
+        }
+    }
+
+    while (nworklist > 0) {
+        const IrInstr* instr = &function->instrs[worklist[--nworklist]];
+
+        for (size_t a = 0; a < instr->nargs; a++) {
+            if (!live[instr->args[a]]) {
+                live[instr->args[a]] = 1;
+                worklist[nworklist++] = instr->args[a];
+            }
+        }
+    }
+
+    for (size_t i = 0; i < function->ninstrs; i++) {
+        if (!live[i])
+            function->instrs[i].dead = 1;
+    }
+
+    sweep(function);
+}
+
+/* maps are the only thing a program writes to. a store into a map that is
+ * never read, only stored into, is dead as long as the store itself cannot
+ * fail on the kinds of its key and value. */
+static void eliminate_dead_stores(IrFunction* function) {
+    char* read = ir_alloc(function, function->ninstrs);
+    memset(read, 0, function->ninstrs);
+
+    for (size_t b = 0; b < function->nblocks; b++) {
+        const IrBlock* block = &function->blocks[b];
+
+        for (size_t i = 0; i < block->ninstrs; i++) {
+            const IrInstr* instr = &function->instrs[block->instrs[i]];
+
+            for (size_t a = 0; a < instr->nargs; a++) {
+                if (instr->op == IR_MAPSET && a == 0) {
+                    const Type* map = &function->instrs[instr->args[0]].type;
+
+                    if (function->instrs[instr->args[1]].type.kind == map->key && function->instrs[instr->args[2]].type.kind == map->value)
+                        continue;
+                }
+
+                read[instr->args[a]] = 1;
+            }
+        }
+
+        if (block->value != IR_NONE)
+            read[block->value] = 1;
+    }
+
+    for (size_t b = 0; b < function->nblocks; b++) {
+        const IrBlock* block = &function->blocks[b];
+
+        for (size_t i = 0; i < block->ninstrs; i++) {
+            IrInstr* instr = &function->instrs[block->instrs[i]];
+            uint32_t map = instr->op == IR_MAPSET ? instr->args[0] : IR_NONE;
+
+            if (map != IR_NONE && function->instrs[map].op == IR_NEWMAP && !read[map])
+                instr->dead = 1;
+        }
+    }
+
+    sweep(function);
+}
+
+/* drops the instructions marked dead from their blocks. */
+static void sweep(IrFunction* function) {
+    for (size_t b = 0; b < function->nblocks; b++) {
+        IrBlock* block = &function->blocks[b];
+        size_t kept = 0;
+
+        for (size_t i = 0; i < block->ninstrs; i++) {
+            if (!function->instrs[block->instrs[i]].dead)
+                block->instrs[kept++] = block->instrs[i];
+        }
+
+        block->ninstrs = kept;
+    }
+}
+
+static int is_constant(const IrFunction* function, uint32_t value, ValueKind kind) {
+    const IrInstr* instr = &function->instrs[value];
+    return instr->op == IR_CONST && instr->constant.kind == kind;
+}
+
+/* k when value is 2^k for k from 1 to 62, 0 otherwise. */
+static int power_of_two(int64_t value) {
+    if (value < 2 || (value & (value - 1)) != 0)
+        return 0;
+
+    int k = __builtin_ctzll((uint64_t)value);
+    return k <= 62 ? k : 0;
+}
+
+/* the immediate dominator of every reachable block, by Cooper, Harvey and
+ * Kennedy's iteration over the reverse postorder. */
+static uint32_t* dominators(IrFunction* function, uint32_t* order, size_t norder) {
+    size_t nblocks = function->nblocks;
+
+    uint32_t* idom = ir_alloc(function, nblocks * sizeof(uint32_t));
+    size_t* index = ir_alloc(function, nblocks * sizeof(size_t));
+
+    for (size_t b = 0; b < nblocks; b++)
+        idom[b] = IR_NONE;
+    for (size_t i = 0; i < norder; i++)
+        index[order[i]] = i;
+
+    idom[0] = 0;
+
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+
+        for (size_t i = 1; i < norder; i++) {
+            const IrBlock* block = &function->blocks[order[i]];
+            uint32_t dom = IR_NONE;
+
+            for (size_t p = 0; p < block->npreds; p++) {
+                uint32_t pred = block->preds[p];
+                if (idom[pred] == IR_NONE)
+                    continue;
+
+                if (dom == IR_NONE) {
+                    dom = pred;
+                    continue;
+                }
+
+                uint32_t other = pred;
+                while (dom != other) {
+                    while (index[dom] > index[other])
+                        dom = idom[dom];
+                    while (index[other] > index[dom])
+                        other = idom[other];
+                }
+            }
+
+            if (idom[order[i]] != dom) {
+                idom[order[i]] = dom;
+                changed = 1;
+            }
+        }
+    }
+
+    return idom;
+}
+
+static int cse_candidate(const IrFunction* function, const IrInstr* instr) {
+    ValueKind kind = instr->nargs > 0 ? function->instrs[instr->args[0]].type.kind : VAL_IDENT;
+
+    switch (instr->op) {
+    case IR_CONST:
+        kind = instr->constant.kind;
+        return kind == VAL_INT || kind == VAL_DOUBLE || kind == VAL_BOOL || kind == VAL_STRING;
+    case IR_BINARY:
+    case IR_SHL:
+    case IR_DIVPOW2:
+    case IR_FIELD:
+    case IR_INDEXFIELD:
+    case IR_COLUMN:
+    case IR_GLOBAL:
+    case IR_DEFINE:
+    case IR_LESS:
+        return 1;
+    case IR_LEN:
+    case IR_INDEX:
+        return kind != VAL_MAP && kind != VAL_IDENT;
+    default:
+        return 0;
+    }
+}
+
+/* numbers, and comparisons that cannot fail, are the same either way
+ * round. */
+static int commutes(const IrFunction* function, const IrInstr* instr) {
+    if (instr->op != IR_BINARY)
+        return 0;
+
+    if (instr->binop == '+' || instr->binop == '*')
+        return instr->type.kind == VAL_INT || instr->type.kind == VAL_DOUBLE;
+
+    return (instr->binop == '=' || instr->binop == '!') && !ir_has_effect(function, instr);
+}
+
+static uint64_t cse_hash(const IrFunction* function, const IrInstr* instr) {
+    uint64_t hash = instr->op * 0x9e3779b97f4a7c15ull;
+
+    if (commutes(function, instr)) {
+        hash += (uint64_t)instr->args[0] * 0xbf58476d1ce4e5b9ull + (uint64_t)instr->args[1] * 0xbf58476d1ce4e5b9ull;
+    } else {
+        for (size_t i = 0; i < instr->nargs; i++)
+            hash = (hash ^ instr->args[i]) * 0xbf58476d1ce4e5b9ull;
+    }
+
+    switch (instr->op) {
+    case IR_CONST: {
+        const Value* constant = &instr->constant;
+        uint64_t bits = 0;
+
+        if (constant->kind == VAL_STRING) {
+            const char* data = string_data(constant);
+            for (size_t i = 0; i < string_size(constant); i++)
+                bits = (bits ^ (unsigned char)data[i]) * 0x100000001b3ull;
+        } else if (constant->kind == VAL_BOOL) {
+            bits = constant->bool;
+        } else {
+            memcpy(&bits, &constant->i64, sizeof(bits));
+        }
+
+        hash = (hash ^ constant->kind ^ bits) * 0xbf58476d1ce4e5b9ull;
+        break;
+    }
+    case IR_BINARY:
+        hash ^= (uint64_t)instr->binop;
+        break;
+    case IR_SHL:
+    case IR_DIVPOW2:
+        hash ^= (uint64_t)instr->shift;
+        break;
+    case IR_FIELD:
+    case IR_INDEXFIELD:
+    case IR_COLUMN:
+        hash ^= (uint64_t)(uintptr_t)instr->field;
+        break;
+    case IR_GLOBAL:
+        hash ^= (uint64_t)instr->global;
+        break;
+    case IR_DEFINE:
+        hash ^= (uint64_t)instr->declared.kind;
+        break;
+    default:
+        break;
+    }
+
+    return hash ^ hash >> 29;
+}
+
+static int cse_equal(const IrFunction* function, const IrInstr* a, const IrInstr* b) {
+    if (a->op != b->op || a->nargs != b->nargs)
+        return 0;
+
+    switch (a->op) {
+    case IR_CONST:
+        /* doubles by their bits, so 0.0 and -0.0 stay apart. */
+        if (a->constant.kind != b->constant.kind)
+            return 0;
+        if (a->constant.kind == VAL_STRING)
+            return string_equals(&a->constant, &b->constant);
+        if (a->constant.kind == VAL_BOOL)
+            return a->constant.bool == b->constant.bool;
+        return memcmp(&a->constant.i64, &b->constant.i64, sizeof(int64_t)) == 0;
+    case IR_BINARY:
+        if (a->binop != b->binop)
+            return 0;
+        break;
+    case IR_SHL:
+    case IR_DIVPOW2:
+        if (a->shift != b->shift)
+            return 0;
+        break;
+    case IR_FIELD:
+    case IR_INDEXFIELD:
+    case IR_COLUMN:
+        if (a->field != b->field)
+            return 0;
+        break;
+    case IR_GLOBAL:
+        if (a->global != b->global)
+            return 0;
+        break;
+    case IR_DEFINE:
+        if (!ir_same_type(&a->declared, &b->declared))
+            return 0;
+        break;
+    default:
+        break;
+    }
+
+    if (commutes(function, a) && a->args[0] == b->args[1] && a->args[1] == b->args[0])
+        return 1;
+
+    for (size_t i = 0; i < a->nargs; i++) {
+        if (a->args[i] != b->args[i])
+            return 0;
+    }
+
+    return 1;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
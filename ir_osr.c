@@ -0,0 +1,248 @@
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+
+#include "ir.h"
+
+/* on-stack replacement: the chunk of the optimized tier that a run of the
+ * first tier moves over to in the middle of a loop, see tier.h.
+ *
+ * the function is lowered again from the same tree, which gives every
+ * value and block the number it had in the first tier. a new entry takes
+ * the place of the block the loop was entered from, with a parameter for
+ * every value the first tier had in a register there, and the code before
+ * the loop, which has run already, cannot be reached anymore. */
+typedef struct Osr_t {
+    IrFunction* function;
+
+    /* by value from before the loop, what stands for it now, IR_NONE when
+     * that is not known yet. */
+    uint32_t* entered;
+} Osr;
+
+static void osr_error(IrFunction* function, const char* message);
+static uint32_t outside_pred(IrFunction* function, uint32_t header);
+static void make_entry(IrFunction* function, uint32_t block);
+static uint32_t enter_value(Osr* osr, uint32_t value);
+
+kd_status ir_enter_loop(IrFunction* function, uint32_t header, const uint32_t* values, size_t nvalues, kd_error* error) {
+    function->error = error;
+
+    if (setjmp(function->bail))
+        return error->status;
+
+    if (header >= function->nblocks)
+        osr_error(function, "the loop is not in this function");
+
+    IrBlock* start = &function->blocks[header];
+
+    size_t nphis = 0;
+    while (nphis < start->ninstrs && function->instrs[start->instrs[nphis]].op == IR_PHI)
+        nphis++;
+
+    if (nvalues < nphis)
+        osr_error(function, "the loop is not in this function");
+
+    for (size_t i = 0; i < nvalues; i++) {
+        if (values[i] >= function->ninstrs)
+            osr_error(function, "the loop is not in this function");
+    }
+
+    for (size_t i = 0; i < nphis; i++) {
+        if (values[i] != start->instrs[i])
+            osr_error(function, "the loop is not in this function");
+    }
+
+    uint32_t pred = outside_pred(function, header);
+
+    Osr osr = {
+        .function = function,
+        .entered = ir_alloc(function, function->ninstrs * sizeof(uint32_t)),
+    };
+
+    for (size_t i = 0; i < function->ninstrs; i++)
+        osr.entered[i] = IR_NONE;
+
+    uint32_t entry = ir_new_block(function);
+    IrBlock* block = &function->blocks[entry];
+    start = &function->blocks[header];
+
+    block->exit = IR_JUMP;
+    block->succs[0] = header;
+    block->line = start->line;
+    block->col = start->col;
+    block->sealed = 1;
+
+    uint32_t* params = ir_alloc(function, (nvalues + 1) * sizeof(uint32_t));
+
+    for (size_t i = 0; i < nvalues; i++) {
+        const IrInstr* value = &function->instrs[values[i]];
+        uint32_t param = ir_new_instr(function, IR_PARAM, 0, value->line, value->col);
+
+        function->instrs[param].param = i;
+        function->instrs[param].type = function->instrs[values[i]].type;
+        ir_insert(function, entry, function->blocks[entry].ninstrs, param);
+
+        params[i] = param;
+    }
+
+    /* the entry stands in for the block before the loop as a pred, and
+     * brings the phis their values from the run so far. */
+    size_t index = 0;
+    while (start->preds[index] != pred)
+        index++;
+
+    start->preds[index] = entry;
+
+    for (size_t i = 0; i < nphis; i++)
+        function->instrs[start->instrs[i]].args[index] = params[i];
+
+    IrBlock* before = &function->blocks[pred];
+    before->exit = IR_HALT;
+    before->value = IR_NONE;
+    before->succs[0] = IR_NONE;
+    before->succs[1] = IR_NONE;
+
+    make_entry(function, entry);
+    ir_remove_unreachable(function);
+
+    /* a value live at the loop is either one of its phis or defined before
+     * it. one defined in a block still reached is from around an outer
+     * loop, which would be read before the entry defines it. */
+    for (size_t i = nphis; i < nvalues; i++) {
+        if (!function->instrs[values[i]].dead)
+            osr_error(function, "the loop is nested in another");
+
+        osr.entered[values[i]] = params[i];
+    }
+
+    for (size_t b = 0; b < function->nblocks; b++) {
+        IrBlock* current = &function->blocks[b];
+        if (current->dead)
+            continue;
+
+        for (size_t i = 0; i < current->ninstrs; i++) {
+            IrInstr* instr = &function->instrs[current->instrs[i]];
+
+            for (size_t a = 0; a < instr->nargs; a++) {
+                if (function->instrs[instr->args[a]].dead)
+                    instr->args[a] = enter_value(&osr, instr->args[a]);
+            }
+        }
+
+        if (current->value != IR_NONE && function->instrs[current->value].dead)
+            current->value = enter_value(&osr, current->value);
+    }
+
+    return KD_OK;
+}
+
+static void osr_error(IrFunction* function, const char* message) {
+    function->error->status = KD_ERROR_SYNTAX;
+    function->error->line = 0;
+    function->error->col = 0;
+    snprintf(function->error->message, sizeof(function->error->message), "%s", message);
+
+    longjmp(function->bail, 1);
+}
+
+/* the one pred of header the loop cannot reach again. */
+static uint32_t outside_pred(IrFunction* function, uint32_t header) {
+    size_t nblocks = function->nblocks;
+
+    uint32_t* stack = ir_alloc(function, nblocks * sizeof(uint32_t));
+    char* seen = ir_alloc(function, nblocks);
+    memset(seen, 0, nblocks);
+
+    size_t top = 0;
+    stack[top++] = header;
+    seen[header] = 1;
+
+    while (top > 0) {
+        const IrBlock* block = &function->blocks[stack[--top]];
+        int nsuccs = block->exit == IR_JUMP ? 1 : block->exit == IR_BRANCH ? 2 : 0;
+
+        for (int s = 0; s < nsuccs; s++) {
+            if (!seen[block->succs[s]]) {
+                seen[block->succs[s]] = 1;
+                stack[top++] = block->succs[s];
+            }
+        }
+    }
+
+    const IrBlock* start = &function->blocks[header];
+    uint32_t pred = IR_NONE;
+
+    for (size_t p = 0; p < start->npreds; p++) {
+        if (seen[start->preds[p]])
+            continue;
+
+        if (pred != IR_NONE)
+            osr_error(function, "the loop has more than one way in");
+
+        pred = start->preds[p];
+    }
+
+    /* every way in comes around an outer loop. */
+    if (pred == IR_NONE)
+        osr_error(function, "the loop is nested in another");
+
+    return pred;
+}
+
+/* block trades its number with block 0, the entry. */
+static void make_entry(IrFunction* function, uint32_t block) {
+    IrBlock entry = function->blocks[block];
+    function->blocks[block] = function->blocks[0];
+    function->blocks[0] = entry;
+
+#define RENAME(id) ((id) == 0 ? block : (id) == block ? 0 : (id))
+
+    for (size_t b = 0; b < function->nblocks; b++) {
+        IrBlock* current = &function->blocks[b];
+
+        for (size_t p = 0; p < current->npreds; p++)
+            current->preds[p] = RENAME(current->preds[p]);
+
+        int nsuccs = current->exit == IR_JUMP ? 1 : current->exit == IR_BRANCH ? 2 : 0;
+        for (int s = 0; s < nsuccs; s++)
+            current->succs[s] = RENAME(current->succs[s]);
+    }
+
+    for (size_t i = 0; i < function->ninstrs; i++) {
+        if (function->instrs[i].block != IR_NONE)
+            function->instrs[i].block = RENAME(function->instrs[i].block);
+    }
+
+#undef RENAME
+}
+
+/* a use of value, which was defined before the loop. copies and checked
+ * values stand for what they copy or check, whose check has passed in the
+ * first tier already, and a constant moves to the entry. */
+static uint32_t enter_value(Osr* osr, uint32_t value) {
+    IrFunction* function = osr->function;
+
+    if (osr->entered[value] != IR_NONE)
+        return osr->entered[value];
+
+    IrInstr* instr = &function->instrs[value];
+    uint32_t result = IR_NONE;
+
+    switch (instr->op) {
+    case IR_COPY:
+    case IR_DEFINE:
+        result = enter_value(osr, instr->args[0]);
+        break;
+    case IR_CONST:
+        instr->dead = 0;
+        ir_insert(function, 0, function->blocks[0].ninstrs, value);
+        result = value;
+        break;
+    default:
+        osr_error(function, "the loop reads a value from before it that is not live there");
+    }
+
+    osr->entered[value] = result;
+    return result;
+}
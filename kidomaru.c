@@ -0,0 +1,858 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "kidomaru.h"
+#include "program.h"
+#include "lexer.h"
+#include "parser.h"
+#include "resolver.h"
+#include "compiler.h"
+#include "ir.h"
+#include "onepass.h"
+#include "module.h"
+#include "tier.h"
+#include "stats.h"
+
+static const char* status_stringified[] = {
+    "ok",
+    "suspended",
+    "out of memory",
+    "syntax error",
+    "runtime error",
+};
+
+static const kd_compile_options default_options = {
+    .optimize = 1,
+    .inline_calls = 1,
+    .dedup = 1,
+    .one_pass = 0,
+    .eager = 0,
+    .auto_parallel = 0,
+    .tiered = 0,
+    .tier_calls = 0,
+    .tier_loops = 0,
+    .trace_tiers = NULL,
+    .dump_ir = NULL,
+    .time_passes = NULL,
+    .modules = NULL,
+    .path = NULL,
+};
+
+static void set_error(kd_error* error, kd_status status, const char* message);
+static kd_status compile(kd_program* program, const char* source, size_t len, size_t line, size_t col,
+    Globals* globals, const kd_compile_options* options, kd_error* error);
+static kd_status compile_direct(kd_program* program, Parser* parser, const kd_compile_options* options, kd_error* error);
+static kd_status compile_ir(kd_program* program, size_t root_nslots, Globals* globals, const IrPassTime* parse, size_t nexprs,
+    const kd_compile_options* options, kd_error* error);
+static kd_status compile_tasks(kd_program* program, const IrFunction* function, size_t root_nslots, const kd_compile_options* options, kd_error* error);
+static kd_status compile_parfors(Arena* arena, const IrFunction* function, Chunk* chunk, Functions* functions,
+    const kd_compile_options* options, kd_error* error);
+static kd_status link_functions(kd_program* program, Globals* globals, const kd_compile_options* options, kd_error* error);
+static kd_status load_imports(kd_program* program, Globals* globals, const kd_compile_options* options, kd_error* error);
+static double now(void);
+
+kd_program* kd_compile(const char* source, size_t len, kd_error* error) {
+    return kd_compile_with(source, len, NULL, error);
+}
+
+kd_program* kd_compile_with(const char* source, size_t len, const kd_compile_options* options, kd_error* error) {
+    kd_error local_error;
+    if (error == NULL)
+        error = &local_error;
+
+    kd_program* program = malloc(sizeof(kd_program));
+    if (program == NULL) {
+        set_error(error, KD_ERROR_NOMEM, "cannot allocate memory!");
+        return NULL;
+    }
+
+    program_init(program);
+
+    if (program_compile(program, source, len, options, error) != KD_OK) {
+        kd_program_free(program);
+        return NULL;
+    }
+
+    return program;
+}
+
+void program_init(kd_program* program) {
+    program->arena = arena_init();
+    program->source = NULL;
+    program->root = NULL;
+
+    functions_init(&program->functions, &program->arena, &default_options);
+}
+
+void program_deinit(kd_program* program) {
+    functions_deinit(&program->functions);
+    arena_deinit(&program->arena);
+}
+
+kd_status program_compile(kd_program* program, const char* source, size_t len, const kd_compile_options* options, kd_error* error) {
+    return compile(program, source, len, 1, 1, NULL, options, error);
+}
+
+kd_status program_compile_global(kd_program* program, const char* source, size_t len, size_t line, size_t col,
+    Globals* globals, const kd_compile_options* options, kd_error* error) {
+    return compile(program, source, len, line, col, globals, options, error);
+}
+
+/* the root of a stream's statement is the statement, and what it reads or
+ * declares at the top level is in globals. */
+static kd_status compile(kd_program* program, const char* source, size_t len, size_t line, size_t col,
+    Globals* globals, const kd_compile_options* options, kd_error* error) {
+    if (options == NULL)
+        options = &default_options;
+
+    program->source = NULL;
+    program->root = NULL;
+    functions_deinit(&program->functions);
+    functions_init(&program->functions, &program->arena, options);
+
+    char* copy = arena_alloc(&program->arena, len + 1);
+    if (copy == NULL) {
+        set_error(error, KD_ERROR_NOMEM, "cannot allocate memory!");
+        return error->status;
+    }
+
+    memcpy(copy, source, len);
+    copy[len] = 0;
+    program->source = copy;
+
+    Lexer lexer = lexer_init(program->source);
+    lexer.line = line;
+    lexer.col = col;
+
+    Parser parser = parser_init(&lexer, &program->arena, error);
+    parser.dedup = options->dedup;
+
+    if (options->one_pass && globals == NULL)
+        return compile_direct(program, &parser, options, error);
+
+    double start = now();
+
+    if (setjmp(parser.bail)) {
+        parser_deinit(&parser);
+        return error->status;
+    }
+
+    program->root = parse_statement(&parser);
+
+    /* the count column of the parse row is of expression nodes. */
+    IrPassTime parse = { .name = "parse", .seconds = now() - start, .ninstrs = parser.nnodes };
+    size_t nexprs = parser.nexprs;
+
+    parser_deinit(&parser);
+
+    if (parser.current.kind != TOK_EOF) {
+        set_error(error, KD_ERROR_SYNTAX, globals != NULL ? "expected the statement to end here" : "expected end of file after the root statement");
+        error->line = parser.current.line;
+        error->col = parser.current.col;
+
+        return error->status;
+    }
+
+    if (load_imports(program, globals, options, error) != KD_OK)
+        return error->status;
+
+    size_t root_nslots;
+    kd_status status = globals != NULL ? resolve_global(program->root, globals, &root_nslots, error)
+        : resolve_program(program->root, &program->functions, &root_nslots, error);
+
+    if (status != KD_OK)
+        return error->status;
+
+    if (compile_ir(program, root_nslots, globals, &parse, nexprs, options, error) != KD_OK)
+        return error->status;
+
+    if (link_functions(program, globals, options, error) != KD_OK)
+        return error->status;
+
+    /* what the run prints is written with write(2), a stream runs each
+     * statement right after its dump. */
+    if (options->dump_ir != NULL)
+        fflush(options->dump_ir);
+
+    set_error(error, KD_OK, "");
+    return KD_OK;
+}
+
+/* the imports the root block starts with, or the statement of a stream
+ * when it is one. the resolver rejects any other. */
+static kd_status load_imports(kd_program* program, Globals* globals, const kd_compile_options* options, kd_error* error) {
+    Statement* root = program->root;
+
+    if (globals != NULL) {
+        if (root->kind != STATEMENT_IMPORT)
+            return KD_OK;
+
+        Import* import = &root->import;
+        return modules_import(options->modules, options->path, &import, 1, &globals->functions, error);
+    }
+
+    if (root->kind != STATEMENT_BLOCK)
+        return KD_OK;
+
+    size_t n = 0;
+
+    for (BlockStatement* node = root->blockstatement; node != NULL && node->statement->kind == STATEMENT_IMPORT; node = node->next)
+        n++;
+
+    if (n == 0)
+        return KD_OK;
+
+    Import** imports = arena_alloc(&program->arena, n * sizeof(Import*));
+    if (imports == NULL) {
+        set_error(error, KD_ERROR_NOMEM, "cannot allocate memory!");
+        return error->status;
+    }
+
+    n = 0;
+
+    for (BlockStatement* node = root->blockstatement; node != NULL && node->statement->kind == STATEMENT_IMPORT; node = node->next)
+        imports[n++] = &node->statement->import;
+
+    return modules_import(options->modules, options->path, imports, n, &program->functions, error);
+}
+
+static kd_status link_functions(kd_program* program, Globals* globals, const kd_compile_options* options, kd_error* error) {
+    Functions* functions = globals != NULL ? &globals->functions : &program->functions;
+
+    functions->options = *options;
+
+    if (globals != NULL)
+        functions->options.one_pass = 0;
+
+    program->chunk.functions = functions;
+
+    if (!options->eager)
+        return KD_OK;
+
+    for (size_t i = 0; i < functions->count; i++) {
+        if (function_chunk(functions->items[i], error) == NULL)
+            return error->status;
+    }
+
+    return KD_OK;
+}
+
+/* the body is parsed from its text now, unless a caller inlining it did
+ * already, with the table's arena for its tree, its string literals and its
+ * chunk. */
+kd_status program_compile_function(Function* function, Chunk* chunk, kd_error* error) {
+    Functions* table = function->table;
+    const kd_compile_options* options = &table->options;
+
+    if (options->one_pass) {
+        Lexer lexer = lexer_init(function->body.data);
+        lexer.line = function->body_line;
+        lexer.col = function->body_col;
+
+        Parser parser = parser_init(&lexer, table->arena, error);
+        parser.dedup = options->dedup;
+        parser.constants = table->arena;
+
+        kd_status status = compile_one_pass_function(&parser, function, table->arena, chunk);
+        parser_deinit(&parser);
+
+        if (status != KD_OK)
+            return status;
+
+        chunk->functions = table;
+        return KD_OK;
+    }
+
+    /* a specialized copy is its generic function with some parameters
+     * made constants. */
+    Function* source = function->generic != NULL ? function->generic : function;
+
+    const Statement* body = program_function_body(source, error);
+    if (body == NULL)
+        return error->status;
+
+    IrFunction ir = ir_init(table->arena);
+    ir.functions = !options->inline_calls ? NULL : table;
+
+    /* the first tier goes without passes, see tier.h. */
+    int tiered = options->tiered && options->optimize;
+    ir.record_loops = tiered;
+
+    int64_t started = stats_start();
+
+    if (ir_lower_function(&ir, source, function->bound, body, error) != KD_OK) {
+        ir_deinit(&ir);
+        return error->status;
+    }
+
+    stats_stop(KD_PHASE_LOWER, started);
+
+    if (options->optimize && !tiered) {
+        IrPassTime times[IR_MAX_PASSES];
+        size_t ntimes = 0;
+        started = stats_start();
+
+        if (ir_optimize(&ir, times, &ntimes, error) != KD_OK) {
+            ir_deinit(&ir);
+            return error->status;
+        }
+
+        stats_stop(KD_PHASE_OPTIMIZE, started);
+    }
+
+    if (options->dump_ir != NULL) {
+        fprintf(options->dump_ir, "fn %.*s", (int)function->name.size, function->name.data);
+
+        for (size_t i = 0; function->bound != NULL && i < source->nparams; i++) {
+            const Value* value = &function->bound[i];
+            fprintf(options->dump_ir, i == 0 ? "(" : ", ");
+
+            if (value->kind == VAL_INT)
+                fprintf(options->dump_ir, "%lld", (long long)value->i64);
+            else if (value->kind == VAL_DOUBLE)
+                fprintf(options->dump_ir, "%g", value->f64);
+            else if (value->kind == VAL_BOOL)
+                fprintf(options->dump_ir, "%s", value->bool ? "true" : "false");
+            else
+                fprintf(options->dump_ir, "_");
+        }
+
+        fprintf(options->dump_ir, "%s:\n", function->bound != NULL ? ")" : "");
+        ir_dump(&ir, options->dump_ir);
+        fflush(options->dump_ir);
+    }
+
+    if (compile_program(table->arena, &ir, chunk, error) != KD_OK
+        || compile_parfors(table->arena, &ir, chunk, table, options, error) != KD_OK) {
+        ir_deinit(&ir);
+        return error->status;
+    }
+
+    ir_deinit(&ir);
+
+    /* a parameter nothing reads still takes its register. */
+    if (chunk->nregisters < function->nparams)
+        chunk->nregisters = function->nparams;
+
+    chunk->functions = table;
+
+    if (tiered && !tier_attach(chunk, function, NULL, 0, table, options)) {
+        set_error(error, KD_ERROR_NOMEM, "cannot allocate memory!");
+        return error->status;
+    }
+
+    return KD_OK;
+}
+
+/* lowered again from the tree the first tier was compiled from, which
+ * gives every value the number it had there. */
+kd_status program_compile_tier(Tier* tier, const ChunkLoop* loop, Chunk* chunk, kd_error* error) {
+    Functions* table = tier->functions;
+    const kd_compile_options* options = &table->options;
+    Function* function = tier->function;
+
+    IrFunction ir = ir_init(table->arena);
+    ir.functions = !options->inline_calls ? NULL : table;
+
+    int64_t started = stats_start();
+    kd_status status;
+    size_t nparams = 0;
+
+    if (function == NULL) {
+        status = ir_lower(&ir, tier->root, tier->root_nslots, NULL, options->auto_parallel, error);
+    } else {
+        Function* source = function->generic != NULL ? function->generic : function;
+        const Statement* body = program_function_body(source, error);
+
+        status = body != NULL ? ir_lower_function(&ir, source, function->bound, body, error) : error->status;
+        nparams = function->nparams;
+    }
+
+    if (status == KD_OK && loop != NULL) {
+        status = ir_enter_loop(&ir, loop->header, loop->values, loop->nvalues, error);
+        nparams = loop->nvalues;
+    }
+
+    stats_stop(KD_PHASE_LOWER, started);
+
+    if (status == KD_OK) {
+        IrPassTime times[IR_MAX_PASSES];
+        size_t ntimes = 0;
+
+        started = stats_start();
+        status = ir_optimize(&ir, times, &ntimes, error);
+        stats_stop(KD_PHASE_OPTIMIZE, started);
+    }
+
+    if (status == KD_OK)
+        status = compile_program(table->arena, &ir, chunk, error);
+
+    ir_deinit(&ir);
+
+    if (status != KD_OK)
+        return status;
+
+    if (chunk->nregisters < nparams)
+        chunk->nregisters = nparams;
+
+    /* the par fors were compiled with every pass for the first tier
+     * already. */
+    chunk->parfors = tier->chunk->parfors;
+    chunk->nparfors = tier->chunk->nparfors;
+    chunk->functions = table;
+
+    return KD_OK;
+}
+
+const Statement* program_function_body(Function* function, kd_error* error) {
+    if (function->tree != NULL)
+        return function->tree;
+
+    Functions* table = function->table;
+
+    Lexer lexer = lexer_init(function->body.data);
+    lexer.line = function->body_line;
+    lexer.col = function->body_col;
+
+    Parser parser = parser_init(&lexer, table->arena, error);
+    parser.dedup = table->options.dedup;
+    parser.constants = table->arena;
+
+    if (setjmp(parser.bail)) {
+        parser_deinit(&parser);
+        return NULL;
+    }
+
+    Statement* body = parse_statement(&parser);
+    parser_deinit(&parser);
+
+    size_t root_nslots;
+    if (resolve_function(function, body, &root_nslots, error) != KD_OK)
+        return NULL;
+
+    function->tree = body;
+    return body;
+}
+
+/* no tree is built, the chunk is emitted as the tokens are read. */
+static kd_status compile_direct(kd_program* program, Parser* parser, const kd_compile_options* options, kd_error* error) {
+    double start = now();
+
+    kd_status status = compile_one_pass(parser, &program->functions, options, &program->arena, &program->chunk);
+    double seconds = now() - start;
+
+    parser_deinit(parser);
+
+    if (status != KD_OK)
+        return status;
+
+    if (parser->current.kind != TOK_EOF) {
+        set_error(error, KD_ERROR_SYNTAX, "expected end of file after the root statement");
+        error->line = parser->current.line;
+        error->col = parser->current.col;
+
+        return error->status;
+    }
+
+    if (options->time_passes != NULL) {
+        fprintf(options->time_passes, "%-20s %12s %10s\n", "pass", "time (us)", "instrs");
+        fprintf(options->time_passes, "%-20s %12.1f %10zu\n", "one-pass", seconds * 1e6, program->chunk.size);
+        fprintf(options->time_passes, "%-20s %12.1f %10zu bytecode instructions\n", "total", seconds * 1e6, program->chunk.size);
+    }
+
+    if (link_functions(program, NULL, options, error) != KD_OK)
+        return error->status;
+
+    set_error(error, KD_OK, "");
+    return KD_OK;
+}
+
+/* the resolved tree goes through ssa form on its way to bytecode. */
+static kd_status compile_ir(kd_program* program, size_t root_nslots, Globals* globals, const IrPassTime* parse, size_t nexprs,
+    const kd_compile_options* options, kd_error* error) {
+    Functions* functions = globals != NULL ? &globals->functions : &program->functions;
+
+    IrFunction function = ir_init(&program->arena);
+    function.functions = !options->inline_calls ? NULL : functions;
+
+    IrPassTime times[IR_MAX_PASSES + 5];
+    size_t ntimes = 0;
+
+    times[ntimes++] = *parse;
+
+    double start = now();
+    int64_t started = stats_start();
+
+    if (ir_lower(&function, program->root, root_nslots, globals, options->auto_parallel, error) != KD_OK) {
+        ir_deinit(&function);
+        return error->status;
+    }
+
+    times[ntimes++] = (IrPassTime) { .name = "lower", .seconds = now() - start, .ninstrs = ir_count(&function) };
+    stats_stop(KD_PHASE_LOWER, started);
+
+    /* the first tier goes without passes, see tier.h. tasks are compiled
+     * with every pass before the root is run at all. */
+    int tiered = options->tiered && options->optimize && globals == NULL && function.ntasks == 0;
+    function.record_loops = tiered;
+
+    if (options->optimize && !tiered) {
+        size_t npasses = 0;
+        started = stats_start();
+
+        if (ir_optimize(&function, times + ntimes, &npasses, error) != KD_OK) {
+            ir_deinit(&function);
+            return error->status;
+        }
+
+        ntimes += npasses;
+        stats_stop(KD_PHASE_OPTIMIZE, started);
+    }
+
+    if (options->dump_ir != NULL)
+        ir_dump(&function, options->dump_ir);
+
+    size_t ninstrs = ir_count(&function);
+    start = now();
+
+    if (compile_program(&program->arena, &function, &program->chunk, error) != KD_OK) {
+        ir_deinit(&function);
+        return error->status;
+    }
+
+    times[ntimes++] = (IrPassTime) { .name = "codegen", .seconds = now() - start, .ninstrs = ninstrs };
+
+    if (function.ntasks > 0) {
+        start = now();
+
+        if (compile_tasks(program, &function, root_nslots, options, error) != KD_OK) {
+            ir_deinit(&function);
+            return error->status;
+        }
+
+        times[ntimes++] = (IrPassTime) { .name = "tasks", .seconds = now() - start, .ninstrs = function.ntasks };
+    }
+
+    if (function.nparfors > 0) {
+        start = now();
+
+        if (compile_parfors(&program->arena, &function, &program->chunk, functions, options, error) != KD_OK) {
+            ir_deinit(&function);
+            return error->status;
+        }
+
+        times[ntimes++] = (IrPassTime) { .name = "parfors", .seconds = now() - start, .ninstrs = function.nparfors };
+    }
+
+    if (tiered && !tier_attach(&program->chunk, NULL, program->root, root_nslots, functions, options)) {
+        ir_deinit(&function);
+        set_error(error, KD_ERROR_NOMEM, "cannot allocate memory!");
+        return error->status;
+    }
+
+    if (options->time_passes != NULL) {
+        double total = 0;
+
+        fprintf(options->time_passes, "%-20s %12s %10s\n", "pass", "time (us)", "instrs");
+        for (size_t i = 0; i < ntimes; i++) {
+            fprintf(options->time_passes, "%-20s %12.1f %10zu\n", times[i].name, times[i].seconds * 1e6, times[i].ninstrs);
+            total += times[i].seconds;
+        }
+        fprintf(options->time_passes, "%-20s %12.1f %10zu bytecode instructions\n", "total", total * 1e6, program->chunk.size);
+        fprintf(options->time_passes, "%zu expression nodes for %zu expressions, deduplication %s\n", parse->ninstrs, nexprs, options->dedup ? "on" : "off");
+    }
+
+    ir_deinit(&function);
+    return KD_OK;
+}
+
+/* every task is lowered, optimized and compiled on its own, into a chunk
+ * calling into the functions of the program. the count column of its row
+ * in time_passes is of tasks. */
+static kd_status compile_tasks(kd_program* program, const IrFunction* function, size_t root_nslots, const kd_compile_options* options, kd_error* error) {
+    Arena* arena = &program->arena;
+    size_t ntasks = function->ntasks;
+
+    ChunkTask* tasks = arena_alloc(arena, ntasks * sizeof(ChunkTask));
+    uint16_t** dependents = arena_alloc(arena, ntasks * sizeof(uint16_t*));
+    size_t* ndependents = arena_alloc(arena, ntasks * sizeof(size_t));
+
+    if (tasks == NULL || dependents == NULL || ndependents == NULL) {
+        set_error(error, KD_ERROR_NOMEM, "cannot allocate memory!");
+        return error->status;
+    }
+
+    memset(ndependents, 0, ntasks * sizeof(size_t));
+
+    for (size_t i = 0; i < ntasks; i++) {
+        const IrTask* task = &function->tasks[i];
+
+        Chunk* chunk = arena_alloc(arena, sizeof(Chunk));
+        uint16_t* deps = arena_alloc(arena, (task->ndeps + 1) * sizeof(uint16_t));
+
+        if (chunk == NULL || deps == NULL) {
+            set_error(error, KD_ERROR_NOMEM, "cannot allocate memory!");
+            return error->status;
+        }
+
+        IrFunction ir = ir_init(arena);
+        ir.functions = !options->inline_calls ? NULL : &program->functions;
+
+        int64_t started = stats_start();
+        kd_status status = ir_lower_task(&ir, task, program->root, root_nslots, error);
+        stats_stop(KD_PHASE_LOWER, started);
+
+        if (status == KD_OK && options->optimize) {
+            IrPassTime times[IR_MAX_PASSES];
+            size_t ntimes = 0;
+
+            started = stats_start();
+            status = ir_optimize(&ir, times, &ntimes, error);
+            stats_stop(KD_PHASE_OPTIMIZE, started);
+        }
+
+        if (status == KD_OK && options->dump_ir != NULL) {
+            fprintf(options->dump_ir, "task t%zu:\n", i);
+            ir_dump(&ir, options->dump_ir);
+        }
+
+        if (status == KD_OK)
+            status = compile_program(arena, &ir, chunk, error);
+
+        ir_deinit(&ir);
+
+        if (status != KD_OK)
+            return status;
+
+        /* a parameter nothing reads still takes its register. */
+        if (chunk->nregisters < task->nparams)
+            chunk->nregisters = task->nparams;
+
+        chunk->functions = &program->functions;
+
+        for (size_t d = 0; d < task->ndeps; d++) {
+            deps[d] = task->deps[d];
+            ndependents[task->deps[d]]++;
+        }
+
+        tasks[i] = (ChunkTask) {
+            .chunk = chunk,
+            .deps = deps,
+            .ndeps = task->ndeps,
+            .nargs = task->nparams - task->ndeps,
+        };
+    }
+
+    for (size_t i = 0; i < ntasks; i++) {
+        dependents[i] = arena_alloc(arena, (ndependents[i] + 1) * sizeof(uint16_t));
+        if (dependents[i] == NULL) {
+            set_error(error, KD_ERROR_NOMEM, "cannot allocate memory!");
+            return error->status;
+        }
+
+        tasks[i].dependents = dependents[i];
+    }
+
+    for (size_t i = 0; i < ntasks; i++) {
+        for (size_t d = 0; d < tasks[i].ndeps; d++) {
+            size_t dep = tasks[i].deps[d];
+            dependents[dep][tasks[dep].ndependents++] = i;
+        }
+    }
+
+    program->chunk.tasks = tasks;
+    program->chunk.ntasks = ntasks;
+
+    return KD_OK;
+}
+
+/* every par for of function is lowered, optimized and compiled on its own
+ * into a chunk of arena, which calls into functions as chunk does. the
+ * count column of its row in time_passes is of par fors. */
+static kd_status compile_parfors(Arena* arena, const IrFunction* function, Chunk* chunk, Functions* functions,
+    const kd_compile_options* options, kd_error* error) {
+    size_t nparfors = function->nparfors;
+
+    if (nparfors == 0)
+        return KD_OK;
+
+    ChunkParFor* parfors = arena_alloc(arena, nparfors * sizeof(ChunkParFor));
+    if (parfors == NULL) {
+        set_error(error, KD_ERROR_NOMEM, "cannot allocate memory!");
+        return error->status;
+    }
+
+    for (size_t i = 0; i < nparfors; i++) {
+        const IrParFor* parfor = &function->parfors[i];
+        const ForStatement* forstatement = &parfor->statement->forstatement;
+
+        Chunk* body = arena_alloc(arena, sizeof(Chunk));
+        if (body == NULL) {
+            set_error(error, KD_ERROR_NOMEM, "cannot allocate memory!");
+            return error->status;
+        }
+
+        IrFunction ir = ir_init(function->constants);
+        ir.functions = !options->inline_calls ? NULL : functions;
+
+        int64_t started = stats_start();
+        kd_status status = ir_lower_parfor(&ir, parfor, error);
+        stats_stop(KD_PHASE_LOWER, started);
+
+        if (status == KD_OK && options->optimize) {
+            IrPassTime times[IR_MAX_PASSES];
+            size_t ntimes = 0;
+
+            started = stats_start();
+            status = ir_optimize(&ir, times, &ntimes, error);
+            stats_stop(KD_PHASE_OPTIMIZE, started);
+        }
+
+        if (status == KD_OK && options->dump_ir != NULL) {
+            fprintf(options->dump_ir, "parfor p%zu:\n", i);
+            ir_dump(&ir, options->dump_ir);
+        }
+
+        if (status == KD_OK)
+            status = compile_program(arena, &ir, body, error);
+
+        ir_deinit(&ir);
+
+        if (status != KD_OK)
+            return status;
+
+        /* a capture nothing reads still takes its register. */
+        size_t nargs = 2 + parfor->ncaptures;
+        if (body->nregisters < nargs)
+            body->nregisters = nargs;
+
+        body->functions = functions;
+
+        parfors[i] = (ChunkParFor) {
+            .chunk = body,
+            .nargs = nargs,
+            .op = forstatement->op,
+            .kind = forstatement->result.type.kind,
+        };
+    }
+
+    chunk->parfors = parfors;
+    chunk->nparfors = nparfors;
+
+    return KD_OK;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void kd_program_free(kd_program* program) {
+    if (program == NULL)
+        return;
+
+    program_deinit(program);
+    free(program);
+}
+
+kd_context* kd_context_new(void) {
+    kd_context* context = malloc(sizeof(kd_context));
+    if (context == NULL)
+        return NULL;
+
+    set_error(&context->error, KD_OK, "");
+    context->interpreter = interpreter_init(&context->error);
+    context->interpreter.output.fd = STDOUT_FILENO;
+    context->status = KD_OK;
+
+    return context;
+}
+
+void kd_context_free(kd_context* context) {
+    if (context == NULL)
+        return;
+
+    interpreter_deinit(&context->interpreter);
+    free(context);
+}
+
+kd_status kd_run(const kd_program* program, kd_context* context) {
+    set_error(&context->error, KD_OK, "");
+
+    int64_t started = stats_start();
+    context->status = interpreter_begin(&context->interpreter, &program->chunk);
+
+    stats_add(STAT_RUNS, 1);
+    stats_stop(KD_PHASE_RUN, started);
+    return context->status;
+}
+
+kd_status kd_resume(kd_context* context) {
+    int64_t started = stats_start();
+    context->status = interpreter_resume(&context->interpreter);
+
+    stats_stop(KD_PHASE_RUN, started);
+    return context->status;
+}
+
+void kd_context_set_fuel(kd_context* context, long long fuel) {
+    context->interpreter.fuel = fuel > 0 ? fuel : 0;
+}
+
+void kd_context_set_threads(kd_context* context, size_t nthreads) {
+    context->interpreter.nthreads = nthreads;
+}
+
+void kd_context_set_output(kd_context* context, int fd) {
+    Output* output = &context->interpreter.output;
+
+    output_flush(output, 1);
+    output->fd = fd;
+}
+
+/* empties the buffer without giving back its memory. */
+const char* kd_context_take_output(kd_context* context, size_t* size) {
+    Output* output = &context->interpreter.output;
+
+    *size = output->fd < 0 ? output->size : 0;
+    if (output->fd < 0)
+        output->size = 0;
+
+    return output->data;
+}
+
+long long kd_context_fuel_used(const kd_context* context) {
+    return context->interpreter.fuel_used;
+}
+
+kd_status kd_context_status(const kd_context* context) {
+    return context->status;
+}
+
+void kd_context_quicken_stats(const kd_context* context, kd_quicken_stats* stats) {
+    *stats = context->interpreter.quicken;
+}
+
+const kd_error* kd_context_error(const kd_context* context) {
+    return &context->error;
+}
+
+long long kd_context_exit_code(const kd_context* context) {
+    return context->interpreter.exit_code;
+}
+
+const char* kd_status_string(kd_status status) {
+    return status_stringified[status];
+}
+
+static void set_error(kd_error* error, kd_status status, const char* message) {
+    error->status = status;
+    error->line = 0;
+    error->col = 0;
+    snprintf(error->message, sizeof(error->message), "%s", message);
+}
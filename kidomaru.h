@@ -0,0 +1,335 @@
+#ifndef KIDOMARU_H
+#define KIDOMARU_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+/* embedding api.
+ *
+ * a kd_program is compiled once and never modified afterwards (except for
+ * quickening, which rewrites instructions into equivalent specialised forms
+ * with single atomic stores), so a single program can be run by any number
+ * of threads at the same time. everything a
+ * run mutates lives in the kd_context passed to kd_run; a context must only
+ * be used by one thread at a time, but can be reused for any number of runs. */
+
+typedef enum kd_status {
+    KD_OK,
+    KD_SUSPENDED, /* the run used up its fuel, continue it with kd_resume. */
+    KD_ERROR_NOMEM,
+    KD_ERROR_SYNTAX,
+    KD_ERROR_RUNTIME,
+} kd_status;
+
+typedef struct kd_error {
+    kd_status status;
+
+    /* 0 when the error has no source location. */
+    size_t line;
+    size_t col;
+
+    char message[256];
+} kd_error;
+
+typedef struct kd_program kd_program;
+typedef struct kd_context kd_context;
+typedef struct kd_modules kd_modules;
+
+/* source does not need to be null terminated. returns NULL and fills error
+ * (when it is not NULL) if the source cannot be compiled. */
+kd_program* kd_compile(const char* source, size_t len, kd_error* error);
+
+typedef struct kd_compile_options {
+    /* run the ssa passes between lowering and code generation. */
+    int optimize;
+
+    /* when optimizing, substitute the bodies of small functions into their
+     * callers and specialize the ones called with constant arguments,
+     * instead of leaving every call a call. */
+    int inline_calls;
+
+    /* share one node between the copies of an expression repeated in a
+     * block, instead of parsing each into a tree of its own. */
+    int dedup;
+
+    /* compile straight from the tokens to bytecode as they are read, with
+     * no tree, no ssa form and no passes. it gets to the first instruction
+     * of a script run once sooner, at the cost of slower code. optimize,
+     * dedup and dump_ir do not apply then, and streams ignore it. */
+    int one_pass;
+
+    /* compile the body of every function along with the program, instead
+     * of the first time it is called, so that errors in bodies that never
+     * run are reported too. */
+    int eager;
+
+    /* run the lets at the top level of the program that call a function
+     * and cannot write to a map on a pool of threads, each as soon as the
+     * variables it reads are known, while the statements after it go on.
+     * a run reports the error of the first statement that fails, as it
+     * would without. a run with fuel that needs a variable still being
+     * computed returns KD_SUSPENDED instead of waiting for it. one_pass
+     * and streams ignore it. */
+    int auto_parallel;
+
+    /* compile every function body, and the root of the program, without
+     * any pass at first, and again with every pass once it turns out to be
+     * hot: a function after tier_calls calls, the root after as many runs,
+     * and either as soon as one of its loops has gone round tier_loops
+     * times, in which case the run carries on in the new code from the
+     * middle of that loop. 0 picks the defaults, and tier_loops is at most
+     * 65536. optimize has to be on, one_pass ignores it, and the root of a
+     * program with tasks or of a stream's statement is compiled with every
+     * pass from the start. */
+    int tiered;
+    size_t tier_calls;
+    size_t tier_loops;
+
+    /* when not NULL, a line for every body and loop moved to the second
+     * tier, or that could not be, is written here. */
+    FILE* trace_tiers;
+
+    /* when not NULL, the ssa form as it goes into code generation and a
+     * table of how long each pass took are written here. */
+    FILE* dump_ir;
+    FILE* time_passes;
+
+    /* where the modules the script imports are loaded and kept, NULL if it
+     * cannot import any, and the file it was read from. imports are
+     * relative to the directory of path, or to the working directory when
+     * path is NULL. */
+    kd_modules* modules;
+    const char* path;
+} kd_compile_options;
+
+/* kd_compile with options, NULL for the defaults kd_compile uses. */
+kd_program* kd_compile_with(const char* source, size_t len, const kd_compile_options* options, kd_error* error);
+void kd_program_free(kd_program* program);
+
+/* modules. `import "path";` at the top level of a script, before its other
+ * statements, makes the structs and functions declared at the top level of
+ * another file visible to it. a module holds nothing but imports, structs
+ * and functions.
+ *
+ * a kd_modules compiles every module a script imports, directly or not, the
+ * ones that do not import each other in parallel on nthreads threads, and
+ * keeps them between compiles. a module is compiled again only when its
+ * text, or a module it imports, has changed since, so compiling after an
+ * edit costs in proportion to what the edit touched, and the version it
+ * replaces is freed with the last program compiled against it. the bodies
+ * of module functions are compiled with options, NULL for the defaults. a
+ * kd_modules can be shared by compiles on any number of threads and must
+ * outlive every program and stream compiled with it. returns NULL when out
+ * of memory. */
+kd_modules* kd_modules_new(const kd_compile_options* options, size_t nthreads);
+void kd_modules_free(kd_modules* modules);
+
+typedef struct kd_module_stats {
+    size_t modules;  /* in the cache. */
+    size_t compiled; /* builds of a module, since the cache was made. */
+    size_t reused;   /* imports served by a module built before. */
+} kd_module_stats;
+
+void kd_modules_stats(kd_modules* modules, kd_module_stats* stats);
+
+/* returns NULL when out of memory. */
+kd_context* kd_context_new(void);
+void kd_context_free(kd_context* context);
+
+kd_status kd_run(const kd_program* program, kd_context* context);
+
+/* continues the run on context that last returned KD_SUSPENDED. the program
+ * it was started with has to be still alive. */
+kd_status kd_resume(kd_context* context);
+
+/* the most instructions a single kd_run or kd_resume on context executes
+ * before it returns KD_SUSPENDED, those of the chunks of a par for
+ * included. an instruction costs one more for every element of an array,
+ * or byte of a string, it goes through, and one over a whole array can
+ * suspend between blocks of its elements. 0, the default, means no
+ * limit. */
+void kd_context_set_fuel(kd_context* context, long long fuel);
+
+/* how many threads run the tasks and par fors of a run on context, from
+ * the next kd_run on. 0, the default, means one per core and 1 runs every
+ * par for in order on the calling thread. results never depend on it. */
+void kd_context_set_threads(kd_context* context, size_t nthreads);
+
+/* where print and println write on context: a file descriptor, standard
+ * output by default, or -1 to keep what runs print in the context until
+ * kd_context_take_output. output is buffered and written out in large
+ * pieces, and at the latest when kd_run or kd_resume returns. */
+void kd_context_set_output(kd_context* context, int fd);
+
+/* what the runs on context printed since the last call, when its output
+ * is kept. the bytes stay valid until the next run on context. */
+const char* kd_context_take_output(kd_context* context, size_t* size);
+
+/* instructions executed by the current (or last) run, over all its slices. */
+long long kd_context_fuel_used(const kd_context* context);
+
+/* what the last kd_run or kd_resume on context returned. */
+kd_status kd_context_status(const kd_context* context);
+
+/* how often the arithmetic instructions ran in their generic and in their
+ * quickened forms. counted over every run on the context. */
+typedef struct kd_quicken_stats {
+    long long generic;
+    long long quickened;
+
+    long long rewrites; /* generic instructions that specialised themselves. */
+    long long deopts;   /* quickened instructions that saw unexpected operands. */
+} kd_quicken_stats;
+
+void kd_context_quicken_stats(const kd_context* context, kd_quicken_stats* stats);
+
+/* the error of the last failed kd_run on this context. */
+const kd_error* kd_context_error(const kd_context* context);
+
+/* the value of a top level `return` of type i64 in the last run, 0 otherwise. */
+long long kd_context_exit_code(const kd_context* context);
+
+const char* kd_status_string(kd_status status);
+
+/* runs a script as its text arrives rather than compiling it whole. the
+ * script is the statements of the root block, the braces around them being
+ * optional, and each statement is compiled, run on the context and freed
+ * before the next one is read. memory is bounded by the largest statement
+ * instead of the length of the input, plus the variables and structs
+ * declared at the top level, which stay visible to the statements after
+ * them. a top level return ends the stream, nothing after it is read. */
+typedef struct kd_stream kd_stream;
+
+/* options as for kd_compile_with. the context runs every statement and must
+ * not be used for anything else while the stream is alive. returns NULL
+ * when out of memory. */
+kd_stream* kd_stream_new(kd_context* context, const kd_compile_options* options);
+void kd_stream_free(kd_stream* stream);
+
+/* runs every statement data completes, a statement split over several
+ * feeds runs once the feed ending it arrives. returns the status of the
+ * first statement to fail, which stops the stream, and KD_OK otherwise.
+ * with fuel set on the context, a statement that uses it up returns
+ * KD_SUSPENDED, and the input is kept but not run until kd_stream_resume
+ * has ended the statement. */
+kd_status kd_stream_feed(kd_stream* stream, const char* data, size_t len);
+
+/* the input has ended, runs whatever is left of it. it can return
+ * KD_SUSPENDED like kd_stream_feed, the stream is finished by the
+ * kd_stream_resume that ends the last statement. */
+kd_status kd_stream_finish(kd_stream* stream);
+
+/* continues the statement that returned KD_SUSPENDED, then the ones after
+ * it, with what kd_stream_feed or kd_stream_finish would have returned. */
+kd_status kd_stream_resume(kd_stream* stream);
+
+/* set once a return ran, the root block was closed or a statement failed.
+ * input fed after that is ignored. */
+int kd_stream_done(const kd_stream* stream);
+
+/* why the stream stopped, KD_OK when it has not failed. */
+const kd_error* kd_stream_error(const kd_stream* stream);
+
+/* round robin over many suspended runs on the calling thread. every run gets
+ * slice_fuel of fuel per turn, see kd_context_set_fuel, so no script can
+ * hold the thread for longer than one slice, or one block of the elements
+ * of an array, no matter what it does. */
+typedef struct kd_scheduler kd_scheduler;
+
+kd_scheduler* kd_scheduler_new(long long slice_fuel);
+void kd_scheduler_free(kd_scheduler* scheduler);
+
+/* queues a run of program on context, it starts on its first turn. the
+ * context must not be used by anything else until the run is finished.
+ * returns 0 when out of memory. */
+int kd_scheduler_spawn(kd_scheduler* scheduler, const kd_program* program, kd_context* context);
+
+/* gives the next queued run one slice. a finished run leaves the queue and
+ * its outcome is available through kd_context_status. returns how many runs
+ * are still queued. */
+size_t kd_scheduler_step(kd_scheduler* scheduler);
+
+/* steps until every run has finished. */
+void kd_scheduler_run(kd_scheduler* scheduler);
+
+/* process wide statistics for monitoring, over every compile and run on
+ * every thread since the last kd_stats_reset. nothing is counted before
+ * kd_stats_enable, and counting costs a thread no lock: each adds to
+ * counters of its own, summed when they are read. */
+typedef enum kd_stats_memory {
+    KD_MEMORY_PARSER,   /* trees and the parser's tables. */
+    KD_MEMORY_RESOLVER, /* scopes and the variables of streams. */
+    KD_MEMORY_IR,       /* ssa form, gone once compiled. */
+    KD_MEMORY_BYTECODE, /* chunks. */
+    KD_MEMORY_STRINGS,  /* strings built by runs. */
+    KD_MEMORY_COUNT,
+} kd_stats_memory;
+
+typedef enum kd_stats_phase {
+    KD_PHASE_PARSE,     /* with one_pass, the whole compile. */
+    KD_PHASE_RESOLVE,
+    KD_PHASE_LOWER,
+    KD_PHASE_OPTIMIZE,  /* including the callees inlining lowers. */
+    KD_PHASE_CODEGEN,
+    KD_PHASE_RUN,       /* kd_run and kd_resume, wall clock. */
+    KD_PHASE_COUNT,
+} kd_stats_phase;
+
+typedef struct kd_stats {
+    long long tokens;       /* read by parsers. */
+    long long nodes;        /* expression nodes parsed. */
+    long long lookups;      /* of variables, structs and functions by name. */
+    long long probes;       /* names those lookups compared. */
+    long long instructions; /* executed, on any thread. */
+    long long calls;        /* of functions of scripts. */
+    long long runs;         /* kd_runs. */
+
+    /* allocations and bytes asked for, by what asked. a piece of an arena
+     * counts as an allocation of its own, a chunk as one. */
+    long long allocations[KD_MEMORY_COUNT];
+    long long bytes[KD_MEMORY_COUNT];
+
+    double seconds[KD_PHASE_COUNT];
+} kd_stats;
+
+/* turns counting on or off, it is off until then. */
+void kd_stats_enable(int enabled);
+
+/* the counts since the last reset. threads counting while it reads may
+ * have some of what they add left for the next read. */
+void kd_stats_read(kd_stats* stats);
+void kd_stats_reset(void);
+
+const char* kd_stats_memory_name(kd_stats_memory memory);
+const char* kd_stats_phase_name(kd_stats_phase phase);
+
+/* stats as one json object, returns 0 when writing failed. */
+int kd_stats_write_json(const kd_stats* stats, FILE* file);
+
+/* a sampling profiler for the whole process. every 1/hz of a second of cpu
+ * time the process uses, SIGPROF stops the thread using it, which notes
+ * the instruction its run is at and the call of every frame around it,
+ * and a thread of the profiler counts those by stack. a run started
+ * while it is on stores every instruction where the handler finds it, one
+ * started before is only placed by its calls. nothing else in the process
+ * may use SIGPROF or ITIMER_PROF meanwhile.
+ *
+ * starting it drops the counts of the last profile. returns 0 when it is
+ * running already or cannot be started. */
+int kd_profile_start(int hz);
+
+/* stops taking samples and counts the last of them. */
+void kd_profile_stop(void);
+
+/* the samples counted, and those lost to a full ring or out of memory. */
+void kd_profile_counts(long long* samples, long long* dropped);
+
+/* the counts as collapsed stacks, as flamegraph.pl and speedscope read
+ * them: a line for each stack, the frames from the root to the one sampled
+ * separated by ';' and followed by the count. a frame is the name of the
+ * function, or root, with the line and column of the instruction running
+ * in it, name:line:col. samples taken on a thread running no script are
+ * (outside a run). returns 0 when writing failed. */
+int kd_profile_write(FILE* file);
+
+#endif /* KIDOMARU_H */
@@ -15,6 +15,7 @@ Lexer lexer_init(const char* input) {
         .input = input,
         .line = 1,
         .col = 1,
+        .error = NULL,
     };
 }
 
@@ -63,6 +64,7 @@ Token token_init(TokenKind kind, Span span, size_t line, size_t col) {
 
 Token lexer_gettok(Lexer* lexer) {
     skip_whitespaces(lexer);
+    lexer->error = NULL;
 
     const char* curr_input = lexer->input;
     size_t curr_line = lexer->line;
@@ -89,7 +91,21 @@ Token lexer_gettok(Lexer* lexer) {
         return token_init(TOK_SEMICOLON, span_from(";"), curr_line, curr_col);
     case '=':
         advance(lexer);
+
+        if (current(lexer) == '=') {
+            advance(lexer); // skip '='
+            return token_init(TOK_EQUALEQUAL, span_from("=="), curr_line, curr_col);
+        }
+
         return token_init(TOK_EQUAL, span_from("="), curr_line, curr_col);
+    case '!':
+        if (lexer->input[1] == '=') {
+            advance(lexer);
+            advance(lexer);
+            return token_init(TOK_BANGEQUAL, span_from("!="), curr_line, curr_col);
+        }
+
+        break;
     case '(':
         advance(lexer);
         return token_init(TOK_LPAREN, span_from("("), curr_line, curr_col);
@@ -102,9 +118,24 @@ Token lexer_gettok(Lexer* lexer) {
     case '}':
         advance(lexer);
         return token_init(TOK_RBRACE, span_from("}"), curr_line, curr_col);
+    case '[':
+        advance(lexer);
+        return token_init(TOK_LBRACKET, span_from("["), curr_line, curr_col);
+    case ']':
+        advance(lexer);
+        return token_init(TOK_RBRACKET, span_from("]"), curr_line, curr_col);
     case ',':
         advance(lexer);
         return token_init(TOK_COMMA, span_from(","), curr_line, curr_col);
+    case '.':
+        advance(lexer);
+
+        if (current(lexer) == '.') {
+            advance(lexer); // skip '.'
+            return token_init(TOK_DOTDOT, span_from(".."), curr_line, curr_col);
+        }
+
+        return token_init(TOK_DOT, span_from("."), curr_line, curr_col);
     case '-':
         advance(lexer);
 
@@ -164,6 +195,30 @@ Token lexer_gettok(Lexer* lexer) {
         if (span_equals(span, span_from("else")))
             return token_init(TOK_ELSE, span, curr_line, curr_col);
 
+        if (span_equals(span, span_from("map")))
+            return token_init(TOK_MAP, span, curr_line, curr_col);
+
+        if (span_equals(span, span_from("struct")))
+            return token_init(TOK_STRUCT, span, curr_line, curr_col);
+
+        if (span_equals(span, span_from("import")))
+            return token_init(TOK_IMPORT, span, curr_line, curr_col);
+
+        if (span_equals(span, span_from("for")))
+            return token_init(TOK_FOR, span, curr_line, curr_col);
+
+        if (span_equals(span, span_from("in")))
+            return token_init(TOK_IN, span, curr_line, curr_col);
+
+        if (span_equals(span, span_from("par")))
+            return token_init(TOK_PAR, span, curr_line, curr_col);
+
+        if (span_equals(span, span_from("reduce")))
+            return token_init(TOK_REDUCE, span, curr_line, curr_col);
+
+        if (span_equals(span, span_from("yield")))
+            return token_init(TOK_YIELD, span, curr_line, curr_col);
+
         return token_init(TOK_IDENTIFIER, span, curr_line, curr_col);
     }
 
@@ -176,7 +231,8 @@ Token lexer_gettok(Lexer* lexer) {
             advance(lexer);
         } while (!is_eof(lexer) && isdigit(current(lexer)));
 
-        if (current(lexer) == '.') {
+        /* the dots of a range are not a fraction. */
+        if (current(lexer) == '.' && lexer->input[1] != '.') {
             length++;
             is_double = 1;
             advance(lexer);
@@ -192,23 +248,17 @@ Token lexer_gettok(Lexer* lexer) {
         Span span = span_init(curr_input, length + mantissa);
 
         if (is_double && mantissa == 0) {
-            fprintf(stderr, "(%zu:%zu) WARNING: invalid floating point number leads to garbage token\n", curr_line, curr_col);
-            fprintf(stderr, "-> ");
-            span_print(stderr, span);
-            fprintf(stderr, "\n");
-
+            lexer->error = "invalid floating point number";
             return token_init(TOK_GARBAGE, span, curr_line, curr_col);
         }
 
+        errno = 0;
+
         if (is_double) {
             strtod(span.data, NULL);
 
             if (errno == ERANGE) {
-                fprintf(stderr, "(%zu:%zu) WARNING: floating point number too large\n", curr_line, curr_col);
-                fprintf(stderr, "-> ");
-                span_print(stderr, span);
-                fprintf(stderr, "\n");
-
+                lexer->error = "floating point number too large";
                 return token_init(TOK_GARBAGE, span, curr_line, curr_col);
             }
 
@@ -218,11 +268,7 @@ Token lexer_gettok(Lexer* lexer) {
         strtol(span.data, NULL, 10);
 
         if (errno == ERANGE) {
-            fprintf(stderr, "(%zu:%zu) WARNING: integer number too large\n", curr_line, curr_col);
-            fprintf(stderr, "-> ");
-            span_print(stderr, span);
-            fprintf(stderr, "\n");
-
+            lexer->error = "integer number too large";
             return token_init(TOK_GARBAGE, span, curr_line, curr_col);
         }
 
@@ -248,7 +294,7 @@ Token lexer_gettok(Lexer* lexer) {
                     advance(lexer);
                     break;
                 default:
-                    fprintf(stderr, "(%zu:%zu) WARNING: invalid escape character: '\\%c'\n", curr_line, curr_col, current(lexer));
+                    lexer->error = "invalid escape character";
                     length++;
                     advance(lexer);
                     break;
@@ -262,20 +308,20 @@ Token lexer_gettok(Lexer* lexer) {
         Span span = span_init(curr_input + 1, length);
 
         if (is_eof(lexer)) {
-            fprintf(stderr, "(%zu:%zu) WARNING: invalid string literal leads to garbage token\n", curr_line, curr_col);
-            fprintf(stderr, "-> ");
-            span_print(stderr, span);
-            fprintf(stderr, "\n");
-
+            lexer->error = "unterminated string literal";
             return token_init(TOK_GARBAGE, span_init(curr_input, length), curr_line, curr_col);
         }
 
         advance(lexer); // skip '"'
 
+        if (lexer->error != NULL)
+            return token_init(TOK_GARBAGE, span, curr_line, curr_col);
+
         return token_init(TOK_STRINGLITERAL, span, curr_line, curr_col);
     }
 
     size_t length = 0;
+    lexer->error = "unrecognized character";
 
     while (!is_eof(lexer) && !isspace(current(lexer))) {
         length++;
@@ -8,6 +8,9 @@ typedef struct Lexer_t {
     const char* input;
     size_t line;
     size_t col;
+
+    /* why the last token was lexed as TOK_GARBAGE. */
+    const char* error;
 } Lexer;
 
 typedef struct Span_t {
@@ -35,11 +38,21 @@ typedef enum TokenKind_t {
     TOK_RETURN,
     TOK_IF,
     TOK_ELSE,
+    TOK_MAP,
+    TOK_STRUCT,
+    TOK_IMPORT,
+    TOK_FOR,
+    TOK_IN,
+    TOK_PAR,
+    TOK_REDUCE,
+    TOK_YIELD,
 
     TOK_PLUS,
     TOK_MINUS,
     TOK_STAR,
     TOK_SLASH,
+    TOK_EQUALEQUAL,
+    TOK_BANGEQUAL,
 
     TOK_COLON,
     TOK_SEMICOLON,
@@ -48,8 +61,12 @@ typedef enum TokenKind_t {
     TOK_RPAREN,
     TOK_LBRACE,
     TOK_RBRACE,
+    TOK_LBRACKET,
+    TOK_RBRACKET,
     TOK_COMMA,
     TOK_ARROW,
+    TOK_DOT,
+    TOK_DOTDOT,
 
     TOK_GARBAGE,
 } TokenKind;
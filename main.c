@@ -1,15 +1,17 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
 
-#include "lexer.h"
-#include "parser.h"
-#include "interpreter.h"
-
-#define ERR_FILE_EMPTY (char*)0xDEADBEEF
-#define ERR_FILE_MISREAD (char*)0xBEEFDEAD /* NOTE: this error name is kinda misleading. this error will yield when num of read bytes is not equal to ftell's size. */
+#include "kidomaru.h"
+#include "file.h"
+#include "batch.h"
 
 static void usage(const char* program);
-static char* read_whole_file(const char* filepath);
+static void print_error(const kd_error* error);
+static int run_file(const char* filepath, const kd_compile_options* options, size_t nthreads);
+static int run_stream(const char* filepath, const kd_compile_options* options, size_t nthreads);
 
 int main(int argc, char** argv) {
     if (argc < 2) {
@@ -17,10 +19,127 @@ int main(int argc, char** argv) {
         return 1;
     }
 
-    const char* filepath = argv[1];
-    char* file_contents = read_whole_file(filepath);
+    if (strcmp(argv[1], "--batch") == 0) {
+        if (argc < 3) {
+            usage(argv[0]);
+            return 1;
+        }
+
+        long njobs = sysconf(_SC_NPROCESSORS_ONLN);
+
+        if (argc > 4 && strcmp(argv[3], "-j") == 0)
+            njobs = atol(argv[4]);
+
+        return batch_run(argv[2], njobs > 0 ? (size_t)njobs : 1);
+    }
+
+    kd_compile_options options = {
+        .optimize = 1,
+        .inline_calls = 1,
+        .dedup = 1,
+        .one_pass = 0,
+        .eager = 0,
+        .auto_parallel = 0,
+        .tiered = 0,
+        .tier_calls = 0,
+        .tier_loops = 0,
+        .trace_tiers = NULL,
+        .dump_ir = NULL,
+        .time_passes = NULL,
+        .modules = NULL,
+        .path = NULL,
+    };
+
+    int arg = 1;
+    int stream = 0;
+    int stats = 0;
+    int profile = 0;
+    size_t nthreads = 0;
+
+    for (; arg < argc - 1 && strncmp(argv[arg], "--", 2) == 0; arg++) {
+        if (strcmp(argv[arg], "--dump-ir") == 0) {
+            options.dump_ir = stdout;
+        } else if (strcmp(argv[arg], "--time-passes") == 0) {
+            options.time_passes = stderr;
+        } else if (strcmp(argv[arg], "--no-opt") == 0) {
+            options.optimize = 0;
+        } else if (strcmp(argv[arg], "--no-inline") == 0) {
+            options.inline_calls = 0;
+        } else if (strcmp(argv[arg], "--no-dedup") == 0) {
+            options.dedup = 0;
+        } else if (strcmp(argv[arg], "--one-pass") == 0) {
+            options.one_pass = 1;
+        } else if (strcmp(argv[arg], "--eager") == 0) {
+            options.eager = 1;
+        } else if (strcmp(argv[arg], "--auto-parallel") == 0) {
+            options.auto_parallel = 1;
+        } else if (strcmp(argv[arg], "--tiered") == 0) {
+            options.tiered = 1;
+        } else if (strncmp(argv[arg], "--tier-calls=", 13) == 0 && atol(argv[arg] + 13) > 0) {
+            options.tier_calls = atol(argv[arg] + 13);
+        } else if (strncmp(argv[arg], "--tier-loops=", 13) == 0 && atol(argv[arg] + 13) > 0) {
+            options.tier_loops = atol(argv[arg] + 13);
+        } else if (strcmp(argv[arg], "--trace-tiers") == 0) {
+            options.trace_tiers = stderr;
+        } else if (strcmp(argv[arg], "--stream") == 0) {
+            stream = 1;
+        } else if (strcmp(argv[arg], "--stats=json") == 0) {
+            stats = 1;
+        } else if (strncmp(argv[arg], "--sample-profile=", 17) == 0 && atoi(argv[arg] + 17) > 0) {
+            profile = atoi(argv[arg] + 17);
+        } else if (strncmp(argv[arg], "--threads=", 10) == 0 && atol(argv[arg] + 10) > 0) {
+            nthreads = atol(argv[arg] + 10);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    const char* filepath = argv[arg];
+    kd_stats_enable(stats);
+
+    long ncores = sysconf(_SC_NPROCESSORS_ONLN);
+
+    options.modules = kd_modules_new(&options, ncores > 0 ? (size_t)ncores : 1);
+    options.path = strcmp(filepath, "-") != 0 ? filepath : NULL;
+
+    if (options.modules == NULL) {
+        fprintf(stderr, "ERROR: cannot allocate memory!\n");
+        return 1;
+    }
 
-    if (file_contents == NULL) {
+    if (profile > 0 && !kd_profile_start(profile)) {
+        fprintf(stderr, "ERROR: cannot start the profiler!\n");
+        kd_modules_free(options.modules);
+        return 1;
+    }
+
+    int status = stream || strcmp(filepath, "-") == 0
+        ? run_stream(filepath, &options, nthreads)
+        : run_file(filepath, &options, nthreads);
+
+    kd_modules_free(options.modules);
+
+    /* on stderr, standard output is the script's. */
+    if (stats) {
+        kd_stats result;
+        kd_stats_read(&result);
+        kd_stats_write_json(&result, stderr);
+    }
+
+    if (profile > 0) {
+        kd_profile_stop();
+        kd_profile_write(stderr);
+    }
+
+    return status;
+}
+
+static int run_file(const char* filepath, const kd_compile_options* options, size_t nthreads) {
+    size_t file_size = 0;
+    char* file_contents = read_whole_file(filepath, &file_size);
+
+    if (file_contents == NULL || file_contents == ERR_FILE_MISREAD) {
         fprintf(stderr, "ERROR: cannot open '%s'!\n", filepath);
         return 1;
     } 
@@ -28,56 +147,111 @@ int main(int argc, char** argv) {
     if (file_contents == ERR_FILE_EMPTY)
         return 0;
 
-    Lexer lexer = lexer_init(file_contents);
-    Parser parser = parser_init(&lexer);
+    kd_error error;
+    kd_program* program = kd_compile_with(file_contents, file_size, options, &error);
+
+    free(file_contents);
+
+    if (program == NULL) {
+        print_error(&error);
+        return 1;
+    }
 
-    
-    Statement* root = parse_statement(&parser);
-    Interpreter interpreter = interpreter_init(root);
+    kd_context* context = kd_context_new();
+    if (context == NULL) {
+        fprintf(stderr, "ERROR: cannot allocate memory!\n");
+        kd_program_free(program);
+        return 1;
+    }
 
-    interpreter_begin(&interpreter);
-    interpreter_deinit(&interpreter);
+    kd_context_set_threads(context, nthreads);
 
-    free(file_contents);
+    /* the script prints with write(2), past whatever --dump-ir left in
+     * the buffer of stdout. */
+    fflush(stdout);
 
-    return 0;
-}
+    int status = 0;
 
-static void usage(const char* program) {
-    fprintf(stderr, "Usage: %s <file>\n", program);
-    fprintf(stderr, "No input files was provided!\n");
+    if (kd_run(program, context) != KD_OK) {
+        print_error(kd_context_error(context));
+        status = 1;
+    } else {
+        status = (int)kd_context_exit_code(context);
+    }
+
+    kd_context_free(context);
+    kd_program_free(program);
+
+    return status;
 }
 
-static char* read_whole_file(const char* filepath) {
-    if (!filepath)
-        return NULL;
+/* statements run as soon as they have been read, whatever is available
+ * is handed over without waiting for more. */
+static int run_stream(const char* filepath, const kd_compile_options* options, size_t nthreads) {
+    int fd = strcmp(filepath, "-") == 0 ? STDIN_FILENO : open(filepath, O_RDONLY);
 
-    FILE* file = fopen(filepath, "r");
-    
-    if (!file)
-        return NULL;
+    if (fd < 0) {
+        fprintf(stderr, "ERROR: cannot open '%s'!\n", filepath);
+        return 1;
+    }
 
-    fseeko(file, 0, SEEK_END);
-    off_t size = ftell(file);
-    fseeko(file, 0, SEEK_SET);
+    kd_context* context = kd_context_new();
+    kd_stream* stream = context != NULL ? kd_stream_new(context, options) : NULL;
 
-    if (size == 0) {
-        fclose(file);
-        return ERR_FILE_EMPTY;
+    if (stream == NULL) {
+        fprintf(stderr, "ERROR: cannot allocate memory!\n");
+        kd_context_free(context);
+        if (fd != STDIN_FILENO)
+            close(fd);
+        return 1;
+    }
+
+    kd_context_set_threads(context, nthreads);
+
+    static char buffer[64 * 1024];
+    kd_status status = KD_OK;
+
+    while (status == KD_OK && !kd_stream_done(stream)) {
+        ssize_t n = read(fd, buffer, sizeof(buffer));
+
+        if (n < 0) {
+            fprintf(stderr, "ERROR: cannot read '%s'!\n", filepath);
+            status = KD_ERROR_RUNTIME;
+            break;
+        }
+
+        fflush(stdout);
+        status = n == 0 ? kd_stream_finish(stream) : kd_stream_feed(stream, buffer, n);
     }
 
-    char* buffer = malloc(sizeof(char) * size);
-    size_t nitems = fread(buffer, sizeof(char), size, file);
+    if (fd != STDIN_FILENO)
+        close(fd);
 
-    fclose(file);
+    int code = (int)kd_context_exit_code(context);
 
-    if (((size_t)size) != nitems) {
-        free(buffer);
-        return ERR_FILE_MISREAD;
+    if (kd_stream_error(stream)->status != KD_OK) {
+        print_error(kd_stream_error(stream));
+        code = 1;
+    } else if (status != KD_OK) {
+        code = 1;
     }
 
-    // add null terminating character.
-    buffer[size - 1] = 0;
+    kd_stream_free(stream);
+    kd_context_free(context);
+
+    return code;
+}
+
+static void usage(const char* program) {
+    fprintf(stderr, "Usage: %s [--dump-ir] [--time-passes] [--no-opt] [--no-inline] [--no-dedup] [--one-pass] [--eager] [--auto-parallel] [--tiered] [--tier-calls=N] [--tier-loops=N] [--trace-tiers] [--stream] [--stats=json] [--sample-profile=HZ] [--threads=N] <file>\n", program);
+    fprintf(stderr, "       %s [options] -    (reads the script from stdin as a stream)\n", program);
+    fprintf(stderr, "       %s --batch <dir> [-j N]\n", program);
+    fprintf(stderr, "No input files was provided!\n");
+}
+
+static void print_error(const kd_error* error) {
+    if (error->line != 0)
+        fprintf(stderr, "(%zu:%zu) ", error->line, error->col);
 
-    return buffer;
+    fprintf(stderr, "ERROR: %s\n", error->message);
 }
@@ -0,0 +1,452 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "map.h"
+
+/* an open addressing table in the style of swiss tables. every slot has a
+ * control byte, either CTRL_EMPTY or the low 7 bits of its key's hash, and a
+ * lookup compares the control bytes of 16 slots at once before touching any
+ * key.
+ *
+ * probing is linear, so a key always sits in the first run of full slots
+ * after its home slot. that lets a delete shift the entries after it back
+ * instead of leaving a tombstone, and a lookup can stop at the first group
+ * with an empty slot in it. */
+
+#if defined(__x86_64__) && !defined(KD_NO_SIMD)
+#define KD_SIMD
+#include <emmintrin.h>
+#endif
+
+#define MAP_GROUP 16
+#define MAP_MIN_CAPACITY 16
+
+/* the only control byte with the high bit set. */
+#define CTRL_EMPTY 0x80
+
+static MapStatus find(MapObject* map, const Value* key, uint64_t hash, size_t* index);
+static size_t find_empty(const MapObject* map, uint64_t hash);
+static MapStatus grow(MapObject* map);
+
+static int key_hash(const MapObject* map, const Value* key, uint64_t* hash);
+static int key_equals(const MapObject* map, const unsigned char* slot, const Value* key);
+
+static void slot_key(const MapObject* map, const unsigned char* slot, Value* key);
+static void slot_value(const MapObject* map, const unsigned char* slot, Value* value);
+static int own(const Value* value, Value* result);
+
+static inline unsigned char* slot_at(const MapObject* map, size_t index) {
+    return map->slots + index * map->slot_size;
+}
+
+/* the first MAP_GROUP - 1 control bytes are mirrored after the last one, so
+ * a group can be loaded from any slot without wrapping around. */
+static inline void set_ctrl(MapObject* map, size_t index, uint8_t ctrl) {
+    map->ctrl[index] = ctrl;
+
+    if (index < MAP_GROUP - 1)
+        map->ctrl[map->capacity + index] = ctrl;
+}
+
+/* bit i is set when the control byte of slot i of the group is ctrl. */
+static inline uint32_t group_match(const uint8_t* group, uint8_t ctrl) {
+#ifdef KD_SIMD
+    __m128i bytes = _mm_loadu_si128((const __m128i*)group);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(ctrl)));
+#else
+    uint32_t mask = 0;
+
+    for (size_t i = 0; i < MAP_GROUP; i++)
+        mask |= (uint32_t)(group[i] == ctrl) << i;
+
+    return mask;
+#endif
+}
+
+static inline uint32_t group_empty(const uint8_t* group) {
+#ifdef KD_SIMD
+    return _mm_movemask_epi8(_mm_loadu_si128((const __m128i*)group));
+#else
+    return group_match(group, CTRL_EMPTY);
+#endif
+}
+
+/* the payload of a value is everything after its kind. */
+static size_t payload_size(ValueKind kind) {
+    return kind == VAL_STRING ? 16 : 8;
+}
+
+/* with a constant size the copy is a load and a store instead of a call. */
+static inline void copy_payload(void* dst, const void* src, size_t size) {
+    if (size == 8)
+        memcpy(dst, src, 8);
+    else
+        memcpy(dst, src, 16);
+}
+
+MapObject* map_new(ValueKind key_kind, ValueKind value_kind) {
+    MapObject* map = malloc(sizeof(MapObject));
+    if (map == NULL)
+        return NULL;
+
+    size_t key_size = payload_size(key_kind);
+
+    *map = (MapObject) {
+        .refcount = 1,
+        .key_kind = key_kind,
+        .value_kind = value_kind,
+        .key_size = key_size,
+        .slot_size = key_size + payload_size(value_kind),
+        .capacity = 0,
+        .count = 0,
+        .ctrl = NULL,
+        .slots = NULL,
+    };
+
+    return map;
+}
+
+void map_release(MapObject* map) {
+    if (__atomic_sub_fetch(&map->refcount, 1, __ATOMIC_ACQ_REL) != 0)
+        return;
+
+    for (size_t i = 0; i < map->capacity; i++) {
+        if (map->ctrl[i] == CTRL_EMPTY)
+            continue;
+
+        Value key, value;
+        slot_key(map, slot_at(map, i), &key);
+        slot_value(map, slot_at(map, i), &value);
+
+        value_release(&key);
+        value_release(&value);
+    }
+
+    free(map->ctrl);
+    free(map);
+}
+
+MapStatus map_get(MapObject* map, const Value* key, Value* value) {
+    uint64_t hash;
+    if (!key_hash(map, key, &hash))
+        return MAP_NOMEM;
+
+    size_t index;
+    MapStatus status = find(map, key, hash, &index);
+
+    if (status == MAP_OK)
+        slot_value(map, slot_at(map, index), value);
+
+    return status;
+}
+
+MapStatus map_put(MapObject* map, const Value* key, const Value* value, int* inserted) {
+    uint64_t hash;
+    if (!key_hash(map, key, &hash))
+        return MAP_NOMEM;
+
+    size_t index;
+    MapStatus status = find(map, key, hash, &index);
+
+    if (status == MAP_NOMEM)
+        return status;
+
+    if (status == MAP_OK) {
+        unsigned char* slot = slot_at(map, index);
+        Value old;
+        slot_value(map, slot, &old);
+
+        Value owned;
+        if (!own(value, &owned))
+            return MAP_NOMEM;
+
+        copy_payload(slot + map->key_size, &owned.i64, map->slot_size - map->key_size);
+        value_release(&old);
+
+        *inserted = 0;
+        return MAP_OK;
+    }
+
+    /* at most 7/8 full. */
+    if ((map->count + 1) * 8 > map->capacity * 7 && grow(map) != MAP_OK)
+        return MAP_NOMEM;
+
+    Value owned_key;
+    Value owned_value;
+
+    if (!own(key, &owned_key))
+        return MAP_NOMEM;
+
+    if (!own(value, &owned_value)) {
+        value_release(&owned_key);
+        return MAP_NOMEM;
+    }
+
+    index = find_empty(map, hash);
+
+    unsigned char* slot = slot_at(map, index);
+
+    copy_payload(slot, &owned_key.i64, map->key_size);
+    copy_payload(slot + map->key_size, &owned_value.i64, map->slot_size - map->key_size);
+
+    set_ctrl(map, index, hash & 0x7f);
+    map->count++;
+
+    *inserted = 1;
+    return MAP_OK;
+}
+
+MapStatus map_delete(MapObject* map, const Value* key) {
+    uint64_t hash;
+    if (!key_hash(map, key, &hash))
+        return MAP_NOMEM;
+
+    size_t hole;
+    MapStatus status = find(map, key, hash, &hole);
+
+    if (status != MAP_OK)
+        return status;
+
+    Value old_key, old_value;
+    slot_key(map, slot_at(map, hole), &old_key);
+    slot_value(map, slot_at(map, hole), &old_value);
+
+    size_t mask = map->capacity - 1;
+
+    /* an entry after the hole moves into it when the hole lies between the
+     * entry's home slot and the entry, which leaves the hole where it was. */
+    for (size_t j = (hole + 1) & mask; map->ctrl[j] != CTRL_EMPTY; j = (j + 1) & mask) {
+        Value moved;
+        slot_key(map, slot_at(map, j), &moved);
+
+        /* cannot fail, the hash of a key in the map is cached or cheap. */
+        uint64_t moved_hash = 0;
+        key_hash(map, &moved, &moved_hash);
+
+        size_t home = (moved_hash >> 7) & mask;
+
+        if (((j - home) & mask) >= ((j - hole) & mask)) {
+            memcpy(slot_at(map, hole), slot_at(map, j), map->slot_size);
+            set_ctrl(map, hole, map->ctrl[j]);
+            hole = j;
+        }
+    }
+
+    set_ctrl(map, hole, CTRL_EMPTY);
+    map->count--;
+
+    value_release(&old_key);
+    value_release(&old_value);
+
+    return MAP_OK;
+}
+
+int map_next(const MapObject* map, size_t* cursor, Value* key, Value* value) {
+    /* skips a group of empty slots at a time. the mirrored control bytes
+     * past the end are masked off. */
+    for (size_t pos = *cursor; pos < map->capacity; pos += MAP_GROUP) {
+        uint32_t full = ~group_empty(map->ctrl + pos) & 0xffff;
+
+        if (map->capacity - pos < MAP_GROUP)
+            full &= (1u << (map->capacity - pos)) - 1;
+
+        if (full == 0)
+            continue;
+
+        size_t i = pos + __builtin_ctz(full);
+
+        slot_key(map, slot_at(map, i), key);
+        slot_value(map, slot_at(map, i), value);
+        *cursor = i + 1;
+
+        return 1;
+    }
+
+    *cursor = map->capacity;
+    return 0;
+}
+
+size_t map_memory(const MapObject* map) {
+    if (map->capacity == 0)
+        return sizeof(MapObject);
+
+    return sizeof(MapObject) + ((map->capacity + MAP_GROUP - 1 + 7) & ~(size_t)7) + map->capacity * map->slot_size;
+}
+
+static MapStatus find(MapObject* map, const Value* key, uint64_t hash, size_t* index) {
+    if (map->capacity == 0)
+        return MAP_NOT_FOUND;
+
+    size_t mask = map->capacity - 1;
+    size_t pos = (hash >> 7) & mask;
+    uint8_t h2 = hash & 0x7f;
+
+    for (;;) {
+        const uint8_t* group = map->ctrl + pos;
+
+        for (uint32_t matches = group_match(group, h2); matches != 0; matches &= matches - 1) {
+            size_t i = (pos + __builtin_ctz(matches)) & mask;
+            int equal = key_equals(map, slot_at(map, i), key);
+
+            if (equal < 0)
+                return MAP_NOMEM;
+
+            if (equal) {
+                *index = i;
+                return MAP_OK;
+            }
+        }
+
+        if (group_empty(group) != 0)
+            return MAP_NOT_FOUND;
+
+        pos = (pos + MAP_GROUP) & mask;
+    }
+}
+
+/* the map is never full, so there always is one. */
+static size_t find_empty(const MapObject* map, uint64_t hash) {
+    size_t mask = map->capacity - 1;
+    size_t pos = (hash >> 7) & mask;
+
+    for (;;) {
+        uint32_t empty = group_empty(map->ctrl + pos);
+
+        if (empty != 0)
+            return (pos + __builtin_ctz(empty)) & mask;
+
+        pos = (pos + MAP_GROUP) & mask;
+    }
+}
+
+/* doubles the capacity. the control bytes and the slots share one
+ * allocation. */
+static MapStatus grow(MapObject* map) {
+    size_t capacity = map->capacity == 0 ? MAP_MIN_CAPACITY : map->capacity * 2;
+    size_t ctrl_size = (capacity + MAP_GROUP - 1 + 7) & ~(size_t)7;
+
+    if (capacity > (SIZE_MAX - ctrl_size) / map->slot_size)
+        return MAP_NOMEM;
+
+    uint8_t* ctrl = malloc(ctrl_size + capacity * map->slot_size);
+    if (ctrl == NULL)
+        return MAP_NOMEM;
+
+    memset(ctrl, CTRL_EMPTY, capacity + MAP_GROUP - 1);
+
+    MapObject old = *map;
+
+    map->capacity = capacity;
+    map->ctrl = ctrl;
+    map->slots = ctrl + ctrl_size;
+
+    /* keys are unique already, only an empty slot is needed for each. */
+    for (size_t i = 0; i < old.capacity; i++) {
+        if (old.ctrl[i] == CTRL_EMPTY)
+            continue;
+
+        Value key;
+        slot_key(&old, slot_at(&old, i), &key);
+
+        uint64_t hash;
+        key_hash(map, &key, &hash);
+
+        size_t index = find_empty(map, hash);
+
+        memcpy(slot_at(map, index), slot_at(&old, i), map->slot_size);
+        set_ctrl(map, index, old.ctrl[i]);
+    }
+
+    free(old.ctrl);
+    return MAP_OK;
+}
+
+/* a 64 bit finaliser, so that the low 7 bits and the home slot both depend
+ * on every bit of the key. */
+static uint64_t mix(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccd;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53;
+    x ^= x >> 33;
+
+    return x;
+}
+
+/* a string key reuses the hash cached in its object. returns 0 when out of
+ * memory, which only happens for a rope that was never flattened. */
+static int key_hash(const MapObject* map, const Value* key, uint64_t* hash) {
+    switch (map->key_kind) {
+    case VAL_INT:
+        *hash = mix(key->i64);
+        return 1;
+    case VAL_DOUBLE: {
+        /* -0.0 == 0.0, so they have to hash the same. */
+        double f64 = key->f64 == 0 ? 0 : key->f64;
+        uint64_t bits;
+
+        memcpy(&bits, &f64, sizeof(bits));
+        *hash = mix(bits);
+        return 1;
+    }
+    case VAL_BOOL:
+        *hash = mix(key->bool != 0);
+        return 1;
+    default: {
+        uint64_t string = string_hash(key);
+        if (string == 0)
+            return 0;
+
+        *hash = mix(string);
+        return 1;
+    }
+    }
+}
+
+/* 1 if equal, 0 if not and -1 when out of memory. */
+static int key_equals(const MapObject* map, const unsigned char* slot, const Value* key) {
+    switch (map->key_kind) {
+    case VAL_INT: {
+        int64_t i64;
+        memcpy(&i64, slot, sizeof(i64));
+        return i64 == key->i64;
+    }
+    case VAL_DOUBLE: {
+        double f64;
+        memcpy(&f64, slot, sizeof(f64));
+        return f64 == key->f64;
+    }
+    case VAL_BOOL: {
+        int bool;
+        memcpy(&bool, slot, sizeof(bool));
+        return (bool != 0) == (key->bool != 0);
+    }
+    default: {
+        Value string;
+        slot_key(map, slot, &string);
+        return string_equals(&string, key);
+    }
+    }
+}
+
+/* only the payload is filled in, the rest of the value is never read. */
+static void slot_key(const MapObject* map, const unsigned char* slot, Value* key) {
+    key->kind = map->key_kind;
+    copy_payload(&key->i64, slot, map->key_size);
+}
+
+static void slot_value(const MapObject* map, const unsigned char* slot, Value* value) {
+    value->kind = map->value_kind;
+    copy_payload(&value->i64, slot + map->key_size, map->slot_size - map->key_size);
+}
+
+/* the map may outlive the program a literal put into it came from, the
+ * statement of a stream say, see string_own. */
+static int own(const Value* value, Value* result) {
+    if (value->kind == VAL_STRING)
+        return string_own(value, result);
+
+    value_retain(value);
+    *result = *value;
+    return 1;
+}
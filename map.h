@@ -0,0 +1,38 @@
+#ifndef MAP_H
+#define MAP_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "value.h"
+
+typedef enum MapStatus_t {
+    MAP_OK,
+    MAP_NOMEM,
+    MAP_NOT_FOUND,
+} MapStatus;
+
+/* an empty map with one reference. keys have to be i64, f64, bool or string
+ * and values anything but a map. returns NULL when out of memory. */
+MapObject* map_new(ValueKind key_kind, ValueKind value_kind);
+
+/* keys and values have to be of the kinds the map was made for, and a f64
+ * key must not be NaN. */
+
+/* value is borrowed from the map, it is valid until the map changes. */
+MapStatus map_get(MapObject* map, const Value* key, Value* value);
+
+/* the map takes its own references to key and value. inserted is set to 1
+ * for a new key and 0 when an existing value was replaced. */
+MapStatus map_put(MapObject* map, const Value* key, const Value* value, int* inserted);
+
+MapStatus map_delete(MapObject* map, const Value* key);
+
+/* iterates in slot order. start with *cursor = 0, returns 0 once every
+ * entry has been seen. key and value are borrowed. */
+int map_next(const MapObject* map, size_t* cursor, Value* key, Value* value);
+
+/* the bytes the map holds on to, not counting the strings and arrays in it. */
+size_t map_memory(const MapObject* map);
+
+#endif /* MAP_H */
@@ -0,0 +1,750 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <setjmp.h>
+#include <sys/types.h>
+
+#include "module.h"
+#include "parser.h"
+#include "resolver.h"
+
+/* a module taking part in one call of modules_import. */
+typedef struct Entry_t {
+    struct Load_t* load;
+
+    char* path;
+    uint64_t path_hash;
+
+    /* the text of its file. */
+    char* text;
+    size_t size;
+    uint64_t hash;
+
+    /* the version in the cache when the text has not changed, which the
+     * load keeps until it is done, and the one to use: the cached one, or
+     * one parsed now (fresh) when there is none. imports are the entries
+     * of module->paths. */
+    Module* cached;
+    Module* module;
+    int fresh;
+    size_t* imports;
+
+    uint64_t key;
+    size_t level;
+    int visit;
+
+    int rebuild;
+    int built;
+
+    kd_error error;
+} Entry;
+
+typedef struct Load_t {
+    kd_modules* modules;
+
+    /* grows only between waves of tasks, which point into it. */
+    Entry* entries;
+    size_t count;
+    size_t capacity;
+} Load;
+
+static uint64_t hash_bytes(uint64_t hash, const void* data, size_t size);
+static void set_error(kd_error* error, kd_status status, size_t line, size_t col, const char* fmt, ...);
+static char* canonical_path(const char* from, Span path);
+
+static Module* find_cached(const kd_modules* modules, const char* path);
+static int reserve(kd_modules* modules, size_t n);
+static void replace_cached(kd_modules* modules, Module* module);
+static void module_free(Module* module);
+
+static size_t add_entry(Load* load, char* path, kd_error* error);
+static int read_file(Entry* entry);
+static Module* parse_module(Entry* entry);
+static void discover(void* arg, size_t worker);
+static void build(void* arg, size_t worker);
+static int visit(Load* load, size_t index, kd_error* error);
+static void run(kd_modules* modules, TaskFn fn, void* arg);
+static int release(Load* load, int failed);
+
+kd_modules* kd_modules_new(const kd_compile_options* options, size_t nthreads) {
+    kd_modules* modules = calloc(1, sizeof(kd_modules));
+    if (modules == NULL)
+        return NULL;
+
+    pthread_mutex_init(&modules->lock, NULL);
+    modules->nthreads = nthreads;
+
+    if (options != NULL) {
+        modules->options = *options;
+    } else {
+        modules->options.optimize = 1;
+        modules->options.inline_calls = 1;
+        modules->options.dedup = 1;
+    }
+
+    modules->options.modules = modules;
+
+    return modules;
+}
+
+void kd_modules_free(kd_modules* modules) {
+    if (modules == NULL)
+        return;
+
+    if (modules->started)
+        pool_deinit(&modules->pool);
+
+    pthread_mutex_destroy(&modules->lock);
+
+    /* a module a program still links is freed with the program. */
+    for (size_t i = 0; i < modules->count; i++)
+        module_release(modules->items[i]);
+
+    free(modules->items);
+    free(modules);
+}
+
+void kd_modules_stats(kd_modules* modules, kd_module_stats* stats) {
+    pthread_mutex_lock(&modules->lock);
+
+    stats->modules = modules->count;
+    stats->compiled = modules->ncompiled;
+    stats->reused = modules->nreused;
+
+    pthread_mutex_unlock(&modules->lock);
+}
+
+/* the graph is found a wave at a time: the files of one wave are read and
+ * parsed in parallel and the files they import make up the next. it is
+ * then checked for cycles and built bottom up, a level at a time, every
+ * module of a level in parallel once the ones it imports are done. the
+ * cache is only locked to look modules up in and to put the ones built
+ * into, so loads of other programs go on at the same time. */
+kd_status modules_import(kd_modules* modules, const char* from, Import** imports, size_t n, Functions* functions, kd_error* error) {
+    if (n == 0)
+        return KD_OK;
+
+    if (modules == NULL) {
+        set_error(error, KD_ERROR_SYNTAX, imports[0]->line, imports[0]->col, "modules can only be imported with a module cache, see kd_modules_new");
+        return error->status;
+    }
+
+    Load load = { .modules = modules };
+    size_t* roots = malloc(n * sizeof(size_t));
+    int failed = 1;
+
+    pthread_mutex_lock(&modules->lock);
+
+    if (!modules->started && pool_init(&modules->pool, modules->nthreads))
+        modules->started = 1;
+
+    int started = modules->started;
+    pthread_mutex_unlock(&modules->lock);
+
+    if (!started) {
+        set_error(error, KD_ERROR_NOMEM, 0, 0, "cannot start the threads to compile modules on");
+        goto done;
+    }
+
+    if (roots == NULL) {
+        set_error(error, KD_ERROR_NOMEM, 0, 0, "cannot allocate memory!");
+        goto done;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        char* path = canonical_path(from, imports[i]->path);
+
+        if (path == NULL) {
+            set_error(error, KD_ERROR_SYNTAX, imports[i]->line, imports[i]->col, "cannot open module '%.*s'",
+                (int)imports[i]->path.size, imports[i]->path.data);
+            goto done;
+        }
+
+        roots[i] = add_entry(&load, path, error);
+        if (roots[i] == SIZE_MAX)
+            goto done;
+    }
+
+    for (size_t start = 0, end = load.count; start < end; start = end, end = load.count) {
+        for (size_t i = start; i < end; i++)
+            run(modules, discover, &load.entries[i]);
+
+        pool_wait(&modules->pool);
+
+        for (size_t i = start; i < end; i++) {
+            Entry* entry = &load.entries[i];
+
+            if (entry->module == NULL) {
+                *error = entry->error;
+                goto done;
+            }
+
+            entry->imports = malloc((entry->module->nimports + 1) * sizeof(size_t));
+            if (entry->imports == NULL) {
+                set_error(error, KD_ERROR_NOMEM, 0, 0, "cannot allocate memory!");
+                goto done;
+            }
+
+            for (size_t j = 0; j < entry->module->nimports; j++) {
+                char* path = strdup(entry->module->paths[j]);
+                size_t imported = path != NULL ? add_entry(&load, path, error) : SIZE_MAX;
+
+                if (path == NULL)
+                    set_error(error, KD_ERROR_NOMEM, 0, 0, "cannot allocate memory!");
+
+                if (imported == SIZE_MAX)
+                    goto done;
+
+                /* add_entry may have moved the entries. */
+                load.entries[i].imports[j] = imported;
+                entry = &load.entries[i];
+            }
+        }
+    }
+
+    size_t levels = 0;
+
+    for (size_t i = 0; i < load.count; i++) {
+        if (!visit(&load, i, error))
+            goto done;
+
+        Entry* entry = &load.entries[i];
+
+        entry->rebuild = entry->fresh || entry->module->key != entry->key;
+        if (entry->level + 1 > levels)
+            levels = entry->level + 1;
+    }
+
+    for (size_t level = 0; level < levels; level++) {
+        for (size_t i = 0; i < load.count; i++) {
+            if (load.entries[i].rebuild && load.entries[i].level == level)
+                run(modules, build, &load.entries[i]);
+        }
+
+        pool_wait(&modules->pool);
+
+        for (size_t i = 0; i < load.count; i++) {
+            const Entry* entry = &load.entries[i];
+
+            if (entry->rebuild && entry->level == level && !entry->built) {
+                *error = entry->error;
+                goto done;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        Module* module = load.entries[roots[i]].module;
+
+        if (!functions_keep(functions, module)) {
+            set_error(error, KD_ERROR_NOMEM, 0, 0, "cannot allocate memory!");
+            goto done;
+        }
+
+        imports[i]->module = module;
+    }
+
+    failed = 0;
+
+done:
+    if (!release(&load, failed) && !failed) {
+        set_error(error, KD_ERROR_NOMEM, 0, 0, "cannot allocate memory!");
+        failed = 1;
+    }
+
+    free(roots);
+    return failed ? error->status : KD_OK;
+}
+
+void module_retain(Module* module) {
+    __atomic_add_fetch(&module->refs, 1, __ATOMIC_RELAXED);
+}
+
+/* whatever the last owner wrote to the module is seen by the thread
+ * freeing it. */
+void module_release(Module* module) {
+    if (__atomic_sub_fetch(&module->refs, 1, __ATOMIC_ACQ_REL) == 0)
+        module_free(module);
+}
+
+/* the end of a message too long for the prefix is cut off. */
+void error_in_module(kd_error* error, const char* path) {
+    size_t size = sizeof(error->message);
+    size_t prefix = strlen(path) + 2;
+
+    if (prefix >= size)
+        return;
+
+    memmove(error->message + prefix, error->message, size - prefix - 1);
+    memcpy(error->message, path, prefix - 2);
+    memcpy(error->message + prefix - 2, ": ", 2);
+
+    error->message[size - 1] = 0;
+}
+
+static uint64_t hash_bytes(uint64_t hash, const void* data, size_t size) {
+    const unsigned char* bytes = data;
+
+    for (size_t i = 0; i < size; i++)
+        hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+
+    return hash;
+}
+
+static void set_error(kd_error* error, kd_status status, size_t line, size_t col, const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+
+    error->status = status;
+    error->line = line;
+    error->col = col;
+    vsnprintf(error->message, sizeof(error->message), fmt, args);
+
+    va_end(args);
+}
+
+/* path is relative to the directory of from, or to the working directory
+ * when from is NULL. NULL when there is no such file. */
+static char* canonical_path(const char* from, Span path) {
+    const char* slash = from != NULL ? strrchr(from, '/') : NULL;
+    size_t dir = path.size > 0 && path.data[0] == '/' ? 0 : slash != NULL ? (size_t)(slash - from) + 1 : 0;
+
+    char* joined = malloc(dir + path.size + 1);
+    if (joined == NULL)
+        return NULL;
+
+    memcpy(joined, from, dir);
+    memcpy(joined + dir, path.data, path.size);
+    joined[dir + path.size] = 0;
+
+    char* canonical = realpath(joined, NULL);
+    free(joined);
+
+    return canonical;
+}
+
+static Module* find_cached(const kd_modules* modules, const char* path) {
+    for (size_t i = 0; i < modules->count; i++) {
+        if (strcmp(modules->items[i]->path, path) == 0)
+            return modules->items[i];
+    }
+
+    return NULL;
+}
+
+/* room for n more modules, so that a load that has built its modules
+ * cannot fail to cache them. returns 0 when out of memory. */
+static int reserve(kd_modules* modules, size_t n) {
+    if (modules->count + n > modules->capacity) {
+        size_t capacity = modules->count + n < 16 ? 16 : (modules->count + n) * 2;
+
+        Module** items = realloc(modules->items, capacity * sizeof(Module*));
+        if (items == NULL)
+            return 0;
+
+        modules->items = items;
+        modules->capacity = capacity;
+    }
+
+    return 1;
+}
+
+static void replace_cached(kd_modules* modules, Module* module) {
+    for (size_t i = 0; i < modules->count; i++) {
+        if (strcmp(modules->items[i]->path, module->path) != 0)
+            continue;
+
+        module_release(modules->items[i]);
+        modules->items[i] = module;
+        return;
+    }
+
+    modules->items[modules->count++] = module;
+}
+
+/* the table of a module is only set up once it is built. */
+static void module_free(Module* module) {
+    if (module == NULL)
+        return;
+
+    if (module->functions.arena != NULL)
+        functions_deinit(&module->functions);
+
+    arena_deinit(&module->arena);
+    free(module);
+}
+
+/* the entry of path, added when there is none yet. takes path over. returns
+ * SIZE_MAX when out of memory. */
+static size_t add_entry(Load* load, char* path, kd_error* error) {
+    uint64_t path_hash = hash_bytes(0xcbf29ce484222325ull, path, strlen(path));
+
+    for (size_t i = 0; i < load->count; i++) {
+        if (load->entries[i].path_hash == path_hash && strcmp(load->entries[i].path, path) == 0) {
+            free(path);
+            return i;
+        }
+    }
+
+    if (load->count == load->capacity) {
+        size_t capacity = load->capacity == 0 ? 16 : load->capacity * 2;
+
+        Entry* entries = realloc(load->entries, capacity * sizeof(Entry));
+        if (entries == NULL) {
+            free(path);
+            set_error(error, KD_ERROR_NOMEM, 0, 0, "cannot allocate memory!");
+            return SIZE_MAX;
+        }
+
+        load->entries = entries;
+        load->capacity = capacity;
+    }
+
+    load->entries[load->count] = (Entry) {
+        .load = load,
+        .path = path,
+        .path_hash = path_hash,
+    };
+
+    return load->count++;
+}
+
+static int read_file(Entry* entry) {
+    FILE* file = fopen(entry->path, "r");
+
+    if (file == NULL) {
+        set_error(&entry->error, KD_ERROR_SYNTAX, 0, 0, "cannot open module '%s'", entry->path);
+        return 0;
+    }
+
+    fseeko(file, 0, SEEK_END);
+    off_t size = ftello(file);
+    fseeko(file, 0, SEEK_SET);
+
+    entry->text = size >= 0 ? malloc(size + 1) : NULL;
+
+    if (entry->text == NULL || fread(entry->text, 1, size, file) != (size_t)size) {
+        fclose(file);
+        set_error(&entry->error, KD_ERROR_RUNTIME, 0, 0, "cannot read module '%s'", entry->path);
+        return 0;
+    }
+
+    fclose(file);
+
+    entry->text[size] = 0;
+    entry->size = size;
+    entry->hash = hash_bytes(0xcbf29ce484222325ull, entry->text, entry->size);
+
+    return 1;
+}
+
+/* a module is only imports, structs and functions. its text goes into its
+ * arena, the tree points into it. */
+static Module* parse_module(Entry* entry) {
+    kd_error* error = &entry->error;
+    Module* module = calloc(1, sizeof(Module));
+
+    if (module == NULL) {
+        set_error(error, KD_ERROR_NOMEM, 0, 0, "cannot allocate memory!");
+        return NULL;
+    }
+
+    module->arena = arena_init();
+    module->hash = entry->hash;
+    module->refs = 1;
+
+    char* path = arena_alloc(&module->arena, strlen(entry->path) + 1);
+    char* source = arena_alloc(&module->arena, entry->size + 1);
+
+    if (path == NULL || source == NULL) {
+        module_free(module);
+        set_error(error, KD_ERROR_NOMEM, 0, 0, "cannot allocate memory!");
+        return NULL;
+    }
+
+    strcpy(path, entry->path);
+    memcpy(source, entry->text, entry->size + 1);
+
+    module->path = path;
+    module->source = source;
+
+    Lexer lexer = lexer_init(module->source);
+    Parser parser = parser_init(&lexer, &module->arena, error);
+    parser.dedup = entry->load->modules->options.dedup;
+
+    if (setjmp(parser.bail)) {
+        parser_deinit(&parser);
+        module_free(module);
+        error_in_module(error, entry->path);
+        return NULL;
+    }
+
+    BlockStatement* statements = NULL;
+    BlockStatement** tail = &statements;
+
+    while (parser.current.kind != TOK_EOF) {
+        BlockStatement* node = arena_alloc(&module->arena, sizeof(BlockStatement));
+
+        if (node == NULL) {
+            set_error(error, KD_ERROR_NOMEM, 0, 0, "cannot allocate memory!");
+            longjmp(parser.bail, 1);
+        }
+
+        node->statement = parse_statement(&parser);
+        node->next = NULL;
+
+        StatementKind kind = node->statement->kind;
+
+        /* a script is one braced block, a module is the inside of one. */
+        if (kind == STATEMENT_BLOCK && statements == NULL) {
+            set_error(error, KD_ERROR_SYNTAX, node->statement->line, node->statement->col,
+                "module files must not be wrapped in braces");
+            longjmp(parser.bail, 1);
+        }
+
+        if (kind != STATEMENT_IMPORT && kind != STATEMENT_STRUCT && kind != STATEMENT_FN) {
+            set_error(error, KD_ERROR_SYNTAX, node->statement->line, node->statement->col,
+                "a module can only import modules and declare structs and functions");
+            longjmp(parser.bail, 1);
+        }
+
+        module->nimports += kind == STATEMENT_IMPORT;
+
+        *tail = node;
+        tail = &node->next;
+    }
+
+    parser_deinit(&parser);
+
+    module->root = arena_alloc(&module->arena, sizeof(Statement));
+    module->imports = arena_alloc(&module->arena, (module->nimports + 1) * sizeof(Import*));
+    module->paths = arena_alloc(&module->arena, (module->nimports + 1) * sizeof(char*));
+
+    if (module->root == NULL || module->imports == NULL || module->paths == NULL) {
+        module_free(module);
+        set_error(error, KD_ERROR_NOMEM, 0, 0, "cannot allocate memory!");
+        return NULL;
+    }
+
+    *module->root = (Statement) {
+        .kind = STATEMENT_BLOCK,
+        .line = 1,
+        .col = 1,
+        .blockstatement = statements,
+    };
+
+    size_t n = 0;
+
+    for (BlockStatement* node = statements; node != NULL; node = node->next) {
+        if (node->statement->kind != STATEMENT_IMPORT)
+            continue;
+
+        Import* import = &node->statement->import;
+        char* canonical = canonical_path(module->path, import->path);
+
+        if (canonical == NULL) {
+            set_error(error, KD_ERROR_SYNTAX, import->line, import->col, "cannot open module '%.*s'",
+                (int)import->path.size, import->path.data);
+            error_in_module(error, entry->path);
+            module_free(module);
+            return NULL;
+        }
+
+        char* kept = arena_alloc(&module->arena, strlen(canonical) + 1);
+
+        if (kept != NULL)
+            strcpy(kept, canonical);
+
+        free(canonical);
+
+        if (kept == NULL) {
+            module_free(module);
+            set_error(error, KD_ERROR_NOMEM, 0, 0, "cannot allocate memory!");
+            return NULL;
+        }
+
+        module->imports[n] = import;
+        module->paths[n++] = kept;
+    }
+
+    return module;
+}
+
+/* a module whose text has not changed keeps the imports it had, only a
+ * changed one is parsed again. */
+static void discover(void* arg, size_t worker) {
+    (void)worker;
+
+    Entry* entry = arg;
+
+    kd_modules* modules = entry->load->modules;
+
+    if (!read_file(entry))
+        return;
+
+    pthread_mutex_lock(&modules->lock);
+    Module* cached = find_cached(modules, entry->path);
+
+    if (cached != NULL && cached->hash == entry->hash) {
+        module_retain(cached);
+        entry->cached = cached;
+    }
+
+    pthread_mutex_unlock(&modules->lock);
+
+    if (entry->cached != NULL) {
+        entry->module = entry->cached;
+        return;
+    }
+
+    entry->module = parse_module(entry);
+    entry->fresh = entry->module != NULL;
+}
+
+/* a module resolved against the ones it imports, which are built already. a
+ * module whose text is unchanged but which imports one that was rebuilt is
+ * parsed again, its tree points at the old versions. */
+static void build(void* arg, size_t worker) {
+    (void)worker;
+
+    Entry* entry = arg;
+    const kd_modules* modules = entry->load->modules;
+
+    if (!entry->fresh) {
+        entry->module = parse_module(entry);
+        if (entry->module == NULL)
+            return;
+
+        entry->fresh = 1;
+    }
+
+    Module* module = entry->module;
+
+    functions_init(&module->functions, &module->arena, &modules->options);
+    module->functions.path = module->path;
+
+    for (size_t i = 0; i < module->nimports; i++) {
+        Module* imported = entry->load->entries[entry->imports[i]].module;
+
+        if (!functions_keep(&module->functions, imported)) {
+            set_error(&entry->error, KD_ERROR_NOMEM, 0, 0, "cannot allocate memory!");
+            return;
+        }
+
+        module->imports[i]->module = imported;
+    }
+
+    size_t nslots;
+    if (resolve_program(module->root, &module->functions, &nslots, &entry->error) != KD_OK) {
+        error_in_module(&entry->error, module->path);
+        return;
+    }
+
+    for (BlockStatement* node = module->root->blockstatement; node != NULL; node = node->next)
+        module->nrecords += node->statement->kind == STATEMENT_STRUCT;
+
+    module->records = arena_alloc(&module->arena, (module->nrecords + 1) * sizeof(RecordType*));
+    if (module->records == NULL) {
+        set_error(&entry->error, KD_ERROR_NOMEM, 0, 0, "cannot allocate memory!");
+        return;
+    }
+
+    size_t n = 0;
+
+    for (BlockStatement* node = module->root->blockstatement; node != NULL; node = node->next) {
+        if (node->statement->kind == STATEMENT_STRUCT) {
+            node->statement->record->path = module->path;
+            module->records[n++] = node->statement->record;
+        }
+    }
+
+    if (modules->options.eager) {
+        for (size_t i = 0; i < module->functions.count; i++) {
+            Function* function = module->functions.items[i];
+
+            if (function->table == &module->functions && function_chunk(function, &entry->error) == NULL)
+                return;
+        }
+    }
+
+    module->key = entry->key;
+    entry->built = 1;
+}
+
+/* depth first, giving every module the level above the ones it imports and
+ * a key that changes with theirs. */
+static int visit(Load* load, size_t index, kd_error* error) {
+    Entry* entry = &load->entries[index];
+
+    if (entry->visit == 2)
+        return 1;
+
+    entry->visit = 1;
+    entry->key = entry->hash;
+
+    for (size_t i = 0; i < entry->module->nimports; i++) {
+        Entry* imported = &load->entries[entry->imports[i]];
+
+        if (imported->visit == 1) {
+            const Import* import = entry->module->imports[i];
+
+            set_error(error, KD_ERROR_SYNTAX, import->line, import->col, "import cycle through '%s'", imported->path);
+            error_in_module(error, entry->path);
+            return 0;
+        }
+
+        if (!visit(load, entry->imports[i], error))
+            return 0;
+
+        if (imported->level + 1 > entry->level)
+            entry->level = imported->level + 1;
+
+        entry->key = hash_bytes(entry->key, &imported->key, sizeof(imported->key));
+    }
+
+    entry->visit = 2;
+    return 1;
+}
+
+/* a task the pool cannot take runs right away. */
+static void run(kd_modules* modules, TaskFn fn, void* arg) {
+    if (!pool_submit(&modules->pool, fn, arg))
+        fn(arg, 0);
+}
+
+/* the modules built are cached even when the load failed, whatever they
+ * import was built too. returns 0 when there was no room to cache them,
+ * they are freed then. */
+static int release(Load* load, int failed) {
+    kd_modules* modules = load->modules;
+
+    pthread_mutex_lock(&modules->lock);
+    int room = reserve(modules, load->count);
+
+    for (size_t i = 0; i < load->count; i++) {
+        Entry* entry = &load->entries[i];
+
+        if (entry->built && room) {
+            replace_cached(modules, entry->module);
+            modules->ncompiled++;
+        } else if (entry->fresh) {
+            module_release(entry->module);
+        } else if (!failed) {
+            modules->nreused++;
+        }
+
+        if (entry->cached != NULL)
+            module_release(entry->cached);
+
+        free(entry->path);
+        free(entry->text);
+        free(entry->imports);
+    }
+
+    pthread_mutex_unlock(&modules->lock);
+
+    free(load->entries);
+    return room;
+}
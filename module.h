@@ -0,0 +1,88 @@
+#ifndef MODULE_H
+#define MODULE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "kidomaru.h"
+#include "arena.h"
+#include "ast.h"
+#include "function.h"
+#include "pool.h"
+
+/* a file of imports, structs and functions, which is what a script that
+ * imports it gets to see of it: the structs and functions it declares, not
+ * the ones it imports itself. it is parsed and resolved on its own and
+ * lives in an arena of its own, in a kd_modules, for as long as neither its
+ * text nor anything it imports changes. */
+typedef struct Module_t {
+    /* canonical, the name of the module in the cache. */
+    const char* path;
+
+    /* of its text, and of its text and the keys of the modules it imports.
+     * a module is built again when its key changes. */
+    uint64_t hash;
+    uint64_t key;
+
+    Arena arena;
+    const char* source;
+
+    /* its statements as one block, and its imports in the order of its
+     * import statements with the canonical paths they name. */
+    Statement* root;
+    Import** imports;
+    const char** paths;
+    size_t nimports;
+
+    /* the functions it imports, then its own, and the structs it declares. */
+    Functions functions;
+    const RecordType** records;
+    size_t nrecords;
+
+    /* one for the cache while it is the version there, one for every table
+     * linking its functions, see functions_keep, and one for every load
+     * using it. */
+    size_t refs;
+} Module;
+
+/* every module built so far, by path. a rebuilt module replaces the one in
+ * the cache, the replaced one is freed once the last program compiled
+ * against it lets go of it. */
+struct kd_modules {
+    kd_compile_options options;
+
+    /* held to look at or change what is cached and the counts, not while
+     * files are read and modules parsed and resolved, which loads do in
+     * parallel on pool, started by the first load. */
+    pthread_mutex_t lock;
+    ThreadPool pool;
+    size_t nthreads;
+    int started;
+
+    Module** items;
+    size_t count;
+    size_t capacity;
+
+    size_t ncompiled;
+    size_t nreused;
+};
+
+/* loads the modules of the n imports of the file from, NULL for a script
+ * that is not read from a file, and the modules they import in turn, and
+ * sets the module of each import, which functions, the table its functions
+ * are linked into, keeps. their paths are relative to the directory of
+ * from. a module that has not changed since it was last built and imports
+ * none that has is reused as it is. */
+kd_status modules_import(kd_modules* modules, const char* from, Import** imports, size_t n, Functions* functions, kd_error* error);
+
+/* a module is freed on the release of its last reference, by whichever
+ * thread that happens on. */
+void module_retain(Module* module);
+void module_release(Module* module);
+
+/* prefixes the message of error, which has a position in the file of a
+ * module, with path. */
+void error_in_module(kd_error* error, const char* path);
+
+#endif /* MODULE_H */
@@ -0,0 +1,1677 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+
+#include "onepass.h"
+#include "compiler.h"
+#include "resolver.h"
+#include "module.h"
+#include "parallel.h"
+#include "stats.h"
+
+#define MAX_REGISTERS UINT16_MAX
+#define MAX_CONSTANTS UINT16_MAX
+
+#define NO_INSTR SIZE_MAX
+
+/* a variable in scope. it lives in its register until the block declaring
+ * it ends, nothing is ever assigned to it after its declaration. */
+typedef struct Local_t {
+    Span id;
+    size_t line;
+    size_t col;
+
+    uint16_t reg;
+    Type type;
+} Local;
+
+/* a compiled expression: a register holding its value, or a constant that
+ * has not been loaded into one. type is what is known about the value, as
+ * in IrInstr.type, and line and col are those Expr would have. */
+typedef struct Operand_t {
+    int constant;
+    uint32_t index;
+
+    Type type;
+
+    size_t line;
+    size_t col;
+
+    /* the OP_INDEX that made the value. a field of it read right away is
+     * read in place, the OP_INDEX becoming an OP_INDEXFIELD. */
+    size_t index_instr;
+} Operand;
+
+/* a call to a function declared further down the root, its c operand is
+ * filled in once the root has been read. */
+typedef struct PendingCall_t {
+    size_t instr;
+    Span name;
+    size_t nargs;
+
+    /* made in the body of a par for. */
+    int parallel;
+
+    size_t line;
+    size_t col;
+} PendingCall;
+
+/* the reduction of the innermost loop a yield adds to, op is 0 when there
+ * is none. */
+typedef struct Reduction_t {
+    char op;
+    ValueKind kind;
+    uint16_t reg;
+} Reduction;
+
+/* registers are a stack. the locals of the blocks being compiled take the
+ * bottom of it and an expression compiled with top at some register leaves
+ * its value there, if it needs one at all, and frees everything above. */
+typedef struct OnePass_t {
+    Parser* parser;
+
+    /* the chunk is built in malloc'd buffers and copied into the arena once
+     * its final size is known. */
+    Instr* code;
+    Position* positions;
+    size_t size;
+    size_t capacity;
+
+    Value* constants;
+    size_t nconstants;
+    size_t constants_capacity;
+
+    /* numbers and bools get one constant per value, string literals one
+     * each. open addressing, index + 1 of the constant, 0 when empty. */
+    uint32_t* table;
+    size_t table_capacity;
+
+    Local* locals;
+    size_t nlocals;
+    size_t locals_capacity;
+
+    /* the structs in scope, innermost last, and every struct of the chunk,
+     * in the order of their indexes. */
+    const RecordType** scope;
+    size_t nscope;
+    size_t scope_capacity;
+
+    const RecordType** records;
+    size_t nrecords;
+    size_t records_capacity;
+
+    /* which fields of the struct literals being compiled have been given,
+     * innermost last. */
+    unsigned char* given;
+    size_t ngiven;
+    size_t given_capacity;
+
+    /* the functions that can be called, the first nfunctions of the table.
+     * the root of a program can declare more at its top level and call
+     * them before their declaration, a body only calls. */
+    Functions* functions;
+    size_t nfunctions;
+    int root;
+    size_t depth;
+
+    /* where the root imports modules from, and whether it has had a
+     * statement other than an import, after which it cannot import. */
+    const kd_compile_options* options;
+    int declared;
+
+    PendingCall* pending;
+    size_t npending;
+    size_t pending_capacity;
+
+    /* a par for runs its iterations in order here, but gets the checks of
+     * the resolver all the same, and a reduction is split into the chunks
+     * parallel_for would run so it comes out the same. */
+    Reduction reduction;
+    int parallel;
+    size_t nbackedges;
+
+    size_t top;
+    size_t nregisters;
+} OnePass;
+
+static void onepass_error(OnePass* pass, size_t line, size_t col, const char* fmt, ...);
+static void out_of_memory(OnePass* pass);
+static void* grow(OnePass* pass, void* items, size_t* capacity, size_t count, size_t size);
+static void release(OnePass* pass);
+
+static size_t emit(OnePass* pass, Instr instr, size_t line, size_t col);
+static void patch(OnePass* pass, size_t jump);
+static Operand add_constant(OnePass* pass, Value value, size_t line, size_t col);
+static uint16_t push(OnePass* pass);
+static uint16_t to_register(OnePass* pass, Operand* operand);
+static void move_to(OnePass* pass, const Operand* operand, size_t reg);
+static Operand in_register(uint16_t reg, Type type, size_t line, size_t col);
+
+static const Local* lookup(OnePass* pass, Span id);
+static const RecordType* lookup_struct(OnePass* pass, Span name);
+static uint16_t record_slot(OnePass* pass, const RecordType* record, size_t line, size_t col);
+static void resolve_type(OnePass* pass, Type* type, size_t line, size_t col);
+
+static void compile_statement(OnePass* pass);
+static void compile_let(OnePass* pass);
+static void compile_if(OnePass* pass);
+static void compile_for(OnePass* pass);
+static void emit_loop(OnePass* pass, size_t header, size_t line, size_t col);
+static void compile_yield(OnePass* pass);
+static void compile_block(OnePass* pass);
+static void compile_struct(OnePass* pass);
+static void compile_fn(OnePass* pass);
+static void compile_import(OnePass* pass);
+static void link_calls(OnePass* pass);
+static void finish(OnePass* pass, Arena* arena, Chunk* chunk);
+
+static Operand compile_expression(OnePass* pass, size_t prec);
+static Operand compile_postfix(OnePass* pass);
+static Operand compile_primary(OnePass* pass);
+static Operand compile_field(OnePass* pass, Operand* record, Token dot, Span name, size_t top);
+static Operand compile_call(OnePass* pass, Token callee);
+static Operand compile_fn_call(OnePass* pass, Token callee, size_t base, size_t nargs);
+static void check_parallel_call(OnePass* pass, const Function* function, Span name, size_t line, size_t col);
+static Operand compile_array(OnePass* pass, Token open);
+static Operand compile_map(OnePass* pass, Token token);
+static Operand compile_record(OnePass* pass, Token name);
+static size_t compile_list(OnePass* pass, TokenKind close, Type* types, size_t ntypes);
+
+static size_t precedence(Token token, char* binop);
+static Type known(ValueKind kind);
+static int same_type(const Type* a, const Type* b);
+static Type binary_type(char binop, const Type* lhs, const Type* rhs);
+static Type builtin_type(Builtin builtin, const Type* args, size_t nargs);
+static Type index_type(const Type* array);
+
+kd_status compile_one_pass(Parser* parser, Functions* functions, const kd_compile_options* options, Arena* arena, Chunk* chunk) {
+    OnePass pass = {
+        .parser = parser,
+        .functions = functions,
+        .root = 1,
+        .options = options,
+    };
+
+    if (setjmp(parser->bail)) {
+        release(&pass);
+        return parser->error->status;
+    }
+
+    compile_statement(&pass);
+
+    Token end = parser->current;
+    emit(&pass, (Instr) { .op = OP_HALT }, end.line, end.col);
+
+    link_calls(&pass);
+    finish(&pass, arena, chunk);
+
+    release(&pass);
+    return KD_OK;
+}
+
+/* the arguments are the first locals. */
+kd_status compile_one_pass_function(Parser* parser, Function* function, Arena* arena, Chunk* chunk) {
+    OnePass pass = {
+        .parser = parser,
+        .functions = function->table,
+        .nfunctions = function->nfunctions,
+    };
+
+    if (setjmp(parser->bail)) {
+        release(&pass);
+        return parser->error->status;
+    }
+
+    pass.scope = grow(&pass, pass.scope, &pass.scope_capacity, function->nrecords, sizeof(RecordType*));
+    pass.locals = grow(&pass, pass.locals, &pass.locals_capacity, function->nparams, sizeof(Local));
+
+    for (size_t i = 0; i < function->nrecords; i++)
+        pass.scope[pass.nscope++] = function->records[i];
+
+    for (size_t i = 0; i < function->nparams; i++) {
+        pass.locals[pass.nlocals++] = (Local) {
+            .id = function->names[i],
+            .line = function->line,
+            .col = function->col,
+            .reg = i,
+            .type = function->params[i],
+        };
+    }
+
+    pass.top = function->nparams;
+    pass.nregisters = function->nparams;
+
+    compile_block(&pass);
+
+    /* running off the end is reported at the body, as by the ir. */
+    emit(&pass, (Instr) { .op = OP_HALT }, function->body_line, function->body_col);
+
+    finish(&pass, arena, chunk);
+
+    release(&pass);
+    return KD_OK;
+}
+
+static void finish(OnePass* pass, Arena* arena, Chunk* chunk) {
+    chunk->size = pass->size;
+    chunk->nconstants = pass->nconstants;
+    chunk->nrecords = pass->nrecords;
+    chunk->nregisters = pass->nregisters;
+    chunk->tasks = NULL;
+    chunk->ntasks = 0;
+    chunk->parfors = NULL;
+    chunk->nparfors = 0;
+    chunk->nbackedges = pass->nbackedges;
+    chunk->loops = NULL;
+    chunk->tier = NULL;
+
+    chunk->code = arena_alloc(arena, (pass->size + 1) * sizeof(Instr));
+    chunk->positions = arena_alloc(arena, (pass->size + 1) * sizeof(Position));
+    chunk->constants = arena_alloc(arena, (pass->nconstants + 1) * sizeof(Value));
+    chunk->records = arena_alloc(arena, (pass->nrecords + 1) * sizeof(RecordType*));
+    chunk->backedges = arena_alloc(arena, (pass->nbackedges + 1) * sizeof(uint32_t));
+
+    if (chunk->code == NULL || chunk->positions == NULL || chunk->constants == NULL || chunk->records == NULL
+        || chunk->backedges == NULL)
+        out_of_memory(pass);
+
+    /* the stats count a chunk as one piece. */
+    stats_alloc(KD_MEMORY_BYTECODE, (pass->size + 1) * (sizeof(Instr) + sizeof(Position)) + (pass->nconstants + 1) * sizeof(Value)
+        + (pass->nrecords + 1) * sizeof(RecordType*) + (pass->nbackedges + 1) * sizeof(uint32_t));
+
+    memset(chunk->backedges, 0, (pass->nbackedges + 1) * sizeof(uint32_t));
+
+    memcpy(chunk->code, pass->code, pass->size * sizeof(Instr));
+    memcpy(chunk->positions, pass->positions, pass->size * sizeof(Position));
+    if (pass->nconstants > 0)
+        memcpy(chunk->constants, pass->constants, pass->nconstants * sizeof(Value));
+    if (pass->nrecords > 0)
+        memcpy(chunk->records, pass->records, pass->nrecords * sizeof(RecordType*));
+}
+
+/* every function of the root can be called from anywhere in it, so the
+ * calls made before a declaration are only checked once all are known. */
+static void link_calls(OnePass* pass) {
+    Functions* functions = pass->functions;
+
+    for (size_t i = 0; i < pass->npending; i++) {
+        const PendingCall* call = &pass->pending[i];
+        size_t slot;
+        const Function* function = functions_lookup(functions, call->name, functions->count, &slot);
+
+        if (function == NULL)
+            onepass_error(pass, call->line, call->col, "undefined function '%.*s'", (int)call->name.size, call->name.data);
+
+        if (call->nargs != function->nparams) {
+            onepass_error(pass, call->line, call->col, "'%.*s' takes %zu argument(s) but got %zu",
+                (int)call->name.size, call->name.data, function->nparams, call->nargs);
+        }
+
+        if (call->parallel)
+            check_parallel_call(pass, function, call->name, call->line, call->col);
+
+        pass->code[call->instr].c = slot;
+    }
+
+    for (size_t i = 0; i < functions->count; i++) {
+        if (functions->items[i]->table == functions)
+            functions->items[i]->nfunctions = functions->count;
+    }
+}
+
+static void onepass_error(OnePass* pass, size_t line, size_t col, const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+
+    kd_error* error = pass->parser->error;
+
+    error->status = KD_ERROR_SYNTAX;
+    error->line = line;
+    error->col = col;
+    vsnprintf(error->message, sizeof(error->message), fmt, args);
+
+    va_end(args);
+    longjmp(pass->parser->bail, 1);
+}
+
+static void out_of_memory(OnePass* pass) {
+    kd_error* error = pass->parser->error;
+
+    error->status = KD_ERROR_NOMEM;
+    error->line = 0;
+    error->col = 0;
+    snprintf(error->message, sizeof(error->message), "cannot allocate memory!");
+
+    longjmp(pass->parser->bail, 1);
+}
+
+/* items with room for at least count of them. */
+static void* grow(OnePass* pass, void* items, size_t* capacity, size_t count, size_t size) {
+    if (count <= *capacity)
+        return items;
+
+    size_t grown = *capacity == 0 ? 16 : *capacity * 2;
+    while (grown < count)
+        grown *= 2;
+
+    void* data = realloc(items, grown * size);
+    if (data == NULL)
+        out_of_memory(pass);
+
+    *capacity = grown;
+    return data;
+}
+
+static void release(OnePass* pass) {
+    free(pass->code);
+    free(pass->positions);
+    free(pass->constants);
+    free(pass->table);
+    free(pass->locals);
+    free(pass->scope);
+    free(pass->records);
+    free(pass->given);
+    free(pass->pending);
+}
+
+static size_t emit(OnePass* pass, Instr instr, size_t line, size_t col) {
+    if (pass->size == pass->capacity) {
+        size_t capacity = pass->capacity == 0 ? 64 : pass->capacity * 2;
+
+        Instr* code = realloc(pass->code, capacity * sizeof(Instr));
+        if (code == NULL)
+            out_of_memory(pass);
+        pass->code = code;
+
+        Position* positions = realloc(pass->positions, capacity * sizeof(Position));
+        if (positions == NULL)
+            out_of_memory(pass);
+        pass->positions = positions;
+
+        pass->capacity = capacity;
+    }
+
+    pass->code[pass->size] = instr;
+    pass->positions[pass->size] = (Position) {
+        .line = line,
+        .col = col,
+    };
+
+    return pass->size++;
+}
+
+/* points the jump at the next instruction to be emitted. */
+static void patch(OnePass* pass, size_t jump) {
+    pass->code[jump].sbx = (int32_t)(pass->size - jump - 1);
+}
+
+static uint64_t hash_constant(const Value* value) {
+    uint64_t bits = value->kind == VAL_BOOL ? (uint64_t)value->bool : (uint64_t)value->i64;
+    uint64_t hash = (0xcbf29ce484222325ull ^ value->kind) * 0x100000001b3ull;
+
+    hash = (hash ^ bits) * 0x100000001b3ull;
+    return hash ^ hash >> 32;
+}
+
+static int equal_constants(const Value* a, const Value* b) {
+    if (a->kind != b->kind)
+        return 0;
+
+    return a->kind == VAL_BOOL ? a->bool == b->bool : a->i64 == b->i64;
+}
+
+/* the table is kept at most half full. */
+static Operand add_constant(OnePass* pass, Value value, size_t line, size_t col) {
+    int shared = value.kind != VAL_STRING;
+    size_t slot = 0;
+
+    if (shared && (pass->nconstants + 1) * 2 > pass->table_capacity) {
+        size_t capacity = pass->table_capacity == 0 ? 64 : pass->table_capacity * 2;
+
+        uint32_t* table = calloc(capacity, sizeof(uint32_t));
+        if (table == NULL)
+            out_of_memory(pass);
+
+        for (size_t i = 0; i < pass->table_capacity; i++) {
+            if (pass->table[i] == 0)
+                continue;
+
+            size_t j = hash_constant(&pass->constants[pass->table[i] - 1]) & (capacity - 1);
+            while (table[j] != 0)
+                j = (j + 1) & (capacity - 1);
+
+            table[j] = pass->table[i];
+        }
+
+        free(pass->table);
+        pass->table = table;
+        pass->table_capacity = capacity;
+    }
+
+    Operand operand = {
+        .constant = 1,
+        .type = known(value.kind),
+        .line = line,
+        .col = col,
+        .index_instr = NO_INSTR,
+    };
+
+    if (shared) {
+        size_t mask = pass->table_capacity - 1;
+
+        for (slot = hash_constant(&value) & mask; pass->table[slot] != 0; slot = (slot + 1) & mask) {
+            if (equal_constants(&pass->constants[pass->table[slot] - 1], &value)) {
+                operand.index = pass->table[slot] - 1;
+                return operand;
+            }
+        }
+    }
+
+    if (pass->nconstants == MAX_CONSTANTS)
+        onepass_error(pass, line, col, "too many constants in one program");
+
+    pass->constants = grow(pass, pass->constants, &pass->constants_capacity, pass->nconstants + 1, sizeof(Value));
+    pass->constants[pass->nconstants] = value;
+
+    if (shared)
+        pass->table[slot] = pass->nconstants + 1;
+
+    operand.index = pass->nconstants++;
+    return operand;
+}
+
+/* the register on top of the stack. */
+static uint16_t push(OnePass* pass) {
+    if (pass->top >= MAX_REGISTERS) {
+        Token token = pass->parser->current;
+        onepass_error(pass, token.line, token.col, "expression needs too many registers");
+    }
+
+    if (pass->top + 1 > pass->nregisters)
+        pass->nregisters = pass->top + 1;
+
+    return pass->top++;
+}
+
+/* the register holding the value of operand, loading a constant into the
+ * top of the stack first. */
+static uint16_t to_register(OnePass* pass, Operand* operand) {
+    if (!operand->constant)
+        return operand->index;
+
+    uint16_t reg = push(pass);
+    emit(pass, (Instr) { .op = OP_LOADK, .a = reg, .bx = operand->index }, operand->line, operand->col);
+
+    operand->constant = 0;
+    operand->index = reg;
+
+    return reg;
+}
+
+/* puts the value of operand in reg, which the caller has taken. */
+static void move_to(OnePass* pass, const Operand* operand, size_t reg) {
+    if (reg + 1 > pass->nregisters)
+        pass->nregisters = reg + 1;
+
+    if (operand->constant)
+        emit(pass, (Instr) { .op = OP_LOADK, .a = reg, .bx = operand->index }, operand->line, operand->col);
+    else if (operand->index != reg)
+        emit(pass, (Instr) { .op = OP_MOVE, .a = reg, .b = operand->index }, operand->line, operand->col);
+}
+
+static Operand in_register(uint16_t reg, Type type, size_t line, size_t col) {
+    return (Operand) {
+        .constant = 0,
+        .index = reg,
+        .type = type,
+        .line = line,
+        .col = col,
+        .index_instr = NO_INSTR,
+    };
+}
+
+static const Local* lookup(OnePass* pass, Span id) {
+    for (size_t i = pass->nlocals; i > 0; i--) {
+        if (span_equals(pass->locals[i - 1].id, id))
+            return &pass->locals[i - 1];
+    }
+
+    return NULL;
+}
+
+static const RecordType* lookup_struct(OnePass* pass, Span name) {
+    for (size_t i = pass->nscope; i > 0; i--) {
+        if (span_equals(pass->scope[i - 1]->name, name))
+            return pass->scope[i - 1];
+    }
+
+    return NULL;
+}
+
+/* as in compiler.c, a struct the chunk does not declare gets an index the
+ * first time it is used. */
+static uint16_t record_slot(OnePass* pass, const RecordType* record, size_t line, size_t col) {
+    for (size_t i = 0; i < pass->nrecords; i++) {
+        if (pass->records[i] == record)
+            return i;
+    }
+
+    if (pass->nrecords == MAX_RECORD_TYPES)
+        onepass_error(pass, line, col, "too many structs");
+
+    pass->records = grow(pass, pass->records, &pass->records_capacity, pass->nrecords + 1, sizeof(RecordType*));
+    pass->records[pass->nrecords] = record;
+
+    return pass->nrecords++;
+}
+
+static void resolve_type(OnePass* pass, Type* type, size_t line, size_t col) {
+    if (type->kind != VAL_RECORD && type->kind != VAL_RECORD_ARRAY)
+        return;
+
+    type->record = lookup_struct(pass, type->name);
+
+    if (type->record == NULL)
+        onepass_error(pass, line, col, "undefined struct '%.*s'", (int)type->name.size, type->name.data);
+}
+
+static void compile_statement(OnePass* pass) {
+    Parser* parser = pass->parser;
+    Token start = parser->current;
+    size_t top = pass->top;
+
+    if (start.kind != TOK_IMPORT && pass->depth == 1)
+        pass->declared = 1;
+
+    switch (start.kind) {
+    case TOK_LET:
+        compile_let(pass);
+        return;
+    case TOK_IF:
+        compile_if(pass);
+        return;
+    case TOK_FOR:
+    case TOK_PAR:
+        compile_for(pass);
+        return;
+    case TOK_YIELD:
+        compile_yield(pass);
+        break;
+    case TOK_LBRACE:
+        compile_block(pass);
+        return;
+    case TOK_STRUCT:
+        compile_struct(pass);
+        return;
+    case TOK_FN:
+        compile_fn(pass);
+        return;
+    case TOK_IMPORT:
+        compile_import(pass);
+        return;
+    case TOK_RETURN: {
+        if (pass->parallel)
+            onepass_error(pass, start.line, start.col, "cannot return from a par for");
+
+        parser_advance(parser);
+
+        Operand value = compile_expression(pass, 1);
+        uint16_t reg = to_register(pass, &value);
+
+        parser_match(parser, TOK_SEMICOLON);
+
+        emit(pass, (Instr) { .op = OP_RETURN, .a = reg }, start.line, start.col);
+        break;
+    }
+    default:
+        compile_expression(pass, 1);
+        parser_match(parser, TOK_SEMICOLON);
+        break;
+    }
+
+    pass->top = top;
+}
+
+/* the variable takes the register its value is computed in, and is not
+ * visible in its own initialiser. */
+static void compile_let(OnePass* pass) {
+    Parser* parser = pass->parser;
+    Token start = parser->current;
+
+    parser_match(parser, TOK_LET);
+
+    Token id = parser->current;
+    parser_match(parser, TOK_IDENTIFIER);
+    parser_match(parser, TOK_COLON);
+
+    Type type = parse_type(parser);
+
+    parser_match(parser, TOK_EQUAL);
+
+    size_t reg = pass->top;
+    Operand value = compile_expression(pass, 1);
+
+    parser_match(parser, TOK_SEMICOLON);
+
+    resolve_type(pass, &type, start.line, start.col);
+
+    const Local* existing = lookup(pass, id.span);
+    if (existing != NULL) {
+        onepass_error(pass, start.line, start.col, "'%.*s' shadows the variable declared at (%zu:%zu)",
+            (int)id.span.size, id.span.data, existing->line, existing->col);
+    }
+
+    move_to(pass, &value, reg);
+    pass->top = reg + 1;
+
+    if (!same_type(&value.type, &type)) {
+        size_t slot = type.record != NULL ? record_slot(pass, type.record, start.line, start.col) : 0;
+        emit(pass, (Instr) { .op = OP_DEFINE, .a = reg, .c = define_operand(type, slot) }, start.line, start.col);
+    }
+
+    pass->locals = grow(pass, pass->locals, &pass->locals_capacity, pass->nlocals + 1, sizeof(Local));
+    pass->locals[pass->nlocals++] = (Local) {
+        .id = id.span,
+        .line = start.line,
+        .col = start.col,
+        .reg = reg,
+        .type = type,
+    };
+}
+
+static void compile_if(OnePass* pass) {
+    Parser* parser = pass->parser;
+    Token start = parser->current;
+    size_t top = pass->top;
+
+    parser_match(parser, TOK_IF);
+    parser_match(parser, TOK_LPAREN);
+
+    Operand condition = compile_expression(pass, 1);
+    uint16_t reg = to_register(pass, &condition);
+
+    parser_match(parser, TOK_RPAREN);
+
+    size_t skip = emit(pass, (Instr) { .op = OP_JMPIFNOT, .a = reg }, condition.line, condition.col);
+    pass->top = top;
+
+    compile_block(pass);
+
+    if (parser->current.kind != TOK_ELSE) {
+        patch(pass, skip);
+        return;
+    }
+
+    parser_advance(parser);
+
+    size_t over = emit(pass, (Instr) { .op = OP_JMP }, start.line, start.col);
+    patch(pass, skip);
+
+    compile_block(pass);
+    patch(pass, over);
+}
+
+/* the index and the upper bound of a loop take two registers, and its
+ * reduction the one after them. as in the ir, both bounds are checked to be
+ * i64s and the index is compared with the upper bound before every
+ * iteration. the result is moved down to the first register once the loop
+ * is done, the variable it becomes living there.
+ *
+ * a par for with a reduction goes through the range in the PARFOR_CHUNKS
+ * chunks of parallel_for, in an outer loop taking the step and the end of
+ * the chunk as two more registers: each chunk reduces into a register of
+ * its own, starting from nothing, which is then added to the result, so
+ * the rounding of an f64 is the same as with OP_PARFOR. */
+static void compile_for(OnePass* pass) {
+    Parser* parser = pass->parser;
+    Token start = parser->current;
+    int parallel = start.kind == TOK_PAR;
+    Type i64 = known(VAL_INT);
+
+    if (parallel)
+        parser_advance(parser);
+
+    parser_match(parser, TOK_FOR);
+    parser_match(parser, TOK_LPAREN);
+
+    Token var = parser->current;
+    parser_match(parser, TOK_IDENTIFIER);
+    parser_match(parser, TOK_IN);
+
+    uint16_t index = push(pass);
+    uint16_t bound = push(pass);
+
+    Operand from = compile_expression(pass, 1);
+    move_to(pass, &from, index);
+    if (!same_type(&from.type, &i64))
+        emit(pass, (Instr) { .op = OP_DEFINE, .a = index, .c = define_operand(i64, 0) }, from.line, from.col);
+    pass->top = bound + 1;
+
+    parser_match(parser, TOK_DOTDOT);
+
+    Operand to = compile_expression(pass, 1);
+    move_to(pass, &to, bound);
+    if (!same_type(&to.type, &i64))
+        emit(pass, (Instr) { .op = OP_DEFINE, .a = bound, .c = define_operand(i64, 0) }, to.line, to.col);
+    pass->top = bound + 1;
+
+    parser_match(parser, TOK_RPAREN);
+
+    Reduction outer = pass->reduction;
+    int outer_parallel = pass->parallel;
+    Reduction reduction = { 0 };
+    Operand initial = { 0 };
+    Token result = { 0 };
+    Type type = { 0 };
+
+    if (parser->current.kind == TOK_REDUCE) {
+        parser_advance(parser);
+        parser_match(parser, TOK_LPAREN);
+
+        if (parser->current.kind == TOK_PLUS)
+            reduction.op = '+';
+        else if (parser->current.kind == TOK_STAR)
+            reduction.op = '*';
+        else
+            parser_error_unexpected(parser, "+ or *");
+
+        parser_advance(parser);
+        parser_match(parser, TOK_RPAREN);
+
+        result = parser->current;
+        parser_match(parser, TOK_IDENTIFIER);
+        parser_match(parser, TOK_COLON);
+
+        Token token = parser->current;
+        type = parse_type(parser);
+
+        if (type.kind != VAL_INT && type.kind != VAL_DOUBLE)
+            onepass_error(pass, token.line, token.col, "a reduction has to be i64 or f64");
+
+        reduction.kind = type.kind;
+        reduction.reg = push(pass);
+
+        Value identity = type.kind == VAL_INT
+            ? (Value) { .kind = VAL_INT, .i64 = reduction.op == '*' }
+            : (Value) { .kind = VAL_DOUBLE, .f64 = reduction.op == '*' };
+        initial = add_constant(pass, identity, start.line, start.col);
+        move_to(pass, &initial, reduction.reg);
+    }
+
+    uint16_t total = reduction.reg;
+    uint16_t step = 0;
+    uint16_t limit = bound;
+    int split = parallel && reduction.op != 0;
+
+    if (split) {
+        step = push(pass);
+        limit = push(pass);
+        reduction.reg = push(pass);
+    }
+
+    const Local* existing = lookup(pass, var.span);
+    if (existing != NULL) {
+        onepass_error(pass, start.line, start.col, "'%.*s' shadows the variable declared at (%zu:%zu)",
+            (int)var.span.size, var.span.data, existing->line, existing->col);
+    }
+
+    size_t nlocals = pass->nlocals;
+    pass->locals = grow(pass, pass->locals, &pass->locals_capacity, pass->nlocals + 1, sizeof(Local));
+    pass->locals[pass->nlocals++] = (Local) {
+        .id = var.span,
+        .line = start.line,
+        .col = start.col,
+        .reg = index,
+        .type = i64,
+    };
+
+    /* a par for without a reduction of its own has nothing a yield could
+     * add to from many iterations at once. */
+    if (reduction.op != 0 || parallel)
+        pass->reduction = reduction;
+    pass->parallel = outer_parallel || parallel;
+
+    /* the step is the length over PARFOR_CHUNKS rounded up, and a chunk
+     * ends a step further on or at the bound. */
+    size_t chunks = 0;
+    size_t chunks_exit = 0;
+
+    if (split) {
+        Operand rounding = add_constant(pass, (Value) { .kind = VAL_INT, .i64 = PARFOR_CHUNKS - 1 }, start.line, start.col);
+        Operand nchunks = add_constant(pass, (Value) { .kind = VAL_INT, .i64 = PARFOR_CHUNKS }, start.line, start.col);
+
+        emit(pass, (Instr) { .op = binary_instruction('-', VAL_INT, VAL_INT, NULL), .a = step, .b = bound, .c = index }, start.line, start.col);
+        Instr round = {
+            .op = binary_instruction('+', VAL_INT, VAL_INT, &pass->constants[rounding.index]),
+            .a = step,
+            .b = step,
+            .c = rounding.index,
+        };
+        emit(pass, round, start.line, start.col);
+        Instr divide = {
+            .op = binary_instruction('/', VAL_INT, VAL_INT, &pass->constants[nchunks.index]),
+            .a = step,
+            .b = step,
+            .c = nchunks.index,
+        };
+        emit(pass, divide, start.line, start.col);
+
+        chunks = pass->size;
+        uint16_t test = push(pass);
+        emit(pass, (Instr) { .op = OP_LT_I64, .a = test, .b = index, .c = bound }, start.line, start.col);
+        chunks_exit = emit(pass, (Instr) { .op = OP_JMPIFNOT, .a = test }, start.line, start.col);
+
+        emit(pass, (Instr) { .op = binary_instruction('+', VAL_INT, VAL_INT, NULL), .a = limit, .b = index, .c = step }, start.line, start.col);
+        emit(pass, (Instr) { .op = OP_LT_I64, .a = test, .b = bound, .c = limit }, start.line, start.col);
+        size_t inside = emit(pass, (Instr) { .op = OP_JMPIFNOT, .a = test }, start.line, start.col);
+        emit(pass, (Instr) { .op = OP_MOVE, .a = limit, .b = bound }, start.line, start.col);
+        patch(pass, inside);
+        pass->top = test;
+
+        move_to(pass, &initial, reduction.reg);
+    }
+
+    size_t header = pass->size;
+    uint16_t test = push(pass);
+    emit(pass, (Instr) { .op = OP_LT_I64, .a = test, .b = index, .c = limit }, start.line, start.col);
+    size_t exit = emit(pass, (Instr) { .op = OP_JMPIFNOT, .a = test }, start.line, start.col);
+    pass->top = test;
+
+    compile_block(pass);
+
+    Operand one = add_constant(pass, (Value) { .kind = VAL_INT, .i64 = 1 }, start.line, start.col);
+    Instr increment = {
+        .op = binary_instruction('+', VAL_INT, VAL_INT, &pass->constants[one.index]),
+        .a = index,
+        .b = index,
+        .c = one.index,
+    };
+    emit(pass, increment, start.line, start.col);
+
+    emit_loop(pass, header, start.line, start.col);
+    patch(pass, exit);
+
+    if (split) {
+        Instr add = {
+            .op = binary_instruction(reduction.op, reduction.kind, reduction.kind, NULL),
+            .a = total,
+            .b = total,
+            .c = reduction.reg,
+        };
+        emit(pass, add, start.line, start.col);
+
+        emit_loop(pass, chunks, start.line, start.col);
+        patch(pass, chunks_exit);
+    }
+
+    pass->nlocals = nlocals;
+    pass->reduction = outer;
+    pass->parallel = outer_parallel;
+    pass->top = index;
+
+    if (reduction.op == 0)
+        return;
+
+    /* the result is not visible in the loop. */
+    existing = lookup(pass, result.span);
+    if (existing != NULL) {
+        onepass_error(pass, start.line, start.col, "'%.*s' shadows the variable declared at (%zu:%zu)",
+            (int)result.span.size, result.span.data, existing->line, existing->col);
+    }
+
+    emit(pass, (Instr) { .op = OP_MOVE, .a = index, .b = total }, start.line, start.col);
+    pass->top = index + 1;
+
+    pass->locals = grow(pass, pass->locals, &pass->locals_capacity, pass->nlocals + 1, sizeof(Local));
+    pass->locals[pass->nlocals++] = (Local) {
+        .id = result.span,
+        .line = start.line,
+        .col = start.col,
+        .reg = index,
+        .type = type,
+    };
+}
+
+/* jumps back to header, the jump counting as a back edge of the chunk. */
+static void emit_loop(OnePass* pass, size_t header, size_t line, size_t col) {
+    if (pass->nbackedges == MAX_LOOPS)
+        onepass_error(pass, line, col, "too many loops in one program");
+
+    size_t loop = emit(pass, (Instr) { .op = OP_LOOP, .a = pass->nbackedges++ }, line, col);
+    pass->code[loop].sbx = (int32_t)header - (int32_t)(loop + 1);
+}
+
+/* adds the value to the reduction of the innermost loop with one, checking
+ * it is of the reduction's kind first. */
+static void compile_yield(OnePass* pass) {
+    Parser* parser = pass->parser;
+    Token start = parser->current;
+    Reduction* reduction = &pass->reduction;
+
+    if (reduction->op == 0)
+        onepass_error(pass, start.line, start.col, "yield outside of a for with a reduction");
+
+    parser_advance(parser);
+
+    Operand value = compile_expression(pass, 1);
+    Type type = known(reduction->kind);
+
+    parser_match(parser, TOK_SEMICOLON);
+
+    if (!same_type(&value.type, &type)) {
+        uint16_t reg = to_register(pass, &value);
+        emit(pass, (Instr) { .op = OP_DEFINE, .a = reg, .c = define_operand(type, 0) }, start.line, start.col);
+        value.type = type;
+    }
+
+    Instr instr = {
+        .op = binary_instruction(reduction->op, reduction->kind, reduction->kind, value.constant ? &pass->constants[value.index] : NULL),
+        .a = reduction->reg,
+        .b = reduction->reg,
+        .c = value.index,
+    };
+    emit(pass, instr, start.line, start.col);
+}
+
+/* leaving a block frees the registers of its locals and forgets its
+ * structs, though they keep their index. */
+static void compile_block(OnePass* pass) {
+    Parser* parser = pass->parser;
+
+    size_t nlocals = pass->nlocals;
+    size_t nscope = pass->nscope;
+    size_t top = pass->top;
+
+    parser_match(parser, TOK_LBRACE);
+    pass->depth++;
+
+    while (parser->current.kind != TOK_RBRACE) {
+        if (parser->current.kind == TOK_EOF)
+            parser_match(parser, TOK_RBRACE);
+
+        compile_statement(pass);
+    }
+
+    parser_match(parser, TOK_RBRACE);
+
+    pass->depth--;
+    pass->nlocals = nlocals;
+    pass->nscope = nscope;
+    pass->top = top;
+}
+
+static void compile_struct(OnePass* pass) {
+    Token start = pass->parser->current;
+    RecordType* record = parse_struct(pass->parser);
+
+    const RecordType* existing = lookup_struct(pass, record->name);
+    if (existing != NULL && existing->path != NULL) {
+        onepass_error(pass, record->line, record->col, "'%.*s' shadows the struct imported from '%s'",
+            (int)record->name.size, record->name.data, existing->path);
+    }
+
+    if (existing != NULL) {
+        onepass_error(pass, record->line, record->col, "'%.*s' shadows the struct declared at (%zu:%zu)",
+            (int)record->name.size, record->name.data, existing->line, existing->col);
+    }
+
+    if (pass->nrecords == MAX_RECORD_TYPES)
+        onepass_error(pass, start.line, start.col, "too many structs");
+
+    pass->records = grow(pass, pass->records, &pass->records_capacity, pass->nrecords + 1, sizeof(RecordType*));
+    pass->records[pass->nrecords++] = record;
+
+    pass->scope = grow(pass, pass->scope, &pass->scope_capacity, pass->nscope + 1, sizeof(RecordType*));
+    pass->scope[pass->nscope++] = record;
+}
+
+/* the checks declare_function makes in the resolver. the signature sees
+ * the structs declared at the top level so far, and so will the body. */
+static void compile_fn(OnePass* pass) {
+    Token start = pass->parser->current;
+    Function* function = parse_function(pass->parser);
+    Functions* functions = pass->functions;
+    Span name = function->name;
+
+    Builtin builtin;
+    size_t nargs;
+
+    if (!pass->root || pass->depth != 1)
+        onepass_error(pass, start.line, start.col, "functions can only be declared at the top level");
+
+    if (builtin_lookup(name, &builtin, &nargs))
+        onepass_error(pass, function->line, function->col, "'%.*s' is a builtin function", (int)name.size, name.data);
+
+    const Function* existing = functions_lookup(functions, name, functions->count, NULL);
+
+    if (existing != NULL && existing->table->path != NULL) {
+        onepass_error(pass, function->line, function->col, "'%.*s' shadows the function imported from '%s'",
+            (int)name.size, name.data, existing->table->path);
+    }
+
+    if (existing != NULL) {
+        onepass_error(pass, function->line, function->col, "'%.*s' shadows the function declared at (%zu:%zu)",
+            (int)name.size, name.data, existing->line, existing->col);
+    }
+
+    for (size_t i = 0; i < function->nparams; i++)
+        resolve_type(pass, &function->params[i], function->line, function->col);
+
+    resolve_type(pass, &function->result, function->line, function->col);
+
+    if (functions->count == MAX_FUNCTIONS)
+        onepass_error(pass, function->line, function->col, "too many functions");
+
+    function->records = arena_alloc(functions->arena, (pass->nscope + 1) * sizeof(RecordType*));
+    if (function->records == NULL || !functions_add(functions, function))
+        out_of_memory(pass);
+
+    if (pass->nscope > 0)
+        memcpy(function->records, pass->scope, pass->nscope * sizeof(RecordType*));
+
+    function->nrecords = pass->nscope;
+}
+
+/* the checks import_module makes in the resolver. the module is loaded
+ * right away, what it declares is visible from here on. */
+static void compile_import(OnePass* pass) {
+    Token start = pass->parser->current;
+    Import import = parse_import(pass->parser);
+    Functions* functions = pass->functions;
+
+    if (!pass->root || pass->depth != 1)
+        onepass_error(pass, start.line, start.col, "modules can only be imported at the top level");
+
+    if (pass->declared)
+        onepass_error(pass, start.line, start.col, "imports have to come before the other statements");
+
+    Import* imports = &import;
+    if (modules_import(pass->options->modules, pass->options->path, &imports, 1, functions, pass->parser->error) != KD_OK)
+        longjmp(pass->parser->bail, 1);
+
+    const Module* module = import.module;
+
+    for (size_t i = 0; i < module->nrecords; i++) {
+        const RecordType* record = module->records[i];
+        const RecordType* existing = lookup_struct(pass, record->name);
+
+        if (existing == record)
+            continue;
+
+        if (existing != NULL) {
+            onepass_error(pass, start.line, start.col, "struct '%.*s' of '%s' shadows the one of '%s'",
+                (int)record->name.size, record->name.data, module->path, existing->path);
+        }
+
+        pass->scope = grow(pass, pass->scope, &pass->scope_capacity, pass->nscope + 1, sizeof(RecordType*));
+        pass->scope[pass->nscope++] = record;
+    }
+
+    for (size_t i = 0; i < module->functions.count; i++) {
+        Function* function = module->functions.items[i];
+        if (function->table != &module->functions)
+            continue;
+
+        const Function* existing = functions_lookup(functions, function->name, functions->count, NULL);
+
+        if (existing == function)
+            continue;
+
+        if (existing != NULL) {
+            onepass_error(pass, start.line, start.col, "function '%.*s' of '%s' shadows the one of '%s'",
+                (int)function->name.size, function->name.data, module->path, existing->table->path);
+        }
+
+        if (functions->count == MAX_FUNCTIONS)
+            onepass_error(pass, start.line, start.col, "too many functions");
+
+        if (!functions_link(functions, function))
+            out_of_memory(pass);
+    }
+}
+
+/* precedence climbing like the parser. the left operand is in a register
+ * by the time the right one is compiled, the right one may stay a
+ * constant. */
+static Operand compile_expression(OnePass* pass, size_t prec) {
+    Parser* parser = pass->parser;
+    size_t top = pass->top;
+
+    Operand lhs = compile_postfix(pass);
+
+    for (;;) {
+        Token token = parser->current;
+        char binop;
+        size_t next = precedence(token, &binop);
+
+        if (next == 0 || next < prec)
+            return lhs;
+
+        parser_advance(parser);
+
+        uint16_t lhs_reg = to_register(pass, &lhs);
+        Operand rhs = compile_expression(pass, next + 1);
+
+        /* c is the constant or the register of the right hand side. */
+        Instr instr = {
+            .op = binary_instruction(binop, lhs.type.kind, rhs.type.kind, rhs.constant ? &pass->constants[rhs.index] : NULL),
+            .b = lhs_reg,
+            .c = rhs.index,
+        };
+
+        pass->top = top;
+        instr.a = push(pass);
+        emit(pass, instr, token.line, token.col);
+
+        lhs = in_register(instr.a, binary_type(binop, &lhs.type, &rhs.type), token.line, token.col);
+    }
+}
+
+static Operand compile_postfix(OnePass* pass) {
+    Parser* parser = pass->parser;
+    size_t top = pass->top;
+
+    Operand value = compile_primary(pass);
+
+    for (;;) {
+        Token token = parser->current;
+
+        if (token.kind == TOK_DOT) {
+            parser_advance(parser);
+
+            Token name = parser->current;
+            parser_match(parser, TOK_IDENTIFIER);
+
+            value = compile_field(pass, &value, token, name.span, top);
+            continue;
+        }
+
+        if (token.kind != TOK_LBRACKET)
+            return value;
+
+        parser_advance(parser);
+
+        uint16_t array = to_register(pass, &value);
+        Operand index = compile_expression(pass, 1);
+        uint16_t index_reg = to_register(pass, &index);
+
+        parser_match(parser, TOK_RBRACKET);
+
+        pass->top = top;
+        uint16_t dst = push(pass);
+        size_t instr = emit(pass, (Instr) { .op = OP_INDEX, .a = dst, .b = array, .c = index_reg }, token.line, token.col);
+
+        value = in_register(dst, index_type(&value.type), token.line, token.col);
+        value.index_instr = instr;
+    }
+}
+
+static Operand compile_primary(OnePass* pass) {
+    Parser* parser = pass->parser;
+    Token token = parser->current;
+    Value value;
+
+    switch (token.kind) {
+    case TOK_INTLITERAL:
+        value = (Value) { .kind = VAL_INT, .i64 = strtol(token.span.data, NULL, 10) };
+        break;
+    case TOK_DOUBLELITERAL:
+        value = (Value) { .kind = VAL_DOUBLE, .f64 = strtod(token.span.data, NULL) };
+        break;
+    case TOK_BOOLTRUE:
+    case TOK_BOOLFALSE:
+        value = (Value) { .kind = VAL_BOOL, .bool = token.kind == TOK_BOOLTRUE };
+        break;
+    case TOK_STRINGLITERAL: {
+        Span text = parse_string_literal(parser);
+
+        if (!string_constant(parser->constants, text.data, text.size, &value))
+            out_of_memory(pass);
+
+        break;
+    }
+    case TOK_IDENTIFIER: {
+        parser_advance(parser);
+
+        if (parser->current.kind == TOK_LPAREN)
+            return compile_call(pass, token);
+        if (parser->current.kind == TOK_LBRACE)
+            return compile_record(pass, token);
+
+        const Local* local = lookup(pass, token.span);
+        if (local == NULL) {
+            onepass_error(pass, token.line, token.col, "undefined variable '%.*s'",
+                (int)token.span.size, token.span.data);
+        }
+
+        return in_register(local->reg, local->type, token.line, token.col);
+    }
+    case TOK_LBRACKET:
+        return compile_array(pass, token);
+    case TOK_MAP:
+        return compile_map(pass, token);
+    default:
+        parser_error_unexpected(parser, "value");
+        return (Operand) { 0 };
+    }
+
+    parser_advance(parser);
+    return add_constant(pass, value, token.line, token.col);
+}
+
+/* the resolver's rules: the field has to be of a struct, or an array of
+ * them, whose type is known before the program runs. */
+static Operand compile_field(OnePass* pass, Operand* record, Token dot, Span name, size_t top) {
+    Type type = record->type;
+
+    if (type.kind != VAL_RECORD && type.kind != VAL_RECORD_ARRAY) {
+        onepass_error(pass, dot.line, dot.col, "'.%.*s' needs a struct or an array of structs of a known type",
+            (int)name.size, name.data);
+    }
+
+    const RecordField* field = NULL;
+
+    for (size_t i = 0; i < type.record->nfields && field == NULL; i++) {
+        if (span_equals(type.record->fields[i].name, name))
+            field = &type.record->fields[i];
+    }
+
+    if (field == NULL) {
+        onepass_error(pass, dot.line, dot.col, "struct '%.*s' has no field '%.*s'",
+            (int)type.record->name.size, type.record->name.data, (int)name.size, name.data);
+    }
+
+    int column = type.kind == VAL_RECORD_ARRAY;
+
+    /* there is no []bool to put the column in. */
+    if (column && field->kind == VAL_BOOL) {
+        onepass_error(pass, dot.line, dot.col, "'.%.*s' is a bool field, only i64 and f64 fields make a column",
+            (int)name.size, name.data);
+    }
+
+    Type result = column ? known(field->kind == VAL_INT ? VAL_INT_ARRAY : VAL_DOUBLE_ARRAY) : known(field->kind);
+
+    if (!column && record->index_instr != NO_INSTR && record->index_instr == pass->size - 1) {
+        Instr* index = &pass->code[pass->size - 1];
+
+        index->op = OP_INDEXFIELD;
+        pass->positions[pass->size - 1] = (Position) { .line = dot.line, .col = dot.col };
+        emit(pass, (Instr) { .op = OP_EXTRAARG, .bx = field_operand(field) }, dot.line, dot.col);
+
+        return in_register(pass->code[pass->size - 2].a, result, dot.line, dot.col);
+    }
+
+    uint16_t reg = to_register(pass, record);
+
+    pass->top = top;
+    uint16_t dst = push(pass);
+    emit(pass, (Instr) { .op = column ? OP_COLUMN : OP_FIELD, .a = dst, .b = reg, .c = field_operand(field) }, dot.line, dot.col);
+
+    return in_register(dst, result, dot.line, dot.col);
+}
+
+/* the arguments go in consecutive registers, even len's one. */
+static Operand compile_call(OnePass* pass, Token callee) {
+    Parser* parser = pass->parser;
+    size_t base = pass->top;
+
+    Type types[2] = { known(VAL_IDENT), known(VAL_IDENT) };
+    Builtin builtin;
+    size_t nargs;
+
+    parser_match(parser, TOK_LPAREN);
+    size_t n = compile_list(pass, TOK_RPAREN, types, 2);
+
+    if (!builtin_lookup(callee.span, &builtin, &nargs))
+        return compile_fn_call(pass, callee, base, n);
+
+    if (n != nargs) {
+        onepass_error(pass, callee.line, callee.col, "'%.*s' takes %zu argument(s) but got %zu",
+            (int)callee.span.size, callee.span.data, nargs, n);
+    }
+
+    if (pass->parallel && (builtin == BUILTIN_PUT || builtin == BUILTIN_DEL))
+        onepass_error(pass, callee.line, callee.col, "a par for cannot write to a map");
+
+    pass->top = base;
+    uint16_t dst = push(pass);
+
+    if (builtin == BUILTIN_LEN)
+        emit(pass, (Instr) { .op = OP_LEN, .a = dst, .b = base }, callee.line, callee.col);
+    else
+        emit(pass, (Instr) { .op = OP_BUILTIN, .a = dst, .b = base, .c = builtin }, callee.line, callee.col);
+
+    return in_register(dst, builtin_type(builtin, types, n), callee.line, callee.col);
+}
+
+/* a call to a function the root has not declared yet is linked once the
+ * root is done, nothing is known about what it returns until then. */
+static Operand compile_fn_call(OnePass* pass, Token callee, size_t base, size_t nargs) {
+    Functions* functions = pass->functions;
+    size_t limit = pass->root ? functions->count : pass->nfunctions;
+    size_t slot = 0;
+    const Function* function = functions_lookup(functions, callee.span, limit, &slot);
+
+    if (function == NULL && !pass->root)
+        onepass_error(pass, callee.line, callee.col, "undefined function '%.*s'", (int)callee.span.size, callee.span.data);
+
+    if (function != NULL && nargs != function->nparams) {
+        onepass_error(pass, callee.line, callee.col, "'%.*s' takes %zu argument(s) but got %zu",
+            (int)callee.span.size, callee.span.data, function->nparams, nargs);
+    }
+
+    if (function != NULL && pass->parallel)
+        check_parallel_call(pass, function, callee.span, callee.line, callee.col);
+
+    pass->top = base;
+    uint16_t dst = push(pass);
+
+    size_t call = emit(pass, (Instr) { .op = OP_CALL, .a = dst, .b = base, .c = slot },
+        callee.line, callee.col);
+
+    if (function != NULL)
+        return in_register(dst, function->result, callee.line, callee.col);
+
+    pass->pending = grow(pass, pass->pending, &pass->pending_capacity, pass->npending + 1, sizeof(PendingCall));
+    pass->pending[pass->npending++] = (PendingCall) {
+        .instr = call,
+        .name = callee.span,
+        .nargs = nargs,
+        .parallel = pass->parallel,
+        .line = callee.line,
+        .col = callee.col,
+    };
+
+    return in_register(dst, known(VAL_IDENT), callee.line, callee.col);
+}
+
+/* only a map can be written to, and a function can write to one it is
+ * passed. */
+static void check_parallel_call(OnePass* pass, const Function* function, Span name, size_t line, size_t col) {
+    for (size_t i = 0; i < function->nparams; i++) {
+        if (function->params[i].kind == VAL_MAP) {
+            onepass_error(pass, line, col, "a par for cannot call '%.*s', which could write to a map",
+                (int)name.size, name.data);
+        }
+    }
+}
+
+static Operand compile_array(OnePass* pass, Token open) {
+    size_t base = pass->top;
+    Type element = known(VAL_IDENT);
+
+    parser_advance(pass->parser);
+    size_t n = compile_list(pass, TOK_RBRACKET, &element, 1);
+
+    /* there would be no element kind to give it. */
+    if (n == 0)
+        onepass_error(pass, open.line, open.col, "an array literal needs at least one element, use fill for an empty array");
+
+    if (n > UINT16_MAX)
+        onepass_error(pass, open.line, open.col, "too many elements in an array literal");
+
+    pass->top = base;
+    uint16_t dst = push(pass);
+    emit(pass, (Instr) { .op = OP_NEWARRAY, .a = dst, .b = base, .c = n }, open.line, open.col);
+
+    Type type = known(VAL_IDENT);
+
+    if (element.kind == VAL_INT || element.kind == VAL_DOUBLE)
+        type = known(element.kind == VAL_INT ? VAL_INT_ARRAY : VAL_DOUBLE_ARRAY);
+
+    if (element.kind == VAL_RECORD) {
+        type = element;
+        type.kind = VAL_RECORD_ARRAY;
+    }
+
+    return in_register(dst, type, open.line, open.col);
+}
+
+/* map[K]V { key: value, ... }, every entry is set as soon as it is read. */
+static Operand compile_map(OnePass* pass, Token token) {
+    Parser* parser = pass->parser;
+    Type type = parse_type(parser);
+
+    parser_match(parser, TOK_LBRACE);
+
+    uint16_t map = push(pass);
+    emit(pass, (Instr) { .op = OP_NEWMAP, .a = map, .b = type.key, .c = type.value }, token.line, token.col);
+
+    for (size_t n = 0; parser->current.kind != TOK_RBRACE; n++) {
+        if (n > 0)
+            parser_match(parser, TOK_COMMA);
+
+        Operand key = compile_expression(pass, 1);
+        uint16_t key_reg = to_register(pass, &key);
+
+        parser_match(parser, TOK_COLON);
+
+        Operand value = compile_expression(pass, 1);
+        uint16_t value_reg = to_register(pass, &value);
+
+        emit(pass, (Instr) { .op = OP_MAPSET, .a = map, .b = key_reg, .c = value_reg }, key.line, key.col);
+        pass->top = map + 1;
+    }
+
+    parser_match(parser, TOK_RBRACE);
+
+    return in_register(map, type, token.line, token.col);
+}
+
+/* Name { field: value, ... }. the values are computed in the order they
+ * are written, each into the register of its field. as long as they come
+ * in field order that is where they are computed anyway, after that the
+ * fields are all taken up front. */
+static Operand compile_record(OnePass* pass, Token name) {
+    Parser* parser = pass->parser;
+
+    const RecordType* record = lookup_struct(pass, name.span);
+    if (record == NULL)
+        onepass_error(pass, name.line, name.col, "undefined struct '%.*s'", (int)name.span.size, name.span.data);
+
+    size_t base = pass->top;
+    size_t nfields = record->nfields;
+    int in_order = 1;
+
+    size_t given = pass->ngiven;
+    pass->given = grow(pass, pass->given, &pass->given_capacity, given + nfields, sizeof(unsigned char));
+    pass->ngiven = given + nfields;
+    memset(pass->given + given, 0, nfields);
+
+    parser_match(parser, TOK_LBRACE);
+
+    for (size_t n = 0; parser->current.kind != TOK_RBRACE; n++) {
+        if (n > 0)
+            parser_match(parser, TOK_COMMA);
+
+        Span field_name = parser->current.span;
+        parser_match(parser, TOK_IDENTIFIER);
+        parser_match(parser, TOK_COLON);
+
+        size_t field = 0;
+        while (field < nfields && !span_equals(record->fields[field].name, field_name))
+            field++;
+
+        if (in_order && field != n) {
+            in_order = 0;
+
+            if (base + nfields > MAX_REGISTERS)
+                onepass_error(pass, name.line, name.col, "expression needs too many registers");
+            if (base + nfields > pass->nregisters)
+                pass->nregisters = base + nfields;
+        }
+
+        pass->top = in_order ? base + field : base + nfields;
+        Operand value = compile_expression(pass, 1);
+
+        if (field == nfields || pass->given[given + field]) {
+            onepass_error(pass, value.line, value.col,
+                field == nfields ? "struct '%.*s' has no field '%.*s'" : "struct '%.*s' field '%.*s' is given twice",
+                (int)record->name.size, record->name.data, (int)field_name.size, field_name.data);
+        }
+
+        pass->given[given + field] = 1;
+        move_to(pass, &value, base + field);
+    }
+
+    parser_match(parser, TOK_RBRACE);
+
+    for (size_t i = 0; i < nfields; i++) {
+        if (!pass->given[given + i]) {
+            Span field_name = record->fields[i].name;
+            onepass_error(pass, name.line, name.col, "struct '%.*s' field '%.*s' is missing",
+                (int)record->name.size, record->name.data, (int)field_name.size, field_name.data);
+        }
+    }
+
+    pass->ngiven = given;
+
+    pass->top = base;
+    uint16_t dst = push(pass);
+    emit(pass, (Instr) { .op = OP_NEWRECORD, .a = dst, .b = base, .c = record_slot(pass, record, name.line, name.col) }, name.line, name.col);
+
+    return in_register(dst, (Type) { .kind = VAL_RECORD, .name = record->name, .record = record }, name.line, name.col);
+}
+
+/* a comma separated list up to and including close, its values put in
+ * consecutive registers from the top of the stack. the types of the first
+ * ntypes of them are written to types. returns how many there were. */
+static size_t compile_list(OnePass* pass, TokenKind close, Type* types, size_t ntypes) {
+    Parser* parser = pass->parser;
+    size_t n = 0;
+
+    while (parser->current.kind != close) {
+        if (n > 0)
+            parser_match(parser, TOK_COMMA);
+
+        size_t reg = pass->top;
+        Operand value = compile_expression(pass, 1);
+
+        if (n < ntypes)
+            types[n] = value.type;
+
+        pass->top = reg;
+        push(pass);
+        move_to(pass, &value, reg);
+        n++;
+    }
+
+    parser_match(parser, close);
+    return n;
+}
+
+/* 0 means the token is not a binary operator. */
+static size_t precedence(Token token, char* binop) {
+    switch (token.kind) {
+    case TOK_EQUALEQUAL:
+        *binop = '=';
+        return 1;
+    case TOK_BANGEQUAL:
+        *binop = '!';
+        return 1;
+    case TOK_PLUS:
+        *binop = '+';
+        return 2;
+    case TOK_MINUS:
+        *binop = '-';
+        return 2;
+    case TOK_STAR:
+        *binop = '*';
+        return 3;
+    case TOK_SLASH:
+        *binop = '/';
+        return 3;
+    default:
+        return 0;
+    }
+}
+
+static Type known(ValueKind kind) {
+    return (Type) { .kind = kind };
+}
+
+/* like ir_same_type: a DEFINE of a value known to be of the declared type
+ * cannot fail and is left out. */
+static int same_type(const Type* a, const Type* b) {
+    if (a->kind != b->kind || a->kind == VAL_IDENT)
+        return 0;
+
+    if (a->kind == VAL_MAP)
+        return a->key == b->key && a->value == b->value;
+
+    if (a->kind == VAL_RECORD || a->kind == VAL_RECORD_ARRAY)
+        return a->record == b->record;
+
+    return 1;
+}
+
+/* the rules of the ir, see binary_type in ir.c. */
+static Type binary_type(char binop, const Type* lhs, const Type* rhs) {
+    if (binop == '=' || binop == '!')
+        return known(VAL_BOOL);
+
+    if (lhs->kind == VAL_INT_ARRAY || lhs->kind == VAL_DOUBLE_ARRAY)
+        return known(lhs->kind);
+    if (rhs->kind == VAL_INT_ARRAY || rhs->kind == VAL_DOUBLE_ARRAY)
+        return known(rhs->kind);
+
+    if (lhs->kind == rhs->kind && (lhs->kind == VAL_INT || lhs->kind == VAL_DOUBLE || (lhs->kind == VAL_STRING && binop == '+')))
+        return known(lhs->kind);
+
+    return known(VAL_IDENT);
+}
+
+static Type builtin_type(Builtin builtin, const Type* args, size_t nargs) {
+    switch (builtin) {
+    case BUILTIN_LEN:
+    case BUILTIN_PRINT:
+    case BUILTIN_PRINTLN:
+        return known(VAL_INT);
+    case BUILTIN_HAS:
+    case BUILTIN_PUT:
+    case BUILTIN_DEL:
+        return known(VAL_BOOL);
+    case BUILTIN_FILL:
+    case BUILTIN_IOTA: {
+        const Type* element = &args[1];
+
+        if (element->kind == VAL_INT || element->kind == VAL_DOUBLE)
+            return known(element->kind == VAL_INT ? VAL_INT_ARRAY : VAL_DOUBLE_ARRAY);
+
+        if (element->kind == VAL_RECORD && builtin == BUILTIN_FILL) {
+            Type type = *element;
+            type.kind = VAL_RECORD_ARRAY;
+            return type;
+        }
+
+        return known(VAL_IDENT);
+    }
+    default:
+        if (nargs > 0 && args[0].kind == VAL_INT_ARRAY)
+            return known(VAL_INT);
+        if (nargs > 0 && args[0].kind == VAL_DOUBLE_ARRAY)
+            return known(VAL_DOUBLE);
+
+        return known(VAL_IDENT);
+    }
+}
+
+static Type index_type(const Type* array) {
+    switch (array->kind) {
+    case VAL_INT_ARRAY:
+        return known(VAL_INT);
+    case VAL_DOUBLE_ARRAY:
+        return known(VAL_DOUBLE);
+    case VAL_MAP:
+        return known(array->value);
+    case VAL_RECORD_ARRAY: {
+        Type type = *array;
+        type.kind = VAL_RECORD;
+        return type;
+    }
+    default:
+        return known(VAL_IDENT);
+    }
+}
@@ -0,0 +1,25 @@
+#ifndef ONEPASS_H
+#define ONEPASS_H
+
+#include "kidomaru.h"
+#include "arena.h"
+#include "parser.h"
+#include "bytecode.h"
+#include "function.h"
+
+/* compiles the root statement straight from the tokens of parser to a
+ * chunk, with no tree, resolver or ssa form in between: every expression is
+ * emitted as soon as it has been read. it accepts the same programs as
+ * parsing, resolving and compiling them does and the chunk does the same
+ * when run, only without the passes. the chunk is allocated from arena and
+ * errors are written to parser->error. the tokens after the root statement
+ * are left to the caller. the functions the root declares are added to
+ * functions, and it imports modules as options say. the one program it does not accept is one reading a field
+ * straight from a call to a function declared further down, as what that
+ * returns is not known yet. */
+kd_status compile_one_pass(Parser* parser, Functions* functions, const kd_compile_options* options, Arena* arena, Chunk* chunk);
+
+/* compiles the body of function the same way, parser being at its '{'. */
+kd_status compile_one_pass_function(Parser* parser, Function* function, Arena* arena, Chunk* chunk);
+
+#endif /* ONEPASS_H */
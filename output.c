@@ -0,0 +1,493 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "output.h"
+
+/* two characters for every number below 100, so an integer takes one
+ * division for every two of its digits. */
+static const char digit_pairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static OutputStatus reserve(Output* output, size_t size);
+static size_t format_u64(char* buffer, uint64_t n);
+static OutputStatus output_array(Output* output, const Value* value);
+static int grisu2(double d, char* digits, int* exponent);
+
+Output output_init(int fd) {
+    return (Output) {
+        .data = NULL,
+        .size = 0,
+        .capacity = 0,
+        .fd = fd,
+        .held = 0,
+    };
+}
+
+void output_deinit(Output* output) {
+    free(output->data);
+    *output = output_init(output->fd);
+}
+
+OutputStatus output_value(Output* output, const Value* value, int newline) {
+    OutputStatus status;
+
+    if (reserve(output, OUTPUT_NUMBER_MAX + 1) != OUTPUT_OK)
+        return OUTPUT_NOMEM;
+
+    char* end = output->data + output->size;
+
+    /* a number and its newline fit in what was reserved. */
+    switch (value->kind) {
+    case VAL_INT:
+        end += output_format_i64(end, value->i64);
+        *end = '\n';
+        output->size = end + (newline != 0) - output->data;
+        return OUTPUT_OK;
+    case VAL_DOUBLE:
+        end += output_format_f64(end, value->f64);
+        *end = '\n';
+        output->size = end + (newline != 0) - output->data;
+        return OUTPUT_OK;
+    case VAL_BOOL:
+        status = value->bool ? output_bytes(output, "true", 4) : output_bytes(output, "false", 5);
+        if (status != OUTPUT_OK)
+            return status;
+        break;
+    case VAL_STRING: {
+        const char* data = string_data(value);
+        if (data == NULL)
+            return OUTPUT_NOMEM;
+
+        status = output_bytes(output, data, string_size(value));
+        if (status != OUTPUT_OK)
+            return status;
+        break;
+    }
+    case VAL_INT_ARRAY:
+    case VAL_DOUBLE_ARRAY:
+        status = output_array(output, value);
+        if (status != OUTPUT_OK)
+            return status;
+        break;
+    default:
+        return OUTPUT_KIND;
+    }
+
+    return newline ? output_bytes(output, "\n", 1) : OUTPUT_OK;
+}
+
+OutputStatus output_bytes(Output* output, const char* data, size_t size) {
+    if (size == 0)
+        return OUTPUT_OK;
+
+    if (reserve(output, size) != OUTPUT_OK)
+        return OUTPUT_NOMEM;
+
+    memcpy(output->data + output->size, data, size);
+    output->size += size;
+
+    return OUTPUT_OK;
+}
+
+OutputStatus output_insert(Output* output, size_t at, const char* data, size_t size) {
+    if (size == 0)
+        return OUTPUT_OK;
+
+    if (reserve(output, size) != OUTPUT_OK)
+        return OUTPUT_NOMEM;
+
+    memmove(output->data + at + size, output->data + at, output->size - at);
+    memcpy(output->data + at, data, size);
+    output->size += size;
+
+    return OUTPUT_OK;
+}
+
+/* a write may take only part of the buffer, or be interrupted. */
+OutputStatus output_flush(Output* output, int all) {
+    if (output->fd < 0 || output->held > 0 || (!all && output->size < OUTPUT_FLUSH))
+        return OUTPUT_OK;
+
+    size_t written = 0;
+
+    while (written < output->size) {
+        ssize_t n = write(output->fd, output->data + written, output->size - written);
+
+        if (n < 0 && errno == EINTR)
+            continue;
+
+        if (n <= 0) {
+            memmove(output->data, output->data + written, output->size - written);
+            output->size -= written;
+            return OUTPUT_WRITE;
+        }
+
+        written += n;
+    }
+
+    output->size = 0;
+    return OUTPUT_OK;
+}
+
+size_t output_format_i64(char* buffer, int64_t n) {
+    if (n >= 0)
+        return format_u64(buffer, n);
+
+    buffer[0] = '-';
+    return 1 + format_u64(buffer + 1, 0 - (uint64_t)n);
+}
+
+/* the digits from grisu2, written plainly when the decimal exponent is from
+ * -5 to 15 and in scientific notation otherwise. a plain number always has
+ * a '.', so 2.0 does not print as the i64 2. */
+size_t output_format_f64(char* buffer, double d) {
+    char* p = buffer;
+
+    if (d != d) {
+        memcpy(p, "nan", 3);
+        return 3;
+    }
+
+    if (signbit(d)) {
+        *p++ = '-';
+        d = -d;
+    }
+
+    if (d == 0) {
+        memcpy(p, "0.0", 3);
+        return p - buffer + 3;
+    }
+
+    if (isinf(d)) {
+        memcpy(p, "inf", 3);
+        return p - buffer + 3;
+    }
+
+    char digits[20];
+    int exponent;
+    int ndigits = grisu2(d, digits, &exponent);
+
+    /* the decimal point goes after the first point digits. */
+    int point = ndigits + exponent;
+
+    if (point > 16 || point < -4) {
+        *p++ = digits[0];
+        if (ndigits > 1) {
+            *p++ = '.';
+            memcpy(p, digits + 1, ndigits - 1);
+            p += ndigits - 1;
+        }
+
+        *p++ = 'e';
+        *p++ = point - 1 < 0 ? '-' : '+';
+        p += format_u64(p, point - 1 < 0 ? 1 - point : point - 1);
+
+        return p - buffer;
+    }
+
+    if (point <= 0) {
+        memcpy(p, "0.", 2);
+        p += 2;
+        memset(p, '0', -point);
+        p += -point;
+        memcpy(p, digits, ndigits);
+        p += ndigits;
+    } else if (point >= ndigits) {
+        memcpy(p, digits, ndigits);
+        p += ndigits;
+        memset(p, '0', point - ndigits);
+        p += point - ndigits;
+        memcpy(p, ".0", 2);
+        p += 2;
+    } else {
+        memcpy(p, digits, point);
+        p += point;
+        *p++ = '.';
+        memcpy(p, digits + point, ndigits - point);
+        p += ndigits - point;
+    }
+
+    return p - buffer;
+}
+
+/* room for size more bytes, growing by doubling. */
+static OutputStatus reserve(Output* output, size_t size) {
+    if (output->size + size <= output->capacity)
+        return OUTPUT_OK;
+
+    size_t capacity = output->capacity == 0 ? OUTPUT_FLUSH + 4096 : output->capacity;
+    while (capacity < output->size + size)
+        capacity *= 2;
+
+    char* data = realloc(output->data, capacity);
+    if (data == NULL)
+        return OUTPUT_NOMEM;
+
+    output->data = data;
+    output->capacity = capacity;
+
+    return OUTPUT_OK;
+}
+
+/* the digits are made from the back, two at a time, then moved to the
+ * front of buffer. */
+static size_t format_u64(char* buffer, uint64_t n) {
+    char digits[20];
+    char* p = digits + sizeof(digits);
+
+    while (n >= 100) {
+        unsigned pair = n % 100;
+        n /= 100;
+        p -= 2;
+        memcpy(p, &digit_pairs[pair * 2], 2);
+    }
+
+    if (n >= 10) {
+        p -= 2;
+        memcpy(p, &digit_pairs[n * 2], 2);
+    } else {
+        *--p = '0' + n;
+    }
+
+    size_t size = digits + sizeof(digits) - p;
+    memcpy(buffer, p, size);
+
+    return size;
+}
+
+static OutputStatus output_array(Output* output, const Value* value) {
+    const ArrayObject* array = value->array;
+    int is_int = value->kind == VAL_INT_ARRAY;
+
+    if (output_bytes(output, "[", 1) != OUTPUT_OK)
+        return OUTPUT_NOMEM;
+
+    for (size_t i = 0; i < array->size; i++) {
+        if (reserve(output, OUTPUT_NUMBER_MAX + 2) != OUTPUT_OK)
+            return OUTPUT_NOMEM;
+
+        char* end = output->data + output->size;
+
+        if (i > 0) {
+            memcpy(end, ", ", 2);
+            end += 2;
+            output->size += 2;
+        }
+
+        output->size += is_int ? output_format_i64(end, array->i64[i]) : output_format_f64(end, array->f64[i]);
+    }
+
+    return output_bytes(output, "]", 1);
+}
+
+/* grisu2, after Florian Loitsch's "Printing Floating-Point Numbers Quickly
+ * and Accurately with Integers". the digits always read back as d and are
+ * the shortest that do for all but a few doubles, which get one more. a
+ * DiyFp is f * 2^e with a 64 bit f. */
+typedef struct DiyFp_t {
+    uint64_t f;
+    int e;
+} DiyFp;
+
+#define DP_SIGNIFICAND_MASK 0x000fffffffffffffull
+#define DP_EXPONENT_MASK 0x7ff0000000000000ull
+#define DP_HIDDEN_BIT 0x0010000000000000ull
+#define DP_EXPONENT_BIAS (0x3ff + 52)
+
+/* 10^k for k = -348, -340, ... 340, normalised and rounded. */
+static const DiyFp cached_powers[] = {
+    { 0xfa8fd5a0081c0288ull, -1220 }, { 0xbaaee17fa23ebf76ull, -1193 },
+    { 0x8b16fb203055ac76ull, -1166 }, { 0xcf42894a5dce35eaull, -1140 },
+    { 0x9a6bb0aa55653b2dull, -1113 }, { 0xe61acf033d1a45dfull, -1087 },
+    { 0xab70fe17c79ac6caull, -1060 }, { 0xff77b1fcbebcdc4full, -1034 },
+    { 0xbe5691ef416bd60cull, -1007 }, { 0x8dd01fad907ffc3cull, -980 },
+    { 0xd3515c2831559a83ull, -954 }, { 0x9d71ac8fada6c9b5ull, -927 },
+    { 0xea9c227723ee8bcbull, -901 }, { 0xaecc49914078536dull, -874 },
+    { 0x823c12795db6ce57ull, -847 }, { 0xc21094364dfb5637ull, -821 },
+    { 0x9096ea6f3848984full, -794 }, { 0xd77485cb25823ac7ull, -768 },
+    { 0xa086cfcd97bf97f4ull, -741 }, { 0xef340a98172aace5ull, -715 },
+    { 0xb23867fb2a35b28eull, -688 }, { 0x84c8d4dfd2c63f3bull, -661 },
+    { 0xc5dd44271ad3cdbaull, -635 }, { 0x936b9fcebb25c996ull, -608 },
+    { 0xdbac6c247d62a584ull, -582 }, { 0xa3ab66580d5fdaf6ull, -555 },
+    { 0xf3e2f893dec3f126ull, -529 }, { 0xb5b5ada8aaff80b8ull, -502 },
+    { 0x87625f056c7c4a8bull, -475 }, { 0xc9bcff6034c13053ull, -449 },
+    { 0x964e858c91ba2655ull, -422 }, { 0xdff9772470297ebdull, -396 },
+    { 0xa6dfbd9fb8e5b88full, -369 }, { 0xf8a95fcf88747d94ull, -343 },
+    { 0xb94470938fa89bcfull, -316 }, { 0x8a08f0f8bf0f156bull, -289 },
+    { 0xcdb02555653131b6ull, -263 }, { 0x993fe2c6d07b7facull, -236 },
+    { 0xe45c10c42a2b3b06ull, -210 }, { 0xaa242499697392d3ull, -183 },
+    { 0xfd87b5f28300ca0eull, -157 }, { 0xbce5086492111aebull, -130 },
+    { 0x8cbccc096f5088ccull, -103 }, { 0xd1b71758e219652cull, -77 },
+    { 0x9c40000000000000ull, -50 }, { 0xe8d4a51000000000ull, -24 },
+    { 0xad78ebc5ac620000ull, 3 }, { 0x813f3978f8940984ull, 30 },
+    { 0xc097ce7bc90715b3ull, 56 }, { 0x8f7e32ce7bea5c70ull, 83 },
+    { 0xd5d238a4abe98068ull, 109 }, { 0x9f4f2726179a2245ull, 136 },
+    { 0xed63a231d4c4fb27ull, 162 }, { 0xb0de65388cc8ada8ull, 189 },
+    { 0x83c7088e1aab65dbull, 216 }, { 0xc45d1df942711d9aull, 242 },
+    { 0x924d692ca61be758ull, 269 }, { 0xda01ee641a708deaull, 295 },
+    { 0xa26da3999aef774aull, 322 }, { 0xf209787bb47d6b85ull, 348 },
+    { 0xb454e4a179dd1877ull, 375 }, { 0x865b86925b9bc5c2ull, 402 },
+    { 0xc83553c5c8965d3dull, 428 }, { 0x952ab45cfa97a0b3ull, 455 },
+    { 0xde469fbd99a05fe3ull, 481 }, { 0xa59bc234db398c25ull, 508 },
+    { 0xf6c69a72a3989f5cull, 534 }, { 0xb7dcbf5354e9beceull, 561 },
+    { 0x88fcf317f22241e2ull, 588 }, { 0xcc20ce9bd35c78a5ull, 614 },
+    { 0x98165af37b2153dfull, 641 }, { 0xe2a0b5dc971f303aull, 667 },
+    { 0xa8d9d1535ce3b396ull, 694 }, { 0xfb9b7cd9a4a7443cull, 720 },
+    { 0xbb764c4ca7a44410ull, 747 }, { 0x8bab8eefb6409c1aull, 774 },
+    { 0xd01fef10a657842cull, 800 }, { 0x9b10a4e5e9913129ull, 827 },
+    { 0xe7109bfba19c0c9dull, 853 }, { 0xac2820d9623bf429ull, 880 },
+    { 0x80444b5e7aa7cf85ull, 907 }, { 0xbf21e44003acdd2dull, 933 },
+    { 0x8e679c2f5e44ff8full, 960 }, { 0xd433179d9c8cb841ull, 986 },
+    { 0x9e19db92b4e31ba9ull, 1013 }, { 0xeb96bf6ebadf77d9ull, 1039 },
+    { 0xaf87023b9bf0ee6bull, 1066 },
+};
+
+/* up to 10^19, the fractional digits of a number can go that far before
+ * the rounding below gives up. */
+static const uint64_t powers_of_10[] = {
+    1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull, 10000000ull,
+    100000000ull, 1000000000ull, 10000000000ull, 100000000000ull,
+    1000000000000ull, 10000000000000ull, 100000000000000ull,
+    1000000000000000ull, 10000000000000000ull, 100000000000000000ull,
+    1000000000000000000ull, 10000000000000000000ull,
+};
+
+static DiyFp diy_multiply(DiyFp a, DiyFp b) {
+    unsigned __int128 product = (unsigned __int128)a.f * b.f;
+    uint64_t high = product >> 64;
+    uint64_t low = (uint64_t)product;
+
+    /* rounded to nearest. */
+    if (low & 1ull << 63)
+        high++;
+
+    return (DiyFp) { .f = high, .e = a.e + b.e + 64 };
+}
+
+static DiyFp diy_normalize(DiyFp x) {
+    int shift = __builtin_clzll(x.f);
+    return (DiyFp) { .f = x.f << shift, .e = x.e - shift };
+}
+
+/* the power of ten that brings the exponent of a number normalised to e
+ * into [-60, -32], and its decimal exponent k. */
+static DiyFp cached_power(int e, int* k) {
+    double dk = (-61 - e) * 0.30102999566398114 + 347;
+    int ik = (int)dk;
+    if (dk - ik > 0.0)
+        ik++;
+
+    unsigned index = (unsigned)((ik >> 3) + 1);
+    *k = -(-348 + (int)index * 8);
+
+    return cached_powers[index];
+}
+
+/* moves the last digit down while that brings it closer to the number and
+ * keeps it within the boundaries. */
+static void grisu_round(char* digits, int ndigits, uint64_t delta, uint64_t rest, uint64_t ten_kappa, uint64_t wp_w) {
+    while (rest < wp_w && delta - rest >= ten_kappa
+           && (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w)) {
+        digits[ndigits - 1]--;
+        rest += ten_kappa;
+    }
+}
+
+static int count_digits(uint32_t n) {
+    int count = 1;
+    while (count < 10 && n >= powers_of_10[count])
+        count++;
+
+    return count;
+}
+
+static int digit_gen(DiyFp w, DiyFp mp, uint64_t delta, char* digits, int* k) {
+    DiyFp one = { .f = 1ull << -mp.e, .e = mp.e };
+    uint64_t wp_w = mp.f - w.f;
+    uint32_t p1 = (uint32_t)(mp.f >> -one.e);
+    uint64_t p2 = mp.f & (one.f - 1);
+    int kappa = count_digits(p1);
+    int ndigits = 0;
+
+    while (kappa > 0) {
+        uint32_t digit = (uint32_t)(p1 / powers_of_10[kappa - 1]);
+        p1 %= powers_of_10[kappa - 1];
+
+        if (digit != 0 || ndigits != 0)
+            digits[ndigits++] = '0' + digit;
+
+        kappa--;
+
+        uint64_t rest = ((uint64_t)p1 << -one.e) + p2;
+        if (rest <= delta) {
+            *k += kappa;
+            grisu_round(digits, ndigits, delta, rest, (uint64_t)powers_of_10[kappa] << -one.e, wp_w);
+            return ndigits;
+        }
+    }
+
+    for (;;) {
+        p2 *= 10;
+        delta *= 10;
+
+        char digit = (char)(p2 >> -one.e);
+        if (digit != 0 || ndigits != 0)
+            digits[ndigits++] = '0' + digit;
+
+        p2 &= one.f - 1;
+        kappa--;
+
+        if (p2 < delta) {
+            *k += kappa;
+            grisu_round(digits, ndigits, delta, p2, one.f, wp_w * (-kappa < 20 ? powers_of_10[-kappa] : 0));
+            return ndigits;
+        }
+    }
+}
+
+/* the digits of a finite d > 0, and the exponent making them d. */
+static int grisu2(double d, char* digits, int* exponent) {
+    uint64_t bits;
+    memcpy(&bits, &d, sizeof(bits));
+
+    int biased = (int)((bits & DP_EXPONENT_MASK) >> 52);
+    uint64_t significand = bits & DP_SIGNIFICAND_MASK;
+
+    DiyFp v = biased != 0
+        ? (DiyFp) { .f = significand + DP_HIDDEN_BIT, .e = biased - DP_EXPONENT_BIAS }
+        : (DiyFp) { .f = significand, .e = 1 - DP_EXPONENT_BIAS };
+
+    /* the numbers halfway to the doubles on either side. */
+    DiyFp plus = diy_normalize((DiyFp) { .f = (v.f << 1) + 1, .e = v.e - 1 });
+    DiyFp minus = v.f == DP_HIDDEN_BIT
+        ? (DiyFp) { .f = (v.f << 2) - 1, .e = v.e - 2 }
+        : (DiyFp) { .f = (v.f << 1) - 1, .e = v.e - 1 };
+
+    minus.f <<= minus.e - plus.e;
+    minus.e = plus.e;
+
+    int k;
+    DiyFp c_mk = cached_power(plus.e, &k);
+
+    DiyFp w = diy_multiply(diy_normalize(v), c_mk);
+    DiyFp wp = diy_multiply(plus, c_mk);
+    DiyFp wm = diy_multiply(minus, c_mk);
+
+    wm.f++;
+    wp.f--;
+
+    *exponent = k;
+    return digit_gen(w, wp, wp.f - wm.f, digits, exponent);
+}
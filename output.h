@@ -0,0 +1,61 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "value.h"
+
+/* what print and println write, formatted into one buffer per interpreter
+ * and handed to write(2) in large pieces. */
+typedef struct Output_t {
+    char* data;
+    size_t size;
+    size_t capacity;
+
+    /* where the buffer is written, -1 keeps everything for whoever reads
+     * it out, as for the runs of tasks and par fors on other threads. */
+    int fd;
+
+    /* tasks that are to insert their output into the buffer have not done
+     * so yet, and nothing is written before they have. */
+    size_t held;
+} Output;
+
+/* a buffer is written once it holds this much. */
+#define OUTPUT_FLUSH (64 * 1024)
+
+typedef enum OutputStatus_t {
+    OUTPUT_OK,
+    OUTPUT_NOMEM,
+    OUTPUT_KIND,    /* a value print has no text for */
+    OUTPUT_WRITE,   /* write(2) failed, errno tells why */
+} OutputStatus;
+
+Output output_init(int fd);
+void output_deinit(Output* output);
+
+/* appends the text of value, and a newline after it with newline. i64s,
+ * f64s, bools, strings and arrays of numbers can be printed. an f64 is
+ * written with the fewest digits that read back as the same double. */
+OutputStatus output_value(Output* output, const Value* value, int newline);
+
+OutputStatus output_bytes(Output* output, const char* data, size_t size);
+
+/* puts the size bytes of data at offset at of the buffer, before what
+ * follows there. */
+OutputStatus output_insert(Output* output, size_t at, const char* data, size_t size);
+
+/* writes the buffer out and empties it unless it is held or has nowhere to
+ * go. with all, it is written whatever its size, otherwise only once it has
+ * reached OUTPUT_FLUSH. */
+OutputStatus output_flush(Output* output, int all);
+
+/* the characters of n and of d, as output_value writes them, into buffer
+ * of at least OUTPUT_NUMBER_MAX bytes. returns how many there are. */
+#define OUTPUT_NUMBER_MAX 32
+
+size_t output_format_i64(char* buffer, int64_t n);
+size_t output_format_f64(char* buffer, double d);
+
+#endif /* OUTPUT_H */
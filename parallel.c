@@ -0,0 +1,958 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "parallel.h"
+
+/* a par for being run, shared by the jobs running its chunks. it is kept
+ * on the interpreter running it while that one is suspended on its
+ * OP_PARFOR, and goes on from there when the run is resumed. */
+typedef struct ParForRun_t {
+    Parallel* parallel;
+    const ChunkParFor* parfor;
+
+    /* references of its own, the registers of the run may be released
+     * while it is suspended. */
+    Value* args;
+
+    /* chunk i runs from + i * step up to the next one, the last one up to
+     * to. */
+    int64_t from;
+    int64_t to;
+    uint64_t step;
+    size_t nchunks;
+
+    /* by chunk. */
+    Value* results;
+    Output* outputs;
+
+    /* the first chunk that failed, nchunks while none has. the chunks after
+     * it are skipped, or stopped, since their results are not needed. */
+    size_t failed;
+    kd_status status;
+    kd_error error;
+
+    /* run on the calling thread, the chunks one after the other on an
+     * interpreter of its own, which has begun chunk next when started. */
+    int in_order;
+    Interpreter interpreter;
+    kd_error chunk_error;
+    size_t next;
+    int started;
+
+    /* or on the pool, each job reporting what it ran every slice
+     * instructions, of which charged has been charged to the run already.
+     * guarded by the lock of parallel, as are the jobs not done yet. */
+    struct ParForJob_t* jobs;
+    int64_t slice;
+    int64_t fuel_used;
+    int64_t charged;
+    size_t remaining;
+
+    /* the run is over, chunks still to start do not. */
+    int cancelled;
+} ParForRun;
+
+typedef struct ParForJob_t {
+    ParForRun* run;
+    size_t chunk;
+} ParForJob;
+
+/* set while a thread runs a task or a chunk of a par for, where a par for
+ * runs in order rather than waiting on the pool for its chunks. */
+static _Thread_local int sequential = 0;
+
+static Parallel* parallel_new(size_t nthreads);
+static int reserve(Parallel* parallel, const Chunk* chunk);
+static void submit(Parallel* parallel, TaskRun* run);
+static void complete(Parallel* parallel, TaskRun* run);
+static const TaskRun* first_failure(Parallel* parallel, size_t limit);
+static const TaskRun* reported(Parallel* parallel, size_t index, int wait);
+static void run_task(void* arg, size_t worker);
+static ParForRun* start(Interpreter* interpreter, const ChunkParFor* parfor, const Value* args, int64_t limit);
+static kd_status run_in_order(ParForRun* run, int64_t limit, int64_t* used);
+static kd_status wait_jobs(ParForRun* run, int64_t limit, int64_t* used);
+static void free_run(ParForRun* run);
+static void run_job(void* arg, size_t worker);
+static void run_chunk(ParForRun* run, Interpreter* interpreter, size_t chunk);
+static int stopped(ParForRun* run, size_t chunk);
+static kd_status begin_chunk(ParForRun* run, Interpreter* interpreter, size_t chunk);
+static void end_chunk(ParForRun* run, Interpreter* interpreter, size_t chunk, kd_status status, const kd_error* error);
+static void fail_chunk(ParForRun* run, size_t chunk, kd_status status, const kd_error* error);
+static Value combine(const ChunkParFor* parfor, const Value* results, size_t nresults);
+static int place(Interpreter* interpreter, TaskRun* run);
+static int place_failure(Interpreter* interpreter, const TaskRun* first);
+static void set_nomem(kd_error* error);
+
+kd_status parallel_spawn(Interpreter* interpreter, uint16_t index, const Value* args) {
+    Parallel* parallel = interpreter->parallel;
+
+    if (parallel == NULL) {
+        parallel = parallel_new(interpreter->nthreads);
+        if (parallel == NULL) {
+            set_nomem(interpreter->error);
+            return KD_ERROR_NOMEM;
+        }
+
+        interpreter->parallel = parallel;
+    }
+
+    const ChunkTask* task = &interpreter->chunk->tasks[index];
+    size_t nparams = task->ndeps + task->nargs;
+
+    pthread_mutex_lock(&parallel->lock);
+
+    if (!reserve(parallel, interpreter->chunk)) {
+        pthread_mutex_unlock(&parallel->lock);
+        set_nomem(interpreter->error);
+        return KD_ERROR_NOMEM;
+    }
+
+    TaskRun* run = &parallel->runs[index];
+
+    if (run->args_capacity < nparams) {
+        Value* grown = realloc(run->args, nparams * sizeof(Value));
+        if (grown == NULL) {
+            pthread_mutex_unlock(&parallel->lock);
+            set_nomem(interpreter->error);
+            return KD_ERROR_NOMEM;
+        }
+
+        run->args = grown;
+        run->args_capacity = nparams;
+    }
+
+    run->task = task;
+    run->state = TASK_WAITING;
+    run->waiting = 0;
+    run->status = KD_OK;
+    run->fuel_used = 0;
+    run->joined = 0;
+    run->output.size = 0;
+    run->output_at = interpreter->output.size;
+    run->placed = 0;
+
+    interpreter->output.held++;
+
+    for (size_t i = 0; i < task->ndeps; i++)
+        run->args[i] = (Value) { .kind = VAL_INT, .i64 = 0 };
+
+    for (size_t i = 0; i < task->nargs; i++) {
+        value_retain(&args[i]);
+        run->args[task->ndeps + i] = args[i];
+    }
+
+    for (size_t i = 0; i < task->ndeps; i++) {
+        TaskRun* dep = &parallel->runs[task->deps[i]];
+
+        if (dep->state != TASK_DONE) {
+            run->waiting++;
+            continue;
+        }
+
+        if (dep->status != KD_OK) {
+            run->status = dep->status;
+            run->error = dep->error;
+            complete(parallel, run);
+
+            pthread_mutex_unlock(&parallel->lock);
+            return KD_OK;
+        }
+
+        value_retain(&dep->result);
+        run->args[i] = dep->result;
+    }
+
+    if (run->waiting == 0)
+        submit(parallel, run);
+
+    pthread_mutex_unlock(&parallel->lock);
+    return KD_OK;
+}
+
+kd_status parallel_join(Interpreter* interpreter, uint16_t index, Value* result) {
+    Parallel* parallel = interpreter->parallel;
+    TaskRun* run = &parallel->runs[index];
+
+    pthread_mutex_lock(&parallel->lock);
+
+    /* a run with fuel does not hold its thread waiting, it tries again once
+     * it is resumed. */
+    const TaskRun* first = reported(parallel, index, interpreter->fuel == 0);
+
+    if (first == NULL) {
+        pthread_mutex_unlock(&parallel->lock);
+        return KD_SUSPENDED;
+    }
+
+    interpreter->fuel_used += first->fuel_used;
+
+    if (first->status != KD_OK) {
+        kd_status status = first->status;
+        *interpreter->error = first->error;
+        parallel->failed = 1;
+
+        /* the run ends here, the tasks after the failure need not. */
+        __atomic_store_n(&parallel->cancelled, 1, __ATOMIC_RELEASE);
+
+        if (!place_failure(interpreter, first)) {
+            status = KD_ERROR_NOMEM;
+            set_nomem(interpreter->error);
+        }
+
+        pthread_mutex_unlock(&parallel->lock);
+        return status;
+    }
+
+    run->joined = 1;
+
+    if (!place(interpreter, run)) {
+        parallel->failed = 1;
+        pthread_mutex_unlock(&parallel->lock);
+
+        set_nomem(interpreter->error);
+        return KD_ERROR_NOMEM;
+    }
+
+    value_retain(&run->result);
+    *result = run->result;
+
+    pthread_mutex_unlock(&parallel->lock);
+    return KD_OK;
+}
+
+kd_status parallel_finish(Interpreter* interpreter, kd_status status) {
+    Parallel* parallel = interpreter->parallel;
+
+    pthread_mutex_lock(&parallel->lock);
+
+    if (!parallel->failed) {
+        const TaskRun* first = first_failure(parallel, parallel->nruns);
+        int placed = 1;
+
+        if (first != NULL) {
+            status = first->status;
+            *interpreter->error = first->error;
+            placed = place_failure(interpreter, first);
+        }
+
+        /* every task left is done and did not fail. */
+        for (size_t i = 0; i < parallel->nruns && placed && first == NULL; i++) {
+            TaskRun* run = &parallel->runs[i];
+
+            if (run->state != TASK_IDLE && !run->placed)
+                placed = place(interpreter, run);
+        }
+
+        if (!placed) {
+            status = KD_ERROR_NOMEM;
+            set_nomem(interpreter->error);
+        }
+    }
+
+    interpreter->output.held = 0;
+
+    pthread_mutex_unlock(&parallel->lock);
+
+    parallel_cancel(parallel);
+    return status;
+}
+
+kd_status parallel_for(Interpreter* interpreter, uint16_t index, const Value* args, int64_t fuel, int64_t* used, Value* result) {
+    ParForRun* run = interpreter->parfor;
+
+    /* a run out of fuel still gets an instruction of the chunks, so a par
+     * for goes on however little fuel there is. */
+    int64_t limit = interpreter->fuel > 0 ? (fuel > 0 ? fuel : 1) : 0;
+
+    *used = 0;
+
+    if (run == NULL) {
+        const ChunkParFor* parfor = &interpreter->chunk->parfors[index];
+
+        if (args[0].i64 >= args[1].i64) {
+            *result = combine(parfor, NULL, 0);
+            return KD_OK;
+        }
+
+        run = start(interpreter, parfor, args, limit);
+        if (run == NULL) {
+            set_nomem(interpreter->error);
+            return KD_ERROR_NOMEM;
+        }
+
+        interpreter->parfor = run;
+    }
+
+    kd_status status = run->in_order ? run_in_order(run, limit, used) : wait_jobs(run, limit, used);
+    if (status == KD_SUSPENDED)
+        return status;
+
+    interpreter->parfor = NULL;
+
+    status = run->failed < run->nchunks ? run->status : KD_OK;
+
+    if (status == KD_OK)
+        *result = combine(run->parfor, run->results, run->nchunks);
+    else
+        *interpreter->error = run->error;
+
+    /* up to the error, a chunk after the one that failed would not have
+     * run at all. */
+    for (size_t i = 0; i < run->nchunks && i <= run->failed; i++) {
+        if (output_bytes(&interpreter->output, run->outputs[i].data, run->outputs[i].size) != OUTPUT_OK && status == KD_OK) {
+            value_release(result);
+            status = KD_ERROR_NOMEM;
+            set_nomem(interpreter->error);
+        }
+    }
+
+    free_run(run);
+    return status;
+}
+
+void parallel_for_cancel(Interpreter* interpreter) {
+    ParForRun* run = interpreter->parfor;
+
+    if (run == NULL)
+        return;
+
+    if (!run->in_order) {
+        pthread_mutex_lock(&run->parallel->lock);
+
+        __atomic_store_n(&run->cancelled, 1, __ATOMIC_RELEASE);
+
+        while (run->remaining > 0)
+            pthread_cond_wait(&run->parallel->done, &run->parallel->lock);
+
+        pthread_mutex_unlock(&run->parallel->lock);
+    }
+
+    interpreter->parfor = NULL;
+    free_run(run);
+}
+
+size_t parallel_threads(size_t nthreads) {
+    if (nthreads > 0)
+        return nthreads;
+
+    long ncores = sysconf(_SC_NPROCESSORS_ONLN);
+    return ncores > 0 ? (size_t)ncores : 1;
+}
+
+void parallel_cancel(Parallel* parallel) {
+    pthread_mutex_lock(&parallel->lock);
+
+    __atomic_store_n(&parallel->cancelled, 1, __ATOMIC_RELEASE);
+
+    while (parallel->running > 0)
+        pthread_cond_wait(&parallel->done, &parallel->lock);
+
+    for (size_t i = 0; i < parallel->nruns; i++) {
+        TaskRun* run = &parallel->runs[i];
+
+        if (run->state == TASK_IDLE)
+            continue;
+
+        for (size_t a = 0; a < run->task->ndeps + run->task->nargs; a++)
+            value_release(&run->args[a]);
+
+        value_release(&run->result);
+        run->result = (Value) { .kind = VAL_INT, .i64 = 0 };
+        run->state = TASK_IDLE;
+    }
+
+    __atomic_store_n(&parallel->cancelled, 0, __ATOMIC_RELEASE);
+    parallel->failed = 0;
+
+    pthread_mutex_unlock(&parallel->lock);
+}
+
+void parallel_free(Parallel* parallel) {
+    if (parallel == NULL)
+        return;
+
+    parallel_cancel(parallel);
+    pool_deinit(&parallel->pool);
+
+    for (size_t i = 0; i < parallel->nworkers; i++)
+        interpreter_deinit(&parallel->workers[i]);
+
+    for (size_t i = 0; i < parallel->nruns; i++) {
+        free(parallel->runs[i].args);
+        output_deinit(&parallel->runs[i].output);
+    }
+
+    pthread_mutex_destroy(&parallel->lock);
+    pthread_cond_destroy(&parallel->done);
+
+    free(parallel->workers);
+    free(parallel->runs);
+    free(parallel);
+}
+
+/* a worker for every thread asked for, the spawning thread only waits on
+ * joins and par fors. */
+static Parallel* parallel_new(size_t nthreads) {
+    size_t nworkers = parallel_threads(nthreads);
+
+    Parallel* parallel = malloc(sizeof(Parallel));
+    Interpreter* workers = malloc(nworkers * sizeof(Interpreter));
+
+    if (parallel == NULL || workers == NULL) {
+        free(parallel);
+        free(workers);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < nworkers; i++)
+        workers[i] = interpreter_init(NULL);
+
+    *parallel = (Parallel) {
+        .workers = workers,
+        .nworkers = nworkers,
+    };
+
+    if (!pool_init(&parallel->pool, nworkers)) {
+        free(parallel);
+        free(workers);
+        return NULL;
+    }
+
+    pthread_mutex_init(&parallel->lock, NULL);
+    pthread_cond_init(&parallel->done, NULL);
+
+    return parallel;
+}
+
+/* only grows at the first spawn of a run, when no worker holds a run. */
+static int reserve(Parallel* parallel, const Chunk* chunk) {
+    if (parallel->nruns >= chunk->ntasks)
+        return 1;
+
+    TaskRun* runs = realloc(parallel->runs, chunk->ntasks * sizeof(TaskRun));
+    if (runs == NULL)
+        return 0;
+
+    for (size_t i = parallel->nruns; i < chunk->ntasks; i++) {
+        runs[i] = (TaskRun) {
+            .state = TASK_IDLE,
+            .result = { .kind = VAL_INT, .i64 = 0 },
+            .output = output_init(-1),
+        };
+    }
+
+    parallel->runs = runs;
+    parallel->nruns = chunk->ntasks;
+
+    return 1;
+}
+
+static void submit(Parallel* parallel, TaskRun* run) {
+    run->state = TASK_QUEUED;
+    parallel->running++;
+
+    if (!pool_submit(&parallel->pool, run_task, parallel)) {
+        parallel->running--;
+        run->status = KD_ERROR_NOMEM;
+        set_nomem(&run->error);
+        complete(parallel, run);
+    }
+}
+
+/* hands the result of run to the tasks waiting for it, or its failure. */
+static void complete(Parallel* parallel, TaskRun* run) {
+    const ChunkTask* task = run->task;
+    uint16_t index = run - parallel->runs;
+
+    run->state = TASK_DONE;
+    pthread_cond_broadcast(&parallel->done);
+
+    for (size_t i = 0; i < task->ndependents; i++) {
+        TaskRun* next = &parallel->runs[task->dependents[i]];
+
+        if (next->state != TASK_WAITING)
+            continue;
+
+        if (run->status != KD_OK || parallel->cancelled) {
+            next->status = run->status != KD_OK ? run->status : KD_SUSPENDED;
+            next->error = run->error;
+            complete(parallel, next);
+            continue;
+        }
+
+        for (size_t d = 0; d < next->task->ndeps; d++) {
+            if (next->task->deps[d] == index) {
+                value_retain(&run->result);
+                next->args[d] = run->result;
+            }
+        }
+
+        if (--next->waiting == 0)
+            submit(parallel, next);
+    }
+}
+
+/* the first of the tasks below limit spawned and not joined that failed,
+ * waiting for each of them in turn. */
+static const TaskRun* first_failure(Parallel* parallel, size_t limit) {
+    for (size_t i = 0; i < limit; i++) {
+        const TaskRun* run = &parallel->runs[i];
+
+        if (run->state == TASK_IDLE || run->joined)
+            continue;
+
+        while (run->state != TASK_DONE)
+            pthread_cond_wait(&parallel->done, &parallel->lock);
+
+        if (run->status != KD_OK)
+            return run;
+    }
+
+    return NULL;
+}
+
+/* what a join of task index reports: the first of the tasks before it
+ * spawned and not joined that failed, which comes first in the program,
+ * or else the task itself. the tasks are waited for in order, each only
+ * once the ones before it have not failed, so a join does not wait for a
+ * task whose statement the failure would never have let run. without wait,
+ * NULL when it would have to wait. */
+static const TaskRun* reported(Parallel* parallel, size_t index, int wait) {
+    for (size_t i = 0; i <= index; i++) {
+        const TaskRun* run = &parallel->runs[i];
+
+        if (i < index && (run->state == TASK_IDLE || run->joined))
+            continue;
+
+        while (run->state != TASK_DONE) {
+            if (!wait)
+                return NULL;
+
+            pthread_cond_wait(&parallel->done, &parallel->lock);
+        }
+
+        if (run->status != KD_OK || i == index)
+            return run;
+    }
+
+    return NULL;
+}
+
+/* a task of the pool runs the first of the queued tasks rather than the one
+ * it was submitted for, so they start in the order of the program whatever
+ * order the pool takes them in, and a failure is not left waiting behind
+ * the tasks after it. */
+static void run_task(void* arg, size_t worker) {
+    Parallel* parallel = arg;
+    Interpreter* interpreter = &parallel->workers[worker];
+
+    pthread_mutex_lock(&parallel->lock);
+
+    TaskRun* run = parallel->runs;
+    while (run->state != TASK_QUEUED)
+        run++;
+
+    run->state = TASK_RUNNING;
+    pthread_mutex_unlock(&parallel->lock);
+
+    kd_status status = KD_SUSPENDED;
+    sequential = 1;
+
+    if (!__atomic_load_n(&parallel->cancelled, __ATOMIC_ACQUIRE)) {
+        interpreter->error = &run->error;
+        interpreter->fuel = TASK_FUEL;
+
+        status = interpreter_begin_task(interpreter, run->task->chunk, run->args, run->task->ndeps + run->task->nargs);
+
+        while (status == KD_SUSPENDED && !__atomic_load_n(&parallel->cancelled, __ATOMIC_ACQUIRE))
+            status = interpreter_resume(interpreter);
+    }
+
+    pthread_mutex_lock(&parallel->lock);
+
+    run->status = status;
+    run->fuel_used = interpreter->fuel_used;
+
+    /* the buffers trade places, so both keep their memory. */
+    Output output = run->output;
+    run->output = interpreter->output;
+    interpreter->output = output;
+
+    if (status == KD_OK) {
+        run->result = interpreter->result;
+        interpreter->result = (Value) { .kind = VAL_INT, .i64 = 0 };
+    }
+
+    parallel->running--;
+    complete(parallel, run);
+
+    pthread_mutex_unlock(&parallel->lock);
+}
+
+/* sets up par for parfor of the chunk running on interpreter, with the
+ * arguments from args on, and hands its chunks to the pool unless they run
+ * in order. NULL when out of memory. */
+static ParForRun* start(Interpreter* interpreter, const ChunkParFor* parfor, const Value* args, int64_t limit) {
+    int64_t from = args[0].i64;
+    int64_t to = args[1].i64;
+    uint64_t length = (uint64_t)to - (uint64_t)from;
+    uint64_t step = length / PARFOR_CHUNKS + (length % PARFOR_CHUNKS != 0);
+    size_t nchunks = length / step + (length % step != 0);
+
+    ParForRun* run = malloc(sizeof(ParForRun));
+    if (run == NULL)
+        return NULL;
+
+    *run = (ParForRun) {
+        .parfor = parfor,
+        .from = from,
+        .to = to,
+        .step = step,
+        .nchunks = nchunks,
+        .failed = nchunks,
+        .in_order = 1,
+        .interpreter = interpreter_init(&run->chunk_error),
+        .slice = limit > 0 && limit < TASK_FUEL ? limit : TASK_FUEL,
+    };
+
+    run->args = malloc(parfor->nargs * sizeof(Value));
+    run->results = malloc(nchunks * sizeof(Value));
+    run->outputs = malloc(nchunks * sizeof(Output));
+
+    if (run->args == NULL || run->results == NULL || run->outputs == NULL) {
+        free(run->args);
+        free(run->results);
+        free(run->outputs);
+        free(run);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < parfor->nargs; i++) {
+        value_retain(&args[i]);
+        run->args[i] = args[i];
+    }
+
+    for (size_t i = 0; i < nchunks; i++) {
+        run->results[i] = (Value) { .kind = VAL_INT, .i64 = 0 };
+        run->outputs[i] = output_init(-1);
+    }
+
+    if (sequential || nchunks == 1 || parallel_threads(interpreter->nthreads) == 1)
+        return run;
+
+    Parallel* parallel = interpreter->parallel;
+
+    if (parallel == NULL) {
+        parallel = parallel_new(interpreter->nthreads);
+        if (parallel == NULL) {
+            free_run(run);
+            return NULL;
+        }
+
+        interpreter->parallel = parallel;
+    }
+
+    run->jobs = malloc(nchunks * sizeof(ParForJob));
+    if (run->jobs == NULL) {
+        free_run(run);
+        return NULL;
+    }
+
+    run->in_order = 0;
+    run->parallel = parallel;
+    run->remaining = nchunks;
+
+    for (size_t i = 0; i < nchunks; i++) {
+        run->jobs[i] = (ParForJob) { .run = run, .chunk = i };
+
+        if (!pool_submit(&parallel->pool, run_job, &run->jobs[i])) {
+            kd_error error;
+            set_nomem(&error);
+            fail_chunk(run, i, KD_ERROR_NOMEM, &error);
+
+            pthread_mutex_lock(&parallel->lock);
+            run->remaining -= nchunks - i;
+            pthread_mutex_unlock(&parallel->lock);
+            break;
+        }
+    }
+
+    return run;
+}
+
+/* runs the chunks of run one after the other on the calling thread, up to
+ * limit instructions of them unless it is 0. */
+static kd_status run_in_order(ParForRun* run, int64_t limit, int64_t* used) {
+    Interpreter* interpreter = &run->interpreter;
+    kd_status status = KD_OK;
+    int outer = sequential;
+
+    sequential = 1;
+
+    while (run->next < run->nchunks && run->next < run->failed) {
+        if (limit > 0 && *used >= limit) {
+            status = KD_SUSPENDED;
+            break;
+        }
+
+        int64_t before = run->started ? interpreter->fuel_used : 0;
+
+        interpreter->fuel = limit > 0 ? limit - *used : 0;
+
+        if (run->started) {
+            status = interpreter_resume(interpreter);
+        } else {
+            interpreter->fuel_used = 0;
+            status = begin_chunk(run, interpreter, run->next);
+            run->started = 1;
+        }
+
+        *used += interpreter->fuel_used - before;
+
+        if (status == KD_SUSPENDED)
+            break;
+
+        end_chunk(run, interpreter, run->next, status, &run->chunk_error);
+        run->started = 0;
+        run->next++;
+        status = KD_OK;
+    }
+
+    sequential = outer;
+    return status;
+}
+
+/* waits for the jobs of run to be done, or to have run limit instructions
+ * more unless it is 0. */
+static kd_status wait_jobs(ParForRun* run, int64_t limit, int64_t* used) {
+    Parallel* parallel = run->parallel;
+
+    pthread_mutex_lock(&parallel->lock);
+
+    while (run->remaining > 0 && (limit == 0 || run->fuel_used - run->charged < limit))
+        pthread_cond_wait(&parallel->done, &parallel->lock);
+
+    *used = run->fuel_used - run->charged;
+    run->charged = run->fuel_used;
+
+    kd_status status = run->remaining > 0 ? KD_SUSPENDED : KD_OK;
+
+    pthread_mutex_unlock(&parallel->lock);
+    return status;
+}
+
+static void free_run(ParForRun* run) {
+    for (size_t i = 0; i < run->nchunks; i++) {
+        value_release(&run->results[i]);
+        output_deinit(&run->outputs[i]);
+    }
+
+    for (size_t i = 0; i < run->parfor->nargs; i++)
+        value_release(&run->args[i]);
+
+    interpreter_deinit(&run->interpreter);
+
+    free(run->args);
+    free(run->results);
+    free(run->outputs);
+    free(run->jobs);
+    free(run);
+}
+
+static void run_job(void* arg, size_t worker) {
+    ParForJob* job = arg;
+    ParForRun* run = job->run;
+    Parallel* parallel = run->parallel;
+
+    sequential = 1;
+    run_chunk(run, &parallel->workers[worker], job->chunk);
+
+    pthread_mutex_lock(&parallel->lock);
+
+    if (--run->remaining == 0)
+        pthread_cond_broadcast(&parallel->done);
+
+    pthread_mutex_unlock(&parallel->lock);
+}
+
+/* runs chunk of the range on interpreter, a worker, reporting what it ran
+ * and checking whether it is still needed every slice instructions. */
+static void run_chunk(ParForRun* run, Interpreter* interpreter, size_t chunk) {
+    if (stopped(run, chunk))
+        return;
+
+    kd_error error;
+    int64_t reported = 0;
+
+    interpreter->error = &error;
+    interpreter->fuel = run->slice;
+    interpreter->fuel_used = 0;
+
+    kd_status status = begin_chunk(run, interpreter, chunk);
+
+    for (;;) {
+        pthread_mutex_lock(&run->parallel->lock);
+        run->fuel_used += interpreter->fuel_used - reported;
+        pthread_cond_broadcast(&run->parallel->done);
+        pthread_mutex_unlock(&run->parallel->lock);
+
+        reported = interpreter->fuel_used;
+
+        if (status != KD_SUSPENDED || stopped(run, chunk))
+            break;
+
+        status = interpreter_resume(interpreter);
+    }
+
+    interpreter->error = NULL;
+    end_chunk(run, interpreter, chunk, status, &error);
+}
+
+/* a chunk after one that failed is not needed, and none is once the run
+ * of the par for is over. */
+static int stopped(ParForRun* run, size_t chunk) {
+    return chunk >= __atomic_load_n(&run->failed, __ATOMIC_ACQUIRE) || __atomic_load_n(&run->cancelled, __ATOMIC_ACQUIRE);
+}
+
+/* begins chunk of the range on interpreter. */
+static kd_status begin_chunk(ParForRun* run, Interpreter* interpreter, size_t chunk) {
+    const ChunkParFor* parfor = run->parfor;
+
+    Value* args = malloc(parfor->nargs * sizeof(Value));
+    if (args == NULL) {
+        set_nomem(interpreter->error);
+        return KD_ERROR_NOMEM;
+    }
+
+    /* wrapping, the last chunk may end right at INT64_MAX. */
+    uint64_t lo = (uint64_t)run->from + chunk * run->step;
+    uint64_t hi = chunk + 1 == run->nchunks ? (uint64_t)run->to : lo + run->step;
+
+    args[0] = (Value) { .kind = VAL_INT, .i64 = (int64_t)lo };
+    args[1] = (Value) { .kind = VAL_INT, .i64 = (int64_t)hi };
+
+    for (size_t i = 2; i < parfor->nargs; i++) {
+        value_retain(&run->args[i]);
+        args[i] = run->args[i];
+    }
+
+    kd_status status = interpreter_begin_task(interpreter, parfor->chunk, args, parfor->nargs);
+
+    /* begin_task moved them unless it failed before. */
+    for (size_t i = 0; i < parfor->nargs; i++)
+        value_release(&args[i]);
+    free(args);
+
+    return status;
+}
+
+/* takes what chunk printed from interpreter, which ran it to status, and
+ * its result or its failure. */
+static void end_chunk(ParForRun* run, Interpreter* interpreter, size_t chunk, kd_status status, const kd_error* error) {
+    Output output = run->outputs[chunk];
+    run->outputs[chunk] = interpreter->output;
+    interpreter->output = output;
+
+    if (status == KD_OK) {
+        run->results[chunk] = interpreter->result;
+        interpreter->result = (Value) { .kind = VAL_INT, .i64 = 0 };
+    } else if (status != KD_SUSPENDED) {
+        fail_chunk(run, chunk, status, error);
+    }
+}
+
+/* keeps the error of the first chunk that failed. */
+static void fail_chunk(ParForRun* run, size_t chunk, kd_status status, const kd_error* error) {
+    if (run->parallel != NULL)
+        pthread_mutex_lock(&run->parallel->lock);
+
+    if (chunk < run->failed) {
+        run->status = status;
+        run->error = *error;
+        __atomic_store_n(&run->failed, chunk, __ATOMIC_RELEASE);
+    }
+
+    if (run->parallel != NULL)
+        pthread_mutex_unlock(&run->parallel->lock);
+}
+
+/* in order of the chunks, i64s wrapping like OP_ADD and OP_MUL do. */
+static Value combine(const ChunkParFor* parfor, const Value* results, size_t nresults) {
+    if (parfor->op == 0)
+        return (Value) { .kind = VAL_INT, .i64 = 0 };
+
+    if (parfor->kind == VAL_INT) {
+        uint64_t acc = parfor->op == '+' ? 0 : 1;
+
+        for (size_t i = 0; i < nresults; i++)
+            acc = parfor->op == '+' ? acc + (uint64_t)results[i].i64 : acc * (uint64_t)results[i].i64;
+
+        return (Value) { .kind = VAL_INT, .i64 = (int64_t)acc };
+    }
+
+    double acc = parfor->op == '+' ? 0 : 1;
+
+    for (size_t i = 0; i < nresults; i++)
+        acc = parfor->op == '+' ? acc + results[i].f64 : acc * results[i].f64;
+
+    return (Value) { .kind = VAL_DOUBLE, .f64 = acc };
+}
+
+/* puts what run printed where its statement is in the output of the run
+ * on interpreter, which spawned it, moving the places of the tasks after
+ * it along. called with the lock held. */
+static int place(Interpreter* interpreter, TaskRun* run) {
+    Parallel* parallel = interpreter->parallel;
+    size_t at = run->output_at;
+    size_t size = run->output.size;
+
+    if (output_insert(&interpreter->output, at, run->output.data, size) != OUTPUT_OK)
+        return 0;
+
+    for (size_t i = 0; i < parallel->nruns; i++) {
+        TaskRun* other = &parallel->runs[i];
+
+        if (other == run || other->state == TASK_IDLE || other->placed)
+            continue;
+
+        if (other->output_at > at || (other->output_at == at && other > run))
+            other->output_at += size;
+    }
+
+    run->placed = 1;
+    run->output.size = 0;
+    interpreter->output.held--;
+
+    return 1;
+}
+
+/* the run stops at the statement of first, which failed: the tasks before
+ * it that were not joined yet put their output in place, whatever was
+ * printed after its statement is dropped and its own output, up to where
+ * it failed, ends that of the run. */
+static int place_failure(Interpreter* interpreter, const TaskRun* first) {
+    Parallel* parallel = interpreter->parallel;
+    Output* output = &interpreter->output;
+
+    for (TaskRun* run = parallel->runs; run < first; run++) {
+        if (run->state != TASK_IDLE && !run->placed && !place(interpreter, run))
+            return 0;
+    }
+
+    output->size = first->output_at;
+
+    for (size_t i = 0; i < parallel->nruns; i++)
+        parallel->runs[i].placed = 1;
+
+    output->held = 0;
+    return output_bytes(output, first->output.data, first->output.size) == OUTPUT_OK;
+}
+
+static void set_nomem(kd_error* error) {
+    error->status = KD_ERROR_NOMEM;
+    error->line = 0;
+    error->col = 0;
+    snprintf(error->message, sizeof(error->message), "cannot allocate memory!");
+}
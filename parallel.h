@@ -0,0 +1,126 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "kidomaru.h"
+#include "bytecode.h"
+#include "interpreter.h"
+#include "pool.h"
+
+typedef enum TaskState_t {
+    TASK_IDLE,      /* not spawned by this run */
+    TASK_WAITING,   /* spawned, some of its deps are not done yet */
+    TASK_QUEUED,    /* on the pool */
+    TASK_RUNNING,
+    TASK_DONE,
+} TaskState;
+
+/* a task of the chunk running on an interpreter, in the current run. */
+typedef struct TaskRun_t {
+    const ChunkTask* task;
+    TaskState state;
+
+    /* its parameters, the results of its deps among them as they come in,
+     * and how many of those are still missing. */
+    Value* args;
+    size_t args_capacity;
+    size_t waiting;
+
+    /* once it is done. a task that did not run because a dep failed has
+     * the status and error of the dep, one that was cancelled before it ran
+     * is KD_SUSPENDED. */
+    kd_status status;
+    kd_error error;
+    Value result;
+    int64_t fuel_used;
+
+    int joined;
+
+    /* what it printed, which goes where its statement is in the output of
+     * the run that spawned it: at output_at, before what that run printed
+     * after the spawn. placed once it is there, or dropped. */
+    Output output;
+    size_t output_at;
+    int placed;
+} TaskRun;
+
+/* the tasks of an interpreter and the threads running them, which are
+ * started the first time the interpreter spawns one or runs a par for, and
+ * kept until it is deinit or asks for another number of threads. each
+ * worker runs tasks and chunks of par fors on an interpreter of its own. */
+typedef struct Parallel_t {
+    ThreadPool pool;
+    Interpreter* workers;
+    size_t nworkers;
+
+    /* guards everything below, done is signalled whenever a task is. */
+    pthread_mutex_t lock;
+    pthread_cond_t done;
+
+    /* by index in Chunk.tasks. */
+    TaskRun* runs;
+    size_t nruns;
+
+    /* tasks on the pool that are not done yet. */
+    size_t running;
+
+    /* the run is over, tasks still to start do not. */
+    int cancelled;
+
+    /* a join has reported the first error of the run already. */
+    int failed;
+} Parallel;
+
+/* a task checks whether it was cancelled every this many instructions. */
+#define TASK_FUEL (1 << 20)
+
+/* how many chunks the range of a par for is split into, fewer when it is
+ * shorter than that. */
+#define PARFOR_CHUNKS 256
+
+/* OP_SPAWN: starts task of the chunk running on interpreter with the
+ * arguments from args on, once its deps are done. */
+kd_status parallel_spawn(Interpreter* interpreter, uint16_t task, const Value* args);
+
+/* OP_JOIN: waits for task and gives a new reference to its result. a task
+ * before it that failed comes first, its error is reported without waiting
+ * for task, and the tasks still running are stopped. either way the output
+ * of the run comes out as if the statements had run in order. a run with
+ * fuel gets KD_SUSPENDED rather than waiting, and joins again once resumed. */
+kd_status parallel_join(Interpreter* interpreter, uint16_t task, Value* result);
+
+/* the run on interpreter is over with status. a task spawned and not
+ * joined that failed comes before whatever ended the run, so the first of
+ * those replaces status and its error. the others are cancelled. */
+kd_status parallel_finish(Interpreter* interpreter, kd_status status);
+
+/* OP_PARFOR: runs par for index of the chunk running on interpreter with
+ * the arguments from args on, and gives what it reduced to. the range is
+ * split the same way whatever the number of threads, and the results and
+ * output of the chunks are combined in order, so neither the result, the
+ * output nor which error is reported depends on it: a failure is that of
+ * the first chunk that failed. on a worker, or when there is a single
+ * thread, the chunks run in order on the calling thread.
+ *
+ * the instructions of the chunks are the run's, *used is set to how many
+ * ran since the last call. when the run has fuel, of which fuel is left, a
+ * par for that goes past it returns KD_SUSPENDED and is kept on the
+ * interpreter: the next call goes on with it, whatever args then. */
+kd_status parallel_for(Interpreter* interpreter, uint16_t index, const Value* args, int64_t fuel, int64_t* used, Value* result);
+
+/* drops the par for the run on interpreter is suspended in, if any,
+ * stopping its chunks. */
+void parallel_for_cancel(Interpreter* interpreter);
+
+/* the number of workers nthreads stands for, 0 being one per core. */
+size_t parallel_threads(size_t nthreads);
+
+/* stops the tasks of the run without waiting for their results. */
+void parallel_cancel(Parallel* parallel);
+
+void parallel_free(Parallel* parallel);
+
+#endif /* PARALLEL_H */
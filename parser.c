@@ -1,8 +1,11 @@
 #include <stdio.h>
+#include <stdarg.h>
 #include <string.h>
 #include <stdlib.h>
 
 #include "parser.h"
+#include "resolver.h"
+#include "stats.h"
 
 static const char* token_stringified[] = {
     "EOF",
@@ -24,11 +27,21 @@ static const char* token_stringified[] = {
     "RETURN",
     "IF",
     "ELSE",
+    "MAP",
+    "STRUCT",
+    "IMPORT",
+    "FOR",
+    "IN",
+    "PAR",
+    "REDUCE",
+    "YIELD",
 
     "+",
     "-",
     "*",
     "/",
+    "==",
+    "!=",
 
     ":",
     ";",
@@ -37,8 +50,12 @@ static const char* token_stringified[] = {
     ")",
     "{",
     "}",
+    "[",
+    "]",
     ",",
     "->",
+    ".",
+    "..",
 
     "GARBAGE",
 };
@@ -51,29 +68,74 @@ static size_t get_prec(Token token);
 static void advance(Parser* parser);
 static void match(Parser* parser, TokenKind kind);
 
+static void* alloc(Parser* parser, size_t size);
+static void out_of_memory(Parser* parser);
+static void error_at(Parser* parser, Token token, const char* fmt, ...);
+static void error_unexpected(Parser* parser, const char* expected);
+
+static Expr* intern(Parser* parser, const Expr* probe, const Span* text);
+static uint64_t hash_expr(const Expr* expr, const Span* text);
+static int equal_exprs(const Expr* a, const Expr* b, const Span* text);
+static int is_constant(const Expr* expr);
+static Expr** copy_list(Parser* parser, Expr** list, size_t count);
+static void* grow(Parser* parser, void* items, size_t* capacity, size_t count, size_t size);
+
 static Expr* parse_primary(Parser* parser);
-static Expr* parse_expression(Parser* parser, TokenKind delim, size_t prec);
+static Expr* parse_call(Parser* parser, Expr* probe);
+static size_t parse_expression_list(Parser* parser, TokenKind close);
+static Expr* parse_postfix(Parser* parser);
+static Expr* parse_expression(Parser* parser, size_t prec);
 
 static VarDecl parse_var_decl(Parser* parser);
 static IfStatement parse_if_statement(Parser* parser);
+static ForStatement parse_for_statement(Parser* parser);
 static BlockStatement* parse_block_statement(Parser* parser);
 
-static ValueKind parse_type(Parser* parser);
+static Expr* parse_map(Parser* parser, Expr* probe);
+static Expr* parse_record(Parser* parser, Expr* probe);
 
-Parser parser_init(Lexer* lexer) {
+Parser parser_init(Lexer* lexer, Arena* arena, kd_error* error) {
     return (Parser) {
         .lexer = lexer,
         .current = lexer_gettok(lexer),
+        .arena = arena,
+        .constants = arena,
+        .dedup = 1,
+        .ntokens = 1,
+        .started = stats_start(),
+        .error = error,
     };
 }
 
-Statement* parse_statement(Parser* parser) {
-    Statement* statement = malloc(sizeof(Statement));
+/* the tree stays in the arena. */
+void parser_deinit(Parser* parser) {
+    free(parser->table);
+    free(parser->list);
+    free(parser->text);
+
+    stats_add(STAT_TOKENS, parser->ntokens);
+    stats_add(STAT_NODES, parser->nnodes);
+    stats_add(STAT_ALLOCATIONS + KD_MEMORY_PARSER, parser->nallocs);
+    stats_add(STAT_BYTES + KD_MEMORY_PARSER, parser->nbytes);
+    stats_stop(KD_PHASE_PARSE, parser->started);
+}
 
-    if (statement == NULL) {
-        fprintf(stderr, "ERROR: cannot allocate memory!\n");
-        exit(1);
-    }
+void parser_advance(Parser* parser) {
+    advance(parser);
+}
+
+void parser_match(Parser* parser, TokenKind kind) {
+    match(parser, kind);
+}
+
+void parser_error_unexpected(Parser* parser, const char* expected) {
+    error_unexpected(parser, expected);
+}
+
+Statement* parse_statement(Parser* parser) {
+    Statement* statement = alloc(parser, sizeof(Statement));
+    statement->line = parser->current.line;
+    statement->col = parser->current.col;
 
     if (expect(parser, TOK_LET)) {
         statement->kind = STATEMENT_VAR_DECL;
@@ -89,11 +151,29 @@ Statement* parse_statement(Parser* parser) {
         return statement;
     }
 
+    if (expect(parser, TOK_FOR) || expect(parser, TOK_PAR)) {
+        statement->kind = STATEMENT_FOR;
+        statement->forstatement = parse_for_statement(parser);
+
+        return statement;
+    }
+
+    if (expect(parser, TOK_YIELD)) {
+        advance(parser);
+
+        statement->kind = STATEMENT_YIELD;
+        statement->yield = parse_expression(parser, 1);
+
+        match(parser, TOK_SEMICOLON);
+
+        return statement;
+    }
+
     if (expect(parser, TOK_RETURN)) {
         advance(parser);
 
         statement->kind = STATEMENT_RETURN;
-        statement->ret = parse_expression(parser, TOK_SEMICOLON, 0);
+        statement->ret = parse_expression(parser, 1);
 
         match(parser, TOK_SEMICOLON);
 
@@ -107,8 +187,33 @@ Statement* parse_statement(Parser* parser) {
         return statement;
     }
 
-    fprintf(stderr, "(%zu:%zu) ERROR: expected statement but got %s\n", parser->current.line, parser->current.col, token_stringified[parser->current.kind]);
-    exit(1);
+    if (expect(parser, TOK_STRUCT)) {
+        statement->kind = STATEMENT_STRUCT;
+        statement->record = parse_struct(parser);
+
+        return statement;
+    }
+
+    if (expect(parser, TOK_FN)) {
+        statement->kind = STATEMENT_FN;
+        statement->function = parse_function(parser);
+
+        return statement;
+    }
+
+    if (expect(parser, TOK_IMPORT)) {
+        statement->kind = STATEMENT_IMPORT;
+        statement->import = parse_import(parser);
+
+        return statement;
+    }
+
+    statement->kind = STATEMENT_EXPR;
+    statement->expr = parse_expression(parser, 1);
+
+    match(parser, TOK_SEMICOLON);
+
+    return statement;
 }
 
 static int is_eof(Parser* parser) {
@@ -119,170 +224,558 @@ static int expect(Parser* parser, TokenKind kind) {
     return parser->current.kind == kind;
 }
 
+/* 0 means the token is not a binary operator. */
 static size_t get_prec(Token token) {
     switch (token.kind) {
-    case TOK_IDENTIFIER:
-    case TOK_INTLITERAL:
-    case TOK_DOUBLELITERAL:
-    case TOK_BOOLTRUE:
-    case TOK_BOOLFALSE:
-    case TOK_STRINGLITERAL:
-        return 0;
+    case TOK_EQUALEQUAL:
+    case TOK_BANGEQUAL:
+        return 1;
     case TOK_PLUS:
     case TOK_MINUS:
-        return 1;
+        return 2;
     case TOK_STAR:
     case TOK_SLASH:
-        return 2;
+        return 3;
     default:
-        fprintf(stderr, "(%zu:%zu) ERROR: cannot get precedence from an invalid token!\n", token.line, token.col);
-        exit(1);
+        return 0;
     }
 }
 
 static void advance(Parser* parser) {
-    if (!is_eof(parser))
+    if (!is_eof(parser)) {
         parser->current = lexer_gettok(parser->lexer);
+        parser->ntokens++;
+    }
 }
 
 static void match(Parser* parser, TokenKind kind) {
-    if (!expect(parser, kind) && expect(parser, TOK_EOF)) {
-        fprintf(stderr, "(%zu:%zu) ERROR: unexpected eof!\n", parser->current.line, parser->current.col);
-        exit(1);
+    if (!expect(parser, kind))
+        error_unexpected(parser, token_stringified[kind]);
+
+    advance(parser);
+}
+
+static void* alloc(Parser* parser, size_t size) {
+    void* ptr = arena_alloc(parser->arena, size);
+
+    if (ptr == NULL)
+        out_of_memory(parser);
+
+    parser->nallocs++;
+    parser->nbytes += size;
+
+    return ptr;
+}
+
+static void out_of_memory(Parser* parser) {
+    parser->error->status = KD_ERROR_NOMEM;
+    parser->error->line = 0;
+    parser->error->col = 0;
+    snprintf(parser->error->message, sizeof(parser->error->message), "cannot allocate memory!");
+    longjmp(parser->bail, 1);
+}
+
+/* the node equal to probe, allocated from a copy of it when there is none
+ * yet. a string literal is compared by its text, and gets a value of its own
+ * only when it is new. */
+static Expr* intern(Parser* parser, const Expr* probe, const Span* text) {
+    parser->nexprs++;
+
+    int shared = parser->dedup && probe->kind != EXPR_MAP && probe->kind != EXPR_RECORD;
+    uint64_t hash = 0;
+    size_t slot = 0;
+
+    if (shared) {
+        hash = hash_expr(probe, text);
+
+        if (parser->table_count * 4 >= parser->table_capacity * 3) {
+            size_t capacity = parser->table_capacity == 0 ? 256 : parser->table_capacity * 2;
+
+            ExprEntry* table = calloc(capacity, sizeof(ExprEntry));
+            if (table == NULL)
+                out_of_memory(parser);
+
+            parser->nallocs++;
+            parser->nbytes += capacity * sizeof(ExprEntry);
+
+            for (size_t i = 0; i < parser->table_capacity; i++) {
+                if (parser->table[i].expr == NULL)
+                    continue;
+
+                size_t j = parser->table[i].hash & (capacity - 1);
+                while (table[j].expr != NULL)
+                    j = (j + 1) & (capacity - 1);
+
+                table[j] = parser->table[i];
+            }
+
+            free(parser->table);
+            parser->table = table;
+            parser->table_capacity = capacity;
+        }
+
+        slot = hash & (parser->table_capacity - 1);
+
+        for (; parser->table[slot].expr != NULL; slot = (slot + 1) & (parser->table_capacity - 1)) {
+            ExprEntry* entry = &parser->table[slot];
+
+            if (entry->hash == hash && entry->block == parser->block && equal_exprs(entry->expr, probe, text)) {
+                entry->expr->uses++;
+                return entry->expr;
+            }
+        }
     }
 
-    if (!expect(parser, kind)) {
-        fprintf(stderr, "(%zu:%zu) ERROR: expected %s but got %s\n", parser->current.line, parser->current.col, token_stringified[kind], token_stringified[parser->current.kind]);
-        exit(1);
+    Expr* expr = alloc(parser, sizeof(Expr));
+    *expr = *probe;
+    parser->nnodes++;
+
+    if (text != NULL && !string_constant(parser->constants, text->data, text->size, &expr->Primary))
+        out_of_memory(parser);
+
+    switch (expr->kind) {
+    case EXPR_CALL:
+        expr->Call.args = copy_list(parser, probe->Call.args, probe->Call.nargs);
+        break;
+    case EXPR_ARRAY:
+        expr->Array.elements = copy_list(parser, probe->Array.elements, probe->Array.nelements);
+        break;
+    default:
+        break;
     }
 
-    advance(parser);
+    expr->uses = 1;
+    expr->constant = shared && is_constant(expr);
+
+    if (shared) {
+        parser->table[slot] = (ExprEntry) {
+            .hash = hash,
+            .block = parser->block,
+            .expr = expr,
+        };
+        parser->table_count++;
+    }
+
+    return expr;
 }
 
-static Expr* parse_primary(Parser* parser) {
-    Expr* expr = malloc(sizeof(Expr));
+/* children are compared by identity, they are shared already. */
+static uint64_t hash_expr(const Expr* expr, const Span* text) {
+    uint64_t hash = 0xcbf29ce484222325ull ^ expr->kind;
+
+#define MIX(value) (hash = (hash ^ (uint64_t)(value)) * 0x100000001b3ull)
+
+    switch (expr->kind) {
+    case EXPR_BINARY:
+        MIX(expr->Binary.op);
+        MIX((uintptr_t)expr->Binary.lhs);
+        MIX((uintptr_t)expr->Binary.rhs);
+        break;
+    case EXPR_PRIMARY:
+        MIX(expr->Primary.kind);
+
+        if (text != NULL) {
+            for (size_t i = 0; i < text->size; i++)
+                MIX((unsigned char)text->data[i]);
+        } else if (expr->Primary.kind == VAL_IDENT) {
+            for (size_t i = 0; i < expr->Primary.span.size; i++)
+                MIX((unsigned char)expr->Primary.span.data[i]);
+        } else if (expr->Primary.kind == VAL_BOOL) {
+            MIX(expr->Primary.bool);
+        } else {
+            MIX(expr->Primary.i64);
+        }
+        break;
+    case EXPR_CALL:
+        for (size_t i = 0; i < expr->Call.callee.size; i++)
+            MIX((unsigned char)expr->Call.callee.data[i]);
+        for (size_t i = 0; i < expr->Call.nargs; i++)
+            MIX((uintptr_t)expr->Call.args[i]);
+        break;
+    case EXPR_ARRAY:
+        for (size_t i = 0; i < expr->Array.nelements; i++)
+            MIX((uintptr_t)expr->Array.elements[i]);
+        break;
+    case EXPR_INDEX:
+        MIX((uintptr_t)expr->Index.array);
+        MIX((uintptr_t)expr->Index.index);
+        break;
+    case EXPR_FIELD:
+        MIX((uintptr_t)expr->Field.record);
+        for (size_t i = 0; i < expr->Field.name.size; i++)
+            MIX((unsigned char)expr->Field.name.data[i]);
+        break;
+    default:
+        break;
+    }
+
+#undef MIX
+
+    return hash ^ hash >> 32;
+}
+
+/* doubles by their bits, so 0.0 and -0.0 stay apart. */
+static int equal_exprs(const Expr* a, const Expr* b, const Span* text) {
+    if (a->kind != b->kind)
+        return 0;
+
+    switch (a->kind) {
+    case EXPR_BINARY:
+        return a->Binary.op == b->Binary.op && a->Binary.lhs == b->Binary.lhs && a->Binary.rhs == b->Binary.rhs;
+    case EXPR_PRIMARY:
+        if (a->Primary.kind != b->Primary.kind)
+            return 0;
+
+        switch (a->Primary.kind) {
+        case VAL_IDENT:
+            return span_equals(a->Primary.span, b->Primary.span);
+        case VAL_BOOL:
+            return a->Primary.bool == b->Primary.bool;
+        case VAL_STRING:
+            return string_size(&a->Primary) == text->size && memcmp(string_data(&a->Primary), text->data, text->size) == 0;
+        default:
+            return memcmp(&a->Primary.i64, &b->Primary.i64, sizeof(int64_t)) == 0;
+        }
+    case EXPR_CALL:
+        return span_equals(a->Call.callee, b->Call.callee) && a->Call.nargs == b->Call.nargs
+            && memcmp(a->Call.args, b->Call.args, a->Call.nargs * sizeof(Expr*)) == 0;
+    case EXPR_ARRAY:
+        return a->Array.nelements == b->Array.nelements
+            && memcmp(a->Array.elements, b->Array.elements, a->Array.nelements * sizeof(Expr*)) == 0;
+    case EXPR_INDEX:
+        return a->Index.array == b->Index.array && a->Index.index == b->Index.index;
+    case EXPR_FIELD:
+        return a->Field.record == b->Field.record && span_equals(a->Field.name, b->Field.name);
+    default:
+        return 0;
+    }
+}
 
-    if (expr == NULL) {
-        fprintf(stderr, "ERROR: cannot allocate memory!\n");
-        exit(1);
+static int is_constant(const Expr* expr) {
+    switch (expr->kind) {
+    case EXPR_BINARY:
+        return expr->Binary.lhs->constant && expr->Binary.rhs->constant;
+    case EXPR_PRIMARY:
+        return expr->Primary.kind != VAL_IDENT;
+    case EXPR_CALL: {
+        /* a function declared with fn may make a new map every time, and
+         * print writes every time. */
+        Builtin builtin;
+        size_t nargs;
+
+        if (!builtin_lookup(expr->Call.callee, &builtin, &nargs) || builtin == BUILTIN_PRINT || builtin == BUILTIN_PRINTLN)
+            return 0;
+
+        for (size_t i = 0; i < expr->Call.nargs; i++) {
+            if (!expr->Call.args[i]->constant)
+                return 0;
+        }
+        return 1;
     }
+    case EXPR_ARRAY:
+        for (size_t i = 0; i < expr->Array.nelements; i++) {
+            if (!expr->Array.elements[i]->constant)
+                return 0;
+        }
+        return 1;
+    case EXPR_INDEX:
+        return expr->Index.array->constant && expr->Index.index->constant;
+    case EXPR_FIELD:
+        return expr->Field.record->constant;
+    default:
+        return 0;
+    }
+}
+
+static Expr** copy_list(Parser* parser, Expr** list, size_t count) {
+    Expr** copy = alloc(parser, (count == 0 ? 1 : count) * sizeof(Expr*));
+    if (count > 0)
+        memcpy(copy, list, count * sizeof(Expr*));
+
+    return copy;
+}
+
+/* room for count more items in a malloc'd array. */
+static void* grow(Parser* parser, void* items, size_t* capacity, size_t count, size_t size) {
+    if (count <= *capacity)
+        return items;
+
+    size_t grown = *capacity == 0 ? 64 : *capacity;
+    while (grown < count)
+        grown *= 2;
+
+    items = realloc(items, grown * size);
+    if (items == NULL)
+        out_of_memory(parser);
+
+    parser->nallocs++;
+    parser->nbytes += grown * size;
+
+    *capacity = grown;
+    return items;
+}
+
+static void error_at(Parser* parser, Token token, const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+
+    parser->error->status = KD_ERROR_SYNTAX;
+    parser->error->line = token.line;
+    parser->error->col = token.col;
+    vsnprintf(parser->error->message, sizeof(parser->error->message), fmt, args);
+
+    va_end(args);
+    longjmp(parser->bail, 1);
+}
+
+static void error_unexpected(Parser* parser, const char* expected) {
+    Token token = parser->current;
+
+    if (token.kind == TOK_EOF)
+        error_at(parser, token, "unexpected eof!");
+
+    if (token.kind == TOK_GARBAGE)
+        error_at(parser, token, "expected %s but got %s: '%.*s'", expected, parser->lexer->error, (int)token.span.size, token.span.data);
+
+    error_at(parser, token, "expected %s but got %s", expected, token_stringified[token.kind]);
+}
+
+static Expr* parse_primary(Parser* parser) {
+    Expr probe = {
+        .kind = EXPR_PRIMARY,
+        .line = parser->current.line,
+        .col = parser->current.col,
+    };
 
     switch (parser->current.kind) {
     case TOK_INTLITERAL:
-        expr->kind = EXPR_PRIMARY;
-        expr->Primary = (Value) {
+        probe.Primary = (Value) {
             .kind = VAL_INT,
             .i64  = strtol(parser->current.span.data, NULL, 10),
         };
 
         break;
     case TOK_DOUBLELITERAL:
-        expr->kind = EXPR_PRIMARY;
-        expr->Primary = (Value) {
+        probe.Primary = (Value) {
             .kind = VAL_DOUBLE,
             .f64  = strtod(parser->current.span.data, NULL),
         };
 
         break;
     case TOK_BOOLTRUE:
-        expr->kind = EXPR_PRIMARY;
-        expr->Primary = (Value) {
+        probe.Primary = (Value) {
             .kind = VAL_BOOL,
             .bool = 1,
         };
 
         break;
     case TOK_BOOLFALSE:
-        expr->kind = EXPR_PRIMARY;
-        expr->Primary = (Value) {
+        probe.Primary = (Value) {
             .kind = VAL_BOOL,
             .bool = 0,
         };
 
         break;
-    case TOK_STRINGLITERAL:
-        expr->kind = EXPR_PRIMARY;
-        expr->Primary = (Value) {
-            .kind   = VAL_STRING,
-            .String = {
-                .data = strndup(parser->current.span.data, parser->current.span.size),
-                .size = parser->current.span.size,
-            },
-        };
+    case TOK_STRINGLITERAL: {
+        Span text = parse_string_literal(parser);
+        probe.Primary = (Value) { .kind = VAL_STRING };
 
-        break;
+        advance(parser);
+        return intern(parser, &probe, &text);
+    }
     case TOK_IDENTIFIER:
-        expr->kind = EXPR_PRIMARY;
-        expr->Primary = (Value) {
+        probe.Primary = (Value) {
             .kind = VAL_IDENT,
             .span = parser->current.span,
         };
 
-        break;
+        advance(parser);
+
+        if (expect(parser, TOK_LPAREN))
+            return parse_call(parser, &probe);
+        if (expect(parser, TOK_LBRACE))
+            return parse_record(parser, &probe);
+
+        return intern(parser, &probe, NULL);
+    case TOK_LBRACKET: {
+        Token open = parser->current;
+        advance(parser);
+
+        size_t n = parse_expression_list(parser, TOK_RBRACKET);
+
+        /* there would be no element kind to give it. */
+        if (n == 0)
+            error_at(parser, open, "an array literal needs at least one element, use fill for an empty array");
+
+        probe.kind = EXPR_ARRAY;
+        probe.Array.elements = parser->list + parser->list_size - n;
+        probe.Array.nelements = n;
+
+        Expr* expr = intern(parser, &probe, NULL);
+        parser->list_size -= n;
+
+        return expr;
+    }
+    case TOK_MAP:
+        return parse_map(parser, &probe);
     default:
-        fprintf(stderr, "(%zu:%zu) ERROR: expected value but got %s\n", parser->current.line, parser->current.col, token_stringified[parser->current.kind]);
-        exit(1);
+        error_unexpected(parser, "value");
     }
 
     advance(parser);
 
+    return intern(parser, &probe, NULL);
+}
+
+/* the lexer has checked the escapes already. the text is only good until
+ * the next string literal. */
+Span parse_string_literal(Parser* parser) {
+    Span span = parser->current.span;
+    size_t size = 0;
+
+    parser->text = grow(parser, parser->text, &parser->text_capacity, span.size + 1, sizeof(char));
+
+    for (size_t i = 0; i < span.size; i++) {
+        if (span.data[i] == '\\')
+            i++;
+
+        parser->text[size++] = span.data[i];
+    }
+
+    return span_init(parser->text, size);
+}
+
+/* probe holds the callee, the current token is the '('. */
+static Expr* parse_call(Parser* parser, Expr* probe) {
+    Span callee = probe->Primary.span;
+
+    match(parser, TOK_LPAREN);
+
+    size_t n = parse_expression_list(parser, TOK_RPAREN);
+
+    probe->kind = EXPR_CALL;
+    probe->Call.callee = callee;
+    probe->Call.args = parser->list + parser->list_size - n;
+    probe->Call.nargs = n;
+
+    Expr* expr = intern(parser, probe, NULL);
+    parser->list_size -= n;
+
     return expr;
 }
 
-static Expr* parse_expression(Parser* parser, TokenKind delim, size_t prec) {
-    Expr* left = parse_primary(parser);
+/* a comma separated list up to and including close, left on top of
+ * parser->list. returns its length. */
+static size_t parse_expression_list(Parser* parser, TokenKind close) {
+    size_t n = 0;
+
+    while (!expect(parser, close)) {
+        if (n > 0)
+            match(parser, TOK_COMMA);
+
+        Expr* expr = parse_expression(parser, 1);
+
+        parser->list = grow(parser, parser->list, &parser->list_capacity, parser->list_size + 1, sizeof(Expr*));
+        parser->list[parser->list_size++] = expr;
+        n++;
+    }
+
+    match(parser, close);
+
+    return n;
+}
+
+static Expr* parse_postfix(Parser* parser) {
+    Expr* expr = parse_primary(parser);
+
+    while (expect(parser, TOK_LBRACKET) || expect(parser, TOK_DOT)) {
+        if (expect(parser, TOK_DOT)) {
+            Expr field = {
+                .kind = EXPR_FIELD,
+                .line = parser->current.line,
+                .col = parser->current.col,
+            };
+
+            advance(parser);
+
+            field.Field.record = expr;
+            field.Field.name = parser->current.span;
+
+            match(parser, TOK_IDENTIFIER);
+
+            expr = intern(parser, &field, NULL);
+            continue;
+        }
+
+        Expr index = {
+            .kind = EXPR_INDEX,
+            .line = parser->current.line,
+            .col = parser->current.col,
+        };
 
-    Token curr_tok = parser->current;
+        advance(parser);
 
-    if (curr_tok.kind == delim)
-        return left;
+        index.Index.array = expr;
+        index.Index.index = parse_expression(parser, 1);
 
-    size_t new_prec = get_prec(curr_tok);
+        match(parser, TOK_RBRACKET);
 
-    if (new_prec == 0) {
-        fprintf(stderr, "(%zu:%zu) ERROR: expected a binary operator but got %s\n", curr_tok.line, curr_tok.col, token_stringified[curr_tok.kind]);
-        exit(1);
+        expr = intern(parser, &index, NULL);
     }
 
-    while (new_prec >= prec) {
-        Expr* binop = malloc(sizeof(Expr));
+    return expr;
+}
+
+/* precedence climbing, every binary operator is left associative. */
+static Expr* parse_expression(Parser* parser, size_t prec) {
+    Expr* left = parse_postfix(parser);
 
-        binop->kind = EXPR_BINARY;
+    while (get_prec(parser->current) >= prec && get_prec(parser->current) != 0) {
+        Token curr_tok = parser->current;
+        size_t new_prec = get_prec(curr_tok);
+
+        Expr binop = {
+            .kind = EXPR_BINARY,
+            .line = curr_tok.line,
+            .col = curr_tok.col,
+        };
 
         switch (curr_tok.kind) {
         case TOK_PLUS:
-            binop->Binary.op = '+';
+            binop.Binary.op = '+';
             break;
         case TOK_MINUS:
-            binop->Binary.op = '-';
+            binop.Binary.op = '-';
             break;
         case TOK_STAR:
-            binop->Binary.op = '*';
+            binop.Binary.op = '*';
             break;
         case TOK_SLASH:
-            binop->Binary.op = '/';
+            binop.Binary.op = '/';
+            break;
+        case TOK_EQUALEQUAL:
+            binop.Binary.op = '=';
+            break;
+        case TOK_BANGEQUAL:
+            binop.Binary.op = '!';
             break;
         default:
-            fprintf(stderr, "(%zu:%zu) ERROR: unreachable!\n", curr_tok.line, curr_tok.col);
-            exit(1);
+            error_at(parser, curr_tok, "unreachable!");
         }
 
         advance(parser);
 
-        binop->Binary.lhs = left;
-        binop->Binary.rhs = parse_expression(parser, delim, new_prec);
-
-        left = binop;
+        binop.Binary.lhs = left;
+        binop.Binary.rhs = parse_expression(parser, new_prec + 1);
 
-        if (parser->current.kind == delim)
-            break;
+        left = intern(parser, &binop, NULL);
     }
 
     return left;
 }
 
 static VarDecl parse_var_decl(Parser* parser) {
-    VarDecl vardecl;
+    VarDecl vardecl = { 0 };
 
     match(parser, TOK_LET);
 
@@ -294,12 +787,11 @@ static VarDecl parse_var_decl(Parser* parser) {
 
     match(parser, TOK_COLON);
 
-    ValueKind type = parse_type(parser);
-    vardecl.type = type;
+    vardecl.type = parse_type(parser);
 
     match(parser, TOK_EQUAL);
 
-    Expr* expr = parse_expression(parser, TOK_SEMICOLON, 0);
+    Expr* expr = parse_expression(parser, 1);
     vardecl.expr = expr;
 
     match(parser, TOK_SEMICOLON);
@@ -313,7 +805,7 @@ static IfStatement parse_if_statement(Parser* parser) {
     match(parser, TOK_IF);
 
     match(parser, TOK_LPAREN);
-    Expr* expr = parse_expression(parser, TOK_RPAREN, 0);
+    Expr* expr = parse_expression(parser, 1);
     match(parser, TOK_RPAREN);
 
     ifstatement.expr = expr;
@@ -330,57 +822,477 @@ static IfStatement parse_if_statement(Parser* parser) {
     return ifstatement;
 }
 
-static BlockStatement* parse_block_statement(Parser* parser) {
-    BlockStatement* blockstatement = malloc(sizeof(BlockStatement));
-    if (blockstatement == NULL) {
-        fprintf(stderr, "ERROR: cannot allocate memory!\n");
-        exit(1);
+static ForStatement parse_for_statement(Parser* parser) {
+    ForStatement forstatement = { .parallel = expect(parser, TOK_PAR) };
+
+    if (forstatement.parallel)
+        advance(parser);
+
+    match(parser, TOK_FOR);
+    match(parser, TOK_LPAREN);
+
+    forstatement.var = parser->current.span;
+    match(parser, TOK_IDENTIFIER);
+    match(parser, TOK_IN);
+
+    forstatement.from = parse_expression(parser, 1);
+    match(parser, TOK_DOTDOT);
+    forstatement.to = parse_expression(parser, 1);
+
+    match(parser, TOK_RPAREN);
+
+    if (expect(parser, TOK_REDUCE)) {
+        advance(parser);
+        match(parser, TOK_LPAREN);
+
+        if (expect(parser, TOK_PLUS))
+            forstatement.op = '+';
+        else if (expect(parser, TOK_STAR))
+            forstatement.op = '*';
+        else
+            error_unexpected(parser, "+ or *");
+
+        advance(parser);
+        match(parser, TOK_RPAREN);
+
+        forstatement.result.id = parser->current.span;
+        match(parser, TOK_IDENTIFIER);
+        match(parser, TOK_COLON);
+
+        Token token = parser->current;
+        forstatement.result.type = parse_type(parser);
+
+        if (forstatement.result.type.kind != VAL_INT && forstatement.result.type.kind != VAL_DOUBLE)
+            error_at(parser, token, "a reduction has to be i64 or f64");
     }
 
-    BlockStatement* ptr = blockstatement;
+    forstatement.body = parse_block_statement(parser);
 
-    match(parser, TOK_LBRACE);
+    return forstatement;
+}
 
-    while (!is_eof(parser)) {
-        if (expect(parser, TOK_RBRACE)) {
-            ptr->next = NULL;
-            break;
-        }
+/* an empty block is represented by NULL. */
+static BlockStatement* parse_block_statement(Parser* parser) {
+    BlockStatement* blockstatement = NULL;
+    BlockStatement** tail = &blockstatement;
 
-        ptr->statement = parse_statement(parser);
+    size_t block = parser->block;
+    parser->block = ++parser->nblocks;
 
-        ptr->next = malloc(sizeof(BlockStatement));
-        ptr = ptr->next;
+    match(parser, TOK_LBRACE);
 
-        if (expect(parser, TOK_RBRACE)) {
-            ptr->next = NULL;
-            break;
-        }
+    while (!expect(parser, TOK_RBRACE)) {
+        if (is_eof(parser))
+            error_unexpected(parser, token_stringified[TOK_RBRACE]);
+
+        BlockStatement* node = alloc(parser, sizeof(BlockStatement));
+        node->statement = parse_statement(parser);
+        node->next = NULL;
+
+        *tail = node;
+        tail = &node->next;
     }
 
     match(parser, TOK_RBRACE);
+    parser->block = block;
 
     return blockstatement;
 }
 
-static ValueKind parse_type(Parser* parser) {
+Type parse_type(Parser* parser) {
     Token token = parser->current;
+    Type type = { .kind = VAL_INT };
 
     switch (token.kind) {
     case TOK_TYPEI64:
         advance(parser);
-        return VAL_INT;
+        type.kind = VAL_INT;
+        break;
     case TOK_TYPEF64:
         advance(parser);
-        return VAL_DOUBLE;
+        type.kind = VAL_DOUBLE;
+        break;
     case TOK_TYPEBOOL:
         advance(parser);
-        return VAL_BOOL;
+        type.kind = VAL_BOOL;
+        break;
     case TOK_TYPESTRING:
         advance(parser);
-        return VAL_STRING;
+        type.kind = VAL_STRING;
+        break;
+    case TOK_IDENTIFIER:
+        type.kind = VAL_RECORD;
+        type.name = token.span;
+        advance(parser);
+        break;
+    case TOK_LBRACKET:
+        advance(parser);
+        match(parser, TOK_RBRACKET);
+
+        if (expect(parser, TOK_IDENTIFIER)) {
+            type.kind = VAL_RECORD_ARRAY;
+            type.name = parser->current.span;
+            advance(parser);
+            break;
+        }
+
+        if (expect(parser, TOK_TYPEI64)) {
+            advance(parser);
+            type.kind = VAL_INT_ARRAY;
+            break;
+        }
+
+        if (expect(parser, TOK_TYPEF64)) {
+            advance(parser);
+            type.kind = VAL_DOUBLE_ARRAY;
+            break;
+        }
+
+        error_unexpected(parser, "array element type");
+        break;
+    case TOK_MAP: {
+        advance(parser);
+        match(parser, TOK_LBRACKET);
+
+        Token key_token = parser->current;
+        Type key = parse_type(parser);
+
+        if (key.kind != VAL_INT && key.kind != VAL_DOUBLE && key.kind != VAL_BOOL && key.kind != VAL_STRING)
+            error_at(parser, key_token, "map keys have to be i64, f64, bool or string");
+
+        match(parser, TOK_RBRACKET);
+
+        Token value_token = parser->current;
+        Type value = parse_type(parser);
+
+        /* a map holding maps could end up holding itself and never be freed.
+         * values are only checked by kind, so a struct would lose its type. */
+        if (value.kind == VAL_MAP || value.kind == VAL_RECORD || value.kind == VAL_RECORD_ARRAY)
+            error_at(parser, value_token, "map values cannot be maps or structs");
+
+        type = (Type) { .kind = VAL_MAP, .key = key.kind, .value = value.kind };
+        break;
+    }
     default:
-        fprintf(stderr, "(%zu:%zu) ERROR: expected type but got %s\n", token.line, token.col, token_stringified[token.kind]);
-        exit(1);
+        error_unexpected(parser, "type");
+    }
+
+    return type;
+}
+
+/* map[K]V { key: value, ... }, the current token is the map. */
+static Expr* parse_map(Parser* parser, Expr* probe) {
+    probe->kind = EXPR_MAP;
+    probe->Map.type = parse_type(parser);
+
+    Expr** keys = NULL;
+    Expr** values = NULL;
+    size_t capacity = 0;
+    size_t n = 0;
+
+    match(parser, TOK_LBRACE);
+
+    while (!expect(parser, TOK_RBRACE)) {
+        if (n > 0)
+            match(parser, TOK_COMMA);
+
+        /* the old lists stay in the arena, at most doubling what is used. */
+        if (n == capacity) {
+            capacity = capacity == 0 ? 8 : capacity * 2;
+
+            Expr** grown_keys = alloc(parser, capacity * sizeof(Expr*));
+            Expr** grown_values = alloc(parser, capacity * sizeof(Expr*));
+
+            if (n > 0) {
+                memcpy(grown_keys, keys, n * sizeof(Expr*));
+                memcpy(grown_values, values, n * sizeof(Expr*));
+            }
+
+            keys = grown_keys;
+            values = grown_values;
+        }
+
+        keys[n] = parse_expression(parser, 1);
+        match(parser, TOK_COLON);
+        values[n] = parse_expression(parser, 1);
+        n++;
+    }
+
+    match(parser, TOK_RBRACE);
+
+    probe->Map.keys = keys;
+    probe->Map.values = values;
+    probe->Map.nentries = n;
+
+    return intern(parser, probe, NULL);
+}
+
+/* struct Name { field: type, ... } or struct(soa) Name { ... } */
+RecordType* parse_struct(Parser* parser) {
+    RecordType* record = alloc(parser, sizeof(RecordType));
+    record->path = NULL;
+    record->soa = 0;
+
+    match(parser, TOK_STRUCT);
+
+    if (expect(parser, TOK_LPAREN)) {
+        advance(parser);
+
+        Token layout = parser->current;
+        match(parser, TOK_IDENTIFIER);
+
+        if (!span_equals(layout.span, span_from("soa")))
+            error_at(parser, layout, "unknown struct layout '%.*s', expected soa", (int)layout.span.size, layout.span.data);
+
+        record->soa = 1;
+        match(parser, TOK_RPAREN);
+    }
+
+    Token name = parser->current;
+    match(parser, TOK_IDENTIFIER);
+
+    record->name = name.span;
+    record->line = name.line;
+    record->col = name.col;
+
+    RecordField* fields = NULL;
+    size_t capacity = 0;
+    size_t n = 0;
+
+    size_t size = 0;
+    size_t align = 1;
+
+    match(parser, TOK_LBRACE);
+
+    while (!expect(parser, TOK_RBRACE)) {
+        if (n > 0)
+            match(parser, TOK_COMMA);
+
+        /* the old lists stay in the arena, at most doubling what is used. */
+        if (n == capacity) {
+            capacity = capacity == 0 ? 8 : capacity * 2;
+
+            RecordField* grown = alloc(parser, capacity * sizeof(RecordField));
+            if (n > 0)
+                memcpy(grown, fields, n * sizeof(RecordField));
+
+            fields = grown;
+        }
+
+        Token field = parser->current;
+        match(parser, TOK_IDENTIFIER);
+
+        for (size_t i = 0; i < n; i++) {
+            if (span_equals(fields[i].name, field.span))
+                error_at(parser, field, "duplicate field '%.*s'", (int)field.span.size, field.span.data);
+        }
+
+        match(parser, TOK_COLON);
+
+        Token type_token = parser->current;
+        Type type = parse_type(parser);
+
+        if (type.kind != VAL_INT && type.kind != VAL_DOUBLE && type.kind != VAL_BOOL)
+            error_at(parser, type_token, "struct fields have to be i64, f64 or bool");
+
+        /* natural alignment: a field starts at a multiple of its size. */
+        size_t field_size = type.kind == VAL_BOOL ? 1 : sizeof(int64_t);
+        size_t offset = (size + field_size - 1) & ~(field_size - 1);
+
+        fields[n++] = (RecordField) {
+            .name = field.span,
+            .kind = type.kind,
+            .size = field_size,
+            .offset = offset,
+        };
+
+        size = offset + field_size;
+        if (field_size > align)
+            align = field_size;
+
+        if (size > RECORD_MAX_SIZE)
+            error_at(parser, field, "struct '%.*s' is larger than %d bytes", (int)name.span.size, name.span.data, RECORD_MAX_SIZE);
+    }
+
+    if (n == 0)
+        error_at(parser, name, "struct '%.*s' has no fields", (int)name.span.size, name.span.data);
+
+    match(parser, TOK_RBRACE);
+
+    record->fields = fields;
+    record->nfields = n;
+    record->size = (size + align - 1) & ~(align - 1);
+
+    return record;
+}
+
+/* fn name(param: type, ...) -> type { ... }. the body is not parsed, it is
+ * skipped over by matching its braces and only its text is kept. */
+Function* parse_function(Parser* parser) {
+    Function* function = alloc(parser, sizeof(Function));
+    memset(function, 0, sizeof(Function));
+
+    match(parser, TOK_FN);
+
+    Token name = parser->current;
+    match(parser, TOK_IDENTIFIER);
+
+    function->name = name.span;
+    function->line = name.line;
+    function->col = name.col;
+
+    Span* names = NULL;
+    Type* params = NULL;
+    size_t capacity = 0;
+    size_t n = 0;
+
+    match(parser, TOK_LPAREN);
+
+    while (!expect(parser, TOK_RPAREN)) {
+        if (n > 0)
+            match(parser, TOK_COMMA);
+
+        /* the old lists stay in the arena, at most doubling what is used. */
+        if (n == capacity) {
+            capacity = capacity == 0 ? 8 : capacity * 2;
+
+            Span* grown_names = alloc(parser, capacity * sizeof(Span));
+            Type* grown_params = alloc(parser, capacity * sizeof(Type));
+
+            if (n > 0) {
+                memcpy(grown_names, names, n * sizeof(Span));
+                memcpy(grown_params, params, n * sizeof(Type));
+            }
+
+            names = grown_names;
+            params = grown_params;
+        }
+
+        Token param = parser->current;
+        match(parser, TOK_IDENTIFIER);
+
+        for (size_t i = 0; i < n; i++) {
+            if (span_equals(names[i], param.span))
+                error_at(parser, param, "duplicate parameter '%.*s'", (int)param.span.size, param.span.data);
+        }
+
+        match(parser, TOK_COLON);
+
+        names[n] = param.span;
+        params[n] = parse_type(parser);
+        n++;
+    }
+
+    match(parser, TOK_RPAREN);
+    match(parser, TOK_ARROW);
+
+    function->names = names;
+    function->params = params;
+    function->nparams = n;
+    function->result = parse_type(parser);
+
+    if (!expect(parser, TOK_LBRACE))
+        error_unexpected(parser, token_stringified[TOK_LBRACE]);
+
+    /* the lexer is right after the '{' and, once the loop is done, right
+     * after the '}'. */
+    const char* start = parser->lexer->input - 1;
+    size_t depth = 0;
+
+    function->body_line = parser->current.line;
+    function->body_col = parser->current.col;
+
+    for (;;) {
+        if (expect(parser, TOK_LBRACE))
+            depth++;
+        else if (expect(parser, TOK_RBRACE) && --depth == 0)
+            break;
+        else if (is_eof(parser))
+            error_unexpected(parser, token_stringified[TOK_RBRACE]);
+
+        advance(parser);
     }
+
+    function->body = span_init(start, parser->lexer->input - start);
+    advance(parser);
+
+    return function;
+}
+
+/* import "path"; the path is copied out of the literal with its escapes
+ * undone. */
+Import parse_import(Parser* parser) {
+    match(parser, TOK_IMPORT);
+
+    Token path = parser->current;
+
+    if (!expect(parser, TOK_STRINGLITERAL))
+        error_unexpected(parser, token_stringified[TOK_STRINGLITERAL]);
+
+    Span text = parse_string_literal(parser);
+
+    char* data = alloc(parser, text.size + 1);
+    memcpy(data, text.data, text.size);
+    data[text.size] = 0;
+
+    advance(parser);
+    match(parser, TOK_SEMICOLON);
+
+    return (Import) {
+        .path = span_init(data, text.size),
+        .line = path.line,
+        .col = path.col,
+        .module = NULL,
+    };
+}
+
+/* Name { field: value, ... }, probe holds the name. */
+static Expr* parse_record(Parser* parser, Expr* probe) {
+    Span name = probe->Primary.span;
+
+    probe->kind = EXPR_RECORD;
+    probe->Record.type = (Type) { .kind = VAL_RECORD, .name = name };
+
+    Span* names = NULL;
+    Expr** values = NULL;
+    size_t capacity = 0;
+    size_t n = 0;
+
+    match(parser, TOK_LBRACE);
+
+    while (!expect(parser, TOK_RBRACE)) {
+        if (n > 0)
+            match(parser, TOK_COMMA);
+
+        /* the old lists stay in the arena, at most doubling what is used. */
+        if (n == capacity) {
+            capacity = capacity == 0 ? 8 : capacity * 2;
+
+            Span* grown_names = alloc(parser, capacity * sizeof(Span));
+            Expr** grown_values = alloc(parser, capacity * sizeof(Expr*));
+
+            if (n > 0) {
+                memcpy(grown_names, names, n * sizeof(Span));
+                memcpy(grown_values, values, n * sizeof(Expr*));
+            }
+
+            names = grown_names;
+            values = grown_values;
+        }
+
+        names[n] = parser->current.span;
+        match(parser, TOK_IDENTIFIER);
+        match(parser, TOK_COLON);
+        values[n] = parse_expression(parser, 1);
+        n++;
+    }
+
+    match(parser, TOK_RBRACE);
+
+    probe->Record.names = names;
+    probe->Record.values = values;
+    probe->Record.fields = alloc(parser, n * sizeof(size_t));
+    probe->Record.nfields = n;
+
+    return intern(parser, probe, NULL);
 }
@@ -2,17 +2,89 @@
 #define PARSER_H
 
 #include <stddef.h>
+#include <stdint.h>
+#include <setjmp.h>
 
+#include "kidomaru.h"
+#include "arena.h"
 #include "lexer.h"
 #include "ast.h"
+#include "function.h"
+
+/* a node in the table of shared expressions. */
+typedef struct ExprEntry_t {
+    uint64_t hash;
+    size_t block;
+    Expr* expr;
+} ExprEntry;
 
 typedef struct Parser_t {
     Lexer* lexer;
     Token current;
+
+    /* every node is allocated from here, the tree is never freed piecewise. */
+    Arena* arena;
+
+    /* string literals go here, arena unless values may outlive the tree. */
+    Arena* constants;
+
+    /* with dedup set, a pure expression is hash-consed: one equal to an
+     * expression already parsed in the same block, by its operator, literal
+     * and children, is that node. keeping to one block keeps what variables
+     * resolve to, and has the node's position be that of the first copy to
+     * run. map and struct literals are never shared. */
+    int dedup;
+    ExprEntry* table;
+    size_t table_count;
+    size_t table_capacity;
+
+    /* the block being parsed, numbered in the order blocks open. */
+    size_t block;
+    size_t nblocks;
+
+    /* the elements of the lists being parsed, innermost last, and the text
+     * of the last string literal. the nodes keep copies of the ones that
+     * are not shared. */
+    Expr** list;
+    size_t list_size;
+    size_t list_capacity;
+
+    char* text;
+    size_t text_capacity;
+
+    /* expressions parsed, and the nodes allocated for them. */
+    size_t nexprs;
+    size_t nnodes;
+
+    /* tokens read, allocations made and their bytes, and when parsing
+     * started when stats are on. they go to the stats at parser_deinit. */
+    size_t ntokens;
+    size_t nallocs;
+    size_t nbytes;
+    int64_t started;
+
+    /* the first syntax error is written to error and parsing unwinds to bail. */
+    kd_error* error;
+    jmp_buf bail;
 } Parser;
 
-Parser parser_init(Lexer* lexer);
+Parser parser_init(Lexer* lexer, Arena* arena, kd_error* error);
+void parser_deinit(Parser* parser);
 
 Statement* parse_statement(Parser* parser);
 
+/* what the one-pass compiler reads its tokens with, see onepass.c. errors
+ * are reported like the parser's own and unwind to parser->bail. */
+void parser_advance(Parser* parser);
+void parser_match(Parser* parser, TokenKind kind);
+void parser_error_unexpected(Parser* parser, const char* expected);
+
+/* the text of the current string literal token, only good until the next
+ * one. the token is not consumed. */
+Span parse_string_literal(Parser* parser);
+Type parse_type(Parser* parser);
+RecordType* parse_struct(Parser* parser);
+Function* parse_function(Parser* parser);
+Import parse_import(Parser* parser);
+
 #endif /* PARSER_H */
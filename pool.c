@@ -0,0 +1,263 @@
+#include <stdlib.h>
+
+#include "pool.h"
+
+typedef struct WorkerArg_t {
+    ThreadPool* pool;
+    size_t index;
+} WorkerArg;
+
+/* lets nested submits find the queue of the worker they run on. */
+static _Thread_local ThreadPool* current_pool = NULL;
+static _Thread_local size_t current_worker = 0;
+
+static int queue_init(WorkQueue* queue);
+static void queue_deinit(WorkQueue* queue);
+static int queue_push(WorkQueue* queue, Task task);
+static int queue_pop(WorkQueue* queue, Task* task);
+static int queue_steal(WorkQueue* queue, Task* task);
+
+static int find_task(ThreadPool* pool, size_t index, Task* task);
+static void finish_task(ThreadPool* pool);
+static void stop_workers(ThreadPool* pool, size_t started);
+static void* worker_main(void* arg);
+
+int pool_init(ThreadPool* pool, size_t nworkers) {
+    if (nworkers == 0)
+        nworkers = 1;
+
+    pool->nworkers = nworkers;
+    pool->queued = 0;
+    pool->pending = 0;
+    pool->sleeping = 0;
+    pool->next_queue = 0;
+    pool->stopping = 0;
+
+    pool->threads = calloc(nworkers, sizeof(pthread_t));
+    pool->queues = calloc(nworkers, sizeof(WorkQueue));
+
+    if (pool->threads == NULL || pool->queues == NULL) {
+        free(pool->threads);
+        free(pool->queues);
+        return 0;
+    }
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    for (size_t i = 0; i < nworkers; i++)
+        queue_init(&pool->queues[i]);
+
+    for (size_t i = 0; i < nworkers; i++) {
+        /* freed by the worker once it has read it. */
+        WorkerArg* arg = malloc(sizeof(WorkerArg));
+
+        if (arg != NULL) {
+            arg->pool = pool;
+            arg->index = i;
+        }
+
+        if (arg == NULL || pthread_create(&pool->threads[i], NULL, worker_main, arg) != 0) {
+            free(arg);
+            stop_workers(pool, i);
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+void pool_deinit(ThreadPool* pool) {
+    stop_workers(pool, pool->nworkers);
+}
+
+static void stop_workers(ThreadPool* pool, size_t started) {
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = 1;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (size_t i = 0; i < started; i++)
+        pthread_join(pool->threads[i], NULL);
+
+    for (size_t i = 0; i < pool->nworkers; i++)
+        queue_deinit(&pool->queues[i]);
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->wake);
+    pthread_cond_destroy(&pool->done);
+
+    free(pool->threads);
+    free(pool->queues);
+}
+
+int pool_submit(ThreadPool* pool, TaskFn fn, void* arg) {
+    size_t index;
+
+    if (current_pool == pool)
+        index = current_worker;
+    else
+        index = __atomic_fetch_add(&pool->next_queue, 1, __ATOMIC_RELAXED) % pool->nworkers;
+
+    __atomic_add_fetch(&pool->pending, 1, __ATOMIC_SEQ_CST);
+
+    if (!queue_push(&pool->queues[index], (Task) { .fn = fn, .arg = arg })) {
+        finish_task(pool);
+        return 0;
+    }
+
+    /* pairs with the sleeper counting itself before it looks at queued:
+     * either it sees this task or this sees it asleep and wakes it. */
+    __atomic_add_fetch(&pool->queued, 1, __ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&pool->sleeping, __ATOMIC_SEQ_CST) != 0) {
+        pthread_mutex_lock(&pool->lock);
+        pthread_cond_signal(&pool->wake);
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    return 1;
+}
+
+void pool_wait(ThreadPool* pool) {
+    pthread_mutex_lock(&pool->lock);
+
+    while (__atomic_load_n(&pool->pending, __ATOMIC_SEQ_CST) != 0)
+        pthread_cond_wait(&pool->done, &pool->lock);
+
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/* the last task out wakes pool_wait, under the lock so it cannot miss it. */
+static void finish_task(ThreadPool* pool) {
+    if (__atomic_sub_fetch(&pool->pending, 1, __ATOMIC_SEQ_CST) != 0)
+        return;
+
+    pthread_mutex_lock(&pool->lock);
+    pthread_cond_broadcast(&pool->done);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+static int queue_init(WorkQueue* queue) {
+    pthread_mutex_init(&queue->lock, NULL);
+    queue->tasks = NULL;
+    queue->capacity = 0;
+    queue->head = 0;
+    queue->size = 0;
+
+    return 1;
+}
+
+static void queue_deinit(WorkQueue* queue) {
+    pthread_mutex_destroy(&queue->lock);
+    free(queue->tasks);
+}
+
+static int queue_push(WorkQueue* queue, Task task) {
+    pthread_mutex_lock(&queue->lock);
+
+    if (queue->size == queue->capacity) {
+        size_t capacity = queue->capacity == 0 ? 64 : queue->capacity * 2;
+        Task* tasks = malloc(capacity * sizeof(Task));
+
+        if (tasks == NULL) {
+            pthread_mutex_unlock(&queue->lock);
+            return 0;
+        }
+
+        for (size_t i = 0; i < queue->size; i++)
+            tasks[i] = queue->tasks[(queue->head + i) % queue->capacity];
+
+        free(queue->tasks);
+        queue->tasks = tasks;
+        queue->capacity = capacity;
+        queue->head = 0;
+    }
+
+    queue->tasks[(queue->head + queue->size) % queue->capacity] = task;
+    queue->size++;
+
+    pthread_mutex_unlock(&queue->lock);
+    return 1;
+}
+
+static int queue_pop(WorkQueue* queue, Task* task) {
+    pthread_mutex_lock(&queue->lock);
+
+    if (queue->size == 0) {
+        pthread_mutex_unlock(&queue->lock);
+        return 0;
+    }
+
+    queue->size--;
+    *task = queue->tasks[(queue->head + queue->size) % queue->capacity];
+
+    pthread_mutex_unlock(&queue->lock);
+    return 1;
+}
+
+static int queue_steal(WorkQueue* queue, Task* task) {
+    pthread_mutex_lock(&queue->lock);
+
+    if (queue->size == 0) {
+        pthread_mutex_unlock(&queue->lock);
+        return 0;
+    }
+
+    *task = queue->tasks[queue->head];
+    queue->head = (queue->head + 1) % queue->capacity;
+    queue->size--;
+
+    pthread_mutex_unlock(&queue->lock);
+    return 1;
+}
+
+static int find_task(ThreadPool* pool, size_t index, Task* task) {
+    if (queue_pop(&pool->queues[index], task))
+        return 1;
+
+    for (size_t i = 1; i < pool->nworkers; i++) {
+        if (queue_steal(&pool->queues[(index + i) % pool->nworkers], task))
+            return 1;
+    }
+
+    return 0;
+}
+
+static void* worker_main(void* arg) {
+    WorkerArg* worker = arg;
+    ThreadPool* pool = worker->pool;
+    size_t index = worker->index;
+
+    free(worker);
+
+    current_pool = pool;
+    current_worker = index;
+
+    while (1) {
+        Task task;
+
+        if (find_task(pool, index, &task)) {
+            __atomic_sub_fetch(&pool->queued, 1, __ATOMIC_SEQ_CST);
+            task.fn(task.arg, index);
+            finish_task(pool);
+            continue;
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        __atomic_add_fetch(&pool->sleeping, 1, __ATOMIC_SEQ_CST);
+
+        while (__atomic_load_n(&pool->queued, __ATOMIC_SEQ_CST) == 0 && !pool->stopping)
+            pthread_cond_wait(&pool->wake, &pool->lock);
+
+        __atomic_sub_fetch(&pool->sleeping, 1, __ATOMIC_SEQ_CST);
+        int stopping = pool->stopping && __atomic_load_n(&pool->queued, __ATOMIC_SEQ_CST) == 0;
+        pthread_mutex_unlock(&pool->lock);
+
+        if (stopping)
+            break;
+    }
+
+    return NULL;
+}
@@ -0,0 +1,56 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+/* worker is the index of the thread running the task, so tasks can keep
+ * per worker state in an array indexed by it. */
+typedef void (*TaskFn)(void* arg, size_t worker);
+
+typedef struct Task_t {
+    TaskFn fn;
+    void* arg;
+} Task;
+
+/* a growable ring of tasks. the owning worker pushes and pops at the tail,
+ * thieves take from the head so they steal the oldest work. */
+typedef struct WorkQueue_t {
+    pthread_mutex_t lock;
+    Task* tasks;
+    size_t capacity;
+    size_t head;
+    size_t size;
+} WorkQueue;
+
+typedef struct ThreadPool_t {
+    size_t nworkers;
+    pthread_t* threads;
+    WorkQueue* queues;
+
+    /* the counters are atomic, so submitting and running a task only lock
+     * a queue. lock is taken to sleep on wake until a task is queued, to
+     * wait on done and to stop. */
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t done;
+
+    size_t queued;
+    size_t pending;
+    size_t sleeping;
+    size_t next_queue;
+    int stopping;
+} ThreadPool;
+
+/* returns 0 on failure. */
+int pool_init(ThreadPool* pool, size_t nworkers);
+void pool_deinit(ThreadPool* pool);
+
+/* a task submitted from inside a worker goes to that worker's own queue,
+ * otherwise the queues are filled round robin. returns 0 when out of memory. */
+int pool_submit(ThreadPool* pool, TaskFn fn, void* arg);
+
+/* blocks until every submitted task has finished. */
+void pool_wait(ThreadPool* pool);
+
+#endif /* POOL_H */
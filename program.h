@@ -0,0 +1,65 @@
+#ifndef PROGRAM_H
+#define PROGRAM_H
+
+#include "kidomaru.h"
+#include "arena.h"
+#include "ast.h"
+#include "bytecode.h"
+#include "interpreter.h"
+#include "resolver.h"
+#include "function.h"
+
+struct kd_program {
+    Arena arena;
+
+    /* spans in the tree point into this copy of the source. */
+    const char* source;
+    Statement* root;
+
+    Chunk chunk;
+
+    /* the functions the program declares, their bodies are compiled into
+     * arena too. */
+    Functions functions;
+};
+
+struct kd_context {
+    Interpreter interpreter;
+    kd_error error;
+    kd_status status;
+};
+
+/* a program with nothing compiled into it yet, and what it holds. */
+void program_init(kd_program* program);
+void program_deinit(kd_program* program);
+
+/* compiles into program, which program_init has set up. a caller compiling
+ * many scripts can arena_reset program->arena between them instead of
+ * going through kd_compile and kd_program_free for each. */
+kd_status program_compile(kd_program* program, const char* source, size_t len, const kd_compile_options* options, kd_error* error);
+
+/* compiles source as one statement at the top level of a stream, which
+ * starts at line and col of the stream's input. what it declares goes to
+ * globals->arena instead, it outlives the program. its string literals do
+ * not, a global or a map keeping one gets a copy, see string_own. */
+kd_status program_compile_global(kd_program* program, const char* source, size_t len, size_t line, size_t col,
+    Globals* globals, const kd_compile_options* options, kd_error* error);
+
+/* compiles the body of function into chunk with the options of its table,
+ * see function_chunk. */
+kd_status program_compile_function(Function* function, Chunk* chunk, kd_error* error);
+
+/* compiles the body of tier with every pass into chunk, for the second
+ * tier. with loop, one of the loops of the chunk of the first tier, the
+ * chunk starts at that loop instead, with its values for arguments. only
+ * called under the lock of the table of tier, see functions_lock. */
+kd_status program_compile_tier(struct Tier_t* tier, const ChunkLoop* loop, Chunk* chunk, kd_error* error);
+
+/* the body of function parsed and resolved, the first time it is asked for,
+ * by its own compile or by a caller inlining it. NULL when it does not
+ * parse or resolve, with the error in error. only called while compiling
+ * something of the table of function, which never happens on two threads
+ * at once. */
+const Statement* program_function_body(Function* function, kd_error* error);
+
+#endif /* PROGRAM_H */
@@ -0,0 +1,118 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "record.h"
+#include "array.h"
+
+#define RECORD_ALIGN 64
+
+/* the elements follow the header, which is padded to keep them aligned. */
+#define RECORD_HEADER ((sizeof(RecordArrayObject) + RECORD_ALIGN - 1) & ~(size_t)(RECORD_ALIGN - 1))
+
+RecordObject* record_new(const RecordType* type) {
+    RecordObject* record = malloc(sizeof(RecordObject) + type->size);
+    if (record == NULL)
+        return NULL;
+
+    record->refcount = 1;
+    record->type = type;
+
+    return record;
+}
+
+void record_release(RecordObject* record) {
+    if (__atomic_sub_fetch(&record->refcount, 1, __ATOMIC_ACQ_REL) == 0)
+        free(record);
+}
+
+RecordArrayObject* record_array_new(const RecordType* type, size_t size) {
+    if (type->size != 0 && size > (SIZE_MAX - RECORD_HEADER - RECORD_ALIGN) / type->size)
+        return NULL;
+
+    /* aligned_alloc wants a multiple of the alignment. */
+    size_t bytes = (RECORD_HEADER + size * type->size + RECORD_ALIGN - 1) & ~(size_t)(RECORD_ALIGN - 1);
+
+    RecordArrayObject* records = aligned_alloc(RECORD_ALIGN, bytes);
+    if (records == NULL)
+        return NULL;
+
+    records->refcount = 1;
+    records->type = type;
+    records->size = size;
+    records->data = (unsigned char*)records + RECORD_HEADER;
+
+    return records;
+}
+
+void record_array_release(RecordArrayObject* records) {
+    if (__atomic_sub_fetch(&records->refcount, 1, __ATOMIC_ACQ_REL) == 0)
+        free(records);
+}
+
+Value record_value(RecordObject* record) {
+    Value value;
+    memset(&value, 0, sizeof(Value));
+
+    value.kind = VAL_RECORD;
+    value.record = record;
+
+    return value;
+}
+
+Value record_array_value(RecordArrayObject* records) {
+    Value value;
+    memset(&value, 0, sizeof(Value));
+
+    value.kind = VAL_RECORD_ARRAY;
+    value.records = records;
+
+    return value;
+}
+
+void record_array_set(RecordArrayObject* records, size_t index, const RecordObject* record) {
+    const RecordType* type = records->type;
+
+    if (!type->soa) {
+        memcpy(records->data + index * type->size, record->data, type->size);
+        return;
+    }
+
+    for (size_t i = 0; i < type->nfields; i++) {
+        const RecordField* field = &type->fields[i];
+        memcpy(record_array_field(records, index, field->offset, field->size), record->data + field->offset, field->size);
+    }
+}
+
+void record_array_get(const RecordArrayObject* records, size_t index, RecordObject* record) {
+    const RecordType* type = records->type;
+
+    if (!type->soa) {
+        memcpy(record->data, records->data + index * type->size, type->size);
+        return;
+    }
+
+    for (size_t i = 0; i < type->nfields; i++) {
+        const RecordField* field = &type->fields[i];
+        memcpy(record->data + field->offset, record_array_field(records, index, field->offset, field->size), field->size);
+    }
+}
+
+ArrayObject* record_column(const RecordArrayObject* records, size_t offset) {
+    ArrayObject* column = array_new(records->size);
+    if (column == NULL)
+        return NULL;
+
+    if (records->type->soa) {
+        memcpy(column->i64, record_array_field(records, 0, offset, sizeof(int64_t)), records->size * sizeof(int64_t));
+        return column;
+    }
+
+    const unsigned char* element = records->data + offset;
+
+    for (size_t i = 0; i < records->size; i++) {
+        memcpy(&column->i64[i], element, sizeof(int64_t));
+        element += records->type->size;
+    }
+
+    return column;
+}
@@ -0,0 +1,57 @@
+#ifndef RECORD_H
+#define RECORD_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "value.h"
+
+/* a struct of type with one reference, its fields are not initialised.
+ * returns NULL when out of memory. */
+RecordObject* record_new(const RecordType* type);
+
+/* an array of size structs of type with one reference, laid out as the type
+ * asks. its elements are not initialised. returns NULL when out of memory. */
+RecordArrayObject* record_array_new(const RecordType* type, size_t size);
+
+Value record_value(RecordObject* record);
+Value record_array_value(RecordArrayObject* records);
+
+/* copies record into element index of records, and back out. */
+void record_array_set(RecordArrayObject* records, size_t index, const RecordObject* record);
+void record_array_get(const RecordArrayObject* records, size_t index, RecordObject* record);
+
+/* the i64 or f64 field at offset of every element as a new []i64 or []f64.
+ * for a soa type this only reads that field's column. returns NULL when out
+ * of memory. */
+ArrayObject* record_column(const RecordArrayObject* records, size_t offset);
+
+/* where element index of records keeps the field at offset, of size bytes. */
+static inline unsigned char* record_array_field(const RecordArrayObject* records, size_t index, size_t offset, size_t size) {
+    if (records->type->soa)
+        return records->data + records->size * offset + index * size;
+
+    return records->data + index * records->type->size + offset;
+}
+
+/* a field as a value, and a value of the field's kind into a field. */
+static inline Value record_load(const unsigned char* field, ValueKind kind) {
+    Value value = { .kind = kind };
+
+    if (kind == VAL_BOOL)
+        value.bool = *field;
+    else
+        memcpy(&value.i64, field, sizeof(int64_t));
+
+    return value;
+}
+
+static inline void record_store(unsigned char* field, const Value* value) {
+    if (value->kind == VAL_BOOL)
+        *field = value->bool != 0;
+    else
+        memcpy(field, &value->i64, sizeof(int64_t));
+}
+
+#endif /* RECORD_H */
@@ -0,0 +1,1109 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+
+#include "resolver.h"
+#include "module.h"
+#include "stats.h"
+
+typedef struct Binding_t {
+    Span id;
+    size_t line;
+    size_t col;
+
+    size_t depth;
+    size_t slot;
+
+    Type type;
+} Binding;
+
+/* the bindings of every scope between the root and the current statement,
+ * innermost last. leaving a scope pops its bindings, and the structs it
+ * declared. */
+typedef struct Resolver_t {
+    Binding* bindings;
+    size_t nbindings;
+    size_t capacity;
+
+    const RecordType** records;
+    size_t nrecords;
+    size_t records_capacity;
+
+    size_t depth;
+    size_t nslots;
+
+    /* the frame around the root when resolving a statement of a stream,
+     * NULL otherwise. lookup hands out a global as a binding in global. */
+    Globals* globals;
+    Binding global;
+
+    /* the functions that can be called, the first nfunctions of the table. */
+    Functions* functions;
+    size_t nfunctions;
+
+    /* inside the body of a for with a reduction, where yield can add to
+     * it, and inside the body of a par for, whose iterations run at the
+     * same time and so must not write to a map or return. */
+    int reduction;
+    int parallel;
+
+    /* names looked up and compared so far, and when resolving started, for
+     * the stats. */
+    size_t nlookups;
+    size_t nprobes;
+    int64_t started;
+
+    kd_error* error;
+    jmp_buf bail;
+} Resolver;
+
+static const struct {
+    const char* name;
+    size_t nargs;
+} builtins[] = {
+    [BUILTIN_LEN] = { "len", 1 },
+    [BUILTIN_SUM] = { "sum", 1 },
+    [BUILTIN_MIN] = { "min", 1 },
+    [BUILTIN_MAX] = { "max", 1 },
+    [BUILTIN_DOT] = { "dot", 2 },
+    [BUILTIN_FILL] = { "fill", 2 },
+    [BUILTIN_IOTA] = { "iota", 2 },
+    [BUILTIN_HAS] = { "has", 2 },
+    [BUILTIN_PUT] = { "put", 3 },
+    [BUILTIN_DEL] = { "del", 2 },
+    [BUILTIN_PRINT] = { "print", 1 },
+    [BUILTIN_PRINTLN] = { "println", 1 },
+};
+
+static void resolve_error(Resolver* resolver, size_t line, size_t col, const char* fmt, ...);
+static void out_of_memory(Resolver* resolver);
+static void report_stats(Resolver* resolver);
+
+static Binding* lookup(Resolver* resolver, Span id);
+static void declare(Resolver* resolver, VarDecl* vardecl, size_t line, size_t col);
+static void declare_struct(Resolver* resolver, const RecordType* record);
+static void push_struct(Resolver* resolver, const RecordType* record);
+static void declare_global(Resolver* resolver, VarDecl* vardecl, size_t line, size_t col);
+static RecordType* keep_struct(Resolver* resolver, const RecordType* record);
+static void declare_function(Resolver* resolver, Function* function);
+static void hoist_functions(Resolver* resolver, BlockStatement* blockstatement);
+static void keep_function(Resolver* resolver, const Function* function);
+static void import_modules(Resolver* resolver, BlockStatement* blockstatement);
+static void import_module(Resolver* resolver, const Statement* statement);
+static void push_global_struct(Resolver* resolver, const RecordType* record);
+static uint64_t hash_name(Span id);
+static Span copy_name(Resolver* resolver, Span id);
+static void resolve_type(Resolver* resolver, Type* type, size_t line, size_t col);
+static Type static_type(Resolver* resolver, const Expr* expr);
+
+static void resolve_statement(Resolver* resolver, Statement* statement);
+static void resolve_block_statement(Resolver* resolver, BlockStatement* blockstatement);
+static void resolve_for_statement(Resolver* resolver, Statement* statement);
+static void resolve_expression(Resolver* resolver, Expr* expr);
+static void resolve_call(Resolver* resolver, Expr* expr);
+static void resolve_record(Resolver* resolver, Expr* expr);
+static void resolve_field(Resolver* resolver, Expr* expr);
+
+kd_status resolve_program(Statement* root, Functions* functions, size_t* root_nslots, kd_error* error) {
+    Resolver resolver = {
+        .bindings = NULL,
+        .nbindings = 0,
+        .capacity = 0,
+        .records = NULL,
+        .nrecords = 0,
+        .records_capacity = 0,
+        .depth = 0,
+        .nslots = 0,
+        .functions = functions,
+        .started = stats_start(),
+        .error = error,
+    };
+
+    if (setjmp(resolver.bail)) {
+        free(resolver.bindings);
+        free(resolver.records);
+        report_stats(&resolver);
+        return error->status;
+    }
+
+    if (root->kind == STATEMENT_BLOCK) {
+        import_modules(&resolver, root->blockstatement);
+        hoist_functions(&resolver, root->blockstatement);
+    }
+
+    resolve_statement(&resolver, root);
+    *root_nslots = resolver.nslots;
+
+    free(resolver.bindings);
+    free(resolver.records);
+    report_stats(&resolver);
+    return KD_OK;
+}
+
+/* the body sees the structs its function did, but none of the variables
+ * around it. */
+kd_status resolve_function(const Function* function, Statement* body, size_t* root_nslots, kd_error* error) {
+    Resolver resolver = {
+        .bindings = NULL,
+        .nbindings = 0,
+        .capacity = 0,
+        .records = NULL,
+        .nrecords = 0,
+        .records_capacity = 0,
+        .depth = 0,
+        .nslots = 0,
+        .functions = function->table,
+        .nfunctions = function->nfunctions,
+        .started = stats_start(),
+        .error = error,
+    };
+
+    if (setjmp(resolver.bail)) {
+        free(resolver.bindings);
+        free(resolver.records);
+        report_stats(&resolver);
+        return error->status;
+    }
+
+    for (size_t i = 0; i < function->nrecords; i++)
+        push_struct(&resolver, function->records[i]);
+
+    for (size_t i = 0; i < function->nparams; i++) {
+        VarDecl param = { .id = function->names[i], .type = function->params[i] };
+        declare(&resolver, &param, function->line, function->col);
+    }
+
+    resolve_statement(&resolver, body);
+    *root_nslots = resolver.nslots;
+
+    free(resolver.bindings);
+    free(resolver.records);
+    report_stats(&resolver);
+    return KD_OK;
+}
+
+/* the options of the functions are set by every compile, see
+ * link_functions. */
+void globals_init(Globals* globals, Arena* arena) {
+    kd_compile_options options = { 0 };
+
+    *globals = (Globals) { .arena = arena };
+    functions_init(&globals->functions, arena, &options);
+}
+
+void globals_deinit(Globals* globals) {
+    functions_deinit(&globals->functions);
+    free(globals->variables);
+    free(globals->table);
+    free(globals->records);
+}
+
+/* globals are at depth 0, so the root of the statement is at 1. */
+kd_status resolve_global(Statement* statement, Globals* globals, size_t* root_nslots, kd_error* error) {
+    Resolver resolver = {
+        .bindings = NULL,
+        .nbindings = 0,
+        .capacity = 0,
+        .records = NULL,
+        .nrecords = 0,
+        .records_capacity = 0,
+        .depth = 1,
+        .nslots = 0,
+        .globals = globals,
+        .functions = &globals->functions,
+        .nfunctions = globals->functions.count,
+        .started = stats_start(),
+        .error = error,
+    };
+
+    if (setjmp(resolver.bail)) {
+        free(resolver.bindings);
+        free(resolver.records);
+        report_stats(&resolver);
+        return error->status;
+    }
+
+    switch (statement->kind) {
+    case STATEMENT_VAR_DECL:
+        resolve_expression(&resolver, statement->vardecl.expr);
+        resolve_type(&resolver, &statement->vardecl.type, statement->line, statement->col);
+        declare_global(&resolver, &statement->vardecl, statement->line, statement->col);
+        break;
+    case STATEMENT_STRUCT:
+        statement->record = keep_struct(&resolver, statement->record);
+        break;
+    case STATEMENT_FN:
+        keep_function(&resolver, statement->function);
+        break;
+    case STATEMENT_IMPORT:
+        import_module(&resolver, statement);
+        break;
+    case STATEMENT_FOR:
+        resolve_for_statement(&resolver, statement);
+
+        if (statement->forstatement.op != 0)
+            declare_global(&resolver, &statement->forstatement.result, statement->line, statement->col);
+        break;
+    default:
+        resolve_statement(&resolver, statement);
+        break;
+    }
+
+    *root_nslots = resolver.nslots;
+
+    free(resolver.bindings);
+    free(resolver.records);
+    report_stats(&resolver);
+    return KD_OK;
+}
+
+int builtin_lookup(Span callee, Builtin* builtin, size_t* nargs) {
+    for (size_t i = 0; i < sizeof(builtins) / sizeof(builtins[0]); i++) {
+        if (!span_equals(callee, span_from(builtins[i].name)))
+            continue;
+
+        *builtin = i;
+        *nargs = builtins[i].nargs;
+        return 1;
+    }
+
+    return 0;
+}
+
+static void resolve_error(Resolver* resolver, size_t line, size_t col, const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+
+    resolver->error->status = KD_ERROR_SYNTAX;
+    resolver->error->line = line;
+    resolver->error->col = col;
+    vsnprintf(resolver->error->message, sizeof(resolver->error->message), fmt, args);
+
+    va_end(args);
+    longjmp(resolver->bail, 1);
+}
+
+static void out_of_memory(Resolver* resolver) {
+    resolver->error->status = KD_ERROR_NOMEM;
+    resolver->error->line = 0;
+    resolver->error->col = 0;
+    snprintf(resolver->error->message, sizeof(resolver->error->message), "cannot allocate memory!");
+
+    longjmp(resolver->bail, 1);
+}
+
+/* on the way out, with whatever it bailed from. */
+static void report_stats(Resolver* resolver) {
+    stats_add(STAT_LOOKUPS, resolver->nlookups);
+    stats_add(STAT_PROBES, resolver->nprobes);
+    stats_stop(KD_PHASE_RESOLVE, resolver->started);
+}
+
+static Binding* lookup(Resolver* resolver, Span id) {
+    resolver->nlookups++;
+
+    for (size_t i = resolver->nbindings; i > 0; i--) {
+        resolver->nprobes++;
+
+        if (span_equals(resolver->bindings[i - 1].id, id))
+            return &resolver->bindings[i - 1];
+    }
+
+    Globals* globals = resolver->globals;
+    if (globals == NULL || globals->nvariables == 0)
+        return NULL;
+
+    size_t mask = globals->table_capacity - 1;
+
+    for (size_t i = hash_name(id) & mask; globals->table[i] != 0; i = (i + 1) & mask) {
+        const Global* global = &globals->variables[globals->table[i] - 1];
+        resolver->nprobes++;
+
+        if (!span_equals(global->id, id))
+            continue;
+
+        resolver->global = (Binding) {
+            .id = global->id,
+            .line = global->line,
+            .col = global->col,
+            .depth = 0,
+            .slot = globals->table[i] - 1,
+            .type = global->type,
+        };
+
+        return &resolver->global;
+    }
+
+    return NULL;
+}
+
+static void declare(Resolver* resolver, VarDecl* vardecl, size_t line, size_t col) {
+    Binding* existing = lookup(resolver, vardecl->id);
+
+    if (existing != NULL) {
+        resolve_error(resolver, line, col, "'%.*s' shadows the variable declared at (%zu:%zu)",
+            (int)vardecl->id.size, vardecl->id.data, existing->line, existing->col);
+    }
+
+    if (resolver->nbindings == resolver->capacity) {
+        size_t capacity = resolver->capacity == 0 ? 16 : resolver->capacity * 2;
+
+        Binding* bindings = realloc(resolver->bindings, capacity * sizeof(Binding));
+        if (bindings == NULL)
+            out_of_memory(resolver);
+
+        stats_alloc(KD_MEMORY_RESOLVER, capacity * sizeof(Binding));
+
+        resolver->bindings = bindings;
+        resolver->capacity = capacity;
+    }
+
+    vardecl->slot = resolver->nslots++;
+
+    resolver->bindings[resolver->nbindings++] = (Binding) {
+        .id = vardecl->id,
+        .line = line,
+        .col = col,
+        .depth = resolver->depth,
+        .slot = vardecl->slot,
+        .type = vardecl->type,
+    };
+}
+
+/* structs live in a namespace of their own, scoped like variables. */
+static const RecordType* lookup_struct(Resolver* resolver, Span name) {
+    resolver->nlookups++;
+
+    for (size_t i = resolver->nrecords; i > 0; i--) {
+        resolver->nprobes++;
+
+        if (span_equals(resolver->records[i - 1]->name, name))
+            return resolver->records[i - 1];
+    }
+
+    for (size_t i = resolver->globals != NULL ? resolver->globals->nrecords : 0; i > 0; i--) {
+        resolver->nprobes++;
+
+        if (span_equals(resolver->globals->records[i - 1]->name, name))
+            return resolver->globals->records[i - 1];
+    }
+
+    return NULL;
+}
+
+static void declare_struct(Resolver* resolver, const RecordType* record) {
+    const RecordType* existing = lookup_struct(resolver, record->name);
+
+    if (existing != NULL && existing->path != NULL) {
+        resolve_error(resolver, record->line, record->col, "'%.*s' shadows the struct imported from '%s'",
+            (int)record->name.size, record->name.data, existing->path);
+    }
+
+    if (existing != NULL) {
+        resolve_error(resolver, record->line, record->col, "'%.*s' shadows the struct declared at (%zu:%zu)",
+            (int)record->name.size, record->name.data, existing->line, existing->col);
+    }
+
+    push_struct(resolver, record);
+}
+
+static void push_struct(Resolver* resolver, const RecordType* record) {
+    if (resolver->nrecords == resolver->records_capacity) {
+        size_t capacity = resolver->records_capacity == 0 ? 8 : resolver->records_capacity * 2;
+
+        const RecordType** records = realloc(resolver->records, capacity * sizeof(RecordType*));
+        if (records == NULL)
+            out_of_memory(resolver);
+
+        stats_alloc(KD_MEMORY_RESOLVER, capacity * sizeof(RecordType*));
+
+        resolver->records = records;
+        resolver->records_capacity = capacity;
+    }
+
+    resolver->records[resolver->nrecords++] = record;
+}
+
+/* the table is kept at most half full. */
+static void declare_global(Resolver* resolver, VarDecl* vardecl, size_t line, size_t col) {
+    Globals* globals = resolver->globals;
+    Binding* existing = lookup(resolver, vardecl->id);
+
+    if (existing != NULL) {
+        resolve_error(resolver, line, col, "'%.*s' shadows the variable declared at (%zu:%zu)",
+            (int)vardecl->id.size, vardecl->id.data, existing->line, existing->col);
+    }
+
+    if (globals->nvariables == globals->capacity) {
+        size_t capacity = globals->capacity == 0 ? 64 : globals->capacity * 2;
+
+        Global* variables = realloc(globals->variables, capacity * sizeof(Global));
+        if (variables == NULL)
+            out_of_memory(resolver);
+
+        stats_alloc(KD_MEMORY_RESOLVER, capacity * sizeof(Global));
+
+        globals->variables = variables;
+        globals->capacity = capacity;
+    }
+
+    if ((globals->nvariables + 1) * 2 > globals->table_capacity) {
+        size_t capacity = globals->table_capacity == 0 ? 128 : globals->table_capacity * 2;
+
+        size_t* table = calloc(capacity, sizeof(size_t));
+        if (table == NULL)
+            out_of_memory(resolver);
+
+        stats_alloc(KD_MEMORY_RESOLVER, capacity * sizeof(size_t));
+
+        for (size_t i = 0; i < globals->nvariables; i++) {
+            size_t j = hash_name(globals->variables[i].id) & (capacity - 1);
+            while (table[j] != 0)
+                j = (j + 1) & (capacity - 1);
+
+            table[j] = i + 1;
+        }
+
+        free(globals->table);
+        globals->table = table;
+        globals->table_capacity = capacity;
+    }
+
+    Type type = vardecl->type;
+    if (type.record != NULL)
+        type.name = type.record->name;
+
+    vardecl->slot = globals->nvariables;
+
+    globals->variables[globals->nvariables++] = (Global) {
+        .id = copy_name(resolver, vardecl->id),
+        .line = line,
+        .col = col,
+        .type = type,
+    };
+
+    size_t i = hash_name(vardecl->id) & (globals->table_capacity - 1);
+    while (globals->table[i] != 0)
+        i = (i + 1) & (globals->table_capacity - 1);
+
+    globals->table[i] = globals->nvariables;
+}
+
+/* a struct declared at the top level outlives the statement declaring it,
+ * its layout and names go into the arena of the globals. */
+static RecordType* keep_struct(Resolver* resolver, const RecordType* record) {
+    Globals* globals = resolver->globals;
+
+    declare_struct(resolver, record);
+
+    RecordType* kept = arena_alloc(globals->arena, sizeof(RecordType));
+    RecordField* fields = arena_alloc(globals->arena, (record->nfields + 1) * sizeof(RecordField));
+    if (kept == NULL || fields == NULL)
+        out_of_memory(resolver);
+
+    *kept = *record;
+    kept->name = copy_name(resolver, record->name);
+    kept->fields = fields;
+
+    for (size_t i = 0; i < record->nfields; i++) {
+        fields[i] = record->fields[i];
+        fields[i].name = copy_name(resolver, record->fields[i].name);
+    }
+
+    push_global_struct(resolver, kept);
+    return kept;
+}
+
+static void push_global_struct(Resolver* resolver, const RecordType* record) {
+    Globals* globals = resolver->globals;
+
+    if (globals->nrecords == globals->records_capacity) {
+        size_t capacity = globals->records_capacity == 0 ? 8 : globals->records_capacity * 2;
+
+        const RecordType** records = realloc(globals->records, capacity * sizeof(RecordType*));
+        if (records == NULL)
+            out_of_memory(resolver);
+
+        stats_alloc(KD_MEMORY_RESOLVER, capacity * sizeof(RecordType*));
+
+        globals->records = records;
+        globals->records_capacity = capacity;
+    }
+
+    globals->records[globals->nrecords++] = record;
+}
+
+/* a function has a name of its own among the functions and the builtins.
+ * its signature may only name structs visible where it is declared. */
+static void declare_function(Resolver* resolver, Function* function) {
+    Functions* functions = resolver->functions;
+    Span name = function->name;
+
+    Builtin builtin;
+    size_t nargs;
+
+    if (builtin_lookup(name, &builtin, &nargs))
+        resolve_error(resolver, function->line, function->col, "'%.*s' is a builtin function", (int)name.size, name.data);
+
+    const Function* existing = functions_lookup(functions, name, functions->count, NULL);
+
+    if (existing != NULL && existing->table->path != NULL) {
+        resolve_error(resolver, function->line, function->col, "'%.*s' shadows the function imported from '%s'",
+            (int)name.size, name.data, existing->table->path);
+    }
+
+    if (existing != NULL) {
+        resolve_error(resolver, function->line, function->col, "'%.*s' shadows the function declared at (%zu:%zu)",
+            (int)name.size, name.data, existing->line, existing->col);
+    }
+
+    for (size_t i = 0; i < function->nparams; i++)
+        resolve_type(resolver, &function->params[i], function->line, function->col);
+
+    resolve_type(resolver, &function->result, function->line, function->col);
+
+    if (functions->count == MAX_FUNCTIONS)
+        resolve_error(resolver, function->line, function->col, "too many functions");
+
+    if (!functions_add(functions, function))
+        out_of_memory(resolver);
+}
+
+/* the functions at the top level of the root can be called from anywhere
+ * in it, before their declaration too. their signatures are resolved up
+ * front, each against the structs declared at the top level before it, and
+ * the structs are declared again, and checked, when the block is resolved. */
+static void hoist_functions(Resolver* resolver, BlockStatement* blockstatement) {
+    Functions* functions = resolver->functions;
+    size_t nrecords = resolver->nrecords;
+
+    for (BlockStatement* node = blockstatement; node != NULL; node = node->next) {
+        Statement* statement = node->statement;
+
+        if (statement->kind == STATEMENT_STRUCT) {
+            push_struct(resolver, statement->record);
+            continue;
+        }
+
+        if (statement->kind != STATEMENT_FN)
+            continue;
+
+        Function* function = statement->function;
+        declare_function(resolver, function);
+
+        function->records = arena_alloc(functions->arena, (resolver->nrecords + 1) * sizeof(RecordType*));
+        if (function->records == NULL)
+            out_of_memory(resolver);
+
+        if (resolver->nrecords > 0)
+            memcpy(function->records, resolver->records, resolver->nrecords * sizeof(RecordType*));
+
+        function->nrecords = resolver->nrecords;
+    }
+
+    for (size_t i = 0; i < functions->count; i++) {
+        if (functions->items[i]->table == functions)
+            functions->items[i]->nfunctions = functions->count;
+    }
+
+    resolver->nrecords = nrecords;
+    resolver->nfunctions = functions->count;
+}
+
+/* a function declared at the top level of a stream outlives the statement
+ * declaring it, its signature and the text of its body go into the arena
+ * of the globals. it can call itself and the functions before it. */
+static void keep_function(Resolver* resolver, const Function* function) {
+    Globals* globals = resolver->globals;
+
+    Function* kept = arena_alloc(globals->arena, sizeof(Function));
+    Span* names = arena_alloc(globals->arena, (function->nparams + 1) * sizeof(Span));
+    Type* params = arena_alloc(globals->arena, (function->nparams + 1) * sizeof(Type));
+    const RecordType** records = arena_alloc(globals->arena, (globals->nrecords + 1) * sizeof(RecordType*));
+    if (kept == NULL || names == NULL || params == NULL || records == NULL)
+        out_of_memory(resolver);
+
+    *kept = *function;
+    kept->name = copy_name(resolver, function->name);
+    kept->names = names;
+    kept->params = params;
+    kept->body = copy_name(resolver, function->body);
+
+    for (size_t i = 0; i < function->nparams; i++) {
+        names[i] = copy_name(resolver, function->names[i]);
+        params[i] = function->params[i];
+    }
+
+    if (globals->nrecords > 0)
+        memcpy(records, globals->records, globals->nrecords * sizeof(RecordType*));
+
+    kept->records = records;
+    kept->nrecords = globals->nrecords;
+
+    declare_function(resolver, kept);
+    kept->nfunctions = globals->functions.count;
+
+    /* the names of the structs are in the text of the statement. */
+    for (size_t i = 0; i < kept->nparams; i++) {
+        if (params[i].record != NULL)
+            params[i].name = params[i].record->name;
+    }
+
+    if (kept->result.record != NULL)
+        kept->result.name = kept->result.record->name;
+}
+
+/* the imports come first in the root block, what the modules they load
+ * declare is visible from anywhere in it. */
+static void import_modules(Resolver* resolver, BlockStatement* blockstatement) {
+    BlockStatement* node = blockstatement;
+
+    for (; node != NULL && node->statement->kind == STATEMENT_IMPORT; node = node->next)
+        import_module(resolver, node->statement);
+
+    for (; node != NULL; node = node->next) {
+        if (node->statement->kind == STATEMENT_IMPORT)
+            resolve_error(resolver, node->statement->line, node->statement->col, "imports have to come before the other statements");
+    }
+}
+
+/* a struct or function reached through two imports of the same module is
+ * the same one. at the top level of a stream they go into the globals. */
+static void import_module(Resolver* resolver, const Statement* statement) {
+    const Module* module = statement->import.module;
+    Functions* functions = resolver->functions;
+
+    for (size_t i = 0; i < module->nrecords; i++) {
+        const RecordType* record = module->records[i];
+        const RecordType* existing = lookup_struct(resolver, record->name);
+
+        if (existing == record)
+            continue;
+
+        if (existing != NULL && existing->path != NULL) {
+            resolve_error(resolver, statement->line, statement->col, "struct '%.*s' of '%s' shadows the one of '%s'",
+                (int)record->name.size, record->name.data, module->path, existing->path);
+        }
+
+        if (existing != NULL) {
+            resolve_error(resolver, statement->line, statement->col, "struct '%.*s' of '%s' shadows the struct declared at (%zu:%zu)",
+                (int)record->name.size, record->name.data, module->path, existing->line, existing->col);
+        }
+
+        if (resolver->globals != NULL)
+            push_global_struct(resolver, record);
+        else
+            push_struct(resolver, record);
+    }
+
+    for (size_t i = 0; i < module->functions.count; i++) {
+        Function* function = module->functions.items[i];
+        if (function->table != &module->functions)
+            continue;
+
+        const Function* existing = functions_lookup(functions, function->name, functions->count, NULL);
+
+        if (existing == function)
+            continue;
+
+        if (existing != NULL && existing->table->path != NULL) {
+            resolve_error(resolver, statement->line, statement->col, "function '%.*s' of '%s' shadows the one of '%s'",
+                (int)function->name.size, function->name.data, module->path, existing->table->path);
+        }
+
+        if (existing != NULL) {
+            resolve_error(resolver, statement->line, statement->col, "function '%.*s' of '%s' shadows the function declared at (%zu:%zu)",
+                (int)function->name.size, function->name.data, module->path, existing->line, existing->col);
+        }
+
+        if (functions->count == MAX_FUNCTIONS)
+            resolve_error(resolver, statement->line, statement->col, "too many functions");
+
+        if (!functions_link(functions, function))
+            out_of_memory(resolver);
+    }
+
+    resolver->nfunctions = functions->count;
+}
+
+static uint64_t hash_name(Span id) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+
+    for (size_t i = 0; i < id.size; i++)
+        hash = (hash ^ (unsigned char)id.data[i]) * 0x100000001b3ull;
+
+    return hash ^ hash >> 32;
+}
+
+static Span copy_name(Resolver* resolver, Span id) {
+    char* data = arena_alloc(resolver->globals->arena, id.size + 1);
+    if (data == NULL)
+        out_of_memory(resolver);
+
+    memcpy(data, id.data, id.size);
+    data[id.size] = 0;
+
+    return span_init(data, id.size);
+}
+
+static void resolve_type(Resolver* resolver, Type* type, size_t line, size_t col) {
+    if (type->kind != VAL_RECORD && type->kind != VAL_RECORD_ARRAY)
+        return;
+
+    type->record = lookup_struct(resolver, type->name);
+
+    if (type->record == NULL)
+        resolve_error(resolver, line, col, "undefined struct '%.*s'", (int)type->name.size, type->name.data);
+}
+
+/* what an expression is known to evaluate to before it runs, as far as
+ * field accesses need it. VAL_IDENT when that is not known. */
+static Type static_type(Resolver* resolver, const Expr* expr) {
+    Type unknown = { .kind = VAL_IDENT };
+
+    switch (expr->kind) {
+    case EXPR_PRIMARY: {
+        if (expr->Primary.kind != VAL_IDENT)
+            return (Type) { .kind = expr->Primary.kind };
+
+        /* variables are checked against their declared type. */
+        return lookup(resolver, expr->Primary.span)->type;
+    }
+    case EXPR_RECORD:
+        return expr->Record.type;
+    case EXPR_FIELD:
+        if (expr->Field.column)
+            return (Type) { .kind = expr->Field.field->kind == VAL_INT ? VAL_INT_ARRAY : VAL_DOUBLE_ARRAY };
+
+        return (Type) { .kind = expr->Field.field->kind };
+    case EXPR_INDEX: {
+        Type array = static_type(resolver, expr->Index.array);
+
+        if (array.kind == VAL_RECORD_ARRAY)
+            return (Type) { .kind = VAL_RECORD, .name = array.name, .record = array.record };
+
+        return unknown;
+    }
+    case EXPR_ARRAY: {
+        Type element = static_type(resolver, expr->Array.elements[0]);
+
+        if (element.kind == VAL_RECORD)
+            return (Type) { .kind = VAL_RECORD_ARRAY, .name = element.name, .record = element.record };
+
+        return unknown;
+    }
+    case EXPR_CALL: {
+        /* what it returns is checked against its result type. */
+        if (expr->Call.function != NULL)
+            return expr->Call.function->result;
+
+        if (expr->Call.builtin != BUILTIN_FILL)
+            return unknown;
+
+        Type element = static_type(resolver, expr->Call.args[1]);
+
+        if (element.kind == VAL_RECORD)
+            return (Type) { .kind = VAL_RECORD_ARRAY, .name = element.name, .record = element.record };
+
+        return unknown;
+    }
+    default:
+        return unknown;
+    }
+}
+
+static void resolve_statement(Resolver* resolver, Statement* statement) {
+    switch (statement->kind) {
+    case STATEMENT_VAR_DECL:
+        /* the variable is not visible in its own initialiser. */
+        resolve_expression(resolver, statement->vardecl.expr);
+        resolve_type(resolver, &statement->vardecl.type, statement->line, statement->col);
+        declare(resolver, &statement->vardecl, statement->line, statement->col);
+        break;
+    case STATEMENT_IF:
+        resolve_expression(resolver, statement->ifstatement.expr);
+        resolve_block_statement(resolver, statement->ifstatement.if_block);
+        resolve_block_statement(resolver, statement->ifstatement.else_block);
+        break;
+    case STATEMENT_BLOCK:
+        resolve_block_statement(resolver, statement->blockstatement);
+        break;
+    case STATEMENT_RETURN:
+        if (resolver->parallel)
+            resolve_error(resolver, statement->line, statement->col, "cannot return from a par for");
+
+        resolve_expression(resolver, statement->ret);
+        break;
+    case STATEMENT_EXPR:
+        resolve_expression(resolver, statement->expr);
+        break;
+    case STATEMENT_STRUCT:
+        declare_struct(resolver, statement->record);
+        break;
+    case STATEMENT_FN:
+        /* hoist_functions has declared it already. */
+        if (statement->function->table == NULL)
+            resolve_error(resolver, statement->line, statement->col, "functions can only be declared at the top level");
+        break;
+    case STATEMENT_IMPORT:
+        /* and import_modules has imported it. */
+        if (statement->import.module == NULL)
+            resolve_error(resolver, statement->line, statement->col, "modules can only be imported at the top level");
+        break;
+    case STATEMENT_FOR:
+        resolve_for_statement(resolver, statement);
+
+        /* the result is not visible in the loop. */
+        if (statement->forstatement.op != 0)
+            declare(resolver, &statement->forstatement.result, statement->line, statement->col);
+        break;
+    case STATEMENT_YIELD:
+        if (!resolver->reduction)
+            resolve_error(resolver, statement->line, statement->col, "yield outside of a for with a reduction");
+
+        resolve_expression(resolver, statement->yield);
+        break;
+    }
+}
+
+static void resolve_block_statement(Resolver* resolver, BlockStatement* blockstatement) {
+    if (blockstatement == NULL)
+        return;
+
+    size_t nbindings = resolver->nbindings;
+    size_t nrecords = resolver->nrecords;
+    size_t nslots = resolver->nslots;
+
+    resolver->depth++;
+    resolver->nslots = 0;
+
+    for (BlockStatement* node = blockstatement; node != NULL; node = node->next) {
+        node->nslots = 0;
+        resolve_statement(resolver, node->statement);
+    }
+
+    blockstatement->nslots = resolver->nslots;
+
+    resolver->depth--;
+    resolver->nslots = nslots;
+    resolver->nbindings = nbindings;
+    resolver->nrecords = nrecords;
+}
+
+/* the frame of the loop holds the loop variable in slot 0, and the
+ * statements of the body declare theirs after it. a yield inside a par for
+ * without a reduction of its own would add to the reduction of an outer
+ * loop from many iterations at once, so it is not allowed there. */
+static void resolve_for_statement(Resolver* resolver, Statement* statement) {
+    ForStatement* forstatement = &statement->forstatement;
+
+    resolve_expression(resolver, forstatement->from);
+    resolve_expression(resolver, forstatement->to);
+
+    size_t nbindings = resolver->nbindings;
+    size_t nrecords = resolver->nrecords;
+    size_t nslots = resolver->nslots;
+    int reduction = resolver->reduction;
+    int parallel = resolver->parallel;
+
+    resolver->depth++;
+    resolver->nslots = 0;
+    resolver->reduction = forstatement->op != 0 || (reduction && !forstatement->parallel);
+    resolver->parallel = parallel || forstatement->parallel;
+
+    VarDecl var = { .id = forstatement->var, .type = { .kind = VAL_INT } };
+    declare(resolver, &var, statement->line, statement->col);
+
+    for (BlockStatement* node = forstatement->body; node != NULL; node = node->next) {
+        node->nslots = 0;
+        resolve_statement(resolver, node->statement);
+    }
+
+    forstatement->nslots = resolver->nslots;
+
+    resolver->depth--;
+    resolver->nslots = nslots;
+    resolver->nbindings = nbindings;
+    resolver->nrecords = nrecords;
+    resolver->reduction = reduction;
+    resolver->parallel = parallel;
+}
+
+static void resolve_expression(Resolver* resolver, Expr* expr) {
+    if (expr->kind == EXPR_BINARY) {
+        resolve_expression(resolver, expr->Binary.lhs);
+        resolve_expression(resolver, expr->Binary.rhs);
+        return;
+    }
+
+    if (expr->kind == EXPR_CALL) {
+        resolve_call(resolver, expr);
+        return;
+    }
+
+    if (expr->kind == EXPR_ARRAY) {
+        for (size_t i = 0; i < expr->Array.nelements; i++)
+            resolve_expression(resolver, expr->Array.elements[i]);
+        return;
+    }
+
+    if (expr->kind == EXPR_MAP) {
+        for (size_t i = 0; i < expr->Map.nentries; i++) {
+            resolve_expression(resolver, expr->Map.keys[i]);
+            resolve_expression(resolver, expr->Map.values[i]);
+        }
+        return;
+    }
+
+    if (expr->kind == EXPR_RECORD) {
+        resolve_record(resolver, expr);
+        return;
+    }
+
+    if (expr->kind == EXPR_FIELD) {
+        resolve_field(resolver, expr);
+        return;
+    }
+
+    if (expr->kind == EXPR_INDEX) {
+        resolve_expression(resolver, expr->Index.array);
+        resolve_expression(resolver, expr->Index.index);
+        return;
+    }
+
+    if (expr->Primary.kind != VAL_IDENT)
+        return;
+
+    Binding* binding = lookup(resolver, expr->Primary.span);
+
+    if (binding == NULL) {
+        resolve_error(resolver, expr->line, expr->col, "undefined variable '%.*s'",
+            (int)expr->Primary.span.size, expr->Primary.span.data);
+    }
+
+    expr->depth = resolver->depth - binding->depth;
+    expr->slot = binding->slot;
+}
+
+static void resolve_call(Resolver* resolver, Expr* expr) {
+    Span callee = expr->Call.callee;
+
+    Builtin builtin;
+    size_t nargs;
+
+    for (size_t i = 0; i < expr->Call.nargs; i++)
+        resolve_expression(resolver, expr->Call.args[i]);
+
+    Function* function = NULL;
+    size_t slot = 0;
+
+    if (!builtin_lookup(callee, &builtin, &nargs)) {
+        if (resolver->functions != NULL)
+            function = functions_lookup(resolver->functions, callee, resolver->nfunctions, &slot);
+
+        if (function == NULL)
+            resolve_error(resolver, expr->line, expr->col, "undefined function '%.*s'", (int)callee.size, callee.data);
+
+        builtin = 0;
+        nargs = function->nparams;
+    }
+
+    if (expr->Call.nargs != nargs) {
+        resolve_error(resolver, expr->line, expr->col, "'%.*s' takes %zu argument(s) but got %zu",
+            (int)callee.size, callee.data, nargs, expr->Call.nargs);
+    }
+
+    /* only a map can be written to, and only by put, del or a function
+     * it is passed to. */
+    if (resolver->parallel && function == NULL && (builtin == BUILTIN_PUT || builtin == BUILTIN_DEL))
+        resolve_error(resolver, expr->line, expr->col, "a par for cannot write to a map");
+
+    for (size_t i = 0; resolver->parallel && function != NULL && i < function->nparams; i++) {
+        if (function->params[i].kind == VAL_MAP) {
+            resolve_error(resolver, expr->line, expr->col, "a par for cannot call '%.*s', which could write to a map",
+                (int)callee.size, callee.data);
+        }
+    }
+
+    expr->Call.builtin = builtin;
+    expr->Call.function = function;
+    expr->Call.slot = slot;
+}
+
+static void resolve_record(Resolver* resolver, Expr* expr) {
+    resolve_type(resolver, &expr->Record.type, expr->line, expr->col);
+
+    const RecordType* record = expr->Record.type.record;
+
+    /* the values are evaluated as written, each stored in its field. */
+    unsigned char* given = calloc(record->nfields, 1);
+    if (given == NULL)
+        out_of_memory(resolver);
+
+    for (size_t i = 0; i < expr->Record.nfields; i++) {
+        Span name = expr->Record.names[i];
+        size_t field = 0;
+
+        while (field < record->nfields && !span_equals(record->fields[field].name, name))
+            field++;
+
+        if (field == record->nfields || given[field]) {
+            free(given);
+            resolve_error(resolver, expr->Record.values[i]->line, expr->Record.values[i]->col,
+                field == record->nfields ? "struct '%.*s' has no field '%.*s'" : "struct '%.*s' field '%.*s' is given twice",
+                (int)record->name.size, record->name.data, (int)name.size, name.data);
+        }
+
+        given[field] = 1;
+        expr->Record.fields[i] = field;
+    }
+
+    for (size_t i = 0; i < record->nfields; i++) {
+        if (!given[i]) {
+            Span name = record->fields[i].name;
+            free(given);
+            resolve_error(resolver, expr->line, expr->col, "struct '%.*s' field '%.*s' is missing",
+                (int)record->name.size, record->name.data, (int)name.size, name.data);
+        }
+    }
+
+    free(given);
+
+    for (size_t i = 0; i < expr->Record.nfields; i++)
+        resolve_expression(resolver, expr->Record.values[i]);
+}
+
+static void resolve_field(Resolver* resolver, Expr* expr) {
+    resolve_expression(resolver, expr->Field.record);
+
+    Type type = static_type(resolver, expr->Field.record);
+    Span name = expr->Field.name;
+
+    if (type.kind != VAL_RECORD && type.kind != VAL_RECORD_ARRAY) {
+        resolve_error(resolver, expr->line, expr->col, "'.%.*s' needs a struct or an array of structs of a known type",
+            (int)name.size, name.data);
+    }
+
+    const RecordType* record = type.record;
+
+    for (size_t i = 0; i < record->nfields; i++) {
+        if (!span_equals(record->fields[i].name, name))
+            continue;
+
+        expr->Field.type = record;
+        expr->Field.field = &record->fields[i];
+        expr->Field.column = type.kind == VAL_RECORD_ARRAY;
+
+        /* there is no []bool to put the column in. */
+        if (expr->Field.column && record->fields[i].kind == VAL_BOOL)
+            resolve_error(resolver, expr->line, expr->col, "'.%.*s' is a bool field, only i64 and f64 fields make a column",
+                (int)name.size, name.data);
+
+        return;
+    }
+
+    resolve_error(resolver, expr->line, expr->col, "struct '%.*s' has no field '%.*s'",
+        (int)record->name.size, record->name.data, (int)name.size, name.data);
+}
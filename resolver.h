@@ -0,0 +1,71 @@
+#ifndef RESOLVER_H
+#define RESOLVER_H
+
+#include "kidomaru.h"
+#include "arena.h"
+#include "ast.h"
+#include "function.h"
+
+/* runs after parsing. every block gets a frame, every variable a slot in the
+ * frame of the block declaring it and every identifier the (depth, slot) of
+ * the variable it names, so nothing is looked up by name at runtime.
+ *
+ * the root statement gets a frame of its own, its size is written to
+ * root_nslots. a name that is not declared in an enclosing scope, or that is
+ * declared again while still visible, is an error.
+ *
+ * the functions declared at the top level of the root block are added to
+ * functions first, so they can be called from anywhere in the program. */
+kd_status resolve_program(Statement* root, Functions* functions, size_t* root_nslots, kd_error* error);
+
+/* resolves the body of function, just parsed from its text. its frame
+ * around the body holds the parameters, in slots 0 to nparams - 1. */
+kd_status resolve_function(const Function* function, Statement* body, size_t* root_nslots, kd_error* error);
+
+/* the builtin function named callee and how many arguments it takes,
+ * returns 0 when there is none. */
+int builtin_lookup(Span callee, Builtin* builtin, size_t* nargs);
+
+/* a variable declared at the top level of a stream, its slot is its index
+ * in Globals.variables. */
+typedef struct Global_t {
+    Span id;
+    size_t line;
+    size_t col;
+
+    Type type;
+} Global;
+
+/* what the statements of a stream run so far have declared. they are
+ * resolved one at a time and their trees freed after they ran, so names and
+ * structs are copied into arena, which lives as long as the stream. */
+typedef struct Globals_t {
+    Arena* arena;
+
+    Global* variables;
+    size_t nvariables;
+    size_t capacity;
+
+    /* open addressing by name, index + 1 of the variable, 0 when empty. */
+    size_t* table;
+    size_t table_capacity;
+
+    const RecordType** records;
+    size_t nrecords;
+    size_t records_capacity;
+
+    /* functions are visible to the statements after the one declaring
+     * them, their bodies are compiled into arena when first called. */
+    Functions functions;
+} Globals;
+
+void globals_init(Globals* globals, Arena* arena);
+void globals_deinit(Globals* globals);
+
+/* resolves statement as one at the top level of a stream, where globals
+ * make up a frame around the root. the variable or struct it declares, if
+ * any, is added to globals: a `let` gets the next global slot and a struct
+ * or function is moved into globals->arena. */
+kd_status resolve_global(Statement* statement, Globals* globals, size_t* root_nslots, kd_error* error);
+
+#endif /* RESOLVER_H */
@@ -0,0 +1,399 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include "sample.h"
+#include "function.h"
+
+/* the calls a sample keeps, from the one running outwards, and the bytes
+ * of a name it keeps. */
+#define SAMPLE_DEPTH 32
+#define SAMPLE_NAME 40
+
+/* samples the ring holds until they are drained, a power of 2. */
+#define SAMPLE_RING 1024
+
+/* how often the ring is drained, in milliseconds. */
+#define SAMPLE_DRAIN 20
+
+/* a frame copied out by the handler, the name and position of the call it
+ * is in, so that it stays valid after the program is freed. line is 0 when
+ * the instruction was not known. */
+typedef struct SampleFrame_t {
+    char name[SAMPLE_NAME];
+    uint32_t line;
+    uint32_t col;
+} SampleFrame;
+
+/* ready is the ticket the sample was taken with plus 1 once it can be read,
+ * see take. */
+typedef struct Sample_t {
+    uint64_t ready;
+
+    size_t nframes;
+    int truncated;
+    SampleFrame frames[SAMPLE_DEPTH];
+} Sample;
+
+/* the count of a stack, written root first as kd_profile_write prints it. */
+typedef struct ProfileEntry_t {
+    char* stack;
+    uint64_t hash;
+    long long count;
+} ProfileEntry;
+
+_Thread_local Interpreter* sample_running = NULL;
+
+int sample_on = 0;
+
+static Sample ring[SAMPLE_RING];
+
+/* tickets handed out and drained. a handler takes head with a compare and
+ * swap, only the drain moves tail. */
+static uint64_t head = 0;
+static uint64_t tail = 0;
+
+static long long dropped = 0;
+
+/* guards the table, the counts and starting and stopping. */
+static pthread_mutex_t profile_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static ProfileEntry* entries = NULL;
+static size_t nentries = 0;
+static size_t capacity = 0;
+static long long samples = 0;
+
+static int running = 0;
+static int stopping = 0;
+static pthread_t drainer;
+
+static void handle(int signal, siginfo_t* info, void* context);
+static void take(Sample* sample, const Interpreter* interpreter);
+static void take_frame(SampleFrame* frame, const Function* function, const Chunk* chunk, size_t pc);
+static void* drain_thread(void* arg);
+static void drain(void);
+static int count(const char* stack, size_t size);
+static void clear(void);
+static int compare_entries(const void* lhs, const void* rhs);
+
+int kd_profile_start(int hz) {
+    if (hz <= 0 || hz > 1000000)
+        return 0;
+
+    pthread_mutex_lock(&profile_lock);
+
+    if (running) {
+        pthread_mutex_unlock(&profile_lock);
+        return 0;
+    }
+
+    clear();
+    stopping = 0;
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = handle;
+    action.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&action.sa_mask);
+
+    long interval = 1000000 / hz;
+    struct itimerval timer = {
+        .it_interval = { .tv_sec = interval / 1000000, .tv_usec = interval % 1000000 },
+        .it_value = { .tv_sec = interval / 1000000, .tv_usec = interval % 1000000 },
+    };
+
+    if (pthread_create(&drainer, NULL, drain_thread, NULL) != 0) {
+        pthread_mutex_unlock(&profile_lock);
+        return 0;
+    }
+
+    if (sigaction(SIGPROF, &action, NULL) != 0 || setitimer(ITIMER_PROF, &timer, NULL) != 0) {
+        __atomic_store_n(&stopping, 1, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&profile_lock);
+        pthread_join(drainer, NULL);
+        return 0;
+    }
+
+    running = 1;
+    __atomic_store_n(&sample_on, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&profile_lock);
+
+    return 1;
+}
+
+/* a signal still on its way once the timer is off is ignored rather than
+ * left to the default action, which ends the process. */
+void kd_profile_stop(void) {
+    pthread_mutex_lock(&profile_lock);
+
+    if (!running) {
+        pthread_mutex_unlock(&profile_lock);
+        return;
+    }
+
+    struct itimerval off;
+    memset(&off, 0, sizeof(off));
+    setitimer(ITIMER_PROF, &off, NULL);
+    signal(SIGPROF, SIG_IGN);
+
+    running = 0;
+    __atomic_store_n(&sample_on, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&stopping, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&profile_lock);
+
+    pthread_join(drainer, NULL);
+}
+
+void kd_profile_counts(long long* taken, long long* lost) {
+    pthread_mutex_lock(&profile_lock);
+    *taken = samples;
+    *lost = __atomic_load_n(&dropped, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&profile_lock);
+}
+
+int kd_profile_write(FILE* file) {
+    pthread_mutex_lock(&profile_lock);
+
+    /* by stack, so that two profiles of one script diff well. the table
+     * itself stays as it is for the counts still to come. */
+    const ProfileEntry** sorted = malloc((nentries + 1) * sizeof(ProfileEntry*));
+    size_t n = 0;
+
+    for (size_t i = 0; i < capacity && sorted != NULL; i++) {
+        if (entries[i].stack != NULL)
+            sorted[n++] = &entries[i];
+    }
+
+    if (sorted != NULL) {
+        qsort(sorted, n, sizeof(ProfileEntry*), compare_entries);
+
+        for (size_t i = 0; i < n; i++)
+            fprintf(file, "%s %lld\n", sorted[i]->stack, sorted[i]->count);
+    } else {
+        for (size_t i = 0; i < capacity; i++) {
+            if (entries[i].stack != NULL)
+                fprintf(file, "%s %lld\n", entries[i].stack, entries[i].count);
+        }
+    }
+
+    free(sorted);
+    pthread_mutex_unlock(&profile_lock);
+
+    return fflush(file) == 0 && !ferror(file);
+}
+
+/* runs on whichever thread the signal stopped, so it only reads memory and
+ * takes a ticket. the ticket is only taken while the ring has room, a
+ * sample that finds it full is dropped. */
+static void handle(int signal, siginfo_t* info, void* context) {
+    (void)signal;
+    (void)info;
+    (void)context;
+
+    int saved = errno;
+    uint64_t ticket = __atomic_load_n(&head, __ATOMIC_RELAXED);
+
+    do {
+        if (ticket - __atomic_load_n(&tail, __ATOMIC_ACQUIRE) >= SAMPLE_RING) {
+            __atomic_fetch_add(&dropped, 1, __ATOMIC_RELAXED);
+            errno = saved;
+            return;
+        }
+    } while (!__atomic_compare_exchange_n(&head, &ticket, ticket + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    Sample* sample = &ring[ticket & (SAMPLE_RING - 1)];
+    take(sample, sample_running);
+
+    __atomic_store_n(&sample->ready, ticket + 1, __ATOMIC_RELEASE);
+    errno = saved;
+}
+
+/* the instruction running now and the call of every frame around it. */
+static void take(Sample* sample, const Interpreter* interpreter) {
+    sample->nframes = 0;
+    sample->truncated = 0;
+
+    const Running* running = interpreter != NULL ? __atomic_load_n(&interpreter->current, __ATOMIC_RELAXED) : NULL;
+    if (running == NULL)
+        return;
+
+    /* the first instruction after a call or a return has not been stored
+     * yet, the frame says where it is. */
+    const Chunk* chunk = running->chunk;
+    uintptr_t instr = (uintptr_t)__atomic_load_n(&interpreter->instr, __ATOMIC_RELAXED);
+    uintptr_t code = (uintptr_t)chunk->code;
+    size_t pc = instr >= code && instr < code + chunk->size * sizeof(Instr) ? (instr - code) / sizeof(Instr) : running->pc;
+
+    take_frame(&sample->frames[sample->nframes++], running->function, chunk, pc);
+
+    /* written before the frame that counts them became current. */
+    const Frame* frames = interpreter->frames;
+
+    for (size_t i = running->nframes; i > 0; i--) {
+        if (sample->nframes == SAMPLE_DEPTH) {
+            sample->truncated = 1;
+            break;
+        }
+
+        const Frame* frame = &frames[i - 1];
+        take_frame(&sample->frames[sample->nframes++], frame->function, frame->chunk, frame->pc - 1);
+    }
+}
+
+static void take_frame(SampleFrame* frame, const Function* function, const Chunk* chunk, size_t pc) {
+    const char* name = function != NULL ? function->name.data : "root";
+    size_t size = function != NULL ? function->name.size : 4;
+
+    if (size > SAMPLE_NAME - 1)
+        size = SAMPLE_NAME - 1;
+
+    for (size_t i = 0; i < size; i++)
+        frame->name[i] = name[i];
+    frame->name[size] = '\0';
+
+    if (pc < chunk->size) {
+        frame->line = chunk->positions[pc].line;
+        frame->col = chunk->positions[pc].col;
+    } else {
+        frame->line = 0;
+        frame->col = 0;
+    }
+}
+
+static void* drain_thread(void* arg) {
+    (void)arg;
+
+    struct timespec wait = { .tv_sec = 0, .tv_nsec = SAMPLE_DRAIN * 1000000L };
+
+    /* the samples of a process that uses no cpu are few, the drain has no
+     * need of a wakeup from the handler. */
+    while (!__atomic_load_n(&stopping, __ATOMIC_RELAXED)) {
+        nanosleep(&wait, NULL);
+        drain();
+    }
+
+    drain();
+    return NULL;
+}
+
+/* counts every sample that is ready, in the order of their tickets. */
+static void drain(void) {
+    char stack[SAMPLE_DEPTH * (SAMPLE_NAME + 24) + 16];
+
+    pthread_mutex_lock(&profile_lock);
+
+    uint64_t at = __atomic_load_n(&tail, __ATOMIC_RELAXED);
+
+    while (at != __atomic_load_n(&head, __ATOMIC_RELAXED)) {
+        Sample* sample = &ring[at & (SAMPLE_RING - 1)];
+
+        /* taken but still being written by a handler on another thread. */
+        if (__atomic_load_n(&sample->ready, __ATOMIC_ACQUIRE) != at + 1)
+            break;
+
+        size_t size = 0;
+
+        if (sample->nframes == 0)
+            size += snprintf(stack, sizeof(stack), "(outside a run)");
+
+        if (sample->truncated)
+            size += snprintf(stack + size, sizeof(stack) - size, "(truncated);");
+
+        for (size_t i = sample->nframes; i > 0; i--) {
+            const SampleFrame* frame = &sample->frames[i - 1];
+
+            size += snprintf(stack + size, sizeof(stack) - size, "%s:%u:%u%s",
+                frame->name, frame->line, frame->col, i > 1 ? ";" : "");
+        }
+
+        count(stack, size);
+        samples++;
+
+        __atomic_store_n(&tail, ++at, __ATOMIC_RELEASE);
+    }
+
+    pthread_mutex_unlock(&profile_lock);
+}
+
+/* with the lock held. a stack that cannot be counted for lack of memory is
+ * counted as dropped. */
+static int count(const char* stack, size_t size) {
+    /* fnv-1a. */
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < size; i++)
+        hash = (hash ^ (unsigned char)stack[i]) * 1099511628211ull;
+
+    if (2 * (nentries + 1) > capacity) {
+        size_t grown = capacity == 0 ? 64 : capacity * 2;
+        ProfileEntry* table = calloc(grown, sizeof(ProfileEntry));
+
+        if (table == NULL) {
+            __atomic_fetch_add(&dropped, 1, __ATOMIC_RELAXED);
+            return 0;
+        }
+
+        for (size_t i = 0; i < capacity; i++) {
+            if (entries[i].stack == NULL)
+                continue;
+
+            size_t at = entries[i].hash & (grown - 1);
+            while (table[at].stack != NULL)
+                at = (at + 1) & (grown - 1);
+
+            table[at] = entries[i];
+        }
+
+        free(entries);
+        entries = table;
+        capacity = grown;
+    }
+
+    size_t at = hash & (capacity - 1);
+
+    while (entries[at].stack != NULL) {
+        if (entries[at].hash == hash && strcmp(entries[at].stack, stack) == 0) {
+            entries[at].count++;
+            return 1;
+        }
+
+        at = (at + 1) & (capacity - 1);
+    }
+
+    char* copy = malloc(size + 1);
+    if (copy == NULL) {
+        __atomic_fetch_add(&dropped, 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+
+    memcpy(copy, stack, size + 1);
+    entries[at] = (ProfileEntry) { .stack = copy, .hash = hash, .count = 1 };
+    nentries++;
+
+    return 1;
+}
+
+/* with the lock held, before the timer is started. */
+static void clear(void) {
+    for (size_t i = 0; i < capacity; i++)
+        free(entries[i].stack);
+
+    free(entries);
+    entries = NULL;
+    nentries = 0;
+    capacity = 0;
+    samples = 0;
+
+    __atomic_store_n(&dropped, 0, __ATOMIC_RELAXED);
+}
+
+static int compare_entries(const void* lhs, const void* rhs) {
+    const ProfileEntry* a = *(const ProfileEntry* const*)lhs;
+    const ProfileEntry* b = *(const ProfileEntry* const*)rhs;
+
+    return strcmp(a->stack, b->stack);
+}
@@ -0,0 +1,52 @@
+#ifndef SAMPLE_H
+#define SAMPLE_H
+
+#include "interpreter.h"
+
+/* the sampling profiler behind kd_profile_start, see kidomaru.h.
+ *
+ * a thread running a chunk points sample_running at its interpreter, which
+ * stores every instruction it is about to run in Interpreter.instr while
+ * the profiler is on, and the frame it runs in whenever it changes. the
+ * SIGPROF handler only reads those, the frames of the calls in progress and
+ * the positions of their chunks, copies what it found into a ring of
+ * samples that takes no lock, and returns. a thread of the profiler drains
+ * the ring into counts by stack.
+ *
+ * the interpreter writes whatever the handler reads before it makes it
+ * reachable, with a signal fence in between, so a sample taken halfway
+ * through a call or a return sees the frame before or the one after, and
+ * never memory that is not there. */
+
+/* of the default tls model, so the library can be opened with dlopen as
+ * well as linked in. */
+extern _Thread_local Interpreter* sample_running;
+
+/* set while kd_profile_start runs the timer, read without ordering like
+ * stats_on. a run started before is only sampled by the frame it is in. */
+extern int sample_on;
+
+static inline int sample_enabled(void) {
+    return __builtin_expect(__atomic_load_n(&sample_on, __ATOMIC_RELAXED), 0);
+}
+
+/* returns what was running on the thread before, a run of a par for can
+ * start inside a run of the program. */
+static inline Interpreter* sample_enter(Interpreter* interpreter) {
+    Interpreter* outer = sample_running;
+
+    interpreter->instr = NULL;
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+    sample_running = interpreter;
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+
+    return outer;
+}
+
+static inline void sample_leave(Interpreter* outer) {
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+    sample_running = outer;
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+}
+
+#endif /* SAMPLE_H */
@@ -0,0 +1,99 @@
+#include <stdlib.h>
+
+#include "kidomaru.h"
+
+typedef struct Task_t {
+    const kd_program* program;
+    kd_context* context;
+    int started;
+} Task;
+
+/* a ring of runs, the one at head gets the next slice. */
+struct kd_scheduler {
+    long long slice_fuel;
+
+    Task* tasks;
+    size_t capacity;
+    size_t head;
+    size_t size;
+};
+
+kd_scheduler* kd_scheduler_new(long long slice_fuel) {
+    kd_scheduler* scheduler = malloc(sizeof(kd_scheduler));
+    if (scheduler == NULL)
+        return NULL;
+
+    scheduler->slice_fuel = slice_fuel;
+    scheduler->tasks = NULL;
+    scheduler->capacity = 0;
+    scheduler->head = 0;
+    scheduler->size = 0;
+
+    return scheduler;
+}
+
+void kd_scheduler_free(kd_scheduler* scheduler) {
+    if (scheduler == NULL)
+        return;
+
+    free(scheduler->tasks);
+    free(scheduler);
+}
+
+int kd_scheduler_spawn(kd_scheduler* scheduler, const kd_program* program, kd_context* context) {
+    if (scheduler->size == scheduler->capacity) {
+        size_t capacity = scheduler->capacity == 0 ? 64 : scheduler->capacity * 2;
+
+        Task* tasks = malloc(capacity * sizeof(Task));
+        if (tasks == NULL)
+            return 0;
+
+        for (size_t i = 0; i < scheduler->size; i++)
+            tasks[i] = scheduler->tasks[(scheduler->head + i) % scheduler->capacity];
+
+        free(scheduler->tasks);
+        scheduler->tasks = tasks;
+        scheduler->capacity = capacity;
+        scheduler->head = 0;
+    }
+
+    scheduler->tasks[(scheduler->head + scheduler->size) % scheduler->capacity] = (Task) {
+        .program = program,
+        .context = context,
+        .started = 0,
+    };
+
+    scheduler->size++;
+
+    return 1;
+}
+
+size_t kd_scheduler_step(kd_scheduler* scheduler) {
+    if (scheduler->size == 0)
+        return 0;
+
+    Task task = scheduler->tasks[scheduler->head];
+
+    scheduler->head = (scheduler->head + 1) % scheduler->capacity;
+    scheduler->size--;
+
+    kd_context_set_fuel(task.context, scheduler->slice_fuel);
+
+    kd_status status = task.started
+        ? kd_resume(task.context)
+        : kd_run(task.program, task.context);
+
+    if (status == KD_SUSPENDED) {
+        task.started = 1;
+
+        /* there is always room, the task was just taken out of the ring. */
+        scheduler->tasks[(scheduler->head + scheduler->size) % scheduler->capacity] = task;
+        scheduler->size++;
+    }
+
+    return scheduler->size;
+}
+
+void kd_scheduler_run(kd_scheduler* scheduler) {
+    while (kd_scheduler_step(scheduler) != 0) {}
+}
@@ -0,0 +1,207 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "stats.h"
+
+/* the counters of one thread, linked into the list of live ones. when the
+ * thread exits its counts are added to retired and the block freed. */
+typedef struct StatsBlock_t {
+    int64_t counts[STAT_COUNT];
+
+    struct StatsBlock_t* prev;
+    struct StatsBlock_t* next;
+} StatsBlock;
+
+int stats_on = 0;
+
+static const char* memory_names[KD_MEMORY_COUNT] = {
+    [KD_MEMORY_PARSER] = "parser",
+    [KD_MEMORY_RESOLVER] = "resolver",
+    [KD_MEMORY_IR] = "ir",
+    [KD_MEMORY_BYTECODE] = "bytecode",
+    [KD_MEMORY_STRINGS] = "strings",
+};
+
+static const char* phase_names[KD_PHASE_COUNT] = {
+    [KD_PHASE_PARSE] = "parse",
+    [KD_PHASE_RESOLVE] = "resolve",
+    [KD_PHASE_LOWER] = "lower",
+    [KD_PHASE_OPTIMIZE] = "optimize",
+    [KD_PHASE_CODEGEN] = "codegen",
+    [KD_PHASE_RUN] = "run",
+};
+
+/* guards the list, retired and baseline. */
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t key;
+
+static StatsBlock* blocks = NULL;
+static int64_t retired[STAT_COUNT];
+
+/* the totals at the last reset, which reads take off. */
+static int64_t baseline[STAT_COUNT];
+
+/* the block of the calling thread, NULL until it first counts. */
+static _Thread_local StatsBlock* local = NULL;
+
+static StatsBlock* attach(void);
+static void detach(void* arg);
+static void make_key(void);
+static void total(int64_t* counts);
+
+void stats_add_slow(Stat stat, int64_t n) {
+    StatsBlock* block = local;
+
+    if (block == NULL && (block = attach()) == NULL)
+        return;
+
+    /* only this thread writes the block, the store is atomic for readers. */
+    __atomic_store_n(&block->counts[stat], block->counts[stat] + n, __ATOMIC_RELAXED);
+}
+
+int64_t stats_clock(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void kd_stats_enable(int enabled) {
+    __atomic_store_n(&stats_on, enabled != 0, __ATOMIC_RELAXED);
+}
+
+void kd_stats_read(kd_stats* stats) {
+    int64_t counts[STAT_COUNT];
+
+    pthread_mutex_lock(&stats_lock);
+    total(counts);
+
+    for (size_t i = 0; i < STAT_COUNT; i++)
+        counts[i] -= baseline[i];
+
+    pthread_mutex_unlock(&stats_lock);
+
+    *stats = (kd_stats) {
+        .tokens = counts[STAT_TOKENS],
+        .nodes = counts[STAT_NODES],
+        .lookups = counts[STAT_LOOKUPS],
+        .probes = counts[STAT_PROBES],
+        .instructions = counts[STAT_INSTRUCTIONS],
+        .calls = counts[STAT_CALLS],
+        .runs = counts[STAT_RUNS],
+    };
+
+    for (size_t i = 0; i < KD_MEMORY_COUNT; i++) {
+        stats->allocations[i] = counts[STAT_ALLOCATIONS + i];
+        stats->bytes[i] = counts[STAT_BYTES + i];
+    }
+
+    for (size_t i = 0; i < KD_PHASE_COUNT; i++)
+        stats->seconds[i] = counts[STAT_NANOSECONDS + i] / 1e9;
+}
+
+void kd_stats_reset(void) {
+    pthread_mutex_lock(&stats_lock);
+    total(baseline);
+    pthread_mutex_unlock(&stats_lock);
+}
+
+const char* kd_stats_memory_name(kd_stats_memory memory) {
+    return memory_names[memory];
+}
+
+const char* kd_stats_phase_name(kd_stats_phase phase) {
+    return phase_names[phase];
+}
+
+int kd_stats_write_json(const kd_stats* stats, FILE* file) {
+    fprintf(file, "{\n");
+    fprintf(file, "  \"tokens\": %lld,\n", stats->tokens);
+    fprintf(file, "  \"nodes\": %lld,\n", stats->nodes);
+    fprintf(file, "  \"lookups\": %lld,\n", stats->lookups);
+    fprintf(file, "  \"probes\": %lld,\n", stats->probes);
+    fprintf(file, "  \"probes_per_lookup\": %.3f,\n", stats->lookups > 0 ? (double)stats->probes / stats->lookups : 0.0);
+    fprintf(file, "  \"instructions\": %lld,\n", stats->instructions);
+    fprintf(file, "  \"calls\": %lld,\n", stats->calls);
+    fprintf(file, "  \"runs\": %lld,\n", stats->runs);
+
+    fprintf(file, "  \"memory\": {\n");
+    for (size_t i = 0; i < KD_MEMORY_COUNT; i++) {
+        fprintf(file, "    \"%s\": { \"allocations\": %lld, \"bytes\": %lld }%s\n", memory_names[i],
+            stats->allocations[i], stats->bytes[i], i + 1 < KD_MEMORY_COUNT ? "," : "");
+    }
+    fprintf(file, "  },\n");
+
+    fprintf(file, "  \"seconds\": {\n");
+    for (size_t i = 0; i < KD_PHASE_COUNT; i++)
+        fprintf(file, "    \"%s\": %.9f%s\n", phase_names[i], stats->seconds[i], i + 1 < KD_PHASE_COUNT ? "," : "");
+    fprintf(file, "  }\n");
+
+    fprintf(file, "}\n");
+
+    return fflush(file) == 0 && !ferror(file);
+}
+
+/* the first count of a thread gives it its block, NULL when out of memory,
+ * which leaves the thread uncounted. */
+static StatsBlock* attach(void) {
+    pthread_once(&key_once, make_key);
+
+    StatsBlock* block = calloc(1, sizeof(StatsBlock));
+    if (block == NULL)
+        return NULL;
+
+    pthread_mutex_lock(&stats_lock);
+
+    block->next = blocks;
+    if (blocks != NULL)
+        blocks->prev = block;
+    blocks = block;
+
+    pthread_mutex_unlock(&stats_lock);
+
+    pthread_setspecific(key, block);
+    local = block;
+
+    return block;
+}
+
+/* at the exit of a thread that counted something. */
+static void detach(void* arg) {
+    StatsBlock* block = arg;
+
+    pthread_mutex_lock(&stats_lock);
+
+    for (size_t i = 0; i < STAT_COUNT; i++)
+        retired[i] += block->counts[i];
+
+    if (block->prev != NULL)
+        block->prev->next = block->next;
+    else
+        blocks = block->next;
+
+    if (block->next != NULL)
+        block->next->prev = block->prev;
+
+    pthread_mutex_unlock(&stats_lock);
+
+    local = NULL;
+    free(block);
+}
+
+static void make_key(void) {
+    pthread_key_create(&key, detach);
+}
+
+/* with the lock held. */
+static void total(int64_t* counts) {
+    memcpy(counts, retired, sizeof(retired));
+
+    for (StatsBlock* block = blocks; block != NULL; block = block->next) {
+        for (size_t i = 0; i < STAT_COUNT; i++)
+            counts[i] += __atomic_load_n(&block->counts[i], __ATOMIC_RELAXED);
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "kidomaru.h"
+
+/* the counters behind kd_stats, see kidomaru.h. every thread adds to a
+ * block of its own, which only it writes, and a read adds the blocks up
+ * under a lock, so counting never waits for another thread. */
+typedef enum Stat_t {
+    STAT_TOKENS,
+    STAT_NODES,
+    STAT_LOOKUPS,
+    STAT_PROBES,
+    STAT_INSTRUCTIONS,
+    STAT_CALLS,
+    STAT_RUNS,
+
+    /* one for each kd_stats_memory. */
+    STAT_ALLOCATIONS,
+    STAT_BYTES = STAT_ALLOCATIONS + KD_MEMORY_COUNT,
+
+    /* nanoseconds, one for each kd_stats_phase. */
+    STAT_NANOSECONDS = STAT_BYTES + KD_MEMORY_COUNT,
+
+    STAT_COUNT = STAT_NANOSECONDS + KD_PHASE_COUNT,
+} Stat;
+
+/* set by kd_stats_enable, read without ordering: a thread may count a
+ * little past the moment it is cleared, or miss a little after it is set. */
+extern int stats_on;
+
+void stats_add_slow(Stat stat, int64_t n);
+int64_t stats_clock(void);
+
+static inline int stats_enabled(void) {
+    return __builtin_expect(__atomic_load_n(&stats_on, __ATOMIC_RELAXED), 0);
+}
+
+static inline void stats_add(Stat stat, int64_t n) {
+    if (stats_enabled())
+        stats_add_slow(stat, n);
+}
+
+static inline void stats_alloc(kd_stats_memory memory, size_t size) {
+    if (stats_enabled()) {
+        stats_add_slow(STAT_ALLOCATIONS + memory, 1);
+        stats_add_slow(STAT_BYTES + memory, size);
+    }
+}
+
+/* a phase is timed from stats_start to stats_stop, which counts nothing
+ * when the stats were off at the start. */
+static inline int64_t stats_start(void) {
+    return stats_enabled() ? stats_clock() : 0;
+}
+
+static inline void stats_stop(kd_stats_phase phase, int64_t start) {
+    if (start != 0)
+        stats_add_slow(STAT_NANOSECONDS + phase, stats_clock() - start);
+}
+
+#endif /* STATS_H */
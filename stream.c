@@ -0,0 +1,407 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "kidomaru.h"
+#include "program.h"
+#include "lexer.h"
+#include "resolver.h"
+
+/* how the unread input starts. */
+typedef enum Boundary_t {
+    BOUNDARY_NONE,          /* with nothing but whitespace */
+    BOUNDARY_INCOMPLETE,    /* with a statement whose end has not arrived */
+    BOUNDARY_STATEMENT,     /* with a whole statement */
+    BOUNDARY_OPEN,          /* with the '{' of the root block */
+    BOUNDARY_CLOSE,         /* with the '}' of the root block */
+} Boundary;
+
+/* one statement at a time is compiled into program and run, its arena is
+ * reset before the next. what has to outlive it is in arena. */
+struct kd_stream {
+    kd_context* context;
+
+    kd_compile_options options;
+    int has_options;
+
+    /* string literals, structs and the names of the globals. */
+    Arena arena;
+    Globals globals;
+
+    /* the values of the globals, they are handed to the interpreter for
+     * every run. */
+    Value* values;
+    size_t nvalues;
+
+    kd_program program;
+
+    /* the input not run yet is from start to size, null terminated. it
+     * begins at line and col of the whole input. */
+    char* buffer;
+    size_t start;
+    size_t size;
+    size_t capacity;
+
+    size_t line;
+    size_t col;
+
+    /* the first token has been seen, it opened the root block when braced
+     * is set. */
+    int began;
+    int braced;
+
+    /* a statement ran out of fuel and waits for kd_stream_resume, with
+     * what follows it already from start on. finishing is set once
+     * kd_stream_finish was called. */
+    int suspended;
+    int finishing;
+
+    int done;
+    kd_error error;
+};
+
+static kd_status run_input(kd_stream* stream, int at_end);
+static Boundary next_statement(kd_stream* stream, int at_end, Lexer* end);
+static kd_status run_statement(kd_stream* stream, size_t len);
+static kd_status end_statement(kd_stream* stream, kd_status status);
+static kd_status close_input(kd_stream* stream);
+static int append(kd_stream* stream, const char* data, size_t len);
+static kd_status fail(kd_stream* stream, kd_status status, size_t line, size_t col, const char* message);
+
+kd_stream* kd_stream_new(kd_context* context, const kd_compile_options* options) {
+    kd_stream* stream = malloc(sizeof(kd_stream));
+    if (stream == NULL)
+        return NULL;
+
+    *stream = (kd_stream) {
+        .context = context,
+        .has_options = options != NULL,
+        .arena = arena_init(),
+        .line = 1,
+        .col = 1,
+        .error = { .status = KD_OK },
+    };
+
+    if (options != NULL)
+        stream->options = *options;
+
+    program_init(&stream->program);
+    globals_init(&stream->globals, &stream->arena);
+    return stream;
+}
+
+void kd_stream_free(kd_stream* stream) {
+    if (stream == NULL)
+        return;
+
+    for (size_t i = 0; i < stream->nvalues; i++)
+        value_release(&stream->values[i]);
+
+    free(stream->values);
+    free(stream->buffer);
+
+    globals_deinit(&stream->globals);
+    program_deinit(&stream->program);
+    arena_deinit(&stream->arena);
+
+    free(stream);
+}
+
+kd_status kd_stream_feed(kd_stream* stream, const char* data, size_t len) {
+    if (stream->done)
+        return stream->error.status;
+
+    if (!append(stream, data, len))
+        return fail(stream, KD_ERROR_NOMEM, 0, 0, "cannot allocate memory!");
+
+    if (stream->suspended)
+        return KD_SUSPENDED;
+
+    return run_input(stream, 0);
+}
+
+kd_status kd_stream_finish(kd_stream* stream) {
+    if (stream->done)
+        return stream->error.status;
+
+    stream->finishing = 1;
+
+    if (stream->suspended)
+        return KD_SUSPENDED;
+
+    kd_status status = run_input(stream, 1);
+    if (status != KD_OK)
+        return status;
+
+    return close_input(stream);
+}
+
+kd_status kd_stream_resume(kd_stream* stream) {
+    if (!stream->suspended)
+        return stream->error.status;
+
+    kd_status status = kd_resume(stream->context);
+    if (status == KD_SUSPENDED)
+        return status;
+
+    stream->suspended = 0;
+
+    if (end_statement(stream, status) != KD_OK)
+        return stream->error.status;
+
+    status = run_input(stream, stream->finishing);
+    if (status != KD_OK || !stream->finishing)
+        return status;
+
+    return close_input(stream);
+}
+
+/* a root block that was opened has to be closed, like in a whole script. */
+static kd_status close_input(kd_stream* stream) {
+    if (stream->braced && !stream->done) {
+        Lexer lexer = lexer_init(stream->buffer + stream->start);
+        lexer.line = stream->line;
+        lexer.col = stream->col;
+
+        Token eof = lexer_gettok(&lexer);
+        return fail(stream, KD_ERROR_SYNTAX, eof.line, eof.col, "unexpected eof!");
+    }
+
+    stream->done = 1;
+    return KD_OK;
+}
+
+int kd_stream_done(const kd_stream* stream) {
+    return stream->done;
+}
+
+const kd_error* kd_stream_error(const kd_stream* stream) {
+    return &stream->error;
+}
+
+static kd_status run_input(kd_stream* stream, int at_end) {
+    while (!stream->done) {
+        Lexer end;
+        kd_status status = KD_OK;
+
+        switch (next_statement(stream, at_end, &end)) {
+        case BOUNDARY_NONE:
+        case BOUNDARY_INCOMPLETE:
+            return KD_OK;
+        case BOUNDARY_OPEN:
+            stream->braced = 1;
+            break;
+        case BOUNDARY_CLOSE:
+            stream->done = 1;
+            return KD_OK;
+        case BOUNDARY_STATEMENT:
+            status = run_statement(stream, end.input - (stream->buffer + stream->start));
+            if (status != KD_OK && status != KD_SUSPENDED)
+                return stream->error.status;
+            break;
+        }
+
+        /* the program keeps a copy of the statement, the input after it
+         * can be moved while it is suspended. */
+        stream->start = end.input - stream->buffer;
+        stream->line = end.line;
+        stream->col = end.col;
+
+        if (status == KD_SUSPENDED)
+            return status;
+    }
+
+    return KD_OK;
+}
+
+/* a statement ends at a ';' outside of any brackets, or at the '}' closing
+ * a block, struct, fn or for statement, or an if statement when no else
+ * follows. the lexer never makes a ';' or '}' out of part of a longer token,
+ * so a token cut off by the end of what has arrived so far does not matter
+ * unless it is the last one. end is left after the statement. */
+static Boundary next_statement(kd_stream* stream, int at_end, Lexer* end) {
+    Lexer lexer = lexer_init(stream->buffer + stream->start);
+    lexer.line = stream->line;
+    lexer.col = stream->col;
+
+    Token first = lexer_gettok(&lexer);
+    *end = lexer;
+
+    if (first.kind == TOK_EOF)
+        return BOUNDARY_NONE;
+
+    if (!stream->began) {
+        stream->began = 1;
+
+        if (first.kind == TOK_LBRACE)
+            return BOUNDARY_OPEN;
+    }
+
+    if (stream->braced && first.kind == TOK_RBRACE)
+        return BOUNDARY_CLOSE;
+
+    size_t depth = 0;
+    Token token = first;
+
+    for (;;) {
+        switch (token.kind) {
+        case TOK_LPAREN:
+        case TOK_LBRACKET:
+        case TOK_LBRACE:
+            depth++;
+            break;
+        case TOK_RPAREN:
+        case TOK_RBRACKET:
+            if (depth > 0)
+                depth--;
+            break;
+        case TOK_RBRACE: {
+            /* one too many, the parser reports it. */
+            if (depth == 0) {
+                *end = lexer;
+                return BOUNDARY_STATEMENT;
+            }
+
+            if (--depth > 0 || (first.kind != TOK_LBRACE && first.kind != TOK_STRUCT && first.kind != TOK_FN && first.kind != TOK_FOR && first.kind != TOK_PAR && first.kind != TOK_IF))
+                break;
+
+            if (first.kind != TOK_IF) {
+                *end = lexer;
+                return BOUNDARY_STATEMENT;
+            }
+
+            Lexer peek = lexer;
+            Token next = lexer_gettok(&peek);
+
+            if (next.kind == TOK_EOF && !at_end)
+                return BOUNDARY_INCOMPLETE;
+
+            if (next.kind != TOK_ELSE) {
+                *end = lexer;
+                return BOUNDARY_STATEMENT;
+            }
+
+            break;
+        }
+        case TOK_SEMICOLON:
+            if (depth == 0) {
+                *end = lexer;
+                return BOUNDARY_STATEMENT;
+            }
+            break;
+        case TOK_EOF:
+            if (!at_end)
+                return BOUNDARY_INCOMPLETE;
+
+            *end = lexer;
+            return BOUNDARY_STATEMENT;
+        case TOK_GARBAGE:
+            /* an unterminated string, say, may still be completed. any
+             * other one is an error the parser reports. */
+            if (*lexer.input == 0 && !at_end)
+                return BOUNDARY_INCOMPLETE;
+
+            *end = lexer;
+            return BOUNDARY_STATEMENT;
+        default:
+            break;
+        }
+
+        token = lexer_gettok(&lexer);
+    }
+}
+
+/* a statement that runs out of fuel is left suspended, it is ended by
+ * kd_stream_resume. */
+static kd_status run_statement(kd_stream* stream, size_t len) {
+    arena_reset(&stream->program.arena);
+
+    kd_status status = program_compile_global(&stream->program, stream->buffer + stream->start, len, stream->line, stream->col,
+        &stream->globals, stream->has_options ? &stream->options : NULL, &stream->error);
+
+    if (status != KD_OK) {
+        stream->done = 1;
+        return status;
+    }
+
+    if (stream->nvalues < stream->globals.nvariables) {
+        size_t nvalues = stream->globals.capacity;
+
+        Value* values = realloc(stream->values, nvalues * sizeof(Value));
+        if (values == NULL)
+            return fail(stream, KD_ERROR_NOMEM, 0, 0, "cannot allocate memory!");
+
+        for (size_t i = stream->nvalues; i < nvalues; i++)
+            values[i] = (Value) { .kind = VAL_INT, .i64 = 0 };
+
+        stream->values = values;
+        stream->nvalues = nvalues;
+    }
+
+    kd_context* context = stream->context;
+    context->interpreter.globals = stream->values;
+
+    status = kd_run(&stream->program, context);
+
+    if (status == KD_SUSPENDED) {
+        stream->suspended = 1;
+        return status;
+    }
+
+    return end_statement(stream, status);
+}
+
+static kd_status end_statement(kd_stream* stream, kd_status status) {
+    kd_context* context = stream->context;
+    context->interpreter.globals = NULL;
+
+    if (status != KD_OK) {
+        stream->error = context->error;
+        stream->done = 1;
+        return status;
+    }
+
+    if (context->interpreter.returned)
+        stream->done = 1;
+
+    return KD_OK;
+}
+
+/* moves what is left to the front first, so the buffer only ever holds
+ * the statement being read. */
+static int append(kd_stream* stream, const char* data, size_t len) {
+    if (stream->start > 0) {
+        memmove(stream->buffer, stream->buffer + stream->start, stream->size - stream->start);
+        stream->size -= stream->start;
+        stream->start = 0;
+    }
+
+    if (stream->size + len + 1 > stream->capacity) {
+        size_t capacity = stream->capacity == 0 ? 4096 : stream->capacity;
+        while (capacity < stream->size + len + 1)
+            capacity *= 2;
+
+        char* buffer = realloc(stream->buffer, capacity);
+        if (buffer == NULL)
+            return 0;
+
+        stream->buffer = buffer;
+        stream->capacity = capacity;
+    }
+
+    memcpy(stream->buffer + stream->size, data, len);
+    stream->size += len;
+    stream->buffer[stream->size] = 0;
+
+    return 1;
+}
+
+static kd_status fail(kd_stream* stream, kd_status status, size_t line, size_t col, const char* message) {
+    stream->error.status = status;
+    stream->error.line = line;
+    stream->error.col = col;
+    snprintf(stream->error.message, sizeof(stream->error.message), "%s", message);
+
+    stream->done = 1;
+    return status;
+}
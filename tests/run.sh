@@ -0,0 +1,89 @@
+#!/usr/bin/bash
+
+# builds the tests against libkidomaru.a and runs them, stopping at the
+# first that fails: each tests/test_*.c is a program that exits with 0 when
+# it passes, each tests/*.mr a script that must print its .out exactly
+# whichever way it is compiled and run.
+#
+# with --sanitize the library, kidomaru and the tests are built again under
+# ASan and UBSan in build/sanitize first.
+
+set -e
+
+cd "$(dirname "$0")/.."
+
+CC=${CC:-clang}
+CFLAGS="-D_FILE_OFFSET_BITS=64 -Wall -O3"
+OUT=build
+LIBRARY=libkidomaru.a
+KIDOMARU=./kidomaru
+
+if [ "$1" = "--sanitize" ]; then
+    CFLAGS="-D_FILE_OFFSET_BITS=64 -Wall -O1 -g -fno-omit-frame-pointer -fsanitize=address,undefined -fno-sanitize-recover=undefined"
+    OUT=build/sanitize
+    LIBRARY=$OUT/libkidomaru.a
+    KIDOMARU=$OUT/kidomaru
+
+    mkdir -p $OUT
+
+    OBJECTS=""
+    for source in $(sed -n 's/^SOURCES="\(.*\)"$/\1/p' build.sh); do
+        $CC $CFLAGS -c $source -o $OUT/${source%.c}.o
+        OBJECTS="$OBJECTS $OUT/${source%.c}.o"
+    done
+
+    rm -f $LIBRARY
+    ar rcs $LIBRARY $OBJECTS
+    $CC $CFLAGS main.c file.c batch.c $LIBRARY -o $KIDOMARU -lpthread
+fi
+
+mkdir -p $OUT
+
+for test in tests/test_*.c; do
+    name=$(basename ${test%.c})
+
+    case $name in
+        test_alloc) LDFLAGS="-Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=aligned_alloc" ;;
+        *) LDFLAGS="" ;;
+    esac
+
+    $CC $CFLAGS -I. $test $LIBRARY -o $OUT/$name $LDFLAGS -lpthread
+    $OUT/$name
+done
+
+# the second tier is entered as early as it can be, from the first call or
+# run, or else from the middle of a loop.
+MODES=("" --no-opt --no-inline --no-dedup --eager --one-pass --auto-parallel "--auto-parallel --threads=1"
+    "--tiered --tier-calls=1 --tier-loops=16" "--tiered --tier-calls=1000 --tier-loops=16")
+
+for script in tests/*.mr; do
+    [ -e "$script" ] || continue
+
+    for flags in "${MODES[@]}"; do
+        if ! $KIDOMARU $flags $script 2>&1 | cmp -s - ${script%.mr}.out; then
+            echo "ERROR: $script${flags:+ with $flags} does not print ${script%.mr}.out!" >&2
+            $KIDOMARU $flags $script 2>&1 | diff ${script%.mr}.out - >&2 || true
+            exit 1
+        fi
+    done
+
+    echo "$script: ok"
+done
+
+# a batch prints the scripts in the order of their names whichever finishes
+# first, and fails when any of them does.
+for jobs in 1 4; do
+    if $KIDOMARU --batch tests/batch -j $jobs > $OUT/batch.out 2>&1 || ! cmp -s $OUT/batch.out tests/batch/batch.out; then
+        echo "ERROR: tests/batch with -j $jobs does not fail printing tests/batch/batch.out!" >&2
+        diff tests/batch/batch.out $OUT/batch.out >&2 || true
+        exit 1
+    fi
+
+    if ! $KIDOMARU --batch tests/batch/ok -j $jobs > $OUT/batch.out 2>&1; then
+        echo "ERROR: tests/batch/ok with -j $jobs fails!" >&2
+        cat $OUT/batch.out >&2
+        exit 1
+    fi
+done
+
+echo "tests/batch: ok"
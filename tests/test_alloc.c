@@ -0,0 +1,115 @@
+/* repeated runs of a program allocate nothing once its context has grown
+ * to it. linked with -Wl,--wrap for malloc, calloc, realloc and
+ * aligned_alloc, which count the calls the library makes while counting
+ * is on.
+ *
+ * usage: test_alloc [runs] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "kidomaru.h"
+
+static const char script[] =
+    "{\n"
+    "fn square(x: i64) -> i64 {\n"
+    "    return x * x;\n"
+    "}\n"
+    "let a: i64 = 3;\n"
+    "{\n"
+    "    let b: i64 = a * 2;\n"
+    "    {\n"
+    "        let c: i64 = b + square(a);\n"
+    "        if (c == 15) {\n"
+    "            let d: i64 = c - 1;\n"
+    "        }\n"
+    "    }\n"
+    "}\n"
+    "for (i in 0..10) reduce(+) s: i64 {\n"
+    "    yield square(i);\n"
+    "}\n"
+    "return s - 285;\n"
+    "}\n";
+
+static int counting = 0;
+static long long allocations = 0;
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* pointer, size_t size);
+void* __real_aligned_alloc(size_t alignment, size_t size);
+
+void* __wrap_malloc(size_t size) {
+    allocations += counting;
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+    allocations += counting;
+    return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* pointer, size_t size) {
+    allocations += counting;
+    return __real_realloc(pointer, size);
+}
+
+void* __wrap_aligned_alloc(size_t alignment, size_t size) {
+    allocations += counting;
+    return __real_aligned_alloc(alignment, size);
+}
+
+int main(int argc, char** argv) {
+    long runs = argc > 1 ? atol(argv[1]) : 1000000;
+
+    if (runs < 1) {
+        fprintf(stderr, "Usage: %s [runs]\n", argv[0]);
+        return 1;
+    }
+
+    /* square is called rather than inlined, so its body is compiled by the
+     * first run. */
+    kd_compile_options options = { .optimize = 1, .inline_calls = 0, .dedup = 1 };
+
+    kd_error error;
+    kd_program* program = kd_compile_with(script, strlen(script), &options, &error);
+    if (program == NULL) {
+        fprintf(stderr, "(%zu:%zu) ERROR: %s\n", error.line, error.col, error.message);
+        return 1;
+    }
+
+    kd_context* context = kd_context_new();
+    if (context == NULL) {
+        fprintf(stderr, "ERROR: cannot allocate memory!\n");
+        return 1;
+    }
+
+    /* the first run grows the registers and compiles square. */
+    kd_status status = kd_run(program, context);
+
+    counting = 1;
+
+    for (long i = 0; i < runs && status == KD_OK && kd_context_exit_code(context) == 0; i++)
+        status = kd_run(program, context);
+
+    counting = 0;
+
+    int failed = 1;
+
+    if (status != KD_OK) {
+        const kd_error* run_error = kd_context_error(context);
+        fprintf(stderr, "(%zu:%zu) ERROR: %s\n", run_error->line, run_error->col, run_error->message);
+    } else if (kd_context_exit_code(context) != 0) {
+        fprintf(stderr, "ERROR: the script returned %lld!\n", kd_context_exit_code(context));
+    } else if (allocations != 0) {
+        fprintf(stderr, "ERROR: %lld allocations in %ld runs!\n", allocations, runs);
+    } else {
+        printf("test_alloc: ok, 0 allocations in %ld runs\n", runs);
+        failed = 0;
+    }
+
+    kd_context_free(context);
+    kd_program_free(program);
+    return failed;
+}
@@ -0,0 +1,80 @@
+/* the vector min and max of f64 arrays give what the scalar loop gives,
+ * NaNs included, for every length up to a few vectors and a NaN at every
+ * position, on whichever instruction set array_isa picked.
+ *
+ * usage: test_array */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "array.h"
+
+#define LENGTH 40
+
+static double scalar(const double* data, size_t n, int is_max);
+static int same(double a, double b);
+
+int main(void) {
+    /* the kernels load whole aligned vectors, as from an ArrayObject. */
+    double* data = aligned_alloc(64, LENGTH * sizeof(double));
+    if (data == NULL) {
+        fprintf(stderr, "ERROR: cannot allocate memory!\n");
+        return 1;
+    }
+
+    int failed = 0;
+
+    for (size_t n = 1; n <= LENGTH && !failed; n++) {
+        /* nan at n is none at all. */
+        for (size_t nan = 0; nan <= n && !failed; nan++) {
+            for (size_t i = 0; i < n; i++)
+                data[i] = (double)((i * 7 + 3) % 11) - 5.0;
+
+            if (nan < n)
+                data[nan] = NAN;
+
+            double min = array_min_f64(data, n);
+            double max = array_max_f64(data, n);
+
+            if (!same(min, scalar(data, n, 0)) || !same(max, scalar(data, n, 1))) {
+                fprintf(stderr, "ERROR: %s: %zu elements with a NaN at %zu give min %g, max %g, not %g and %g!\n", array_isa(), n, nan, min, max, scalar(data, n, 0), scalar(data, n, 1));
+                failed = 1;
+            }
+        }
+    }
+
+    /* the cases that tell the operand orders apart. */
+    static const double three[] = { NAN, 1.0, 2.0 };
+    static const double eight[] = { NAN, 1.0, 2.0, 3.0, 4.0, 5.0, 6.0, 7.0 };
+
+    memcpy(data, three, sizeof(three));
+    if (!isnan(array_min_f64(data, 3)) || !isnan(array_max_f64(data, 3)))
+        failed = 1;
+
+    memcpy(data, eight, sizeof(eight));
+    if (!isnan(array_min_f64(data, 8)) || !isnan(array_max_f64(data, 8)))
+        failed = 1;
+
+    if (failed)
+        fprintf(stderr, "ERROR: %s: min and max of [nan, 1.0, 2.0, ...] are not nan!\n", array_isa());
+    else
+        printf("test_array: ok, %s\n", array_isa());
+
+    free(data);
+    return failed;
+}
+
+static double scalar(const double* data, size_t n, int is_max) {
+    double result = data[0];
+
+    for (size_t i = 1; i < n; i++)
+        result = is_max ? (data[i] > result ? data[i] : result) : (data[i] < result ? data[i] : result);
+
+    return result;
+}
+
+static int same(double a, double b) {
+    return (isnan(a) && isnan(b)) || a == b;
+}
@@ -0,0 +1,258 @@
+/* runs that have fuel hold the thread for about that many instructions at
+ * a time, par fors, joins of tasks and instructions over whole arrays
+ * included, and give the same results as without.
+ *
+ * usage: test_fuel */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "kidomaru.h"
+#include "array.h"
+
+/* exit code (n - 1) * n / 2 * 3 modulo 256. */
+static const char parfor_script[] =
+    "{\n"
+    "fn work(x: i64) -> i64 {\n"
+    "    return x * 3;\n"
+    "}\n"
+    "par for (i in 0..%ld) reduce(+) s: i64 {\n"
+    "    yield work(i);\n"
+    "}\n"
+    "print(s);\n"
+    "return s;\n"
+    "}\n";
+
+/* a par for inside one, which runs in order on the thread of its chunk. */
+static const char nested_script[] =
+    "{\n"
+    "par for (i in 0..%ld) reduce(+) s: i64 {\n"
+    "    par for (j in 0..1000) reduce(+) t: i64 {\n"
+    "        yield i + j;\n"
+    "    }\n"
+    "    yield t;\n"
+    "}\n"
+    "print(s);\n"
+    "return s;\n"
+    "}\n";
+
+/* with auto_parallel, each of the first lets is a task the return joins. */
+static const char tasks_script[] =
+    "{\n"
+    "fn work(n: i64) -> i64 {\n"
+    "    if (n == 0) { return 0; }\n"
+    "    if (n == 1) { return 1; }\n"
+    "    return work(n - 1) + work(n - 2);\n"
+    "}\n"
+    "let a: i64 = work(%ld);\n"
+    "let b: i64 = work(20);\n"
+    "let c: i64 = work(21) - a;\n"
+    "print(a);\n"
+    "return a + b + c;\n"
+    "}\n";
+
+/* every line goes through all the elements of an array. */
+static const char arrays_script[] =
+    "{\n"
+    "let a: []i64 = iota(%ld, 1);\n"
+    "let b: []i64 = a * 3 + a;\n"
+    "let c: []f64 = fill(len(a), 0.1) / 3.0;\n"
+    "println(sum(b));\n"
+    "println(max(b - 7));\n"
+    "println(dot(a, b));\n"
+    "println(min(c));\n"
+    "println(sum(c * c));\n"
+    "return 0;\n"
+    "}\n";
+
+static int check(const char* name, const char* format, long n, size_t nthreads, long long fuel);
+static kd_status run(const kd_program* program, size_t nthreads, long long fuel, long long* slices, long long* fuel_used, char** output);
+static int abandon(const char* format, long n, size_t nthreads);
+static int blocks(long n, long long fuel);
+
+int main(void) {
+    int failed = 0;
+
+    failed |= check("par for", parfor_script, 2000000, 1, 1000);
+    failed |= check("par for", parfor_script, 2000000, 4, 1000);
+    failed |= check("par for", parfor_script, 100000, 1, 1);
+    failed |= check("par for", parfor_script, 100000, 4, 7);
+    failed |= check("nested par for", nested_script, 2000, 1, 1000);
+    failed |= check("nested par for", nested_script, 2000, 4, 1000);
+
+    failed |= check("joins", tasks_script, 22, 1, 1000);
+    failed |= check("joins", tasks_script, 22, 4, 1000);
+    failed |= check("joins", tasks_script, 22, 4, 1);
+
+    failed |= blocks(1000000, 1);
+    failed |= blocks(1000000, 1000);
+    failed |= blocks(30000000, 1000000);
+
+    failed |= abandon(parfor_script, 2000000, 1);
+    failed |= abandon(parfor_script, 2000000, 4);
+    failed |= abandon(nested_script, 2000, 4);
+
+    if (!failed)
+        printf("test_fuel: ok\n");
+
+    return failed;
+}
+
+static kd_program* compile(const char* format, long n) {
+    char source[512];
+    int len = snprintf(source, sizeof(source), format, n);
+
+    kd_compile_options options = { .optimize = 1, .inline_calls = 1, .dedup = 1, .auto_parallel = 1 };
+
+    kd_error error;
+    kd_program* program = kd_compile_with(source, len, &options, &error);
+
+    if (program == NULL)
+        fprintf(stderr, "(%zu:%zu) ERROR: %s\n", error.line, error.col, error.message);
+
+    return program;
+}
+
+/* the script runs the same with fuel as without, in about as many slices as
+ * its instructions take. */
+static int check(const char* name, const char* format, long n, size_t nthreads, long long fuel) {
+    kd_program* program = compile(format, n);
+    if (program == NULL)
+        return 1;
+
+    long long slices[2];
+    long long fuel_used[2];
+    char* outputs[2] = { NULL, NULL };
+    kd_status status[2];
+
+    status[0] = run(program, nthreads, 0, &slices[0], &fuel_used[0], &outputs[0]);
+    status[1] = run(program, nthreads, fuel, &slices[1], &fuel_used[1], &outputs[1]);
+
+    int failed = 1;
+
+    if (status[0] != KD_OK || status[1] != KD_OK) {
+        fprintf(stderr, "ERROR: %s on %zu threads: %s without fuel, %s with %lld!\n", name, nthreads, kd_status_string(status[0]), kd_status_string(status[1]), fuel);
+    } else if (strcmp(outputs[0], outputs[1]) != 0) {
+        fprintf(stderr, "ERROR: %s on %zu threads printed %s without fuel, %s with %lld!\n", name, nthreads, outputs[0], outputs[1], fuel);
+    } else if (nthreads == 1 ? slices[1] < fuel_used[0] / fuel / 2 : slices[1] < 2) {
+        /* on the pool the chunks go on while the run is suspended, and
+         * what they ran comes out of the fuel of the next slices. */
+        fprintf(stderr, "ERROR: %s on %zu threads ran %lld instructions in %lld slices of %lld!\n", name, nthreads, fuel_used[0], slices[1], fuel);
+    } else if (fuel_used[1] != fuel_used[0]) {
+        fprintf(stderr, "ERROR: %s on %zu threads used %lld fuel, %lld without a limit!\n", name, nthreads, fuel_used[1], fuel_used[0]);
+    } else {
+        failed = 0;
+    }
+
+    free(outputs[0]);
+    free(outputs[1]);
+    kd_program_free(program);
+    return failed;
+}
+
+/* runs program to its end, resuming it whenever it runs out of fuel. */
+static kd_status run(const kd_program* program, size_t nthreads, long long fuel, long long* slices, long long* fuel_used, char** output) {
+    kd_context* context = kd_context_new();
+    if (context == NULL)
+        return KD_ERROR_NOMEM;
+
+    kd_context_set_threads(context, nthreads);
+    kd_context_set_fuel(context, fuel);
+    kd_context_set_output(context, -1);
+
+    kd_status status = kd_run(program, context);
+
+    for (*slices = 1; status == KD_SUSPENDED; (*slices)++)
+        status = kd_resume(context);
+
+    *fuel_used = kd_context_fuel_used(context);
+
+    size_t size;
+    const char* data = kd_context_take_output(context, &size);
+
+    *output = malloc(size + 1);
+    if (*output != NULL) {
+        memcpy(*output, data, size);
+        (*output)[size] = '\0';
+    }
+
+    kd_context_free(context);
+    return *output != NULL ? status : KD_ERROR_NOMEM;
+}
+
+/* a run suspended in a par for can be dropped, or run again from the
+ * start, while its chunks are still running. */
+static int abandon(const char* format, long n, size_t nthreads) {
+    kd_program* program = compile(format, n);
+    if (program == NULL)
+        return 1;
+
+    kd_context* context = kd_context_new();
+    kd_context_set_threads(context, nthreads);
+    kd_context_set_fuel(context, 1000);
+    kd_context_set_output(context, -1);
+
+    kd_status first = kd_run(program, context);
+    kd_status again = kd_run(program, context);
+
+    kd_context_set_fuel(context, 0);
+    kd_status last = kd_run(program, context);
+
+    kd_context_free(context);
+
+    kd_context* suspended = kd_context_new();
+    kd_context_set_threads(suspended, nthreads);
+    kd_context_set_fuel(suspended, 1000);
+    kd_context_set_output(suspended, -1);
+    kd_run(program, suspended);
+    kd_context_free(suspended);
+
+    kd_program_free(program);
+
+    if (first != KD_SUSPENDED || again != KD_SUSPENDED || last != KD_OK) {
+        fprintf(stderr, "ERROR: a dropped par for on %zu threads gave %s, %s then %s!\n", nthreads, kd_status_string(first), kd_status_string(again), kd_status_string(last));
+        return 1;
+    }
+
+    return 0;
+}
+
+/* an array instruction costs its elements, and suspends between blocks of
+ * them once those used up the fuel: a run over arrays of n elements takes
+ * a slice for every block at the least, or for every two slices of fuel. */
+static int blocks(long n, long long fuel) {
+    kd_program* program = compile(arrays_script, n);
+    if (program == NULL)
+        return 1;
+
+    long long slices[2];
+    long long fuel_used[2];
+    char* outputs[2] = { NULL, NULL };
+    kd_status status[2];
+
+    status[0] = run(program, 1, 0, &slices[0], &fuel_used[0], &outputs[0]);
+    status[1] = run(program, 1, fuel, &slices[1], &fuel_used[1], &outputs[1]);
+
+    long long expected = fuel < ARRAY_BLOCK ? fuel_used[0] / ARRAY_BLOCK : fuel_used[0] / fuel / 2;
+    int failed = 1;
+
+    if (status[0] != KD_OK || status[1] != KD_OK) {
+        fprintf(stderr, "ERROR: arrays of %ld: %s without fuel, %s with %lld!\n", n, kd_status_string(status[0]), kd_status_string(status[1]), fuel);
+    } else if (strcmp(outputs[0], outputs[1]) != 0) {
+        fprintf(stderr, "ERROR: arrays of %ld printed %s without fuel, %s with %lld!\n", n, outputs[0], outputs[1], fuel);
+    } else if (fuel_used[0] < 10LL * n) {
+        fprintf(stderr, "ERROR: arrays of %ld used %lld fuel, the elements are not counted!\n", n, fuel_used[0]);
+    } else if (slices[1] < expected) {
+        fprintf(stderr, "ERROR: arrays of %ld ran %lld fuel in %lld slices of %lld!\n", n, fuel_used[0], slices[1], fuel);
+    } else if (fuel_used[1] != fuel_used[0]) {
+        fprintf(stderr, "ERROR: arrays of %ld used %lld fuel, %lld without a limit!\n", n, fuel_used[1], fuel_used[0]);
+    } else {
+        failed = 0;
+    }
+
+    free(outputs[0]);
+    free(outputs[1]);
+    kd_program_free(program);
+    return failed;
+}
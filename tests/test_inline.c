@@ -0,0 +1,134 @@
+/* small functions are copied into their callers, so no call of them is
+ * left, while a function that calls itself, or calls one that calls it
+ * back, stays a call however small it is: inlining it would only unroll
+ * the recursion as far as the budget goes. the results are the same
+ * either way.
+ *
+ * usage: test_inline */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "kidomaru.h"
+
+static const char script[] =
+    "{\n"
+    "fn twice(n: i64) -> i64 {\n"
+    "    return n * 2;\n"
+    "}\n"
+    "fn quad(n: i64) -> i64 {\n"
+    "    return twice(twice(n));\n"
+    "}\n"
+    "fn is_even(n: i64) -> bool {\n"
+    "    if (n == 0) { return true; }\n"
+    "    return is_odd(n - 1);\n"
+    "}\n"
+    "fn is_odd(n: i64) -> bool {\n"
+    "    if (n == 0) { return false; }\n"
+    "    return is_even(n - 1);\n"
+    "}\n"
+    "fn fib(n: i64) -> i64 {\n"
+    "    if (n == 0) { return 0; }\n"
+    "    if (n == 1) { return 1; }\n"
+    "    return fib(n - 1) + fib(n - 2);\n"
+    "}\n"
+    "println(quad(5));\n"
+    "println(is_even(10));\n"
+    "println(is_odd(10));\n"
+    "println(fib(15));\n"
+    "return 0;\n"
+    "}\n";
+
+static const char expected[] = "20\ntrue\nfalse\n610\n";
+
+static int check(int inline_calls);
+static size_t count(const char* from, const char* to, const char* needle);
+
+int main(void) {
+    int failed = check(0) || check(1);
+
+    if (!failed)
+        printf("test_inline: ok\n");
+
+    return failed;
+}
+
+/* the root is dumped first, each function then as its body is compiled. */
+static int check(int inline_calls) {
+    char* dump = NULL;
+    size_t dump_size = 0;
+    FILE* file = open_memstream(&dump, &dump_size);
+
+    kd_compile_options options = { .optimize = 1, .inline_calls = inline_calls, .dedup = 1, .dump_ir = file };
+
+    kd_error error;
+    kd_program* program = kd_compile_with(script, strlen(script), &options, &error);
+    kd_context* context = kd_context_new();
+
+    if (program == NULL || context == NULL) {
+        fprintf(stderr, "ERROR: the script does not compile!\n");
+        return 1;
+    }
+
+    kd_context_set_output(context, -1);
+    kd_status status = kd_run(program, context);
+
+    size_t size;
+    const char* printed = kd_context_take_output(context, &size);
+    int failed = 0;
+
+    if (status != KD_OK || size != strlen(expected) || memcmp(printed, expected, size) != 0) {
+        fprintf(stderr, "ERROR: with inline_calls %d the script printed '%.*s', expected '%s'!\n", inline_calls, (int)size, printed, expected);
+        failed = 1;
+    }
+
+    kd_context_free(context);
+    kd_program_free(program);
+    fclose(file);
+
+    const char* root_end = strstr(dump, "fn ");
+    if (root_end == NULL)
+        root_end = dump + dump_size;
+
+    /* each body of the cycle keeps the one call it makes. */
+    size_t twice = count(dump, root_end, "call twice") + count(dump, root_end, "call quad");
+    size_t cycle = count(dump, dump + dump_size, "call is_even") + count(dump, dump + dump_size, "call is_odd");
+    size_t fib = count(dump, dump + dump_size, "call fib");
+
+    if (inline_calls && twice != 0) {
+        fprintf(stderr, "ERROR: %zu calls of twice and quad are left in the root!\n", twice);
+        failed = 1;
+    } else if (!inline_calls && twice != 1) {
+        fprintf(stderr, "ERROR: without inlining the root calls twice and quad %zu times, expected once!\n", twice);
+        failed = 1;
+    }
+
+    if (cycle != 4) {
+        fprintf(stderr, "ERROR: with inline_calls %d is_even and is_odd are called %zu times, expected 4!\n", inline_calls, cycle);
+        failed = 1;
+    }
+
+    if (fib != 3) {
+        fprintf(stderr, "ERROR: with inline_calls %d fib is called %zu times, expected 3!\n", inline_calls, fib);
+        failed = 1;
+    }
+
+    free(dump);
+    return failed;
+}
+
+/* how many lines between from and to end in needle and its arguments. */
+static size_t count(const char* from, const char* to, const char* needle) {
+    size_t n = 0;
+    size_t length = strlen(needle);
+
+    for (const char* p = from; p < to && (p = strstr(p, needle)) != NULL && p < to; p += length) {
+        if (p[length] == ' ')
+            n++;
+    }
+
+    return n;
+}
@@ -0,0 +1,138 @@
+/* a function body is compiled the first time it is called: one that is
+ * never called can hold a compile error, which eager reports up front and
+ * a call reports at its position, every time the program runs. a body
+ * first called from many threads at once is compiled once, and every
+ * chunk gets it.
+ *
+ * usage: test_lazy */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "kidomaru.h"
+
+static const char uncalled_script[] =
+    "{\n"
+    "fn broken(n: i64) -> i64 {\n"
+    "    return missing + n;\n"
+    "}\n"
+    "fn fine(n: i64) -> i64 {\n"
+    "    return n + 1;\n"
+    "}\n"
+    "println(fine(1));\n"
+    "return 0;\n"
+    "}\n";
+
+static const char called_script[] =
+    "{\n"
+    "fn broken(n: i64) -> i64 {\n"
+    "    return missing + n;\n"
+    "}\n"
+    "println(1);\n"
+    "println(broken(2));\n"
+    "return 0;\n"
+    "}\n";
+
+static const char parallel_script[] =
+    "{\n"
+    "fn square(n: i64) -> i64 {\n"
+    "    let m: i64 = n;\n"
+    "    return m * n;\n"
+    "}\n"
+    "par for (i in 0..100000) reduce(+) s: i64 {\n"
+    "    yield square(i);\n"
+    "}\n"
+    "return s - 333328333350000;\n"
+    "}\n";
+
+#define PARALLEL_PROGRAMS 50
+
+static kd_status run(const char* source, int eager, size_t nthreads, kd_error* error, char* printed, size_t capacity);
+static int expect(const char* what, kd_status status, const kd_error* error, kd_status expected, size_t line, const char* printed, const char* output);
+
+int main(void) {
+    kd_error error;
+    char printed[64];
+    int failed = 0;
+
+    kd_status status = run(uncalled_script, 0, 1, &error, printed, sizeof(printed));
+    failed |= expect("an uncalled broken body", status, &error, KD_OK, 0, printed, "2\n");
+
+    status = run(uncalled_script, 1, 1, &error, printed, sizeof(printed));
+    failed |= expect("an uncalled broken body with eager", status, &error, KD_ERROR_SYNTAX, 3, printed, "");
+
+    status = run(called_script, 0, 1, &error, printed, sizeof(printed));
+    failed |= expect("a called broken body", status, &error, KD_ERROR_SYNTAX, 3, printed, "1\n");
+
+    for (int i = 0; i < PARALLEL_PROGRAMS && !failed; i++) {
+        status = run(parallel_script, 0, 4, &error, printed, sizeof(printed));
+        failed |= expect("a body first called by a par for", status, &error, KD_OK, 0, printed, "");
+    }
+
+    if (!failed)
+        printf("test_lazy: ok\n");
+
+    return failed;
+}
+
+/* compiles source and runs it twice, returning what the second run did. a
+ * compile error is returned as is with nothing printed. */
+static kd_status run(const char* source, int eager, size_t nthreads, kd_error* error, char* printed, size_t capacity) {
+    kd_compile_options options = { .optimize = 1, .inline_calls = 1, .dedup = 1, .eager = eager };
+
+    printed[0] = '\0';
+
+    kd_program* program = kd_compile_with(source, strlen(source), &options, error);
+    if (program == NULL)
+        return error->status;
+
+    kd_context* context = kd_context_new();
+    if (context == NULL) {
+        kd_program_free(program);
+        error->status = KD_ERROR_NOMEM;
+        return KD_ERROR_NOMEM;
+    }
+
+    kd_context_set_threads(context, nthreads);
+    kd_context_set_output(context, -1);
+
+    kd_status status = KD_OK;
+
+    for (int i = 0; i < 2; i++) {
+        status = kd_run(program, context);
+
+        size_t size;
+        const char* output = kd_context_take_output(context, &size);
+        size = size < capacity - 1 ? size : capacity - 1;
+        if (size != 0)
+            memcpy(printed, output, size);
+        printed[size] = '\0';
+    }
+
+    if (status != KD_OK) {
+        *error = *kd_context_error(context);
+    } else if (kd_context_exit_code(context) != 0) {
+        error->line = 0;
+        snprintf(error->message, sizeof(error->message), "exited with %lld", kd_context_exit_code(context));
+        status = KD_ERROR_RUNTIME;
+    }
+    kd_context_free(context);
+    kd_program_free(program);
+    return status;
+}
+
+static int expect(const char* what, kd_status status, const kd_error* error, kd_status expected, size_t line, const char* printed, const char* output) {
+    if (status != expected || (status != KD_OK && error->line != line)) {
+        fprintf(stderr, "ERROR: %s gave %s at line %zu: %s, expected %s at line %zu!\n",
+            what, kd_status_string(status), error->line, error->message, kd_status_string(expected), line);
+        return 1;
+    }
+
+    if (strcmp(printed, output) != 0) {
+        fprintf(stderr, "ERROR: %s printed '%s', expected '%s'!\n", what, printed, output);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,190 @@
+/* random puts, gets and deletes on maps, checked against a reference array
+ * indexed by key after every operation, and by a walk with map_next every
+ * so often. i64 keys, short strings stored inline and long ones on the
+ * heap, so the refcounts of keys and values get a workout under ASan.
+ *
+ * usage: test_map [operations] [seed] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "map.h"
+
+/* keys are drawn from this many, so puts often replace a value and
+ * deletes often shift a run of entries back. */
+#define KEYS 5000
+
+typedef struct Reference_t {
+    int present[KEYS];
+    int64_t values[KEYS];
+    size_t count;
+} Reference;
+
+static uint64_t state;
+
+static uint64_t next_random(void);
+static int make_key(ValueKind kind, long index, Value* key);
+static int check(const char* name, ValueKind kind, long operations);
+static int check_walk(const char* name, ValueKind kind, const MapObject* map, const Reference* reference);
+
+int main(int argc, char** argv) {
+    long operations = argc > 1 ? atol(argv[1]) : 1000000;
+    uint64_t seed = argc > 2 ? strtoull(argv[2], NULL, 10) : 88172645463325252ull;
+
+    if (operations < 1 || seed == 0) {
+        fprintf(stderr, "Usage: %s [operations] [seed]\n", argv[0]);
+        return 1;
+    }
+
+    int failed = 0;
+
+    state = seed;
+    failed |= check("i64 keys", VAL_INT, operations);
+    failed |= check("string keys", VAL_STRING, operations);
+
+    if (!failed)
+        printf("test_map: ok, %ld operations\n", operations);
+
+    return failed;
+}
+
+/* xorshift64. */
+static uint64_t next_random(void) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+/* key index of a map of kind, the odd string keys too long to be inline.
+ * returns 0 when out of memory. */
+static int make_key(ValueKind kind, long index, Value* key) {
+    if (kind == VAL_INT) {
+        *key = (Value) { .kind = VAL_INT, .i64 = index * 7919 - KEYS };
+        return 1;
+    }
+
+    Value head = { .kind = VAL_STRING };
+    Value tail = { .kind = VAL_STRING };
+
+    head.String.size = snprintf(head.String.data, sizeof(head.String.data), "k%ld", index);
+    tail.String.size = index % 2 == 0 ? 0 : snprintf(tail.String.data, sizeof(tail.String.data), "-a-long-tail");
+
+    return string_concat(&head, &tail, key);
+}
+
+static int check(const char* name, ValueKind kind, long operations) {
+    static Reference reference;
+    memset(&reference, 0, sizeof(reference));
+
+    MapObject* map = map_new(kind, VAL_INT);
+    if (map == NULL) {
+        fprintf(stderr, "ERROR: cannot allocate memory!\n");
+        return 1;
+    }
+
+    int failed = 0;
+
+    for (long i = 0; i < operations && !failed; i++) {
+        long index = next_random() % KEYS;
+        uint64_t op = next_random() % 8;
+
+        Value key;
+        if (!make_key(kind, index, &key)) {
+            fprintf(stderr, "ERROR: cannot allocate memory!\n");
+            failed = 1;
+            break;
+        }
+
+        Value value;
+        MapStatus status;
+
+        if (op < 4) {
+            value = (Value) { .kind = VAL_INT, .i64 = (int64_t)next_random() };
+
+            int inserted;
+            status = map_put(map, &key, &value, &inserted);
+
+            if (status != MAP_OK || inserted == reference.present[index]) {
+                fprintf(stderr, "ERROR: %s: put of key %ld gave %d, inserted %d!\n", name, index, status, inserted);
+                failed = 1;
+            }
+
+            reference.count += !reference.present[index];
+            reference.present[index] = 1;
+            reference.values[index] = value.i64;
+        } else if (op < 7) {
+            status = map_get(map, &key, &value);
+
+            if (status != (reference.present[index] ? MAP_OK : MAP_NOT_FOUND) || (status == MAP_OK && value.i64 != reference.values[index])) {
+                fprintf(stderr, "ERROR: %s: get of key %ld gave %d!\n", name, index, status);
+                failed = 1;
+            }
+        } else {
+            status = map_delete(map, &key);
+
+            if (status != (reference.present[index] ? MAP_OK : MAP_NOT_FOUND)) {
+                fprintf(stderr, "ERROR: %s: delete of key %ld gave %d!\n", name, index, status);
+                failed = 1;
+            }
+
+            reference.count -= reference.present[index];
+            reference.present[index] = 0;
+        }
+
+        value_release(&key);
+
+        if (!failed && map->count != reference.count) {
+            fprintf(stderr, "ERROR: %s: %zu entries, %zu expected!\n", name, map->count, reference.count);
+            failed = 1;
+        }
+
+        if (!failed && i % 10007 == 0)
+            failed = check_walk(name, kind, map, &reference);
+    }
+
+    if (!failed)
+        failed = check_walk(name, kind, map, &reference);
+
+    map_release(map);
+    return failed;
+}
+
+/* map_next sees every key of the reference once, with its value. */
+static int check_walk(const char* name, ValueKind kind, const MapObject* map, const Reference* reference) {
+    static int seen[KEYS];
+    memset(seen, 0, sizeof(seen));
+
+    size_t cursor = 0;
+    size_t count = 0;
+    Value key;
+    Value value;
+
+    while (map_next(map, &cursor, &key, &value)) {
+        long index = -1;
+
+        if (kind == VAL_INT) {
+            index = (key.i64 + KEYS) / 7919;
+        } else {
+            const char* data = string_data(&key);
+            if (data != NULL)
+                index = atol(data + 1);
+        }
+
+        if (index < 0 || index >= KEYS || !reference->present[index] || seen[index] || value.i64 != reference->values[index]) {
+            fprintf(stderr, "ERROR: %s: the walk found key %ld, which is not in the reference!\n", name, index);
+            return 1;
+        }
+
+        seen[index] = 1;
+        count++;
+    }
+
+    if (count != reference->count) {
+        fprintf(stderr, "ERROR: %s: the walk found %zu entries, %zu expected!\n", name, count, reference->count);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,157 @@
+/* a module rebuilt after an edit replaces the one in the cache, which a
+ * program compiled against it still calls into until it is freed, and
+ * which is freed then: the memory in use stays flat over many edits. a
+ * module wrapped in braces like a script is told so.
+ *
+ * usage: test_modules [edits] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#include <unistd.h>
+
+#include "kidomaru.h"
+
+#define WARMUP 100
+
+/* a module arena is 64KB, keeping the replaced ones would grow by that much
+ * every edit. */
+#define MAX_GROWTH (4 * 1024 * 1024)
+
+static const char source[] = "{ import \"lib.mr\"; return version(); }";
+
+static int write_module(const char* path, long version);
+static int check(kd_program* program, kd_context* context, long version);
+static int check_braced(const char* path, const kd_compile_options* options);
+
+int main(int argc, char** argv) {
+    long edits = argc > 1 ? atol(argv[1]) : 2000;
+
+    if (edits <= WARMUP) {
+        fprintf(stderr, "Usage: %s [edits, more than %d]\n", argv[0], WARMUP);
+        return 1;
+    }
+
+    char dir[] = "/tmp/kidomaru_modules_XXXXXX";
+
+    if (mkdtemp(dir) == NULL) {
+        fprintf(stderr, "ERROR: cannot make a directory for the modules!\n");
+        return 1;
+    }
+
+    char main_path[sizeof(dir) + 16];
+    char lib_path[sizeof(dir) + 16];
+    snprintf(main_path, sizeof(main_path), "%s/main.mr", dir);
+    snprintf(lib_path, sizeof(lib_path), "%s/lib.mr", dir);
+
+    kd_modules* modules = kd_modules_new(NULL, 1);
+    kd_context* context = kd_context_new();
+
+    if (modules == NULL || context == NULL) {
+        fprintf(stderr, "ERROR: cannot allocate memory!\n");
+        return 1;
+    }
+
+    kd_context_set_output(context, -1);
+
+    kd_compile_options options = { .optimize = 1, .inline_calls = 1, .dedup = 1, .modules = modules, .path = main_path };
+    kd_program* previous = NULL;
+    size_t warm = 0;
+    int failed = 0;
+
+    for (long i = 0; i < edits && !failed; i++) {
+        if (!write_module(lib_path, i)) {
+            fprintf(stderr, "ERROR: cannot write '%s'!\n", lib_path);
+            failed = 1;
+            break;
+        }
+
+        kd_error error;
+        kd_program* program = kd_compile_with(source, strlen(source), &options, &error);
+
+        if (program == NULL) {
+            fprintf(stderr, "ERROR: edit %ld does not compile: %s\n", i, error.message);
+            failed = 1;
+            break;
+        }
+
+        /* the version before is no longer in the cache. */
+        failed = check(program, context, i) || (previous != NULL && check(previous, context, i - 1));
+
+        kd_program_free(previous);
+        previous = program;
+
+        if (i == WARMUP)
+            warm = mallinfo2().uordblks;
+    }
+
+    if (!failed)
+        failed = check_braced(lib_path, &options);
+
+    size_t used = mallinfo2().uordblks;
+    size_t growth = used > warm ? used - warm : 0;
+
+    kd_program_free(previous);
+    kd_context_free(context);
+    kd_modules_free(modules);
+
+    unlink(lib_path);
+    rmdir(dir);
+
+    if (failed)
+        return 1;
+
+    if (warm != 0 && growth > MAX_GROWTH) {
+        fprintf(stderr, "ERROR: %zu bytes more in use after %ld edits, the replaced modules are kept!\n", growth, edits - WARMUP);
+        return 1;
+    }
+
+    printf("test_modules: ok, %ld edits\n", edits);
+    return 0;
+}
+
+static int write_module(const char* path, long version) {
+    FILE* file = fopen(path, "w");
+    if (file == NULL)
+        return 0;
+
+    fprintf(file, "fn version() -> i64 { return %ld; }\n", version);
+    return fclose(file) == 0;
+}
+
+static int check(kd_program* program, kd_context* context, long version) {
+    if (kd_run(program, context) != KD_OK) {
+        fprintf(stderr, "ERROR: %s\n", kd_context_error(context)->message);
+        return 1;
+    }
+
+    if (kd_context_exit_code(context) != version) {
+        fprintf(stderr, "ERROR: expected version %ld, got %lld!\n", version, kd_context_exit_code(context));
+        return 1;
+    }
+
+    return 0;
+}
+
+static int check_braced(const char* path, const kd_compile_options* options) {
+    FILE* file = fopen(path, "w");
+    if (file != NULL)
+        fprintf(file, "{\nfn version() -> i64 { return 0; }\n}\n");
+
+    if (file == NULL || fclose(file) != 0) {
+        fprintf(stderr, "ERROR: cannot write '%s'!\n", path);
+        return 1;
+    }
+
+    kd_error error;
+    kd_program* program = kd_compile_with(source, strlen(source), options, &error);
+
+    if (program != NULL || strstr(error.message, "module files must not be wrapped in braces") == NULL) {
+        fprintf(stderr, "ERROR: a braced module gave '%s'!\n", program != NULL ? "no error" : error.message);
+        kd_program_free(program);
+        return 1;
+    }
+
+    return 0;
+}
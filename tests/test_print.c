@@ -0,0 +1,100 @@
+/* an f64 prints as the fewest digits grisu2 finds that read back as the
+ * same double, rounded to the nearest of those however far past the point
+ * they go.
+ *
+ * usage: test_print [doubles] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "output.h"
+
+typedef struct Case_t {
+    double value;
+    const char* text;
+} Case;
+
+static const Case cases[] = {
+    { 0.1 * 3.0, "0.30000000000000004" },
+    { 0.1 + 0.7, "0.7999999999999999" },
+    { 1.0 / 3.0, "0.3333333333333333" },
+    { 2.0 / 3.0, "0.6666666666666666" },
+    { 0.1, "0.1" },
+    { 1e-5, "0.00001" },
+    { 1.5e-5 * 3.0, "0.000045" },
+    { 1e-5 * 3.0, "0.000030000000000000004" },
+    { 123456.789, "123456.789" },
+    { 2.0, "2.0" },
+    { -0.0, "-0.0" },
+    { 1e15, "1000000000000000.0" },
+    { 1e16, "1e+16" },
+    { 5e-324, "5e-324" },
+    { 1.7976931348623157e308, "1.7976931348623157e+308" },
+    { 2.2250738585072014e-308, "2.2250738585072014e-308" },
+};
+
+static int check_case(const Case* test);
+static int check_round_trip(double d);
+
+int main(int argc, char** argv) {
+    long n = argc > 1 ? atol(argv[1]) : 1000000;
+    int failed = 0;
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+        failed |= check_case(&cases[i]);
+
+    /* any bits that are not a nan or an infinity, and numbers with few
+     * digits, which have the most room past them to round wrong. */
+    uint64_t state = 0x9e3779b97f4a7c15ull;
+
+    for (long i = 0; i < n && !failed; i++) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+
+        double d;
+        memcpy(&d, &state, sizeof(d));
+
+        if (d != d || d - d != 0)
+            continue;
+
+        failed |= check_round_trip(d);
+        failed |= check_round_trip((double)(state % 100000) / 1000.0 * 3.0);
+    }
+
+    if (!failed)
+        printf("test_print: ok, %ld doubles\n", n);
+
+    return failed;
+}
+
+static int check_case(const Case* test) {
+    char buffer[OUTPUT_NUMBER_MAX];
+    size_t size = output_format_f64(buffer, test->value);
+
+    if (size != strlen(test->text) || memcmp(buffer, test->text, size) != 0) {
+        fprintf(stderr, "ERROR: %.17g printed as '%.*s', expected '%s'!\n", test->value, (int)size, buffer, test->text);
+        return 1;
+    }
+
+    return 0;
+}
+
+static int check_round_trip(double d) {
+    char buffer[OUTPUT_NUMBER_MAX + 1];
+    size_t size = output_format_f64(buffer, d);
+    buffer[size] = '\0';
+
+    size_t ndigits = 0;
+    for (const char* p = buffer; *p != '\0' && *p != 'e'; p++)
+        ndigits += *p >= '1' && *p <= '9' ? 1 : 0;
+
+    if (strtod(buffer, NULL) != d || ndigits > 17) {
+        fprintf(stderr, "ERROR: %.17g printed as '%s'!\n", d, buffer);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,139 @@
+/* the profiler places the samples of a run on the lines it spends its time
+ * on, under the calls that led there, on whichever thread ran them, and
+ * its counts add up to the samples taken. it only runs once at a time.
+ *
+ * usage: test_profile */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "kidomaru.h"
+
+/* spin takes about all of the time, from the root or from the chunks of
+ * the par for. */
+static const char script[] =
+    "{\n"
+    "fn spin(n: i64) -> f64 {\n"
+    "    for (i in 0..n) reduce(+) s: f64 {\n"
+    "        yield 0.5;\n"
+    "    }\n"
+    "    return s;\n"
+    "}\n"
+    "println(spin(4000000));\n"
+    "par for (i in 0..16) reduce(+) t: f64 {\n"
+    "    yield spin(250000);\n"
+    "}\n"
+    "println(t);\n"
+    "return 0;\n"
+    "}\n";
+
+#define HZ 997
+
+static int check(const char* profile, long long samples);
+
+int main(void) {
+    if (!kd_profile_start(HZ)) {
+        fprintf(stderr, "ERROR: cannot start the profiler!\n");
+        return 1;
+    }
+
+    if (kd_profile_start(HZ)) {
+        fprintf(stderr, "ERROR: the profiler started twice!\n");
+        return 1;
+    }
+
+    kd_compile_options options = { .optimize = 1, .inline_calls = 0, .dedup = 1 };
+
+    kd_error error;
+    kd_program* program = kd_compile_with(script, strlen(script), &options, &error);
+    kd_context* context = kd_context_new();
+
+    if (program == NULL || context == NULL) {
+        fprintf(stderr, "ERROR: the script does not compile!\n");
+        return 1;
+    }
+
+    kd_context_set_threads(context, 4);
+    kd_context_set_output(context, -1);
+
+    kd_status status = kd_run(program, context);
+    kd_profile_stop();
+
+    if (status != KD_OK) {
+        fprintf(stderr, "ERROR: %s\n", kd_context_error(context)->message);
+        return 1;
+    }
+
+    kd_context_free(context);
+    kd_program_free(program);
+
+    long long samples;
+    long long dropped;
+    kd_profile_counts(&samples, &dropped);
+
+    char* profile = NULL;
+    size_t size = 0;
+    FILE* file = open_memstream(&profile, &size);
+
+    if (file == NULL || !kd_profile_write(file) || fclose(file) != 0) {
+        fprintf(stderr, "ERROR: cannot write the profile!\n");
+        return 1;
+    }
+
+    int failed = check(profile, samples);
+
+    if (failed)
+        fprintf(stderr, "the profile of %lld samples, %lld dropped, is:\n%s", samples, dropped, profile);
+    else
+        printf("test_profile: ok, %lld samples\n", samples);
+
+    free(profile);
+    return failed;
+}
+
+/* most samples are in spin, called from line 8 or from the par for at
+ * line 10. */
+static int check(const char* profile, long long samples) {
+    long long total = 0;
+    long long from_root = 0;
+    long long from_chunks = 0;
+
+    for (const char* line = profile; *line != '\0';) {
+        const char* end = strchr(line, '\n');
+        const char* space = end;
+
+        while (space != NULL && space > line && *space != ' ')
+            space--;
+
+        if (end == NULL || space == line) {
+            fprintf(stderr, "ERROR: a line of the profile is not a stack and a count!\n");
+            return 1;
+        }
+
+        long long count = atoll(space + 1);
+        const char* spin = strstr(line, ";spin:");
+        total += count;
+
+        if (spin != NULL && spin < space && strncmp(line, "root:8:", 7) == 0)
+            from_root += count;
+        else if (spin != NULL && spin < space && strncmp(line, "root:10:", 8) == 0)
+            from_chunks += count;
+
+        line = end + 1;
+    }
+
+    if (total != samples) {
+        fprintf(stderr, "ERROR: the profile counts %lld samples of %lld!\n", total, samples);
+        return 1;
+    }
+
+    if (samples < 20 || from_root < samples / 4 || from_chunks < samples / 4) {
+        fprintf(stderr, "ERROR: %lld samples in spin from the root and %lld from the par for!\n", from_root, from_chunks);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,160 @@
+/* arithmetic on operands of known kinds runs in its quickened form from
+ * the first run, that on arrays and strings in the generic one, which it
+ * never specialises to. a quickened division still fails on a zero
+ * divisor and wraps the smallest i64 over -1, and the counts add up over
+ * the runs on a context.
+ *
+ * usage: test_quicken */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "kidomaru.h"
+
+#define ITERATIONS 1000
+#define RUNS 3
+
+static const char scalar_script[] =
+    "{\n"
+    "for (i in 0..1000) reduce(+) s: i64 {\n"
+    "    yield i * 3 + i / 2 - 1;\n"
+    "}\n"
+    "for (i in 0..1000) reduce(+) t: f64 {\n"
+    "    yield 0.5 * 3.0 - 1.0 / 4.0;\n"
+    "}\n"
+    "println(s);\n"
+    "println(t);\n"
+    "return 0;\n"
+    "}\n";
+
+static const char generic_script[] =
+    "{\n"
+    "let xs: []i64 = iota(1000, 0);\n"
+    "for (i in 0..1000) reduce(+) s: i64 {\n"
+    "    let ys: []i64 = xs * 2 + xs;\n"
+    "    let text: string = \"a\" + \"b\";\n"
+    "    yield ys[i] + len(text);\n"
+    "}\n"
+    "println(s);\n"
+    "return 0;\n"
+    "}\n";
+
+/* divide is called, so its division sees a different divisor each time. */
+static const char divide_script[] =
+    "{\n"
+    "fn divide(a: i64, b: i64) -> i64 {\n"
+    "    return a / b;\n"
+    "}\n"
+    "let smallest: i64 = 0 - 9223372036854775807 - 1;\n"
+    "println(divide(7, 2));\n"
+    "println(divide(0 - 7, 2));\n"
+    "println(divide(smallest, 0 - 1));\n"
+    "println(divide(1, 0));\n"
+    "return 0;\n"
+    "}\n";
+
+typedef struct Expected_t {
+    const char* name;
+    const char* source;
+    const char* output;
+
+    /* the line of the error, 0 when the run does not fail. */
+    size_t line;
+} Expected;
+
+static const Expected scripts[] = {
+    { "scalar", scalar_script, "1747000\n1250.0\n", 0 },
+    { "generic", generic_script, "1500500\n", 0 },
+    { "divide", divide_script, "3\n-3\n-9223372036854775808\n", 3 },
+};
+
+static int check(const Expected* expected, int optimize, kd_quicken_stats* stats);
+
+int main(void) {
+    int failed = 0;
+
+    for (int optimize = 0; optimize < 2; optimize++) {
+        kd_quicken_stats scalar;
+        kd_quicken_stats generic;
+        kd_quicken_stats divide;
+
+        failed |= check(&scripts[0], optimize, &scalar);
+        failed |= check(&scripts[1], optimize, &generic);
+        failed |= check(&scripts[2], optimize, &divide);
+
+        if (failed)
+            break;
+
+        if (scalar.generic != 0 || scalar.quickened < 2LL * ITERATIONS * RUNS || scalar.deopts != 0) {
+            fprintf(stderr, "ERROR: with optimize %d the scalar script ran %lld generic and %lld quickened instructions!\n",
+                optimize, scalar.generic, scalar.quickened);
+            failed = 1;
+        }
+
+        if (generic.generic < 2LL * ITERATIONS * RUNS || generic.rewrites != 0) {
+            fprintf(stderr, "ERROR: with optimize %d the array script ran %lld generic instructions and rewrote %lld!\n",
+                optimize, generic.generic, generic.rewrites);
+            failed = 1;
+        }
+
+        /* only the division by zero of each run goes to the generic form,
+         * which reports it. */
+        if (divide.generic > RUNS || divide.deopts != 0) {
+            fprintf(stderr, "ERROR: with optimize %d the division ran %lld times generic and deopted %lld times!\n",
+                optimize, divide.generic, divide.deopts);
+            failed = 1;
+        }
+    }
+
+    if (!failed)
+        printf("test_quicken: ok\n");
+
+    return failed;
+}
+
+/* runs the script RUNS times on one context, with calls left calls. */
+static int check(const Expected* expected, int optimize, kd_quicken_stats* stats) {
+    kd_compile_options options = { .optimize = optimize, .inline_calls = 0, .dedup = 1 };
+
+    kd_error error;
+    kd_program* program = kd_compile_with(expected->source, strlen(expected->source), &options, &error);
+
+    if (program == NULL) {
+        fprintf(stderr, "(%zu:%zu) ERROR: %s\n", error.line, error.col, error.message);
+        return 1;
+    }
+
+    kd_context* context = kd_context_new();
+    if (context == NULL) {
+        fprintf(stderr, "ERROR: cannot allocate memory!\n");
+        kd_program_free(program);
+        return 1;
+    }
+
+    kd_context_set_output(context, -1);
+
+    int failed = 0;
+
+    for (int i = 0; i < RUNS && !failed; i++) {
+        kd_status status = kd_run(program, context);
+
+        size_t size;
+        const char* printed = kd_context_take_output(context, &size);
+        const kd_error* reported = kd_context_error(context);
+
+        if (expected->line == 0 ? status != KD_OK : status != KD_ERROR_RUNTIME || reported->line != expected->line) {
+            fprintf(stderr, "ERROR: the %s script gave %s at line %zu: %s!\n", expected->name, kd_status_string(status), reported->line, reported->message);
+            failed = 1;
+        } else if (size != strlen(expected->output) || memcmp(printed, expected->output, size) != 0) {
+            fprintf(stderr, "ERROR: the %s script printed '%.*s', expected '%s'!\n", expected->name, (int)size, printed, expected->output);
+            failed = 1;
+        }
+    }
+
+    kd_context_quicken_stats(context, stats);
+
+    kd_context_free(context);
+    kd_program_free(program);
+    return failed;
+}
@@ -0,0 +1,159 @@
+/* the statistics count what the runs and compiles did and nothing while
+ * they are off: every instruction once whichever thread ran it, every
+ * call of a function left a call, every kd_run. the ssa passes leave
+ * fewer instructions to run and dedup fewer nodes to parse.
+ *
+ * usage: test_stats */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "kidomaru.h"
+
+#define RUNS 5
+
+/* every other statement repeats work the passes remove. */
+static const char script[] =
+    "{\n"
+    "fn step(n: i64) -> i64 {\n"
+    "    let a: i64 = n * 3 + 1;\n"
+    "    let b: i64 = n * 3 + 1;\n"
+    "    let unused: i64 = a * b * 0 + 1;\n"
+    "    return a + b * 1 + 0;\n"
+    "}\n"
+    "par for (i in 0..1000) reduce(+) s: i64 {\n"
+    "    yield step(i) + step(i) * 1;\n"
+    "}\n"
+    "println(s);\n"
+    "return 0;\n"
+    "}\n";
+
+typedef struct Options_t {
+    int optimize;
+    int dedup;
+    size_t nthreads;
+} Options;
+
+static int measure(const Options* options, int enabled, kd_stats* stats);
+static int check_json(const kd_stats* stats);
+
+int main(void) {
+    kd_stats off;
+    kd_stats one;
+    kd_stats four;
+    kd_stats unoptimized;
+    kd_stats undeduped;
+
+    int failed = measure(&(Options) { 1, 1, 1 }, 0, &off)
+        || measure(&(Options) { 1, 1, 1 }, 1, &one)
+        || measure(&(Options) { 1, 1, 4 }, 1, &four)
+        || measure(&(Options) { 0, 1, 1 }, 1, &unoptimized)
+        || measure(&(Options) { 1, 0, 1 }, 1, &undeduped);
+
+    if (failed)
+        return 1;
+
+    if (off.runs != 0 || off.instructions != 0 || off.tokens != 0 || off.bytes[KD_MEMORY_BYTECODE] != 0) {
+        fprintf(stderr, "ERROR: %lld runs and %lld instructions counted while off!\n", off.runs, off.instructions);
+        failed = 1;
+    }
+
+    if (one.runs != RUNS || one.calls != 2000LL * RUNS || one.tokens == 0 || one.nodes == 0 || one.bytes[KD_MEMORY_BYTECODE] == 0
+        || one.seconds[KD_PHASE_RUN] <= 0) {
+        fprintf(stderr, "ERROR: counted %lld runs, %lld calls, %lld tokens, %lld nodes and %lld bytes of bytecode!\n",
+            one.runs, one.calls, one.tokens, one.nodes, one.bytes[KD_MEMORY_BYTECODE]);
+        failed = 1;
+    }
+
+    if (four.instructions != one.instructions || four.calls != one.calls) {
+        fprintf(stderr, "ERROR: %lld instructions and %lld calls on 4 threads, %lld and %lld on 1!\n",
+            four.instructions, four.calls, one.instructions, one.calls);
+        failed = 1;
+    }
+
+    if (one.instructions >= unoptimized.instructions) {
+        fprintf(stderr, "ERROR: %lld instructions with the passes, %lld without!\n", one.instructions, unoptimized.instructions);
+        failed = 1;
+    }
+
+    if (one.nodes >= undeduped.nodes) {
+        fprintf(stderr, "ERROR: %lld nodes with dedup, %lld without!\n", one.nodes, undeduped.nodes);
+        failed = 1;
+    }
+
+    failed |= check_json(&one);
+
+    if (!failed)
+        printf("test_stats: ok\n");
+
+    return failed;
+}
+
+/* what compiling the script once, with calls left calls, and running it
+ * RUNS times counts. */
+static int measure(const Options* options, int enabled, kd_stats* stats) {
+    kd_stats_enable(enabled);
+    kd_stats_reset();
+
+    kd_compile_options compile = { .optimize = options->optimize, .inline_calls = 0, .dedup = options->dedup };
+
+    kd_error error;
+    kd_program* program = kd_compile_with(script, strlen(script), &compile, &error);
+
+    if (program == NULL) {
+        fprintf(stderr, "(%zu:%zu) ERROR: %s\n", error.line, error.col, error.message);
+        return 1;
+    }
+
+    kd_context* context = kd_context_new();
+    if (context == NULL) {
+        fprintf(stderr, "ERROR: cannot allocate memory!\n");
+        kd_program_free(program);
+        return 1;
+    }
+
+    kd_context_set_threads(context, options->nthreads);
+    kd_context_set_output(context, -1);
+
+    int failed = 0;
+
+    for (int i = 0; i < RUNS && !failed; i++) {
+        if (kd_run(program, context) != KD_OK || kd_context_exit_code(context) != 0) {
+            fprintf(stderr, "ERROR: %s\n", kd_context_error(context)->message);
+            failed = 1;
+        }
+    }
+
+    kd_context_free(context);
+    kd_program_free(program);
+
+    kd_stats_read(stats);
+    kd_stats_enable(0);
+    return failed;
+}
+
+static int check_json(const kd_stats* stats) {
+    char* json = NULL;
+    size_t size = 0;
+    FILE* file = open_memstream(&json, &size);
+
+    if (file == NULL || !kd_stats_write_json(stats, file) || fclose(file) != 0) {
+        fprintf(stderr, "ERROR: cannot write the stats as json!\n");
+        return 1;
+    }
+
+    char runs[64];
+    snprintf(runs, sizeof(runs), "\"runs\": %lld,", stats->runs);
+
+    int failed = strstr(json, runs) == NULL || strstr(json, "\"bytecode\": { \"allocations\": ") == NULL
+        || strstr(json, "\"run\": ") == NULL || json[size - 2] != '}';
+
+    if (failed)
+        fprintf(stderr, "ERROR: the stats as json are '%s'!\n", json);
+
+    free(json);
+    return failed;
+}
@@ -0,0 +1,170 @@
+/* a stream frees the long literals of a statement with it: the ones top
+ * level lets and maps keep are copied, and read back right after many
+ * statements of other literals have reused the memory. the input is fed a
+ * few bytes at a time. with fuel, a statement suspends the stream, which
+ * keeps what is fed meanwhile and runs it once resumed.
+ *
+ * usage: test_stream [statements] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "kidomaru.h"
+
+static const char head[] =
+    "let a: string = \"a literal of the first statement, long enough\";\n"
+    "let m: map[string]string = map[string]string{\"a key longer than fifteen\": \"a value longer than fifteen\"};\n"
+    "let b: string = a + \" and more, so that the rope is longer than sixty-four bytes\";\n"
+    "put(m, \"another key longer than fifteen bytes\", \"another value longer than fifteen bytes\");\n"
+    "put(m, b, a + \" and a tail that makes a rope of more than sixty-four bytes\");\n";
+
+static const char tail[] =
+    "println(a);\n"
+    "println(b);\n"
+    "println(m[\"a key longer than fifteen\"]);\n"
+    "println(m[\"another key longer than fifteen bytes\"]);\n"
+    "println(m[b]);\n"
+    "println(len(m));\n";
+
+static const char expected[] =
+    "a literal of the first statement, long enough\n"
+    "a literal of the first statement, long enough and more, so that the rope is longer than sixty-four bytes\n"
+    "a value longer than fifteen\n"
+    "another value longer than fifteen bytes\n"
+    "a literal of the first statement, long enough and a tail that makes a rope of more than sixty-four bytes\n"
+    "3\n";
+
+/* thousands of instructions per loop, on 50 of fuel. */
+static const char fuel_script[] =
+    "for (i in 0..10000) reduce(+) s: i64 { yield i; }\n"
+    "println(s);\n"
+    "for (i in 0..10000) reduce(+) t: i64 { yield s + i; }\n"
+    "println(t);\n";
+
+static const char fuel_expected[] =
+    "49995000\n"
+    "499999995000\n";
+
+static int feed(kd_stream* stream, const char* data, size_t len);
+static int check_fuel(void);
+
+int main(int argc, char** argv) {
+    long statements = argc > 1 ? atol(argv[1]) : 20000;
+
+    if (statements < 0) {
+        fprintf(stderr, "Usage: %s [statements]\n", argv[0]);
+        return 1;
+    }
+
+    kd_context* context = kd_context_new();
+    kd_stream* stream = context != NULL ? kd_stream_new(context, NULL) : NULL;
+
+    if (stream == NULL) {
+        fprintf(stderr, "ERROR: cannot allocate memory!\n");
+        return 1;
+    }
+
+    kd_context_set_output(context, -1);
+
+    int failed = feed(stream, head, strlen(head));
+
+    for (long i = 0; i < statements && !failed; i++) {
+        char statement[160];
+        int len = snprintf(statement, sizeof(statement), "let x%ld: i64 = len(\"%0*ld overwriting what the first statements left in the arena\");\n", i, (int)(i % 64), i);
+
+        failed = feed(stream, statement, len);
+        kd_context_take_output(context, &(size_t) { 0 });
+    }
+
+    if (!failed)
+        failed = feed(stream, tail, strlen(tail));
+
+    if (!failed && kd_stream_finish(stream) != KD_OK) {
+        const kd_error* error = kd_stream_error(stream);
+        fprintf(stderr, "(%zu:%zu) ERROR: %s\n", error->line, error->col, error->message);
+        failed = 1;
+    }
+
+    size_t size;
+    const char* output = kd_context_take_output(context, &size);
+
+    if (!failed && (size != strlen(expected) || memcmp(output, expected, size) != 0)) {
+        fprintf(stderr, "ERROR: the stream printed\n%.*s", (int)size, output);
+        failed = 1;
+    }
+
+    kd_stream_free(stream);
+    kd_context_free(context);
+
+    if (!failed)
+        failed = check_fuel();
+
+    if (!failed)
+        printf("test_stream: ok, %ld statements\n", statements);
+
+    return failed;
+}
+
+/* feeds everything without resuming, then resumes until it is done. */
+static int check_fuel(void) {
+    kd_context* context = kd_context_new();
+    kd_stream* stream = context != NULL ? kd_stream_new(context, NULL) : NULL;
+
+    if (stream == NULL) {
+        fprintf(stderr, "ERROR: cannot allocate memory!\n");
+        kd_context_free(context);
+        return 1;
+    }
+
+    kd_context_set_fuel(context, 50);
+    kd_context_set_output(context, -1);
+
+    kd_status status = KD_OK;
+    size_t len = strlen(fuel_script);
+
+    for (size_t at = 0; at < len && (status == KD_OK || status == KD_SUSPENDED); at += 7)
+        status = kd_stream_feed(stream, fuel_script + at, len - at < 7 ? len - at : 7);
+
+    if (status == KD_OK || status == KD_SUSPENDED)
+        status = kd_stream_finish(stream);
+
+    long slices = 0;
+
+    for (; status == KD_SUSPENDED; slices++)
+        status = kd_stream_resume(stream);
+
+    size_t size;
+    const char* output = kd_context_take_output(context, &size);
+    int failed = 1;
+
+    if (status != KD_OK) {
+        const kd_error* error = kd_stream_error(stream);
+        fprintf(stderr, "(%zu:%zu) ERROR: %s\n", error->line, error->col, error->message);
+    } else if (slices < 100 || !kd_stream_done(stream)) {
+        fprintf(stderr, "ERROR: the stream with fuel was resumed %ld times!\n", slices);
+    } else if (size != strlen(fuel_expected) || memcmp(output, fuel_expected, size) != 0) {
+        fprintf(stderr, "ERROR: the stream with fuel printed\n%.*s", (int)size, output);
+    } else {
+        failed = 0;
+    }
+
+    kd_stream_free(stream);
+    kd_context_free(context);
+    return failed;
+}
+
+/* in pieces of up to 7 bytes, cutting tokens and literals apart. */
+static int feed(kd_stream* stream, const char* data, size_t len) {
+    for (size_t at = 0; at < len; at += 7) {
+        size_t piece = len - at < 7 ? len - at : 7;
+
+        if (kd_stream_feed(stream, data + at, piece) != KD_OK) {
+            const kd_error* error = kd_stream_error(stream);
+            fprintf(stderr, "(%zu:%zu) ERROR: %s\n", error->line, error->col, error->message);
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,190 @@
+/* 1000 runs of a script of strings on one context: inline strings, long
+ * literals, ropes, string keys of a map, equality and printing. runs go
+ * to their end, or are sliced by fuel and resumed, or left suspended for
+ * the next run to drop, or dropped with their context, and every run that
+ * ends prints and returns what a plain one does. meant to be run under
+ * ASan and UBSan too, see tests/run.sh.
+ *
+ * usage: test_strings [runs] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "kidomaru.h"
+
+static const char script[] =
+    "{\n"
+    "    fn build(n: i64, s: string) -> string {\n"
+    "        if (n == 0) { return s; }\n"
+    "        return build(n - 1, s + \"-a-piece-longer-than-inline-\" + s);\n"
+    "    }\n"
+    "\n"
+    "    fn repeat(n: i64, s: string) -> string {\n"
+    "        if (n == 0) { return \"\"; }\n"
+    "        return s + repeat(n - 1, s);\n"
+    "    }\n"
+    "\n"
+    "    let short: string = \"short \\\"one\\\"\";\n"
+    "    let long: string = \"a literal longer than fifteen bytes, \\\\ too\";\n"
+    "    let rope: string = build(6, \"x\");\n"
+    "    let line: string = repeat(200, \"ab\");\n"
+    "    let m: map[string]i64 = map[string]i64{\"a\": 1, long: 2};\n"
+    "    put(m, rope, len(rope));\n"
+    "    put(m, line, 3);\n"
+    "    println(short);\n"
+    "    println(long);\n"
+    "    println(len(rope));\n"
+    "    println(len(line));\n"
+    "    println(m[rope] + m[long] + m[\"a\"] + m[repeat(200, \"ab\")]);\n"
+    "    println(rope == build(6, \"x\"));\n"
+    "    println(rope != line);\n"
+    "    println(short + long);\n"
+    "    println(repeat(3, long));\n"
+    "    return len(rope) + len(line);\n"
+    "}\n";
+
+typedef struct Expected_t {
+    char* output;
+    size_t size;
+    long long exit_code;
+} Expected;
+
+static kd_context* new_context(void);
+static int finish(kd_context* context, kd_status status, const Expected* expected, long run);
+
+int main(int argc, char** argv) {
+    long runs = argc > 1 ? atol(argv[1]) : 1000;
+
+    if (runs < 1) {
+        fprintf(stderr, "Usage: %s [runs]\n", argv[0]);
+        return 1;
+    }
+
+    kd_error error;
+    kd_program* program = kd_compile(script, strlen(script), &error);
+    if (program == NULL) {
+        fprintf(stderr, "(%zu:%zu) ERROR: %s\n", error.line, error.col, error.message);
+        return 1;
+    }
+
+    kd_context* context = new_context();
+    if (context == NULL) {
+        fprintf(stderr, "ERROR: cannot allocate memory!\n");
+        return 1;
+    }
+
+    Expected expected = { NULL, 0, 0 };
+    kd_status status = kd_run(program, context);
+
+    if (status == KD_OK) {
+        const char* output = kd_context_take_output(context, &expected.size);
+
+        expected.output = malloc(expected.size);
+        if (expected.output != NULL)
+            memcpy(expected.output, output, expected.size);
+
+        expected.exit_code = kd_context_exit_code(context);
+    }
+
+    /* the lengths of rope and line. */
+    if (status != KD_OK || expected.output == NULL || expected.exit_code != 1828 + 400) {
+        fprintf(stderr, "ERROR: the first run gave %s, returning %lld!\n", kd_status_string(status), expected.exit_code);
+        return 1;
+    }
+
+    int failed = 0;
+
+    for (long i = 0; i < runs && !failed; i++) {
+        long long fuel = 1 + i * 7919 % 997;
+
+        switch (i % 4) {
+        case 0:
+            kd_context_set_fuel(context, 0);
+            failed = finish(context, kd_run(program, context), &expected, i);
+            break;
+
+        case 1:
+            kd_context_set_fuel(context, fuel);
+            status = kd_run(program, context);
+
+            while (status == KD_SUSPENDED)
+                status = kd_resume(context);
+
+            failed = finish(context, status, &expected, i);
+            break;
+
+        case 2:
+            /* the next run starts over. */
+            kd_context_set_fuel(context, fuel);
+            status = kd_run(program, context);
+
+            for (long resumes = i % 5; resumes > 0 && status == KD_SUSPENDED; resumes--)
+                status = kd_resume(context);
+
+            kd_context_take_output(context, &(size_t) { 0 });
+            break;
+
+        case 3:
+            /* dropped halfway, every so often with its context. */
+            kd_context_set_fuel(context, fuel);
+            status = kd_run(program, context);
+
+            if (i % 12 == 3) {
+                kd_context_free(context);
+                context = new_context();
+
+                if (context == NULL) {
+                    fprintf(stderr, "ERROR: cannot allocate memory!\n");
+                    failed = 1;
+                }
+            } else {
+                kd_context_take_output(context, &(size_t) { 0 });
+            }
+            break;
+        }
+    }
+
+    if (!failed)
+        printf("test_strings: ok, %ld runs\n", runs);
+
+    if (context != NULL)
+        kd_context_free(context);
+
+    free(expected.output);
+    kd_program_free(program);
+    return failed;
+}
+
+static kd_context* new_context(void) {
+    kd_context* context = kd_context_new();
+
+    if (context != NULL)
+        kd_context_set_output(context, -1);
+
+    return context;
+}
+
+/* the run that ended with status printed and returned what was expected. */
+static int finish(kd_context* context, kd_status status, const Expected* expected, long run) {
+    size_t size;
+    const char* output = kd_context_take_output(context, &size);
+
+    if (status != KD_OK) {
+        const kd_error* error = kd_context_error(context);
+        fprintf(stderr, "(%zu:%zu) ERROR: run %ld: %s\n", error->line, error->col, run, error->message);
+        return 1;
+    }
+
+    if (size != expected->size || memcmp(output, expected->output, size) != 0) {
+        fprintf(stderr, "ERROR: run %ld printed %.*s!\n", run, (int)size, output);
+        return 1;
+    }
+
+    if (kd_context_exit_code(context) != expected->exit_code) {
+        fprintf(stderr, "ERROR: run %ld returned %lld, %lld expected!\n", run, kd_context_exit_code(context), expected->exit_code);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,135 @@
+/* with auto_parallel, a failing task reports the error of the first
+ * statement in program order that failed, with the output of the ones
+ * before it, and the tasks after it are stopped rather than waited for.
+ * with fuel or without, on one thread or many.
+ *
+ * usage: test_tasks */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "kidomaru.h"
+
+/* b fails long before a, which still wins. */
+static const char order_script[] =
+    "{\n"
+    "fn noisy(x: i64) -> i64 {\n"
+    "    println(x);\n"
+    "    return x;\n"
+    "}\n"
+    "fn fail_late(n: i64) -> i64 {\n"
+    "    for (i in 0..n) reduce(+) s: i64 { yield i; }\n"
+    "    let a: []i64 = [1];\n"
+    "    return a[s];\n"
+    "}\n"
+    "fn fail_now(n: i64) -> i64 {\n"
+    "    let a: []i64 = [1];\n"
+    "    return a[n];\n"
+    "}\n"
+    "let p: i64 = noisy(5);\n"
+    "let a: i64 = fail_late(3000000);\n"
+    "let b: i64 = fail_now(7);\n"
+    "println(p + a + b);\n"
+    "return 0;\n"
+    "}\n";
+
+/* the loop after the failure takes about a minute. */
+static const char cancel_script[] =
+    "{\n"
+    "fn fail_now(n: i64) -> i64 {\n"
+    "    let a: []i64 = [1];\n"
+    "    return a[n];\n"
+    "}\n"
+    "fn slow(n: i64) -> i64 {\n"
+    "    for (i in 0..n) reduce(+) s: i64 { yield i; }\n"
+    "    return s;\n"
+    "}\n"
+    "let x: i64 = fail_now(5);\n"
+    "let c: i64 = slow(1000000000);\n"
+    "return x + c;\n"
+    "}\n";
+
+/* a run that takes longer has waited for the loop. */
+#define MAX_SECONDS 10.0
+
+static int check(const char* name, const char* source, size_t nthreads, long long fuel, size_t line, const char* output);
+
+int main(void) {
+    int failed = 0;
+    size_t threads[] = { 1, 4 };
+    long long fuels[] = { 0, 1000 };
+
+    for (size_t t = 0; t < sizeof(threads) / sizeof(threads[0]); t++) {
+        for (size_t f = 0; f < sizeof(fuels) / sizeof(fuels[0]); f++) {
+            failed |= check("order", order_script, threads[t], fuels[f], 9, "5\n");
+            failed |= check("cancel", cancel_script, threads[t], fuels[f], 4, "");
+        }
+    }
+
+    if (!failed)
+        printf("test_tasks: ok\n");
+
+    return failed;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* the run fails at line with output printed before, in time. */
+static int check(const char* name, const char* source, size_t nthreads, long long fuel, size_t line, const char* output) {
+    kd_compile_options options = { .optimize = 1, .inline_calls = 1, .dedup = 1, .auto_parallel = 1 };
+
+    kd_error error;
+    kd_program* program = kd_compile_with(source, strlen(source), &options, &error);
+
+    if (program == NULL) {
+        fprintf(stderr, "(%zu:%zu) ERROR: %s\n", error.line, error.col, error.message);
+        return 1;
+    }
+
+    kd_context* context = kd_context_new();
+    if (context == NULL) {
+        fprintf(stderr, "ERROR: cannot allocate memory!\n");
+        kd_program_free(program);
+        return 1;
+    }
+
+    kd_context_set_threads(context, nthreads);
+    kd_context_set_fuel(context, fuel);
+    kd_context_set_output(context, -1);
+
+    double start = now();
+    kd_status status = kd_run(program, context);
+
+    while (status == KD_SUSPENDED)
+        status = kd_resume(context);
+
+    double seconds = now() - start;
+
+    const kd_error* reported = kd_context_error(context);
+    size_t size;
+    const char* printed = kd_context_take_output(context, &size);
+
+    int failed = 1;
+
+    if (status != KD_ERROR_RUNTIME || reported->line != line) {
+        fprintf(stderr, "ERROR: %s on %zu threads with fuel %lld gave %s at line %zu, expected a runtime error at line %zu!\n",
+            name, nthreads, fuel, kd_status_string(status), reported->line, line);
+    } else if (size != strlen(output) || (size != 0 && memcmp(printed, output, size) != 0)) {
+        fprintf(stderr, "ERROR: %s on %zu threads with fuel %lld printed '%.*s', expected '%s'!\n", name, nthreads, fuel, (int)size, printed, output);
+    } else if (seconds > MAX_SECONDS) {
+        fprintf(stderr, "ERROR: %s on %zu threads with fuel %lld took %.1f seconds!\n", name, nthreads, fuel, seconds);
+    } else {
+        failed = 0;
+    }
+
+    kd_context_free(context);
+    kd_program_free(program);
+    return failed;
+}
@@ -0,0 +1,173 @@
+/* a tiered program prints what it would untiered, on every run, whether
+ * the second tier is entered by a call, by a run or from the middle of a
+ * loop, when runs are suspended and resumed around it, and when several
+ * threads run the program as it is promoted.
+ *
+ * usage: test_tiers */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "kidomaru.h"
+
+static const char script[] =
+    "{\n"
+    "fn step(n: i64) -> i64 { return n * 3 + 1; }\n"
+    "fn spin(n: i64) -> f64 {\n"
+    "    for (i in 0..n) reduce(+) s: f64 { yield 0.5; }\n"
+    "    return s;\n"
+    "}\n"
+    "for (i in 0..20000) reduce(+) s: i64 {\n"
+    "    yield step(i);\n"
+    "}\n"
+    "println(s);\n"
+    "println(spin(5000));\n"
+    "return 0;\n"
+    "}\n";
+
+static const char expected[] = "599990000\n2500.0\n";
+
+/* what each promotion writes to the trace. */
+static const char* traced[] = {
+    "'step' promoted to the second tier",
+    "loop at 4:5 of 'spin' entered in the second tier",
+    "loop at 7:1 of the root entered in the second tier",
+};
+
+#define RUNS 10
+#define THREADS 4
+
+typedef struct Worker_t {
+    const kd_program* program;
+    pthread_t thread;
+    int failed;
+} Worker;
+
+static kd_program* compile(FILE* trace);
+static int run(const kd_program* program, kd_context* context, long long fuel);
+static void* work(void* arg);
+
+int main(void) {
+    int failed = 0;
+    long long fuels[] = { 0, 97 };
+
+    for (size_t f = 0; f < sizeof(fuels) / sizeof(fuels[0]) && !failed; f++) {
+        char* trace = NULL;
+        size_t size = 0;
+        FILE* file = open_memstream(&trace, &size);
+
+        kd_program* program = compile(file);
+        kd_context* context = kd_context_new();
+
+        if (program == NULL || context == NULL)
+            return 1;
+
+        kd_context_set_fuel(context, fuels[f]);
+        kd_context_set_output(context, -1);
+
+        for (int i = 0; i < RUNS && !failed; i++)
+            failed = run(program, context, fuels[f]);
+
+        kd_context_free(context);
+        kd_program_free(program);
+        fclose(file);
+
+        for (size_t i = 0; i < sizeof(traced) / sizeof(traced[0]) && !failed; i++) {
+            if (strstr(trace, traced[i]) == NULL) {
+                fprintf(stderr, "ERROR: with fuel %lld nothing traced '%s', the trace is:\n%s", fuels[f], traced[i], trace);
+                failed = 1;
+            }
+        }
+
+        free(trace);
+    }
+
+    Worker workers[THREADS];
+    kd_program* program = compile(NULL);
+
+    if (program == NULL)
+        return 1;
+
+    for (size_t i = 0; i < THREADS; i++) {
+        workers[i] = (Worker) { .program = program };
+        pthread_create(&workers[i].thread, NULL, work, &workers[i]);
+    }
+
+    for (size_t i = 0; i < THREADS; i++) {
+        pthread_join(workers[i].thread, NULL);
+        failed |= workers[i].failed;
+    }
+
+    kd_program_free(program);
+
+    if (!failed)
+        printf("test_tiers: ok\n");
+
+    return failed;
+}
+
+/* promoted after 3 calls or runs, or 64 times round a loop. */
+static kd_program* compile(FILE* trace) {
+    kd_compile_options options = {
+        .optimize = 1,
+        .inline_calls = 0,
+        .dedup = 1,
+        .tiered = 1,
+        .tier_calls = 3,
+        .tier_loops = 64,
+        .trace_tiers = trace,
+    };
+
+    kd_error error;
+    kd_program* program = kd_compile_with(script, strlen(script), &options, &error);
+
+    if (program == NULL)
+        fprintf(stderr, "(%zu:%zu) ERROR: %s\n", error.line, error.col, error.message);
+
+    return program;
+}
+
+static int run(const kd_program* program, kd_context* context, long long fuel) {
+    kd_status status = kd_run(program, context);
+
+    while (status == KD_SUSPENDED)
+        status = kd_resume(context);
+
+    size_t size;
+    const char* printed = kd_context_take_output(context, &size);
+
+    if (status != KD_OK) {
+        fprintf(stderr, "ERROR: with fuel %lld: %s\n", fuel, kd_context_error(context)->message);
+        return 1;
+    }
+
+    if (size != strlen(expected) || memcmp(printed, expected, size) != 0) {
+        fprintf(stderr, "ERROR: with fuel %lld the program printed '%.*s', expected '%s'!\n", fuel, (int)size, printed, expected);
+        return 1;
+    }
+
+    return 0;
+}
+
+static void* work(void* arg) {
+    Worker* worker = arg;
+    kd_context* context = kd_context_new();
+
+    if (context == NULL) {
+        worker->failed = 1;
+        return NULL;
+    }
+
+    kd_context_set_threads(context, 1);
+    kd_context_set_output(context, -1);
+
+    for (int i = 0; i < RUNS && !worker->failed; i++)
+        worker->failed = run(worker->program, context, 0);
+
+    kd_context_free(context);
+    return NULL;
+}
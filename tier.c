@@ -0,0 +1,160 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "tier.h"
+#include "program.h"
+#include "stats.h"
+
+static const Chunk* promote(Tier* tier, uint32_t count, const char* counted);
+static void describe(const Tier* tier, char* buffer, size_t size);
+
+int tier_attach(Chunk* chunk, Function* function, const Statement* root, size_t root_nslots, Functions* functions,
+    const kd_compile_options* options) {
+    Tier* tier = arena_alloc(functions->arena, sizeof(Tier));
+    if (tier == NULL)
+        return 0;
+
+    size_t calls = options->tier_calls > 0 ? options->tier_calls : TIER_CALLS;
+    size_t loops = options->tier_loops > 0 ? options->tier_loops : TIER_LOOPS;
+
+    *tier = (Tier) {
+        .function = function,
+        .root = root,
+        .root_nslots = root_nslots,
+        .functions = functions,
+        .chunk = chunk,
+        .promoted = NULL,
+        .failed = 0,
+        .calls_threshold = calls < UINT32_MAX ? calls : UINT32_MAX,
+        .loops_threshold = loops < BACKEDGE_LIMIT ? loops : BACKEDGE_LIMIT,
+        .calls = 0,
+    };
+
+    chunk->tier = tier;
+    return 1;
+}
+
+/* like the backedge counters, calls lost to a race only delay the
+ * promotion. */
+const Chunk* tier_call(Tier* tier) {
+    const Chunk* promoted = __atomic_load_n(&tier->promoted, __ATOMIC_ACQUIRE);
+    if (promoted != NULL)
+        return promoted;
+
+    uint32_t calls = __atomic_load_n(&tier->calls, __ATOMIC_RELAXED);
+
+    if (calls < tier->calls_threshold) {
+        __atomic_store_n(&tier->calls, ++calls, __ATOMIC_RELAXED);
+
+        if (calls < tier->calls_threshold)
+            return tier->chunk;
+    }
+
+    if (__atomic_load_n(&tier->failed, __ATOMIC_RELAXED))
+        return tier->chunk;
+
+    return promote(tier, calls, tier->function != NULL ? "calls" : "runs");
+}
+
+const Chunk* tier_enter_loop(Tier* tier, size_t loop, size_t pc) {
+    const ChunkLoop* entered = &tier->chunk->loops[loop];
+    FILE* trace = tier->functions->options.trace_tiers;
+
+    Chunk* chunk = NULL;
+    kd_error error;
+    kd_status status;
+
+    int64_t start = stats_clock();
+    functions_lock(tier->functions);
+
+    if (entered->nvalues > TIER_MAX_VALUES) {
+        status = KD_ERROR_SYNTAX;
+        snprintf(error.message, sizeof(error.message), "%zu values are live in the loop", entered->nvalues);
+    } else if ((chunk = arena_alloc(tier->functions->arena, sizeof(Chunk))) == NULL) {
+        status = KD_ERROR_NOMEM;
+        snprintf(error.message, sizeof(error.message), "cannot allocate memory!");
+    } else {
+        status = program_compile_tier(tier, entered, chunk, &error);
+    }
+
+    if (trace != NULL) {
+        char name[128];
+        describe(tier, name, sizeof(name));
+
+        const Position* position = &tier->chunk->positions[pc];
+
+        if (status == KD_OK) {
+            fprintf(trace, "tier: loop at %u:%u of %s entered in the second tier after %u iterations, compiled in %.1f us\n",
+                position->line, position->col, name, tier->loops_threshold, (stats_clock() - start) / 1e3);
+        } else {
+            fprintf(trace, "tier: loop at %u:%u of %s stays in the first tier: %s\n",
+                position->line, position->col, name, error.message);
+        }
+    }
+
+    functions_unlock(tier->functions);
+
+    /* whatever runs the body next had better start in the second tier
+     * too. it is the loop that got it there, not the calls. */
+    promote(tier, tier->loops_threshold, "loop iterations");
+
+    return status == KD_OK ? chunk : NULL;
+}
+
+/* the body is compiled once, by whichever thread gets here first. the trace
+ * says it took count of what was counted. */
+static const Chunk* promote(Tier* tier, uint32_t count, const char* counted) {
+    FILE* trace = tier->functions->options.trace_tiers;
+
+    functions_lock(tier->functions);
+
+    if (tier->promoted == NULL && !tier->failed) {
+        kd_error error;
+        kd_status status;
+
+        int64_t start = stats_clock();
+        Chunk* chunk = arena_alloc(tier->functions->arena, sizeof(Chunk));
+
+        if (chunk == NULL) {
+            status = KD_ERROR_NOMEM;
+            snprintf(error.message, sizeof(error.message), "cannot allocate memory!");
+        } else {
+            status = program_compile_tier(tier, NULL, chunk, &error);
+        }
+
+        if (status == KD_OK) {
+            __atomic_store_n(&tier->promoted, chunk, __ATOMIC_RELEASE);
+
+            if (tier->function != NULL)
+                __atomic_store_n(&tier->function->chunk, chunk, __ATOMIC_RELEASE);
+        } else {
+            __atomic_store_n(&tier->failed, 1, __ATOMIC_RELAXED);
+        }
+
+        if (trace != NULL) {
+            char name[128];
+            describe(tier, name, sizeof(name));
+
+            if (status == KD_OK) {
+                fprintf(trace, "tier: %s promoted to the second tier after %u %s, compiled in %.1f us\n",
+                    name, count, counted, (stats_clock() - start) / 1e3);
+            } else {
+                fprintf(trace, "tier: %s stays in the first tier: %s\n", name, error.message);
+            }
+        }
+    }
+
+    const Chunk* chunk = tier->promoted != NULL ? tier->promoted : tier->chunk;
+
+    functions_unlock(tier->functions);
+    return chunk;
+}
+
+static void describe(const Tier* tier, char* buffer, size_t size) {
+    const Function* function = tier->function;
+
+    if (function == NULL)
+        snprintf(buffer, size, "the root");
+    else
+        snprintf(buffer, size, "'%.*s'", (int)function->name.size, function->name.data);
+}
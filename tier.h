@@ -0,0 +1,72 @@
+#ifndef TIER_H
+#define TIER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ast.h"
+#include "bytecode.h"
+#include "function.h"
+
+/* tiered execution, see kd_compile_options.tiered.
+ *
+ * a body starts in the first tier, lowered to ssa form and compiled with no
+ * pass, and its chunk carries a Tier. the tier counts the calls of the
+ * body, or the runs of the root of a program, and the backedge counters of
+ * the chunk count its loops. once either count reaches its threshold, the
+ * body is compiled again with every pass for the second tier, which every
+ * call or run from then on goes to.
+ *
+ * a loop reaching its threshold moves the frame running it over to the
+ * second tier on the spot: the body is lowered once more and entered at
+ * the start of the loop, see ir_enter_loop, with the values live at its
+ * OP_LOOP moved to the first registers as the arguments. */
+typedef struct Tier_t {
+    /* the body the chunk was compiled from, or the root of a program with
+     * root_nslots slots in its frame when function is NULL. */
+    Function* function;
+    const Statement* root;
+    size_t root_nslots;
+
+    /* the table of the body, whose options and arena the second tier is
+     * compiled with. */
+    Functions* functions;
+
+    /* the chunk of the first tier and, once compiled, of the second, NULL
+     * until then. promoted is published like Function.chunk. */
+    const Chunk* chunk;
+    const Chunk* promoted;
+
+    /* the second tier could not be compiled, it is not tried again. */
+    int failed;
+
+    uint32_t calls_threshold;
+    uint32_t loops_threshold;
+
+    /* calls or runs so far, counted with relaxed atomics. */
+    uint32_t calls;
+} Tier;
+
+/* the thresholds when the options leave them 0. */
+#define TIER_CALLS 1000
+#define TIER_LOOPS 10000
+
+/* a loop with more values live at its OP_LOOP stays in the first tier. */
+#define TIER_MAX_VALUES 64
+
+/* gives chunk, compiled from function, or from root when that is NULL, in
+ * the first tier, a Tier from the arena of functions with the thresholds
+ * of options. returns 0 when out of memory. */
+int tier_attach(Chunk* chunk, Function* function, const Statement* root, size_t root_nslots, Functions* functions,
+    const kd_compile_options* options);
+
+/* the chunk a call of the body of tier runs, or a run of the root, after
+ * counting it. */
+const Chunk* tier_call(Tier* tier);
+
+/* the chunk of the second tier entering loop of the chunk of tier, on
+ * the OP_LOOP at pc reaching the threshold, NULL when the loop stays in
+ * the first tier. the body is promoted along with it. */
+const Chunk* tier_enter_loop(Tier* tier, size_t loop, size_t pc);
+
+#endif /* TIER_H */
@@ -0,0 +1,365 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "value.h"
+#include "stats.h"
+
+/* concatenations up to this size are copied instead of building a rope. */
+#define STRING_FLAT_MAX 64
+
+static Value string_inline(const char* data, size_t size);
+static Value string_object(StringObject* object, uint8_t tag);
+static StringObject* string_alloc_flat(size_t size);
+
+static const char* flatten(StringObject* rope);
+static int borrows(const Value* value);
+
+int string_constant(Arena* arena, const char* data, size_t size, Value* value) {
+    if (size <= STRING_INLINE_MAX) {
+        *value = string_inline(data, size);
+        return 1;
+    }
+
+    StringObject* object = arena_alloc(arena, sizeof(StringObject) + size);
+    if (object == NULL)
+        return 0;
+
+    *object = (StringObject) {
+        .refcount = 0,
+        .shape = STRING_FLAT,
+        .borrows = 0,
+        .size = size,
+        .hash = 0,
+        .data = object->chars,
+    };
+
+    memcpy(object->chars, data, size);
+
+    *value = string_object(object, STRING_CONSTANT);
+    return 1;
+}
+
+size_t string_size(const Value* value) {
+    if (value->String.size <= STRING_INLINE_MAX)
+        return value->String.size;
+
+    return value->object->size;
+}
+
+const char* string_data(const Value* value) {
+    if (value->String.size <= STRING_INLINE_MAX)
+        return value->String.data;
+
+    StringObject* object = value->object;
+
+    const char* data = __atomic_load_n(&object->data, __ATOMIC_ACQUIRE);
+    if (data != NULL)
+        return data;
+
+    return flatten(object);
+}
+
+size_t string_unflattened(const Value* value) {
+    if (value->String.size <= STRING_INLINE_MAX)
+        return 0;
+
+    return __atomic_load_n(&value->object->data, __ATOMIC_ACQUIRE) == NULL ? value->object->size : 0;
+}
+
+/* FNV-1a, never 0 so that 0 can mean not computed yet. */
+uint64_t string_hash(const Value* value) {
+    StringObject* object = value->String.size <= STRING_INLINE_MAX ? NULL : value->object;
+
+    if (object != NULL) {
+        uint64_t hash = __atomic_load_n(&object->hash, __ATOMIC_RELAXED);
+        if (hash != 0)
+            return hash;
+    }
+
+    const char* data = string_data(value);
+    if (data == NULL)
+        return 0;
+
+    uint64_t hash = 0xcbf29ce484222325;
+    size_t size = string_size(value);
+
+    for (size_t i = 0; i < size; i++) {
+        hash ^= (unsigned char)data[i];
+        hash *= 0x100000001b3;
+    }
+
+    if (hash == 0)
+        hash = 1;
+
+    if (object != NULL)
+        __atomic_store_n(&object->hash, hash, __ATOMIC_RELAXED);
+
+    return hash;
+}
+
+int string_concat(const Value* lhs, const Value* rhs, Value* result) {
+    size_t lhs_size = string_size(lhs);
+    size_t rhs_size = string_size(rhs);
+    size_t size = lhs_size + rhs_size;
+
+    if (size < lhs_size)
+        return 0;
+
+    /* anything this short is inline, so both sides are too. */
+    if (size <= STRING_INLINE_MAX) {
+        *result = string_inline(lhs->String.data, lhs_size);
+        memcpy(result->String.data + lhs_size, rhs->String.data, rhs_size);
+        result->String.size = size;
+
+        return 1;
+    }
+
+    if (size <= STRING_FLAT_MAX) {
+        const char* lhs_data = string_data(lhs);
+        const char* rhs_data = string_data(rhs);
+
+        StringObject* object = lhs_data != NULL && rhs_data != NULL ? string_alloc_flat(size) : NULL;
+        if (object == NULL)
+            return 0;
+
+        memcpy(object->chars, lhs_data, lhs_size);
+        memcpy(object->chars + lhs_size, rhs_data, rhs_size);
+
+        *result = string_object(object, STRING_HEAP);
+        return 1;
+    }
+
+    StringObject* rope = malloc(sizeof(StringObject));
+    if (rope == NULL)
+        return 0;
+
+    stats_alloc(KD_MEMORY_STRINGS, sizeof(StringObject));
+
+    *rope = (StringObject) {
+        .refcount = 1,
+        .shape = STRING_ROPE,
+        .borrows = borrows(lhs) || borrows(rhs),
+        .size = size,
+        .hash = 0,
+        .data = NULL,
+        .left = *lhs,
+        .right = *rhs,
+    };
+
+    value_retain(lhs);
+    value_retain(rhs);
+
+    *result = string_object(rope, STRING_HEAP);
+    return 1;
+}
+
+int string_equals(const Value* lhs, const Value* rhs) {
+    size_t size = string_size(lhs);
+
+    if (size != string_size(rhs))
+        return 0;
+
+    if (size <= STRING_INLINE_MAX)
+        return memcmp(lhs->String.data, rhs->String.data, size) == 0;
+
+    if (lhs->object == rhs->object)
+        return 1;
+
+    uint64_t lhs_hash = __atomic_load_n(&lhs->object->hash, __ATOMIC_RELAXED);
+    uint64_t rhs_hash = __atomic_load_n(&rhs->object->hash, __ATOMIC_RELAXED);
+
+    if (lhs_hash != 0 && rhs_hash != 0 && lhs_hash != rhs_hash)
+        return 0;
+
+    const char* lhs_data = string_data(lhs);
+    const char* rhs_data = string_data(rhs);
+
+    if (lhs_data == NULL || rhs_data == NULL)
+        return -1;
+
+    return memcmp(lhs_data, rhs_data, size) == 0;
+}
+
+int string_own(const Value* value, Value* result) {
+    if (!borrows(value)) {
+        value_retain(value);
+        *result = *value;
+        return 1;
+    }
+
+    const char* data = string_data(value);
+    StringObject* object = data != NULL ? string_alloc_flat(value->object->size) : NULL;
+    if (object == NULL)
+        return 0;
+
+    memcpy(object->chars, data, object->size);
+    object->hash = __atomic_load_n(&value->object->hash, __ATOMIC_RELAXED);
+
+    *result = string_object(object, STRING_HEAP);
+    return 1;
+}
+
+/* a rope can be millions of nodes deep after a loop of appends, so neither
+ * freeing nor flattening one may recurse. dead ropes are kept on a list
+ * threaded through themselves until both their children are released. */
+void string_release(StringObject* object) {
+    StringObject* dead = NULL;
+
+    for (;;) {
+        if (object != NULL && __atomic_sub_fetch(&object->refcount, 1, __ATOMIC_ACQ_REL) == 0) {
+            if (object->shape == STRING_FLAT) {
+                free(object);
+            } else {
+                free(object->data);
+                object->next_dead = dead;
+                dead = object;
+            }
+        }
+
+        if (dead == NULL)
+            return;
+
+        StringObject* rope = dead;
+
+        if (value_is_counted(&rope->left)) {
+            object = rope->left.object;
+            rope->left.kind = VAL_INT;
+            continue;
+        }
+
+        if (value_is_counted(&rope->right)) {
+            object = rope->right.object;
+            rope->right.kind = VAL_INT;
+            continue;
+        }
+
+        dead = rope->next_dead;
+        free(rope);
+        object = NULL;
+    }
+}
+
+static Value string_inline(const char* data, size_t size) {
+    Value value;
+    memset(&value, 0, sizeof(Value));
+
+    value.kind = VAL_STRING;
+    memcpy(value.String.data, data, size);
+    value.String.size = size;
+
+    return value;
+}
+
+static Value string_object(StringObject* object, uint8_t tag) {
+    Value value;
+    memset(&value, 0, sizeof(Value));
+
+    value.kind = VAL_STRING;
+    value.object = object;
+    value.String.size = tag;
+
+    return value;
+}
+
+static StringObject* string_alloc_flat(size_t size) {
+    StringObject* object = malloc(sizeof(StringObject) + size);
+    if (object == NULL)
+        return NULL;
+
+    stats_alloc(KD_MEMORY_STRINGS, sizeof(StringObject) + size);
+
+    *object = (StringObject) {
+        .refcount = 1,
+        .shape = STRING_FLAT,
+        .borrows = 0,
+        .size = size,
+        .hash = 0,
+        .data = object->chars,
+    };
+
+    return object;
+}
+
+/* fills the buffer from the end, so the usual left leaning rope of a loop of
+ * appends keeps the stack of pending nodes short. the children are kept, a
+ * thread may still be walking them. */
+static const char* flatten(StringObject* rope) {
+    char* buffer = malloc(rope->size);
+    if (buffer == NULL)
+        return NULL;
+
+    stats_alloc(KD_MEMORY_STRINGS, rope->size);
+
+    const Value* local[64];
+    const Value** stack = local;
+    size_t capacity = sizeof(local) / sizeof(local[0]);
+    size_t nstack = 0;
+
+    size_t end = rope->size;
+
+    stack[nstack++] = &rope->left;
+    stack[nstack++] = &rope->right;
+
+    while (nstack > 0) {
+        const Value* value = stack[--nstack];
+        size_t size = string_size(value);
+
+        if (size <= STRING_INLINE_MAX) {
+            end -= size;
+            memcpy(buffer + end, value->String.data, size);
+            continue;
+        }
+
+        StringObject* object = value->object;
+
+        const char* data = __atomic_load_n(&object->data, __ATOMIC_ACQUIRE);
+        if (data != NULL) {
+            end -= size;
+            memcpy(buffer + end, data, size);
+            continue;
+        }
+
+        if (nstack + 2 > capacity) {
+            size_t new_capacity = capacity * 2;
+            const Value** new_stack = malloc(new_capacity * sizeof(Value*));
+
+            if (new_stack == NULL) {
+                if (stack != local)
+                    free(stack);
+                free(buffer);
+
+                return NULL;
+            }
+
+            memcpy(new_stack, stack, nstack * sizeof(Value*));
+
+            if (stack != local)
+                free(stack);
+
+            stack = new_stack;
+            capacity = new_capacity;
+        }
+
+        stack[nstack++] = &object->left;
+        stack[nstack++] = &object->right;
+    }
+
+    if (stack != local)
+        free(stack);
+
+    char* expected = NULL;
+
+    if (!__atomic_compare_exchange_n(&rope->data, &expected, buffer, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        free(buffer);
+        return expected;
+    }
+
+    return buffer;
+}
+
+static int borrows(const Value* value) {
+    if (value->String.size <= STRING_INLINE_MAX)
+        return 0;
+
+    return value->String.size == STRING_CONSTANT || value->object->borrows;
+}
@@ -0,0 +1,258 @@
+#ifndef VALUE_H
+#define VALUE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "lexer.h"
+#include "arena.h"
+
+typedef enum ValueKind_t {
+    VAL_INT,
+    VAL_DOUBLE,
+    VAL_BOOL,
+    VAL_STRING,
+    VAL_INT_ARRAY,
+    VAL_DOUBLE_ARRAY,
+    VAL_MAP,
+    VAL_RECORD,
+    VAL_RECORD_ARRAY,
+    VAL_IDENT,
+} ValueKind;
+
+/* strings of up to STRING_INLINE_MAX bytes are stored in the value itself.
+ * longer ones live in a StringObject and String.size is one of the tags
+ * below instead of a length. */
+#define STRING_INLINE_MAX 15
+
+/* the object belongs to a program arena and lives as long as the program,
+ * its references are not counted. */
+#define STRING_CONSTANT 0xfe
+
+/* the object is reference counted. */
+#define STRING_HEAP 0xff
+
+typedef struct StringObject_t StringObject;
+typedef struct ArrayObject_t ArrayObject;
+typedef struct MapObject_t MapObject;
+typedef struct RecordObject_t RecordObject;
+typedef struct RecordArrayObject_t RecordArrayObject;
+
+typedef struct Value_t {
+    ValueKind kind;
+
+    union {
+        int64_t i64;
+        double f64;
+        int bool;
+        struct {
+            char data[STRING_INLINE_MAX];
+            uint8_t size;
+        } String;
+        StringObject* object; /* when String.size is STRING_CONSTANT or STRING_HEAP. */
+        ArrayObject* array;
+        MapObject* map;
+        RecordObject* record;
+        RecordArrayObject* records;
+        Span span;
+    };
+} Value;
+
+typedef enum StringShape_t {
+    STRING_FLAT,
+    STRING_ROPE,
+} StringShape;
+
+/* an immutable string longer than STRING_INLINE_MAX.
+ *
+ * a rope is the concatenation of left and right, it is only copied into one
+ * buffer the first time its bytes are needed. the buffer is published once
+ * with a compare and swap, so any number of threads may read a shared
+ * string. */
+struct StringObject_t {
+    size_t refcount;
+    StringShape shape;
+
+    /* a rope with a constant somewhere below it, whose bytes belong to the
+     * program of the literal. */
+    int borrows;
+
+    size_t size;
+
+    /* 0 until it has been computed. */
+    uint64_t hash;
+
+    union {
+        /* the bytes of a flat string, or of a rope that has been flattened. */
+        char* data;
+
+        /* links dead ropes while their children are released. */
+        StringObject* next_dead;
+    };
+
+    Value left;
+    Value right;
+
+    /* the bytes of a flat string follow the object. */
+    char chars[];
+};
+
+/* the unboxed elements of an immutable []i64 or []f64, always reference
+ * counted. */
+struct ArrayObject_t {
+    size_t refcount;
+    size_t size;
+
+    /* 64 byte aligned, so the kernels in array.c use aligned loads. */
+    union {
+        int64_t* i64;
+        double* f64;
+    };
+};
+
+/* a hash table from keys of one kind to values of one kind, see map.c. it
+ * is the only mutable object, and always reference counted. */
+struct MapObject_t {
+    size_t refcount;
+
+    ValueKind key_kind;
+    ValueKind value_kind;
+
+    /* a slot holds the payloads of a key and a value, without their kinds. */
+    size_t key_size;
+    size_t slot_size;
+
+    size_t capacity;
+    size_t count;
+
+    uint8_t* ctrl;
+    unsigned char* slots;
+};
+
+/* fields are at most this far into a struct, so an offset fits the operand
+ * of a field instruction. */
+#define RECORD_MAX_SIZE 16384
+
+typedef struct RecordField_t {
+    Span name;
+    ValueKind kind; /* VAL_INT, VAL_DOUBLE or VAL_BOOL. */
+    size_t size;
+    size_t offset;
+} RecordField;
+
+/* the layout of a struct, fixed where it is declared. fields keep their
+ * declaration order at offsets aligned to their size, like a C struct, and
+ * size is rounded up to the largest field. the type belongs to the program
+ * arena. */
+typedef struct RecordType_t {
+    Span name;
+    size_t line;
+    size_t col;
+
+    /* the module declaring it, NULL for the script itself. */
+    const char* path;
+
+    RecordField* fields;
+    size_t nfields;
+    size_t size;
+
+    /* arrays of the struct keep each field in a column of its own. */
+    int soa;
+} RecordType;
+
+/* an immutable struct value, always reference counted. */
+struct RecordObject_t {
+    size_t refcount;
+    const RecordType* type;
+
+    /* type->size bytes, 8 byte aligned. */
+    unsigned char data[];
+};
+
+/* the elements of an immutable array of structs, always reference counted.
+ * element i of an array of n keeps field f at
+ *
+ *     data + i * type->size + f.offset        normally,
+ *     data + n * f.offset + i * f.size        for a soa type,
+ *
+ * so with soa every field is a column of its own, in the same space. */
+struct RecordArrayObject_t {
+    size_t refcount;
+    const RecordType* type;
+    size_t size;
+
+    /* 64 byte aligned. */
+    unsigned char* data;
+};
+
+static inline int value_is_array(const Value* value) {
+    return value->kind == VAL_INT_ARRAY || value->kind == VAL_DOUBLE_ARRAY;
+}
+
+static inline int value_is_counted(const Value* value) {
+    return (value->kind == VAL_STRING && value->String.size == STRING_HEAP) || value_is_array(value)
+        || value->kind == VAL_MAP || value->kind == VAL_RECORD || value->kind == VAL_RECORD_ARRAY;
+}
+
+static inline void value_retain(const Value* value) {
+    if (value->kind == VAL_STRING && value->String.size == STRING_HEAP)
+        __atomic_fetch_add(&value->object->refcount, 1, __ATOMIC_RELAXED);
+    else if (value_is_array(value))
+        __atomic_fetch_add(&value->array->refcount, 1, __ATOMIC_RELAXED);
+    else if (value->kind == VAL_MAP)
+        __atomic_fetch_add(&value->map->refcount, 1, __ATOMIC_RELAXED);
+    else if (value->kind == VAL_RECORD)
+        __atomic_fetch_add(&value->record->refcount, 1, __ATOMIC_RELAXED);
+    else if (value->kind == VAL_RECORD_ARRAY)
+        __atomic_fetch_add(&value->records->refcount, 1, __ATOMIC_RELAXED);
+}
+
+void string_release(StringObject* object);
+void array_release(ArrayObject* array);
+void map_release(MapObject* map);
+void record_release(RecordObject* record);
+void record_array_release(RecordArrayObject* records);
+
+static inline void value_release(const Value* value) {
+    if (value->kind == VAL_STRING && value->String.size == STRING_HEAP)
+        string_release(value->object);
+    else if (value_is_array(value))
+        array_release(value->array);
+    else if (value->kind == VAL_MAP)
+        map_release(value->map);
+    else if (value->kind == VAL_RECORD)
+        record_release(value->record);
+    else if (value->kind == VAL_RECORD_ARRAY)
+        record_array_release(value->records);
+}
+
+/* a string literal of the program owning arena, escapes already removed.
+ * returns 0 when out of memory. */
+int string_constant(Arena* arena, const char* data, size_t size, Value* value);
+
+size_t string_size(const Value* value);
+
+/* the bytes of a string, flattening it first if it is a rope. they stay valid
+ * as long as the value does. returns NULL when out of memory. */
+const char* string_data(const Value* value);
+
+/* how many bytes string_data would copy to flatten value, 0 when it is
+ * flat already. */
+size_t string_unflattened(const Value* value);
+
+uint64_t string_hash(const Value* value);
+
+/* result is left with a new reference to lhs followed by rhs. returns 0 when
+ * out of memory. */
+int string_concat(const Value* lhs, const Value* rhs, Value* result);
+
+/* 1 if equal, 0 if not and -1 when out of memory. */
+int string_equals(const Value* lhs, const Value* rhs);
+
+/* result is left with a new reference to a string equal to value that
+ * holds no constant, so it outlives the program value came from: a copy
+ * when it is a long literal or a rope reaching one, value itself
+ * otherwise. returns 0 when out of memory. */
+int string_own(const Value* value, Value* result);
+
+#endif /* VALUE_H */